@@ -30,6 +30,7 @@
 #include <winpr/cmdline.h>
 
 #include <freerdp/addin.h>
+#include <freerdp/codec/dsp.h>
 
 #include <winpr/stream.h>
 
@@ -68,6 +69,15 @@ struct _AUDIN_CHANNEL_CALLBACK
 	 */
 	audinFormat* formats;
 	int formats_count;
+
+	/**
+	 * Compressed formats the device does not record itself are encoded by
+	 * the channel from the PCM the device records in their place
+	 */
+	BOOL encodeWave;
+	AUDIO_FORMAT format;
+	audinFormat deviceFormat;
+	FREERDP_DSP_CONTEXT* dsp_context;
 };
 
 typedef struct _AUDIN_PLUGIN AUDIN_PLUGIN;
@@ -117,6 +127,77 @@ static int audin_send_incoming_data_pdu(IWTSVirtualChannelCallback* pChannelCall
 	return callback->channel->Write(callback->channel, 1, out_data, NULL);
 }
 
+static void audin_get_audio_format(audinFormat* format, AUDIO_FORMAT* audioFormat)
+{
+	audioFormat->wFormatTag = format->wFormatTag;
+	audioFormat->nChannels = format->nChannels;
+	audioFormat->nSamplesPerSec = format->nSamplesPerSec;
+	audioFormat->nAvgBytesPerSec = format->nAvgBytesPerSec;
+	audioFormat->nBlockAlign = format->nBlockAlign;
+	audioFormat->wBitsPerSample = format->wBitsPerSample;
+	audioFormat->cbSize = format->cbSize;
+	audioFormat->data = format->data;
+}
+
+static void audin_get_pcm_format(audinFormat* format, audinFormat* pcm)
+{
+	AUDIO_FORMAT audioFormat;
+	AUDIO_FORMAT pcmFormat;
+
+	audin_get_audio_format(format, &audioFormat);
+	freerdp_dsp_get_pcm_format(&audioFormat, &pcmFormat);
+
+	ZeroMemory(pcm, sizeof(audinFormat));
+	pcm->wFormatTag = pcmFormat.wFormatTag;
+	pcm->nChannels = pcmFormat.nChannels;
+	pcm->nSamplesPerSec = pcmFormat.nSamplesPerSec;
+	pcm->nAvgBytesPerSec = pcmFormat.nAvgBytesPerSec;
+	pcm->nBlockAlign = pcmFormat.nBlockAlign;
+	pcm->wBitsPerSample = pcmFormat.wBitsPerSample;
+}
+
+static BOOL audin_format_supported(AUDIN_PLUGIN* audin, audinFormat* format)
+{
+	audinFormat pcm;
+	AUDIO_FORMAT audioFormat;
+
+	if (audin->device->FormatSupported(audin->device, format))
+		return TRUE;
+
+	audin_get_audio_format(format, &audioFormat);
+
+	if (!freerdp_dsp_supports_format(&audioFormat, TRUE))
+		return FALSE;
+
+	audin_get_pcm_format(format, &pcm);
+
+	return audin->device->FormatSupported(audin->device, &pcm);
+}
+
+/**
+ * Returns the format the device records in, for an encoded format the
+ * device delivers a codec frame per packet.
+ */
+
+static audinFormat* audin_get_device_format(AUDIN_CHANNEL_CALLBACK* callback,
+	audinFormat* format, UINT32* FramesPerPacket)
+{
+	AUDIN_PLUGIN* audin = (AUDIN_PLUGIN*) callback->plugin;
+
+	callback->encodeWave = !audin->device->FormatSupported(audin->device, format);
+
+	if (!callback->encodeWave)
+		return format;
+
+	audin_get_audio_format(format, &callback->format);
+	audin_get_pcm_format(format, &callback->deviceFormat);
+	freerdp_dsp_context_reset(callback->dsp_context);
+
+	*FramesPerPacket = freerdp_dsp_get_block_frames(&callback->format);
+
+	return &callback->deviceFormat;
+}
+
 static int audin_process_formats(IWTSVirtualChannelCallback* pChannelCallback, wStream* s)
 {
 	AUDIN_CHANNEL_CALLBACK* callback = (AUDIN_CHANNEL_CALLBACK*) pChannelCallback;
@@ -151,7 +232,7 @@ static int audin_process_formats(IWTSVirtualChannelCallback* pChannelCallback, w
 		Stream_Read_UINT16(s, format.wFormatTag);
 		Stream_Read_UINT16(s, format.nChannels);
 		Stream_Read_UINT32(s, format.nSamplesPerSec);
-		Stream_Seek_UINT32(s); /* nAvgBytesPerSec */
+		Stream_Read_UINT32(s, format.nAvgBytesPerSec);
 		Stream_Read_UINT16(s, format.nBlockAlign);
 		Stream_Read_UINT16(s, format.wBitsPerSample);
 		Stream_Read_UINT16(s, format.cbSize);
@@ -169,7 +250,7 @@ static int audin_process_formats(IWTSVirtualChannelCallback* pChannelCallback, w
 			continue;
 		if (audin->fixed_rate > 0 && audin->fixed_rate != format.nSamplesPerSec)
 			continue;
-		if (audin->device && audin->device->FormatSupported(audin->device, &format))
+		if (audin->device && audin_format_supported(audin, &format))
 		{
 			DEBUG_DVC("format ok");
 
@@ -232,14 +313,41 @@ static BOOL audin_receive_wave_data(BYTE* data, int size, void* user_data)
 	wStream* out;
 	AUDIN_CHANNEL_CALLBACK* callback = (AUDIN_CHANNEL_CALLBACK*) user_data;
 
+	out = Stream_New(NULL, size + 1);
+
+	if (!out)
+		return FALSE;
+
+	Stream_Write_UINT8(out, MSG_SNDIN_DATA);
+
+	if (callback->encodeWave)
+	{
+		if (!freerdp_dsp_encode(callback->dsp_context, &callback->format, data, size, out))
+		{
+			Stream_Free(out, TRUE);
+			return FALSE;
+		}
+
+		/* the codec holds back a partial frame until more data is recorded */
+		if (Stream_GetPosition(out) <= 1)
+		{
+			Stream_Free(out, TRUE);
+			return TRUE;
+		}
+	}
+	else
+	{
+		Stream_Write(out, data, size);
+	}
+
 	error = audin_send_incoming_data_pdu((IWTSVirtualChannelCallback*) callback);
 
 	if (error != 0)
+	{
+		Stream_Free(out, TRUE);
 		return FALSE;
+	}
 
-	out = Stream_New(NULL, size + 1);
-	Stream_Write_UINT8(out, MSG_SNDIN_DATA);
-	Stream_Write(out, data, size);
 	error = callback->channel->Write(callback->channel, (UINT32) Stream_GetPosition(out), Stream_Buffer(out), NULL);
 	Stream_Free(out, TRUE);
 
@@ -270,6 +378,7 @@ static int audin_process_open(IWTSVirtualChannelCallback* pChannelCallback, wStr
 	format = &callback->formats[initialFormat];
 	if (audin->device)
 	{
+		format = audin_get_device_format(callback, format, &FramesPerPacket);
 		IFCALL(audin->device->SetFormat, audin->device, format, FramesPerPacket);
 		IFCALL(audin->device->Open, audin->device, audin_receive_wave_data, callback);
 	}
@@ -286,6 +395,7 @@ static int audin_process_format_change(IWTSVirtualChannelCallback* pChannelCallb
 	AUDIN_PLUGIN * audin = (AUDIN_PLUGIN*) callback->plugin;
 	UINT32 NewFormat;
 	audinFormat* format;
+	UINT32 FramesPerPacket = 0;
 
 	Stream_Read_UINT32(s, NewFormat);
 
@@ -303,7 +413,8 @@ static int audin_process_format_change(IWTSVirtualChannelCallback* pChannelCallb
 	if (audin->device)
 	{
 		IFCALL(audin->device->Close, audin->device);
-		IFCALL(audin->device->SetFormat, audin->device, format, 0);
+		format = audin_get_device_format(callback, format, &FramesPerPacket);
+		IFCALL(audin->device->SetFormat, audin->device, format, FramesPerPacket);
 		IFCALL(audin->device->Open, audin->device, audin_receive_wave_data, callback);
 	}
 
@@ -358,6 +469,7 @@ static int audin_on_close(IWTSVirtualChannelCallback* pChannelCallback)
 	if (audin->device)
 		IFCALL(audin->device->Close, audin->device);
 
+	freerdp_dsp_context_free(callback->dsp_context);
 	free(callback->formats);
 	free(callback);
 
@@ -376,6 +488,14 @@ static int audin_on_new_channel_connection(IWTSListenerCallback* pListenerCallba
 	callback = (AUDIN_CHANNEL_CALLBACK*) malloc(sizeof(AUDIN_CHANNEL_CALLBACK));
 	ZeroMemory(callback, sizeof(AUDIN_CHANNEL_CALLBACK));
 
+	callback->dsp_context = freerdp_dsp_context_new();
+
+	if (!callback->dsp_context)
+	{
+		free(callback);
+		return 1;
+	}
+
 	callback->iface.OnDataReceived = audin_on_data_received;
 	callback->iface.OnClose = audin_on_close;
 	callback->plugin = listener_callback->plugin;
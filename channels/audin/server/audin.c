@@ -59,6 +59,7 @@ typedef struct _audin_server
 	DWORD SessionId;
 
 	FREERDP_DSP_CONTEXT* dsp_context;
+	wStream* decoded;
 
 } audin_server;
 
@@ -70,6 +71,7 @@ static void audin_server_select_format(audin_server_context* context, int client
 		return;
 
 	context->selected_client_format = client_format_index;
+	freerdp_dsp_context_reset(audin->dsp_context);
 
 	if (audin->opened)
 	{
@@ -118,6 +120,10 @@ static void audin_server_send_formats(audin_server* audin, wStream* s)
 			audin->context.server_formats[i].nChannels *
 			audin->context.server_formats[i].wBitsPerSample / 8;
 
+		/* compressed formats carry their byte rate */
+		if (!audin->context.server_formats[i].wBitsPerSample)
+			nAvgBytesPerSec = audin->context.server_formats[i].nAvgBytesPerSec;
+
 		Stream_EnsureRemainingCapacity(s, 18);
 
 		Stream_Write_UINT16(s, audin->context.server_formats[i].wFormatTag);
@@ -168,7 +174,7 @@ static BOOL audin_server_recv_formats(audin_server* audin, wStream* s, UINT32 le
 		Stream_Read_UINT16(s, audin->context.client_formats[i].wFormatTag);
 		Stream_Read_UINT16(s, audin->context.client_formats[i].nChannels);
 		Stream_Read_UINT32(s, audin->context.client_formats[i].nSamplesPerSec);
-		Stream_Seek_UINT32(s); /* nAvgBytesPerSec */
+		Stream_Read_UINT32(s, audin->context.client_formats[i].nAvgBytesPerSec);
 		Stream_Read_UINT16(s, audin->context.client_formats[i].nBlockAlign);
 		Stream_Read_UINT16(s, audin->context.client_formats[i].wBitsPerSample);
 		Stream_Read_UINT16(s, audin->context.client_formats[i].cbSize);
@@ -241,21 +247,15 @@ static BOOL audin_server_recv_data(audin_server* audin, wStream* s, UINT32 lengt
 
 	format = &audin->context.client_formats[audin->context.selected_client_format];
 
-	if (format->wFormatTag == WAVE_FORMAT_ADPCM)
-	{
-		audin->dsp_context->decode_ms_adpcm(audin->dsp_context,
-			Stream_Pointer(s), length, format->nChannels, format->nBlockAlign);
-		size = audin->dsp_context->adpcm_size;
-		src = audin->dsp_context->adpcm_buffer;
-		sbytes_per_sample = 2;
-		sbytes_per_frame = format->nChannels * 2;
-	}
-	else if (format->wFormatTag == WAVE_FORMAT_DVI_ADPCM)
+	if (freerdp_dsp_supports_format(format, FALSE))
 	{
-		audin->dsp_context->decode_ima_adpcm(audin->dsp_context,
-			Stream_Pointer(s), length, format->nChannels, format->nBlockAlign);
-		size = audin->dsp_context->adpcm_size;
-		src = audin->dsp_context->adpcm_buffer;
+		Stream_SetPosition(audin->decoded, 0);
+
+		if (!freerdp_dsp_decode(audin->dsp_context, format, Stream_Pointer(s), length, audin->decoded))
+			return FALSE;
+
+		size = (int) Stream_GetPosition(audin->decoded);
+		src = Stream_Buffer(audin->decoded);
 		sbytes_per_sample = 2;
 		sbytes_per_frame = format->nChannels * 2;
 	}
@@ -475,6 +475,7 @@ audin_server_context* audin_server_context_new(HANDLE vcm)
 	audin->context.Close = audin_server_close;
 
 	audin->dsp_context = freerdp_dsp_context_new();
+	audin->decoded = Stream_New(NULL, 4096);
 
 	return (audin_server_context*) audin;
 }
@@ -488,6 +489,9 @@ void audin_server_context_free(audin_server_context* context)
 	if (audin->dsp_context)
 		freerdp_dsp_context_free(audin->dsp_context);
 
+	if (audin->decoded)
+		Stream_Free(audin->decoded, TRUE);
+
 	if (audin->context.client_formats)
 		free(audin->context.client_formats);
 
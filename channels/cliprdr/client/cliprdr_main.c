@@ -248,20 +248,12 @@ static int cliprdr_process_filecontents_request(cliprdrPlugin* cliprdr, wStream*
 	if (!context->custom)
 		return -1;
 
-	if (Stream_GetRemainingLength(s) < 28)
-		return -1;
-
 	request.msgType = CB_FILECONTENTS_REQUEST;
 	request.msgFlags = flags;
 	request.dataLen = length;
 
-	Stream_Read_UINT32(s, request.streamId); /* streamId (4 bytes) */
-	Stream_Read_UINT32(s, request.listIndex); /* listIndex (4 bytes) */
-	Stream_Read_UINT32(s, request.dwFlags); /* dwFlags (4 bytes) */
-	Stream_Read_UINT32(s, request.nPositionLow); /* nPositionLow (4 bytes) */
-	Stream_Read_UINT32(s, request.nPositionHigh); /* nPositionHigh (4 bytes) */
-	Stream_Read_UINT32(s, request.cbRequested); /* cbRequested (4 bytes) */
-	Stream_Read_UINT32(s, request.clipDataId); /* clipDataId (4 bytes) */
+	if (!cliprdr_read_file_contents_request(s, &request))
+		return -1;
 
 	if (context->ServerFileContentsRequest)
 		context->ServerFileContentsRequest(context, &request);
@@ -279,17 +271,12 @@ static int cliprdr_process_filecontents_response(cliprdrPlugin* cliprdr, wStream
 	if (!context->custom)
 		return -1;
 		
-	if (Stream_GetRemainingLength(s) < 4)
-		return -1;
-
 	response.msgType = CB_FILECONTENTS_RESPONSE;
 	response.msgFlags = flags;
 	response.dataLen = length;
 
-	Stream_Read_UINT32(s, response.streamId); /* streamId (4 bytes) */
-	
-	response.cbRequested = length - 4;
-	response.requestedData = Stream_Pointer(s); /* requestedFileContentsData */
+	if (!cliprdr_read_file_contents_response(s, &response))
+		return -1;
 
 	if (context->ServerFileContentsResponse)
 		context->ServerFileContentsResponse(context, &response);
@@ -666,15 +653,9 @@ int cliprdr_client_file_contents_request(CliprdrClientContext* context, CLIPRDR_
 	wStream* s;
 	cliprdrPlugin* cliprdr = (cliprdrPlugin*) context->handle;
 
-	s = cliprdr_packet_new(CB_FILECONTENTS_REQUEST, 0, 28);
+	s = cliprdr_packet_new(CB_FILECONTENTS_REQUEST, 0, CLIPRDR_FILE_CONTENTS_REQUEST_LENGTH);
 
-	Stream_Write_UINT32(s, fileContentsRequest->streamId); /* streamId (4 bytes) */
-	Stream_Write_UINT32(s, fileContentsRequest->listIndex); /* listIndex (4 bytes) */
-	Stream_Write_UINT32(s, fileContentsRequest->dwFlags); /* dwFlags (4 bytes) */
-	Stream_Write_UINT32(s, fileContentsRequest->nPositionLow); /* nPositionLow (4 bytes) */
-	Stream_Write_UINT32(s, fileContentsRequest->nPositionHigh); /* nPositionHigh (4 bytes) */
-	Stream_Write_UINT32(s, fileContentsRequest->cbRequested); /* cbRequested (4 bytes) */
-	Stream_Write_UINT32(s, fileContentsRequest->clipDataId); /* clipDataId (4 bytes) */
+	cliprdr_write_file_contents_request(s, fileContentsRequest);
 
 	WLog_Print(cliprdr->log, WLOG_DEBUG, "ClientFileContentsRequest: streamId: 0x%04X",
 		fileContentsRequest->streamId);
@@ -692,18 +673,14 @@ int cliprdr_client_file_contents_response(CliprdrClientContext* context, CLIPRDR
 	if (fileContentsResponse->dwFlags & FILECONTENTS_SIZE)
 		fileContentsResponse->cbRequested = sizeof(UINT64);
 
-	s = cliprdr_packet_new(CB_FILECONTENTS_REQUEST, 0,
-			4 + fileContentsResponse->cbRequested);
-
-	Stream_Write_UINT32(s, fileContentsResponse->streamId); /* streamId (4 bytes) */
+	/* responses from callers that predate the flags are taken as successful */
+	if (!(fileContentsResponse->msgFlags & CB_RESPONSE_FAIL))
+		fileContentsResponse->msgFlags = CB_RESPONSE_OK;
 
-	/**
-	 * requestedFileContentsData:
-	 * FILECONTENTS_SIZE: file size as UINT64
-	 * FILECONTENTS_RANGE: file data from requested range
-	 */
+	s = cliprdr_packet_new(CB_FILECONTENTS_RESPONSE, fileContentsResponse->msgFlags,
+			CLIPRDR_FILE_CONTENTS_RESPONSE_LENGTH + fileContentsResponse->cbRequested);
 
-	Stream_Write(s, fileContentsResponse->requestedData, fileContentsResponse->cbRequested);
+	cliprdr_write_file_contents_response(s, fileContentsResponse);
 
 	WLog_Print(cliprdr->log, WLOG_DEBUG, "ClientFileContentsResponse: streamId: 0x%04X",
 		fileContentsResponse->streamId);
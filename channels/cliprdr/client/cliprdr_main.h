@@ -27,6 +27,8 @@
 #include <freerdp/addin.h>
 #include <freerdp/channels/log.h>
 
+#include "../cliprdr_common.h"
+
 #define TAG CHANNELS_TAG("cliprdr.client")
 
 struct cliprdr_plugin
@@ -0,0 +1,547 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+#include <winpr/collections.h>
+
+#include <freerdp/utils/cliprdr.h>
+
+#include "../../cliprdr_common.h"
+
+/**
+ * Clipboard file transfer over a simulated link: the client side requests
+ * the files of a FileGroupDescriptorW, the server side answers from files in
+ * memory, and every request and response crosses the link as an encoded
+ * PDU. Requests are small and only delayed, responses are also limited by
+ * the bandwidth of the link, which sends one after the other. Time is
+ * simulated so that the throughput of the transfer can be compared to the
+ * bandwidth of the link and to a transfer in lockstep.
+ */
+
+#define TEST_FILE_COUNT		5
+#define TEST_FILE_LARGE		0
+#define TEST_FILE_EMPTY		1
+#define TEST_FILE_BYTE		2
+#define TEST_FILE_NO_SIZE	3
+#define TEST_FILE_MISSING	4
+
+struct _TEST_CLIPRDR_PDU
+{
+	UINT64 time;
+	wStream* s;
+};
+typedef struct _TEST_CLIPRDR_PDU TEST_CLIPRDR_PDU;
+
+struct _TEST_CLIPRDR_FILE
+{
+	BYTE* data;
+	UINT64 size;
+	BOOL sizeKnown;
+};
+typedef struct _TEST_CLIPRDR_FILE TEST_CLIPRDR_FILE;
+
+struct _TEST_CLIPRDR_LINK
+{
+	/* one way, in microseconds */
+	UINT64 latency;
+
+	/* bytes per second from the server to the client */
+	UINT64 bandwidth;
+
+	/* the largest response the server sends, 0 for no limit */
+	UINT32 maxResponse;
+
+	UINT64 now;
+	UINT64 busyUntil;
+	wQueue* toServer;
+	wQueue* toClient;
+
+	TEST_CLIPRDR_FILE* files;
+	BYTE* destination;
+	UINT64 destinationSize;
+	UINT32 errors;
+	UINT64 responseBytes;
+};
+typedef struct _TEST_CLIPRDR_LINK TEST_CLIPRDR_LINK;
+
+struct _TEST_CLIPRDR_RESULT
+{
+	double throughput;
+	UINT32 chunkSize;
+	UINT32 requests;
+	UINT32 peakOutstanding;
+};
+typedef struct _TEST_CLIPRDR_RESULT TEST_CLIPRDR_RESULT;
+
+static UINT32 g_Seed = 1;
+
+static UINT32 test_cliprdr_random(void)
+{
+	g_Seed = g_Seed * 1103515245 + 12345;
+	return (g_Seed >> 16) & 0x7FFF;
+}
+
+static BOOL test_cliprdr_send(wQueue* queue, UINT64 time, wStream* s)
+{
+	TEST_CLIPRDR_PDU* pdu;
+
+	pdu = (TEST_CLIPRDR_PDU*) calloc(1, sizeof(TEST_CLIPRDR_PDU));
+
+	if (!pdu)
+		return FALSE;
+
+	/* the header is completed as the channel does before sending */
+	Stream_SealLength(s);
+	Stream_SetPosition(s, 4);
+	Stream_Write_UINT32(s, (UINT32) (Stream_Length(s) - CLIPRDR_HEADER_LENGTH));
+	Stream_SetPosition(s, 0);
+
+	pdu->time = time;
+	pdu->s = s;
+
+	return Queue_Enqueue(queue, pdu);
+}
+
+static wStream* test_cliprdr_packet_new(UINT16 msgType, UINT16 msgFlags, UINT32 dataLen)
+{
+	wStream* s;
+
+	s = Stream_New(NULL, dataLen + CLIPRDR_HEADER_LENGTH);
+
+	if (!s)
+		return NULL;
+
+	Stream_Write_UINT16(s, msgType);
+	Stream_Write_UINT16(s, msgFlags);
+	Stream_Seek(s, 4);
+
+	return s;
+}
+
+/* client: sends a FileContents request */
+static int test_cliprdr_client_request(CLIPRDR_FILE_TRANSFER* transfer, CLIPRDR_FILE_CONTENTS_REQUEST* request)
+{
+	wStream* s;
+	TEST_CLIPRDR_LINK* link = (TEST_CLIPRDR_LINK*) transfer->custom;
+
+	s = test_cliprdr_packet_new(CB_FILECONTENTS_REQUEST, 0, CLIPRDR_FILE_CONTENTS_REQUEST_LENGTH);
+
+	if (!s)
+		return -1;
+
+	cliprdr_write_file_contents_request(s, request);
+
+	return test_cliprdr_send(link->toServer, link->now + link->latency, s) ? 1 : -1;
+}
+
+/* client: writes the data where it belongs in the destination */
+static int test_cliprdr_client_write(CLIPRDR_FILE_TRANSFER* transfer, UINT64 offset, const BYTE* data, UINT32 length)
+{
+	TEST_CLIPRDR_LINK* link = (TEST_CLIPRDR_LINK*) transfer->custom;
+
+	if ((offset > link->destinationSize) || (length > link->destinationSize - offset))
+	{
+		link->errors++;
+		return -1;
+	}
+
+	CopyMemory(&link->destination[offset], data, length);
+
+	return 1;
+}
+
+/* server: answers a FileContents request from the files in memory */
+static BOOL test_cliprdr_server_receive(TEST_CLIPRDR_LINK* link, wStream* s)
+{
+	UINT64 size;
+	UINT64 offset;
+	UINT64 duration;
+	BYTE sizeData[8];
+	wStream* response_s;
+	CLIPRDR_HEADER header;
+	TEST_CLIPRDR_FILE* file;
+	CLIPRDR_FILE_CONTENTS_REQUEST request;
+	CLIPRDR_FILE_CONTENTS_RESPONSE response;
+
+	Stream_Read_UINT16(s, header.msgType);
+	Stream_Read_UINT16(s, header.msgFlags);
+	Stream_Read_UINT32(s, header.dataLen);
+
+	if ((header.msgType != CB_FILECONTENTS_REQUEST) || !cliprdr_read_file_contents_request(s, &request))
+		return FALSE;
+
+	ZeroMemory(&response, sizeof(CLIPRDR_FILE_CONTENTS_RESPONSE));
+	response.streamId = request.streamId;
+	response.dwFlags = request.dwFlags;
+	response.msgFlags = CB_RESPONSE_OK;
+
+	file = (request.listIndex < TEST_FILE_COUNT) ? &link->files[request.listIndex] : NULL;
+
+	if (!file || !file->data)
+	{
+		response.msgFlags = CB_RESPONSE_FAIL;
+	}
+	else if (request.dwFlags & FILECONTENTS_SIZE)
+	{
+		size = file->size;
+		CopyMemory(sizeData, &size, sizeof(UINT64));
+		response.cbRequested = sizeof(UINT64);
+		response.requestedData = sizeData;
+	}
+	else
+	{
+		offset = (((UINT64) request.nPositionHigh) << 32) | request.nPositionLow;
+
+		if (offset > file->size)
+			offset = file->size;
+
+		response.cbRequested = request.cbRequested;
+
+		if (response.cbRequested > file->size - offset)
+			response.cbRequested = (UINT32) (file->size - offset);
+
+		if (link->maxResponse && (response.cbRequested > link->maxResponse))
+			response.cbRequested = link->maxResponse;
+
+		response.requestedData = &file->data[offset];
+	}
+
+	response_s = test_cliprdr_packet_new(CB_FILECONTENTS_RESPONSE, response.msgFlags,
+			CLIPRDR_FILE_CONTENTS_RESPONSE_LENGTH + response.cbRequested);
+
+	if (!response_s)
+		return FALSE;
+
+	cliprdr_write_file_contents_response(response_s, &response);
+
+	/* the link sends one response after the other */
+	if (link->busyUntil < link->now)
+		link->busyUntil = link->now;
+
+	duration = Stream_GetPosition(response_s) * 1000000 / link->bandwidth;
+	link->busyUntil += duration;
+	link->responseBytes += Stream_GetPosition(response_s);
+
+	return test_cliprdr_send(link->toClient, link->busyUntil + link->latency, response_s);
+}
+
+/* client: hands a FileContents response to the transfer */
+static int test_cliprdr_client_receive(TEST_CLIPRDR_LINK* link, CLIPRDR_FILE_TRANSFER* transfer, wStream* s)
+{
+	CLIPRDR_FILE_CONTENTS_RESPONSE response;
+
+	ZeroMemory(&response, sizeof(CLIPRDR_FILE_CONTENTS_RESPONSE));
+
+	Stream_Read_UINT16(s, response.msgType);
+	Stream_Read_UINT16(s, response.msgFlags);
+	Stream_Read_UINT32(s, response.dataLen);
+
+	if ((response.msgType != CB_FILECONTENTS_RESPONSE) || !cliprdr_read_file_contents_response(s, &response))
+	{
+		link->errors++;
+		return -1;
+	}
+
+	return cliprdr_file_transfer_response(transfer, &response, (UINT32) (link->now / 1000));
+}
+
+/* delivers the PDUs in the order they arrive until the link is idle */
+static BOOL test_cliprdr_run(TEST_CLIPRDR_LINK* link, CLIPRDR_FILE_TRANSFER* transfer)
+{
+	wQueue* queue;
+	TEST_CLIPRDR_PDU* pdu;
+	TEST_CLIPRDR_PDU* toServer;
+	TEST_CLIPRDR_PDU* toClient;
+
+	while (Queue_Count(link->toServer) || Queue_Count(link->toClient))
+	{
+		toServer = (TEST_CLIPRDR_PDU*) Queue_Peek(link->toServer);
+		toClient = (TEST_CLIPRDR_PDU*) Queue_Peek(link->toClient);
+
+		if (toServer && (!toClient || (toServer->time <= toClient->time)))
+			queue = link->toServer;
+		else
+			queue = link->toClient;
+
+		pdu = (TEST_CLIPRDR_PDU*) Queue_Dequeue(queue);
+
+		if (pdu->time > link->now)
+			link->now = pdu->time;
+
+		if (queue == link->toServer)
+		{
+			if (!test_cliprdr_server_receive(link, pdu->s))
+				link->errors++;
+		}
+		else
+		{
+			test_cliprdr_client_receive(link, transfer, pdu->s);
+		}
+
+		Stream_Free(pdu->s, TRUE);
+		free(pdu);
+
+		if ((transfer->state != CLIPRDR_FILE_TRANSFER_SIZE) && (transfer->state != CLIPRDR_FILE_TRANSFER_DATA))
+			break;
+	}
+
+	return (transfer->state == CLIPRDR_FILE_TRANSFER_DONE);
+}
+
+/* drops whatever is still on the link, as after a failed transfer */
+static void test_cliprdr_drain(TEST_CLIPRDR_LINK* link, CLIPRDR_FILE_TRANSFER* transfer)
+{
+	TEST_CLIPRDR_PDU* pdu;
+
+	while ((pdu = (TEST_CLIPRDR_PDU*) Queue_Dequeue(link->toServer)))
+	{
+		if (pdu->time > link->now)
+			link->now = pdu->time;
+
+		test_cliprdr_server_receive(link, pdu->s);
+		Stream_Free(pdu->s, TRUE);
+		free(pdu);
+	}
+
+	while ((pdu = (TEST_CLIPRDR_PDU*) Queue_Dequeue(link->toClient)))
+	{
+		/* responses to an earlier transfer must be ignored */
+		if (test_cliprdr_client_receive(link, transfer, pdu->s) != 0)
+			link->errors++;
+
+		Stream_Free(pdu->s, TRUE);
+		free(pdu);
+	}
+}
+
+static void test_cliprdr_descriptor(TEST_CLIPRDR_FILE* file, CLIPRDR_FILEDESCRIPTOR* descriptor, const char* name)
+{
+	int index;
+
+	ZeroMemory(descriptor, sizeof(CLIPRDR_FILEDESCRIPTOR));
+
+	descriptor->flags = FD_ATTRIBUTES | FD_SHOWPROGRESSUI;
+	descriptor->fileAttributes = FILE_ATTRIBUTE_NORMAL;
+
+	if (file->sizeKnown)
+	{
+		descriptor->flags |= FD_FILESIZE;
+		descriptor->fileSizeHigh = (UINT32) (file->size >> 32);
+		descriptor->fileSizeLow = (UINT32) (file->size & 0xFFFFFFFF);
+	}
+
+	for (index = 0; name[index] && (index < 259); index++)
+		descriptor->fileName[index * 2] = name[index];
+}
+
+/**
+ * The file list goes through FileGroupDescriptorW and back, then every file
+ * is copied. The destination is cleared so that only the writes of the
+ * transfer can fill it.
+ */
+
+static BOOL test_cliprdr_copy(TEST_CLIPRDR_LINK* link, CLIPRDR_FILE_TRANSFER* transfer,
+		TEST_CLIPRDR_RESULT* result)
+{
+	UINT32 index;
+	BYTE* data = NULL;
+	UINT32 length = 0;
+	UINT32 count = 0;
+	UINT64 start;
+	BOOL done;
+	BOOL rc = FALSE;
+	CLIPRDR_FILEDESCRIPTOR descriptors[TEST_FILE_COUNT];
+	CLIPRDR_FILEDESCRIPTOR* parsed = NULL;
+	static const char* names[TEST_FILE_COUNT] = { "large.bin", "empty.txt", "byte.txt", "nosize.dat", "missing.dat" };
+
+	ZeroMemory(result, sizeof(TEST_CLIPRDR_RESULT));
+
+	for (index = 0; index < TEST_FILE_COUNT; index++)
+		test_cliprdr_descriptor(&link->files[index], &descriptors[index], names[index]);
+
+	if (cliprdr_serialize_file_list(descriptors, TEST_FILE_COUNT, &data, &length) < 0)
+		return FALSE;
+
+	if ((length != 4 + TEST_FILE_COUNT * CLIPRDR_FILEDESCRIPTOR_SIZE) ||
+			(cliprdr_parse_file_list(data, length, &parsed, &count) < 0) || (count != TEST_FILE_COUNT) ||
+			(memcmp(parsed, descriptors, sizeof(descriptors)) != 0))
+		goto out;
+
+	/* a list that is cut short is refused */
+	free(parsed);
+	parsed = NULL;
+
+	if (cliprdr_parse_file_list(data, length - 1, &parsed, &count) == 0)
+		goto out;
+
+	if (cliprdr_parse_file_list(data, length, &parsed, &count) < 0)
+		goto out;
+
+	for (index = 0; index < count; index++)
+	{
+		TEST_CLIPRDR_FILE* file = &link->files[index];
+
+		link->destinationSize = file->size;
+		ZeroMemory(link->destination, (size_t) file->size);
+
+		start = link->now;
+
+		if (cliprdr_file_transfer_start(transfer, index, 0, &parsed[index], (UINT32) (link->now / 1000)) < 0)
+			done = FALSE;
+		else
+			done = test_cliprdr_run(link, transfer);
+
+		if (index == TEST_FILE_MISSING)
+		{
+			/* the server refused, the transfer must end and forget its requests */
+			if (done || (transfer->state != CLIPRDR_FILE_TRANSFER_FAILED))
+				goto out;
+
+			test_cliprdr_drain(link, transfer);
+			continue;
+		}
+
+		if (!done || (transfer->received != file->size) ||
+				(file->size && (memcmp(link->destination, file->data, (size_t) file->size) != 0)))
+		{
+			printf("cliprdr: file %u was not copied (state %d, %llu of %llu bytes)\n", index, transfer->state,
+					(unsigned long long) transfer->received, (unsigned long long) file->size);
+			goto out;
+		}
+
+		if (index == TEST_FILE_LARGE)
+		{
+			result->throughput = ((double) file->size) * 1000000.0 / (double) (link->now - start);
+			result->chunkSize = transfer->chunkSize;
+			result->requests = transfer->requests;
+			result->peakOutstanding = transfer->peakOutstanding;
+		}
+	}
+
+	rc = !link->errors && !Queue_Count(link->toServer) && !Queue_Count(link->toClient);
+
+out:
+	free(parsed);
+	free(data);
+	return rc;
+}
+
+static BOOL test_cliprdr_link(const char* name, UINT64 latency, UINT64 bandwidth, UINT64 size,
+		UINT32 maxResponse, BOOL lockstep, TEST_CLIPRDR_RESULT* result)
+{
+	UINT64 index;
+	BOOL rc = FALSE;
+	TEST_CLIPRDR_LINK link;
+	CLIPRDR_FILE_TRANSFER* transfer;
+	TEST_CLIPRDR_FILE files[TEST_FILE_COUNT];
+
+	ZeroMemory(&link, sizeof(TEST_CLIPRDR_LINK));
+	ZeroMemory(files, sizeof(files));
+
+	g_Seed = 1;
+
+	link.latency = latency;
+	link.bandwidth = bandwidth;
+	link.maxResponse = maxResponse;
+	link.files = files;
+
+	files[TEST_FILE_LARGE].size = size;
+	files[TEST_FILE_EMPTY].size = 0;
+	files[TEST_FILE_BYTE].size = 1;
+	files[TEST_FILE_NO_SIZE].size = 100003;
+	files[TEST_FILE_MISSING].size = 10;
+
+	for (index = 0; index < TEST_FILE_COUNT; index++)
+	{
+		files[index].sizeKnown = (index != TEST_FILE_NO_SIZE);
+
+		if (index == TEST_FILE_MISSING)
+			continue;
+
+		files[index].data = (BYTE*) malloc((size_t) files[index].size + 1);
+
+		if (!files[index].data)
+			goto out;
+	}
+
+	for (index = 0; index < size; index++)
+		files[TEST_FILE_LARGE].data[index] = (BYTE) test_cliprdr_random();
+
+	for (index = 0; index < files[TEST_FILE_NO_SIZE].size; index++)
+		files[TEST_FILE_NO_SIZE].data[index] = (BYTE) test_cliprdr_random();
+
+	files[TEST_FILE_BYTE].data[0] = 0x5A;
+
+	link.destination = (BYTE*) malloc((size_t) size + 1);
+	link.toServer = Queue_New(TRUE, -1, -1);
+	link.toClient = Queue_New(TRUE, -1, -1);
+	transfer = cliprdr_file_transfer_new();
+
+	if (!link.destination || !link.toServer || !link.toClient || !transfer)
+		goto out;
+
+	transfer->custom = &link;
+	transfer->Request = test_cliprdr_client_request;
+	transfer->Write = test_cliprdr_client_write;
+
+	/* one request at a time of a fixed size */
+	if (lockstep)
+	{
+		transfer->maxRequests = 1;
+		transfer->minChunkSize = transfer->maxChunkSize = transfer->chunkSize;
+	}
+
+	rc = test_cliprdr_copy(&link, transfer, result);
+
+	printf("%-6s %s: %6.2f MB/s of %6.2f MB/s, chunk %7u, %5u requests, %u in flight\n",
+			name, lockstep ? "lockstep " : "pipelined", result->throughput / 1000000.0,
+			bandwidth / 1000000.0, result->chunkSize, result->requests, result->peakOutstanding);
+
+	test_cliprdr_drain(&link, transfer);
+	cliprdr_file_transfer_free(transfer);
+
+out:
+	Queue_Free(link.toServer);
+	Queue_Free(link.toClient);
+	free(link.destination);
+
+	for (index = 0; index < TEST_FILE_COUNT; index++)
+		free(files[index].data);
+
+	return rc;
+}
+
+int TestCliprdrFileTransfer(int argc, char* argv[])
+{
+	TEST_CLIPRDR_RESULT pipelined;
+	TEST_CLIPRDR_RESULT lockstep;
+
+	/* 10 MB/s with 40 ms each way */
+	if (!test_cliprdr_link("wan", 40000, 10000000, 32 * 1024 * 1024, 0, FALSE, &pipelined) ||
+			!test_cliprdr_link("wan", 40000, 10000000, 32 * 1024 * 1024, 0, TRUE, &lockstep))
+		return -1;
+
+	if ((pipelined.throughput < 0.9 * 10000000) || (pipelined.throughput < 5 * lockstep.throughput) ||
+			(pipelined.peakOutstanding < 2) || (pipelined.chunkSize <= CLIPRDR_FILE_TRANSFER_START_CHUNK))
+		return -1;
+
+	/* 100 MB/s with 1 ms each way, the chunks grow to the largest */
+	if (!test_cliprdr_link("lan", 1000, 100000000, 64 * 1024 * 1024, 0, FALSE, &pipelined))
+		return -1;
+
+	if ((pipelined.throughput < 0.9 * 100000000) || (pipelined.chunkSize != CLIPRDR_FILE_TRANSFER_MAX_CHUNK))
+		return -1;
+
+	/* 256 kB/s with 100 ms each way, the chunks shrink to keep requests answered in time */
+	if (!test_cliprdr_link("slow", 100000, 256000, 4 * 1024 * 1024, 0, FALSE, &pipelined))
+		return -1;
+
+	if ((pipelined.throughput < 0.9 * 256000) || (pipelined.chunkSize != CLIPRDR_FILE_TRANSFER_MIN_CHUNK))
+		return -1;
+
+	/* a server that answers with less than requested */
+	if (!test_cliprdr_link("short", 40000, 10000000, 8 * 1024 * 1024 + 17, 24000, FALSE, &pipelined))
+		return -1;
+
+	return 0;
+}
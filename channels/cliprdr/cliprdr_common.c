@@ -0,0 +1,83 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Clipboard Virtual Channel
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "cliprdr_common.h"
+
+BOOL cliprdr_read_file_contents_request(wStream* s, CLIPRDR_FILE_CONTENTS_REQUEST* request)
+{
+	if (Stream_GetRemainingLength(s) < CLIPRDR_FILE_CONTENTS_REQUEST_LENGTH)
+		return FALSE;
+
+	Stream_Read_UINT32(s, request->streamId); /* streamId (4 bytes) */
+	Stream_Read_UINT32(s, request->listIndex); /* listIndex (4 bytes) */
+	Stream_Read_UINT32(s, request->dwFlags); /* dwFlags (4 bytes) */
+	Stream_Read_UINT32(s, request->nPositionLow); /* nPositionLow (4 bytes) */
+	Stream_Read_UINT32(s, request->nPositionHigh); /* nPositionHigh (4 bytes) */
+	Stream_Read_UINT32(s, request->cbRequested); /* cbRequested (4 bytes) */
+	Stream_Read_UINT32(s, request->clipDataId); /* clipDataId (4 bytes) */
+
+	return TRUE;
+}
+
+void cliprdr_write_file_contents_request(wStream* s, CLIPRDR_FILE_CONTENTS_REQUEST* request)
+{
+	Stream_Write_UINT32(s, request->streamId); /* streamId (4 bytes) */
+	Stream_Write_UINT32(s, request->listIndex); /* listIndex (4 bytes) */
+	Stream_Write_UINT32(s, request->dwFlags); /* dwFlags (4 bytes) */
+	Stream_Write_UINT32(s, request->nPositionLow); /* nPositionLow (4 bytes) */
+	Stream_Write_UINT32(s, request->nPositionHigh); /* nPositionHigh (4 bytes) */
+	Stream_Write_UINT32(s, request->cbRequested); /* cbRequested (4 bytes) */
+	Stream_Write_UINT32(s, request->clipDataId); /* clipDataId (4 bytes) */
+}
+
+/**
+ * The data length comes from the header, response->dataLen must be set.
+ * The requested data points into the stream, it is not copied.
+ */
+
+BOOL cliprdr_read_file_contents_response(wStream* s, CLIPRDR_FILE_CONTENTS_RESPONSE* response)
+{
+	if ((response->dataLen < CLIPRDR_FILE_CONTENTS_RESPONSE_LENGTH) ||
+			(Stream_GetRemainingLength(s) < response->dataLen))
+		return FALSE;
+
+	Stream_Read_UINT32(s, response->streamId); /* streamId (4 bytes) */
+
+	response->dwFlags = 0;
+	response->cbRequested = response->dataLen - CLIPRDR_FILE_CONTENTS_RESPONSE_LENGTH;
+	response->requestedData = Stream_Pointer(s); /* requestedFileContentsData */
+
+	return TRUE;
+}
+
+void cliprdr_write_file_contents_response(wStream* s, CLIPRDR_FILE_CONTENTS_RESPONSE* response)
+{
+	Stream_Write_UINT32(s, response->streamId); /* streamId (4 bytes) */
+
+	/**
+	 * requestedFileContentsData:
+	 * FILECONTENTS_SIZE: file size as UINT64
+	 * FILECONTENTS_RANGE: file data from requested range
+	 */
+
+	if (response->cbRequested && response->requestedData)
+		Stream_Write(s, response->requestedData, response->cbRequested);
+}
@@ -0,0 +1,37 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Clipboard Virtual Channel
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CHANNEL_CLIPRDR_COMMON_H
+#define FREERDP_CHANNEL_CLIPRDR_COMMON_H
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+
+#include <freerdp/channels/cliprdr.h>
+
+#define CLIPRDR_HEADER_LENGTH				8
+
+/* Fixed length of PDUs, excluding the header and variable lengths */
+#define CLIPRDR_FILE_CONTENTS_REQUEST_LENGTH		28	/* fixed */
+#define CLIPRDR_FILE_CONTENTS_RESPONSE_LENGTH		4	/* variable */
+
+BOOL cliprdr_read_file_contents_request(wStream* s, CLIPRDR_FILE_CONTENTS_REQUEST* request);
+void cliprdr_write_file_contents_request(wStream* s, CLIPRDR_FILE_CONTENTS_REQUEST* request);
+BOOL cliprdr_read_file_contents_response(wStream* s, CLIPRDR_FILE_CONTENTS_RESPONSE* response);
+void cliprdr_write_file_contents_response(wStream* s, CLIPRDR_FILE_CONTENTS_RESPONSE* response);
+
+#endif /* FREERDP_CHANNEL_CLIPRDR_COMMON_H */
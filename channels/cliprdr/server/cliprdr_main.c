@@ -341,15 +341,9 @@ static int cliprdr_server_file_contents_request(CliprdrServerContext* context, C
 	wStream* s;
 	CliprdrServerPrivate* cliprdr = (CliprdrServerPrivate*) context->handle;
 
-	s = cliprdr_server_packet_new(CB_FILECONTENTS_REQUEST, 0, 28);
+	s = cliprdr_server_packet_new(CB_FILECONTENTS_REQUEST, 0, CLIPRDR_FILE_CONTENTS_REQUEST_LENGTH);
 
-	Stream_Write_UINT32(s, fileContentsRequest->streamId); /* streamId (4 bytes) */
-	Stream_Write_UINT32(s, fileContentsRequest->listIndex); /* listIndex (4 bytes) */
-	Stream_Write_UINT32(s, fileContentsRequest->dwFlags); /* dwFlags (4 bytes) */
-	Stream_Write_UINT32(s, fileContentsRequest->nPositionLow); /* nPositionLow (4 bytes) */
-	Stream_Write_UINT32(s, fileContentsRequest->nPositionHigh); /* nPositionHigh (4 bytes) */
-	Stream_Write_UINT32(s, fileContentsRequest->cbRequested); /* cbRequested (4 bytes) */
-	Stream_Write_UINT32(s, fileContentsRequest->clipDataId); /* clipDataId (4 bytes) */
+	cliprdr_write_file_contents_request(s, fileContentsRequest);
 
 	WLog_DBG(TAG, "ServerFileContentsRequest: streamId: 0x%04X",
 		fileContentsRequest->streamId);
@@ -367,18 +361,14 @@ static int cliprdr_server_file_contents_response(CliprdrServerContext* context,
 	if (fileContentsResponse->dwFlags & FILECONTENTS_SIZE)
 		fileContentsResponse->cbRequested = sizeof(UINT64);
 
-	s = cliprdr_server_packet_new(CB_FILECONTENTS_REQUEST, 0,
-			4 + fileContentsResponse->cbRequested);
+	/* responses from callers that predate the flags are taken as successful */
+	if (!(fileContentsResponse->msgFlags & CB_RESPONSE_FAIL))
+		fileContentsResponse->msgFlags = CB_RESPONSE_OK;
 
-	Stream_Write_UINT32(s, fileContentsResponse->streamId); /* streamId (4 bytes) */
+	s = cliprdr_server_packet_new(CB_FILECONTENTS_RESPONSE, fileContentsResponse->msgFlags,
+			CLIPRDR_FILE_CONTENTS_RESPONSE_LENGTH + fileContentsResponse->cbRequested);
 
-	/**
-	 * requestedFileContentsData:
-	 * FILECONTENTS_SIZE: file size as UINT64
-	 * FILECONTENTS_RANGE: file data from requested range
-	 */
-
-	Stream_Write(s, fileContentsResponse->requestedData, fileContentsResponse->cbRequested);
+	cliprdr_write_file_contents_response(s, fileContentsResponse);
 
 	WLog_DBG(TAG, "ServerFileContentsResponse: streamId: 0x%04X",
 		fileContentsResponse->streamId);
@@ -755,17 +745,9 @@ static int cliprdr_server_receive_filecontents_request(CliprdrServerContext* con
 	request.msgFlags = header->msgFlags;
 	request.dataLen = header->dataLen;
 
-	if (Stream_GetRemainingLength(s) < 28)
+	if (!cliprdr_read_file_contents_request(s, &request))
 		return -1;
 
-	Stream_Read_UINT32(s, request.streamId); /* streamId (4 bytes) */
-	Stream_Read_UINT32(s, request.listIndex); /* listIndex (4 bytes) */
-	Stream_Read_UINT32(s, request.dwFlags); /* dwFlags (4 bytes) */
-	Stream_Read_UINT32(s, request.nPositionLow); /* nPositionLow (4 bytes) */
-	Stream_Read_UINT32(s, request.nPositionHigh); /* nPositionHigh (4 bytes) */
-	Stream_Read_UINT32(s, request.cbRequested); /* cbRequested (4 bytes) */
-	Stream_Read_UINT32(s, request.clipDataId); /* clipDataId (4 bytes) */
-
 	if (context->ClientFileContentsRequest)
 		context->ClientFileContentsRequest(context, &request);
 
@@ -782,16 +764,11 @@ static int cliprdr_server_receive_filecontents_response(CliprdrServerContext* co
 	response.msgFlags = header->msgFlags;
 	response.dataLen = header->dataLen;
 
-	if (Stream_GetRemainingLength(s) < 4)
+	if (!cliprdr_read_file_contents_response(s, &response))
 		return -1;
 
-	Stream_Read_UINT32(s, response.streamId); /* streamId (4 bytes) */
-
-	response.cbRequested = header->dataLen - 4;
-	response.requestedData = Stream_Pointer(s); /* requestedFileContentsData */
-
-	if (context->ServerFileContentsResponse)
-		context->ServerFileContentsResponse(context, &response);
+	if (context->ClientFileContentsResponse)
+		context->ClientFileContentsResponse(context, &response);
 
 	return 1;
 }
@@ -28,9 +28,9 @@
 #include <freerdp/server/cliprdr.h>
 #include <freerdp/channels/log.h>
 
-#define TAG CHANNELS_TAG("cliprdr.server")
+#include "../cliprdr_common.h"
 
-#define CLIPRDR_HEADER_LENGTH	8
+#define TAG CHANNELS_TAG("cliprdr.server")
 
 struct _cliprdr_server_private
 {
@@ -120,32 +120,24 @@ UINT32 dvcman_get_channel_id(IWTSVirtualChannel * channel)
 	return ((DVCMAN_CHANNEL*) channel)->channel_id;
 }
 
-IWTSVirtualChannel* dvcman_find_channel_by_id(IWTSVirtualChannelManager* pChannelMgr, UINT32 ChannelId)
-{
-	int index;
-	BOOL found = FALSE;
-	DVCMAN_CHANNEL* channel;
-	DVCMAN* dvcman = (DVCMAN*) pChannelMgr;
-
-	ArrayList_Lock(dvcman->channels);
-
-	index = 0;
-	channel = (DVCMAN_CHANNEL*) ArrayList_GetItem(dvcman->channels, index++);
+/**
+ * Channel ids are assigned by the server, mostly in sequence, they hash to
+ * themselves. Keys are biased by one since the hash table rejects a NULL
+ * key and 0 is a valid channel id.
+ */
 
-	while (channel)
-	{
-		if (channel->channel_id == ChannelId)
-		{
-			found = TRUE;
-			break;
-		}
+#define DVCMAN_CHANNEL_KEY(_id)	((void*) (((size_t) (_id)) + 1))
 
-		channel = (DVCMAN_CHANNEL*) ArrayList_GetItem(dvcman->channels, index++);
-	}
+static UINT32 dvcman_channel_id_hash(void* key)
+{
+	return (UINT32) (size_t) key;
+}
 
-	ArrayList_Unlock(dvcman->channels);
+IWTSVirtualChannel* dvcman_find_channel_by_id(IWTSVirtualChannelManager* pChannelMgr, UINT32 ChannelId)
+{
+	DVCMAN* dvcman = (DVCMAN*) pChannelMgr;
 
-	return (found) ? ((IWTSVirtualChannel*) channel) : NULL;
+	return (IWTSVirtualChannel*) HashTable_GetItemValue(dvcman->channels, DVCMAN_CHANNEL_KEY(ChannelId));
 }
 
 void* dvcman_get_channel_interface_by_name(IWTSVirtualChannelManager* pChannelMgr, const char* ChannelName)
@@ -181,7 +173,8 @@ IWTSVirtualChannelManager* dvcman_new(drdynvcPlugin* plugin)
 	dvcman->iface.FindChannelById = dvcman_find_channel_by_id;
 	dvcman->iface.GetChannelId = dvcman_get_channel_id;
 	dvcman->drdynvc = plugin;
-	dvcman->channels = ArrayList_New(TRUE);
+	dvcman->channels = HashTable_New(TRUE);
+	dvcman->channels->hash = dvcman_channel_id_hash;
 	dvcman->pool = StreamPool_New(TRUE, 10);
 
 	return (IWTSVirtualChannelManager*) dvcman;
@@ -254,24 +247,26 @@ void dvcman_free(IWTSVirtualChannelManager* pChannelMgr)
 {
 	int i;
 	int count;
+	ULONG_PTR* keys = NULL;
 	IWTSPlugin* pPlugin;
 	DVCMAN_LISTENER* listener;
 	DVCMAN_CHANNEL* channel;
 	DVCMAN* dvcman = (DVCMAN*) pChannelMgr;
 
-	ArrayList_Lock(dvcman->channels);
-
-	count = ArrayList_Count(dvcman->channels);
+	count = HashTable_GetKeys(dvcman->channels, &keys);
 
 	for (i = 0; i < count; i++)
 	{
-		channel = (DVCMAN_CHANNEL*) ArrayList_GetItem(dvcman->channels, i);
-		dvcman_channel_free(channel);
+		channel = (DVCMAN_CHANNEL*) HashTable_GetItemValue(dvcman->channels, (void*) keys[i]);
+		HashTable_Remove(dvcman->channels, (void*) keys[i]);
+
+		if (channel)
+			dvcman_channel_free(channel);
 	}
 
-	ArrayList_Unlock(dvcman->channels);
+	free(keys);
 
-	ArrayList_Free(dvcman->channels);
+	HashTable_Free(dvcman->channels);
 
 	for (i = 0; i < dvcman->num_listeners; i++)
 	{
@@ -330,12 +325,14 @@ static int dvcman_close_channel_iface(IWTSVirtualChannel* pChannel)
 
 	WLog_DBG(TAG, "id=%d", channel->channel_id);
 
-	ArrayList_Remove(dvcman->channels, channel);
+	HashTable_Remove(dvcman->channels, DVCMAN_CHANNEL_KEY(channel->channel_id));
 	dvcman_channel_free(channel);
 
 	return 1;
 }
 
+int dvcman_close_channel(IWTSVirtualChannelManager* pChannelMgr, UINT32 ChannelId);
+
 int dvcman_create_channel(IWTSVirtualChannelManager* pChannelMgr, UINT32 ChannelId, const char* ChannelName)
 {
 	int i;
@@ -346,10 +343,25 @@ int dvcman_create_channel(IWTSVirtualChannelManager* pChannelMgr, UINT32 Channel
 	IWTSVirtualChannelCallback* pCallback;
 	DVCMAN* dvcman = (DVCMAN*) pChannelMgr;
 
+	if (HashTable_Contains(dvcman->channels, DVCMAN_CHANNEL_KEY(ChannelId)))
+	{
+		WLog_WARN(TAG, "ChannelId %d already in use, closing the previous channel", ChannelId);
+		dvcman_close_channel(pChannelMgr, ChannelId);
+	}
+
 	channel = dvcman_channel_new(pChannelMgr, ChannelId, ChannelName);
 
+	if (!channel)
+		return 1;
+
 	channel->status = 1;
-	ArrayList_Add(dvcman->channels, channel);
+
+	if (HashTable_Add(dvcman->channels, DVCMAN_CHANNEL_KEY(ChannelId), channel) < 0)
+	{
+		WLog_ERR(TAG, "failed to register ChannelId %d", ChannelId);
+		dvcman_channel_free(channel);
+		return 1;
+	}
 
 	for (i = 0; i < dvcman->num_listeners; i++)
 	{
@@ -432,11 +444,15 @@ int dvcman_close_channel(IWTSVirtualChannelManager* pChannelMgr, UINT32 ChannelI
 
 		ichannel = (IWTSVirtualChannel*) channel;
 
+		/* removes and frees the channel */
 		if (ichannel->Close)
+		{
 			ichannel->Close(ichannel);
+			return 0;
+		}
 	}
 
-	ArrayList_Remove(dvcman->channels, channel);
+	HashTable_Remove(dvcman->channels, DVCMAN_CHANNEL_KEY(ChannelId));
 	dvcman_channel_free(channel);
 
 	return 0;
@@ -555,83 +571,76 @@ int drdynvc_send(drdynvcPlugin* drdynvc, wStream* s)
 
 int drdynvc_write_data(drdynvcPlugin* drdynvc, UINT32 ChannelId, BYTE* data, UINT32 dataSize)
 {
-	wStream* data_out;
-	UINT32 pos = 0;
+	wStream* s;
+	BYTE* pdu;
 	UINT32 cbChId;
 	UINT32 cbLen;
+	UINT32 offset = 0;
+	UINT32 headerLength;
 	UINT32 chunkLength;
-	int status;
+	UINT32 pduCount;
+	UINT32 status = CHANNEL_RC_OK;
+	DVCMAN* dvcman = (DVCMAN*) drdynvc->channel_mgr;
 
 	WLog_DBG(TAG, "ChannelId=%d size=%d", ChannelId, dataSize);
 
 	if (drdynvc->channel_error != CHANNEL_RC_OK)
 		return 1;
 
-	data_out = Stream_New(NULL, CHANNEL_CHUNK_LENGTH);
-	Stream_SetPosition(data_out, 1);
-	cbChId = drdynvc_write_variable_uint(data_out, ChannelId);
+	/**
+	 * All PDUs of the message are laid out back to back in one pooled stream,
+	 * a header takes at most 9 bytes. Every PDU handed to VirtualChannelWrite
+	 * holds a reference on the stream until its write has completed.
+	 */
 
-	if (dataSize == 0)
-	{
-		pos = Stream_GetPosition(data_out);
-		Stream_SetPosition(data_out, 0);
-		Stream_Write_UINT8(data_out, 0x40 | cbChId);
-		Stream_SetPosition(data_out, pos);
+	pduCount = (dataSize / (CHANNEL_CHUNK_LENGTH - 9)) + 1;
+	s = StreamPool_Take(dvcman->pool, dataSize + (pduCount * 9));
 
-		status = drdynvc_send(drdynvc, data_out);
-	}
-	else if (dataSize <= CHANNEL_CHUNK_LENGTH - pos)
-	{
-		pos = Stream_GetPosition(data_out);
-		Stream_SetPosition(data_out, 0);
-		Stream_Write_UINT8(data_out, 0x30 | cbChId);
-		Stream_SetPosition(data_out, pos);
-		Stream_Write(data_out, data, dataSize);
+	if (!s)
+		return 1;
 
-		status = drdynvc_send(drdynvc, data_out);
-	}
-	else
+	do
 	{
-		/* Fragment the data */
-		cbLen = drdynvc_write_variable_uint(data_out, dataSize);
-		pos = Stream_GetPosition(data_out);
-		Stream_SetPosition(data_out, 0);
-		Stream_Write_UINT8(data_out, 0x20 | cbChId | (cbLen << 2));
-		Stream_SetPosition(data_out, pos);
-
-		chunkLength = CHANNEL_CHUNK_LENGTH - pos;
-
-		Stream_Write(data_out, data, chunkLength);
+		pdu = Stream_Pointer(s);
+		Stream_Seek_UINT8(s);
+		cbChId = drdynvc_write_variable_uint(s, ChannelId);
+		headerLength = (UINT32) (Stream_Pointer(s) - pdu);
 
-		data += chunkLength;
-		dataSize -= chunkLength;
-
-		status = drdynvc_send(drdynvc, data_out);
-
-		while (status == CHANNEL_RC_OK && dataSize > 0)
+		if (dataSize == 0)
+		{
+			*pdu = 0x40 | cbChId;
+		}
+		else if ((offset == 0) && (headerLength + dataSize > CHANNEL_CHUNK_LENGTH))
+		{
+			/* Fragment the data */
+			cbLen = drdynvc_write_variable_uint(s, dataSize);
+			headerLength = (UINT32) (Stream_Pointer(s) - pdu);
+			*pdu = 0x20 | cbChId | (cbLen << 2);
+		}
+		else
 		{
-			data_out = Stream_New(NULL, CHANNEL_CHUNK_LENGTH);
-			Stream_SetPosition(data_out, 1);
-			cbChId = drdynvc_write_variable_uint(data_out, ChannelId);
+			*pdu = 0x30 | cbChId;
+		}
 
-			pos = Stream_GetPosition(data_out);
-			Stream_SetPosition(data_out, 0);
-			Stream_Write_UINT8(data_out, 0x30 | cbChId);
-			Stream_SetPosition(data_out, pos);
+		chunkLength = dataSize - offset;
 
-			chunkLength = dataSize;
+		if (chunkLength > CHANNEL_CHUNK_LENGTH - headerLength)
+			chunkLength = CHANNEL_CHUNK_LENGTH - headerLength;
 
-			if (chunkLength > CHANNEL_CHUNK_LENGTH - pos)
-				chunkLength = CHANNEL_CHUNK_LENGTH - pos;
+		Stream_Write(s, &data[offset], chunkLength);
+		offset += chunkLength;
 
-			Stream_Write(data_out, data, chunkLength);
+		Stream_AddRef(s);
 
-			data += chunkLength;
-			dataSize -= chunkLength;
+		status = drdynvc->channelEntryPoints.pVirtualChannelWrite(drdynvc->OpenHandle,
+			pdu, headerLength + chunkLength, s);
 
-			status = drdynvc_send(drdynvc, data_out);
-		}
+		if (status != CHANNEL_RC_OK)
+			Stream_Release(s);
 	}
+	while ((status == CHANNEL_RC_OK) && (offset < dataSize));
+
+	Stream_Release(s);
 
 	if (status != CHANNEL_RC_OK)
 	{
@@ -982,7 +991,10 @@ static VOID VCAPITYPE drdynvc_virtual_channel_open_event(DWORD openHandle, UINT
 			break;
 
 		case CHANNEL_EVENT_WRITE_COMPLETE:
-			Stream_Free((wStream*) pData, TRUE);
+			if (((wStream*) pData)->pool)
+				Stream_Release((wStream*) pData);
+			else
+				Stream_Free((wStream*) pData, TRUE);
 			break;
 	}
 }
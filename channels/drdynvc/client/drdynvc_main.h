@@ -49,7 +49,7 @@ struct _DVCMAN
 	int num_listeners;
 	IWTSListener* listeners[MAX_PLUGINS];
 
-	wArrayList* channels;
+	wHashTable* channels;
 	wStreamPool* pool;
 };
 typedef struct _DVCMAN DVCMAN;
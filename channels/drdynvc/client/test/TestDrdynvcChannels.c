@@ -0,0 +1,483 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/stream.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/settings.h>
+
+#include "drdynvc_main.h"
+
+/**
+ * Dynamic virtual channel benchmark: the plugin is driven through a fake
+ * static channel. Thousands of channels are opened, data PDUs are spread
+ * across all of them and the time to look up and dispatch them is reported.
+ * Messages of various sizes are written on one channel, the PDUs sent must
+ * fit into a chunk and reassemble to the message. All channels are closed
+ * again before the plugin terminates.
+ */
+
+BOOL VCAPITYPE drdynvc_VirtualChannelEntry(PCHANNEL_ENTRY_POINTS pEntryPoints);
+
+#define TEST_DRDYNVC_CHANNELS	4096
+#define TEST_DRDYNVC_MESSAGES	(64 * 1024)
+#define TEST_DRDYNVC_LOOKUPS	(256 * 1024)
+#define TEST_DRDYNVC_OPEN_HANDLE	0x44
+
+typedef struct _TEST_DRDYNVC_CALLBACK TEST_DRDYNVC_CALLBACK;
+
+struct _TEST_DRDYNVC_CALLBACK
+{
+	IWTSVirtualChannelCallback iface;
+
+	UINT32 ChannelId;
+};
+
+static PCHANNEL_INIT_EVENT_FN test_drdynvc_init_event = NULL;
+static PCHANNEL_OPEN_EVENT_FN test_drdynvc_open_event = NULL;
+
+static LONG test_drdynvc_errors = 0;
+static LONG test_drdynvc_capabilities = 0;
+static LONG test_drdynvc_created = 0;
+static LONG test_drdynvc_closed = 0;
+static LONG test_drdynvc_received = 0;
+static LONG test_drdynvc_callbacks = 0;
+
+static UINT32 test_drdynvc_pdus = 0;
+static UINT32 test_drdynvc_length = 0;
+static wStream* test_drdynvc_message = NULL;
+
+static UINT32 test_drdynvc_read_variable_uint(wStream* s, int cbLen)
+{
+	UINT32 val;
+
+	switch (cbLen)
+	{
+		case 0:
+			Stream_Read_UINT8(s, val);
+			break;
+
+		case 1:
+			Stream_Read_UINT16(s, val);
+			break;
+
+		default:
+			Stream_Read_UINT32(s, val);
+			break;
+	}
+
+	return val;
+}
+
+static int test_drdynvc_write_variable_uint(wStream* s, UINT32 val)
+{
+	if (val <= 0xFF)
+	{
+		Stream_Write_UINT8(s, val);
+		return 0;
+	}
+
+	if (val <= 0xFFFF)
+	{
+		Stream_Write_UINT16(s, val);
+		return 1;
+	}
+
+	Stream_Write_UINT32(s, val);
+	return 2;
+}
+
+static void test_drdynvc_error(const char* message, UINT32 value)
+{
+	printf("%s (%u)\n", message, value);
+	InterlockedIncrement(&test_drdynvc_errors);
+}
+
+/* the server side: collects what the client sends */
+
+static UINT VCAPITYPE test_drdynvc_channel_write(DWORD openHandle, LPVOID pData, ULONG dataLength, LPVOID pUserData)
+{
+	int Cmd;
+	int Sp;
+	int cbChId;
+	BYTE value;
+	UINT32 status;
+	wStream* s;
+
+	if (openHandle != TEST_DRDYNVC_OPEN_HANDLE)
+		test_drdynvc_error("write on an unknown handle", openHandle);
+
+	if (dataLength > CHANNEL_CHUNK_LENGTH)
+		test_drdynvc_error("PDU exceeds the chunk length", dataLength);
+
+	s = Stream_New((BYTE*) pData, dataLength);
+
+	Stream_Read_UINT8(s, value);
+	Cmd = (value & 0xF0) >> 4;
+	Sp = (value & 0x0C) >> 2;
+	cbChId = (value & 0x03);
+
+	switch (Cmd)
+	{
+		case CAPABILITY_REQUEST_PDU:
+			InterlockedIncrement(&test_drdynvc_capabilities);
+			break;
+
+		case CREATE_REQUEST_PDU:
+			test_drdynvc_read_variable_uint(s, cbChId);
+			Stream_Read_UINT32(s, status);
+
+			if (status != 0)
+				test_drdynvc_error("channel not accepted", status);
+
+			InterlockedIncrement(&test_drdynvc_created);
+			break;
+
+		case CLOSE_REQUEST_PDU:
+			InterlockedIncrement(&test_drdynvc_closed);
+			break;
+
+		case DATA_FIRST_PDU:
+			test_drdynvc_read_variable_uint(s, cbChId);
+			test_drdynvc_length = test_drdynvc_read_variable_uint(s, Sp);
+			Stream_SetPosition(test_drdynvc_message, 0);
+			Stream_EnsureCapacity(test_drdynvc_message, test_drdynvc_length);
+			/* fall through */
+
+		case DATA_PDU:
+			if (Cmd == DATA_PDU)
+				test_drdynvc_read_variable_uint(s, cbChId);
+
+			if (Stream_GetPosition(test_drdynvc_message) + Stream_GetRemainingLength(s) > test_drdynvc_length)
+			{
+				test_drdynvc_error("data exceeds the message length", (UINT32) Stream_GetRemainingLength(s));
+				break;
+			}
+
+			Stream_Write(test_drdynvc_message, Stream_Pointer(s), Stream_GetRemainingLength(s));
+			test_drdynvc_pdus++;
+			break;
+
+		default:
+			test_drdynvc_error("unexpected PDU", Cmd);
+			break;
+	}
+
+	Stream_Free(s, FALSE);
+
+	test_drdynvc_open_event(openHandle, CHANNEL_EVENT_WRITE_COMPLETE, pUserData, dataLength, dataLength, 0);
+
+	return CHANNEL_RC_OK;
+}
+
+static UINT VCAPITYPE test_drdynvc_channel_init(LPVOID* ppInitHandle, PCHANNEL_DEF pChannel,
+		INT channelCount, ULONG versionRequested, PCHANNEL_INIT_EVENT_FN pChannelInitEventProc)
+{
+	*ppInitHandle = (LPVOID) &test_drdynvc_init_event;
+	test_drdynvc_init_event = pChannelInitEventProc;
+	return CHANNEL_RC_OK;
+}
+
+static UINT VCAPITYPE test_drdynvc_channel_open(LPVOID pInitHandle, LPDWORD pOpenHandle,
+		PCHAR pChannelName, PCHANNEL_OPEN_EVENT_FN pChannelOpenEventProc)
+{
+	*pOpenHandle = TEST_DRDYNVC_OPEN_HANDLE;
+	test_drdynvc_open_event = pChannelOpenEventProc;
+	return CHANNEL_RC_OK;
+}
+
+static UINT VCAPITYPE test_drdynvc_channel_close(DWORD openHandle)
+{
+	return CHANNEL_RC_OK;
+}
+
+static void test_drdynvc_send(wStream* s)
+{
+	test_drdynvc_open_event(TEST_DRDYNVC_OPEN_HANDLE, CHANNEL_EVENT_DATA_RECEIVED, Stream_Buffer(s),
+			(UINT32) Stream_GetPosition(s), (UINT32) Stream_GetPosition(s), CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST);
+}
+
+static BOOL test_drdynvc_wait(LONG* counter, LONG count)
+{
+	UINT64 start = GetTickCount64();
+
+	while (*counter < count)
+	{
+		if (GetTickCount64() - start > 30000)
+		{
+			printf("timeout: %d of %d PDUs\n", (int) *counter, (int) count);
+			return FALSE;
+		}
+
+		Sleep(1);
+	}
+
+	return TRUE;
+}
+
+/* the client side: a listener accepting every channel */
+
+static int test_drdynvc_on_data_received(IWTSVirtualChannelCallback* pChannelCallback, wStream* data)
+{
+	UINT32 ChannelId;
+	TEST_DRDYNVC_CALLBACK* callback = (TEST_DRDYNVC_CALLBACK*) pChannelCallback;
+
+	Stream_Read_UINT32(data, ChannelId);
+
+	if (ChannelId != callback->ChannelId)
+		test_drdynvc_error("data received on the wrong channel", ChannelId);
+
+	InterlockedIncrement(&test_drdynvc_received);
+	return 0;
+}
+
+static int test_drdynvc_on_close(IWTSVirtualChannelCallback* pChannelCallback)
+{
+	InterlockedDecrement(&test_drdynvc_callbacks);
+	free(pChannelCallback);
+	return 0;
+}
+
+static int test_drdynvc_on_new_channel_connection(IWTSListenerCallback* pListenerCallback,
+		IWTSVirtualChannel* pChannel, BYTE* Data, int* pbAccept, IWTSVirtualChannelCallback** ppCallback)
+{
+	TEST_DRDYNVC_CALLBACK* callback;
+
+	callback = (TEST_DRDYNVC_CALLBACK*) calloc(1, sizeof(TEST_DRDYNVC_CALLBACK));
+
+	if (!callback)
+		return 1;
+
+	callback->iface.OnDataReceived = test_drdynvc_on_data_received;
+	callback->iface.OnClose = test_drdynvc_on_close;
+	callback->ChannelId = ((DVCMAN_CHANNEL*) pChannel)->channel_id;
+
+	InterlockedIncrement(&test_drdynvc_callbacks);
+
+	*ppCallback = (IWTSVirtualChannelCallback*) callback;
+	return 0;
+}
+
+static UINT32 test_drdynvc_channel_id(UINT32 index)
+{
+	/* spread over all variable length encodings, starting with channel id 0 */
+	return (index * 41) + ((index % 3) ? 0x10000 : 0);
+}
+
+static UINT32 test_drdynvc_variable_uint_length(UINT32 val)
+{
+	return (val <= 0xFF) ? 1 : (val <= 0xFFFF) ? 2 : 4;
+}
+
+/* the least number of PDUs a message can be sent in */
+
+static UINT32 test_drdynvc_pdu_count(UINT32 ChannelId, UINT32 size)
+{
+	UINT32 header = 1 + test_drdynvc_variable_uint_length(ChannelId);
+	UINT32 first = CHANNEL_CHUNK_LENGTH - header - test_drdynvc_variable_uint_length(size);
+
+	if (header + size <= CHANNEL_CHUNK_LENGTH)
+		return 1;
+
+	return 1 + ((size - first) + (CHANNEL_CHUNK_LENGTH - header) - 1) / (CHANNEL_CHUNK_LENGTH - header);
+}
+
+static BOOL test_drdynvc_write_messages(IWTSVirtualChannelManager* channelMgr)
+{
+	UINT32 i;
+	UINT32 index;
+	BYTE* data;
+	IWTSVirtualChannel* channel;
+	const UINT32 sizes[] = { 1, 1596, 1597, 1598, 1599, 1600, 1601, 3190, 3191, 65536, 1000003 };
+
+	data = (BYTE*) malloc(1000003);
+
+	if (!data)
+		return FALSE;
+
+	for (i = 0; i < 1000003; i++)
+		data[i] = (BYTE) ((i * 7) + (i >> 11));
+
+	for (index = 0; index < 3; index++)
+	{
+		channel = channelMgr->FindChannelById(channelMgr, test_drdynvc_channel_id(index));
+
+		if (!channel)
+		{
+			test_drdynvc_error("channel not found", test_drdynvc_channel_id(index));
+			break;
+		}
+
+		for (i = 0; i < ARRAYSIZE(sizes); i++)
+		{
+			test_drdynvc_pdus = 0;
+			test_drdynvc_length = sizes[i];
+			Stream_SetPosition(test_drdynvc_message, 0);
+			Stream_EnsureCapacity(test_drdynvc_message, sizes[i]);
+
+			if (channel->Write(channel, sizes[i], data, NULL) != 0)
+				test_drdynvc_error("channel write failed", sizes[i]);
+
+			if ((Stream_GetPosition(test_drdynvc_message) != sizes[i]) ||
+					(memcmp(Stream_Buffer(test_drdynvc_message), data, sizes[i]) != 0))
+				test_drdynvc_error("message not reassembled", sizes[i]);
+
+			if (test_drdynvc_pdus != test_drdynvc_pdu_count(test_drdynvc_channel_id(index), sizes[i]))
+				test_drdynvc_error("unexpected number of PDUs", test_drdynvc_pdus);
+		}
+	}
+
+	free(data);
+
+	return (test_drdynvc_errors == 0);
+}
+
+int TestDrdynvcChannels(int argc, char* argv[])
+{
+	int rc = -1;
+	UINT32 index;
+	UINT32 ChannelId;
+	UINT64 start;
+	UINT64 elapsed;
+	wStream* s = NULL;
+	rdpSettings settings;
+	drdynvcPlugin* drdynvc;
+	DrdynvcClientContext* context = NULL;
+	IWTSVirtualChannelManager* channelMgr;
+	IWTSListenerCallback listenerCallback;
+	CHANNEL_ENTRY_POINTS_FREERDP entryPoints;
+
+	ZeroMemory(&settings, sizeof(rdpSettings));
+	ZeroMemory(&entryPoints, sizeof(CHANNEL_ENTRY_POINTS_FREERDP));
+
+	entryPoints.cbSize = sizeof(CHANNEL_ENTRY_POINTS_FREERDP);
+	entryPoints.protocolVersion = VIRTUAL_CHANNEL_VERSION_WIN2000;
+	entryPoints.pVirtualChannelInit = test_drdynvc_channel_init;
+	entryPoints.pVirtualChannelOpen = test_drdynvc_channel_open;
+	entryPoints.pVirtualChannelClose = test_drdynvc_channel_close;
+	entryPoints.pVirtualChannelWrite = test_drdynvc_channel_write;
+	entryPoints.MagicNumber = FREERDP_CHANNEL_MAGIC_NUMBER;
+	entryPoints.pExtendedData = &settings;
+	entryPoints.ppInterface = (void**) &context;
+
+	s = Stream_New(NULL, 1024);
+	test_drdynvc_message = Stream_New(NULL, 1024);
+
+	if (!s || !test_drdynvc_message)
+		goto fail;
+
+	if (!drdynvc_VirtualChannelEntry((PCHANNEL_ENTRY_POINTS) &entryPoints) || !context)
+		goto fail;
+
+	test_drdynvc_init_event(&test_drdynvc_init_event, CHANNEL_EVENT_CONNECTED, NULL, 0);
+
+	drdynvc = (drdynvcPlugin*) context->handle;
+	channelMgr = drdynvc->channel_mgr;
+
+	listenerCallback.OnNewChannelConnection = test_drdynvc_on_new_channel_connection;
+	channelMgr->CreateListener(channelMgr, "TESTDVC", 0, &listenerCallback, NULL);
+
+	Stream_SetPosition(s, 0);
+	Stream_Write_UINT8(s, CAPABILITY_REQUEST_PDU << 4);
+	Stream_Write_UINT8(s, 0); /* pad */
+	Stream_Write_UINT16(s, 3); /* version */
+	Stream_Zero(s, 8); /* PriorityCharge0-3 */
+	test_drdynvc_send(s);
+
+	start = GetTickCount64();
+
+	for (index = 0; index < TEST_DRDYNVC_CHANNELS; index++)
+	{
+		Stream_SetPosition(s, 1);
+		Stream_Buffer(s)[0] = (CREATE_REQUEST_PDU << 4) | test_drdynvc_write_variable_uint(s, test_drdynvc_channel_id(index));
+		Stream_Write(s, "TESTDVC", 8);
+		test_drdynvc_send(s);
+	}
+
+	if (!test_drdynvc_wait(&test_drdynvc_created, TEST_DRDYNVC_CHANNELS))
+		goto fail;
+
+	elapsed = GetTickCount64() - start;
+
+	printf("create: %d channels in %d ms\n", TEST_DRDYNVC_CHANNELS, (int) elapsed);
+
+	start = GetTickCount64();
+
+	for (index = 0; index < TEST_DRDYNVC_MESSAGES; index++)
+	{
+		ChannelId = test_drdynvc_channel_id((index * 2654435761U) % TEST_DRDYNVC_CHANNELS);
+
+		Stream_SetPosition(s, 1);
+		Stream_Buffer(s)[0] = (DATA_PDU << 4) | test_drdynvc_write_variable_uint(s, ChannelId);
+		Stream_Write_UINT32(s, ChannelId);
+		Stream_Zero(s, 60);
+		test_drdynvc_send(s);
+	}
+
+	if (!test_drdynvc_wait(&test_drdynvc_received, TEST_DRDYNVC_MESSAGES))
+		goto fail;
+
+	elapsed = GetTickCount64() - start;
+
+	printf("receive: %d data PDUs in %d ms (%.0f PDUs/s)\n", TEST_DRDYNVC_MESSAGES, (int) elapsed,
+			TEST_DRDYNVC_MESSAGES * 1000.0 / (elapsed ? elapsed : 1));
+
+	start = GetTickCount64();
+
+	for (index = 0; index < TEST_DRDYNVC_LOOKUPS; index++)
+	{
+		if (!channelMgr->FindChannelById(channelMgr, test_drdynvc_channel_id(index % TEST_DRDYNVC_CHANNELS)))
+		{
+			test_drdynvc_error("channel not found", index);
+			goto fail;
+		}
+	}
+
+	elapsed = GetTickCount64() - start;
+
+	printf("lookup: %d lookups in %d ms\n", TEST_DRDYNVC_LOOKUPS, (int) elapsed);
+
+	start = GetTickCount64();
+
+	if (!test_drdynvc_write_messages(channelMgr))
+		goto fail;
+
+	elapsed = GetTickCount64() - start;
+
+	printf("write: fragmented messages in %d ms\n", (int) elapsed);
+
+	for (index = 0; index < TEST_DRDYNVC_CHANNELS; index++)
+	{
+		Stream_SetPosition(s, 1);
+		Stream_Buffer(s)[0] = (CLOSE_REQUEST_PDU << 4) | test_drdynvc_write_variable_uint(s, test_drdynvc_channel_id(index));
+		test_drdynvc_send(s);
+	}
+
+	if (!test_drdynvc_wait(&test_drdynvc_closed, TEST_DRDYNVC_CHANNELS))
+		goto fail;
+
+	if (test_drdynvc_callbacks != 0)
+	{
+		printf("%d channels not closed\n", (int) test_drdynvc_callbacks);
+		goto fail;
+	}
+
+	if ((test_drdynvc_capabilities != 1) || (test_drdynvc_errors != 0))
+		goto fail;
+
+	rc = 0;
+
+fail:
+	if (test_drdynvc_init_event)
+		test_drdynvc_init_event(&test_drdynvc_init_event, CHANNEL_EVENT_TERMINATED, NULL, 0);
+
+	free(context);
+	Stream_Free(s, TRUE);
+	Stream_Free(test_drdynvc_message, TRUE);
+
+	return rc;
+}
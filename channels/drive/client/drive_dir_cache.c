@@ -0,0 +1,339 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * File System Virtual Channel
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef _WIN32
+#define __USE_LARGEFILE64
+#define _LARGEFILE_SOURCE
+#define _LARGEFILE64_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+
+#define DRIVE_DIR_CACHE_EVENTS	(IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_DELETE_SELF | \
+		IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+#endif
+
+#include "drive_dir_cache.h"
+
+static DRIVE_DIR_SNAPSHOT* drive_dir_snapshot_new(const char* path, DIR* dir)
+{
+	UINT32 size = 0;
+	struct dirent* ent;
+	DRIVE_DIR_ENTRY* entry;
+	DRIVE_DIR_ENTRY* entries;
+	DRIVE_DIR_SNAPSHOT* snapshot;
+#ifdef _WIN32
+	char* ent_path;
+#endif
+
+	snapshot = (DRIVE_DIR_SNAPSHOT*) calloc(1, sizeof(DRIVE_DIR_SNAPSHOT));
+
+	if (!snapshot)
+		return NULL;
+
+	snapshot->refCount = 1;
+	snapshot->wd = -1;
+	snapshot->path = _strdup(path);
+
+	if (!snapshot->path)
+	{
+		drive_dir_snapshot_release(snapshot);
+		return NULL;
+	}
+
+	rewinddir(dir);
+
+	while ((ent = readdir(dir)) != NULL)
+	{
+		if (snapshot->count >= size)
+		{
+			size = size ? size * 2 : 64;
+			entries = (DRIVE_DIR_ENTRY*) realloc(snapshot->entries, size * sizeof(DRIVE_DIR_ENTRY));
+
+			if (!entries)
+			{
+				drive_dir_snapshot_release(snapshot);
+				return NULL;
+			}
+
+			snapshot->entries = entries;
+		}
+
+		entry = &snapshot->entries[snapshot->count];
+		ZeroMemory(entry, sizeof(DRIVE_DIR_ENTRY));
+
+		entry->name = _strdup(ent->d_name);
+
+		if (!entry->name)
+		{
+			drive_dir_snapshot_release(snapshot);
+			return NULL;
+		}
+
+		snapshot->count++;
+
+		entry->nameLength = ConvertToUnicode(sys_code_page, 0, entry->name, -1, &entry->nameW, 0) * 2;
+
+#ifdef _WIN32
+		ent_path = (char*) malloc(strlen(path) + strlen(ent->d_name) + 2);
+
+		if (ent_path)
+		{
+			sprintf(ent_path, "%s/%s", path, ent->d_name);
+			STAT(ent_path, &entry->st);
+			free(ent_path);
+		}
+#else
+		/* relative to the directory, no path to build and resolve per entry */
+		FSTATAT(dirfd(dir), ent->d_name, &entry->st, 0);
+#endif
+	}
+
+	return snapshot;
+}
+
+void drive_dir_snapshot_release(DRIVE_DIR_SNAPSHOT* snapshot)
+{
+	UINT32 index;
+
+	if (!snapshot)
+		return;
+
+	if (InterlockedDecrement(&snapshot->refCount) > 0)
+		return;
+
+	for (index = 0; index < snapshot->count; index++)
+	{
+		free(snapshot->entries[index].name);
+		free(snapshot->entries[index].nameW);
+	}
+
+	free(snapshot->entries);
+	free(snapshot->path);
+	free(snapshot);
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+static UINT32 drive_dir_cache_wd_hash(void* key)
+{
+	return (UINT32) (UINT_PTR) key;
+}
+
+static void drive_dir_cache_invalidate(DRIVE_DIR_CACHE* cache, DRIVE_DIR_SNAPSHOT* snapshot)
+{
+	HashTable_Remove(cache->watches, (void*) (UINT_PTR) snapshot->wd);
+	inotify_rm_watch(cache->fd, snapshot->wd);
+
+	/* drops the reference held by the cache */
+	HashTable_Remove(cache->snapshots, snapshot->path);
+}
+
+static void drive_dir_cache_invalidate_all(DRIVE_DIR_CACHE* cache)
+{
+	int index;
+	int count;
+	ULONG_PTR* keys = NULL;
+	DRIVE_DIR_SNAPSHOT* snapshot;
+
+	count = HashTable_GetKeys(cache->watches, &keys);
+
+	for (index = 0; index < count; index++)
+	{
+		snapshot = (DRIVE_DIR_SNAPSHOT*) HashTable_GetItemValue(cache->watches, (void*) keys[index]);
+
+		if (snapshot)
+			drive_dir_cache_invalidate(cache, snapshot);
+	}
+
+	free(keys);
+}
+
+/* applies the pending change notifications, the cache lock must be held */
+
+static void drive_dir_cache_poll(DRIVE_DIR_CACHE* cache)
+{
+	ssize_t length;
+	char* ptr;
+	struct inotify_event* event;
+	DRIVE_DIR_SNAPSHOT* snapshot;
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	while (1)
+	{
+		length = read(cache->fd, buffer, sizeof(buffer));
+
+		if (length <= 0)
+			break;
+
+		for (ptr = buffer; ptr < buffer + length; ptr += sizeof(struct inotify_event) + event->len)
+		{
+			event = (struct inotify_event*) ptr;
+
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				drive_dir_cache_invalidate_all(cache);
+				continue;
+			}
+
+			snapshot = (DRIVE_DIR_SNAPSHOT*) HashTable_GetItemValue(cache->watches, (void*) (UINT_PTR) event->wd);
+
+			if (snapshot)
+				drive_dir_cache_invalidate(cache, snapshot);
+		}
+	}
+}
+
+#endif
+
+DRIVE_DIR_SNAPSHOT* drive_dir_cache_acquire(DRIVE_DIR_CACHE* cache, const char* path, DIR* dir)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	int wd = -1;
+	DRIVE_DIR_SNAPSHOT* snapshot;
+
+	if (cache && (cache->fd >= 0))
+	{
+		EnterCriticalSection(&cache->lock);
+
+		drive_dir_cache_poll(cache);
+
+		snapshot = (DRIVE_DIR_SNAPSHOT*) HashTable_GetItemValue(cache->snapshots, (void*) path);
+
+		if (snapshot)
+		{
+			InterlockedIncrement(&snapshot->refCount);
+			LeaveCriticalSection(&cache->lock);
+			return snapshot;
+		}
+
+		/**
+		 * The watch is set up before the directory is read so that a change
+		 * made while reading it already drops the new snapshot. Another path
+		 * leading to the same directory shares the watch descriptor, such a
+		 * snapshot is not cached.
+		 */
+
+		if (HashTable_Count(cache->snapshots) < DRIVE_DIR_CACHE_MAX)
+		{
+			wd = inotify_add_watch(cache->fd, path, DRIVE_DIR_CACHE_EVENTS);
+
+			if ((wd >= 0) && HashTable_Contains(cache->watches, (void*) (UINT_PTR) wd))
+				wd = -1;
+		}
+
+		snapshot = drive_dir_snapshot_new(path, dir);
+
+		if (snapshot && (wd >= 0))
+		{
+			snapshot->wd = wd;
+			InterlockedIncrement(&snapshot->refCount);
+
+			HashTable_Add(cache->snapshots, snapshot->path, snapshot);
+			HashTable_Add(cache->watches, (void*) (UINT_PTR) wd, snapshot);
+		}
+		else if (wd >= 0)
+		{
+			inotify_rm_watch(cache->fd, wd);
+		}
+
+		LeaveCriticalSection(&cache->lock);
+
+		return snapshot;
+	}
+#endif
+
+	return drive_dir_snapshot_new(path, dir);
+}
+
+DRIVE_DIR_CACHE* drive_dir_cache_new(void)
+{
+	DRIVE_DIR_CACHE* cache;
+
+	cache = (DRIVE_DIR_CACHE*) calloc(1, sizeof(DRIVE_DIR_CACHE));
+
+	if (!cache)
+		return NULL;
+
+	cache->fd = -1;
+
+	InitializeCriticalSectionAndSpinCount(&cache->lock, 4000);
+
+#ifdef HAVE_SYS_INOTIFY_H
+	cache->snapshots = HashTable_New(FALSE);
+	cache->watches = HashTable_New(FALSE);
+
+	if (!cache->snapshots || !cache->watches)
+	{
+		drive_dir_cache_free(cache);
+		return NULL;
+	}
+
+	cache->snapshots->hash = HashTable_StringHash;
+	cache->snapshots->keyCompare = HashTable_StringCompare;
+	cache->snapshots->keyClone = HashTable_StringClone;
+	cache->snapshots->keyFree = HashTable_StringFree;
+	cache->snapshots->valueFree = (HASH_TABLE_VALUE_FREE_FN) drive_dir_snapshot_release;
+
+	cache->watches->hash = drive_dir_cache_wd_hash;
+
+	cache->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+	return cache;
+}
+
+void drive_dir_cache_free(DRIVE_DIR_CACHE* cache)
+{
+	if (!cache)
+		return;
+
+	if (cache->watches)
+		HashTable_Free(cache->watches);
+
+	if (cache->snapshots)
+		HashTable_Free(cache->snapshots);
+
+	if (cache->fd >= 0)
+		close(cache->fd);
+
+	DeleteCriticalSection(&cache->lock);
+
+	free(cache);
+}
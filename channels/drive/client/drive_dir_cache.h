@@ -0,0 +1,71 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * File System Virtual Channel
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CHANNEL_DRIVE_DIR_CACHE_H
+#define FREERDP_CHANNEL_DRIVE_DIR_CACHE_H
+
+#include <winpr/collections.h>
+
+#include "drive_file.h"
+
+/**
+ * A directory snapshot holds the names and attributes of all entries of a
+ * directory, read and stat'ed in one pass. Snapshots are shared between the
+ * handles of a directory through the cache as long as the directory can be
+ * watched for changes (inotify), any change drops the snapshot and the next
+ * enumeration takes a new one.
+ */
+
+#define DRIVE_DIR_CACHE_MAX	256
+
+typedef struct _DRIVE_DIR_ENTRY DRIVE_DIR_ENTRY;
+
+struct _DRIVE_DIR_ENTRY
+{
+	char* name;
+	WCHAR* nameW;
+	int nameLength;
+	struct STAT st;
+};
+
+struct _DRIVE_DIR_SNAPSHOT
+{
+	LONG refCount;
+
+	char* path;
+	int wd;
+
+	UINT32 count;
+	DRIVE_DIR_ENTRY* entries;
+};
+
+struct _DRIVE_DIR_CACHE
+{
+	CRITICAL_SECTION lock;
+
+	int fd;
+	wHashTable* snapshots;
+	wHashTable* watches;
+};
+
+DRIVE_DIR_SNAPSHOT* drive_dir_cache_acquire(DRIVE_DIR_CACHE* cache, const char* path, DIR* dir);
+void drive_dir_snapshot_release(DRIVE_DIR_SNAPSHOT* snapshot);
+
+DRIVE_DIR_CACHE* drive_dir_cache_new(void);
+void drive_dir_cache_free(DRIVE_DIR_CACHE* cache);
+
+#endif /* FREERDP_CHANNEL_DRIVE_DIR_CACHE_H */
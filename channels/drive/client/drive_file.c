@@ -60,6 +60,7 @@
 #endif
 
 #include "drive_file.h"
+#include "drive_dir_cache.h"
 
 #ifdef _WIN32
 #pragma warning(push)
@@ -304,6 +305,7 @@ DRIVE_FILE* drive_file_new(const char* base_path, const char* path, UINT32 id,
 
 	file->id = id;
 	file->basepath = (char*) base_path;
+	InitializeCriticalSectionAndSpinCount(&file->lock, 4000);
 	drive_file_set_fullpath(file, drive_file_combine_fullpath(base_path, path));
 	file->fd = -1;
 
@@ -343,6 +345,8 @@ void drive_file_free(DRIVE_FILE* file)
 	if (file->dir != NULL)
 		closedir(file->dir);
 
+	drive_dir_snapshot_release(file->snapshot);
+
 	if (file->delete_pending)
 	{
 		if (file->is_dir)
@@ -351,30 +355,96 @@ void drive_file_free(DRIVE_FILE* file)
 			unlink(file->fullpath);
 	}
 
+	DeleteCriticalSection(&file->lock);
+
 	free(file->pattern);
 	free(file->fullpath);
 	free(file);
 }
 
-BOOL drive_file_seek(DRIVE_FILE* file, UINT64 Offset)
+static void drive_file_readahead(DRIVE_FILE* file, UINT64 Offset, UINT32 Length)
 {
-	if (file->is_dir || file->fd == -1)
-		return FALSE;
+	UINT64 end;
+	UINT64 start = 0;
+	UINT64 stop = 0;
+	BOOL sequential;
 
-	if (LSEEK(file->fd, Offset, SEEK_SET) == (off_t)-1)
-		return FALSE;
+	end = Offset + Length;
 
-	return TRUE;
+	EnterCriticalSection(&file->lock);
+
+	/* reads issued back to back by the server may be served out of order */
+
+	if (Offset > file->read_next)
+		sequential = ((Offset - file->read_next) <= file->readahead_window) ? TRUE : FALSE;
+	else
+		sequential = ((file->read_next - Offset) <= file->readahead_window + Length) ? TRUE : FALSE;
+
+	if (!sequential)
+	{
+		file->readahead_window = 0;
+		file->readahead_end = 0;
+		file->read_next = end;
+	}
+	else
+	{
+		if (!file->readahead_window)
+			file->readahead_window = DRIVE_READAHEAD_MIN;
+		else if (file->readahead_window < DRIVE_READAHEAD_MAX)
+			file->readahead_window *= 2;
+
+		if (end > file->read_next)
+			file->read_next = end;
+
+		/* top the window up once half of it has been consumed */
+
+		if (file->readahead_end < file->read_next + file->readahead_window / 2)
+		{
+			start = (file->readahead_end > file->read_next) ? file->readahead_end : file->read_next;
+			stop = file->read_next + file->readahead_window;
+			file->readahead_end = stop;
+		}
+	}
+
+	LeaveCriticalSection(&file->lock);
+
+	if (!stop)
+		return;
+
+#if defined(POSIX_FADV_WILLNEED)
+	posix_fadvise(file->fd, (off_t) start, (off_t) (stop - start), POSIX_FADV_WILLNEED);
+#elif defined(F_RDADVISE)
+	{
+		struct radvisory ra;
+
+		ra.ra_offset = (off_t) start;
+		ra.ra_count = (int) (stop - start);
+		fcntl(file->fd, F_RDADVISE, &ra);
+	}
+#endif
 }
 
-BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length)
+BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length, UINT64 Offset)
 {
 	ssize_t r;
 
 	if (file->is_dir || file->fd == -1)
 		return FALSE;
 
-	r = read(file->fd, buffer, *Length);
+	drive_file_readahead(file, Offset, *Length);
+
+#ifdef PREAD
+	r = PREAD(file->fd, buffer, *Length, Offset);
+#else
+	EnterCriticalSection(&file->lock);
+
+	if (LSEEK(file->fd, Offset, SEEK_SET) == (off_t)-1)
+		r = -1;
+	else
+		r = read(file->fd, buffer, *Length);
+
+	LeaveCriticalSection(&file->lock);
+#endif
 
 	if (r < 0)
 		return FALSE;
@@ -384,25 +454,49 @@ BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length)
 	return TRUE;
 }
 
-BOOL drive_file_write(DRIVE_FILE* file, BYTE* buffer, UINT32 Length)
+BOOL drive_file_write(DRIVE_FILE* file, BYTE* buffer, UINT32 Length, UINT64 Offset)
 {
 	ssize_t r;
+	BOOL status = TRUE;
 
 	if (file->is_dir || file->fd == -1)
 		return FALSE;
 
+#ifdef PWRITE
 	while (Length > 0)
 	{
-		r = write(file->fd, buffer, Length);
+		r = PWRITE(file->fd, buffer, Length, Offset);
 
 		if (r == -1)
 			return FALSE;
 
 		Length -= r;
 		buffer += r;
+		Offset += r;
 	}
+#else
+	EnterCriticalSection(&file->lock);
 
-	return TRUE;
+	if (LSEEK(file->fd, Offset, SEEK_SET) == (off_t)-1)
+		status = FALSE;
+
+	while (status && (Length > 0))
+	{
+		r = write(file->fd, buffer, Length);
+
+		if (r == -1)
+			status = FALSE;
+		else
+		{
+			Length -= r;
+			buffer += r;
+		}
+	}
+
+	LeaveCriticalSection(&file->lock);
+#endif
+
+	return status;
 }
 
 BOOL drive_file_query_information(DRIVE_FILE* file, UINT32 FsInformationClass, wStream* output)
@@ -606,14 +700,14 @@ BOOL drive_file_set_information(DRIVE_FILE* file, UINT32 FsInformationClass, UIN
 	return TRUE;
 }
 
-BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYTE InitialQuery,
-	const char* path, wStream* output)
+BOOL drive_file_query_directory(DRIVE_FILE* file, DRIVE_DIR_CACHE* cache, UINT32 FsInformationClass,
+	BYTE InitialQuery, const char* path, wStream* output)
 {
 	int length;
 	BOOL ret;
 	WCHAR* ent_path;
 	struct STAT st;
-	struct dirent* ent;
+	DRIVE_DIR_ENTRY* ent = NULL;
 
 	if (!file->dir)
 	{
@@ -622,9 +716,15 @@ BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYT
 		return FALSE;
 	}
 
+	if ((InitialQuery != 0) || !file->snapshot)
+	{
+		drive_dir_snapshot_release(file->snapshot);
+		file->snapshot = drive_dir_cache_acquire(cache, file->fullpath, file->dir);
+		file->snapshot_index = 0;
+	}
+
 	if (InitialQuery != 0)
 	{
-		rewinddir(file->dir);
 		free(file->pattern);
 
 		if (path[0])
@@ -633,24 +733,14 @@ BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYT
 			file->pattern = NULL;
 	}
 
-	if (file->pattern)
+	while (file->snapshot && (file->snapshot_index < file->snapshot->count))
 	{
-		do
-		{
-			ent = readdir(file->dir);
+		ent = &file->snapshot->entries[file->snapshot_index++];
 
-			if (ent == NULL)
-				continue;
-
-			if (FilePatternMatchA(ent->d_name, file->pattern))
-				break;
+		if (!file->pattern || FilePatternMatchA(ent->name, file->pattern))
+			break;
 
-		}
-		while (ent);
-	}
-	else
-	{
-		ent = readdir(file->dir);
+		ent = NULL;
 	}
 
 	if (!ent)
@@ -660,19 +750,9 @@ BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYT
 		return FALSE;
 	}
 
-	memset(&st, 0, sizeof(struct STAT));
-	ent_path = (WCHAR*) malloc(strlen(file->fullpath) + strlen(ent->d_name) + 2);
-	sprintf((char*) ent_path, "%s/%s", file->fullpath, ent->d_name);
-
-	if (STAT((char*) ent_path, &st) != 0)
-	{
-
-	}
-
-	free(ent_path);
-	ent_path = NULL;
-
-	length = ConvertToUnicode(sys_code_page, 0, ent->d_name, -1, &ent_path, 0) * 2;
+	st = ent->st;
+	ent_path = ent->nameW;
+	length = ent->nameLength;
 
 	ret = TRUE;
 
@@ -751,8 +831,6 @@ BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYT
 			break;
 	}
 
-	free(ent_path);
-
 	return ret;
 }
 
@@ -25,6 +25,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <winpr/synch.h>
+
 #ifdef _WIN32
 #include <direct.h>
 #include <io.h>
@@ -60,20 +62,29 @@ typedef UINT32 mode_t;
 #define STAT stat
 #define OPEN open
 #define LSEEK lseek
+#define PREAD pread
+#define PWRITE pwrite
 #define FSTAT fstat
+#define FSTATAT fstatat
 #define STATVFS statvfs
 #define O_LARGEFILE 0
 #elif defined(ANDROID)
 #define STAT stat
 #define OPEN open
 #define LSEEK lseek
+#define PREAD pread
+#define PWRITE pwrite
 #define FSTAT fstat
+#define FSTATAT fstatat
 #define STATVFS statfs
 #else
 #define STAT stat64
 #define OPEN open64
 #define LSEEK lseek64
+#define PREAD pread64
+#define PWRITE pwrite64
 #define FSTAT fstat64
+#define FSTATAT fstatat64
 #define STATVFS statvfs64
 #endif
 
@@ -90,7 +101,17 @@ typedef UINT32 mode_t;
 	(_f->delete_pending ? FILE_ATTRIBUTE_TEMPORARY : 0) | \
 	(st.st_mode & S_IWUSR ? 0 : FILE_ATTRIBUTE_READONLY))
 
+/**
+ * Sequential reads prefetch the data following them, starting with a window
+ * of DRIVE_READAHEAD_MIN bytes which doubles with every further sequential
+ * read up to DRIVE_READAHEAD_MAX. A read elsewhere in the file resets it.
+ */
+#define DRIVE_READAHEAD_MIN	(128 * 1024)
+#define DRIVE_READAHEAD_MAX	(4 * 1024 * 1024)
+
 typedef struct _DRIVE_FILE DRIVE_FILE;
+typedef struct _DRIVE_DIR_CACHE DRIVE_DIR_CACHE;
+typedef struct _DRIVE_DIR_SNAPSHOT DRIVE_DIR_SNAPSHOT;
 
 struct _DRIVE_FILE
 {
@@ -103,20 +124,34 @@ struct _DRIVE_FILE
 	char* fullpath;
 	char* filename;
 	char* pattern;
+	DRIVE_DIR_SNAPSHOT* snapshot;
+	UINT32 snapshot_index;
 	BOOL delete_pending;
+
+	/**
+	 * IRPs of one file may run on several worker threads: lock serializes
+	 * the read-ahead state and positioned I/O where there is no pread/pwrite,
+	 * pending_irps counts the IRPs handed to the workers (protected by the
+	 * drive).
+	 */
+	CRITICAL_SECTION lock;
+	UINT32 pending_irps;
+
+	UINT64 read_next;
+	UINT64 readahead_end;
+	UINT32 readahead_window;
 };
 
 DRIVE_FILE* drive_file_new(const char* base_path, const char* path, UINT32 id,
 	UINT32 DesiredAccess, UINT32 CreateDisposition, UINT32 CreateOptions);
 void drive_file_free(DRIVE_FILE* file);
 
-BOOL drive_file_seek(DRIVE_FILE* file, UINT64 Offset);
-BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length);
-BOOL drive_file_write(DRIVE_FILE* file, BYTE* buffer, UINT32 Length);
+BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length, UINT64 Offset);
+BOOL drive_file_write(DRIVE_FILE* file, BYTE* buffer, UINT32 Length, UINT64 Offset);
 BOOL drive_file_query_information(DRIVE_FILE* file, UINT32 FsInformationClass, wStream* output);
 BOOL drive_file_set_information(DRIVE_FILE* file, UINT32 FsInformationClass, UINT32 Length, wStream* input);
-BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYTE InitialQuery,
-	const char* path, wStream* output);
+BOOL drive_file_query_directory(DRIVE_FILE* file, DRIVE_DIR_CACHE* cache, UINT32 FsInformationClass,
+	BYTE InitialQuery, const char* path, wStream* output);
 int dir_empty(const char *path);
 
 extern UINT sys_code_page;
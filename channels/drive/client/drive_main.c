@@ -37,6 +37,7 @@
 
 #include <winpr/crt.h>
 #include <winpr/synch.h>
+#include <winpr/pool.h>
 #include <winpr/thread.h>
 #include <winpr/stream.h>
 #include <winpr/interlocked.h>
@@ -45,6 +46,9 @@
 #include <freerdp/channels/rdpdr.h>
 
 #include "drive_file.h"
+#include "drive_dir_cache.h"
+
+#define DRIVE_WORKER_THREADS	8
 
 typedef struct _DRIVE_DEVICE DRIVE_DEVICE;
 
@@ -53,14 +57,31 @@ struct _DRIVE_DEVICE
 	DEVICE device;
 
 	char* path;
-	wListDictionary* files;
+	wHashTable* files;
+	DRIVE_DIR_CACHE* dirCache;
 
 	HANDLE thread;
 	wMessageQueue* IrpQueue;
 
+	PTP_POOL ThreadPool;
+	TP_CALLBACK_ENVIRON ThreadPoolEnv;
+
+	CRITICAL_SECTION PendingLock;
+	HANDLE PendingEvent;
+	UINT32 PendingIrps;
+
 	DEVMAN* devman;
 };
 
+typedef struct _DRIVE_IRP_WORK DRIVE_IRP_WORK;
+
+struct _DRIVE_IRP_WORK
+{
+	IRP* irp;
+	DRIVE_FILE* file;
+	DRIVE_DEVICE* drive;
+};
+
 static UINT32 drive_map_posix_err(int fs_errno)
 {
 	UINT32 rc;
@@ -94,12 +115,19 @@ static UINT32 drive_map_posix_err(int fs_errno)
 	return rc;
 }
 
+/* file ids are handed out in sequence, they hash to themselves */
+
+static UINT32 drive_file_id_hash(void* key)
+{
+	return (UINT32) (size_t) key;
+}
+
 static DRIVE_FILE* drive_get_file_by_id(DRIVE_DEVICE* drive, UINT32 id)
 {
 	DRIVE_FILE* file = NULL;
 	void* key = (void*) (size_t) id;
 
-	file = (DRIVE_FILE*) ListDictionary_GetItemValue(drive->files, key);
+	file = (DRIVE_FILE*) HashTable_GetItemValue(drive->files, key);
 
 	return file;
 }
@@ -152,7 +180,7 @@ static void drive_process_irp_create(DRIVE_DEVICE* drive, IRP* irp)
 	else
 	{
 		key = (void*) (size_t) file->id;
-		ListDictionary_Add(drive->files, key, file);
+		HashTable_Add(drive->files, key, file);
 
 		switch (CreateDisposition)
 		{
@@ -197,8 +225,8 @@ static void drive_process_irp_close(DRIVE_DEVICE* drive, IRP* irp)
 	}
 	else
 	{
-		ListDictionary_Remove(drive->files, key);
-		drive_file_free(file);
+		/* frees the file */
+		HashTable_Remove(drive->files, key);
 	}
 
 	Stream_Zero(irp->output, 5); /* Padding(5) */
@@ -211,7 +239,6 @@ static void drive_process_irp_read(DRIVE_DEVICE* drive, IRP* irp)
 	DRIVE_FILE* file;
 	UINT32 Length;
 	UINT64 Offset;
-	BYTE* buffer = NULL;
 
 	Stream_Read_UINT32(irp->input, Length);
 	Stream_Read_UINT64(irp->input, Offset);
@@ -223,37 +250,21 @@ static void drive_process_irp_read(DRIVE_DEVICE* drive, IRP* irp)
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
 		Length = 0;
 	}
-	else if (!drive_file_seek(file, Offset))
-	{
-		irp->IoStatus = STATUS_UNSUCCESSFUL;
-		Length = 0;
-	}
 	else
 	{
-		buffer = (BYTE*) malloc(Length);
+		/* read straight into the response, behind its Length field */
 
-		if (!drive_file_read(file, buffer, &Length))
+		Stream_EnsureRemainingCapacity(irp->output, 4 + (size_t) Length);
+
+		if (!drive_file_read(file, Stream_Pointer(irp->output) + 4, &Length, Offset))
 		{
 			irp->IoStatus = STATUS_UNSUCCESSFUL;
-			free(buffer);
-			buffer = NULL;
 			Length = 0;
 		}
-		else
-		{
-
-		}
 	}
 
 	Stream_Write_UINT32(irp->output, Length);
-
-	if (Length > 0)
-	{
-		Stream_EnsureRemainingCapacity(irp->output, (int) Length);
-		Stream_Write(irp->output, buffer, Length);
-	}
-
-	free(buffer);
+	Stream_Seek(irp->output, Length);
 
 	irp->Complete(irp);
 }
@@ -275,12 +286,7 @@ static void drive_process_irp_write(DRIVE_DEVICE* drive, IRP* irp)
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
 		Length = 0;
 	}
-	else if (!drive_file_seek(file, Offset))
-	{
-		irp->IoStatus = STATUS_UNSUCCESSFUL;
-		Length = 0;
-	}
-	else if (!drive_file_write(file, Stream_Pointer(irp->input), Length))
+	else if (!drive_file_write(file, Stream_Pointer(irp->input), Length, Offset))
 	{
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
 		Length = 0;
@@ -488,7 +494,7 @@ static void drive_process_irp_query_directory(DRIVE_DEVICE* drive, IRP* irp)
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
 		Stream_Write_UINT32(irp->output, 0); /* Length */
 	}
-	else if (!drive_file_query_directory(file, FsInformationClass, InitialQuery, path, irp->output))
+	else if (!drive_file_query_directory(file, drive->dirCache, FsInformationClass, InitialQuery, path, irp->output))
 	{
 		irp->IoStatus = STATUS_NO_MORE_FILES;
 	}
@@ -577,6 +583,123 @@ static void drive_process_irp(DRIVE_DEVICE* drive, IRP* irp)
 	}
 }
 
+/**
+ * Reads, writes, information and directory queries of an open file are run
+ * on the worker pool so that a large transfer does not hold up the IRPs of
+ * other files. Everything else, including the IRPs that create, close or
+ * modify a file, is run in order on the drive thread once the workers are
+ * done with the file concerned. Directory queries continue the enumeration
+ * of the previous one and wait for their file the same way before they are
+ * submitted. Completions are matched by CompletionId, the order in which
+ * they are sent does not matter.
+ */
+
+static BOOL drive_irp_is_parallel(IRP* irp)
+{
+	switch (irp->MajorFunction)
+	{
+		case IRP_MJ_READ:
+		case IRP_MJ_WRITE:
+		case IRP_MJ_QUERY_INFORMATION:
+			return TRUE;
+
+		case IRP_MJ_DIRECTORY_CONTROL:
+			return (irp->MinorFunction == IRP_MN_QUERY_DIRECTORY) ? TRUE : FALSE;
+
+		default:
+			return FALSE;
+	}
+}
+
+static void drive_wait_pending(DRIVE_DEVICE* drive, UINT32* pending)
+{
+	EnterCriticalSection(&drive->PendingLock);
+
+	while (*pending > 0)
+	{
+		ResetEvent(drive->PendingEvent);
+		LeaveCriticalSection(&drive->PendingLock);
+		WaitForSingleObject(drive->PendingEvent, INFINITE);
+		EnterCriticalSection(&drive->PendingLock);
+	}
+
+	LeaveCriticalSection(&drive->PendingLock);
+}
+
+static void CALLBACK drive_irp_work_callback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
+{
+	DRIVE_IRP_WORK* param = (DRIVE_IRP_WORK*) context;
+	DRIVE_DEVICE* drive = param->drive;
+
+	drive_process_irp(drive, param->irp);
+
+	EnterCriticalSection(&drive->PendingLock);
+	param->file->pending_irps--;
+	drive->PendingIrps--;
+	SetEvent(drive->PendingEvent);
+	LeaveCriticalSection(&drive->PendingLock);
+
+	free(param);
+	CloseThreadpoolWork(work);
+}
+
+static BOOL drive_submit_irp(DRIVE_DEVICE* drive, DRIVE_FILE* file, IRP* irp)
+{
+	PTP_WORK work;
+	DRIVE_IRP_WORK* param;
+
+	param = (DRIVE_IRP_WORK*) malloc(sizeof(DRIVE_IRP_WORK));
+
+	if (!param)
+		return FALSE;
+
+	param->irp = irp;
+	param->file = file;
+	param->drive = drive;
+
+	work = CreateThreadpoolWork((PTP_WORK_CALLBACK) drive_irp_work_callback,
+			(void*) param, &drive->ThreadPoolEnv);
+
+	if (!work)
+	{
+		free(param);
+		return FALSE;
+	}
+
+	EnterCriticalSection(&drive->PendingLock);
+	file->pending_irps++;
+	drive->PendingIrps++;
+	LeaveCriticalSection(&drive->PendingLock);
+
+	SubmitThreadpoolWork(work);
+
+	return TRUE;
+}
+
+static void drive_dispatch_irp(DRIVE_DEVICE* drive, IRP* irp)
+{
+	DRIVE_FILE* file = NULL;
+
+	if (irp->MajorFunction != IRP_MJ_CREATE)
+		file = drive_get_file_by_id(drive, irp->FileId);
+
+	if (file)
+	{
+		if (irp->MajorFunction == IRP_MJ_DIRECTORY_CONTROL)
+			drive_wait_pending(drive, &file->pending_irps);
+
+		if (drive->ThreadPool && drive_irp_is_parallel(irp))
+		{
+			if (drive_submit_irp(drive, file, irp))
+				return;
+		}
+
+		drive_wait_pending(drive, &file->pending_irps);
+	}
+
+	drive_process_irp(drive, irp);
+}
+
 static void* drive_thread_func(void* arg)
 {
 	IRP* irp;
@@ -597,9 +720,11 @@ static void* drive_thread_func(void* arg)
 		irp = (IRP*) message.wParam;
 
 		if (irp)
-			drive_process_irp(drive, irp);
+			drive_dispatch_irp(drive, irp);
 	}
 
+	drive_wait_pending(drive, &drive->PendingIrps);
+
 	ExitThread(0);
 	return NULL;
 }
@@ -619,7 +744,17 @@ static void drive_free(DEVICE* device)
 
 	CloseHandle(drive->thread);
 
-	ListDictionary_Free(drive->files);
+	if (drive->ThreadPool)
+	{
+		DestroyThreadpoolEnvironment(&drive->ThreadPoolEnv);
+		CloseThreadpool(drive->ThreadPool);
+	}
+
+	CloseHandle(drive->PendingEvent);
+	DeleteCriticalSection(&drive->PendingLock);
+
+	HashTable_Free(drive->files);
+	drive_dir_cache_free(drive->dirCache);
 	MessageQueue_Free(drive->IrpQueue);
 
 	Stream_Free(drive->device.data, TRUE);
@@ -664,10 +799,28 @@ void drive_register_drive_path(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints, char*
 
 		drive->path = path;
 
-		drive->files = ListDictionary_New(TRUE);
-		ListDictionary_ValueObject(drive->files)->fnObjectFree = (OBJECT_FREE_FN) drive_file_free;
+		drive->files = HashTable_New(TRUE);
+		drive->files->hash = drive_file_id_hash;
+		drive->files->valueFree = (HASH_TABLE_VALUE_FREE_FN) drive_file_free;
+
+		drive->dirCache = drive_dir_cache_new();
 
 		drive->IrpQueue = MessageQueue_New(NULL);
+
+		InitializeCriticalSectionAndSpinCount(&drive->PendingLock, 4000);
+		drive->PendingEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+		drive->ThreadPool = CreateThreadpool(NULL);
+
+		if (drive->ThreadPool)
+		{
+			/* the winpr pool only starts threads up to its minimum, it never grows on demand */
+			SetThreadpoolThreadMaximum(drive->ThreadPool, DRIVE_WORKER_THREADS);
+			SetThreadpoolThreadMinimum(drive->ThreadPool, DRIVE_WORKER_THREADS);
+			InitializeThreadpoolEnvironment(&drive->ThreadPoolEnv);
+			SetThreadpoolCallbackPool(&drive->ThreadPoolEnv, drive->ThreadPool);
+		}
+
 		drive->thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) drive_thread_func, drive, CREATE_SUSPENDED, NULL);
 
 		pEntryPoints->RegisterDevice(pEntryPoints->devman, (DEVICE*) drive);
@@ -0,0 +1,469 @@
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/stream.h>
+#include <winpr/sysinfo.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <freerdp/channels/rdpdr.h>
+
+/**
+ * Drive redirection benchmark: a synthetic IRP stream, as a server copying
+ * a set of files would send it, is replayed against a temporary directory
+ * (on tmpfs when /dev/shm is available). Every file is written and read back
+ * in interleaved chunks with all IRPs outstanding at once, mixed with
+ * information and directory queries. Completions are checked for status and
+ * content, and the throughput of both passes is reported.
+ */
+
+#ifdef STATIC_CHANNELS
+#define TestDriveServiceEntry	drive_DeviceServiceEntry
+#else
+#define TestDriveServiceEntry	DeviceServiceEntry
+#endif
+
+int TestDriveServiceEntry(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints);
+
+#define TEST_DRIVE_FILES	16
+#define TEST_DRIVE_FILE_SIZE	(1024 * 1024)
+#define TEST_DRIVE_CHUNK_SIZE	(64 * 1024)
+
+typedef struct _TEST_DRIVE_IRP TEST_DRIVE_IRP;
+
+struct _TEST_DRIVE_IRP
+{
+	IRP irp;
+
+	UINT32 Index;
+	UINT64 Offset;
+	UINT32* FileId;
+};
+
+static DEVMAN* test_drive_devman = NULL;
+static DEVICE* test_drive_device = NULL;
+static HANDLE test_drive_semaphore = NULL;
+static LONG test_drive_errors = 0;
+static LONG test_drive_entries = 0;
+
+static BYTE test_drive_pattern(UINT32 index, UINT64 offset)
+{
+	return (BYTE) ((offset * 7) + (index * 13) + (offset >> 12));
+}
+
+static void test_drive_register_device(DEVMAN* devman, DEVICE* device)
+{
+	test_drive_devman = devman;
+	test_drive_device = device;
+}
+
+static void test_drive_irp_complete(IRP* irp)
+{
+	UINT32 i;
+	UINT32 Length;
+	BYTE* data;
+	TEST_DRIVE_IRP* test = (TEST_DRIVE_IRP*) irp;
+
+	Stream_SetPosition(irp->output, 0);
+
+	switch (irp->MajorFunction)
+	{
+		case IRP_MJ_CREATE:
+			Stream_Read_UINT32(irp->output, *test->FileId);
+
+			if ((irp->IoStatus != STATUS_SUCCESS) || !*test->FileId)
+				InterlockedIncrement(&test_drive_errors);
+			break;
+
+		case IRP_MJ_WRITE:
+			Stream_Read_UINT32(irp->output, Length);
+
+			if ((irp->IoStatus != STATUS_SUCCESS) || (Length != TEST_DRIVE_CHUNK_SIZE))
+				InterlockedIncrement(&test_drive_errors);
+			break;
+
+		case IRP_MJ_READ:
+			Stream_Read_UINT32(irp->output, Length);
+			data = Stream_Pointer(irp->output);
+
+			if ((irp->IoStatus != STATUS_SUCCESS) || (Length != TEST_DRIVE_CHUNK_SIZE))
+			{
+				InterlockedIncrement(&test_drive_errors);
+				break;
+			}
+
+			for (i = 0; i < Length; i++)
+			{
+				if (data[i] != test_drive_pattern(test->Index, test->Offset + i))
+				{
+					InterlockedIncrement(&test_drive_errors);
+					break;
+				}
+			}
+			break;
+
+		case IRP_MJ_DIRECTORY_CONTROL:
+			if (irp->IoStatus == STATUS_SUCCESS)
+				InterlockedIncrement(&test_drive_entries);
+			else if (irp->IoStatus != STATUS_NO_MORE_FILES)
+				InterlockedIncrement(&test_drive_errors);
+			break;
+
+		default:
+			if (irp->IoStatus != STATUS_SUCCESS)
+				InterlockedIncrement(&test_drive_errors);
+			break;
+	}
+
+	Stream_Free(irp->input, TRUE);
+	Stream_Free(irp->output, TRUE);
+	free(test);
+
+	ReleaseSemaphore(test_drive_semaphore, 1, NULL);
+}
+
+static TEST_DRIVE_IRP* test_drive_irp_new(UINT32 FileId, UINT32 MajorFunction, UINT32 MinorFunction, int size)
+{
+	TEST_DRIVE_IRP* test;
+
+	test = (TEST_DRIVE_IRP*) calloc(1, sizeof(TEST_DRIVE_IRP));
+
+	if (!test)
+		return NULL;
+
+	test->irp.device = test_drive_device;
+	test->irp.devman = test_drive_devman;
+	test->irp.FileId = FileId;
+	test->irp.MajorFunction = MajorFunction;
+	test->irp.MinorFunction = MinorFunction;
+	test->irp.input = Stream_New(NULL, size + 64);
+	test->irp.output = Stream_New(NULL, 256);
+	test->irp.Complete = test_drive_irp_complete;
+	test->irp.Discard = test_drive_irp_complete;
+
+	return test;
+}
+
+static void test_drive_irp_request(TEST_DRIVE_IRP* test)
+{
+	Stream_SealLength(test->irp.input);
+	Stream_SetPosition(test->irp.input, 0);
+
+	test_drive_device->IRPRequest(test_drive_device, &test->irp);
+}
+
+static void test_drive_write_path(wStream* s, const char* path)
+{
+	int length;
+	WCHAR* pathW = NULL;
+
+	length = ConvertToUnicode(CP_UTF8, 0, path, -1, &pathW, 0) * 2;
+
+	Stream_Write_UINT32(s, length); /* PathLength */
+	Stream_Write(s, pathW, length); /* Path */
+
+	free(pathW);
+}
+
+static void test_drive_create(const char* path, UINT32 CreateOptions, UINT32* FileId)
+{
+	TEST_DRIVE_IRP* test;
+
+	test = test_drive_irp_new(0, IRP_MJ_CREATE, 0, 512);
+	test->FileId = FileId;
+
+	Stream_Write_UINT32(test->irp.input, GENERIC_READ | GENERIC_WRITE); /* DesiredAccess */
+	Stream_Zero(test->irp.input, 16); /* AllocationSize(8), FileAttributes(4), SharedAccess(4) */
+	Stream_Write_UINT32(test->irp.input, FILE_OPEN_IF); /* CreateDisposition */
+	Stream_Write_UINT32(test->irp.input, CreateOptions); /* CreateOptions */
+	test_drive_write_path(test->irp.input, path);
+
+	test_drive_irp_request(test);
+}
+
+static void test_drive_close(UINT32 FileId)
+{
+	TEST_DRIVE_IRP* test;
+
+	test = test_drive_irp_new(FileId, IRP_MJ_CLOSE, 0, 32);
+	Stream_Zero(test->irp.input, 32); /* Padding */
+
+	test_drive_irp_request(test);
+}
+
+static void test_drive_read_write(UINT32 FileId, UINT32 index, UINT64 offset, BOOL write)
+{
+	UINT32 i;
+	BYTE* data;
+	TEST_DRIVE_IRP* test;
+
+	test = test_drive_irp_new(FileId, write ? IRP_MJ_WRITE : IRP_MJ_READ, 0,
+			write ? TEST_DRIVE_CHUNK_SIZE : 0);
+	test->Index = index;
+	test->Offset = offset;
+
+	Stream_Write_UINT32(test->irp.input, TEST_DRIVE_CHUNK_SIZE); /* Length */
+	Stream_Write_UINT64(test->irp.input, offset); /* Offset */
+	Stream_Zero(test->irp.input, 20); /* Padding */
+
+	if (write)
+	{
+		data = Stream_Pointer(test->irp.input);
+
+		for (i = 0; i < TEST_DRIVE_CHUNK_SIZE; i++)
+			data[i] = test_drive_pattern(index, offset + i);
+
+		Stream_Seek(test->irp.input, TEST_DRIVE_CHUNK_SIZE);
+	}
+
+	test_drive_irp_request(test);
+}
+
+static void test_drive_query_information(UINT32 FileId)
+{
+	TEST_DRIVE_IRP* test;
+
+	test = test_drive_irp_new(FileId, IRP_MJ_QUERY_INFORMATION, 0, 32);
+
+	Stream_Write_UINT32(test->irp.input, FileStandardInformation); /* FsInformationClass */
+	Stream_Zero(test->irp.input, 28); /* Length(4), Padding(24) */
+
+	test_drive_irp_request(test);
+}
+
+static void test_drive_query_directory(UINT32 FileId, BOOL InitialQuery)
+{
+	int length = 0;
+	WCHAR* pathW = NULL;
+	TEST_DRIVE_IRP* test;
+
+	test = test_drive_irp_new(FileId, IRP_MJ_DIRECTORY_CONTROL, IRP_MN_QUERY_DIRECTORY, 128);
+
+	if (InitialQuery)
+		length = ConvertToUnicode(CP_UTF8, 0, "\\*.dat", -1, &pathW, 0) * 2;
+
+	Stream_Write_UINT32(test->irp.input, FileBothDirectoryInformation); /* FsInformationClass */
+	Stream_Write_UINT8(test->irp.input, InitialQuery ? 1 : 0); /* InitialQuery */
+	Stream_Write_UINT32(test->irp.input, length); /* PathLength */
+	Stream_Zero(test->irp.input, 23); /* Padding */
+
+	if (length)
+		Stream_Write(test->irp.input, pathW, length); /* Path */
+
+	free(pathW);
+
+	test_drive_irp_request(test);
+}
+
+static void test_drive_wait(int count)
+{
+	while (count-- > 0)
+		WaitForSingleObject(test_drive_semaphore, INFINITE);
+}
+
+static int test_drive_pass(UINT32* FileIds, UINT32 DirId, BOOL write)
+{
+	int count = 0;
+	UINT32 index;
+	UINT64 offset;
+	ULONGLONG start;
+	ULONGLONG elapsed;
+
+	start = GetTickCount64();
+
+	if (!write)
+		test_drive_query_directory(DirId, TRUE);
+
+	for (offset = 0; offset < TEST_DRIVE_FILE_SIZE; offset += TEST_DRIVE_CHUNK_SIZE)
+	{
+		for (index = 0; index < TEST_DRIVE_FILES; index++)
+		{
+			test_drive_read_write(FileIds[index], index, offset, write);
+			count++;
+
+			if (!write && (offset == 0))
+			{
+				test_drive_query_information(FileIds[index]);
+				test_drive_query_directory(DirId, FALSE);
+				count += 2;
+			}
+		}
+	}
+
+	test_drive_wait(count + (write ? 0 : 1));
+
+	elapsed = GetTickCount64() - start;
+
+	printf("%s: %d IRPs, %d MiB in %d ms (%.1f MiB/s)\n", write ? "write" : "read",
+			count, (TEST_DRIVE_FILES * TEST_DRIVE_FILE_SIZE) / (1024 * 1024), (int) elapsed,
+			(TEST_DRIVE_FILES * (TEST_DRIVE_FILE_SIZE / (1024.0 * 1024.0))) * 1000.0 / (elapsed ? elapsed : 1));
+
+	return 0;
+}
+
+static void test_drive_remove_dir(const char* path)
+{
+#ifdef _WIN32
+	RemoveDirectoryA(path);
+#else
+	rmdir(path);
+#endif
+}
+
+static char* test_drive_temp_path(void)
+{
+	char* tempPath;
+	char name[64];
+	char* path;
+
+#ifndef _WIN32
+	if (PathFileExistsA("/dev/shm"))
+		tempPath = _strdup("/dev/shm");
+	else
+#endif
+		tempPath = GetKnownPath(KNOWN_PATH_TEMP);
+
+	if (!tempPath)
+		return NULL;
+
+	sprintf_s(name, sizeof(name), "TestDriveIrp.%u", (unsigned int) GetCurrentProcessId());
+	path = GetCombinedPath(tempPath, name);
+	free(tempPath);
+
+	if (path && !CreateDirectoryA(path, NULL))
+	{
+		free(path);
+		return NULL;
+	}
+
+	return path;
+}
+
+int TestDriveIrp(int argc, char* argv[])
+{
+	int rc = -1;
+	UINT32 index;
+	UINT32 DirId = 0;
+	UINT32 FileIds[TEST_DRIVE_FILES];
+	char name[64];
+	char* path;
+	char* filename;
+	DEVMAN devman;
+	RDPDR_DRIVE drive;
+	DEVICE_SERVICE_ENTRY_POINTS entryPoints;
+
+	path = test_drive_temp_path();
+	test_drive_semaphore = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+
+	if (!path || !test_drive_semaphore)
+		goto fail;
+
+	ZeroMemory(&devman, sizeof(DEVMAN));
+	ZeroMemory(&drive, sizeof(RDPDR_DRIVE));
+	ZeroMemory(&entryPoints, sizeof(DEVICE_SERVICE_ENTRY_POINTS));
+
+	devman.id_sequence = 1;
+	drive.Type = RDPDR_DTYP_FILESYSTEM;
+	drive.Name = "TEST";
+	drive.Path = _strdup(path);
+
+	entryPoints.devman = &devman;
+	entryPoints.RegisterDevice = test_drive_register_device;
+	entryPoints.device = (RDPDR_DEVICE*) &drive;
+
+	TestDriveServiceEntry(&entryPoints);
+
+	if (!test_drive_device)
+		goto fail;
+
+	for (index = 0; index < TEST_DRIVE_FILES; index++)
+	{
+		sprintf_s(name, sizeof(name), "\\file%02u.dat", index);
+		test_drive_create(name, FILE_NON_DIRECTORY_FILE, &FileIds[index]);
+	}
+
+	test_drive_create("\\", FILE_DIRECTORY_FILE, &DirId);
+	test_drive_wait(TEST_DRIVE_FILES + 1);
+
+	if (test_drive_errors)
+		goto cleanup;
+
+	test_drive_pass(FileIds, DirId, TRUE);
+	test_drive_pass(FileIds, DirId, FALSE);
+
+	for (index = 0; index < TEST_DRIVE_FILES; index++)
+		test_drive_close(FileIds[index]);
+
+	test_drive_close(DirId);
+	test_drive_wait(TEST_DRIVE_FILES + 1);
+
+	if (test_drive_entries != TEST_DRIVE_FILES)
+	{
+		printf("directory query returned %d entries, expected %d\n", (int) test_drive_entries, TEST_DRIVE_FILES);
+		goto cleanup;
+	}
+
+	/* a file removed behind the drive's back must not be listed again */
+
+	sprintf_s(name, sizeof(name), "file%02u.dat", TEST_DRIVE_FILES - 1);
+	filename = GetCombinedPath(path, name);
+
+	if (filename)
+		DeleteFileA(filename);
+
+	free(filename);
+
+	test_drive_entries = 0;
+	test_drive_create("\\", FILE_DIRECTORY_FILE, &DirId);
+	test_drive_wait(1);
+
+	test_drive_query_directory(DirId, TRUE);
+
+	for (index = 0; index < TEST_DRIVE_FILES; index++)
+		test_drive_query_directory(DirId, FALSE);
+
+	test_drive_close(DirId);
+	test_drive_wait(TEST_DRIVE_FILES + 2);
+
+	if (test_drive_entries != TEST_DRIVE_FILES - 1)
+		printf("directory query returned %d entries after a removal, expected %d\n",
+				(int) test_drive_entries, TEST_DRIVE_FILES - 1);
+	else if (test_drive_errors)
+		printf("%d IRPs failed\n", (int) test_drive_errors);
+	else
+		rc = 0;
+
+cleanup:
+	test_drive_device->Free(test_drive_device);
+	free(drive.Path);
+
+	for (index = 0; index < TEST_DRIVE_FILES; index++)
+	{
+		sprintf_s(name, sizeof(name), "file%02u.dat", index);
+		filename = GetCombinedPath(path, name);
+
+		if (filename)
+			DeleteFileA(filename);
+
+		free(filename);
+	}
+
+	test_drive_remove_dir(path);
+
+fail:
+	if (test_drive_semaphore)
+		CloseHandle(test_drive_semaphore);
+
+	free(path);
+
+	return rc;
+}
@@ -115,6 +115,109 @@ int rdpgfx_send_caps_advertise_pdu(RDPGFX_CHANNEL_CALLBACK* callback)
 	return status;
 }
 
+/**
+ * Offered entries stay pinned in the persistent cache until the reply is
+ * processed: the server assigns them cache slots without sending them again,
+ * so they must not be evicted in between.
+ */
+
+static void rdpgfx_release_cache_import_offer(RDPGFX_PLUGIN* gfx)
+{
+	UINT16 index;
+
+	if (gfx->persistent)
+	{
+		for (index = 0; index < gfx->CacheImportOfferCount; index++)
+			persistent_cache_pin(gfx->persistent, gfx->CacheImportOfferKeys[index], FALSE);
+	}
+
+	gfx->CacheImportOfferCount = 0;
+}
+
+int rdpgfx_send_cache_import_offer_pdu(RDPGFX_CHANNEL_CALLBACK* callback)
+{
+	int status;
+	wStream* s;
+	UINT32 index;
+	UINT32 count;
+	UINT64* keys;
+	RDPGFX_HEADER header;
+	PERSISTENT_CACHE_ENTRY entry;
+	RDPGFX_PLUGIN* gfx = (RDPGFX_PLUGIN*) callback->plugin;
+
+	/* the server accepts a single offer per connection */
+
+	if (!gfx->persistent || gfx->CacheImportOfferSent)
+		return 1;
+
+	gfx->CacheImportOfferSent = TRUE;
+	rdpgfx_release_cache_import_offer(gfx);
+
+	keys = (UINT64*) calloc(RDPGFX_CACHE_ENTRY_MAX_COUNT, sizeof(UINT64));
+
+	if (!keys)
+		return -1;
+
+	count = persistent_cache_get_key_list(gfx->persistent, 0, keys, RDPGFX_CACHE_ENTRY_MAX_COUNT);
+
+	if (count < 1)
+	{
+		free(keys);
+		return 1;
+	}
+
+	header.flags = 0;
+	header.cmdId = RDPGFX_CMDID_CACHEIMPORTOFFER;
+	header.pduLength = RDPGFX_HEADER_SIZE + 2 + (count * 12);
+
+	s = Stream_New(NULL, header.pduLength);
+
+	if (!s)
+	{
+		free(keys);
+		return -1;
+	}
+
+	rdpgfx_write_header(s, &header);
+
+	/* RDPGFX_CACHE_IMPORT_OFFER_PDU */
+
+	Stream_Seek_UINT16(s); /* cacheEntriesCount (2 bytes) */
+
+	/**
+	 * Looking up an entry refreshes its timestamp, so walk the list from the
+	 * least recently used end to keep the on-disk eviction order intact.
+	 */
+
+	for (index = count; index > 0; index--)
+	{
+		if (!persistent_cache_get(gfx->persistent, keys[index - 1], &entry))
+			continue;
+
+		persistent_cache_pin(gfx->persistent, entry.key64, TRUE);
+		gfx->CacheImportOfferKeys[gfx->CacheImportOfferCount++] = entry.key64;
+
+		Stream_Write_UINT64(s, entry.key64); /* cacheKey (8 bytes) */
+		Stream_Write_UINT32(s, entry.size); /* bitmapLength (4 bytes) */
+	}
+
+	free(keys);
+
+	Stream_SealLength(s);
+	Stream_SetPosition(s, 4);
+	Stream_Write_UINT32(s, Stream_Length(s)); /* pduLength (4 bytes) */
+	Stream_Write_UINT16(s, gfx->CacheImportOfferCount); /* cacheEntriesCount (2 bytes) */
+
+	WLog_Print(gfx->log, WLOG_DEBUG, "SendCacheImportOfferPdu: cacheEntriesCount: %d",
+			gfx->CacheImportOfferCount);
+
+	status = callback->channel->Write(callback->channel, (UINT32) Stream_Length(s), Stream_Buffer(s), NULL);
+
+	Stream_Free(s, TRUE);
+
+	return status;
+}
+
 int rdpgfx_recv_caps_confirm_pdu(RDPGFX_CHANNEL_CALLBACK* callback, wStream* s)
 {
 	RDPGFX_CAPSET capsSet;
@@ -136,6 +239,9 @@ int rdpgfx_recv_caps_confirm_pdu(RDPGFX_CHANNEL_CALLBACK* callback, wStream* s)
 	WLog_Print(gfx->log, WLOG_DEBUG, "RecvCapsConfirmPdu: version: 0x%04X flags: 0x%04X",
 			capsSet.version, capsSet.flags);
 
+	if (rdpgfx_send_cache_import_offer_pdu(callback) < 0)
+		return -1;
+
 	return 1;
 }
 
@@ -239,6 +345,9 @@ int rdpgfx_recv_evict_cache_entry_pdu(RDPGFX_CHANNEL_CALLBACK* callback, wStream
 
 	WLog_Print(gfx->log, WLOG_DEBUG, "RecvEvictCacheEntryPdu: cacheSlot: %d", pdu.cacheSlot);
 
+	if (pdu.cacheSlot < gfx->MaxCacheSlot)
+		gfx->CacheSlotKeys[pdu.cacheSlot] = 0;
+
 	if (context && context->EvictCacheEntry)
 	{
 		context->EvictCacheEntry(context, &pdu);
@@ -247,6 +356,65 @@ int rdpgfx_recv_evict_cache_entry_pdu(RDPGFX_CHANNEL_CALLBACK* callback, wStream
 	return 1;
 }
 
+static void rdpgfx_load_cache_import_reply(RDPGFX_PLUGIN* gfx, RDPGFX_CACHE_IMPORT_REPLY_PDU* pdu)
+{
+	UINT16 index;
+	UINT16 cacheSlot;
+	UINT64 cacheKey;
+	PERSISTENT_CACHE_ENTRY entry;
+	RDPGFX_EVICT_CACHE_ENTRY_PDU evict;
+	RdpgfxClientContext* context = (RdpgfxClientContext*) gfx->iface.pInterface;
+
+	if (!gfx->persistent || !context || !context->ImportCacheEntry)
+	{
+		rdpgfx_release_cache_import_offer(gfx);
+		return;
+	}
+
+	/* cacheSlots[i] is the slot assigned to the i-th offered entry, zero if it was rejected */
+
+	for (index = 0; index < pdu->importedEntriesCount; index++)
+	{
+		cacheSlot = pdu->cacheSlots[index];
+
+		if (index >= gfx->CacheImportOfferCount)
+			break;
+
+		if (!cacheSlot || (cacheSlot >= gfx->MaxCacheSlot))
+			continue;
+
+		cacheKey = gfx->CacheImportOfferKeys[index];
+
+		/* whatever the slot held before is stale either way */
+
+		if (gfx->CacheSlots[cacheSlot] && context->EvictCacheEntry)
+		{
+			evict.cacheSlot = cacheSlot;
+			context->EvictCacheEntry(context, &evict);
+		}
+
+		gfx->CacheSlotKeys[cacheSlot] = 0;
+
+		/**
+		 * The server now considers the slot filled. When the entry cannot be
+		 * loaded the slot is left empty, so that a Cache To Surface using it
+		 * is dropped instead of drawing unrelated pixels.
+		 */
+
+		if (!persistent_cache_get(gfx->persistent, cacheKey, &entry) ||
+				(context->ImportCacheEntry(context, cacheSlot, &entry) < 0))
+		{
+			WLog_Print(gfx->log, WLOG_WARN, "failed to import cache entry 0x%016llX into slot %d",
+					(unsigned long long) cacheKey, cacheSlot);
+			continue;
+		}
+
+		gfx->CacheSlotKeys[cacheSlot] = cacheKey;
+	}
+
+	rdpgfx_release_cache_import_offer(gfx);
+}
+
 int rdpgfx_recv_cache_import_reply_pdu(RDPGFX_CHANNEL_CALLBACK* callback, wStream* s)
 {
 	UINT16 index;
@@ -259,6 +427,9 @@ int rdpgfx_recv_cache_import_reply_pdu(RDPGFX_CHANNEL_CALLBACK* callback, wStrea
 
 	Stream_Read_UINT16(s, pdu.importedEntriesCount); /* cacheSlot (2 bytes) */
 
+	if (pdu.importedEntriesCount > RDPGFX_CACHE_ENTRY_MAX_COUNT)
+		return -1;
+
 	if (Stream_GetRemainingLength(s) < (size_t) (pdu.importedEntriesCount * 2))
 		return -1;
 
@@ -275,6 +446,8 @@ int rdpgfx_recv_cache_import_reply_pdu(RDPGFX_CHANNEL_CALLBACK* callback, wStrea
 	WLog_Print(gfx->log, WLOG_DEBUG, "RecvCacheImportReplyPdu: importedEntriesCount: %d",
 			pdu.importedEntriesCount);
 
+	rdpgfx_load_cache_import_reply(gfx, &pdu);
+
 	if (context && context->CacheImportReply)
 	{
 		context->CacheImportReply(context, &pdu);
@@ -603,6 +776,43 @@ int rdpgfx_recv_surface_to_surface_pdu(RDPGFX_CHANNEL_CALLBACK* callback, wStrea
 	return 1;
 }
 
+static void rdpgfx_save_cache_entry(RDPGFX_PLUGIN* gfx, UINT16 cacheSlot, UINT64 cacheKey)
+{
+	PERSISTENT_CACHE_ENTRY entry;
+	RdpgfxClientContext* context = (RdpgfxClientContext*) gfx->iface.pInterface;
+
+	if (cacheSlot >= gfx->MaxCacheSlot)
+		return;
+
+	gfx->CacheSlotKeys[cacheSlot] = cacheKey;
+
+	if (!gfx->persistent || !context || !context->ExportCacheEntry)
+		return;
+
+	/* already on disk: the lookup alone marks it as recently used */
+
+	if (persistent_cache_get(gfx->persistent, cacheKey, &entry))
+		return;
+
+	ZeroMemory(&entry, sizeof(PERSISTENT_CACHE_ENTRY));
+
+	entry.key64 = cacheKey;
+	entry.data = gfx->CacheExportBuffer;
+	entry.size = sizeof(gfx->CacheExportBuffer);
+
+	/* entries larger than a persistent cache slot are simply not kept */
+
+	if (context->ExportCacheEntry(context, cacheSlot, &entry) < 0)
+		return;
+
+	entry.cacheId = 0;
+	entry.bpp = 32;
+
+	if (!persistent_cache_put(gfx->persistent, &entry))
+		WLog_Print(gfx->log, WLOG_WARN, "failed to store cache entry 0x%016llX",
+				(unsigned long long) cacheKey);
+}
+
 int rdpgfx_recv_surface_to_cache_pdu(RDPGFX_CHANNEL_CALLBACK* callback, wStream* s)
 {
 	RDPGFX_SURFACE_TO_CACHE_PDU pdu;
@@ -625,7 +835,8 @@ int rdpgfx_recv_surface_to_cache_pdu(RDPGFX_CHANNEL_CALLBACK* callback, wStream*
 
 	if (context && context->SurfaceToCache)
 	{
-		context->SurfaceToCache(context, &pdu);
+		if (context->SurfaceToCache(context, &pdu) >= 0)
+			rdpgfx_save_cache_entry(gfx, pdu.cacheSlot, pdu.cacheKey);
 	}
 
 	return 1;
@@ -663,6 +874,14 @@ int rdpgfx_recv_cache_to_surface_pdu(RDPGFX_CHANNEL_CALLBACK* callback, wStream*
 	WLog_Print(gfx->log, WLOG_DEBUG, "RdpGfxRecvCacheToSurfacePdu: cacheSlot: %d surfaceId: %d destPtsCount: %d",
 			pdu.cacheSlot, (int) pdu.surfaceId, pdu.destPtsCount);
 
+	if (gfx->persistent && (pdu.cacheSlot < gfx->MaxCacheSlot) && gfx->CacheSlotKeys[pdu.cacheSlot])
+	{
+		PERSISTENT_CACHE_ENTRY entry;
+
+		/* refresh the entry so that it survives eviction from the file */
+		persistent_cache_get(gfx->persistent, gfx->CacheSlotKeys[pdu.cacheSlot], &entry);
+	}
+
 	if (context && context->CacheToSurface)
 	{
 		context->CacheToSurface(context, &pdu);
@@ -890,6 +1109,10 @@ static int rdpgfx_on_close(IWTSVirtualChannelCallback* pChannelCallback)
 
 	WLog_Print(gfx->log, WLOG_DEBUG, "OnClose");
 
+	/* a reconnect reusing the plugin offers the cache again */
+	rdpgfx_release_cache_import_offer(gfx);
+	gfx->CacheImportOfferSent = FALSE;
+
 	free(callback);
 
 	return 0;
@@ -994,6 +1217,8 @@ static int rdpgfx_plugin_terminated(IWTSPlugin* pPlugin)
 		}
 	}
 
+	persistent_cache_free(gfx->persistent);
+
 	free(context);
 
 	free(gfx);
@@ -1016,6 +1241,44 @@ int rdpgfx_set_surface_data(RdpgfxClientContext* context, UINT16 surfaceId, void
 	return 1;
 }
 
+int rdpgfx_get_surface_ids(RdpgfxClientContext* context, UINT16** ppSurfaceIds, UINT16* count_out)
+{
+	int count;
+	int index;
+	UINT16* pSurfaceIds;
+	ULONG_PTR* pKeys = NULL;
+	RDPGFX_PLUGIN* gfx = (RDPGFX_PLUGIN*) context->handle;
+
+	*ppSurfaceIds = NULL;
+	*count_out = 0;
+
+	count = HashTable_GetKeys(gfx->SurfaceTable, &pKeys);
+
+	if (count < 1)
+	{
+		free(pKeys);
+		return 1;
+	}
+
+	pSurfaceIds = (UINT16*) calloc(count, sizeof(UINT16));
+
+	if (!pSurfaceIds)
+	{
+		free(pKeys);
+		return -1;
+	}
+
+	for (index = 0; index < count; index++)
+		pSurfaceIds[index] = ((UINT16) pKeys[index]) - 1;
+
+	free(pKeys);
+
+	*ppSurfaceIds = pSurfaceIds;
+	*count_out = (UINT16) count;
+
+	return 1;
+}
+
 void* rdpgfx_get_surface_data(RdpgfxClientContext* context, UINT16 surfaceId)
 {
 	ULONG_PTR key;
@@ -1112,9 +1375,11 @@ int DVCPluginEntry(IDRDYNVC_ENTRY_POINTS* pEntryPoints)
 		}
 
 		context->handle = (void*) gfx;
+		context->MaxCacheSlots = gfx->MaxCacheSlot;
 
 		context->SetSurfaceData = rdpgfx_set_surface_data;
 		context->GetSurfaceData = rdpgfx_get_surface_data;
+		context->GetSurfaceIds = rdpgfx_get_surface_ids;
 		context->SetCacheSlotData = rdpgfx_set_cache_slot_data;
 		context->GetCacheSlotData = rdpgfx_get_cache_slot_data;
 
@@ -1129,6 +1394,20 @@ int DVCPluginEntry(IDRDYNVC_ENTRY_POINTS* pEntryPoints)
 			return -1;
 		}
 
+		if (gfx->settings->GfxCachePersistFile)
+		{
+			gfx->persistent = persistent_cache_new(RDPGFX_CACHE_ENTRY_MAX_COUNT);
+
+			if (gfx->persistent && (persistent_cache_open(gfx->persistent,
+					gfx->settings->GfxCachePersistFile, FALSE) < 0))
+			{
+				WLog_Print(gfx->log, WLOG_WARN, "unable to open persistent cache %s",
+						gfx->settings->GfxCachePersistFile);
+				persistent_cache_free(gfx->persistent);
+				gfx->persistent = NULL;
+			}
+		}
+
 		status = pEntryPoints->RegisterPlugin(pEntryPoints, "rdpgfx", (IWTSPlugin*) gfx);
 	}
 
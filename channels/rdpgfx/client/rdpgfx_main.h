@@ -77,6 +77,13 @@ struct _RDPGFX_PLUGIN
 
 	UINT16 MaxCacheSlot;
 	void* CacheSlots[25600];
+
+	rdpPersistentCache* persistent;
+	BOOL CacheImportOfferSent;
+	UINT16 CacheImportOfferCount;
+	UINT64 CacheImportOfferKeys[RDPGFX_CACHE_ENTRY_MAX_COUNT];
+	UINT64 CacheSlotKeys[25600];
+	BYTE CacheExportBuffer[PERSIST_CACHE_MAX_DATA_SIZE];
 };
 typedef struct _RDPGFX_PLUGIN RDPGFX_PLUGIN;
 
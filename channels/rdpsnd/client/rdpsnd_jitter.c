@@ -0,0 +1,233 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Output Virtual Channel - Jitter Buffer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+
+#include "rdpsnd_jitter.h"
+
+/* the delay covers this many mean deviations of the arrival time */
+#define RDPSND_JITTER_DEVIATIONS	4
+
+/* waves in a row with a surplus queued before one is dropped */
+#define RDPSND_JITTER_TRIM_WAVES	4
+#define RDPSND_JITTER_TRIM_MARGIN	80
+#define RDPSND_JITTER_TRIM_MARGIN_MAX	1280
+#define RDPSND_JITTER_TRIM_MEMORY	1000
+
+static void rdpsnd_jitter_update_delay(RDPSND_JITTER* jitter)
+{
+	UINT32 delay;
+
+	delay = jitter->minDelay + ((RDPSND_JITTER_DEVIATIONS * jitter->jitter + jitter->spike) >> 4);
+
+	if (delay > jitter->maxDelay)
+		delay = jitter->maxDelay;
+
+	jitter->targetDelay = delay;
+}
+
+/**
+ * Called for every wave as it arrives, returns RDPSND_JITTER_DROP if the
+ * wave should not be played to bring the latency down, otherwise the local
+ * time the wave will have finished playing is returned in pPlaybackEnd.
+ */
+
+int rdpsnd_jitter_wave(RDPSND_JITTER* jitter, UINT32 now, UINT16 wTimeStamp,
+		UINT16 wAudioLength, UINT32* pPlaybackEnd)
+{
+	INT32 level;
+	INT32 elapsed;
+	INT32 spacing;
+	UINT32 deviation;
+	BOOL paused;
+	int status = RDPSND_JITTER_PLAY;
+
+	level = (INT32) (jitter->playbackEnd - now);
+
+	/* the queue has been empty for longer than any delay, the server paused */
+	paused = jitter->playing && (level < -((INT32) jitter->maxDelay));
+
+	if (jitter->started && !paused)
+	{
+		elapsed = (INT32) (now - jitter->lastArrival);
+		spacing = (UINT16) (wTimeStamp - jitter->lastTimeStamp);
+
+		/* servers that do not fill in the timestamp send in real time */
+		if (!spacing)
+			spacing = jitter->lastAudioLength;
+
+		deviation = (UINT32) abs(elapsed - spacing);
+
+		if (deviation > jitter->maxDelay)
+			deviation = jitter->maxDelay;
+
+		jitter->jitter += deviation - ((jitter->jitter + 8) >> 4);
+	}
+
+	jitter->spike -= (jitter->spike >> 6);
+	rdpsnd_jitter_update_delay(jitter);
+
+	jitter->waves++;
+	jitter->lastArrival = now;
+	jitter->lastTimeStamp = wTimeStamp;
+	jitter->lastAudioLength = wAudioLength;
+
+	if (!jitter->started || (jitter->playing && (level < 0)))
+	{
+		if (jitter->started && !paused)
+		{
+			jitter->underruns++;
+			jitter->spike += ((UINT32) -level) << 4;
+
+			if (jitter->spike > (jitter->maxDelay << 4))
+				jitter->spike = jitter->maxDelay << 4;
+
+			rdpsnd_jitter_update_delay(jitter);
+			status = RDPSND_JITTER_UNDERRUN;
+		}
+
+		rdpsnd_jitter_reset(jitter);
+		jitter->started = TRUE;
+		jitter->startDelay = jitter->targetDelay;
+	}
+
+	if (!jitter->playing)
+	{
+		/* the device starts playing once the delay is buffered */
+		jitter->queued += wAudioLength;
+
+		if (jitter->queued >= jitter->startDelay)
+		{
+			jitter->playing = TRUE;
+			jitter->playbackEnd = now + jitter->queued;
+		}
+		else
+		{
+			jitter->playbackEnd = now + jitter->startDelay;
+		}
+
+		*pPlaybackEnd = jitter->playbackEnd;
+		return status;
+	}
+
+	/* the queue grew past the level the last wave was dropped from, a burst arrived */
+	if (jitter->trimLevel && (level > (INT32) (jitter->trimLevel + wAudioLength)))
+		jitter->trimLevel = 0;
+
+	if (level > (INT32) (jitter->targetDelay + jitter->trimMargin))
+	{
+		if (++jitter->surplus >= RDPSND_JITTER_TRIM_WAVES)
+		{
+			jitter->surplus = 0;
+
+			/**
+			 * If the queue is back at the level the last wave was dropped from,
+			 * the server refilled it: it keeps its own window of waves outstanding
+			 * instead of pacing on the confirms. Once that happened twice in a row
+			 * dropping does not help, back off.
+			 */
+			if (jitter->trimLevel && ((now - jitter->trimTime) < RDPSND_JITTER_TRIM_MEMORY) &&
+					(level + wAudioLength / 2 >= (INT32) jitter->trimLevel))
+				jitter->trimRefills++;
+			else
+				jitter->trimRefills = 0;
+
+			if (jitter->trimRefills >= 2)
+			{
+				jitter->trimMargin *= 2;
+				jitter->trimLevel = 0;
+				jitter->trimRefills = 0;
+
+				if (jitter->trimMargin > RDPSND_JITTER_TRIM_MARGIN_MAX)
+					jitter->trimMargin = RDPSND_JITTER_TRIM_MARGIN_MAX;
+			}
+			else
+			{
+				jitter->dropped++;
+				jitter->trimLevel = (UINT32) level;
+				jitter->trimTime = now;
+				*pPlaybackEnd = now;
+				return RDPSND_JITTER_DROP;
+			}
+		}
+	}
+	else
+	{
+		jitter->surplus = 0;
+	}
+
+	jitter->playbackEnd += wAudioLength;
+	*pPlaybackEnd = jitter->playbackEnd;
+
+	return status;
+}
+
+/**
+ * Devices that know their own playback delay report when a wave will have
+ * finished playing, which replaces the modelled time.
+ */
+
+void rdpsnd_jitter_played(RDPSND_JITTER* jitter, UINT32 playbackEnd)
+{
+	jitter->playing = TRUE;
+	jitter->playbackEnd = playbackEnd;
+}
+
+/**
+ * The stream restarts when the device is closed or changes format, the
+ * jitter estimate is kept as it belongs to the link.
+ */
+
+void rdpsnd_jitter_reset(RDPSND_JITTER* jitter)
+{
+	jitter->started = FALSE;
+	jitter->playing = FALSE;
+	jitter->queued = 0;
+	jitter->surplus = 0;
+	jitter->trimLevel = 0;
+	jitter->trimRefills = 0;
+	jitter->trimMargin = RDPSND_JITTER_TRIM_MARGIN;
+}
+
+RDPSND_JITTER* rdpsnd_jitter_new(UINT32 minDelay, UINT32 maxDelay)
+{
+	RDPSND_JITTER* jitter;
+
+	jitter = (RDPSND_JITTER*) calloc(1, sizeof(RDPSND_JITTER));
+
+	if (!jitter)
+		return NULL;
+
+	jitter->minDelay = minDelay;
+	jitter->maxDelay = (maxDelay > minDelay) ? maxDelay : minDelay;
+
+	rdpsnd_jitter_reset(jitter);
+	rdpsnd_jitter_update_delay(jitter);
+
+	return jitter;
+}
+
+void rdpsnd_jitter_free(RDPSND_JITTER* jitter)
+{
+	free(jitter);
+}
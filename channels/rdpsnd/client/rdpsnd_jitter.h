@@ -0,0 +1,83 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Output Virtual Channel - Jitter Buffer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RDPSND_JITTER_H
+#define __RDPSND_JITTER_H
+
+#include <winpr/wtypes.h>
+
+/* playback delay bounds in ms, the upper bound keeps audio in sync with video */
+#define RDPSND_JITTER_MIN_DELAY		40
+#define RDPSND_JITTER_MAX_DELAY		300
+
+#define RDPSND_JITTER_PLAY		0
+#define RDPSND_JITTER_UNDERRUN		1
+#define RDPSND_JITTER_DROP		2
+
+/**
+ * Adaptive jitter buffer: every wave updates an estimate of the arrival
+ * jitter (the mean deviation of the arrival spacing from the server
+ * timestamp spacing, as in RFC 3550) from which the playback delay is
+ * derived. The device is modelled as starting once the delay is buffered,
+ * after the first wave or after running dry, and then playing in real
+ * time, which gives the local time each wave has finished playing.
+ * Running dry raises the delay by how late the wave was, a queue that
+ * stays well above the delay is trimmed by dropping waves. All times are
+ * in ms of GetTickCount().
+ */
+
+struct _RDPSND_JITTER
+{
+	UINT32 minDelay;
+	UINT32 maxDelay;
+	UINT32 targetDelay;
+
+	BOOL started;
+	BOOL playing;
+	UINT32 queued;
+	UINT32 startDelay;
+
+	UINT32 lastArrival;
+	UINT16 lastTimeStamp;
+	UINT16 lastAudioLength;
+
+	UINT32 jitter; /* in 1/16 ms */
+	UINT32 spike; /* in 1/16 ms */
+	UINT32 playbackEnd;
+
+	UINT32 surplus;
+	UINT32 trimLevel;
+	UINT32 trimTime;
+	UINT32 trimRefills;
+	UINT32 trimMargin;
+
+	UINT32 waves;
+	UINT32 underruns;
+	UINT32 dropped;
+};
+typedef struct _RDPSND_JITTER RDPSND_JITTER;
+
+RDPSND_JITTER* rdpsnd_jitter_new(UINT32 minDelay, UINT32 maxDelay);
+void rdpsnd_jitter_free(RDPSND_JITTER* jitter);
+
+void rdpsnd_jitter_reset(RDPSND_JITTER* jitter);
+
+int rdpsnd_jitter_wave(RDPSND_JITTER* jitter, UINT32 now, UINT16 wTimeStamp,
+		UINT16 wAudioLength, UINT32* pPlaybackEnd);
+void rdpsnd_jitter_played(RDPSND_JITTER* jitter, UINT32 playbackEnd);
+
+#endif /* __RDPSND_JITTER_H */
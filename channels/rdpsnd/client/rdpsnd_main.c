@@ -45,12 +45,12 @@
 #include <freerdp/types.h>
 #include <freerdp/addin.h>
 #include <freerdp/constants.h>
+#include <freerdp/codec/dsp.h>
 #include <freerdp/channels/log.h>
 #include <freerdp/utils/signal.h>
 
 #include "rdpsnd_main.h"
-
-#define TIME_DELAY_MS	65
+#include "rdpsnd_jitter.h"
 
 struct rdpsnd_plugin
 {
@@ -66,6 +66,10 @@ struct rdpsnd_plugin
 	wLog* log;
 	HANDLE ScheduleThread;
 
+	wQueue* DroppedWaves;
+	UINT32 wavesPlayed;
+	UINT32 wavesConfirmed;
+
 	BYTE cBlockNo;
 	UINT16 wQualityMode;
 	int wCurrentFormatNo;
@@ -82,6 +86,13 @@ struct rdpsnd_plugin
 	UINT32 wTimeStamp;
 
 	int latency;
+	int deviceLatency;
+	RDPSND_JITTER* jitter;
+
+	BOOL decodeWave;
+	AUDIO_FORMAT deviceFormat;
+	FREERDP_DSP_CONTEXT* dsp_context;
+	wStream* decoded;
 	BOOL isOpen;
 	UINT16 fixedFormat;
 	UINT16 fixedChannel;
@@ -94,14 +105,25 @@ struct rdpsnd_plugin
 	rdpsndDevicePlugin* device;
 };
 
+/**
+ * Devices without a confirm thread confirm the waves they play from their
+ * own playback callback. Waves dropped in the meantime are held back until
+ * every wave played before them has been confirmed.
+ */
+
+struct rdpsnd_dropped_wave
+{
+	RDPSND_WAVE* wave;
+	UINT32 sequence;
+};
+typedef struct rdpsnd_dropped_wave RDPSND_DROPPED_WAVE;
+
 static void rdpsnd_confirm_wave(rdpsndPlugin* rdpsnd, RDPSND_WAVE* wave);
 
 static void* rdpsnd_schedule_thread(void* arg)
 {
 	wMessage message;
-	UINT16 wTimeDiff;
-	UINT16 wTimeStamp;
-	UINT16 wCurrentTime;
+	INT32 wTimeDiff;
 	RDPSND_WAVE* wave;
 	rdpsndPlugin* rdpsnd = (rdpsndPlugin*) arg;
 
@@ -117,14 +139,12 @@ static void* rdpsnd_schedule_thread(void* arg)
 			break;
 
 		wave = (RDPSND_WAVE*) message.wParam;
-		wCurrentTime = (UINT16) GetTickCount();
-		wTimeStamp = wave->wLocalTimeB;
 
-		if (wCurrentTime <= wTimeStamp)
-		{
-			wTimeDiff = wTimeStamp - wCurrentTime;
-			Sleep(wTimeDiff);
-		}
+		/* confirm once the wave has been played, the server paces itself on it */
+		wTimeDiff = (INT32) (wave->wLocalTimeB - GetTickCount());
+
+		if (wTimeDiff > 0)
+			Sleep((DWORD) wTimeDiff);
 
 		rdpsnd_confirm_wave(rdpsnd, wave);
 
@@ -151,6 +171,39 @@ void rdpsnd_send_quality_mode_pdu(rdpsndPlugin* rdpsnd)
 	rdpsnd_virtual_channel_write(rdpsnd, pdu);
 }
 
+/**
+ * Compressed formats the device does not play itself are decoded by the
+ * channel, the device then plays the PCM they decode to.
+ */
+
+static BOOL rdpsnd_format_supported(rdpsndPlugin* rdpsnd, AUDIO_FORMAT* format)
+{
+	AUDIO_FORMAT pcm;
+
+	if (rdpsnd->device->FormatSupported(rdpsnd->device, format))
+		return TRUE;
+
+	if (!freerdp_dsp_supports_format(format, FALSE))
+		return FALSE;
+
+	freerdp_dsp_get_pcm_format(format, &pcm);
+
+	return rdpsnd->device->FormatSupported(rdpsnd->device, &pcm);
+}
+
+static AUDIO_FORMAT* rdpsnd_get_device_format(rdpsndPlugin* rdpsnd, AUDIO_FORMAT* format)
+{
+	rdpsnd->decodeWave = !rdpsnd->device->FormatSupported(rdpsnd->device, format);
+
+	if (!rdpsnd->decodeWave)
+		return format;
+
+	freerdp_dsp_get_pcm_format(format, &rdpsnd->deviceFormat);
+	freerdp_dsp_context_reset(rdpsnd->dsp_context);
+
+	return &rdpsnd->deviceFormat;
+}
+
 void rdpsnd_select_supported_audio_formats(rdpsndPlugin* rdpsnd)
 {
 	int index;
@@ -178,7 +231,7 @@ void rdpsnd_select_supported_audio_formats(rdpsndPlugin* rdpsnd)
 		if (rdpsnd->fixedRate > 0 && (rdpsnd->fixedRate != serverFormat->nSamplesPerSec))
 			continue;
 
-		if (rdpsnd->device && rdpsnd->device->FormatSupported(rdpsnd->device, serverFormat))
+		if (rdpsnd->device && rdpsnd_format_supported(rdpsnd, serverFormat))
 		{
 			clientFormat = &rdpsnd->ClientFormats[rdpsnd->NumberOfClientFormats++];
 
@@ -356,6 +409,19 @@ static void rdpsnd_recv_training_pdu(rdpsndPlugin* rdpsnd, wStream* s)
 	rdpsnd_send_training_confirm_pdu(rdpsnd, wTimeStamp, wPackSize);
 }
 
+/**
+ * The device buffers as much audio as the jitter buffer delays playback,
+ * unless a fixed latency was given.
+ */
+
+static int rdpsnd_get_device_latency(rdpsndPlugin* rdpsnd)
+{
+	if (rdpsnd->latency > 0)
+		return rdpsnd->latency;
+
+	return (int) rdpsnd->jitter->targetDelay;
+}
+
 static void rdpsnd_recv_wave_info_pdu(rdpsndPlugin* rdpsnd, wStream* s, UINT16 BodySize)
 {
 	UINT16 wFormatNo;
@@ -385,7 +451,10 @@ static void rdpsnd_recv_wave_info_pdu(rdpsndPlugin* rdpsnd, wStream* s, UINT16 B
 
 		if (rdpsnd->device)
 		{
-			IFCALL(rdpsnd->device->Open, rdpsnd->device, format, rdpsnd->latency);
+			rdpsnd->deviceLatency = rdpsnd_get_device_latency(rdpsnd);
+			rdpsnd_jitter_reset(rdpsnd->jitter);
+			format = rdpsnd_get_device_format(rdpsnd, format);
+			IFCALL(rdpsnd->device->Open, rdpsnd->device, format, rdpsnd->deviceLatency);
 		}
 	}
 	else if (wFormatNo != rdpsnd->wCurrentFormatNo)
@@ -394,7 +463,10 @@ static void rdpsnd_recv_wave_info_pdu(rdpsndPlugin* rdpsnd, wStream* s, UINT16 B
 
 		if (rdpsnd->device)
 		{
-			IFCALL(rdpsnd->device->SetFormat, rdpsnd->device, format, rdpsnd->latency);
+			rdpsnd->deviceLatency = rdpsnd_get_device_latency(rdpsnd);
+			rdpsnd_jitter_reset(rdpsnd->jitter);
+			format = rdpsnd_get_device_format(rdpsnd, format);
+			IFCALL(rdpsnd->device->SetFormat, rdpsnd->device, format, rdpsnd->deviceLatency);
 		}
 	}
 }
@@ -422,17 +494,130 @@ void rdpsnd_confirm_wave(rdpsndPlugin* rdpsnd, RDPSND_WAVE* wave)
 	rdpsnd_send_wave_confirm_pdu(rdpsnd, wave->wTimeStampB, wave->cBlockNo);
 }
 
-static void rdpsnd_device_send_wave_confirm_pdu(rdpsndDevicePlugin* device, RDPSND_WAVE* wave)
+static void rdpsnd_free_dropped_wave(RDPSND_DROPPED_WAVE* dropped)
 {
-	if (device->DisableConfirmThread)
-		rdpsnd_confirm_wave(device->rdpsnd, wave);
+	free(dropped->wave);
+	free(dropped);
+}
+
+/**
+ * Confirms the dropped waves that are no longer behind a played wave,
+ * or all of them when the device will not confirm what it still holds.
+ */
+
+static void rdpsnd_confirm_dropped_waves(rdpsndPlugin* rdpsnd, BOOL flush)
+{
+	RDPSND_DROPPED_WAVE* dropped;
+
+	Queue_Lock(rdpsnd->DroppedWaves);
+
+	while ((dropped = (RDPSND_DROPPED_WAVE*) Queue_Peek(rdpsnd->DroppedWaves)) != NULL)
+	{
+		if (!flush && ((INT32) (rdpsnd->wavesConfirmed - dropped->sequence) < 0))
+			break;
+
+		Queue_Dequeue(rdpsnd->DroppedWaves);
+		rdpsnd_confirm_wave(rdpsnd, dropped->wave);
+		rdpsnd_free_dropped_wave(dropped);
+	}
+
+	if (flush)
+		rdpsnd->wavesConfirmed = rdpsnd->wavesPlayed;
+
+	Queue_Unlock(rdpsnd->DroppedWaves);
+}
+
+static void rdpsnd_drop_wave(rdpsndPlugin* rdpsnd, RDPSND_WAVE* wave)
+{
+	RDPSND_DROPPED_WAVE* dropped;
+
+	if (!rdpsnd->device->DisableConfirmThread)
+	{
+		/* queued behind the waves still playing so that blocks are confirmed in order */
+		rdpsnd->device->WaveConfirm(rdpsnd->device, wave);
+		return;
+	}
+
+	Queue_Lock(rdpsnd->DroppedWaves);
+
+	if ((Queue_Count(rdpsnd->DroppedWaves) < 1) &&
+			((INT32) (rdpsnd->wavesConfirmed - rdpsnd->wavesPlayed) >= 0))
+	{
+		rdpsnd_confirm_wave(rdpsnd, wave);
+		free(wave);
+	}
 	else
-		MessageQueue_Post(device->rdpsnd->MsgPipe->Out, NULL, 0, (void*) wave, NULL);
+	{
+		dropped = (RDPSND_DROPPED_WAVE*) malloc(sizeof(RDPSND_DROPPED_WAVE));
+
+		if (dropped)
+		{
+			dropped->wave = wave;
+			dropped->sequence = rdpsnd->wavesPlayed;
+		}
+
+		if (!dropped || !Queue_Enqueue(rdpsnd->DroppedWaves, dropped))
+		{
+			free(dropped);
+			rdpsnd_confirm_wave(rdpsnd, wave);
+			free(wave);
+		}
+	}
+
+	Queue_Unlock(rdpsnd->DroppedWaves);
+}
+
+static void rdpsnd_device_send_wave_confirm_pdu(rdpsndDevicePlugin* device, RDPSND_WAVE* wave)
+{
+	rdpsndPlugin* rdpsnd = device->rdpsnd;
+
+	if (!device->DisableConfirmThread)
+	{
+		MessageQueue_Post(rdpsnd->MsgPipe->Out, NULL, 0, (void*) wave, NULL);
+		return;
+	}
+
+	Queue_Lock(rdpsnd->DroppedWaves);
+
+	rdpsnd_confirm_wave(rdpsnd, wave);
+	rdpsnd->wavesConfirmed++;
+	rdpsnd_confirm_dropped_waves(rdpsnd, FALSE);
+
+	Queue_Unlock(rdpsnd->DroppedWaves);
+}
+
+/**
+ * After an underrun the device queue is empty, which is the moment to
+ * resize its buffer to the new playback delay.
+ */
+
+static void rdpsnd_resize_device_buffer(rdpsndPlugin* rdpsnd, AUDIO_FORMAT* format)
+{
+	int latency;
+
+	if (rdpsnd->latency > 0)
+		return;
+
+	latency = rdpsnd_get_device_latency(rdpsnd);
+
+	if (latency == rdpsnd->deviceLatency)
+		return;
+
+	WLog_Print(rdpsnd->log, WLOG_DEBUG, "Device latency: %d ms -> %d ms",
+			rdpsnd->deviceLatency, latency);
+
+	rdpsnd->deviceLatency = latency;
+
+	if (rdpsnd->decodeWave)
+		format = &rdpsnd->deviceFormat;
+
+	IFCALL(rdpsnd->device->SetFormat, rdpsnd->device, format, latency);
 }
 
 static void rdpsnd_recv_wave_pdu(rdpsndPlugin* rdpsnd, wStream* s)
 {
 	int size;
+	int status;
 	BYTE* data;
 	RDPSND_WAVE* wave;
 	AUDIO_FORMAT* format;
@@ -477,6 +662,56 @@ static void rdpsnd_recv_wave_pdu(rdpsndPlugin* rdpsnd, wStream* s)
 		return;
 	}
 
+	status = rdpsnd_jitter_wave(rdpsnd->jitter, wave->wLocalTimeA, wave->wTimeStampA,
+			wave->wAudioLength, &wave->wLocalTimeB);
+
+	if ((status != RDPSND_JITTER_DROP) && rdpsnd->decodeWave)
+	{
+		Stream_SetPosition(rdpsnd->decoded, 0);
+
+		if (freerdp_dsp_decode(rdpsnd->dsp_context, format, data, size, rdpsnd->decoded))
+		{
+			data = Stream_Buffer(rdpsnd->decoded);
+			size = (int) Stream_GetPosition(rdpsnd->decoded);
+			wave->data = data;
+			wave->length = size;
+		}
+		else
+		{
+			/* confirmed without being played, as a dropped wave */
+			WLog_Print(rdpsnd->log, WLOG_ERROR, "Wave decoding failed: cBlockNo: %d format: %s",
+					wave->cBlockNo, rdpsnd_get_audio_tag_string(format->wFormatTag));
+			status = RDPSND_JITTER_DROP;
+		}
+	}
+
+	if (status == RDPSND_JITTER_DROP)
+	{
+		/* too much audio is queued, skip this wave to bring the latency down */
+		WLog_Print(rdpsnd->log, WLOG_DEBUG, "Wave dropped: cBlockNo: %d delay: %d ms",
+				wave->cBlockNo, rdpsnd->jitter->targetDelay);
+
+		wave->wTimeStampB = wave->wTimeStampA;
+		rdpsnd_drop_wave(rdpsnd, wave);
+		return;
+	}
+
+	if (status == RDPSND_JITTER_UNDERRUN)
+	{
+		WLog_Print(rdpsnd->log, WLOG_DEBUG, "Underrun: cBlockNo: %d jitter: %d ms delay: %d ms",
+				wave->cBlockNo, rdpsnd->jitter->jitter >> 4, rdpsnd->jitter->targetDelay);
+
+		rdpsnd_resize_device_buffer(rdpsnd, format);
+	}
+
+	if (rdpsnd->device->DisableConfirmThread)
+	{
+		/* counted before the device can confirm it from its playback callback */
+		Queue_Lock(rdpsnd->DroppedWaves);
+		rdpsnd->wavesPlayed++;
+		Queue_Unlock(rdpsnd->DroppedWaves);
+	}
+
 	if (rdpsnd->device->WaveDecode)
 	{
 		IFCALL(rdpsnd->device->WaveDecode, rdpsnd->device, wave);
@@ -493,8 +728,12 @@ static void rdpsnd_recv_wave_pdu(rdpsndPlugin* rdpsnd, wStream* s)
 
 	if (!rdpsnd->device->WavePlay)
 	{
-		wave->wTimeStampB = rdpsnd->wTimeStamp + wave->wAudioLength + TIME_DELAY_MS;
-		wave->wLocalTimeB = wave->wLocalTimeA + wave->wAudioLength + TIME_DELAY_MS;
+		/* the wave is confirmed when the jitter buffer expects it to have been played */
+		wave->wTimeStampB = wave->wTimeStampA + (UINT16) (wave->wLocalTimeB - wave->wLocalTimeA);
+	}
+	else if (wave->AutoConfirm)
+	{
+		rdpsnd_jitter_played(rdpsnd->jitter, wave->wLocalTimeB);
 	}
 
 	if (wave->AutoConfirm)
@@ -510,6 +749,9 @@ static void rdpsnd_recv_close_pdu(rdpsndPlugin* rdpsnd)
 		IFCALL(rdpsnd->device->Close, rdpsnd->device);
 	}
 
+	/* waves the device gave up on are never confirmed, release the ones held behind them */
+	rdpsnd_confirm_dropped_waves(rdpsnd, TRUE);
+
 	rdpsnd->isOpen = FALSE;
 }
 
@@ -798,12 +1040,50 @@ static void rdpsnd_process_connect(rdpsndPlugin* rdpsnd)
 		return;
 	}
 
+	/* a fixed latency disables the adaptive playback delay */
+	if (rdpsnd->latency > 0)
+		rdpsnd->jitter = rdpsnd_jitter_new(rdpsnd->latency, rdpsnd->latency);
+	else
+		rdpsnd->jitter = rdpsnd_jitter_new(RDPSND_JITTER_MIN_DELAY, RDPSND_JITTER_MAX_DELAY);
+
+	if (!rdpsnd->jitter)
+	{
+		WLog_ERR(TAG, "unable to create jitter buffer.");
+		goto fail;
+	}
+
+	rdpsnd->dsp_context = freerdp_dsp_context_new();
+
+	if (!rdpsnd->dsp_context)
+	{
+		WLog_ERR(TAG, "unable to create dsp context.");
+		goto fail;
+	}
+
+	rdpsnd->decoded = Stream_New(NULL, 4096);
+
+	if (!rdpsnd->decoded)
+	{
+		WLog_ERR(TAG, "unable to allocate decode buffer.");
+		goto fail;
+	}
+
 	if (!rdpsnd->device->DisableConfirmThread)
 	{
 		rdpsnd->ScheduleThread = CreateThread(NULL, 0,
 			(LPTHREAD_START_ROUTINE) rdpsnd_schedule_thread,
 			(void*) rdpsnd, 0, NULL);
 	}
+
+	return;
+
+fail:
+	rdpsnd_jitter_free(rdpsnd->jitter);
+	rdpsnd->jitter = NULL;
+	freerdp_dsp_context_free(rdpsnd->dsp_context);
+	rdpsnd->dsp_context = NULL;
+	IFCALL(rdpsnd->device->Free, rdpsnd->device);
+	rdpsnd->device = NULL;
 }
 
 
@@ -996,6 +1276,9 @@ static void rdpsnd_virtual_channel_event_connected(rdpsndPlugin* plugin, LPVOID
 
 	plugin->MsgPipe = MessagePipe_New();
 
+	plugin->DroppedWaves = Queue_New(TRUE, -1, -1);
+	Queue_Object(plugin->DroppedWaves)->fnObjectFree = (OBJECT_FREE_FN) rdpsnd_free_dropped_wave;
+
 	plugin->thread = CreateThread(NULL, 0,
 			(LPTHREAD_START_ROUTINE) rdpsnd_virtual_channel_client_thread, (void*) plugin, 0, NULL);
 }
@@ -1025,6 +1308,24 @@ static void rdpsnd_virtual_channel_event_terminated(rdpsndPlugin* rdpsnd)
 	if (rdpsnd->device)
 		IFCALL(rdpsnd->device->Free, rdpsnd->device);
 
+	if (rdpsnd->DroppedWaves)
+	{
+		Queue_Free(rdpsnd->DroppedWaves);
+		rdpsnd->DroppedWaves = NULL;
+	}
+
+	rdpsnd_jitter_free(rdpsnd->jitter);
+	rdpsnd->jitter = NULL;
+
+	freerdp_dsp_context_free(rdpsnd->dsp_context);
+	rdpsnd->dsp_context = NULL;
+
+	if (rdpsnd->decoded)
+	{
+		Stream_Free(rdpsnd->decoded, TRUE);
+		rdpsnd->decoded = NULL;
+	}
+
 	free(rdpsnd->subsystem);
 	rdpsnd->subsystem = NULL;
 
@@ -0,0 +1,279 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+#include "rdpsnd_jitter.h"
+
+/**
+ * Jitter buffer simulation: waves of a fixed length are sent in real time
+ * and arrive in order over a link with a synthetic delay. They are written
+ * to a null playback device which starts once its buffer holds the device
+ * latency and plays in real time, counting every time it runs dry. The
+ * latency and underruns once the buffer settled are compared to a fixed
+ * delay, and the confirm times against the time the device played a wave.
+ * The clock starts just before the 32 bit tick count wraps.
+ */
+
+#define TEST_JITTER_WAVE_LENGTH	20
+#define TEST_JITTER_WAVES	3000
+#define TEST_JITTER_SETTLE	250
+#define TEST_JITTER_CLOCK	(0xFFFFFFFF - 5000)
+
+#define TEST_JITTER_STEADY	0
+#define TEST_JITTER_JITTERY	1
+#define TEST_JITTER_STALL	2
+#define TEST_JITTER_WINDOW	3
+
+struct _TEST_JITTER_DEVICE
+{
+	UINT32 prebuf;
+	BOOL playing;
+	UINT32 clock;
+	INT32 level;
+	UINT32 underruns;
+};
+typedef struct _TEST_JITTER_DEVICE TEST_JITTER_DEVICE;
+
+struct _TEST_JITTER_RESULT
+{
+	UINT32 underruns;
+	UINT32 dropped;
+	UINT32 delay;
+	double latency;
+	double error;
+	UINT32 maxLatency;
+};
+typedef struct _TEST_JITTER_RESULT TEST_JITTER_RESULT;
+
+static const char* g_Schedules[] = { "steady", "jittery", "stall", "window" };
+
+static UINT32 g_Seed = 1;
+
+static UINT32 test_jitter_random(UINT32 range)
+{
+	g_Seed = g_Seed * 1103515245 + 12345;
+	return ((g_Seed >> 16) & 0x7FFF) % (range + 1);
+}
+
+static void test_jitter_device_advance(TEST_JITTER_DEVICE* device, UINT32 now)
+{
+	if (device->playing)
+	{
+		device->level -= (INT32) (now - device->clock);
+
+		if (device->level < 0)
+		{
+			device->underruns++;
+			device->playing = FALSE;
+			device->level = 0;
+		}
+	}
+
+	device->clock = now;
+}
+
+/* returns the time the wave has been played, or 0 if the device has not started */
+static UINT32 test_jitter_device_play(TEST_JITTER_DEVICE* device, UINT32 now, UINT32 length)
+{
+	test_jitter_device_advance(device, now);
+	device->level += length;
+
+	if (!device->playing && ((UINT32) device->level >= device->prebuf))
+		device->playing = TRUE;
+
+	return device->playing ? now + device->level : 0;
+}
+
+/* network delay of a wave sent at the given time */
+static UINT32 test_jitter_link_delay(int schedule, UINT32 index)
+{
+	switch (schedule)
+	{
+		case TEST_JITTER_JITTERY:
+			/* mostly up to 60 ms, one wave in twenty up to 200 ms */
+			if (test_jitter_random(19) == 0)
+				return 30 + test_jitter_random(200);
+			return 30 + test_jitter_random(60);
+
+		case TEST_JITTER_STALL:
+			/* the link stalls for 800 ms every 15 s */
+			if ((index % 750) == 500)
+				return 30 + 800;
+			return 30 + test_jitter_random(2);
+
+		default:
+			return 30 + test_jitter_random(2);
+	}
+}
+
+static BOOL test_jitter_run(int schedule, UINT32 minDelay, UINT32 maxDelay, TEST_JITTER_RESULT* result)
+{
+	int status;
+	UINT32 index;
+	UINT32 send;
+	UINT32 lastSend = 0;
+	UINT32 arrival;
+	UINT32 lastArrival = 0;
+	UINT32 stallEnd = 0;
+	UINT32 delay;
+	UINT32 played;
+	UINT32 expected;
+	UINT32 latency;
+	UINT32 samples = 0;
+	UINT32 measured = 0;
+	UINT32 underruns = 0;
+	UINT32 confirms[TEST_JITTER_WAVES];
+	RDPSND_JITTER* jitter;
+	TEST_JITTER_DEVICE device = { 0 };
+
+	ZeroMemory(result, sizeof(TEST_JITTER_RESULT));
+	g_Seed = 1;
+
+	jitter = rdpsnd_jitter_new(minDelay, maxDelay);
+
+	if (!jitter)
+		return FALSE;
+
+	device.prebuf = jitter->targetDelay;
+	device.clock = TEST_JITTER_CLOCK;
+
+	for (index = 0; index < TEST_JITTER_WAVES; index++)
+	{
+		send = TEST_JITTER_CLOCK + index * TEST_JITTER_WAVE_LENGTH;
+
+		/* the server keeps ten waves outstanding, it sends as soon as the oldest is confirmed */
+		if (schedule == TEST_JITTER_WINDOW)
+		{
+			send = TEST_JITTER_CLOCK;
+
+			if (index >= 10)
+				send = confirms[index - 10];
+
+			if (index && ((INT32) (lastSend - send) > 0))
+				send = lastSend;
+
+			lastSend = send;
+		}
+
+		delay = test_jitter_link_delay(schedule, index);
+		arrival = send + delay;
+
+		/* the link is in order: a delayed wave holds back the ones after it */
+		if (delay > 500)
+			stallEnd = arrival;
+
+		if (index && ((INT32) (lastArrival - arrival) > 0))
+			arrival = lastArrival;
+
+		if (stallEnd && ((INT32) (stallEnd - arrival) > 0))
+			arrival = stallEnd;
+
+		lastArrival = arrival;
+
+		status = rdpsnd_jitter_wave(jitter, arrival, (UINT16) send, TEST_JITTER_WAVE_LENGTH, &expected);
+		confirms[index] = expected;
+
+		if (status == RDPSND_JITTER_DROP)
+			continue;
+
+		/* the device buffer is resized to the new delay while it is empty */
+		if (status == RDPSND_JITTER_UNDERRUN)
+			device.prebuf = jitter->startDelay;
+
+		played = test_jitter_device_play(&device, arrival, TEST_JITTER_WAVE_LENGTH);
+
+		if (index < TEST_JITTER_SETTLE)
+		{
+			underruns = device.underruns;
+			continue;
+		}
+
+		if (!played)
+			continue;
+
+		latency = played - arrival;
+		result->latency += latency;
+		result->error += abs((INT32) (expected - played));
+		samples++;
+
+		/* after a stall the latency must come back within a few seconds */
+		if ((schedule != TEST_JITTER_STALL) || ((index % 750) < 500) || ((index % 750) >= 500 + 200))
+		{
+			if (latency > result->maxLatency)
+				result->maxLatency = latency;
+			measured++;
+		}
+	}
+
+	result->underruns = device.underruns - underruns;
+	result->dropped = jitter->dropped;
+	result->delay = jitter->targetDelay;
+
+	if (samples)
+	{
+		result->latency /= samples;
+		result->error /= samples;
+	}
+
+	rdpsnd_jitter_free(jitter);
+
+	return (samples > 0) && (measured > 0);
+}
+
+int TestRdpsndJitter(int argc, char* argv[])
+{
+	int schedule;
+	TEST_JITTER_RESULT adaptive;
+	TEST_JITTER_RESULT fixed;
+
+	for (schedule = TEST_JITTER_STEADY; schedule <= TEST_JITTER_WINDOW; schedule++)
+	{
+		if (!test_jitter_run(schedule, RDPSND_JITTER_MIN_DELAY, RDPSND_JITTER_MAX_DELAY, &adaptive))
+			return -1;
+
+		/* a fixed delay, as set with the latency option */
+		if (!test_jitter_run(schedule, 65, 65, &fixed))
+			return -1;
+
+		printf("%-7s adaptive: delay %3u ms latency %5.1f ms (max %3u ms) underruns %2u dropped %2u confirm error %4.1f ms\n",
+				g_Schedules[schedule], adaptive.delay, adaptive.latency, adaptive.maxLatency,
+				adaptive.underruns, adaptive.dropped, adaptive.error);
+		printf("%-7s fixed:    delay %3u ms latency %5.1f ms (max %3u ms) underruns %2u dropped %2u confirm error %4.1f ms\n",
+				g_Schedules[schedule], fixed.delay, fixed.latency, fixed.maxLatency,
+				fixed.underruns, fixed.dropped, fixed.error);
+
+		/* confirms within a wave of the time the device played it */
+		if (adaptive.error > TEST_JITTER_WAVE_LENGTH)
+			return -1;
+
+		/* audio stays within the bound kept for audio-video sync */
+		if (adaptive.maxLatency > RDPSND_JITTER_MAX_DELAY + 2 * TEST_JITTER_WAVE_LENGTH)
+			return -1;
+
+		switch (schedule)
+		{
+			case TEST_JITTER_STEADY:
+				if (adaptive.underruns || adaptive.dropped ||
+						(adaptive.latency > RDPSND_JITTER_MIN_DELAY + 2 * TEST_JITTER_WAVE_LENGTH))
+					return -1;
+				break;
+
+			case TEST_JITTER_JITTERY:
+				if ((adaptive.underruns > 10) || (adaptive.underruns * 3 > fixed.underruns))
+					return -1;
+				break;
+
+			case TEST_JITTER_STALL:
+				if (!adaptive.dropped)
+					return -1;
+				break;
+
+			case TEST_JITTER_WINDOW:
+				if (adaptive.underruns || (adaptive.dropped > 3))
+					return -1;
+				break;
+		}
+	}
+
+	return 0;
+}
@@ -59,9 +59,17 @@ BOOL rdpsnd_server_send_formats(RdpsndServerContext* context, wStream* s)
 		Stream_Write_UINT16(s, context->server_formats[i].nChannels); /* nChannels */
 		Stream_Write_UINT32(s, context->server_formats[i].nSamplesPerSec); /* nSamplesPerSec */
 
-		Stream_Write_UINT32(s, context->server_formats[i].nSamplesPerSec *
-			context->server_formats[i].nChannels *
-			context->server_formats[i].wBitsPerSample / 8); /* nAvgBytesPerSec */
+		/* compressed formats without a sample size carry their own byte rate */
+		if (context->server_formats[i].wBitsPerSample)
+		{
+			Stream_Write_UINT32(s, context->server_formats[i].nSamplesPerSec *
+				context->server_formats[i].nChannels *
+				context->server_formats[i].wBitsPerSample / 8); /* nAvgBytesPerSec */
+		}
+		else
+		{
+			Stream_Write_UINT32(s, context->server_formats[i].nAvgBytesPerSec); /* nAvgBytesPerSec */
+		}
 
 		Stream_Write_UINT16(s, context->server_formats[i].nBlockAlign); /* nBlockAlign */
 		Stream_Write_UINT16(s, context->server_formats[i].wBitsPerSample); /* wBitsPerSample */
@@ -258,9 +266,18 @@ static BOOL rdpsnd_server_select_format(RdpsndServerContext* context, int client
 			bs = (format->nBlockAlign - 7 * format->nChannels) * 2 / format->nChannels + 2;
 			context->priv->out_frames = bs * 4;
 			break;
-		default:
+
+		case WAVE_FORMAT_PCM:
 			context->priv->out_frames = 0x4000 / context->priv->src_bytes_per_frame;
 			break;
+
+		default:
+			/* frame based codecs send a frame per wave, the lowest latency they allow */
+			if (freerdp_dsp_supports_format(format, TRUE))
+				context->priv->out_frames = freerdp_dsp_get_block_frames(format);
+			else
+				context->priv->out_frames = 0x4000 / context->priv->src_bytes_per_frame;
+			break;
 	}
 
 	if (format->nSamplesPerSec != context->src_format.nSamplesPerSec)
@@ -283,7 +300,7 @@ static BOOL rdpsnd_server_select_format(RdpsndServerContext* context, int client
 		context->priv->out_buffer_size = out_buffer_size;
 	}
 
-	freerdp_dsp_context_reset_adpcm(context->priv->dsp_context);
+	freerdp_dsp_context_reset(context->priv->dsp_context);
 	return TRUE;
 }
 
@@ -319,19 +336,26 @@ static BOOL rdpsnd_server_send_audio_pdu(RdpsndServerContext* context, UINT16 wT
 	}
 	size = frames * tbytes_per_frame;
 
-	if (format->wFormatTag == WAVE_FORMAT_DVI_ADPCM)
-	{
-		context->priv->dsp_context->encode_ima_adpcm(context->priv->dsp_context,
-			src, size, format->nChannels, format->nBlockAlign);
-		src = context->priv->dsp_context->adpcm_buffer;
-		size = context->priv->dsp_context->adpcm_size;
-	}
-	else if (format->wFormatTag == WAVE_FORMAT_ADPCM)
+	if ((format->wFormatTag != WAVE_FORMAT_PCM) && freerdp_dsp_supports_format(format, TRUE))
 	{
-		context->priv->dsp_context->encode_ms_adpcm(context->priv->dsp_context,
-			src, size, format->nChannels, format->nBlockAlign);
-		src = context->priv->dsp_context->adpcm_buffer;
-		size = context->priv->dsp_context->adpcm_size;
+		Stream_SetPosition(context->priv->encoded_stream, 0);
+
+		if (!freerdp_dsp_encode(context->priv->dsp_context, format, src, size,
+				context->priv->encoded_stream))
+		{
+			status = FALSE;
+			goto out;
+		}
+
+		src = Stream_Buffer(context->priv->encoded_stream);
+		size = (int) Stream_GetPosition(context->priv->encoded_stream);
+
+		/* a frame based codec holds back input short of a frame */
+		if (!size)
+		{
+			status = TRUE;
+			goto out;
+		}
 	}
 
 	context->block_no = (context->block_no + 1) % 256;
@@ -566,11 +590,17 @@ RdpsndServerContext* rdpsnd_server_context_new(HANDLE vcm)
 	if (!priv->input_stream)
 		goto out_free_dsp;
 
+	priv->encoded_stream = Stream_New(NULL, 4096);
+	if (!priv->encoded_stream)
+		goto out_free_input;
+
 	priv->expectedBytes = 4;
 	priv->waitingHeader = TRUE;
 	priv->ownThread = TRUE;
 	return context;
 
+out_free_input:
+	Stream_Free(priv->input_stream, TRUE);
 out_free_dsp:
 	freerdp_dsp_context_free(priv->dsp_context);
 out_free_priv:
@@ -606,6 +636,9 @@ void rdpsnd_server_context_free(RdpsndServerContext* context)
 	if (context->priv->out_buffer)
 		free(context->priv->out_buffer);
 
+	if (context->priv->encoded_stream)
+		Stream_Free(context->priv->encoded_stream, TRUE);
+
 	if (context->priv->dsp_context)
 		freerdp_dsp_context_free(context->priv->dsp_context);
 
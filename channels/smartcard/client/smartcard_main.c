@@ -35,53 +35,176 @@
 
 #include "smartcard_main.h"
 
-void* smartcard_context_thread(SMARTCARD_CONTEXT* pContext)
+/* context handles and completion ids are spread well enough to hash to themselves */
+
+static UINT32 smartcard_handle_hash(void* key)
 {
-	DWORD nCount;
-	DWORD status;
-	HANDLE hEvents[2];
-	wMessage message;
-	SMARTCARD_DEVICE* smartcard;
-	SMARTCARD_OPERATION* operation;
+	return (UINT32) (size_t) key;
+}
 
-	smartcard = pContext->smartcard;
+/**
+ * A SCardGetStatusChange with a timeout holds its worker until a reader
+ * changes or the call is cancelled, possibly forever. Such calls do not
+ * count against SMARTCARD_MAX_WORKER_THREADS, so contexts waiting for a
+ * card can never starve the others of a thread.
+ */
 
-	nCount = 0;
-	hEvents[nCount++] = MessageQueue_Event(pContext->IrpQueue);
+static BOOL smartcard_operation_is_blocking(SMARTCARD_OPERATION* operation)
+{
+	switch (operation->ioControlCode)
+	{
+		case SCARD_IOCTL_GETSTATUSCHANGEA:
+			return (((GetStatusChangeA_Call*) operation->call)->dwTimeOut != 0) ? TRUE : FALSE;
 
-	while (1)
+		case SCARD_IOCTL_GETSTATUSCHANGEW:
+			return (((GetStatusChangeW_Call*) operation->call)->dwTimeOut != 0) ? TRUE : FALSE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * The pool minimum follows the contexts with operations in flight, up and
+ * down: it is lowered again when contexts are done and when blocking calls
+ * return. Called with PoolLock held.
+ */
+
+static void smartcard_pool_resize(SMARTCARD_DEVICE* smartcard)
+{
+	UINT32 workerThreads;
+	UINT32 maxThreads = SMARTCARD_MAX_WORKER_THREADS + smartcard->BlockingCalls;
+
+	workerThreads = smartcard->ScheduledContexts;
+
+	if (workerThreads < SMARTCARD_WORKER_THREADS)
+		workerThreads = SMARTCARD_WORKER_THREADS;
+
+	if (workerThreads > maxThreads)
+		workerThreads = maxThreads;
+
+	if (workerThreads == smartcard->WorkerThreads)
+		return;
+
+	/* the maximum is raised before the minimum and lowered after it */
+
+	if (workerThreads > smartcard->WorkerThreads)
 	{
-		status = WaitForMultipleObjects(nCount, hEvents, FALSE, INFINITE);
+		if (workerThreads > SMARTCARD_MAX_WORKER_THREADS)
+			SetThreadpoolThreadMaximum(smartcard->ThreadPool, workerThreads);
+
+		SetThreadpoolThreadMinimum(smartcard->ThreadPool, workerThreads);
+	}
+	else
+	{
+		SetThreadpoolThreadMinimum(smartcard->ThreadPool, workerThreads);
+
+		if (smartcard->WorkerThreads > SMARTCARD_MAX_WORKER_THREADS)
+			SetThreadpoolThreadMaximum(smartcard->ThreadPool, (workerThreads > SMARTCARD_MAX_WORKER_THREADS) ?
+					workerThreads : SMARTCARD_MAX_WORKER_THREADS);
+	}
 
-		if (WaitForSingleObject(MessageQueue_Event(pContext->IrpQueue), 0) == WAIT_OBJECT_0)
+	smartcard->WorkerThreads = workerThreads;
+}
+
+static void CALLBACK smartcard_context_work_callback(PTP_CALLBACK_INSTANCE instance, void* param, PTP_WORK work)
+{
+	BOOL blocking;
+	SMARTCARD_CONTEXT* pContext = (SMARTCARD_CONTEXT*) param;
+	SMARTCARD_DEVICE* smartcard = pContext->smartcard;
+	SMARTCARD_OPERATION* operation;
+
+	EnterCriticalSection(&smartcard->PoolLock);
+	operation = (SMARTCARD_OPERATION*) Queue_Dequeue(pContext->OperationQueue);
+	LeaveCriticalSection(&smartcard->PoolLock);
+
+	if (operation)
+	{
+		blocking = smartcard_operation_is_blocking(operation);
+
+		if (blocking)
 		{
-			if (!MessageQueue_Peek(pContext->IrpQueue, &message, TRUE))
-				break;
+			EnterCriticalSection(&smartcard->PoolLock);
+			smartcard->BlockingCalls++;
+			smartcard_pool_resize(smartcard);
+			LeaveCriticalSection(&smartcard->PoolLock);
+		}
 
-			if (message.id == WMQ_QUIT)
-				break;
+		smartcard_irp_device_control_call(smartcard, operation);
+
+		if (blocking)
+		{
+			EnterCriticalSection(&smartcard->PoolLock);
+			smartcard->BlockingCalls--;
+			smartcard_pool_resize(smartcard);
+			LeaveCriticalSection(&smartcard->PoolLock);
+		}
 
-			operation = (SMARTCARD_OPERATION*) message.wParam;
+		Queue_Enqueue(smartcard->CompletedIrpQueue, (void*) operation->irp);
 
-			if (operation)
-			{
-				status = smartcard_irp_device_control_call(smartcard, operation);
+		free(operation);
+	}
 
-				Queue_Enqueue(smartcard->CompletedIrpQueue, (void*) operation->irp);
+	/**
+	 * One operation per turn: a context with more operations queued
+	 * goes to the back of the pool queue behind the other contexts.
+	 */
 
-				free(operation);
-			}
+	EnterCriticalSection(&smartcard->PoolLock);
+
+	if (Queue_Count(pContext->OperationQueue) > 0)
+	{
+		SubmitThreadpoolWork(work);
+	}
+	else
+	{
+		pContext->scheduled = FALSE;
+		smartcard->ScheduledContexts--;
+		smartcard_pool_resize(smartcard);
+		SetEvent(smartcard->PoolEvent);
+	}
+
+	LeaveCriticalSection(&smartcard->PoolLock);
+}
+
+static BOOL smartcard_context_post(SMARTCARD_CONTEXT* pContext, SMARTCARD_OPERATION* operation)
+{
+	SMARTCARD_DEVICE* smartcard = pContext->smartcard;
+
+	EnterCriticalSection(&smartcard->PoolLock);
+
+	if (!Queue_Enqueue(pContext->OperationQueue, (void*) operation))
+	{
+		LeaveCriticalSection(&smartcard->PoolLock);
+		return FALSE;
+	}
+
+	if (!pContext->scheduled)
+	{
+		pContext->scheduled = TRUE;
+		smartcard->ScheduledContexts++;
+		smartcard_pool_resize(smartcard);
+
+		if (smartcard->ScheduledContexts > smartcard->WorkerThreads)
+		{
+			WLog_Print(smartcard->log, WLOG_WARN, "%d contexts scheduled, worker threads capped at %d: "
+					"operations wait for a free worker", smartcard->ScheduledContexts, smartcard->WorkerThreads);
 		}
+
+		SubmitThreadpoolWork(pContext->work);
 	}
 
-	ExitThread(0);
-	return NULL;
+	LeaveCriticalSection(&smartcard->PoolLock);
+
+	return TRUE;
 }
 
 SMARTCARD_CONTEXT* smartcard_context_new(SMARTCARD_DEVICE* smartcard, SCARDCONTEXT hContext)
 {
 	SMARTCARD_CONTEXT* pContext;
 
+	if (!smartcard->ThreadPool)
+		return NULL;
+
 	pContext = (SMARTCARD_CONTEXT*) calloc(1, sizeof(SMARTCARD_CONTEXT));
 
 	if (!pContext)
@@ -91,34 +214,56 @@ SMARTCARD_CONTEXT* smartcard_context_new(SMARTCARD_DEVICE* smartcard, SCARDCONTE
 
 	pContext->hContext = hContext;
 
-	pContext->IrpQueue = MessageQueue_New(NULL);
+	pContext->OperationQueue = Queue_New(FALSE, -1, -1);
 
-	pContext->thread = CreateThread(NULL, 0,
-			(LPTHREAD_START_ROUTINE) smartcard_context_thread,
-			pContext, 0, NULL);
+	pContext->work = CreateThreadpoolWork((PTP_WORK_CALLBACK) smartcard_context_work_callback,
+			(void*) pContext, &smartcard->ThreadPoolEnv);
+
+	if (!pContext->OperationQueue || !pContext->work)
+	{
+		smartcard_context_free(pContext);
+		return NULL;
+	}
 
 	return pContext;
 }
 
 void smartcard_context_free(SMARTCARD_CONTEXT* pContext)
 {
+	SMARTCARD_DEVICE* smartcard;
+
 	if (!pContext)
 		return;
 
-	/* cancel blocking calls like SCardGetStatusChange */
-	SCardCancel(pContext->hContext);
+	smartcard = pContext->smartcard;
+
+	EnterCriticalSection(&smartcard->PoolLock);
 
-	MessageQueue_PostQuit(pContext->IrpQueue, 0);
-	WaitForSingleObject(pContext->thread, INFINITE);
-	CloseHandle(pContext->thread);
+	while (pContext->scheduled)
+	{
+		ResetEvent(smartcard->PoolEvent);
+		LeaveCriticalSection(&smartcard->PoolLock);
+
+		/* cancel blocking calls like SCardGetStatusChange, queued ones included */
+		SCardCancel(pContext->hContext);
+
+		WaitForSingleObject(smartcard->PoolEvent, 100);
+		EnterCriticalSection(&smartcard->PoolLock);
+	}
 
-	MessageQueue_Free(pContext->IrpQueue);
+	LeaveCriticalSection(&smartcard->PoolLock);
+
+	if (pContext->work)
+		CloseThreadpoolWork(pContext->work);
+
+	Queue_Free(pContext->OperationQueue);
 
 	free(pContext);
 }
 
 static void smartcard_free(DEVICE* device)
 {
+	IRP* irp;
 	SMARTCARD_DEVICE* smartcard = (SMARTCARD_DEVICE*) device;
 
 	if (smartcard->IrpQueue)
@@ -139,10 +284,24 @@ static void smartcard_free(DEVICE* device)
 		smartcard->device.data = NULL;
 	}
 
-	ListDictionary_Free(smartcard->rgSCardContextList);
-	ListDictionary_Free(smartcard->rgOutstandingMessages);
+	/* waits for the operations still running on the pool */
+	HashTable_Free(smartcard->rgSCardContextList);
+	HashTable_Free(smartcard->rgOutstandingMessages);
+
+	while ((irp = (IRP*) Queue_Dequeue(smartcard->CompletedIrpQueue)) != NULL)
+		irp->Discard(irp);
+
 	Queue_Free(smartcard->CompletedIrpQueue);
 
+	if (smartcard->ThreadPool)
+	{
+		DestroyThreadpoolEnvironment(&smartcard->ThreadPoolEnv);
+		CloseThreadpool(smartcard->ThreadPool);
+	}
+
+	CloseHandle(smartcard->PoolEvent);
+	DeleteCriticalSection(&smartcard->PoolLock);
+
 	if (smartcard->StartedEvent)
 	{
 		SCardReleaseStartedEvent();
@@ -177,14 +336,14 @@ static void smartcard_init(DEVICE* device)
 	 * Call SCardCancel on existing contexts, unblocking all outstanding IRPs.
 	 */
 
-	if (ListDictionary_Count(smartcard->rgSCardContextList) > 0)
+	if (HashTable_Count(smartcard->rgSCardContextList) > 0)
 	{
 		pKeys = NULL;
-		keyCount = ListDictionary_GetKeys(smartcard->rgSCardContextList, &pKeys);
+		keyCount = HashTable_GetKeys(smartcard->rgSCardContextList, &pKeys);
 
 		for (index = 0; index < keyCount; index++)
 		{
-			pContext = (SMARTCARD_CONTEXT*) ListDictionary_GetItemValue(smartcard->rgSCardContextList, (void*) pKeys[index]);
+			pContext = (SMARTCARD_CONTEXT*) HashTable_GetItemValue(smartcard->rgSCardContextList, (void*) pKeys[index]);
 
 			if (!pContext)
 				continue;
@@ -204,20 +363,23 @@ static void smartcard_init(DEVICE* device)
 	 * Call SCardReleaseContext on remaining contexts and remove them from rgSCardContextList.
 	 */
 
-	if (ListDictionary_Count(smartcard->rgSCardContextList) > 0)
+	if (HashTable_Count(smartcard->rgSCardContextList) > 0)
 	{
 		pKeys = NULL;
-		keyCount = ListDictionary_GetKeys(smartcard->rgSCardContextList, &pKeys);
+		keyCount = HashTable_GetKeys(smartcard->rgSCardContextList, &pKeys);
 
 		for (index = 0; index < keyCount; index++)
 		{
-			pContext = (SMARTCARD_CONTEXT*) ListDictionary_Remove(smartcard->rgSCardContextList, (void*) pKeys[index]);
+			pContext = (SMARTCARD_CONTEXT*) HashTable_GetItemValue(smartcard->rgSCardContextList, (void*) pKeys[index]);
 
 			if (!pContext)
 				continue;
 
 			hContext = pContext->hContext;
 
+			/* waits for the outstanding operations of the context and frees it */
+			HashTable_Remove(smartcard->rgSCardContextList, (void*) pKeys[index]);
+
 			if (SCardIsValidContext(hContext))
 			{
 				SCardReleaseContext(hContext);
@@ -233,7 +395,7 @@ void smartcard_complete_irp(SMARTCARD_DEVICE* smartcard, IRP* irp)
 	void* key;
 
 	key = (void*) (size_t) irp->CompletionId;
-	ListDictionary_Remove(smartcard->rgOutstandingMessages, key);
+	HashTable_Remove(smartcard->rgOutstandingMessages, key);
 
 	irp->Complete(irp);
 }
@@ -271,7 +433,7 @@ void smartcard_process_irp(SMARTCARD_DEVICE* smartcard, IRP* irp)
 	SMARTCARD_OPERATION* operation = NULL;
 
 	key = (void*) (size_t) irp->CompletionId;
-	ListDictionary_Add(smartcard->rgOutstandingMessages, key, irp);
+	HashTable_Add(smartcard->rgOutstandingMessages, key, irp);
 
 	if (irp->MajorFunction == IRP_MJ_DEVICE_CONTROL)
 	{
@@ -364,24 +526,17 @@ void smartcard_process_irp(SMARTCARD_DEVICE* smartcard, IRP* irp)
 				break;
 		}
 
-		pContext = ListDictionary_GetItemValue(smartcard->rgSCardContextList, (void*) operation->hContext);
+		pContext = HashTable_GetItemValue(smartcard->rgSCardContextList, (void*) operation->hContext);
 
 		if (!pContext)
 			asyncIrp = FALSE;
 
-		if (!asyncIrp)
-		{
-			status = smartcard_irp_device_control_call(smartcard, operation);
-			Queue_Enqueue(smartcard->CompletedIrpQueue, (void*) irp);
-			free(operation);
-		}
-		else
-		{
-			if (pContext)
-			{
-				MessageQueue_Post(pContext->IrpQueue, NULL, 0, (void*) operation, NULL);
-			}
-		}
+		if (asyncIrp && smartcard_context_post(pContext, operation))
+			return;
+
+		status = smartcard_irp_device_control_call(smartcard, operation);
+		Queue_Enqueue(smartcard->CompletedIrpQueue, (void*) irp);
+		free(operation);
 	}
 	else
 	{
@@ -527,12 +682,26 @@ int DeviceServiceEntry(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints)
 
 	smartcard->CompletedIrpQueue = Queue_New(TRUE, -1, -1);
 
-	smartcard->rgSCardContextList = ListDictionary_New(TRUE);
+	smartcard->rgSCardContextList = HashTable_New(TRUE);
+	smartcard->rgSCardContextList->hash = smartcard_handle_hash;
+	smartcard->rgSCardContextList->valueFree = (HASH_TABLE_VALUE_FREE_FN) smartcard_context_free;
+
+	smartcard->rgOutstandingMessages = HashTable_New(TRUE);
+	smartcard->rgOutstandingMessages->hash = smartcard_handle_hash;
 
-	ListDictionary_ValueObject(smartcard->rgSCardContextList)->fnObjectFree =
-			(OBJECT_FREE_FN) smartcard_context_free;
+	InitializeCriticalSectionAndSpinCount(&smartcard->PoolLock, 4000);
+	smartcard->PoolEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
 
-	smartcard->rgOutstandingMessages = ListDictionary_New(TRUE);
+	smartcard->ThreadPool = CreateThreadpool(NULL);
+
+	if (smartcard->ThreadPool)
+	{
+		smartcard->WorkerThreads = SMARTCARD_WORKER_THREADS;
+		SetThreadpoolThreadMinimum(smartcard->ThreadPool, smartcard->WorkerThreads);
+		SetThreadpoolThreadMaximum(smartcard->ThreadPool, SMARTCARD_MAX_WORKER_THREADS);
+		InitializeThreadpoolEnvironment(&smartcard->ThreadPoolEnv);
+		SetThreadpoolCallbackPool(&smartcard->ThreadPoolEnv, smartcard->ThreadPool);
+	}
 
 	smartcard->thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) smartcard_thread_func,
 			smartcard, CREATE_SUSPENDED, NULL);
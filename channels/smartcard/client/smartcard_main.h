@@ -27,6 +27,7 @@
 #include <winpr/crt.h>
 #include <winpr/wlog.h>
 #include <winpr/synch.h>
+#include <winpr/pool.h>
 #include <winpr/smartcard.h>
 #include <winpr/collections.h>
 
@@ -83,6 +84,23 @@
 #define SCARD_IOCTL_GETREADERICON		RDP_SCARD_CTL_CODE(67)	/* SCardGetReaderIconA */
 #define SCARD_IOCTL_GETDEVICETYPEID		RDP_SCARD_CTL_CODE(68)	/* SCardGetDeviceTypeIdA */
 
+/**
+ * Operations of all contexts run on a shared pool of worker threads. The
+ * operations of one context run one at a time and in order, and the pool
+ * keeps a thread for every context with operations in flight so that a
+ * context blocked in SCardGetStatusChange does not hold back the others.
+ * Past SMARTCARD_MAX_WORKER_THREADS contexts wait for a free worker, with
+ * a warning; workers blocked in SCardGetStatusChange are not counted.
+ *
+ * The pool minimum is lowered again as contexts finish, but the winpr pool
+ * never stops a thread it started: outside of Windows the number of threads
+ * stays at the peak concurrency seen, bounded by the cap above plus the
+ * blocking calls in flight at that peak.
+ */
+
+#define SMARTCARD_WORKER_THREADS	4
+#define SMARTCARD_MAX_WORKER_THREADS	64
+
 typedef struct _SMARTCARD_DEVICE SMARTCARD_DEVICE;
 
 struct _SMARTCARD_OPERATION
@@ -97,9 +115,10 @@ typedef struct _SMARTCARD_OPERATION SMARTCARD_OPERATION;
 
 struct _SMARTCARD_CONTEXT
 {
-	HANDLE thread;
+	PTP_WORK work;
+	BOOL scheduled;
 	SCARDCONTEXT hContext;
-	wMessageQueue* IrpQueue;
+	wQueue* OperationQueue;
 	SMARTCARD_DEVICE* smartcard;
 };
 typedef struct _SMARTCARD_CONTEXT SMARTCARD_CONTEXT;
@@ -117,8 +136,16 @@ struct _SMARTCARD_DEVICE
 	HANDLE StartedEvent;
 	wMessageQueue* IrpQueue;
 	wQueue* CompletedIrpQueue;
-	wListDictionary* rgSCardContextList;
-	wListDictionary* rgOutstandingMessages;
+	wHashTable* rgSCardContextList;
+	wHashTable* rgOutstandingMessages;
+
+	PTP_POOL ThreadPool;
+	TP_CALLBACK_ENVIRON ThreadPoolEnv;
+	CRITICAL_SECTION PoolLock;
+	HANDLE PoolEvent;
+	UINT32 ScheduledContexts;
+	UINT32 WorkerThreads;
+	UINT32 BlockingCalls;
 };
 
 SMARTCARD_CONTEXT* smartcard_context_new(SMARTCARD_DEVICE* smartcard, SCARDCONTEXT hContext);
@@ -219,7 +219,9 @@ static UINT32 smartcard_EstablishContext_Call(SMARTCARD_DEVICE* smartcard, SMART
 		SMARTCARD_CONTEXT* pContext;
 		void* key = (void*)(size_t) hContext;
 		pContext = smartcard_context_new(smartcard, hContext);
-		ListDictionary_Add(smartcard->rgSCardContextList, key, (void*) pContext);
+
+		if (pContext)
+			HashTable_Add(smartcard->rgSCardContextList, key, (void*) pContext);
 	}
 
 	smartcard_scard_context_native_to_redir(smartcard, &(ret.hContext), hContext);
@@ -254,10 +256,10 @@ static UINT32 smartcard_ReleaseContext_Call(SMARTCARD_DEVICE* smartcard, SMARTCA
 
 	if (ret.ReturnCode == SCARD_S_SUCCESS)
 	{
-		SMARTCARD_CONTEXT* pContext;
 		void* key = (void*)(size_t) operation->hContext;
-		pContext = (SMARTCARD_CONTEXT*) ListDictionary_Remove(smartcard->rgSCardContextList, key);
-		smartcard_context_free(pContext);
+
+		/* frees the context */
+		HashTable_Remove(smartcard->rgSCardContextList, key);
 	}
 
 	smartcard_trace_long_return(smartcard, &ret, "ReleaseContext");
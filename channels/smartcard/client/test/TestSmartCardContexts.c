@@ -0,0 +1,448 @@
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/stream.h>
+#include <winpr/sysinfo.h>
+#include <winpr/smartcard.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/channels/rdpdr.h>
+
+/**
+ * Smart card redirection against a stand-in for PC/SC: a number of contexts
+ * larger than the worker thread cap each get a SCardGetStatusChange that
+ * blocks until cancelled, followed by one that returns at once. All blocking
+ * calls must be in progress at the same time, the second call of a context
+ * must not start before the first returned, and SCardCancel must unblock
+ * them all before the contexts are released.
+ */
+
+int smartcard_DeviceServiceEntry(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints);
+
+#define TEST_SCARD_CONTEXTS	72
+
+#define TEST_SCARD_CTL_CODE(code)	CTL_CODE(FILE_DEVICE_FILE_SYSTEM, (code), METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define TEST_SCARD_IOCTL_ESTABLISHCONTEXT	TEST_SCARD_CTL_CODE(5)
+#define TEST_SCARD_IOCTL_RELEASECONTEXT		TEST_SCARD_CTL_CODE(6)
+#define TEST_SCARD_IOCTL_GETSTATUSCHANGEA	TEST_SCARD_CTL_CODE(40)
+#define TEST_SCARD_IOCTL_CANCEL			TEST_SCARD_CTL_CODE(42)
+
+/* response offsets: IoCompletion header, OutputBufferLength, type headers, Result */
+#define TEST_SCARD_RESULT_OFFSET	(RDPDR_DEVICE_IO_RESPONSE_LENGTH + 4 + 16)
+#define TEST_SCARD_CONTEXT_OFFSET	(TEST_SCARD_RESULT_OFFSET + 4)
+
+typedef struct _TEST_SCARD_IRP TEST_SCARD_IRP;
+
+struct _TEST_SCARD_IRP
+{
+	IRP irp;
+
+	LONG* Result;
+	SCARDCONTEXT* hContext;
+};
+
+typedef struct _TEST_SCARD_CONTEXT TEST_SCARD_CONTEXT;
+
+struct _TEST_SCARD_CONTEXT
+{
+	HANDLE event;
+	LONG active;
+	BOOL unblocked;
+};
+
+static DEVMAN* test_scard_devman = NULL;
+static DEVICE* test_scard_device = NULL;
+static HANDLE test_scard_semaphore = NULL;
+static UINT32 test_scard_completion_id = 0;
+static LONG test_scard_errors = 0;
+static LONG test_scard_blocked = 0;
+static LONG test_scard_next = 0;
+static TEST_SCARD_CONTEXT test_scard_contexts[TEST_SCARD_CONTEXTS];
+
+/* PC/SC stand-in */
+
+static TEST_SCARD_CONTEXT* test_scard_get_context(SCARDCONTEXT hContext)
+{
+	if ((hContext < 1) || (hContext > TEST_SCARD_CONTEXTS))
+		return NULL;
+
+	return &test_scard_contexts[hContext - 1];
+}
+
+static LONG WINAPI test_SCardEstablishContext(DWORD dwScope,
+		LPCVOID pvReserved1, LPCVOID pvReserved2, LPSCARDCONTEXT phContext)
+{
+	LONG id = InterlockedIncrement(&test_scard_next);
+
+	if (id > TEST_SCARD_CONTEXTS)
+		return SCARD_E_NO_MEMORY;
+
+	*phContext = (SCARDCONTEXT) id;
+
+	return SCARD_S_SUCCESS;
+}
+
+static LONG WINAPI test_SCardReleaseContext(SCARDCONTEXT hContext)
+{
+	return test_scard_get_context(hContext) ? SCARD_S_SUCCESS : SCARD_E_INVALID_HANDLE;
+}
+
+static LONG WINAPI test_SCardIsValidContext(SCARDCONTEXT hContext)
+{
+	return test_scard_get_context(hContext) ? SCARD_S_SUCCESS : SCARD_E_INVALID_HANDLE;
+}
+
+static LONG WINAPI test_SCardCancel(SCARDCONTEXT hContext)
+{
+	TEST_SCARD_CONTEXT* context = test_scard_get_context(hContext);
+
+	if (!context)
+		return SCARD_E_INVALID_HANDLE;
+
+	SetEvent(context->event);
+
+	return SCARD_S_SUCCESS;
+}
+
+static LONG WINAPI test_SCardGetStatusChangeA(SCARDCONTEXT hContext,
+		DWORD dwTimeout, LPSCARD_READERSTATEA rgReaderStates, DWORD cReaders)
+{
+	LONG status;
+	TEST_SCARD_CONTEXT* context = test_scard_get_context(hContext);
+
+	if (!context)
+		return SCARD_E_INVALID_HANDLE;
+
+	if (InterlockedIncrement(&context->active) != 1)
+		InterlockedIncrement(&test_scard_errors);
+
+	if (dwTimeout == INFINITE)
+	{
+		InterlockedIncrement(&test_scard_blocked);
+		WaitForSingleObject(context->event, INFINITE);
+		InterlockedDecrement(&test_scard_blocked);
+
+		context->unblocked = TRUE;
+		status = SCARD_E_CANCELLED;
+	}
+	else
+	{
+		if (!context->unblocked)
+			InterlockedIncrement(&test_scard_errors);
+
+		status = SCARD_E_TIMEOUT;
+	}
+
+	InterlockedDecrement(&context->active);
+
+	return status;
+}
+
+static SCardApiFunctionTable test_scard_api;
+
+/* IRPs */
+
+static void test_scard_register_device(DEVMAN* devman, DEVICE* device)
+{
+	test_scard_devman = devman;
+	test_scard_device = device;
+}
+
+static void test_scard_irp_complete(IRP* irp)
+{
+	UINT32 cbContext;
+	TEST_SCARD_IRP* test = (TEST_SCARD_IRP*) irp;
+
+	Stream_SealLength(irp->output);
+
+	if ((irp->IoStatus != STATUS_SUCCESS) || (Stream_Length(irp->output) < TEST_SCARD_CONTEXT_OFFSET))
+	{
+		InterlockedIncrement(&test_scard_errors);
+	}
+	else
+	{
+		Stream_SetPosition(irp->output, TEST_SCARD_RESULT_OFFSET);
+		Stream_Read_UINT32(irp->output, *test->Result);
+
+		if (test->hContext && (*test->Result == SCARD_S_SUCCESS))
+		{
+			Stream_Read_UINT32(irp->output, cbContext); /* cbContext (4 bytes) */
+			Stream_Seek(irp->output, 8); /* pbContextNdrPtr (4 bytes), Length (4 bytes) */
+
+			*test->hContext = 0;
+
+			if (cbContext <= sizeof(SCARDCONTEXT))
+				Stream_Read(irp->output, test->hContext, cbContext);
+		}
+	}
+
+	Stream_Free(irp->input, TRUE);
+	Stream_Free(irp->output, TRUE);
+	free(test);
+
+	ReleaseSemaphore(test_scard_semaphore, 1, NULL);
+}
+
+static TEST_SCARD_IRP* test_scard_irp_new(UINT32 ioControlCode, LONG* Result)
+{
+	TEST_SCARD_IRP* test;
+
+	test = (TEST_SCARD_IRP*) calloc(1, sizeof(TEST_SCARD_IRP));
+
+	if (!test)
+		return NULL;
+
+	test->Result = Result;
+
+	test->irp.device = test_scard_device;
+	test->irp.devman = test_scard_devman;
+	test->irp.CompletionId = ++test_scard_completion_id;
+	test->irp.MajorFunction = IRP_MJ_DEVICE_CONTROL;
+	test->irp.input = Stream_New(NULL, 256);
+	test->irp.output = Stream_New(NULL, 256);
+	test->irp.Complete = test_scard_irp_complete;
+	test->irp.Discard = test_scard_irp_complete;
+
+	Stream_Zero(test->irp.input, RDPDR_DEVICE_IO_REQUEST_LENGTH);
+	Stream_Write_UINT32(test->irp.input, 2048); /* OutputBufferLength */
+	Stream_Write_UINT32(test->irp.input, 0); /* InputBufferLength, set on request */
+	Stream_Write_UINT32(test->irp.input, ioControlCode); /* IoControlCode */
+	Stream_Zero(test->irp.input, 20); /* Padding */
+
+	Stream_Write_UINT8(test->irp.input, 1); /* Version */
+	Stream_Write_UINT8(test->irp.input, 0x10); /* Endianness */
+	Stream_Write_UINT16(test->irp.input, 8); /* CommonHeaderLength */
+	Stream_Write_UINT32(test->irp.input, 0xCCCCCCCC); /* Filler */
+	Stream_Write_UINT32(test->irp.input, 0); /* ObjectBufferLength, set on request */
+	Stream_Write_UINT32(test->irp.input, 0); /* Filler */
+
+	Stream_Zero(test->irp.output, RDPDR_DEVICE_IO_RESPONSE_LENGTH);
+
+	return test;
+}
+
+static void test_scard_irp_request(TEST_SCARD_IRP* test)
+{
+	size_t length;
+	size_t offset = RDPDR_DEVICE_IO_REQUEST_LENGTH + RDPDR_DEVICE_IO_CONTROL_REQ_HDR_LENGTH;
+	wStream* s = test->irp.input;
+
+	length = Stream_GetPosition(s) - offset;
+
+	if (length % 8)
+		Stream_Zero(s, 8 - (length % 8));
+
+	length = Stream_GetPosition(s);
+	Stream_SealLength(s);
+
+	Stream_SetPosition(s, RDPDR_DEVICE_IO_REQUEST_LENGTH + 4);
+	Stream_Write_UINT32(s, length - offset); /* InputBufferLength */
+
+	Stream_SetPosition(s, offset + 8);
+	Stream_Write_UINT32(s, length - offset - 16); /* ObjectBufferLength */
+
+	Stream_SetPosition(s, RDPDR_DEVICE_IO_REQUEST_LENGTH);
+
+	test_scard_device->IRPRequest(test_scard_device, &test->irp);
+}
+
+static void test_scard_write_context(wStream* s)
+{
+	Stream_Write_UINT32(s, sizeof(SCARDCONTEXT)); /* cbContext */
+	Stream_Write_UINT32(s, 0x00020001); /* pbContextNdrPtr */
+}
+
+static void test_scard_write_context_ref(wStream* s, SCARDCONTEXT hContext)
+{
+	Stream_Write_UINT32(s, sizeof(SCARDCONTEXT)); /* Length */
+	Stream_Write(s, &hContext, sizeof(SCARDCONTEXT)); /* pbContext */
+}
+
+static void test_scard_establish_context(SCARDCONTEXT* hContext, LONG* Result)
+{
+	TEST_SCARD_IRP* test;
+
+	test = test_scard_irp_new(TEST_SCARD_IOCTL_ESTABLISHCONTEXT, Result);
+	test->hContext = hContext;
+
+	Stream_Write_UINT32(test->irp.input, SCARD_SCOPE_SYSTEM); /* dwScope */
+
+	test_scard_irp_request(test);
+}
+
+static void test_scard_context_call(UINT32 ioControlCode, SCARDCONTEXT hContext, LONG* Result)
+{
+	TEST_SCARD_IRP* test;
+
+	test = test_scard_irp_new(ioControlCode, Result);
+
+	test_scard_write_context(test->irp.input);
+	test_scard_write_context_ref(test->irp.input, hContext);
+
+	test_scard_irp_request(test);
+}
+
+static void test_scard_get_status_change(SCARDCONTEXT hContext, DWORD dwTimeOut, LONG* Result)
+{
+	TEST_SCARD_IRP* test;
+
+	test = test_scard_irp_new(TEST_SCARD_IOCTL_GETSTATUSCHANGEA, Result);
+
+	test_scard_write_context(test->irp.input);
+	Stream_Write_UINT32(test->irp.input, dwTimeOut); /* dwTimeOut */
+	Stream_Write_UINT32(test->irp.input, 0); /* cReaders */
+	Stream_Write_UINT32(test->irp.input, 0); /* rgReaderStatesNdrPtr */
+	test_scard_write_context_ref(test->irp.input, hContext);
+	Stream_Write_UINT32(test->irp.input, 0); /* NdrCount */
+
+	test_scard_irp_request(test);
+}
+
+static BOOL test_scard_wait(int count)
+{
+	while (count-- > 0)
+	{
+		if (WaitForSingleObject(test_scard_semaphore, 10000) != WAIT_OBJECT_0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static int test_scard_check(LONG* results, LONG expected, const char* name)
+{
+	int index;
+
+	for (index = 0; index < TEST_SCARD_CONTEXTS; index++)
+	{
+		if (results[index] != expected)
+		{
+			printf("%s on context %d: 0x%08X, expected 0x%08X\n", name, index,
+					(UINT32) results[index], (UINT32) expected);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int TestSmartCardContexts(int argc, char* argv[])
+{
+	int rc = -1;
+	int index;
+	BOOL blocked;
+	ULONGLONG start;
+	DEVMAN devman;
+	RDPDR_SMARTCARD device;
+	DEVICE_SERVICE_ENTRY_POINTS entryPoints;
+	SCARDCONTEXT hContexts[TEST_SCARD_CONTEXTS];
+	LONG establishResults[TEST_SCARD_CONTEXTS];
+	LONG blockingResults[TEST_SCARD_CONTEXTS];
+	LONG pollingResults[TEST_SCARD_CONTEXTS];
+	LONG cancelResults[TEST_SCARD_CONTEXTS];
+	LONG releaseResults[TEST_SCARD_CONTEXTS];
+
+	ZeroMemory(&test_scard_api, sizeof(SCardApiFunctionTable));
+	test_scard_api.pfnSCardEstablishContext = test_SCardEstablishContext;
+	test_scard_api.pfnSCardReleaseContext = test_SCardReleaseContext;
+	test_scard_api.pfnSCardIsValidContext = test_SCardIsValidContext;
+	test_scard_api.pfnSCardCancel = test_SCardCancel;
+	test_scard_api.pfnSCardGetStatusChangeA = test_SCardGetStatusChangeA;
+
+	SCardRegisterSCardApiFunctionTable(&test_scard_api);
+
+	for (index = 0; index < TEST_SCARD_CONTEXTS; index++)
+		test_scard_contexts[index].event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	test_scard_semaphore = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+
+	ZeroMemory(&devman, sizeof(DEVMAN));
+	ZeroMemory(&device, sizeof(RDPDR_SMARTCARD));
+	ZeroMemory(&entryPoints, sizeof(DEVICE_SERVICE_ENTRY_POINTS));
+
+	devman.id_sequence = 1;
+	device.Type = RDPDR_DTYP_SMARTCARD;
+	device.Name = "SCARD";
+
+	entryPoints.devman = &devman;
+	entryPoints.RegisterDevice = test_scard_register_device;
+	entryPoints.device = (RDPDR_DEVICE*) &device;
+
+	smartcard_DeviceServiceEntry(&entryPoints);
+
+	if (!test_scard_device)
+		goto fail;
+
+	for (index = 0; index < TEST_SCARD_CONTEXTS; index++)
+		test_scard_establish_context(&hContexts[index], &establishResults[index]);
+
+	if (!test_scard_wait(TEST_SCARD_CONTEXTS) ||
+			(test_scard_check(establishResults, SCARD_S_SUCCESS, "EstablishContext") < 0))
+		goto cleanup;
+
+	for (index = 0; index < TEST_SCARD_CONTEXTS; index++)
+	{
+		test_scard_get_status_change(hContexts[index], INFINITE, &blockingResults[index]);
+		test_scard_get_status_change(hContexts[index], 0, &pollingResults[index]);
+	}
+
+	/* every context must get a worker thread of its own */
+
+	start = GetTickCount64();
+
+	while ((test_scard_blocked < TEST_SCARD_CONTEXTS) && ((GetTickCount64() - start) < 10000))
+		Sleep(10);
+
+	blocked = (test_scard_blocked == TEST_SCARD_CONTEXTS) ? TRUE : FALSE;
+
+	if (!blocked)
+		printf("%d of %d contexts blocked at once\n", (int) test_scard_blocked, TEST_SCARD_CONTEXTS);
+
+	for (index = 0; index < TEST_SCARD_CONTEXTS; index++)
+		test_scard_context_call(TEST_SCARD_IOCTL_CANCEL, hContexts[index], &cancelResults[index]);
+
+	if (!test_scard_wait(TEST_SCARD_CONTEXTS * 3))
+	{
+		printf("IRPs did not complete after SCardCancel\n");
+		goto cleanup;
+	}
+
+	for (index = 0; index < TEST_SCARD_CONTEXTS; index++)
+		test_scard_context_call(TEST_SCARD_IOCTL_RELEASECONTEXT, hContexts[index], &releaseResults[index]);
+
+	if (!test_scard_wait(TEST_SCARD_CONTEXTS))
+		goto cleanup;
+
+	if (test_scard_check(blockingResults, SCARD_E_CANCELLED, "SCardGetStatusChange (blocking)") < 0)
+		goto cleanup;
+
+	if (test_scard_check(pollingResults, SCARD_E_TIMEOUT, "SCardGetStatusChange (polling)") < 0)
+		goto cleanup;
+
+	if (test_scard_check(cancelResults, SCARD_S_SUCCESS, "SCardCancel") < 0)
+		goto cleanup;
+
+	if (test_scard_check(releaseResults, SCARD_S_SUCCESS, "SCardReleaseContext") < 0)
+		goto cleanup;
+
+	if (test_scard_errors)
+		printf("%d errors\n", (int) test_scard_errors);
+	else if (blocked)
+		rc = 0;
+
+cleanup:
+	test_scard_device->Free(test_scard_device);
+
+fail:
+	for (index = 0; index < TEST_SCARD_CONTEXTS; index++)
+		CloseHandle(test_scard_contexts[index].event);
+
+	CloseHandle(test_scard_semaphore);
+
+	return rc;
+}
@@ -56,61 +56,29 @@ static void usb_process_get_port_status(IUDEVICE* pdev, BYTE* OutputBuffer)
 
 #if ISOCH_FIFO
 
-static int func_check_isochronous_fds(IUDEVICE* pdev)
+static void func_isoch_write(ISOCH_CALLBACK_DATA* isoch)
 {
-	int ret = 0;
-	BYTE* data_temp;
-	UINT32 size_temp, process_times = 2;
-	ISOCH_CALLBACK_QUEUE* isoch_queue = NULL;
-	ISOCH_CALLBACK_DATA* isoch = NULL;
-	URBDRC_CHANNEL_CALLBACK* callback;
-
-	isoch_queue = (ISOCH_CALLBACK_QUEUE*) pdev->get_isoch_queue(pdev);
-
-	while (process_times)
-	{
-		process_times--;
-
-		if (isoch_queue == NULL || !pdev)
-			return -1;
-
-		pthread_mutex_lock(&isoch_queue->isoch_loading);
+	IUDEVICE* pdev = (IUDEVICE*) isoch->device;
+	URBDRC_CHANNEL_CALLBACK* callback = (URBDRC_CHANNEL_CALLBACK*) isoch->callback;
 
-		if (isoch_queue->head == NULL)
-		{
-			pthread_mutex_unlock(&isoch_queue->isoch_loading);
-			continue;
-		}
-		else
-		{
-			isoch = isoch_queue->head;
-		}
+	if (pdev && !pdev->isSigToEnd(pdev))
+		callback->channel->Write(callback->channel, isoch->out_size, isoch->out_data, NULL);
+}
 
-		if (!isoch || !isoch->out_data)
-		{
-			pthread_mutex_unlock(&isoch_queue->isoch_loading);
-			continue;
-		}
-		else
-		{
-			callback = (URBDRC_CHANNEL_CALLBACK*) isoch->callback;
-			size_temp = isoch->out_size;
-			data_temp = isoch->out_data;
+static int func_check_isochronous_fds(IUDEVICE* pdev)
+{
+	ISOCH_CALLBACK_QUEUE* isoch_queue = NULL;
 
-			ret = isoch_queue->unregister_data(isoch_queue, isoch);
+	if (!pdev)
+		return -1;
 
-			if (!ret)
-				WLog_DBG(TAG, "isoch_queue_unregister_data: Not found isoch data!!");
+	isoch_queue = (ISOCH_CALLBACK_QUEUE*) pdev->get_isoch_queue(pdev);
 
-			pthread_mutex_unlock(&isoch_queue->isoch_loading);
+	if (isoch_queue == NULL)
+		return -1;
 
-			if (pdev && !pdev->isSigToEnd(pdev))
-			{
-				callback->channel->Write(callback->channel, size_temp, data_temp, NULL);
-				zfree(data_temp);
-			}
-		}
-	}
+	/* sends every completion that is ready, in request order */
+	isoch_queue->flush(isoch_queue, func_isoch_write);
 
 	return 0;
 }
@@ -837,22 +805,60 @@ static int urb_isoch_transfer(URBDRC_CHANNEL_CALLBACK * callback, BYTE * data,
 	data_read_UINT32(data + offset, OutputBufferSize);
 	offset += 4;
 
+#if ISOCH_FIFO
+	ISOCH_CALLBACK_QUEUE * isoch_queue = NULL;
+	ISOCH_CALLBACK_DATA * isoch = NULL;
+	if (!noAck)
+	{
+		isoch_queue = (ISOCH_CALLBACK_QUEUE *)pdev->get_isoch_queue(pdev);
+		isoch = isoch_queue->register_data(isoch_queue, callback, pdev);
+
+		if (isoch == NULL)
+		{
+			/* the dispatcher locked the fifo for this request */
+			pdev->unlock_fifo_isoch(pdev);
+			return -1;
+		}
+	}
+#endif
+
 	/** send data memory alloc */
 	if (transferDir == USBD_TRANSFER_DIRECTION_OUT) {
-		if (!noAck) {
+		if (!noAck)
 			out_size = 48 + (NumberOfPackets * 12);
-			out_data = (BYTE *) malloc(out_size);
-			iso_packets = out_data + 40;
-		}
 	}
 	else {
 		out_size = 48 + OutputBufferSize + (NumberOfPackets * 12);
-		out_data = (BYTE *) malloc(out_size);
-		iso_packets = out_data + 40;
 	}
 
 	if (out_size)
+	{
+#if ISOCH_FIFO
+		/* the completion is built in a recycled buffer of the queue */
+		if (isoch)
+			out_data = isoch_queue->get_buffer(isoch_queue, isoch, out_size);
+		else
+#endif
+			out_data = (BYTE *) malloc(out_size);
+
+		if (out_data == NULL)
+		{
+			WLog_ERR(TAG, "urb_isoch_transfer: out of memory");
+#if ISOCH_FIFO
+			if (isoch)
+			{
+				pthread_mutex_lock(&isoch_queue->isoch_loading);
+				isoch_queue->unregister_data(isoch_queue, isoch);
+				pthread_mutex_unlock(&isoch_queue->isoch_loading);
+				pdev->unlock_fifo_isoch(pdev);
+			}
+#endif
+			return -1;
+		}
+
 		memset(out_data, 0, out_size);
+		iso_packets = out_data + 40;
+	}
 
 	switch (transferDir)
 	{
@@ -873,16 +879,6 @@ static int urb_isoch_transfer(URBDRC_CHANNEL_CALLBACK * callback, BYTE * data,
 		EndpointAddress, TransferFlags, StartFrame,
 		NumberOfPackets, OutputBufferSize, RequestId);
 
-#if ISOCH_FIFO
-	ISOCH_CALLBACK_QUEUE * isoch_queue = NULL;
-	ISOCH_CALLBACK_DATA * isoch = NULL;
-	if(!noAck)
-	{
-		isoch_queue = (ISOCH_CALLBACK_QUEUE *)pdev->get_isoch_queue(pdev);
-		isoch = isoch_queue->register_data(isoch_queue, callback, pdev);
-	}
-#endif
-
 	iso_status = pdev->isoch_transfer(
 		pdev, RequestId, EndpointAddress,
 		TransferFlags,
@@ -945,12 +941,8 @@ static int urb_isoch_transfer(URBDRC_CHANNEL_CALLBACK * callback, BYTE * data,
 	data_write_UINT32(out_data + offset + 4, OutputBufferSize);	/** OutputBufferSize */
 
 #if ISOCH_FIFO
-	if(!noAck){
-		pthread_mutex_lock(&isoch_queue->isoch_loading);
-		isoch->out_data = out_data;
-		isoch->out_size = out_size;
-		pthread_mutex_unlock(&isoch_queue->isoch_loading);
-	}
+	/* sent by func_check_isochronous_fds once the earlier requests completed */
+	isoch_queue->complete_data(isoch_queue, isoch, out_size);
 #else
 	if (!pdev->isSigToEnd(pdev))
 		callback->channel->Write(callback->channel, out_size, out_data, NULL);
@@ -51,17 +51,34 @@ static ISOCH_CALLBACK_DATA* isoch_queue_register_data(ISOCH_CALLBACK_QUEUE* queu
 {
 	ISOCH_CALLBACK_DATA* isoch;
 	
-	isoch = (ISOCH_CALLBACK_DATA*) malloc(sizeof(ISOCH_CALLBACK_DATA));
+	pthread_mutex_lock(&queue->isoch_loading);
+
+	/* reuse a recycled entry, it keeps its completion buffer */
+	isoch = queue->pool;
+
+	if (isoch != NULL)
+	{
+		queue->pool = (ISOCH_CALLBACK_DATA*)isoch->next;
+		queue->pool_num--;
+	}
+	else
+	{
+		isoch = (ISOCH_CALLBACK_DATA*) calloc(1, sizeof(ISOCH_CALLBACK_DATA));
+
+		if (isoch == NULL)
+		{
+			pthread_mutex_unlock(&queue->isoch_loading);
+			return NULL;
+		}
+	}
 	
 	isoch->prev = NULL;
 	isoch->next = NULL;
 	
-	isoch->out_data = NULL;
 	isoch->out_size = 0;
+	isoch->completed = FALSE;
 	isoch->device = dev;
 	isoch->callback = callback;
-	
-	pthread_mutex_lock(&queue->isoch_loading);
 
 	if (queue->head == NULL)
 	{
@@ -83,6 +100,25 @@ static ISOCH_CALLBACK_DATA* isoch_queue_register_data(ISOCH_CALLBACK_QUEUE* queu
 	return isoch;
 }
 
+/* called with the queue locked, once the entry is out of the linked queue */
+static void isoch_queue_recycle(ISOCH_CALLBACK_QUEUE* queue, ISOCH_CALLBACK_DATA* isoch)
+{
+	if (queue->pool_num >= ISOCH_POOL_MAX)
+	{
+		zfree(isoch->out_data);
+		zfree(isoch);
+		return;
+	}
+
+	isoch->prev = NULL;
+	isoch->next = (void*)queue->pool;
+	isoch->device = NULL;
+	isoch->callback = NULL;
+	isoch->completed = FALSE;
+	queue->pool = isoch;
+	queue->pool_num++;
+}
+
 static int isoch_queue_unregister_data(ISOCH_CALLBACK_QUEUE* queue, ISOCH_CALLBACK_DATA* isoch)
 {
 	ISOCH_CALLBACK_DATA* p;
@@ -124,10 +160,7 @@ static int isoch_queue_unregister_data(ISOCH_CALLBACK_QUEUE* queue, ISOCH_CALLBA
 			}
 			queue->isoch_num--;
 			
-			/* free data info */
-			isoch->out_data = NULL;
-			
-			if (isoch) zfree(isoch); 
+			isoch_queue_recycle(queue, isoch);
 	
 			return 1; /* unregistration successful */
 		}
@@ -137,6 +170,94 @@ static int isoch_queue_unregister_data(ISOCH_CALLBACK_QUEUE* queue, ISOCH_CALLBA
 	return 0;
 }
 
+/**
+ * The entry is owned by the transfer until it is completed, so its buffer
+ * is sized without holding the queue lock.
+ */
+static BYTE* isoch_queue_get_buffer(ISOCH_CALLBACK_QUEUE* queue, ISOCH_CALLBACK_DATA* isoch, UINT32 size)
+{
+	if (size > isoch->out_capacity)
+	{
+		zfree(isoch->out_data);
+		isoch->out_capacity = 0;
+		isoch->out_data = (BYTE*) malloc(size);
+
+		if (isoch->out_data == NULL)
+			return NULL;
+
+		isoch->out_capacity = size;
+	}
+
+	return isoch->out_data;
+}
+
+static void isoch_queue_complete_data(ISOCH_CALLBACK_QUEUE* queue, ISOCH_CALLBACK_DATA* isoch, UINT32 out_size)
+{
+	pthread_mutex_lock(&queue->isoch_loading);
+	isoch->out_size = out_size;
+	isoch->completed = TRUE;
+	pthread_mutex_unlock(&queue->isoch_loading);
+}
+
+/**
+ * Sends the completed entries at the head of the queue, returns how many
+ * were sent. Only one thread flushes at a time: a completion that arrives
+ * while another thread is writing is picked up by that thread before it
+ * leaves, so the caller does not wait for it.
+ */
+static int isoch_queue_flush(ISOCH_CALLBACK_QUEUE* queue, ISOCH_WRITE_FN write)
+{
+	int i, count;
+	int sent = 0;
+	ISOCH_CALLBACK_DATA* batch[ISOCH_FLUSH_BATCH];
+
+	pthread_mutex_lock(&queue->isoch_loading);
+
+	if (queue->flushing)
+	{
+		pthread_mutex_unlock(&queue->isoch_loading);
+		return 0;
+	}
+
+	queue->flushing = TRUE;
+
+	while (queue->head != NULL && queue->head->completed)
+	{
+		/* take the run of completed entries off the head */
+		count = 0;
+
+		while (count < ISOCH_FLUSH_BATCH && queue->head != NULL && queue->head->completed)
+		{
+			batch[count++] = queue->head;
+			queue->head = (ISOCH_CALLBACK_DATA*)queue->head->next;
+			queue->isoch_num--;
+		}
+
+		if (queue->head != NULL)
+			queue->head->prev = NULL;
+		else
+			queue->tail = NULL;
+
+		pthread_mutex_unlock(&queue->isoch_loading);
+
+		for (i = 0; i < count; i++)
+			write(batch[i]);
+
+		pthread_mutex_lock(&queue->isoch_loading);
+
+		for (i = 0; i < count; i++)
+			isoch_queue_recycle(queue, batch[i]);
+
+		sent += count;
+	}
+
+	queue->flushing = FALSE;
+
+	pthread_mutex_unlock(&queue->isoch_loading);
+
+	return sent;
+}
+
 void isoch_queue_free(ISOCH_CALLBACK_QUEUE* queue)
 {
 	ISOCH_CALLBACK_DATA* isoch;
@@ -154,6 +275,17 @@ void isoch_queue_free(ISOCH_CALLBACK_QUEUE* queue)
 			queue->unregister_data(queue, isoch);
 	}
 
+	/** free the recycled entries */
+	while (queue->pool != NULL)
+	{
+		isoch = queue->pool;
+		queue->pool = (ISOCH_CALLBACK_DATA*)isoch->next;
+		zfree(isoch->out_data);
+		zfree(isoch);
+	}
+
+	queue->pool_num = 0;
+
 	pthread_mutex_unlock(&queue->isoch_loading);
 
 	pthread_mutex_destroy(&queue->isoch_loading);
@@ -167,11 +299,18 @@ ISOCH_CALLBACK_QUEUE* isoch_queue_new()
 {
 	ISOCH_CALLBACK_QUEUE* queue;
 	
-	queue = (ISOCH_CALLBACK_QUEUE*) malloc(sizeof(ISOCH_CALLBACK_QUEUE));
+	queue = (ISOCH_CALLBACK_QUEUE*) calloc(1, sizeof(ISOCH_CALLBACK_QUEUE));
+
+	if (queue == NULL)
+		return NULL;
+
 	queue->isoch_num = 0;
 	queue->curr = NULL;
 	queue->head = NULL;
 	queue->tail = NULL;   
+	queue->pool = NULL;
+	queue->pool_num = 0;
+	queue->flushing = FALSE;
 	
 	pthread_mutex_init(&queue->isoch_loading, NULL);
 	
@@ -181,6 +320,9 @@ ISOCH_CALLBACK_QUEUE* isoch_queue_new()
 	queue->rewind = isoch_queue_rewind;
 	queue->register_data = isoch_queue_register_data;
 	queue->unregister_data = isoch_queue_unregister_data;
+	queue->get_buffer = isoch_queue_get_buffer;
+	queue->complete_data = isoch_queue_complete_data;
+	queue->flush = isoch_queue_flush;
 	queue->free = isoch_queue_free;
 	
 	return queue;
@@ -27,6 +27,12 @@
 typedef struct _ISOCH_CALLBACK_DATA ISOCH_CALLBACK_DATA;
 typedef struct _ISOCH_CALLBACK_QUEUE ISOCH_CALLBACK_QUEUE;
 
+/* sends a completed isochronous URB, called in request order */
+typedef void (*ISOCH_WRITE_FN) (ISOCH_CALLBACK_DATA* isoch);
+
+/* completions sent per pass of the flusher and completion buffers kept for reuse */
+#define ISOCH_FLUSH_BATCH	32
+#define ISOCH_POOL_MAX		64
 
 struct _ISOCH_CALLBACK_DATA
 {
@@ -36,10 +42,19 @@ struct _ISOCH_CALLBACK_DATA
 	void * device;
 	BYTE * out_data;
 	UINT32 out_size;
+	UINT32 out_capacity;
+	BOOL completed;
 	void * callback;
 };
 
-
+/**
+ * Isochronous URBs are completed in the order they were requested. The
+ * entries are registered in request order, their transfers run in parallel
+ * and complete in any order, and whichever thread completes the head of the
+ * queue sends every completion that is ready in one pass while the others
+ * return at once. Entries are recycled with their completion buffer, so a
+ * steady stream of URBs does not allocate.
+ */
 
 struct _ISOCH_CALLBACK_QUEUE
 {
@@ -47,6 +62,10 @@ struct _ISOCH_CALLBACK_QUEUE
 	ISOCH_CALLBACK_DATA* curr; /* current point */
 	ISOCH_CALLBACK_DATA* head; /* head point in linked list */
 	ISOCH_CALLBACK_DATA* tail; /* tail point in linked list */
+
+	ISOCH_CALLBACK_DATA* pool; /* recycled entries */
+	int pool_num;
+	BOOL flushing;
 	
 	pthread_mutex_t isoch_loading;
 	
@@ -57,6 +76,9 @@ struct _ISOCH_CALLBACK_QUEUE
 	ISOCH_CALLBACK_DATA *(*get_next) (ISOCH_CALLBACK_QUEUE * queue);
 	ISOCH_CALLBACK_DATA *(*register_data) (ISOCH_CALLBACK_QUEUE* queue, 
 		void * callback, void * dev);
+	BYTE *(*get_buffer) (ISOCH_CALLBACK_QUEUE* queue, ISOCH_CALLBACK_DATA* isoch, UINT32 size);
+	void (*complete_data) (ISOCH_CALLBACK_QUEUE* queue, ISOCH_CALLBACK_DATA* isoch, UINT32 out_size);
+	int (*flush) (ISOCH_CALLBACK_QUEUE* queue, ISOCH_WRITE_FN write);
 	void (*free) (ISOCH_CALLBACK_QUEUE * queue);
 	
 };
@@ -1246,6 +1246,74 @@ static int libusb_udev_request_queue_is_none(IUDEVICE* idev)
 	return 0;
 }
 
+/**
+ * A transfer allocated for at least the number of packets is taken from
+ * the pool, isochronous URBs of a stream usually all have the same size.
+ */
+static struct libusb_transfer* func_iso_transfer_get(UDEVICE* pdev, int NumberOfPackets, int* PoolPackets)
+{
+	int i;
+	struct libusb_transfer* transfer = NULL;
+
+	pthread_mutex_lock(&pdev->mutex_iso_pool);
+
+	for (i = pdev->iso_pool_num - 1; i >= 0; i--)
+	{
+		if (pdev->iso_pool_packets[i] >= NumberOfPackets)
+		{
+			transfer = pdev->iso_pool[i];
+			*PoolPackets = pdev->iso_pool_packets[i];
+			pdev->iso_pool_num--;
+			pdev->iso_pool[i] = pdev->iso_pool[pdev->iso_pool_num];
+			pdev->iso_pool_packets[i] = pdev->iso_pool_packets[pdev->iso_pool_num];
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&pdev->mutex_iso_pool);
+
+	if (transfer == NULL)
+	{
+		transfer = libusb_alloc_transfer(NumberOfPackets);
+		*PoolPackets = NumberOfPackets;
+	}
+
+	return transfer;
+}
+
+static void func_iso_transfer_put(UDEVICE* pdev, struct libusb_transfer* transfer, int PoolPackets)
+{
+	pthread_mutex_lock(&pdev->mutex_iso_pool);
+
+	if (pdev->iso_pool_num < ISO_TRANSFER_POOL_SIZE)
+	{
+		pdev->iso_pool[pdev->iso_pool_num] = transfer;
+		pdev->iso_pool_packets[pdev->iso_pool_num] = PoolPackets;
+		pdev->iso_pool_num++;
+		transfer = NULL;
+	}
+
+	pthread_mutex_unlock(&pdev->mutex_iso_pool);
+
+	if (transfer != NULL)
+		libusb_free_transfer(transfer);
+}
+
+void udev_free_iso_pool(UDEVICE* pdev)
+{
+	int i;
+
+	pthread_mutex_lock(&pdev->mutex_iso_pool);
+
+	for (i = 0; i < pdev->iso_pool_num; i++)
+		libusb_free_transfer(pdev->iso_pool[i]);
+
+	pdev->iso_pool_num = 0;
+
+	pthread_mutex_unlock(&pdev->mutex_iso_pool);
+	pthread_mutex_destroy(&pdev->mutex_iso_pool);
+}
+
 static int libusb_udev_isoch_transfer(IUDEVICE* idev, UINT32 RequestId, UINT32 EndpointAddress,
 	UINT32 TransferFlags, int NoAck, UINT32* ErrorCount,
 	UINT32* UrbdStatus, UINT32* StartFrame, UINT32 NumberOfPackets,
@@ -1256,26 +1324,29 @@ static int libusb_udev_isoch_transfer(IUDEVICE* idev, UINT32 RequestId, UINT32 E
 	ISO_USER_DATA iso_user_data;
 	struct libusb_transfer* iso_transfer = NULL;
 	int status = 0, ret = 0, submit = 0;
+	int pool_packets = 0;
 
 	iso_packet_size = *BufferSize / NumberOfPackets;
 
-	iso_transfer = libusb_alloc_transfer(NumberOfPackets);
+	iso_transfer = func_iso_transfer_get(pdev, NumberOfPackets, &pool_packets);
+
+	/**  process URB_FUNCTION_IOSCH_TRANSFER */
+	func_iso_data_init(&iso_user_data, NumberOfPackets, *BufferSize, NoAck, IsoPacket, Buffer);
 
 	if (iso_transfer == NULL)
 	{
 		WLog_ERR(TAG,  "Error: libusb_alloc_transfer.");
 		status = -1;
 	}
+	else
+	{
+		/** fill setting */
+		libusb_fill_iso_transfer(iso_transfer, 
+			pdev->libusb_handle, EndpointAddress, Buffer, *BufferSize,
+			NumberOfPackets, func_iso_callback, &iso_user_data, 2000);
 
-	/**  process URB_FUNCTION_IOSCH_TRANSFER */
-	func_iso_data_init(&iso_user_data, NumberOfPackets, *BufferSize, NoAck, IsoPacket, Buffer);
-
-	/** fill setting */
-	libusb_fill_iso_transfer(iso_transfer, 
-		pdev->libusb_handle, EndpointAddress, Buffer, *BufferSize,
-		NumberOfPackets, func_iso_callback, &iso_user_data, 2000);
-
-	libusb_set_iso_packet_lengths(iso_transfer, iso_packet_size);
+		libusb_set_iso_packet_lengths(iso_transfer, iso_packet_size);
+	}
 
 	if (pdev->status & (URBDRC_DEVICE_SIGNAL_END | URBDRC_DEVICE_NOT_FOUND))
 		status = -1;
@@ -1326,8 +1397,20 @@ static int libusb_udev_isoch_transfer(IUDEVICE* idev, UINT32 RequestId, UINT32 E
 
 	*ErrorCount = iso_user_data.error_count;
 	*StartFrame = iso_user_data.start_frame;
+
+	if (iso_transfer == NULL)
+	{
+		*BufferSize = 0;
+		return status;
+	}
+
 	*BufferSize = iso_transfer->actual_length;
-	libusb_free_transfer(iso_transfer);
+
+	/* only a transfer libusb is done with can be submitted again */
+	if (iso_user_data.completed)
+		func_iso_transfer_put(pdev, iso_transfer, pool_packets);
+	else
+		libusb_free_transfer(iso_transfer);
 
 	return status;
 }
@@ -1800,6 +1883,8 @@ static IUDEVICE* udev_init(UDEVICE* pdev, UINT16 bus_number, UINT16 dev_number)
 	pdev->MsConfig = msusb_msconfig_new();
 
 	pthread_mutex_init(&pdev->mutex_isoch, NULL);
+	pthread_mutex_init(&pdev->mutex_iso_pool, NULL);
+	pdev->iso_pool_num = 0;
 
 	//deb_config_msg(pdev->libusb_dev, config_temp, devDescriptor->bNumConfigurations);  
 
@@ -39,6 +39,9 @@ typedef struct libusb_endpoint_descriptor		LIBUSB_ENDPOINT_DESCEIPTOR;
 
 typedef struct _UDEVICE UDEVICE;
 
+/* isochronous transfers kept for reuse per device */
+#define ISO_TRANSFER_POOL_SIZE			16
+
 struct _UDEVICE
 {
 	IUDEVICE iface;
@@ -70,11 +73,17 @@ struct _UDEVICE
 
 	pthread_mutex_t mutex_isoch;
 	sem_t   sem_id;
+
+	struct libusb_transfer * iso_pool[ISO_TRANSFER_POOL_SIZE];
+	int	iso_pool_packets[ISO_TRANSFER_POOL_SIZE];
+	int	iso_pool_num;
+	pthread_mutex_t mutex_iso_pool;
 };
 typedef UDEVICE * PUDEVICE;
 
 int udev_new_by_id(UINT16 idVendor, UINT16 idProduct, IUDEVICE ***devArray);
 IUDEVICE* udev_new_by_addr(int bus_number, int dev_number);
+void udev_free_iso_pool(UDEVICE* pdev);
 
 extern int libusb_debug;
 
@@ -282,6 +282,8 @@ static int udevman_unregister_udevice(IUDEVMAN* idevman, int bus_number, int dev
 		/* free the config descriptor that send from windows */
 		msusb_msconfig_free(dev->MsConfig);
 
+		udev_free_iso_pool(dev);
+
 		libusb_close (dev->libusb_handle);
 		libusb_close (dev->hub_handle);
 		
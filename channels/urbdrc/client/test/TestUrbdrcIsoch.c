@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <winpr/crt.h>
+
+#include "isoch_queue.h"
+
+/**
+ * Isochronous pipeline against a mock device: URBs are dispatched in order
+ * to a thread each, as the channel does, and the mock device completes them
+ * after a random latency so that completions arrive out of order. Every
+ * completion must be sent exactly once and in request order, the buffers
+ * must be reused, and completions that became ready together must be sent
+ * in one pass.
+ */
+
+#define TEST_ISOCH_URBS		2000
+#define TEST_ISOCH_IN_FLIGHT	24
+#define TEST_ISOCH_PACKETS	8
+#define TEST_ISOCH_PACKET_SIZE	384
+#define TEST_ISOCH_OUT_SIZE	(48 + TEST_ISOCH_PACKETS * (12 + TEST_ISOCH_PACKET_SIZE))
+#define TEST_ISOCH_MAX_BUFFERS	256
+
+struct _TEST_ISOCH_DEVICE
+{
+	ISOCH_CALLBACK_QUEUE* queue;
+	sem_t dispatched;
+	sem_t slots;
+	pthread_mutex_t lock;
+
+	UINT32 next;
+	UINT32 errors;
+	UINT32 flushes;
+	UINT32 batched;
+	BYTE* buffers[TEST_ISOCH_MAX_BUFFERS];
+	UINT32 buffer_num;
+};
+typedef struct _TEST_ISOCH_DEVICE TEST_ISOCH_DEVICE;
+
+struct _TEST_ISOCH_URB
+{
+	TEST_ISOCH_DEVICE* device;
+	UINT32 index;
+	UINT32 latency;
+};
+typedef struct _TEST_ISOCH_URB TEST_ISOCH_URB;
+
+static UINT32 g_Seed = 1;
+
+static UINT32 test_isoch_random(UINT32 range)
+{
+	g_Seed = g_Seed * 1103515245 + 12345;
+	return ((g_Seed >> 16) & 0x7FFF) % (range + 1);
+}
+
+/* the channel write: checks the order and records the buffers in use */
+static void test_isoch_write(ISOCH_CALLBACK_DATA* isoch)
+{
+	UINT32 i;
+	UINT32 index;
+	TEST_ISOCH_DEVICE* device = (TEST_ISOCH_DEVICE*) isoch->device;
+
+	index = *((UINT32*) isoch->out_data);
+
+	if ((index != device->next) || (isoch->out_size != TEST_ISOCH_OUT_SIZE) || !isoch->completed)
+		device->errors++;
+
+	device->next++;
+
+	for (i = 0; i < device->buffer_num; i++)
+	{
+		if (device->buffers[i] == isoch->out_data)
+			return;
+	}
+
+	if (device->buffer_num < TEST_ISOCH_MAX_BUFFERS)
+		device->buffers[device->buffer_num] = isoch->out_data;
+
+	device->buffer_num++;
+}
+
+static void* test_isoch_transfer(void* arg)
+{
+	int sent;
+	BYTE* out_data;
+	ISOCH_CALLBACK_DATA* isoch;
+	TEST_ISOCH_URB* urb = (TEST_ISOCH_URB*) arg;
+	TEST_ISOCH_DEVICE* device = urb->device;
+	ISOCH_CALLBACK_QUEUE* queue = device->queue;
+
+	/* registered before the next URB is dispatched, as urb_isoch_transfer does */
+	isoch = queue->register_data(queue, NULL, device);
+	sem_post(&device->dispatched);
+
+	if (!isoch)
+	{
+		pthread_mutex_lock(&device->lock);
+		device->errors++;
+		pthread_mutex_unlock(&device->lock);
+		sem_post(&device->slots);
+		return NULL;
+	}
+
+	out_data = queue->get_buffer(queue, isoch, TEST_ISOCH_OUT_SIZE);
+
+	/* the mock device fills the packets after its latency */
+	usleep(urb->latency);
+
+	if (out_data)
+	{
+		ZeroMemory(out_data, TEST_ISOCH_OUT_SIZE);
+		*((UINT32*) out_data) = urb->index;
+	}
+
+	queue->complete_data(queue, isoch, out_data ? TEST_ISOCH_OUT_SIZE : 0);
+	sent = queue->flush(queue, test_isoch_write);
+
+	pthread_mutex_lock(&device->lock);
+	device->flushes++;
+
+	if (sent > 1)
+		device->batched++;
+
+	pthread_mutex_unlock(&device->lock);
+
+	sem_post(&device->slots);
+
+	return NULL;
+}
+
+/* the head of the queue completes last, nothing may be sent before it */
+static BOOL test_isoch_head_of_line(void)
+{
+	int i;
+	BOOL rc = FALSE;
+	ISOCH_CALLBACK_DATA* isoch[3];
+	TEST_ISOCH_DEVICE device = { 0 };
+
+	device.queue = isoch_queue_new();
+
+	if (!device.queue)
+		return FALSE;
+
+	for (i = 0; i < 3; i++)
+	{
+		isoch[i] = device.queue->register_data(device.queue, NULL, &device);
+
+		if (!isoch[i] || !device.queue->get_buffer(device.queue, isoch[i], TEST_ISOCH_OUT_SIZE))
+			goto out;
+
+		*((UINT32*) isoch[i]->out_data) = i;
+	}
+
+	device.queue->complete_data(device.queue, isoch[2], TEST_ISOCH_OUT_SIZE);
+	device.queue->complete_data(device.queue, isoch[1], TEST_ISOCH_OUT_SIZE);
+
+	if (device.queue->flush(device.queue, test_isoch_write) != 0)
+		goto out;
+
+	device.queue->complete_data(device.queue, isoch[0], TEST_ISOCH_OUT_SIZE);
+
+	if (device.queue->flush(device.queue, test_isoch_write) != 3)
+		goto out;
+
+	/* the entries are recycled with their buffers */
+	if ((device.queue->isoch_num != 0) || (device.queue->pool_num != 3))
+		goto out;
+
+	isoch[0] = device.queue->register_data(device.queue, NULL, &device);
+
+	if (!isoch[0] || (isoch[0]->out_capacity != TEST_ISOCH_OUT_SIZE) || isoch[0]->completed)
+		goto out;
+
+	rc = (device.next == 3) && !device.errors;
+
+out:
+	device.queue->free(device.queue);
+	return rc;
+}
+
+static BOOL test_isoch_stream(void)
+{
+	UINT32 index;
+	BOOL rc = FALSE;
+	pthread_t* threads;
+	TEST_ISOCH_URB* urbs;
+	TEST_ISOCH_DEVICE device = { 0 };
+
+	g_Seed = 1;
+
+	threads = (pthread_t*) calloc(TEST_ISOCH_URBS, sizeof(pthread_t));
+	urbs = (TEST_ISOCH_URB*) calloc(TEST_ISOCH_URBS, sizeof(TEST_ISOCH_URB));
+	device.queue = isoch_queue_new();
+
+	if (!threads || !urbs || !device.queue)
+		goto out;
+
+	pthread_mutex_init(&device.lock, NULL);
+	sem_init(&device.dispatched, 0, 0);
+	sem_init(&device.slots, 0, TEST_ISOCH_IN_FLIGHT);
+
+	for (index = 0; index < TEST_ISOCH_URBS; index++)
+	{
+		urbs[index].device = &device;
+		urbs[index].index = index;
+
+		/* one URB in eight is held up for several frames */
+		urbs[index].latency = test_isoch_random(1000);
+
+		if (test_isoch_random(7) == 0)
+			urbs[index].latency += 4000;
+
+		sem_wait(&device.slots);
+
+		if (pthread_create(&threads[index], NULL, test_isoch_transfer, &urbs[index]) != 0)
+			break;
+
+		/* the next URB is dispatched once this one is registered */
+		sem_wait(&device.dispatched);
+	}
+
+	while (index > 0)
+		pthread_join(threads[--index], NULL);
+
+	/* nothing may be left behind once the last transfer flushed */
+	if (device.queue->flush(device.queue, test_isoch_write) != 0)
+		device.errors++;
+
+	printf("isoch: %u URBs sent, %u flushes, %u sent several completions, %u buffers, %d pooled\n",
+			device.next, device.flushes, device.batched, device.buffer_num, device.queue->pool_num);
+
+	rc = (device.next == TEST_ISOCH_URBS) && !device.errors &&
+		(device.queue->isoch_num == 0) && (device.queue->head == NULL) &&
+		(device.queue->pool_num > 0) && (device.queue->pool_num <= ISOCH_POOL_MAX) &&
+		(device.buffer_num <= TEST_ISOCH_URBS / 10) && (device.batched > 0);
+
+	sem_destroy(&device.slots);
+	sem_destroy(&device.dispatched);
+	pthread_mutex_destroy(&device.lock);
+
+out:
+	if (device.queue)
+		device.queue->free(device.queue);
+
+	free(urbs);
+	free(threads);
+
+	return rc;
+}
+
+int TestUrbdrcIsoch(int argc, char* argv[])
+{
+	if (!test_isoch_head_of_line())
+	{
+		printf("isoch: head of line test failed\n");
+		return -1;
+	}
+
+	if (!test_isoch_stream())
+	{
+		printf("isoch: stream test failed\n");
+		return -1;
+	}
+
+	return 0;
+}
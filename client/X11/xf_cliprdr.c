@@ -21,7 +21,12 @@
 #include "config.h"
 #endif
 
+#include <errno.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 
@@ -30,11 +35,15 @@
 #endif
 
 #include <winpr/crt.h>
+#include <winpr/path.h>
 #include <winpr/image.h>
+#include <winpr/endian.h>
 #include <winpr/stream.h>
+#include <winpr/sysinfo.h>
 #include <winpr/clipboard.h>
 
 #include <freerdp/log.h>
+#include <freerdp/utils/cliprdr.h>
 #include <freerdp/client/cliprdr.h>
 #include <freerdp/channels/channels.h>
 
@@ -42,6 +51,9 @@
 
 #define TAG CLIENT_TAG("x11")
 
+/* the largest range read for the server at once */
+#define XF_CLIPRDR_MAX_RANGE	0x1000000
+
 struct xf_cliprdr_format
 {
 	Atom atom;
@@ -93,9 +105,34 @@ struct xf_clipboard
 	int xfixes_event_base;
 	int xfixes_error_base;
 	BOOL xfixes_supported;
+
+	/* File streams */
+	BOOL streams_supported;
+	UINT32 file_group_descriptor_id;
+
+	/* local files offered to the server */
+	char** local_files;
+	UINT32 num_local_files;
+	int local_fd;
+	UINT32 local_fd_index;
+	BYTE* local_buffer;
+	UINT32 local_buffer_size;
+
+	/* server files copied to the download directory */
+	CLIPRDR_FILEDESCRIPTOR* remote_files;
+	UINT32 num_remote_files;
+	UINT32 remote_file_index;
+	char* download_path;
+	char** old_download_paths;
+	UINT32 num_old_download_paths;
+	int download_fd;
+	CLIPRDR_FILE_TRANSFER* transfer;
+	char* file_uri_list;
+	char* file_gnome_list;
 };
 
 int xf_cliprdr_send_client_format_list(xfClipboard* clipboard);
+static void xf_cliprdr_provide_file_uris(xfClipboard* clipboard, XEvent* respond, UINT32 formatId);
 
 static void xf_cliprdr_check_owner(xfClipboard* clipboard)
 {
@@ -148,6 +185,11 @@ static BOOL xf_cliprdr_is_self_owned(xfClipboard* clipboard)
 	return (id ? TRUE : FALSE);
 }
 
+static BOOL xf_cliprdr_is_file_format(UINT32 formatId)
+{
+	return (formatId == CB_FORMAT_TEXTURILIST) || (formatId == CB_FORMAT_GNOMECOPIEDFILES);
+}
+
 static xfCliprdrFormat* xf_cliprdr_get_format_by_id(xfClipboard* clipboard, UINT32 formatId)
 {
 	UINT32 index;
@@ -179,6 +221,15 @@ static xfCliprdrFormat* xf_cliprdr_get_format_by_atom(xfClipboard* clipboard, At
 		if (format->formatId == 0)
 			return format;
 
+		/* the server registers its own id for files */
+		if (xf_cliprdr_is_file_format(format->formatId))
+		{
+			if (clipboard->file_group_descriptor_id)
+				return format;
+
+			continue;
+		}
+
 		for (j = 0; j < clipboard->numServerFormats; j++)
 		{
 			if (clipboard->serverFormats[j].formatId == format->formatId)
@@ -189,6 +240,24 @@ static xfCliprdrFormat* xf_cliprdr_get_format_by_atom(xfClipboard* clipboard, At
 	return NULL;
 }
 
+/* files of the local owner are offered whatever the server has on its clipboard */
+static xfCliprdrFormat* xf_cliprdr_get_local_format_by_atom(xfClipboard* clipboard, Atom atom)
+{
+	xfCliprdrFormat* format;
+
+	format = xf_cliprdr_get_format_by_id(clipboard, CB_FORMAT_TEXTURILIST);
+
+	if (format && (format->atom == atom))
+		return clipboard->streams_supported ? format : NULL;
+
+	format = xf_cliprdr_get_format_by_atom(clipboard, atom);
+
+	if (format && xf_cliprdr_is_file_format(format->formatId))
+		return NULL;
+
+	return format;
+}
+
 static void xf_cliprdr_send_data_request(xfClipboard* clipboard, UINT32 formatId)
 {
 	CLIPRDR_FORMAT_DATA_REQUEST request;
@@ -213,6 +282,275 @@ static void xf_cliprdr_send_data_response(xfClipboard* clipboard, BYTE* data, in
 	clipboard->context->ClientFormatDataResponse(clipboard->context, &response);
 }
 
+static void xf_cliprdr_clear_local_files(xfClipboard* clipboard)
+{
+	UINT32 index;
+
+	for (index = 0; index < clipboard->num_local_files; index++)
+		free(clipboard->local_files[index]);
+
+	free(clipboard->local_files);
+	clipboard->local_files = NULL;
+	clipboard->num_local_files = 0;
+
+	if (clipboard->local_fd >= 0)
+	{
+		close(clipboard->local_fd);
+		clipboard->local_fd = -1;
+	}
+}
+
+/**
+ * Adds a file to the list offered to the server, a directory is followed by
+ * its contents. Names are relative to the directory the file was copied
+ * from, with backslashes as separators.
+ */
+
+static BOOL xf_cliprdr_add_local_file(xfClipboard* clipboard, const char* path, const char* name,
+		CLIPRDR_FILEDESCRIPTOR** files, UINT32* capacity, BOOL follow)
+{
+	int length;
+	DIR* dir;
+	UINT32 newCapacity;
+	struct stat sb;
+	struct dirent* entry;
+	char* childPath;
+	char* childName;
+	char** localFiles;
+	WCHAR* wszName = NULL;
+	CLIPRDR_FILEDESCRIPTOR* file;
+	CLIPRDR_FILEDESCRIPTOR* newFiles;
+
+	if ((follow ? stat(path, &sb) : lstat(path, &sb)) != 0)
+		return FALSE;
+
+	/* links within a directory are not followed, they could loop */
+	if (!S_ISDIR(sb.st_mode) && !S_ISREG(sb.st_mode))
+		return TRUE;
+
+	if (clipboard->num_local_files >= *capacity)
+	{
+		newCapacity = *capacity ? *capacity * 2 : 16;
+
+		newFiles = (CLIPRDR_FILEDESCRIPTOR*) realloc(*files, newCapacity * sizeof(CLIPRDR_FILEDESCRIPTOR));
+
+		if (!newFiles)
+			return FALSE;
+
+		*files = newFiles;
+
+		localFiles = (char**) realloc(clipboard->local_files, newCapacity * sizeof(char*));
+
+		if (!localFiles)
+			return FALSE;
+
+		clipboard->local_files = localFiles;
+		*capacity = newCapacity;
+	}
+
+	file = &(*files)[clipboard->num_local_files];
+	ZeroMemory(file, sizeof(CLIPRDR_FILEDESCRIPTOR));
+
+	length = ConvertToUnicode(CP_UTF8, 0, name, -1, &wszName, 0);
+
+	if ((length < 1) || (length * 2 > sizeof(file->fileName)))
+	{
+		WLog_WARN(TAG, "file name too long: %s", name);
+		free(wszName);
+		return FALSE;
+	}
+
+	CopyMemory(file->fileName, wszName, length * 2);
+	free(wszName);
+
+	file->flags = FD_ATTRIBUTES | FD_FILESIZE | FD_WRITESTIME | FD_SHOWPROGRESSUI;
+	file->lastWriteTime = (((UINT64) sb.st_mtime) + 11644473600ULL) * 10000000ULL;
+
+	if (S_ISDIR(sb.st_mode))
+	{
+		file->fileAttributes = FILE_ATTRIBUTE_DIRECTORY;
+	}
+	else
+	{
+		file->fileAttributes = FILE_ATTRIBUTE_NORMAL;
+		file->fileSizeHigh = (UINT32) (((UINT64) sb.st_size) >> 32);
+		file->fileSizeLow = (UINT32) (((UINT64) sb.st_size) & 0xFFFFFFFF);
+	}
+
+	clipboard->local_files[clipboard->num_local_files] = _strdup(path);
+
+	if (!clipboard->local_files[clipboard->num_local_files])
+		return FALSE;
+
+	clipboard->num_local_files++;
+
+	if (!S_ISDIR(sb.st_mode))
+		return TRUE;
+
+	dir = opendir(path);
+
+	if (!dir)
+		return TRUE;
+
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+			continue;
+
+		childPath = (char*) malloc(strlen(path) + strlen(entry->d_name) + 2);
+		childName = (char*) malloc(strlen(name) + strlen(entry->d_name) + 2);
+
+		if (childPath && childName)
+		{
+			sprintf(childPath, "%s/%s", path, entry->d_name);
+			sprintf(childName, "%s\\%s", name, entry->d_name);
+
+			if (!xf_cliprdr_add_local_file(clipboard, childPath, childName, files, capacity, FALSE))
+				WLog_WARN(TAG, "unable to offer %s", childPath);
+		}
+
+		free(childPath);
+		free(childName);
+	}
+
+	closedir(dir);
+
+	return TRUE;
+}
+
+static int xf_cliprdr_hex_value(char c)
+{
+	if ((c >= '0') && (c <= '9'))
+		return c - '0';
+
+	if ((c >= 'a') && (c <= 'f'))
+		return c - 'a' + 10;
+
+	if ((c >= 'A') && (c <= 'F'))
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+/* file://host/path with the host being local, percent-encoded */
+static char* xf_cliprdr_uri_to_path(const char* uri, size_t length)
+{
+	char* path;
+	size_t index;
+	size_t pathLength = 0;
+
+	if ((length < 7) || (strncmp(uri, "file://", 7) != 0))
+		return NULL;
+
+	uri += 7;
+	length -= 7;
+
+	while (length && (*uri != '/'))
+	{
+		uri++;
+		length--;
+	}
+
+	if (!length)
+		return NULL;
+
+	path = (char*) malloc(length + 1);
+
+	if (!path)
+		return NULL;
+
+	for (index = 0; index < length; index++)
+	{
+		if ((uri[index] == '%') && (index + 2 < length) &&
+				(xf_cliprdr_hex_value(uri[index + 1]) >= 0) && (xf_cliprdr_hex_value(uri[index + 2]) >= 0))
+		{
+			path[pathLength++] = (char) ((xf_cliprdr_hex_value(uri[index + 1]) << 4) |
+					xf_cliprdr_hex_value(uri[index + 2]));
+			index += 2;
+		}
+		else
+		{
+			path[pathLength++] = uri[index];
+		}
+	}
+
+	path[pathLength] = '\0';
+
+	/* a directory is named without its trailing separator */
+	while ((pathLength > 1) && (path[pathLength - 1] == '/'))
+		path[--pathLength] = '\0';
+
+	return path;
+}
+
+/**
+ * The text/uri-list of the local clipboard owner is sent to the server as
+ * FileGroupDescriptorW, the files are then read as the server requests them.
+ */
+
+static void xf_cliprdr_send_file_list(xfClipboard* clipboard, const BYTE* data, int size)
+{
+	char* path;
+	char* name;
+	size_t length;
+	UINT32 capacity = 0;
+	BYTE* formatData = NULL;
+	UINT32 formatDataLength = 0;
+	const char* line = (const char*) data;
+	const char* end = (const char*) data + size;
+	const char* lineEnd;
+	CLIPRDR_FILEDESCRIPTOR* files = NULL;
+
+	xf_cliprdr_clear_local_files(clipboard);
+
+	while (line < end)
+	{
+		lineEnd = (const char*) memchr(line, '\n', end - line);
+
+		if (!lineEnd)
+			lineEnd = end;
+
+		length = lineEnd - line;
+
+		if (length && (line[length - 1] == '\r'))
+			length--;
+
+		/* the list may end with a terminating null */
+		while (length && !line[length - 1])
+			length--;
+
+		if (length && (line[0] != '#'))
+		{
+			path = xf_cliprdr_uri_to_path(line, length);
+
+			if (path)
+			{
+				name = strrchr(path, '/');
+
+				if (name && name[1] && !xf_cliprdr_add_local_file(clipboard, path, name + 1, &files, &capacity, TRUE))
+					WLog_WARN(TAG, "unable to offer %s", path);
+
+				free(path);
+			}
+		}
+
+		line = lineEnd + 1;
+	}
+
+	if (!clipboard->num_local_files ||
+			(cliprdr_serialize_file_list(files, clipboard->num_local_files, &formatData, &formatDataLength) < 0))
+	{
+		xf_cliprdr_send_data_response(clipboard, NULL, 0);
+	}
+	else
+	{
+		xf_cliprdr_send_data_response(clipboard, formatData, (int) formatDataLength);
+	}
+
+	free(formatData);
+	free(files);
+}
+
 static void xf_cliprdr_get_requested_targets(xfClipboard* clipboard)
 {
 	int i;
@@ -240,7 +578,7 @@ static void xf_cliprdr_get_requested_targets(xfClipboard* clipboard)
 	{
 		atom = ((Atom*) data)[i];
 
-		format = xf_cliprdr_get_format_by_atom(clipboard, atom);
+		format = xf_cliprdr_get_local_format_by_atom(clipboard, atom);
 
 		if (format)
 		{
@@ -285,6 +623,12 @@ static void xf_cliprdr_process_requested_data(xfClipboard* clipboard, BOOL hasDa
 		return;
 	}
 
+	if (format->formatId == CB_FORMAT_TEXTURILIST)
+	{
+		xf_cliprdr_send_file_list(clipboard, data, size);
+		return;
+	}
+
 	formatId = 0;
 	altFormatId = 0;
 
@@ -553,7 +897,13 @@ static BOOL xf_cliprdr_process_selection_request(xfClipboard* clipboard, XEvent*
 				}
 			}
 
-			if ((clipboard->data != 0) && (formatId == clipboard->data_format) && (altFormatId == clipboard->data_alt_format))
+			if (xf_cliprdr_is_file_format(formatId) && clipboard->file_uri_list)
+			{
+				/* the files of the server are being or have been copied */
+				respond->xselection.property = xevent->xselectionrequest.property;
+				xf_cliprdr_provide_file_uris(clipboard, respond, formatId);
+			}
+			else if ((clipboard->data != 0) && (formatId == clipboard->data_format) && (altFormatId == clipboard->data_alt_format))
 			{
 				/* Cached clipboard data available. Send it now */
 				respond->xselection.property = xevent->xselectionrequest.property;
@@ -581,6 +931,9 @@ static BOOL xf_cliprdr_process_selection_request(xfClipboard* clipboard, XEvent*
 				clipboard->data_alt_format = altFormatId;
 				delayRespond = TRUE;
 
+				if (xf_cliprdr_is_file_format(formatId))
+					altFormatId = clipboard->file_group_descriptor_id;
+
 				xf_cliprdr_send_data_request(clipboard, altFormatId);
 			}
 		}
@@ -707,7 +1060,7 @@ int xf_cliprdr_send_client_capabilities(xfClipboard* clipboard)
 	generalCapabilitySet.capabilitySetLength = 12;
 
 	generalCapabilitySet.version = CB_CAPS_VERSION_2;
-	generalCapabilitySet.generalFlags = CB_USE_LONG_FORMAT_NAMES;
+	generalCapabilitySet.generalFlags = CB_USE_LONG_FORMAT_NAMES | CB_STREAM_FILECLIP_ENABLED | CB_FILECLIP_NO_FILE_PATHS;
 
 	clipboard->context->ClientCapabilities(clipboard->context, &capabilities);
 
@@ -726,10 +1079,19 @@ int xf_cliprdr_send_client_format_list(xfClipboard* clipboard)
 	numFormats = clipboard->numClientFormats;
 	formats = (CLIPRDR_FORMAT*) calloc(numFormats, sizeof(CLIPRDR_FORMAT));
 
-	for (i = 0; i < numFormats; i++)
+	numFormats = 0;
+
+	for (i = 0; i < clipboard->numClientFormats; i++)
 	{
-		formats[i].formatId = clipboard->clientFormats[i].formatId;
-		formats[i].formatName = clipboard->clientFormats[i].formatName;
+		if (clipboard->clientFormats[i].formatId == CB_FORMAT_GNOMECOPIEDFILES)
+			continue;
+
+		if ((clipboard->clientFormats[i].formatId == CB_FORMAT_TEXTURILIST) && !clipboard->streams_supported)
+			continue;
+
+		formats[numFormats].formatId = clipboard->clientFormats[i].formatId;
+		formats[numFormats].formatName = clipboard->clientFormats[i].formatName;
+		numFormats++;
 	}
 
 	formatList.msgFlags = CB_RESPONSE_OK;
@@ -791,7 +1153,654 @@ static int xf_cliprdr_monitor_ready(CliprdrClientContext* context, CLIPRDR_MONIT
 
 static int xf_cliprdr_server_capabilities(CliprdrClientContext* context, CLIPRDR_CAPABILITIES* capabilities)
 {
-	//xfClipboard* clipboard = (xfClipboard*) context->custom;
+	CLIPRDR_GENERAL_CAPABILITY_SET* generalCapabilitySet;
+	xfClipboard* clipboard = (xfClipboard*) context->custom;
+
+	generalCapabilitySet = (CLIPRDR_GENERAL_CAPABILITY_SET*) capabilities->capabilitySets;
+
+	clipboard->streams_supported = (capabilities->cCapabilitiesSets > 0) &&
+		(generalCapabilitySet->capabilitySetType == CB_CAPSTYPE_GENERAL) &&
+		(generalCapabilitySet->generalFlags & CB_STREAM_FILECLIP_ENABLED);
+
+	return 1;
+}
+
+static BOOL xf_cliprdr_open_local_file(xfClipboard* clipboard, UINT32 listIndex)
+{
+	if (listIndex >= clipboard->num_local_files)
+		return FALSE;
+
+	if ((clipboard->local_fd >= 0) && (clipboard->local_fd_index == listIndex))
+		return TRUE;
+
+	if (clipboard->local_fd >= 0)
+		close(clipboard->local_fd);
+
+	clipboard->local_fd = open(clipboard->local_files[listIndex], O_RDONLY);
+	clipboard->local_fd_index = listIndex;
+
+	return (clipboard->local_fd >= 0);
+}
+
+/* a range that is only partly read is requested again for the rest */
+static BYTE* xf_cliprdr_read_local_file(xfClipboard* clipboard, UINT64 offset, UINT32* length)
+{
+	ssize_t status;
+	UINT32 count = 0;
+	BYTE* buffer;
+
+	if (*length > XF_CLIPRDR_MAX_RANGE)
+		*length = XF_CLIPRDR_MAX_RANGE;
+
+	if (clipboard->local_buffer_size < *length)
+	{
+		buffer = (BYTE*) realloc(clipboard->local_buffer, *length);
+
+		if (!buffer)
+			return NULL;
+
+		clipboard->local_buffer = buffer;
+		clipboard->local_buffer_size = *length;
+	}
+
+	while (count < *length)
+	{
+		status = pread(clipboard->local_fd, &clipboard->local_buffer[count], *length - count, (off_t) (offset + count));
+
+		if (status < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return NULL;
+		}
+
+		if (status == 0)
+			break;
+
+		count += (UINT32) status;
+	}
+
+	*length = count;
+
+	return clipboard->local_buffer;
+}
+
+static int xf_cliprdr_server_file_contents_request(CliprdrClientContext* context, CLIPRDR_FILE_CONTENTS_REQUEST* fileContentsRequest)
+{
+	UINT64 offset;
+	UINT32 length;
+	BYTE* data;
+	struct stat sb;
+	BYTE sizeData[8];
+	CLIPRDR_FILE_CONTENTS_RESPONSE response;
+	xfClipboard* clipboard = (xfClipboard*) context->custom;
+
+	ZeroMemory(&response, sizeof(CLIPRDR_FILE_CONTENTS_RESPONSE));
+
+	response.streamId = fileContentsRequest->streamId;
+	response.dwFlags = fileContentsRequest->dwFlags;
+	response.msgFlags = CB_RESPONSE_FAIL;
+
+	if (xf_cliprdr_open_local_file(clipboard, fileContentsRequest->listIndex))
+	{
+		if (fileContentsRequest->dwFlags & FILECONTENTS_SIZE)
+		{
+			if (fstat(clipboard->local_fd, &sb) == 0)
+			{
+				Data_Write_UINT64(sizeData, (UINT64) sb.st_size);
+				response.msgFlags = CB_RESPONSE_OK;
+				response.cbRequested = sizeof(UINT64);
+				response.requestedData = sizeData;
+			}
+		}
+		else if (fileContentsRequest->dwFlags & FILECONTENTS_RANGE)
+		{
+			offset = (((UINT64) fileContentsRequest->nPositionHigh) << 32) | fileContentsRequest->nPositionLow;
+			length = fileContentsRequest->cbRequested;
+			data = xf_cliprdr_read_local_file(clipboard, offset, &length);
+
+			if (data)
+			{
+				response.msgFlags = CB_RESPONSE_OK;
+				response.cbRequested = length;
+				response.requestedData = data;
+			}
+		}
+	}
+
+	if (response.msgFlags & CB_RESPONSE_FAIL)
+		WLog_WARN(TAG, "unable to read file %u for the server", fileContentsRequest->listIndex);
+
+	context->ClientFileContentsResponse(context, &response);
+
+	return 1;
+}
+
+static char* xf_cliprdr_encode_uri(char* dst, const char* path)
+{
+	BYTE c;
+	static const char hex[] = "0123456789ABCDEF";
+
+	dst += sprintf(dst, "file://");
+
+	for (; *path; path++)
+	{
+		c = (BYTE) *path;
+
+		if (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9')) ||
+				(c == '/') || (c == '-') || (c == '_') || (c == '.') || (c == '~'))
+		{
+			*dst++ = (char) c;
+		}
+		else
+		{
+			*dst++ = '%';
+			*dst++ = hex[c >> 4];
+			*dst++ = hex[c & 0x0F];
+		}
+	}
+
+	return dst;
+}
+
+/* the name is relative to the download directory and may not leave it */
+static char* xf_cliprdr_get_download_path(xfClipboard* clipboard, const CLIPRDR_FILEDESCRIPTOR* file)
+{
+	char* p;
+	char* path;
+	char* name = NULL;
+	char* component;
+
+	if (ConvertFromUnicode(CP_UTF8, 0, (const WCHAR*) file->fileName, -1, &name, 0, NULL, NULL) < 1)
+		return NULL;
+
+	for (p = name; *p; p++)
+	{
+		if (*p == '/')
+			*p = '\\';
+	}
+
+	component = name;
+
+	for (p = name; ; p++)
+	{
+		if ((*p == '\\') || !*p)
+		{
+			if ((p == component) || (*component == ':') ||
+					((p - component == 1) && (component[0] == '.')) ||
+					((p - component == 2) && (component[0] == '.') && (component[1] == '.')) ||
+					(memchr(component, ':', p - component) != NULL))
+			{
+				WLog_ERR(TAG, "refusing to copy a file outside of %s", clipboard->download_path);
+				free(name);
+				return NULL;
+			}
+
+			if (!*p)
+				break;
+
+			component = p + 1;
+		}
+	}
+
+	path = GetCombinedPath(clipboard->download_path, name);
+	free(name);
+
+	return path;
+}
+
+static BOOL xf_cliprdr_build_file_uris(xfClipboard* clipboard)
+{
+	UINT32 index;
+	size_t size;
+	char* path;
+	char* uriList;
+	char* gnomeList;
+	char** paths;
+	const WCHAR* wszName;
+	CLIPRDR_FILEDESCRIPTOR* file;
+
+	paths = (char**) calloc(clipboard->num_remote_files, sizeof(char*));
+
+	if (!paths)
+		return FALSE;
+
+	/* only the top level is pasted, directories bring their contents */
+	size = 8;
+
+	for (index = 0; index < clipboard->num_remote_files; index++)
+	{
+		file = &clipboard->remote_files[index];
+		wszName = (const WCHAR*) file->fileName;
+
+		while (*wszName && (*wszName != '\\') && (*wszName != '/'))
+			wszName++;
+
+		if (*wszName)
+			continue;
+
+		paths[index] = xf_cliprdr_get_download_path(clipboard, file);
+
+		if (paths[index])
+			size += 7 + 3 * strlen(paths[index]) + 2;
+	}
+
+	uriList = (char*) malloc(size);
+	gnomeList = (char*) malloc(size);
+
+	if (uriList && gnomeList)
+	{
+		char* uri = uriList;
+		char* gnome = gnomeList + sprintf(gnomeList, "copy");
+
+		for (index = 0; index < clipboard->num_remote_files; index++)
+		{
+			path = paths[index];
+
+			if (!path)
+				continue;
+
+			uri = xf_cliprdr_encode_uri(uri, path);
+			uri += sprintf(uri, "\r\n");
+
+			gnome += sprintf(gnome, "\n");
+			gnome = xf_cliprdr_encode_uri(gnome, path);
+		}
+
+		*uri = '\0';
+		*gnome = '\0';
+	}
+
+	for (index = 0; index < clipboard->num_remote_files; index++)
+		free(paths[index]);
+
+	free(paths);
+
+	if (!uriList || !gnomeList)
+	{
+		free(uriList);
+		free(gnomeList);
+		return FALSE;
+	}
+
+	clipboard->file_uri_list = uriList;
+	clipboard->file_gnome_list = gnomeList;
+
+	return TRUE;
+}
+
+static void xf_cliprdr_provide_file_uris(xfClipboard* clipboard, XEvent* respond, UINT32 formatId)
+{
+	char* list;
+
+	list = (formatId == CB_FORMAT_GNOMECOPIEDFILES) ? clipboard->file_gnome_list : clipboard->file_uri_list;
+
+	xf_cliprdr_provide_data(clipboard, respond, (BYTE*) list, (UINT32) strlen(list));
+}
+
+/* the contents of the files may still be on their way when the request is answered */
+static void xf_cliprdr_respond_file_uris(xfClipboard* clipboard, BOOL success)
+{
+	xfContext* xfc = clipboard->xfc;
+
+	if (success && !clipboard->file_uri_list)
+		success = xf_cliprdr_build_file_uris(clipboard);
+
+	if (!clipboard->respond)
+		return;
+
+	if (success)
+		xf_cliprdr_provide_file_uris(clipboard, clipboard->respond, clipboard->data_format);
+	else
+		clipboard->respond->xselection.property = None;
+
+	XSendEvent(xfc->display, clipboard->respond->xselection.requestor, 0, 0, clipboard->respond);
+	XFlush(xfc->display);
+
+	free(clipboard->respond);
+	clipboard->respond = NULL;
+}
+
+/* links are removed rather than followed, only what they point to lives elsewhere */
+static void xf_cliprdr_remove_download_path(const char* path)
+{
+	DIR* dir;
+	char* childPath;
+	struct stat sb;
+	struct dirent* entry;
+
+	if (lstat(path, &sb) != 0)
+		return;
+
+	if (!S_ISDIR(sb.st_mode))
+	{
+		if (unlink(path) != 0)
+			WLog_WARN(TAG, "unable to remove %s", path);
+
+		return;
+	}
+
+	dir = opendir(path);
+
+	if (dir)
+	{
+		while ((entry = readdir(dir)) != NULL)
+		{
+			if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+				continue;
+
+			childPath = (char*) malloc(strlen(path) + strlen(entry->d_name) + 2);
+
+			if (!childPath)
+				continue;
+
+			sprintf(childPath, "%s/%s", path, entry->d_name);
+			xf_cliprdr_remove_download_path(childPath);
+			free(childPath);
+		}
+
+		closedir(dir);
+	}
+
+	if (rmdir(path) != 0)
+		WLog_WARN(TAG, "unable to remove %s", path);
+}
+
+/* pastes of an earlier copy may read from its directory until a later copy is complete */
+static void xf_cliprdr_remove_old_download_paths(xfClipboard* clipboard)
+{
+	UINT32 index;
+
+	for (index = 0; index < clipboard->num_old_download_paths; index++)
+	{
+		xf_cliprdr_remove_download_path(clipboard->old_download_paths[index]);
+		free(clipboard->old_download_paths[index]);
+	}
+
+	free(clipboard->old_download_paths);
+	clipboard->old_download_paths = NULL;
+	clipboard->num_old_download_paths = 0;
+}
+
+static void xf_cliprdr_clear_remote_files(xfClipboard* clipboard)
+{
+	char** paths;
+
+	cliprdr_file_transfer_cancel(clipboard->transfer);
+
+	if (clipboard->download_fd >= 0)
+	{
+		close(clipboard->download_fd);
+		clipboard->download_fd = -1;
+	}
+
+	free(clipboard->remote_files);
+	clipboard->remote_files = NULL;
+	clipboard->num_remote_files = 0;
+	clipboard->remote_file_index = 0;
+
+	if (clipboard->download_path)
+	{
+		paths = (char**) realloc(clipboard->old_download_paths,
+				(clipboard->num_old_download_paths + 1) * sizeof(char*));
+
+		if (paths)
+		{
+			paths[clipboard->num_old_download_paths++] = clipboard->download_path;
+			clipboard->old_download_paths = paths;
+		}
+		else
+		{
+			WLog_WARN(TAG, "leaving %s behind", clipboard->download_path);
+			free(clipboard->download_path);
+		}
+
+		clipboard->download_path = NULL;
+	}
+
+	free(clipboard->file_uri_list);
+	clipboard->file_uri_list = NULL;
+
+	free(clipboard->file_gnome_list);
+	clipboard->file_gnome_list = NULL;
+}
+
+static void xf_cliprdr_file_done(xfClipboard* clipboard)
+{
+	UINT64 lastWriteTime;
+	struct timespec times[2];
+	CLIPRDR_FILEDESCRIPTOR* file = &clipboard->remote_files[clipboard->remote_file_index];
+
+	if ((file->flags & FD_WRITESTIME) && (file->lastWriteTime >= 116444736000000000ULL))
+	{
+		lastWriteTime = file->lastWriteTime - 116444736000000000ULL;
+
+		times[0].tv_sec = 0;
+		times[0].tv_nsec = UTIME_OMIT;
+		times[1].tv_sec = (time_t) (lastWriteTime / 10000000ULL);
+		times[1].tv_nsec = (long) ((lastWriteTime % 10000000ULL) * 100);
+
+		futimens(clipboard->download_fd, times);
+	}
+
+	close(clipboard->download_fd);
+	clipboard->download_fd = -1;
+	clipboard->remote_file_index++;
+}
+
+/* the directories and empty files exist before the request is answered */
+static BOOL xf_cliprdr_create_download_layout(xfClipboard* clipboard)
+{
+	int fd;
+	int status;
+	char* path;
+	UINT32 index;
+	CLIPRDR_FILEDESCRIPTOR* file;
+
+	for (index = 0; index < clipboard->num_remote_files; index++)
+	{
+		file = &clipboard->remote_files[index];
+		path = xf_cliprdr_get_download_path(clipboard, file);
+
+		if (!path)
+			return FALSE;
+
+		if (file->fileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			status = mkdir(path, 0700);
+
+			if ((status != 0) && (errno == EEXIST))
+				status = 0;
+		}
+		else
+		{
+			fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+			status = (fd < 0) ? -1 : close(fd);
+		}
+
+		if (status != 0)
+		{
+			WLog_ERR(TAG, "unable to create %s", path);
+			free(path);
+			return FALSE;
+		}
+
+		free(path);
+	}
+
+	return TRUE;
+}
+
+/* a later paste asks the server again */
+static void xf_cliprdr_download_failed(xfClipboard* clipboard)
+{
+	if (clipboard->download_fd >= 0)
+	{
+		close(clipboard->download_fd);
+		clipboard->download_fd = -1;
+	}
+
+	WLog_ERR(TAG, "unable to copy the files from the server, %s is incomplete", clipboard->download_path);
+
+	free(clipboard->file_uri_list);
+	clipboard->file_uri_list = NULL;
+
+	free(clipboard->file_gnome_list);
+	clipboard->file_gnome_list = NULL;
+}
+
+/**
+ * The files are copied one after the other, each of them with several
+ * ranges in flight. Data is written to the destination file as it arrives.
+ */
+
+static void xf_cliprdr_download_next(xfClipboard* clipboard)
+{
+	char* path;
+	CLIPRDR_FILEDESCRIPTOR* file;
+
+	while (clipboard->remote_file_index < clipboard->num_remote_files)
+	{
+		file = &clipboard->remote_files[clipboard->remote_file_index];
+
+		if (file->fileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			clipboard->remote_file_index++;
+			continue;
+		}
+
+		path = xf_cliprdr_get_download_path(clipboard, file);
+
+		if (!path)
+			break;
+
+		clipboard->download_fd = open(path, O_WRONLY | O_TRUNC);
+
+		if (clipboard->download_fd < 0)
+		{
+			WLog_ERR(TAG, "unable to create %s", path);
+			free(path);
+			break;
+		}
+
+		free(path);
+
+		if (cliprdr_file_transfer_start(clipboard->transfer, clipboard->remote_file_index, 0,
+				file, GetTickCount()) < 0)
+			break;
+
+		if (clipboard->transfer->state != CLIPRDR_FILE_TRANSFER_DONE)
+			return;
+
+		xf_cliprdr_file_done(clipboard);
+	}
+
+	if (clipboard->remote_file_index < clipboard->num_remote_files)
+	{
+		xf_cliprdr_download_failed(clipboard);
+		return;
+	}
+
+	xf_cliprdr_remove_old_download_paths(clipboard);
+}
+
+static void xf_cliprdr_download_files(xfClipboard* clipboard, CLIPRDR_FORMAT_DATA_RESPONSE* formatDataResponse)
+{
+	char* path;
+	char* tempPath;
+
+	xf_cliprdr_clear_remote_files(clipboard);
+
+	if ((formatDataResponse->msgFlags & CB_RESPONSE_FAIL) ||
+			(cliprdr_parse_file_list(formatDataResponse->requestedFormatData, formatDataResponse->dataLen,
+				&clipboard->remote_files, &clipboard->num_remote_files) < 0) ||
+			!clipboard->num_remote_files)
+	{
+		xf_cliprdr_respond_file_uris(clipboard, FALSE);
+		return;
+	}
+
+	tempPath = GetKnownPath(KNOWN_PATH_TEMP);
+	path = GetCombinedPath(tempPath, "freerdp-cliprdr-XXXXXX");
+	free(tempPath);
+
+	if (!path || !mkdtemp(path))
+	{
+		WLog_ERR(TAG, "unable to create a directory for the files from the server");
+		free(path);
+		xf_cliprdr_respond_file_uris(clipboard, FALSE);
+		return;
+	}
+
+	clipboard->download_path = path;
+
+	if (!xf_cliprdr_create_download_layout(clipboard))
+	{
+		xf_cliprdr_respond_file_uris(clipboard, FALSE);
+		return;
+	}
+
+	/* requestors time out after a few seconds, the contents are streamed after the answer */
+	xf_cliprdr_respond_file_uris(clipboard, TRUE);
+
+	if (clipboard->file_uri_list)
+		xf_cliprdr_download_next(clipboard);
+}
+
+static int xf_cliprdr_download_request(CLIPRDR_FILE_TRANSFER* transfer, CLIPRDR_FILE_CONTENTS_REQUEST* request)
+{
+	xfClipboard* clipboard = (xfClipboard*) transfer->custom;
+
+	return (clipboard->context->ClientFileContentsRequest(clipboard->context, request) < 0) ? -1 : 1;
+}
+
+static int xf_cliprdr_download_write(CLIPRDR_FILE_TRANSFER* transfer, UINT64 offset, const BYTE* data, UINT32 length)
+{
+	ssize_t status;
+	xfClipboard* clipboard = (xfClipboard*) transfer->custom;
+
+	while (length > 0)
+	{
+		status = pwrite(clipboard->download_fd, data, length, (off_t) offset);
+
+		if (status < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			WLog_ERR(TAG, "unable to write file %u: %s", transfer->listIndex, strerror(errno));
+			return -1;
+		}
+
+		data += status;
+		offset += status;
+		length -= (UINT32) status;
+	}
+
+	return 1;
+}
+
+static int xf_cliprdr_server_file_contents_response(CliprdrClientContext* context, CLIPRDR_FILE_CONTENTS_RESPONSE* fileContentsResponse)
+{
+	int status;
+	xfClipboard* clipboard = (xfClipboard*) context->custom;
+
+	status = cliprdr_file_transfer_response(clipboard->transfer, fileContentsResponse, GetTickCount());
+
+	/* a response to a copy that was given up */
+	if (status == 0)
+		return 1;
+
+	if (clipboard->transfer->state == CLIPRDR_FILE_TRANSFER_DONE)
+	{
+		xf_cliprdr_file_done(clipboard);
+		xf_cliprdr_download_next(clipboard);
+	}
+	else if (status < 0)
+	{
+		xf_cliprdr_download_failed(clipboard);
+	}
 
 	return 1;
 }
@@ -809,6 +1818,10 @@ static int xf_cliprdr_server_format_list(CliprdrClientContext* context, CLIPRDR_
 		clipboard->data = NULL;
 	}
 
+	/* a copy of the previous files is given up, their directory is kept for pastes in progress */
+	xf_cliprdr_clear_remote_files(clipboard);
+	clipboard->file_group_descriptor_id = 0;
+
 	if (clipboard->serverFormats)
 	{
 		for (i = 0; i < clipboard->numServerFormats; i++)
@@ -846,6 +1859,18 @@ static int xf_cliprdr_server_format_list(CliprdrClientContext* context, CLIPRDR_
 				xf_cliprdr_append_target(clipboard, clipboard->clientFormats[j].atom);
 			}
 		}
+
+		if (format->formatName && !strcmp(format->formatName, "FileGroupDescriptorW"))
+			clipboard->file_group_descriptor_id = format->formatId;
+	}
+
+	if (clipboard->file_group_descriptor_id)
+	{
+		for (j = 0; j < clipboard->numClientFormats; j++)
+		{
+			if (xf_cliprdr_is_file_format(clipboard->clientFormats[j].formatId))
+				xf_cliprdr_append_target(clipboard, clipboard->clientFormats[j].atom);
+		}
 	}
 
 	xf_cliprdr_send_client_format_list_response(clipboard, TRUE);
@@ -920,6 +1945,13 @@ static int xf_cliprdr_server_format_data_response(CliprdrClientContext* context,
 	if (!clipboard->respond)
 		return 1;
 
+	if (xf_cliprdr_is_file_format(clipboard->data_format))
+	{
+		/* the request is answered once the directory layout exists */
+		xf_cliprdr_download_files(clipboard, formatDataResponse);
+		return 1;
+	}
+
 	format = xf_cliprdr_get_format_by_id(clipboard, clipboard->requestedFormatId);
 
 	if (clipboard->data)
@@ -1100,6 +2132,15 @@ xfClipboard* xf_clipboard_new(xfContext* xfc)
 	clipboard->clientFormats[n].formatName = _strdup("HTML Format");
 	n++;
 
+	clipboard->clientFormats[n].atom = XInternAtom(xfc->display, "text/uri-list", False);
+	clipboard->clientFormats[n].formatId = CB_FORMAT_TEXTURILIST;
+	clipboard->clientFormats[n].formatName = _strdup("FileGroupDescriptorW");
+	n++;
+
+	clipboard->clientFormats[n].atom = XInternAtom(xfc->display, "x-special/gnome-copied-files", False);
+	clipboard->clientFormats[n].formatId = CB_FORMAT_GNOMECOPIEDFILES;
+	n++;
+
 	clipboard->numClientFormats = n;
 
 	clipboard->targets[0] = XInternAtom(xfc->display, "TIMESTAMP", FALSE);
@@ -1108,6 +2149,21 @@ xfClipboard* xf_clipboard_new(xfContext* xfc)
 
 	clipboard->incr_atom = XInternAtom(xfc->display, "INCR", FALSE);
 
+	clipboard->local_fd = -1;
+	clipboard->download_fd = -1;
+	clipboard->transfer = cliprdr_file_transfer_new();
+
+	if (!clipboard->transfer)
+	{
+		xf_clipboard_free(clipboard);
+		xfc->clipboard = NULL;
+		return NULL;
+	}
+
+	clipboard->transfer->custom = clipboard;
+	clipboard->transfer->Request = xf_cliprdr_download_request;
+	clipboard->transfer->Write = xf_cliprdr_download_write;
+
 	return clipboard;
 }
 
@@ -1133,6 +2189,12 @@ void xf_clipboard_free(xfClipboard* clipboard)
 			free(clipboard->clientFormats[i].formatName);
 	}
 
+	xf_cliprdr_clear_local_files(clipboard);
+	xf_cliprdr_clear_remote_files(clipboard);
+	xf_cliprdr_remove_old_download_paths(clipboard);
+	cliprdr_file_transfer_free(clipboard->transfer);
+	free(clipboard->local_buffer);
+
 	ClipboardDestroy(clipboard->system);
 
 	free(clipboard->data);
@@ -1153,6 +2215,8 @@ void xf_cliprdr_init(xfContext* xfc, CliprdrClientContext* cliprdr)
 	cliprdr->ServerFormatListResponse = xf_cliprdr_server_format_list_response;
 	cliprdr->ServerFormatDataRequest = xf_cliprdr_server_format_data_request;
 	cliprdr->ServerFormatDataResponse = xf_cliprdr_server_format_data_response;
+	cliprdr->ServerFileContentsRequest = xf_cliprdr_server_file_contents_request;
+	cliprdr->ServerFileContentsResponse = xf_cliprdr_server_file_contents_response;
 }
 
 void xf_cliprdr_uninit(xfContext* xfc, CliprdrClientContext* cliprdr)
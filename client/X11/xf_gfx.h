@@ -25,33 +25,16 @@
 
 #include <freerdp/gdi/gfx.h>
 
+/* front-end data attached to each engine surface */
+
 struct xf_gfx_surface
 {
-	UINT16 surfaceId;
-	UINT32 width;
-	UINT32 height;
-	BOOL alpha;
-	BYTE* data;
-	BYTE* stage;
 	XImage* image;
-	int scanline;
+	BYTE* stage;
 	int stageStep;
-	UINT32 format;
 };
 typedef struct xf_gfx_surface xfGfxSurface;
 
-struct xf_gfx_cache_entry
-{
-	UINT64 cacheKey;
-	UINT32 width;
-	UINT32 height;
-	BOOL alpha;
-	BYTE* data;
-	int scanline;
-	UINT32 format;
-};
-typedef struct xf_gfx_cache_entry xfGfxCacheEntry;
-
 int xf_OutputExpose(xfContext* xfc, int x, int y, int width, int height);
 
 void xf_graphics_pipeline_init(xfContext* xfc, RdpgfxClientContext* gfx);
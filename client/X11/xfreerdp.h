@@ -121,10 +121,6 @@ struct xf_context
 	UINT32 bitmap_size;
 	BYTE* bitmap_buffer;
 	BYTE* primary_buffer;
-	REGION16 invalidRegion;
-	BOOL inGfxFrame;
-	BOOL graphicsReset;
-	UINT16 outputSurfaceId;
 
 	BOOL frame_begin;
 	UINT16 frame_x1;
@@ -196,6 +192,7 @@ struct xf_context
 	/* Channels */
 	RdpeiClientContext* rdpei;
 	RdpgfxClientContext* gfx;
+	gdiGfxEngine* gfxEngine;
 	EncomspClientContext* encomsp;
 
 	RailClientContext* rail;
@@ -25,6 +25,7 @@
 #include <assert.h>
 
 #include <winpr/crt.h>
+#include <winpr/path.h>
 #include <winpr/cmdline.h>
 
 #include <freerdp/addin.h>
@@ -88,6 +89,7 @@ COMMAND_LINE_ARGUMENT_A args[] =
 	{ "app-guid", COMMAND_LINE_VALUE_REQUIRED, "<app guid>", NULL, NULL, -1, NULL, "Remote application GUID" },
 	{ "compression", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, "z", "Compression" },
 	{ "compression-level", COMMAND_LINE_VALUE_REQUIRED, "<level>", NULL, NULL, -1, NULL, "Compression level (0,1,2)" },
+	{ "compression-effort", COMMAND_LINE_VALUE_REQUIRED, "<effort>", NULL, NULL, -1, NULL, "Compression effort (0: fast, 1: default, 2: high)" },
 	{ "shell", COMMAND_LINE_VALUE_REQUIRED, NULL, NULL, NULL, -1, NULL, "Alternate shell" },
 	{ "shell-dir", COMMAND_LINE_VALUE_REQUIRED, NULL, NULL, NULL, -1, NULL, "Shell working directory" },
 	{ "sound", COMMAND_LINE_VALUE_OPTIONAL, NULL, NULL, NULL, -1, "audio", "Audio output (sound)" },
@@ -119,6 +121,7 @@ COMMAND_LINE_ARGUMENT_A args[] =
 	{ "gfx-thin-client", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL, "RDP8 graphics pipeline thin client mode" },
 	{ "gfx-small-cache", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL, "RDP8 graphics pipeline small cache mode" },
 	{ "gfx-progressive", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL, "RDP8 graphics pipeline progressive codec" },
+	{ "gfx-cache-persist", COMMAND_LINE_VALUE_OPTIONAL, "<file>", NULL, NULL, -1, NULL, "RDP8 graphics pipeline persistent cache" },
 	{ "gfx-h264", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL, "RDP8.1 graphics pipeline H264 codec" },
 	{ "rfx", COMMAND_LINE_VALUE_FLAG, NULL, NULL, NULL, -1, NULL, "RemoteFX" },
 	{ "rfx-mode", COMMAND_LINE_VALUE_REQUIRED, "<image|video>", NULL, NULL, -1, NULL, "RemoteFX mode" },
@@ -148,6 +151,7 @@ COMMAND_LINE_ARGUMENT_A args[] =
 	{ "mouse-motion", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "mouse-motion" },
 	{ "parent-window", COMMAND_LINE_VALUE_REQUIRED, "<window id>", NULL, NULL, -1, NULL, "Parent window id" },
 	{ "bitmap-cache", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "bitmap cache" },
+	{ "bitmap-cache-persist", COMMAND_LINE_VALUE_OPTIONAL, "<file>", NULL, NULL, -1, NULL, "persistent bitmap cache" },
 	{ "offscreen-cache", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "offscreen bitmap cache" },
 	{ "glyph-cache", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "glyph cache" },
 	{ "codec-cache", COMMAND_LINE_VALUE_REQUIRED, "<rfx|nsc|jpeg>", NULL, NULL, -1, NULL, "bitmap codec cache" },
@@ -161,6 +165,7 @@ COMMAND_LINE_ARGUMENT_A args[] =
 	{ "version", COMMAND_LINE_VALUE_FLAG | COMMAND_LINE_PRINT_VERSION, NULL, NULL, NULL, -1, NULL, "print version" },
 	{ "help", COMMAND_LINE_VALUE_FLAG | COMMAND_LINE_PRINT_HELP, NULL, NULL, NULL, -1, "?", "print help" },
 	{ "play-rfx", COMMAND_LINE_VALUE_REQUIRED, "<pcap file>", NULL, NULL, -1, NULL, "Replay rfx pcap file" },
+	{ "dump-updates", COMMAND_LINE_VALUE_REQUIRED, "<pcap file>", NULL, NULL, -1, NULL, "Record decrypted update PDUs for replay" },
 	{ "auth-only", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL, "Authenticate only." },
 	{ "auto-reconnect", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL, "Automatic reconnection" },
 	{ "reconnect-cookie", COMMAND_LINE_VALUE_REQUIRED, "<base64 cookie>", NULL, NULL, -1, NULL, "Pass base64 reconnect cookie to the connection" },
@@ -1552,6 +1557,10 @@ int freerdp_client_settings_parse_command_line_arguments(rdpSettings* settings,
 		{
 			settings->CompressionLevel = atoi(arg->Value);
 		}
+		CommandLineSwitchCase(arg, "compression-effort")
+		{
+			settings->CompressionEffort = atoi(arg->Value);
+		}
 		CommandLineSwitchCase(arg, "drives")
 		{
 			settings->RedirectDrives = arg->Value ? TRUE : FALSE;
@@ -1674,6 +1683,17 @@ int freerdp_client_settings_parse_command_line_arguments(rdpSettings* settings,
 			settings->GfxThinClient = settings->GfxProgressive ? FALSE : TRUE;
 			settings->SupportGraphicsPipeline = TRUE;
 		}
+		CommandLineSwitchCase(arg, "gfx-cache-persist")
+		{
+			free(settings->GfxCachePersistFile);
+
+			if (arg->Flags & COMMAND_LINE_VALUE_PRESENT)
+				settings->GfxCachePersistFile = _strdup(arg->Value);
+			else
+				settings->GfxCachePersistFile = GetCombinedPath(settings->ConfigPath, "gfxcache.bin");
+
+			settings->SupportGraphicsPipeline = TRUE;
+		}
 		CommandLineSwitchCase(arg, "gfx-h264")
 		{
 			settings->GfxH264 = arg->Value ? TRUE : FALSE;
@@ -1852,6 +1872,22 @@ int freerdp_client_settings_parse_command_line_arguments(rdpSettings* settings,
 		{
 			settings->BitmapCacheEnabled = arg->Value ? TRUE : FALSE;
 		}
+		CommandLineSwitchCase(arg, "bitmap-cache-persist")
+		{
+			UINT32 i;
+
+			settings->BitmapCachePersistEnabled = TRUE;
+
+			free(settings->BitmapCachePersistFile);
+
+			if (arg->Flags & COMMAND_LINE_VALUE_PRESENT)
+				settings->BitmapCachePersistFile = _strdup(arg->Value);
+			else
+				settings->BitmapCachePersistFile = GetCombinedPath(settings->ConfigPath, "bmcache.bin");
+
+			for (i = 0; i < settings->BitmapCacheV2NumCells; i++)
+				settings->BitmapCacheV2CellInfo[i].persistent = TRUE;
+		}
 		CommandLineSwitchCase(arg, "offscreen-cache")
 		{
 			settings->OffscreenSupportLevel = arg->Value ? TRUE : FALSE;
@@ -1914,6 +1950,11 @@ int freerdp_client_settings_parse_command_line_arguments(rdpSettings* settings,
 			settings->PlayRemoteFxFile = _strdup(arg->Value);
 			settings->PlayRemoteFx = TRUE;
 		}
+		CommandLineSwitchCase(arg, "dump-updates")
+		{
+			settings->DumpUpdatesFile = _strdup(arg->Value);
+			settings->DumpUpdates = TRUE;
+		}
 		CommandLineSwitchCase(arg, "auth-only")
 		{
 			settings->AuthenticationOnly = arg->Value ? TRUE : FALSE;
@@ -20,12 +20,19 @@ else()
 	option(WITH_SSE2 "Enable SSE2 optimization." OFF)
 endif()
 
+if(WITH_SSE2 AND (NOT DEFINED WITH_AVX2))
+	option(WITH_AVX2 "Enable AVX2 optimization (selected at runtime)." ON)
+else()
+	option(WITH_AVX2 "Enable AVX2 optimization (selected at runtime)." OFF)
+endif()
+
 if(TARGET_ARCH MATCHES "ARM")
 	if (NOT DEFINED WITH_NEON)
 		option(WITH_NEON "Enable NEON optimization." ON)
 	else()
 		option(WITH_NEON "Enable NEON optimization." OFF)
 	endif()
+	option(WITH_NEON_PROGRESSIVE "Enable the NEON inverse DWT of the progressive codec (untested)." OFF)
 	if (NOT DEFINED ARM_FP_ABI)
 		set(ARM_FP_ABI "softfp" CACHE STRING "Floating point ABI to use on arm")
 	else()
@@ -39,6 +46,7 @@ else()
 endif()
 
 option(WITH_JPEG "Use JPEG decoding." OFF)
+option(WITH_OPUS "Use the Opus audio codec (not yet tested against libopus)." OFF)
 
 if(CMAKE_C_COMPILER_ID MATCHES "Clang" OR CMAKE_CXX_COMPILER_ID MATCHES "Clang")
 	set(CMAKE_COMPILER_IS_CLANG 1)
@@ -27,6 +27,8 @@
 
 #include <winpr/stream.h>
 
+#include <freerdp/cache/persistent.h>
+
 typedef struct _BITMAP_V2_CELL BITMAP_V2_CELL;
 typedef struct rdp_bitmap_cache rdpBitmapCache;
 
@@ -58,6 +60,10 @@ struct rdp_bitmap_cache
 	rdpUpdate* update;
 	rdpContext* context;
 	rdpSettings* settings;
+
+	rdpPersistentCache* persistent;
+	UINT64* persistentKeys[PERSIST_CACHE_MAX_CELLS];
+	UINT32 persistentKeyCount[PERSIST_CACHE_MAX_CELLS];
 };
 
 #ifdef __cplusplus
@@ -68,6 +74,7 @@ FREERDP_API rdpBitmap* bitmap_cache_get(rdpBitmapCache* bitmap_cache, UINT32 id,
 FREERDP_API void bitmap_cache_put(rdpBitmapCache* bitmap_cache, UINT32 id, UINT32 index, rdpBitmap* bitmap);
 
 FREERDP_API void bitmap_cache_register_callbacks(rdpUpdate* update);
+FREERDP_API void bitmap_cache_reset_persistent_keys(rdpBitmapCache* bitmap_cache);
 
 FREERDP_API rdpBitmapCache* bitmap_cache_new(rdpSettings* settings);
 FREERDP_API void bitmap_cache_free(rdpBitmapCache* bitmap_cache);
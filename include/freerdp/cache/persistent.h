@@ -0,0 +1,74 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Persistent Bitmap Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_PERSISTENT_CACHE_H
+#define FREERDP_PERSISTENT_CACHE_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/settings.h>
+
+typedef struct rdp_persistent_cache rdpPersistentCache;
+
+#define PERSIST_CACHE_MAX_CELLS			5
+
+/* [MS-RDPBCGR] 2.2.1.17.1: at most 169 keys per Persistent Key List PDU */
+#define PERSIST_CACHE_MAX_PDU_KEYS		169
+
+/* largest bitmap stream kept on disk (64x64 tile at 32bpp) */
+#define PERSIST_CACHE_MAX_DATA_SIZE		(64 * 64 * 4)
+
+#define PERSIST_CACHE_FLAG_COMPRESSED		0x01
+
+struct _PERSISTENT_CACHE_ENTRY
+{
+	UINT64 key64;
+	UINT16 width;
+	UINT16 height;
+	BYTE cacheId;
+	BYTE bpp;
+	BYTE flags;
+	BYTE codecId;
+	UINT32 size;
+	BYTE* data;
+};
+typedef struct _PERSISTENT_CACHE_ENTRY PERSISTENT_CACHE_ENTRY;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FREERDP_API int persistent_cache_open(rdpPersistentCache* persistent, const char* filename, BOOL readOnly);
+FREERDP_API void persistent_cache_close(rdpPersistentCache* persistent);
+
+FREERDP_API UINT32 persistent_cache_get_count(rdpPersistentCache* persistent);
+FREERDP_API BOOL persistent_cache_get(rdpPersistentCache* persistent, UINT64 key64, PERSISTENT_CACHE_ENTRY* entry);
+FREERDP_API BOOL persistent_cache_put(rdpPersistentCache* persistent, PERSISTENT_CACHE_ENTRY* entry);
+FREERDP_API BOOL persistent_cache_pin(rdpPersistentCache* persistent, UINT64 key64, BOOL pinned);
+
+FREERDP_API UINT32 persistent_cache_get_key_list(rdpPersistentCache* persistent, BYTE cacheId, UINT64* keys, UINT32 maxKeys);
+
+FREERDP_API UINT32 persistent_cache_max_entries(rdpSettings* settings);
+
+FREERDP_API rdpPersistentCache* persistent_cache_new(UINT32 maxEntries);
+FREERDP_API void persistent_cache_free(rdpPersistentCache* persistent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_PERSISTENT_CACHE_H */
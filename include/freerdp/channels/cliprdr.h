@@ -33,6 +33,8 @@
 #define CB_FORMAT_PNG			0xD011
 #define CB_FORMAT_JPEG			0xD012
 #define CB_FORMAT_GIF			0xD013
+#define CB_FORMAT_TEXTURILIST		0xD014
+#define CB_FORMAT_GNOMECOPIEDFILES	0xD015
 
 /* CLIPRDR_HEADER.msgType */
 #define CB_MONITOR_READY		0x0001
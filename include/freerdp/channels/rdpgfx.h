@@ -85,6 +85,8 @@ typedef BYTE RDPGFX_PIXELFORMAT;
 
 #define RDPGFX_HEADER_SIZE			8
 
+#define RDPGFX_CACHE_ENTRY_MAX_COUNT		5462
+
 struct _RDPGFX_HEADER
 {
 	UINT16 cmdId;
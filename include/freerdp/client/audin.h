@@ -34,6 +34,7 @@ struct audin_format
 	UINT16 wFormatTag;
 	UINT16 nChannels;
 	UINT32 nSamplesPerSec;
+	UINT32 nAvgBytesPerSec;
 	UINT16 nBlockAlign;
 	UINT16 wBitsPerSample;
 	UINT16 cbSize;
@@ -21,6 +21,7 @@
 #define FREERDP_CHANNEL_CLIENT_RDPGFX_H
 
 #include <freerdp/channels/rdpgfx.h>
+#include <freerdp/cache/persistent.h>
 
 /**
  * Client Interface
@@ -42,11 +43,14 @@ typedef int (*pcRdpgfxCacheToSurface)(RdpgfxClientContext* context, RDPGFX_CACHE
 typedef int (*pcRdpgfxCacheImportOffer)(RdpgfxClientContext* context, RDPGFX_CACHE_IMPORT_OFFER_PDU* cacheImportOffer);
 typedef int (*pcRdpgfxCacheImportReply)(RdpgfxClientContext* context, RDPGFX_CACHE_IMPORT_REPLY_PDU* cacheImportReply);
 typedef int (*pcRdpgfxEvictCacheEntry)(RdpgfxClientContext* context, RDPGFX_EVICT_CACHE_ENTRY_PDU* evictCacheEntry);
+typedef int (*pcRdpgfxImportCacheEntry)(RdpgfxClientContext* context, UINT16 cacheSlot, PERSISTENT_CACHE_ENTRY* cacheEntry);
+typedef int (*pcRdpgfxExportCacheEntry)(RdpgfxClientContext* context, UINT16 cacheSlot, PERSISTENT_CACHE_ENTRY* cacheEntry);
 typedef int (*pcRdpgfxMapSurfaceToOutput)(RdpgfxClientContext* context, RDPGFX_MAP_SURFACE_TO_OUTPUT_PDU* surfaceToOutput);
 typedef int (*pcRdpgfxMapSurfaceToWindow)(RdpgfxClientContext* context, RDPGFX_MAP_SURFACE_TO_WINDOW_PDU* surfaceToWindow);
 
 typedef int (*pcRdpgfxSetSurfaceData)(RdpgfxClientContext* context, UINT16 surfaceId, void* pData);
 typedef void* (*pcRdpgfxGetSurfaceData)(RdpgfxClientContext* context, UINT16 surfaceId);
+typedef int (*pcRdpgfxGetSurfaceIds)(RdpgfxClientContext* context, UINT16** ppSurfaceIds, UINT16* count);
 typedef int (*pcRdpgfxSetCacheSlotData)(RdpgfxClientContext* context, UINT16 cacheSlot, void* pData);
 typedef void* (*pcRdpgfxGetCacheSlotData)(RdpgfxClientContext* context, UINT16 cacheSlot);
 
@@ -55,6 +59,8 @@ struct _rdpgfx_client_context
 	void* handle;
 	void* custom;
 
+	UINT16 MaxCacheSlots;
+
 	pcRdpgfxResetGraphics ResetGraphics;
 	pcRdpgfxStartFrame StartFrame;
 	pcRdpgfxEndFrame EndFrame;
@@ -69,11 +75,14 @@ struct _rdpgfx_client_context
 	pcRdpgfxCacheImportOffer CacheImportOffer;
 	pcRdpgfxCacheImportReply CacheImportReply;
 	pcRdpgfxEvictCacheEntry EvictCacheEntry;
+	pcRdpgfxImportCacheEntry ImportCacheEntry;
+	pcRdpgfxExportCacheEntry ExportCacheEntry;
 	pcRdpgfxMapSurfaceToOutput MapSurfaceToOutput;
 	pcRdpgfxMapSurfaceToWindow MapSurfaceToWindow;
 
 	pcRdpgfxSetSurfaceData SetSurfaceData;
 	pcRdpgfxGetSurfaceData GetSurfaceData;
+	pcRdpgfxGetSurfaceIds GetSurfaceIds;
 	pcRdpgfxSetCacheSlotData SetCacheSlotData;
 	pcRdpgfxGetCacheSlotData GetCacheSlotData;
 };
@@ -182,6 +182,13 @@ typedef struct AUDIO_FORMAT AUDIO_FORMAT;
 #define WAVE_FORMAT_SOUNDSPACE_MUSICOMPRESS	0x1500
 #define WAVE_FORMAT_DVM				0x2000
 
+/**
+ * Opus at a constant bit rate: nAvgBytesPerSec is the bit rate in bytes,
+ * every packet is nBlockAlign bytes long and holds one Opus frame, the
+ * frame duration follows from the two.
+ */
+#define WAVE_FORMAT_OPUS			0x704F
+
 /**
  * Audio Format Functions
  */
@@ -36,5 +36,11 @@
 #define L1_COMPRESSED			0x01
 #define L1_INNER_COMPRESSION		0x10
 
+/* Compression Effort (NCRUSH, XCRUSH) */
+
+#define BULK_COMPRESSION_EFFORT_FAST	0 /* most recent match candidate only */
+#define BULK_COMPRESSION_EFFORT_DEFAULT	1 /* historical match search */
+#define BULK_COMPRESSION_EFFORT_HIGH	2 /* deeper match candidate chains */
+
 #endif /* FREERDP_CODEC_BULK_H */
 
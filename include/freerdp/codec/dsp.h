@@ -20,7 +20,10 @@
 #ifndef FREERDP_CODEC_DSP_H
 #define FREERDP_CODEC_DSP_H
 
+#include <winpr/stream.h>
+
 #include <freerdp/api.h>
+#include <freerdp/codec/audio.h>
 
 union _ADPCM
 {
@@ -39,6 +42,19 @@ union _ADPCM
 };
 typedef union _ADPCM ADPCM;
 
+/**
+ * Resampler quality, taking effect with the next resample call:
+ * linear interpolation, or a Kaiser windowed-sinc filter of 32 (medium)
+ * or 96 (high) taps. The filter state carries over between calls, a
+ * context resamples a single stream.
+ */
+
+#define FREERDP_DSP_RESAMPLE_QUALITY_LOW	0
+#define FREERDP_DSP_RESAMPLE_QUALITY_MEDIUM	1
+#define FREERDP_DSP_RESAMPLE_QUALITY_HIGH	2
+
+typedef struct _FREERDP_DSP_RESAMPLER FREERDP_DSP_RESAMPLER;
+typedef struct _FREERDP_DSP_CODEC_CONTEXT FREERDP_DSP_CODEC_CONTEXT;
 typedef struct _FREERDP_DSP_CONTEXT FREERDP_DSP_CONTEXT;
 
 struct _FREERDP_DSP_CONTEXT
@@ -48,12 +64,17 @@ struct _FREERDP_DSP_CONTEXT
 	UINT32 resampled_frames;
 	UINT32 resampled_maxlength;
 
+	UINT32 resample_quality;
+	FREERDP_DSP_RESAMPLER* resampler;
+
 	BYTE* adpcm_buffer;
 	UINT32 adpcm_size;
 	UINT32 adpcm_maxlength;
 
 	ADPCM adpcm;
 
+	FREERDP_DSP_CODEC_CONTEXT* codec;
+
 	BOOL (*resample)(FREERDP_DSP_CONTEXT* context,
 		const BYTE* src, int bytes_per_sample,
 		UINT32 schan, UINT32 srate, int sframes,
@@ -78,6 +99,28 @@ FREERDP_API FREERDP_DSP_CONTEXT* freerdp_dsp_context_new(void);
 FREERDP_API void freerdp_dsp_context_free(FREERDP_DSP_CONTEXT* context);
 #define freerdp_dsp_context_reset_adpcm(_c) memset(&_c->adpcm, 0, sizeof(ADPCM))
 
+/**
+ * Compressed formats: encoded from and decoded to interleaved 16 bit PCM
+ * at the rate and channel count of the format. A context codes a single
+ * stream, a reset starts a new one. The codec is set up for the format
+ * on the first call after a reset or a format change.
+ * The output is appended to the stream. Codecs that only code whole
+ * frames keep the remainder of the input for the next call, the output
+ * of a call may then be empty. The block frames of a format are the
+ * frames coded at once, a multiple of which gives the lowest latency.
+ */
+
+FREERDP_API BOOL freerdp_dsp_supports_format(const AUDIO_FORMAT* format, BOOL encode);
+FREERDP_API UINT32 freerdp_dsp_get_block_frames(const AUDIO_FORMAT* format);
+FREERDP_API void freerdp_dsp_get_pcm_format(const AUDIO_FORMAT* format, AUDIO_FORMAT* pcm);
+
+FREERDP_API void freerdp_dsp_context_reset(FREERDP_DSP_CONTEXT* context);
+
+FREERDP_API BOOL freerdp_dsp_encode(FREERDP_DSP_CONTEXT* context, const AUDIO_FORMAT* format,
+		const BYTE* data, UINT32 length, wStream* out);
+FREERDP_API BOOL freerdp_dsp_decode(FREERDP_DSP_CONTEXT* context, const AUDIO_FORMAT* format,
+		const BYTE* data, UINT32 length, wStream* out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -41,6 +41,7 @@ struct _NCRUSH_CONTEXT
 	UINT16 MatchTable[65536];
 	BYTE HuffTableCopyOffset[1024];
 	BYTE HuffTableLOM[4096];
+	UINT32 CompressionEffort;
 };
 typedef struct _NCRUSH_CONTEXT NCRUSH_CONTEXT;
 
@@ -51,6 +52,8 @@ extern "C" {
 FREERDP_API int ncrush_compress(NCRUSH_CONTEXT* ncrush, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags);
 FREERDP_API int ncrush_decompress(NCRUSH_CONTEXT* ncrush, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32 flags);
 
+FREERDP_API void ncrush_set_compression_effort(NCRUSH_CONTEXT* ncrush, DWORD CompressionEffort);
+
 FREERDP_API void ncrush_context_reset(NCRUSH_CONTEXT* ncrush, BOOL flush);
 
 FREERDP_API NCRUSH_CONTEXT* ncrush_context_new(BOOL Compressor);
@@ -26,6 +26,7 @@ typedef struct _PROGRESSIVE_CONTEXT PROGRESSIVE_CONTEXT;
 #include <freerdp/types.h>
 
 #include <winpr/wlog.h>
+#include <winpr/pool.h>
 #include <winpr/collections.h>
 
 #include <freerdp/codec/rfx.h>
@@ -279,6 +280,8 @@ struct _PROGRESSIVE_SURFACE_CONTEXT
 };
 typedef struct _PROGRESSIVE_SURFACE_CONTEXT PROGRESSIVE_SURFACE_CONTEXT;
 
+typedef struct _PROGRESSIVE_TILE_WORKER PROGRESSIVE_TILE_WORKER;
+
 struct _PROGRESSIVE_CONTEXT
 {
 	BOOL Compressor;
@@ -286,7 +289,18 @@ struct _PROGRESSIVE_CONTEXT
 	BOOL invert;
 
 	wLog* log;
-	wBufferPool* bufferPool;
+
+	BOOL UseThreads;
+	UINT32 numWorkers;
+	PROGRESSIVE_TILE_WORKER* workers;
+	PTP_POOL ThreadPool;
+	TP_CALLBACK_ENVIRON ThreadPoolEnv;
+
+	/* routines */
+	void (*idwt_x)(INT16* pLowBand, int nLowStep, INT16* pHighBand, int nHighStep,
+			INT16* pDstBand, int nDstStep, int nLowCount, int nHighCount, int nDstCount);
+	void (*idwt_y)(INT16* pLowBand, int nLowStep, INT16* pHighBand, int nHighStep,
+			INT16* pDstBand, int nDstStep, int nLowCount, int nHighCount, int nDstCount);
 
 	UINT32 cRects;
 	RFX_RECT* rects;
@@ -315,6 +329,14 @@ FREERDP_API int progressive_compress(PROGRESSIVE_CONTEXT* progressive, BYTE* pSr
 FREERDP_API int progressive_decompress(PROGRESSIVE_CONTEXT* progressive, BYTE* pSrcData, UINT32 SrcSize,
 		BYTE** ppDstData, DWORD DstFormat, int nDstStep, int nXDst, int nYDst, int nWidth, int nHeight, UINT16 surfaceId);
 
+FREERDP_API void progressive_rfx_idwt_x(INT16* pLowBand, int nLowStep, INT16* pHighBand, int nHighStep,
+		INT16* pDstBand, int nDstStep, int nLowCount, int nHighCount, int nDstCount);
+FREERDP_API void progressive_rfx_idwt_y(INT16* pLowBand, int nLowStep, INT16* pHighBand, int nHighStep,
+		INT16* pDstBand, int nDstStep, int nLowCount, int nHighCount, int nDstCount);
+FREERDP_API int progressive_rfx_upgrade_component(PROGRESSIVE_CONTEXT* progressive, RFX_COMPONENT_CODEC_QUANT* shift,
+		RFX_COMPONENT_CODEC_QUANT* bitPos, RFX_COMPONENT_CODEC_QUANT* numBits, INT16* buffer, INT16* temp,
+		INT16* current, INT16* sign, const BYTE* srlData, int srlLen, const BYTE* rawData, int rawLen);
+
 FREERDP_API int progressive_create_surface_context(PROGRESSIVE_CONTEXT* progressive, UINT16 surfaceId, UINT32 width, UINT32 height);
 FREERDP_API int progressive_delete_surface_context(PROGRESSIVE_CONTEXT* progressive, UINT16 surfaceId);
 
@@ -156,6 +156,12 @@ struct _RFX_CONTEXT
 FREERDP_API void rfx_context_set_pixel_format(RFX_CONTEXT* context, RDP_PIXEL_FORMAT pixel_format);
 
 FREERDP_API int rfx_rlgr_decode(const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData, UINT32 DstSize, int mode);
+FREERDP_API int rfx_rlgr_encode(RLGR_MODE mode, const INT16* data, int data_size, BYTE* buffer, int buffer_size);
+
+FREERDP_API void rfx_quantization_decode(INT16* buffer, const UINT32* quantization_values);
+FREERDP_API void rfx_quantization_encode(INT16* buffer, const UINT32* quantization_values);
+FREERDP_API void rfx_dwt_2d_decode(INT16* buffer, INT16* dwt_buffer);
+FREERDP_API void rfx_dwt_2d_encode(INT16* buffer, INT16* dwt_buffer);
 
 FREERDP_API RFX_MESSAGE* rfx_process_message(RFX_CONTEXT* context, BYTE* data, UINT32 length);
 FREERDP_API UINT16 rfx_message_get_tile_count(RFX_MESSAGE* message);
@@ -174,6 +180,14 @@ FREERDP_API RFX_MESSAGE* rfx_encode_messages(RFX_CONTEXT* context, const RFX_REC
 		BYTE* data, int width, int height, int scanline, int* numMessages, int maxDataSize);
 FREERDP_API void rfx_write_message(RFX_CONTEXT* context, wStream* s, RFX_MESSAGE* message);
 
+FREERDP_API RFX_MESSAGE* rfx_encode_frame(RFX_CONTEXT* context, const RFX_RECT* rects, int numRects,
+		BYTE* data, int width, int height, int scanline);
+FREERDP_API int rfx_write_message_fragment(RFX_CONTEXT* context, wStream* s, RFX_MESSAGE* message,
+		int firstTile, int maxDataSize);
+
+FREERDP_API void rfx_context_set_change_detection(RFX_CONTEXT* context, BOOL enabled);
+FREERDP_API void rfx_context_invalidate_tiles(RFX_CONTEXT* context, const RECTANGLE_16* rect);
+
 FREERDP_API int rfx_context_reset(RFX_CONTEXT* context);
 
 FREERDP_API RFX_CONTEXT* rfx_context_new(BOOL encoder);
@@ -79,6 +79,7 @@ struct _XCRUSH_CONTEXT
 	BYTE HistoryBuffer[2000000];
 	BYTE BlockBuffer[16384];
 	UINT32 CompressionFlags;
+	UINT32 CompressionEffort;
 
 	UINT32 SignatureIndex;
 	UINT32 SignatureCount;
@@ -103,6 +104,8 @@ extern "C" {
 FREERDP_API int xcrush_compress(XCRUSH_CONTEXT* xcrush, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags);
 FREERDP_API int xcrush_decompress(XCRUSH_CONTEXT* xcrush, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32 flags);
 
+FREERDP_API void xcrush_set_compression_effort(XCRUSH_CONTEXT* xcrush, DWORD CompressionEffort);
+
 FREERDP_API void xcrush_context_reset(XCRUSH_CONTEXT* xcrush, BOOL flush);
 
 FREERDP_API XCRUSH_CONTEXT* xcrush_context_new(BOOL Compressor);
@@ -81,6 +81,7 @@ struct rdp_tls
 	int alertLevel;
 	int alertDescription;
 	BOOL isGatewayTransport;
+	rdpTlsServerContext* serverContext;
 };
 
 #ifdef __cplusplus
@@ -105,6 +106,10 @@ FREERDP_API BOOL tls_print_error(char* func, SSL* connection, int value);
 FREERDP_API rdpTls* tls_new(rdpSettings* settings);
 FREERDP_API void tls_free(rdpTls* tls);
 
+FREERDP_API rdpTlsServerContext* tls_server_context_new(void);
+FREERDP_API rdpTlsServerContext* tls_server_context_ref(rdpTlsServerContext* context);
+FREERDP_API void tls_server_context_free(rdpTlsServerContext* context);
+
 #ifdef __cplusplus
  }
 #endif
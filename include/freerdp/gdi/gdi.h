@@ -271,6 +271,8 @@ struct gdi_glyph
 };
 typedef struct gdi_glyph gdiGlyph;
 
+typedef struct gdi_gfx_engine gdiGfxEngine;
+
 struct rdp_gdi
 {
 	rdpContext* context;
@@ -297,11 +299,8 @@ struct rdp_gdi
 	gdiBitmap* tile;
 	gdiBitmap* image;
 
-	BOOL inGfxFrame;
-	BOOL graphicsReset;
-	UINT16 outputSurfaceId;
-	REGION16 invalidRegion;
 	RdpgfxClientContext* gfx;
+	gdiGfxEngine* gfxEngine;
 };
 
 #ifdef __cplusplus
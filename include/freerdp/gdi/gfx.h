@@ -32,6 +32,7 @@ struct gdi_gfx_surface
 	BYTE* data;
 	int scanline;
 	UINT32 format;
+	void* custom;
 };
 typedef struct gdi_gfx_surface gdiGfxSurface;
 
@@ -47,10 +48,50 @@ struct gdi_gfx_cache_entry
 };
 typedef struct gdi_gfx_cache_entry gdiGfxCacheEntry;
 
+/**
+ * Graphics pipeline surface engine
+ *
+ * The engine implements the RDPGFX client callbacks once for every front-end:
+ * it owns surfaces and cache entries as 16-byte aligned buffers in the engine
+ * pixel format, decodes straight into them and accumulates the invalid region
+ * of the current frame. Front-ends only present dirty rectangles, and may
+ * attach their own data (e.g. an XImage wrapping the surface buffer) to each
+ * surface through the SurfaceCreated / SurfaceDeleted hooks.
+ */
+
+typedef int (*pcGdiGfxResetGraphics)(gdiGfxEngine* engine, UINT32 width, UINT32 height);
+typedef int (*pcGdiGfxSurfaceCreated)(gdiGfxEngine* engine, gdiGfxSurface* surface);
+typedef void (*pcGdiGfxSurfaceDeleted)(gdiGfxEngine* engine, gdiGfxSurface* surface);
+typedef int (*pcGdiGfxPresent)(gdiGfxEngine* engine, gdiGfxSurface* surface, const RECTANGLE_16* rects, UINT32 numRects);
+
+struct gdi_gfx_engine
+{
+	void* custom;
+	rdpCodecs* codecs;
+	RdpgfxClientContext* gfx;
+
+	UINT32 format;
+	BOOL inGfxFrame;
+	BOOL graphicsReset;
+	UINT16 outputSurfaceId;
+	REGION16 invalidRegion;
+
+	pcGdiGfxResetGraphics ResetGraphics;
+	pcGdiGfxSurfaceCreated SurfaceCreated;
+	pcGdiGfxSurfaceDeleted SurfaceDeleted;
+	pcGdiGfxPresent Present;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+FREERDP_API gdiGfxEngine* gdi_gfx_engine_new(RdpgfxClientContext* gfx, rdpCodecs* codecs, UINT32 format);
+FREERDP_API void gdi_gfx_engine_free(gdiGfxEngine* engine);
+
+FREERDP_API int gdi_gfx_engine_update(gdiGfxEngine* engine);
+FREERDP_API int gdi_gfx_engine_expose(gdiGfxEngine* engine, int x, int y, int width, int height);
+
 FREERDP_API void gdi_graphics_pipeline_init(rdpGdi* gdi, RdpgfxClientContext* gfx);
 FREERDP_API void gdi_graphics_pipeline_uninit(rdpGdi* gdi, RdpgfxClientContext* gfx);
 
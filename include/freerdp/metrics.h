@@ -22,6 +22,9 @@
 
 #include <freerdp/api.h>
 
+/* indexed by fast-path update code */
+#define METRICS_UPDATE_TYPE_COUNT	16
+
 struct rdp_metrics
 {
 	rdpContext* context;
@@ -29,6 +32,12 @@ struct rdp_metrics
 	UINT64 TotalCompressedBytes;
 	UINT64 TotalUncompressedBytes;
 	double TotalCompressionRatio;
+
+	UINT32 UpdateSampleCount[METRICS_UPDATE_TYPE_COUNT];
+	UINT64 UpdateCompressedBytes[METRICS_UPDATE_TYPE_COUNT];
+	UINT64 UpdateUncompressedBytes[METRICS_UPDATE_TYPE_COUNT];
+	UINT64 UpdateBypassedBytes[METRICS_UPDATE_TYPE_COUNT];
+	double UpdateCompressionRatio[METRICS_UPDATE_TYPE_COUNT]; /* moving average */
 };
 
 #ifdef __cplusplus
@@ -36,6 +45,8 @@ struct rdp_metrics
 #endif
 
 FREERDP_API double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes, UINT32 CompressedBytes);
+FREERDP_API double metrics_write_update_bytes(rdpMetrics* metrics, UINT32 UpdateType, UINT32 UncompressedBytes, UINT32 CompressedBytes);
+FREERDP_API void metrics_write_bypassed_bytes(rdpMetrics* metrics, UINT32 UpdateType, UINT32 Bytes);
 
 FREERDP_API rdpMetrics* metrics_new(rdpContext* context);
 FREERDP_API void metrics_free(rdpMetrics* metrics);
@@ -106,6 +106,8 @@ struct rdp_freerdp_peer
 
 	psPeerIsWriteBlocked IsWriteBlocked;
 	psPeerDrainOutputBuffer DrainOutputBuffer;
+
+	rdpTlsServerContext* TlsServerContext;
 };
 
 #ifdef __cplusplus
@@ -0,0 +1,73 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RDP Server Peer Reactor
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_REACTOR_H
+#define FREERDP_REACTOR_H
+
+typedef struct rdp_peer_reactor rdpPeerReactor;
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/peer.h>
+
+#include <winpr/pool.h>
+
+/**
+ * The peer reactor multiplexes many peers over a small set of I/O worker
+ * threads instead of running one thread per peer.
+ *
+ * All the event sources of a peer are served by the same worker, so the
+ * callbacks of one peer never run concurrently. A callback returning FALSE
+ * removes the peer from the reactor and reports it through PeerClosed.
+ *
+ * Callbacks must not block: CPU-heavy work such as encoding is submitted to
+ * the reactor thread pool with freerdp_peer_reactor_submit(). The events of
+ * the peer are held back until the work handler returns, which keeps it
+ * serialized with the other callbacks of the peer. A work handler is called
+ * with a NULL client when the peer was removed before it could run.
+ */
+
+typedef BOOL (*psPeerReactorEventHandler)(freerdp_peer* client, HANDLE event, void* param);
+typedef BOOL (*psPeerReactorWorkHandler)(freerdp_peer* client, void* param);
+typedef void (*psPeerReactorPeerClosed)(rdpPeerReactor* reactor, freerdp_peer* client, void* param);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FREERDP_API BOOL freerdp_peer_reactor_add(rdpPeerReactor* reactor, freerdp_peer* client);
+FREERDP_API BOOL freerdp_peer_reactor_add_event(rdpPeerReactor* reactor, freerdp_peer* client,
+		HANDLE event, psPeerReactorEventHandler handler, void* param);
+FREERDP_API void freerdp_peer_reactor_remove(rdpPeerReactor* reactor, freerdp_peer* client);
+
+FREERDP_API BOOL freerdp_peer_reactor_submit(rdpPeerReactor* reactor, freerdp_peer* client,
+		psPeerReactorWorkHandler handler, void* param);
+FREERDP_API UINT32 freerdp_peer_reactor_submit_all(rdpPeerReactor* reactor,
+		psPeerReactorWorkHandler handler, void* param);
+FREERDP_API void freerdp_peer_reactor_wait_for_work(rdpPeerReactor* reactor);
+
+FREERDP_API UINT32 freerdp_peer_reactor_get_peer_count(rdpPeerReactor* reactor);
+FREERDP_API PTP_CALLBACK_ENVIRON freerdp_peer_reactor_get_callback_environment(rdpPeerReactor* reactor);
+
+FREERDP_API rdpPeerReactor* freerdp_peer_reactor_new(UINT32 numWorkers, psPeerReactorPeerClosed PeerClosed, void* param);
+FREERDP_API void freerdp_peer_reactor_free(rdpPeerReactor* reactor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_REACTOR_H */
@@ -0,0 +1,84 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Update Recording and Replay
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_REPLAY_H
+#define FREERDP_REPLAY_H
+
+typedef struct rdp_replay_stats rdpReplayStats;
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/freerdp.h>
+
+/**
+ * With the DumpUpdates setting a client records every update it receives,
+ * after decryption, bulk decompression and fast-path reassembly, to a pcap
+ * file. Each record starts with a record type and an update code:
+ *
+ * REPLAY_RECORD_FASTPATH_UPDATE: fast-path update code, update data
+ * REPLAY_RECORD_SLOWPATH_UPDATE: 0, slow-path update data PDU payload
+ * REPLAY_RECORD_SLOWPATH_POINTER: 0, slow-path pointer PDU payload
+ * REPLAY_RECORD_END_PAINT: 0, end of a fast-path PDU
+ *
+ * freerdp_replay_updates() feeds such a recording through the regular
+ * update parsers and callbacks of a context (usually a gdi-only client
+ * context without a connection), as fast as possible, and reports where
+ * the time went: per update type, and per stage of the decode pipeline.
+ * The parse stage is the fast-path, update and order parsing, the codec
+ * stage the bitmap update, surface bits and cache bitmap handlers (bitmap
+ * codecs and the copy into the surface), the gdi stage all other drawing,
+ * cache, pointer and paint handlers. Recordings only depend on the negotiated session state,
+ * the replaying context must use the same desktop size and color depth.
+ */
+
+#define REPLAY_RECORD_FASTPATH_UPDATE	0x01
+#define REPLAY_RECORD_SLOWPATH_UPDATE	0x02
+#define REPLAY_RECORD_SLOWPATH_POINTER	0x03
+#define REPLAY_RECORD_END_PAINT		0x04
+
+/* indexed by fast-path update code, slow-path updates share the codes */
+#define REPLAY_UPDATE_TYPE_COUNT	16
+
+struct rdp_replay_stats
+{
+	UINT32 RecordCount;
+	UINT64 RecordBytes;
+	UINT32 PaintCount;
+
+	UINT32 UpdateCount[REPLAY_UPDATE_TYPE_COUNT];
+	UINT64 UpdateBytes[REPLAY_UPDATE_TYPE_COUNT];
+	double UpdateTime[REPLAY_UPDATE_TYPE_COUNT]; /* seconds */
+	double EndPaintTime;
+	double TotalTime;
+
+	double ParseTime;
+	double CodecTime;
+	double GdiTime;
+	double FramesPerSecond;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FREERDP_API int freerdp_replay_updates(rdpContext* context, char* file, rdpReplayStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_REPLAY_H */
@@ -25,6 +25,7 @@
 
 #include <freerdp/settings.h>
 #include <freerdp/listener.h>
+#include <freerdp/reactor.h>
 
 #include <freerdp/channels/wtsvc.h>
 #include <freerdp/channels/channels.h>
@@ -93,6 +94,8 @@ struct rdp_shadow_client
 	HANDLE vcm;
 	EncomspServerContext* encomsp;
 	RemdeskServerContext* remdesk;
+
+	BOOL reactorEvents;
 };
 
 struct rdp_shadow_server
@@ -119,6 +122,10 @@ struct rdp_shadow_server
 	char* PrivateKeyFile;
 	CRITICAL_SECTION lock;
 	freerdp_listener* listener;
+
+	BOOL useReactor;
+	HANDLE frameThread;
+	rdpPeerReactor* reactor;
 };
 
 struct _RDP_SHADOW_ENTRY_POINTS
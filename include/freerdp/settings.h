@@ -575,6 +575,7 @@ typedef struct _RDPDR_PARALLEL RDPDR_PARALLEL;
 #define FreeRDP_ForceEncryptedCsPdu				719
 #define FreeRDP_HiDefRemoteApp					720
 #define FreeRDP_CompressionLevel				721
+#define FreeRDP_CompressionEffort				722
 #define FreeRDP_IPv6Enabled					768
 #define FreeRDP_ClientAddress					769
 #define FreeRDP_ClientDir					770
@@ -680,6 +681,8 @@ typedef struct _RDPDR_PARALLEL RDPDR_PARALLEL;
 #define FreeRDP_PlayRemoteFx					1857
 #define FreeRDP_DumpRemoteFxFile				1858
 #define FreeRDP_PlayRemoteFxFile				1859
+#define FreeRDP_DumpUpdates					1860
+#define FreeRDP_DumpUpdatesFile					1861
 #define FreeRDP_GatewayUsageMethod				1984
 #define FreeRDP_GatewayPort					1985
 #define FreeRDP_GatewayHostname					1986
@@ -727,6 +730,7 @@ typedef struct _RDPDR_PARALLEL RDPDR_PARALLEL;
 #define FreeRDP_BitmapCachePersistEnabled			2500
 #define FreeRDP_BitmapCacheV2NumCells				2501
 #define FreeRDP_BitmapCacheV2CellInfo				2502
+#define FreeRDP_BitmapCachePersistFile				2503
 #define FreeRDP_ColorPointerFlag				2560
 #define FreeRDP_PointerCacheSize				2561
 #define FreeRDP_KeyboardLayout					2624
@@ -775,6 +779,7 @@ typedef struct _RDPDR_PARALLEL RDPDR_PARALLEL;
 #define FreeRDP_GfxProgressive					3842
 #define FreeRDP_GfxProgressiveV2				3843
 #define FreeRDP_GfxH264						3844
+#define FreeRDP_GfxCachePersistFile				3845
 #define FreeRDP_BitmapCacheV3CodecId				3904
 #define FreeRDP_DrawNineGridEnabled				3968
 #define FreeRDP_DrawNineGridCacheSize				3969
@@ -935,7 +940,8 @@ struct rdp_settings
 	ALIGN64 BOOL ForceEncryptedCsPdu; /* 719 */
 	ALIGN64 BOOL HiDefRemoteApp; /* 720 */
 	ALIGN64 UINT32 CompressionLevel; /* 721 */
-	UINT64 padding0768[768 - 722]; /* 722 */
+	ALIGN64 UINT32 CompressionEffort; /* 722 */
+	UINT64 padding0768[768 - 723]; /* 723 */
 
 	/* Client Info (Extra) */
 	ALIGN64 BOOL IPv6Enabled; /* 768 */
@@ -1106,7 +1112,9 @@ struct rdp_settings
 	ALIGN64 BOOL PlayRemoteFx; /* 1857 */
 	ALIGN64 char* DumpRemoteFxFile; /* 1858 */
 	ALIGN64 char* PlayRemoteFxFile; /* 1859 */
-	UINT64 padding1920[1920 - 1860]; /* 1860 */
+	ALIGN64 BOOL DumpUpdates; /* 1860 */
+	ALIGN64 char* DumpUpdatesFile; /* 1861 */
+	UINT64 padding1920[1920 - 1862]; /* 1862 */
 	UINT64 padding1984[1984 - 1920]; /* 1920 */
 
 	/**
@@ -1189,7 +1197,8 @@ struct rdp_settings
 	ALIGN64 BOOL BitmapCachePersistEnabled; /* 2500 */
 	ALIGN64 UINT32 BitmapCacheV2NumCells; /* 2501 */
 	ALIGN64 BITMAP_CACHE_V2_CELL_INFO* BitmapCacheV2CellInfo; /* 2502 */
-	UINT64 padding2560[2560 - 2503]; /* 2503 */
+	ALIGN64 char* BitmapCachePersistFile; /* 2503 */
+	UINT64 padding2560[2560 - 2504]; /* 2504 */
 
 	/* Pointer Capabilities */
 	ALIGN64 BOOL ColorPointerFlag; /* 2560 */
@@ -1303,7 +1312,8 @@ struct rdp_settings
 	ALIGN64 BOOL GfxProgressive; /* 3842 */
 	ALIGN64 BOOL GfxProgressiveV2; /* 3843 */
 	ALIGN64 BOOL GfxH264; /* 3844 */
-	UINT64 padding3904[3904 - 3845]; /* 3845 */
+	ALIGN64 char* GfxCachePersistFile; /* 3845 */
+	UINT64 padding3904[3904 - 3846]; /* 3846 */
 
 	/**
 	 * Caches
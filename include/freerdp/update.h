@@ -196,6 +196,9 @@ struct rdp_update
 	BOOL dump_rfx;
 	BOOL play_rfx;
 	rdpPcap* pcap_rfx;
+	BOOL dump_updates;
+	rdpPcap* pcap_updates;
+	struct rdp_replay_hooks* replay;
 	BOOL initialState;
 
 	BITMAP_UPDATE bitmap_update;
@@ -0,0 +1,121 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Clipboard File Transfer Utils
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_UTILS_CLIPRDR_H
+#define FREERDP_UTILS_CLIPRDR_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/channels/cliprdr.h>
+
+/* FileGroupDescriptorW */
+#define CLIPRDR_FILEDESCRIPTOR_SIZE		592
+
+/* CLIPRDR_FILEDESCRIPTOR.flags */
+#define FD_ATTRIBUTES				0x00000004
+#define FD_WRITESTIME				0x00000020
+#define FD_FILESIZE				0x00000040
+#define FD_SHOWPROGRESSUI			0x00004000
+
+/**
+ * FileContents ranges are requested ahead of the data that arrived so that
+ * several are in flight at once. Their size adapts to the time a request
+ * takes to be answered: it doubles while that stays below half the target
+ * delay and halves once it goes above.
+ */
+
+#define CLIPRDR_FILE_TRANSFER_MAX_REQUESTS	8
+#define CLIPRDR_FILE_TRANSFER_MIN_CHUNK		0x4000
+#define CLIPRDR_FILE_TRANSFER_START_CHUNK	0x10000
+#define CLIPRDR_FILE_TRANSFER_MAX_CHUNK		0x100000
+#define CLIPRDR_FILE_TRANSFER_TARGET_DELAY	250
+
+#define CLIPRDR_FILE_TRANSFER_IDLE		0
+#define CLIPRDR_FILE_TRANSFER_SIZE		1
+#define CLIPRDR_FILE_TRANSFER_DATA		2
+#define CLIPRDR_FILE_TRANSFER_DONE		3
+#define CLIPRDR_FILE_TRANSFER_FAILED		4
+
+typedef struct _CLIPRDR_FILE_TRANSFER CLIPRDR_FILE_TRANSFER;
+
+typedef int (*pcCliprdrFileTransferRequest)(CLIPRDR_FILE_TRANSFER* transfer, CLIPRDR_FILE_CONTENTS_REQUEST* request);
+typedef int (*pcCliprdrFileTransferWrite)(CLIPRDR_FILE_TRANSFER* transfer, UINT64 offset, const BYTE* data, UINT32 length);
+
+struct _CLIPRDR_FILE_RANGE
+{
+	BOOL pending;
+	UINT32 streamId;
+	UINT32 dwFlags;
+	UINT64 offset;
+	UINT32 length;
+	UINT32 sent;
+};
+typedef struct _CLIPRDR_FILE_RANGE CLIPRDR_FILE_RANGE;
+
+struct _CLIPRDR_FILE_TRANSFER
+{
+	void* custom;
+
+	/* sends a FileContents request, the response must not be delivered from within */
+	pcCliprdrFileTransferRequest Request;
+
+	/* writes received data at its offset in the destination */
+	pcCliprdrFileTransferWrite Write;
+
+	int state;
+	UINT32 listIndex;
+	UINT32 clipDataId;
+	UINT32 streamId;
+
+	UINT64 size;
+	UINT64 offset;
+	UINT64 received;
+
+	UINT32 chunkSize;
+	UINT32 minChunkSize;
+	UINT32 maxChunkSize;
+	UINT32 maxRequests;
+
+	UINT32 outstanding;
+	UINT32 peakOutstanding;
+	UINT32 requests;
+	CLIPRDR_FILE_RANGE ranges[CLIPRDR_FILE_TRANSFER_MAX_REQUESTS];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FREERDP_API int cliprdr_parse_file_list(const BYTE* format_data, UINT32 format_data_length,
+		CLIPRDR_FILEDESCRIPTOR** file_descriptor_array, UINT32* file_descriptor_count);
+FREERDP_API int cliprdr_serialize_file_list(const CLIPRDR_FILEDESCRIPTOR* file_descriptor_array,
+		UINT32 file_descriptor_count, BYTE** format_data, UINT32* format_data_length);
+
+FREERDP_API int cliprdr_file_transfer_start(CLIPRDR_FILE_TRANSFER* transfer, UINT32 listIndex,
+		UINT32 clipDataId, const CLIPRDR_FILEDESCRIPTOR* descriptor, UINT32 now);
+FREERDP_API int cliprdr_file_transfer_response(CLIPRDR_FILE_TRANSFER* transfer,
+		const CLIPRDR_FILE_CONTENTS_RESPONSE* response, UINT32 now);
+FREERDP_API void cliprdr_file_transfer_cancel(CLIPRDR_FILE_TRANSFER* transfer);
+
+FREERDP_API CLIPRDR_FILE_TRANSFER* cliprdr_file_transfer_new(void);
+FREERDP_API void cliprdr_file_transfer_free(CLIPRDR_FILE_TRANSFER* transfer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_UTILS_CLIPRDR_H */
@@ -104,6 +104,72 @@ void update_gdi_cache_bitmap(rdpContext* context, CACHE_BITMAP_ORDER* cacheBitma
 	bitmap_cache_put(cache->bitmap, cacheBitmap->cacheId, cacheBitmap->cacheIndex, bitmap);
 }
 
+static BOOL bitmap_cache_is_persistent(rdpBitmapCache* bitmapCache, UINT32 id, UINT32 index)
+{
+	if (!bitmapCache->persistent || (id >= bitmapCache->maxCells) || (id >= PERSIST_CACHE_MAX_CELLS))
+		return FALSE;
+
+	if (index == BITMAP_CACHE_WAITING_LIST_INDEX)
+		return FALSE;
+
+	return bitmapCache->settings->BitmapCacheV2CellInfo[id].persistent;
+}
+
+static void bitmap_cache_store_persistent(rdpBitmapCache* bitmapCache, UINT32 id, UINT32 key1, UINT32 key2,
+		UINT32 width, UINT32 height, UINT32 bpp, BOOL compressed, UINT32 codecId, BYTE* data, UINT32 length)
+{
+	PERSISTENT_CACHE_ENTRY entry;
+
+	entry.key64 = (((UINT64) key2) << 32) | key1;
+	entry.width = (UINT16) width;
+	entry.height = (UINT16) height;
+	entry.cacheId = (BYTE) id;
+	entry.bpp = (BYTE) bpp;
+	entry.flags = compressed ? PERSIST_CACHE_FLAG_COMPRESSED : 0;
+	entry.codecId = (BYTE) codecId;
+	entry.size = length;
+	entry.data = data;
+
+	persistent_cache_put(bitmapCache->persistent, &entry);
+}
+
+static rdpBitmap* bitmap_cache_load_persistent(rdpBitmapCache* bitmapCache, UINT32 id, UINT32 index)
+{
+	UINT64 key64;
+	rdpBitmap* bitmap;
+	rdpContext* context = bitmapCache->context;
+	PERSISTENT_CACHE_ENTRY entry;
+
+	if ((id >= PERSIST_CACHE_MAX_CELLS) || (index >= bitmapCache->persistentKeyCount[id]))
+		return NULL;
+
+	key64 = bitmapCache->persistentKeys[id][index];
+
+	if (!key64 || !persistent_cache_get(bitmapCache->persistent, key64, &entry))
+		return NULL;
+
+	bitmapCache->persistentKeys[id][index] = 0;
+	persistent_cache_pin(bitmapCache->persistent, key64, FALSE);
+
+	bitmap = Bitmap_Alloc(context);
+
+	if (!bitmap)
+		return NULL;
+
+	Bitmap_SetDimensions(context, bitmap, entry.width, entry.height);
+
+	bitmap->Decompress(context, bitmap,
+			entry.data, entry.width, entry.height,
+			entry.bpp, entry.size,
+			(entry.flags & PERSIST_CACHE_FLAG_COMPRESSED) ? TRUE : FALSE, entry.codecId);
+
+	bitmap->New(context, bitmap);
+
+	bitmapCache->cells[id].entries[index] = bitmap;
+
+	return bitmap;
+}
+
 void update_gdi_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cacheBitmapV2)
 {
 	rdpBitmap* bitmap;
@@ -134,6 +200,18 @@ void update_gdi_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cach
 		Bitmap_Free(context, prevBitmap);
 
 	bitmap_cache_put(cache->bitmap, cacheBitmapV2->cacheId, cacheBitmapV2->cacheIndex, bitmap);
+
+	/* stored once the replaced entry released its persistent slot */
+
+	if ((cacheBitmapV2->flags & CBR2_PERSISTENT_KEY_PRESENT) &&
+		bitmap_cache_is_persistent(cache->bitmap, cacheBitmapV2->cacheId, cacheBitmapV2->cacheIndex))
+	{
+		bitmap_cache_store_persistent(cache->bitmap, cacheBitmapV2->cacheId,
+				cacheBitmapV2->key1, cacheBitmapV2->key2,
+				cacheBitmapV2->bitmapWidth, cacheBitmapV2->bitmapHeight, cacheBitmapV2->bitmapBpp,
+				cacheBitmapV2->compressed, RDP_CODEC_ID_NONE,
+				cacheBitmapV2->bitmapDataStream, cacheBitmapV2->bitmapLength);
+	}
 }
 
 void update_gdi_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cacheBitmapV3)
@@ -167,6 +245,18 @@ void update_gdi_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cach
 		Bitmap_Free(context, prevBitmap);
 
 	bitmap_cache_put(cache->bitmap, cacheBitmapV3->cacheId, cacheBitmapV3->cacheIndex, bitmap);
+
+	/* stored once the replaced entry released its persistent slot */
+
+	if ((cacheBitmapV3->key1 || cacheBitmapV3->key2) &&
+		bitmap_cache_is_persistent(cache->bitmap, cacheBitmapV3->cacheId, cacheBitmapV3->cacheIndex))
+	{
+		bitmap_cache_store_persistent(cache->bitmap, cacheBitmapV3->cacheId,
+				cacheBitmapV3->key1, cacheBitmapV3->key2,
+				bitmapData->width, bitmapData->height, bitmapData->bpp,
+				compressed, bitmapData->codecID,
+				bitmapData->data, bitmapData->length);
+	}
 }
 
 void update_gdi_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmapUpdate)
@@ -238,6 +328,9 @@ rdpBitmap* bitmap_cache_get(rdpBitmapCache* bitmapCache, UINT32 id, UINT32 index
 
 	bitmap = bitmapCache->cells[id].entries[index];
 
+	if (!bitmap && bitmapCache->persistent)
+		bitmap = bitmap_cache_load_persistent(bitmapCache, id, index);
+
 	return bitmap;
 }
 
@@ -260,6 +353,15 @@ void bitmap_cache_put(rdpBitmapCache* bitmapCache, UINT32 id, UINT32 index, rdpB
 	}
 
 	bitmapCache->cells[id].entries[index] = bitmap;
+
+	/* the server replaced the bitmap offered in the persistent key list */
+
+	if ((id < PERSIST_CACHE_MAX_CELLS) && (index < bitmapCache->persistentKeyCount[id]) &&
+		bitmapCache->persistentKeys[id][index])
+	{
+		persistent_cache_pin(bitmapCache->persistent, bitmapCache->persistentKeys[id][index], FALSE);
+		bitmapCache->persistentKeys[id][index] = 0;
+	}
 }
 
 void bitmap_cache_register_callbacks(rdpUpdate* update)
@@ -279,6 +381,107 @@ void bitmap_cache_register_callbacks(rdpUpdate* update)
 	update->BitmapUpdate = update_gdi_bitmap_update;
 }
 
+/**
+ * Rebuild the key lists offered to the server in the Persistent Key List PDU
+ * and pin their slots until they are loaded or replaced. Bitmaps are decoded
+ * lazily, on the first reference to their cache index.
+ */
+
+static void bitmap_cache_build_persistent_keys(rdpBitmapCache* bitmapCache)
+{
+	UINT32 i;
+	UINT32 j;
+	UINT32 numEntries;
+	rdpSettings* settings = bitmapCache->settings;
+
+	for (i = 0; (i < bitmapCache->maxCells) && (i < PERSIST_CACHE_MAX_CELLS); i++)
+	{
+		if (!settings->BitmapCacheV2CellInfo[i].persistent)
+			continue;
+
+		numEntries = bitmapCache->cells[i].number;
+
+		if (numEntries > 0xFFFF)
+			numEntries = 0xFFFF;
+
+		if (!bitmapCache->persistentKeys[i])
+			bitmapCache->persistentKeys[i] = (UINT64*) calloc(numEntries + 1, sizeof(UINT64));
+
+		if (!bitmapCache->persistentKeys[i])
+			continue;
+
+		bitmapCache->persistentKeyCount[i] = persistent_cache_get_key_list(bitmapCache->persistent,
+				(BYTE) i, bitmapCache->persistentKeys[i], numEntries);
+
+		for (j = 0; j < bitmapCache->persistentKeyCount[i]; j++)
+			persistent_cache_pin(bitmapCache->persistent, bitmapCache->persistentKeys[i][j], TRUE);
+	}
+}
+
+/**
+ * Called when the key lists are offered again (on reconnect): the server only
+ * knows about the offered bitmaps, so the persistent cells are emptied and the
+ * lists rebuilt from the current contents of the file.
+ */
+
+void bitmap_cache_reset_persistent_keys(rdpBitmapCache* bitmapCache)
+{
+	UINT32 i;
+	UINT32 j;
+	rdpBitmap* bitmap;
+
+	if (!bitmapCache->persistent)
+		return;
+
+	for (i = 0; (i < bitmapCache->maxCells) && (i < PERSIST_CACHE_MAX_CELLS); i++)
+	{
+		for (j = 0; j < bitmapCache->persistentKeyCount[i]; j++)
+		{
+			if (bitmapCache->persistentKeys[i][j])
+				persistent_cache_pin(bitmapCache->persistent, bitmapCache->persistentKeys[i][j], FALSE);
+		}
+
+		bitmapCache->persistentKeyCount[i] = 0;
+
+		if (!bitmapCache->settings->BitmapCacheV2CellInfo[i].persistent)
+			continue;
+
+		for (j = 0; j < bitmapCache->cells[i].number + 1; j++)
+		{
+			bitmap = bitmapCache->cells[i].entries[j];
+
+			if (bitmap)
+				Bitmap_Free(bitmapCache->context, bitmap);
+
+			bitmapCache->cells[i].entries[j] = NULL;
+		}
+	}
+
+	bitmap_cache_build_persistent_keys(bitmapCache);
+}
+
+static void bitmap_cache_open_persistent(rdpBitmapCache* bitmapCache)
+{
+	rdpSettings* settings = bitmapCache->settings;
+
+	bitmapCache->persistent = persistent_cache_new(persistent_cache_max_entries(settings));
+
+	if (!bitmapCache->persistent)
+		return;
+
+	if (persistent_cache_open(bitmapCache->persistent, settings->BitmapCachePersistFile, FALSE) < 0)
+	{
+		persistent_cache_free(bitmapCache->persistent);
+		bitmapCache->persistent = NULL;
+		return;
+	}
+
+	bitmap_cache_build_persistent_keys(bitmapCache);
+
+	WLog_DBG(TAG, "persistent bitmap cache: %d bitmaps available",
+			 persistent_cache_get_count(bitmapCache->persistent));
+}
+
 rdpBitmapCache* bitmap_cache_new(rdpSettings* settings)
 {
 	int i;
@@ -308,6 +511,9 @@ rdpBitmapCache* bitmap_cache_new(rdpSettings* settings)
 			/* allocate an extra entry for BITMAP_CACHE_WAITING_LIST_INDEX */
 			bitmapCache->cells[i].entries = (rdpBitmap**) calloc((bitmapCache->cells[i].number + 1), sizeof(rdpBitmap*));
 		}
+
+		if (settings->BitmapCachePersistEnabled && settings->BitmapCachePersistFile)
+			bitmap_cache_open_persistent(bitmapCache);
 	}
 
 	return bitmapCache;
@@ -336,6 +542,11 @@ void bitmap_cache_free(rdpBitmapCache* bitmapCache)
 		if (bitmapCache->bitmap)
 			Bitmap_Free(bitmapCache->context, bitmapCache->bitmap);
 
+		for (i = 0; i < PERSIST_CACHE_MAX_CELLS; i++)
+			free(bitmapCache->persistentKeys[i]);
+
+		persistent_cache_free(bitmapCache->persistent);
+
 		free(bitmapCache->cells);
 		free(bitmapCache);
 	}
@@ -0,0 +1,801 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Persistent Bitmap Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <freerdp/log.h>
+#include <freerdp/cache/persistent.h>
+
+#define TAG FREERDP_TAG("cache.persistent")
+
+/**
+ * The cache file is a fixed array of slots mapped into memory:
+ *
+ * | header | slot 0 | slot 1 | ... | slot (count - 1) |
+ *
+ * Each slot holds one bitmap as it was received from the server (before
+ * decompression), so it can be decoded again by whatever client backend
+ * loads it. The header clock is bumped on every access and copied into
+ * the slot stamp, which gives the least recently used slot for eviction
+ * and the ordering of the keys offered in the Persistent Key List PDU.
+ *
+ * Slots holding keys that were offered to the server but not loaded yet are
+ * pinned in memory: the server may still reference them, so they are never
+ * evicted until they are loaded or replaced.
+ */
+
+#define PERSIST_CACHE_MAGIC		0x43505246 /* "FRPC" */
+#define PERSIST_CACHE_VERSION		1
+
+struct _PERSIST_CACHE_HEADER
+{
+	UINT32 magic;
+	UINT32 version;
+	UINT32 count;
+	UINT32 slotSize;
+	UINT32 clock;
+	UINT32 reserved[3];
+};
+typedef struct _PERSIST_CACHE_HEADER PERSIST_CACHE_HEADER;
+
+struct _PERSIST_CACHE_SLOT
+{
+	UINT64 key64;
+	UINT32 stamp;
+	UINT32 size;
+	UINT16 width;
+	UINT16 height;
+	BYTE cacheId;
+	BYTE bpp;
+	BYTE flags;
+	BYTE codecId;
+};
+typedef struct _PERSIST_CACHE_SLOT PERSIST_CACHE_SLOT;
+
+#define PERSIST_CACHE_SLOT_STRIDE	(sizeof(PERSIST_CACHE_SLOT) + PERSIST_CACHE_MAX_DATA_SIZE)
+
+struct rdp_persistent_cache
+{
+	BOOL readOnly;
+	UINT32 maxEntries;
+
+	UINT32 count;
+	UINT32 used;
+	UINT32 nextFree;
+
+	BYTE* view;
+	size_t viewSize;
+	PERSIST_CACHE_HEADER* header;
+
+#ifdef _WIN32
+	HANDLE hFile;
+	HANDLE hMapping;
+#else
+	int fd;
+#endif
+
+	UINT32* index;
+	UINT32 indexMask;
+	BYTE* pinned;
+};
+
+struct _PERSIST_CACHE_ORDER
+{
+	UINT32 stamp;
+	UINT32 slot;
+};
+typedef struct _PERSIST_CACHE_ORDER PERSIST_CACHE_ORDER;
+
+static PERSIST_CACHE_SLOT* persistent_cache_slot(rdpPersistentCache* persistent, UINT32 slot)
+{
+	return (PERSIST_CACHE_SLOT*) &persistent->view[sizeof(PERSIST_CACHE_HEADER) + (size_t) slot * PERSIST_CACHE_SLOT_STRIDE];
+}
+
+static UINT32 persistent_cache_hash(UINT64 key64)
+{
+	key64 ^= key64 >> 33;
+	key64 *= 0xFF51AFD7ED558CCDULL;
+	key64 ^= key64 >> 33;
+
+	return (UINT32) key64;
+}
+
+static UINT32 persistent_cache_index_find(rdpPersistentCache* persistent, UINT64 key64)
+{
+	UINT32 i;
+	UINT32 slot;
+
+	i = persistent_cache_hash(key64) & persistent->indexMask;
+
+	while ((slot = persistent->index[i]) != 0)
+	{
+		if (persistent_cache_slot(persistent, slot - 1)->key64 == key64)
+			return i;
+
+		i = (i + 1) & persistent->indexMask;
+	}
+
+	return i;
+}
+
+static void persistent_cache_index_remove(rdpPersistentCache* persistent, UINT32 i)
+{
+	UINT32 j;
+	UINT32 home;
+
+	/* backward shift deletion keeps the linear probe sequences intact */
+
+	persistent->index[i] = 0;
+	j = i;
+
+	while (1)
+	{
+		j = (j + 1) & persistent->indexMask;
+
+		if (!persistent->index[j])
+			break;
+
+		home = persistent_cache_hash(persistent_cache_slot(persistent, persistent->index[j] - 1)->key64) & persistent->indexMask;
+
+		if (((j - home) & persistent->indexMask) >= ((j - i) & persistent->indexMask))
+		{
+			persistent->index[i] = persistent->index[j];
+			persistent->index[j] = 0;
+			i = j;
+		}
+	}
+}
+
+static BOOL persistent_cache_index_build(rdpPersistentCache* persistent)
+{
+	UINT32 i;
+	UINT32 j;
+	UINT32 size;
+	PERSIST_CACHE_SLOT* slot;
+	PERSIST_CACHE_SLOT* other;
+
+	size = 1;
+
+	while (size < (persistent->count * 2))
+		size <<= 1;
+
+	free(persistent->index);
+	persistent->index = (UINT32*) calloc(size, sizeof(UINT32));
+
+	if (!persistent->index)
+		return FALSE;
+
+	free(persistent->pinned);
+	persistent->pinned = (BYTE*) calloc(persistent->count, sizeof(BYTE));
+
+	if (!persistent->pinned)
+		return FALSE;
+
+	persistent->indexMask = size - 1;
+	persistent->used = 0;
+	persistent->nextFree = 0;
+
+	for (i = 0; i < persistent->count; i++)
+	{
+		slot = persistent_cache_slot(persistent, i);
+
+		if (!slot->size)
+			continue;
+
+		if ((slot->size > PERSIST_CACHE_MAX_DATA_SIZE) || (slot->cacheId >= PERSIST_CACHE_MAX_CELLS))
+		{
+			if (!persistent->readOnly)
+				ZeroMemory(slot, sizeof(PERSIST_CACHE_SLOT));
+
+			continue;
+		}
+
+		j = persistent_cache_index_find(persistent, slot->key64);
+
+		if (persistent->index[j])
+		{
+			/**
+			 * The same key stored twice (the file is shared by another client):
+			 * the most recently used copy is kept, ties going to the first slot,
+			 * so that read-only and writable opens agree on the keys offered.
+			 */
+
+			other = persistent_cache_slot(persistent, persistent->index[j] - 1);
+
+			if (other->stamp >= slot->stamp)
+			{
+				if (!persistent->readOnly)
+					ZeroMemory(slot, sizeof(PERSIST_CACHE_SLOT));
+
+				continue;
+			}
+
+			if (!persistent->readOnly)
+				ZeroMemory(other, sizeof(PERSIST_CACHE_SLOT));
+
+			persistent->index[j] = i + 1;
+			continue;
+		}
+
+		persistent->index[j] = i + 1;
+		persistent->used++;
+	}
+
+	return TRUE;
+}
+
+static BOOL persistent_cache_header_valid(rdpPersistentCache* persistent)
+{
+	PERSIST_CACHE_HEADER* header = persistent->header;
+
+	if ((header->magic != PERSIST_CACHE_MAGIC) || (header->version != PERSIST_CACHE_VERSION))
+		return FALSE;
+
+	if (header->slotSize != PERSIST_CACHE_MAX_DATA_SIZE)
+		return FALSE;
+
+	if (persistent->viewSize != sizeof(PERSIST_CACHE_HEADER) + (size_t) header->count * PERSIST_CACHE_SLOT_STRIDE)
+		return FALSE;
+
+	return TRUE;
+}
+
+#ifndef _WIN32
+
+static void persistent_cache_unmap(rdpPersistentCache* persistent)
+{
+	if (persistent->view)
+		munmap(persistent->view, persistent->viewSize);
+
+	if (persistent->fd >= 0)
+		close(persistent->fd);
+
+	persistent->fd = -1;
+	persistent->view = NULL;
+	persistent->viewSize = 0;
+	persistent->header = NULL;
+}
+
+static int persistent_cache_map(rdpPersistentCache* persistent, const char* filename, size_t size, BOOL reset)
+{
+	struct stat st;
+
+	persistent->fd = open(filename, persistent->readOnly ? O_RDONLY : (O_RDWR | O_CREAT), 0600);
+
+	if (persistent->fd < 0)
+		return -1;
+
+	if (fstat(persistent->fd, &st) != 0)
+		return -1;
+
+	if (size && (reset || ((size_t) st.st_size != size)))
+	{
+		if (ftruncate(persistent->fd, 0) != 0 || ftruncate(persistent->fd, size) != 0)
+			return -1;
+	}
+	else
+	{
+		size = (size_t) st.st_size;
+	}
+
+	if (size < sizeof(PERSIST_CACHE_HEADER))
+		return -1;
+
+	persistent->view = (BYTE*) mmap(NULL, size, persistent->readOnly ? PROT_READ : (PROT_READ | PROT_WRITE),
+			MAP_SHARED, persistent->fd, 0);
+
+	if (persistent->view == MAP_FAILED)
+	{
+		persistent->view = NULL;
+		return -1;
+	}
+
+	persistent->viewSize = size;
+	persistent->header = (PERSIST_CACHE_HEADER*) persistent->view;
+
+	return 1;
+}
+
+#else
+
+static void persistent_cache_unmap(rdpPersistentCache* persistent)
+{
+	if (persistent->view)
+		UnmapViewOfFile(persistent->view);
+
+	if (persistent->hMapping)
+		CloseHandle(persistent->hMapping);
+
+	if (persistent->hFile && (persistent->hFile != INVALID_HANDLE_VALUE))
+		CloseHandle(persistent->hFile);
+
+	persistent->hFile = NULL;
+	persistent->hMapping = NULL;
+	persistent->view = NULL;
+	persistent->viewSize = 0;
+	persistent->header = NULL;
+}
+
+static int persistent_cache_map(rdpPersistentCache* persistent, const char* filename, size_t size, BOOL reset)
+{
+	LARGE_INTEGER fileSize;
+
+	persistent->hFile = CreateFileA(filename, persistent->readOnly ? GENERIC_READ : (GENERIC_READ | GENERIC_WRITE),
+			FILE_SHARE_READ, NULL, persistent->readOnly ? OPEN_EXISTING : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (persistent->hFile == INVALID_HANDLE_VALUE)
+		return -1;
+
+	if (!GetFileSizeEx(persistent->hFile, &fileSize))
+		return -1;
+
+	if (size && (reset || ((size_t) fileSize.QuadPart != size)))
+	{
+		fileSize.QuadPart = 0;
+
+		if (!SetFilePointerEx(persistent->hFile, fileSize, NULL, FILE_BEGIN) || !SetEndOfFile(persistent->hFile))
+			return -1;
+
+		fileSize.QuadPart = size;
+
+		if (!SetFilePointerEx(persistent->hFile, fileSize, NULL, FILE_BEGIN) || !SetEndOfFile(persistent->hFile))
+			return -1;
+	}
+	else
+	{
+		size = (size_t) fileSize.QuadPart;
+	}
+
+	if (size < sizeof(PERSIST_CACHE_HEADER))
+		return -1;
+
+	persistent->hMapping = CreateFileMappingA(persistent->hFile, NULL,
+			persistent->readOnly ? PAGE_READONLY : PAGE_READWRITE, 0, 0, NULL);
+
+	if (!persistent->hMapping)
+		return -1;
+
+	persistent->view = (BYTE*) MapViewOfFile(persistent->hMapping,
+			persistent->readOnly ? FILE_MAP_READ : FILE_MAP_WRITE, 0, 0, size);
+
+	if (!persistent->view)
+		return -1;
+
+	persistent->viewSize = size;
+	persistent->header = (PERSIST_CACHE_HEADER*) persistent->view;
+
+	return 1;
+}
+
+#endif
+
+/**
+ * Open (and create if needed) a persistent cache file.
+ * A read-only cache is only used to look at the stored keys and is never
+ * created nor reset; a writable cache with a mismatching layout is reset.
+ */
+
+int persistent_cache_open(rdpPersistentCache* persistent, const char* filename, BOOL readOnly)
+{
+	size_t size;
+
+	persistent_cache_close(persistent);
+
+	if (!filename)
+		return -1;
+
+	persistent->readOnly = readOnly;
+
+	size = sizeof(PERSIST_CACHE_HEADER) + (size_t) persistent->maxEntries * PERSIST_CACHE_SLOT_STRIDE;
+
+	if (persistent_cache_map(persistent, filename, readOnly ? 0 : size, FALSE) < 0)
+	{
+		if (!readOnly)
+			WLog_WARN(TAG, "unable to map persistent cache file %s", filename);
+
+		persistent_cache_unmap(persistent);
+		return -1;
+	}
+
+	if (!persistent_cache_header_valid(persistent) || (persistent->header->count != persistent->maxEntries))
+	{
+		persistent_cache_unmap(persistent);
+
+		if (readOnly)
+			return -1;
+
+		/* truncating leaves a sparse, zero-filled file: every slot is empty */
+
+		if (persistent_cache_map(persistent, filename, size, TRUE) < 0)
+		{
+			WLog_WARN(TAG, "unable to reset persistent cache file %s", filename);
+			persistent_cache_unmap(persistent);
+			return -1;
+		}
+
+		persistent->header->magic = PERSIST_CACHE_MAGIC;
+		persistent->header->version = PERSIST_CACHE_VERSION;
+		persistent->header->count = persistent->maxEntries;
+		persistent->header->slotSize = PERSIST_CACHE_MAX_DATA_SIZE;
+	}
+
+	persistent->count = persistent->header->count;
+
+	if (!persistent_cache_index_build(persistent))
+	{
+		persistent_cache_close(persistent);
+		return -1;
+	}
+
+	return 1;
+}
+
+void persistent_cache_close(rdpPersistentCache* persistent)
+{
+	persistent_cache_unmap(persistent);
+
+	free(persistent->index);
+	persistent->index = NULL;
+	persistent->indexMask = 0;
+
+	free(persistent->pinned);
+	persistent->pinned = NULL;
+
+	persistent->count = 0;
+	persistent->used = 0;
+	persistent->nextFree = 0;
+}
+
+UINT32 persistent_cache_get_count(rdpPersistentCache* persistent)
+{
+	return persistent->used;
+}
+
+static int persistent_cache_order_compare(const void* a, const void* b)
+{
+	const PERSIST_CACHE_ORDER* oa = (const PERSIST_CACHE_ORDER*) a;
+	const PERSIST_CACHE_ORDER* ob = (const PERSIST_CACHE_ORDER*) b;
+
+	if (oa->stamp != ob->stamp)
+		return (oa->stamp > ob->stamp) ? -1 : 1;
+
+	return (oa->slot < ob->slot) ? -1 : 1;
+}
+
+/**
+ * Renumber the stamps of the used slots from 1 in the same order, so that the
+ * clock restarts from the number of used slots instead of wrapping around.
+ */
+
+static void persistent_cache_renumber(rdpPersistentCache* persistent)
+{
+	UINT32 i;
+	UINT32 count = 0;
+	PERSIST_CACHE_SLOT* slot;
+	PERSIST_CACHE_ORDER* order;
+
+	order = (PERSIST_CACHE_ORDER*) calloc(persistent->count, sizeof(PERSIST_CACHE_ORDER));
+
+	for (i = 0; i < persistent->count; i++)
+	{
+		slot = persistent_cache_slot(persistent, i);
+
+		if (!slot->size)
+		{
+			slot->stamp = 0;
+			continue;
+		}
+
+		if (!order)
+		{
+			/* out of memory: the recency is lost but the clock still restarts */
+			slot->stamp = 1;
+			continue;
+		}
+
+		order[count].stamp = slot->stamp;
+		order[count].slot = i;
+		count++;
+	}
+
+	if (!order)
+	{
+		persistent->header->clock = 1;
+		return;
+	}
+
+	qsort(order, count, sizeof(PERSIST_CACHE_ORDER), persistent_cache_order_compare);
+
+	for (i = 0; i < count; i++)
+		persistent_cache_slot(persistent, order[i].slot)->stamp = count - i;
+
+	persistent->header->clock = count;
+
+	free(order);
+}
+
+static UINT32 persistent_cache_tick(rdpPersistentCache* persistent)
+{
+	if (persistent->header->clock == 0xFFFFFFFF)
+		persistent_cache_renumber(persistent);
+
+	return ++persistent->header->clock;
+}
+
+/**
+ * Look up a bitmap by its 64-bit key. The returned data points into the
+ * mapped file and stays valid until the next persistent_cache_put().
+ */
+
+BOOL persistent_cache_get(rdpPersistentCache* persistent, UINT64 key64, PERSISTENT_CACHE_ENTRY* entry)
+{
+	UINT32 slotIndex;
+	PERSIST_CACHE_SLOT* slot;
+
+	if (!persistent->view)
+		return FALSE;
+
+	slotIndex = persistent->index[persistent_cache_index_find(persistent, key64)];
+
+	if (!slotIndex)
+		return FALSE;
+
+	slot = persistent_cache_slot(persistent, slotIndex - 1);
+
+	if (!persistent->readOnly)
+		slot->stamp = persistent_cache_tick(persistent);
+
+	entry->key64 = slot->key64;
+	entry->width = slot->width;
+	entry->height = slot->height;
+	entry->cacheId = slot->cacheId;
+	entry->bpp = slot->bpp;
+	entry->flags = slot->flags;
+	entry->codecId = slot->codecId;
+	entry->size = slot->size;
+	entry->data = ((BYTE*) slot) + sizeof(PERSIST_CACHE_SLOT);
+
+	return TRUE;
+}
+
+/**
+ * Mark the slot of a key offered to the server as pinned, or release it once
+ * the bitmap was loaded or replaced. Pinned slots are never evicted.
+ */
+
+BOOL persistent_cache_pin(rdpPersistentCache* persistent, UINT64 key64, BOOL pinned)
+{
+	UINT32 slotIndex;
+
+	if (!persistent->view)
+		return FALSE;
+
+	slotIndex = persistent->index[persistent_cache_index_find(persistent, key64)];
+
+	if (!slotIndex)
+		return FALSE;
+
+	persistent->pinned[slotIndex - 1] = pinned ? 1 : 0;
+
+	return TRUE;
+}
+
+static BOOL persistent_cache_evict(rdpPersistentCache* persistent, UINT32* victim)
+{
+	UINT32 i;
+	UINT32 index;
+	BOOL found = FALSE;
+	UINT32 stamp = 0xFFFFFFFF;
+	PERSIST_CACHE_SLOT* slot;
+
+	for (i = 0; i < persistent->count; i++)
+	{
+		slot = persistent_cache_slot(persistent, i);
+
+		if (!slot->size || persistent->pinned[i])
+			continue;
+
+		if (!found || (slot->stamp < stamp))
+		{
+			stamp = slot->stamp;
+			*victim = i;
+			found = TRUE;
+		}
+	}
+
+	if (!found)
+		return FALSE;
+
+	slot = persistent_cache_slot(persistent, *victim);
+	index = persistent_cache_index_find(persistent, slot->key64);
+
+	if (persistent->index[index] == (*victim + 1))
+	{
+		persistent_cache_index_remove(persistent, index);
+		persistent->used--;
+	}
+
+	ZeroMemory(slot, sizeof(PERSIST_CACHE_SLOT));
+
+	return TRUE;
+}
+
+BOOL persistent_cache_put(rdpPersistentCache* persistent, PERSISTENT_CACHE_ENTRY* entry)
+{
+	UINT32 i;
+	UINT32 slotIndex;
+	PERSIST_CACHE_SLOT* slot;
+
+	if (!persistent->view || persistent->readOnly || !persistent->count)
+		return FALSE;
+
+	if (!entry->size || (entry->size > PERSIST_CACHE_MAX_DATA_SIZE) || (entry->cacheId >= PERSIST_CACHE_MAX_CELLS))
+		return FALSE;
+
+	i = persistent_cache_index_find(persistent, entry->key64);
+	slotIndex = persistent->index[i];
+
+	if (slotIndex)
+	{
+		slotIndex--;
+	}
+	else
+	{
+		if (persistent->used < persistent->count)
+		{
+			while (persistent_cache_slot(persistent, persistent->nextFree)->size)
+				persistent->nextFree = (persistent->nextFree + 1) % persistent->count;
+
+			slotIndex = persistent->nextFree;
+		}
+		else if (!persistent_cache_evict(persistent, &slotIndex))
+		{
+			/* every slot holds a key the server may still reference */
+			return FALSE;
+		}
+
+		persistent->index[persistent_cache_index_find(persistent, entry->key64)] = slotIndex + 1;
+		persistent->used++;
+	}
+
+	slot = persistent_cache_slot(persistent, slotIndex);
+
+	slot->key64 = entry->key64;
+	slot->stamp = persistent_cache_tick(persistent);
+	slot->size = entry->size;
+	slot->width = entry->width;
+	slot->height = entry->height;
+	slot->cacheId = entry->cacheId;
+	slot->bpp = entry->bpp;
+	slot->flags = entry->flags;
+	slot->codecId = entry->codecId;
+
+	CopyMemory(((BYTE*) slot) + sizeof(PERSIST_CACHE_SLOT), entry->data, entry->size);
+
+	return TRUE;
+}
+
+/**
+ * Fill keys with the most recently used keys stored for a given bitmap cell.
+ * The result only depends on the file contents, so the list offered in the
+ * Persistent Key List PDU can be rebuilt identically when the bitmap cache
+ * is created: the n-th key of a cell is expected at cache index n.
+ */
+
+UINT32 persistent_cache_get_key_list(rdpPersistentCache* persistent, BYTE cacheId, UINT64* keys, UINT32 maxKeys)
+{
+	UINT32 i;
+	UINT32 count = 0;
+	PERSIST_CACHE_SLOT* slot;
+	PERSIST_CACHE_ORDER* order;
+
+	if (!persistent->view || !persistent->used || !maxKeys)
+		return 0;
+
+	order = (PERSIST_CACHE_ORDER*) calloc(persistent->used, sizeof(PERSIST_CACHE_ORDER));
+
+	if (!order)
+		return 0;
+
+	for (i = 0; (i < persistent->count) && (count < persistent->used); i++)
+	{
+		slot = persistent_cache_slot(persistent, i);
+
+		if (!slot->size || (slot->cacheId != cacheId))
+			continue;
+
+		/* skip stale duplicates left in a read-only file */
+
+		if (persistent->index[persistent_cache_index_find(persistent, slot->key64)] != (i + 1))
+			continue;
+
+		order[count].stamp = slot->stamp;
+		order[count].slot = i;
+		count++;
+	}
+
+	qsort(order, count, sizeof(PERSIST_CACHE_ORDER), persistent_cache_order_compare);
+
+	if (count > maxKeys)
+		count = maxKeys;
+
+	for (i = 0; i < count; i++)
+		keys[i] = persistent_cache_slot(persistent, order[i].slot)->key64;
+
+	free(order);
+
+	return count;
+}
+
+/**
+ * Number of slots needed to back every persistent bitmap cell.
+ */
+
+UINT32 persistent_cache_max_entries(rdpSettings* settings)
+{
+	UINT32 i;
+	UINT32 count = 0;
+
+	for (i = 0; (i < settings->BitmapCacheV2NumCells) && (i < PERSIST_CACHE_MAX_CELLS); i++)
+	{
+		if (settings->BitmapCacheV2CellInfo[i].persistent)
+			count += settings->BitmapCacheV2CellInfo[i].numEntries;
+	}
+
+	return count;
+}
+
+rdpPersistentCache* persistent_cache_new(UINT32 maxEntries)
+{
+	rdpPersistentCache* persistent;
+
+	persistent = (rdpPersistentCache*) calloc(1, sizeof(rdpPersistentCache));
+
+	if (!persistent)
+		return NULL;
+
+	persistent->maxEntries = maxEntries;
+
+#ifndef _WIN32
+	persistent->fd = -1;
+#endif
+
+	return persistent;
+}
+
+void persistent_cache_free(rdpPersistentCache* persistent)
+{
+	if (!persistent)
+		return;
+
+	persistent_cache_close(persistent);
+	free(persistent);
+}
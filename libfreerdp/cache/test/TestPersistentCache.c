@@ -0,0 +1,327 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/path.h>
+#include <winpr/file.h>
+
+#include <freerdp/cache/persistent.h>
+
+static BOOL test_persistent_cache_put(rdpPersistentCache* persistent, UINT64 key64, BYTE cacheId)
+{
+	BYTE data[64];
+	PERSISTENT_CACHE_ENTRY entry;
+
+	FillMemory(data, sizeof(data), (BYTE) key64);
+
+	entry.key64 = key64;
+	entry.width = 4;
+	entry.height = 4;
+	entry.cacheId = cacheId;
+	entry.bpp = 32;
+	entry.flags = 0;
+	entry.codecId = 0;
+	entry.size = sizeof(data);
+	entry.data = data;
+
+	return persistent_cache_put(persistent, &entry);
+}
+
+/* the header clock follows the magic, version, count and slot size fields */
+
+static BOOL test_persistent_cache_set_clock(const char* filename, UINT32 clock)
+{
+	FILE* fp;
+	BOOL status;
+
+	fp = fopen(filename, "r+b");
+
+	if (!fp)
+		return FALSE;
+
+	status = (fseek(fp, 16, SEEK_SET) == 0) && (fwrite(&clock, sizeof(clock), 1, fp) == 1);
+	fclose(fp);
+
+	return status;
+}
+
+static int test_persistent_cache_pinned(const char* filename)
+{
+	int rc = -1;
+	PERSISTENT_CACHE_ENTRY entry;
+	rdpPersistentCache* persistent;
+
+	DeleteFileA(filename);
+	persistent = persistent_cache_new(2);
+
+	if (!persistent || (persistent_cache_open(persistent, filename, FALSE) < 0))
+		goto fail;
+
+	if (!test_persistent_cache_put(persistent, 0x1111, 0) || !test_persistent_cache_put(persistent, 0x2222, 0))
+		goto fail;
+
+	/* offered keys cannot be evicted, the new bitmap is simply not stored */
+
+	if (!persistent_cache_pin(persistent, 0x1111, TRUE) || !persistent_cache_pin(persistent, 0x2222, TRUE))
+		goto fail;
+
+	if (test_persistent_cache_put(persistent, 0x3333, 0))
+	{
+		printf("pinned entry was evicted\n");
+		goto fail;
+	}
+
+	if (!persistent_cache_pin(persistent, 0x1111, FALSE) || !test_persistent_cache_put(persistent, 0x3333, 0))
+		goto fail;
+
+	if (persistent_cache_get(persistent, 0x1111, &entry) || !persistent_cache_get(persistent, 0x2222, &entry))
+		goto fail;
+
+	/* 0x2222 stays pinned once it becomes the least recently used entry */
+
+	if (!test_persistent_cache_put(persistent, 0x4444, 0) || !test_persistent_cache_put(persistent, 0x5555, 0))
+		goto fail;
+
+	if (!persistent_cache_get(persistent, 0x2222, &entry) || persistent_cache_get(persistent, 0x3333, &entry))
+	{
+		printf("pinned entry was not kept\n");
+		goto fail;
+	}
+
+	rc = 0;
+
+fail:
+	persistent_cache_free(persistent);
+	return rc;
+}
+
+static int test_persistent_cache_shared(const char* filename)
+{
+	int rc = -1;
+	UINT32 count;
+	UINT64 keys[8];
+	rdpPersistentCache* first;
+	rdpPersistentCache* second;
+
+	DeleteFileA(filename);
+	first = persistent_cache_new(4);
+	second = persistent_cache_new(4);
+
+	if (!first || !second)
+		goto fail;
+
+	if ((persistent_cache_open(first, filename, FALSE) < 0) || (persistent_cache_open(second, filename, FALSE) < 0))
+		goto fail;
+
+	/* two clients sharing the file store the same key in different slots */
+
+	if (!test_persistent_cache_put(first, 0x1111, 0) || !test_persistent_cache_put(second, 0x1111, 0) ||
+		!test_persistent_cache_put(second, 0x2222, 0))
+		goto fail;
+
+	persistent_cache_close(second);
+
+	if (persistent_cache_open(second, filename, TRUE) < 0)
+		goto fail;
+
+	count = persistent_cache_get_key_list(second, 0, keys, 8);
+
+	if ((count != 2) || (keys[0] != 0x2222) || (keys[1] != 0x1111))
+	{
+		printf("duplicate key offered (%d keys)\n", count);
+		goto fail;
+	}
+
+	persistent_cache_close(first);
+
+	if (persistent_cache_open(first, filename, FALSE) < 0)
+		goto fail;
+
+	if (persistent_cache_get_count(first) != 2)
+		goto fail;
+
+	/* the duplicate slot was released: two more keys fit without eviction */
+
+	if (!test_persistent_cache_put(first, 0x3333, 0) || !test_persistent_cache_put(first, 0x4444, 0))
+		goto fail;
+
+	if ((persistent_cache_get_count(first) != 4) || (persistent_cache_get_key_list(first, 0, keys, 8) != 4))
+		goto fail;
+
+	rc = 0;
+
+fail:
+	persistent_cache_free(first);
+	persistent_cache_free(second);
+	return rc;
+}
+
+static int test_persistent_cache_clock(const char* filename)
+{
+	int rc = -1;
+	UINT32 count;
+	UINT64 keys[8];
+	PERSISTENT_CACHE_ENTRY entry;
+	rdpPersistentCache* persistent;
+
+	DeleteFileA(filename);
+	persistent = persistent_cache_new(4);
+
+	if (!persistent || (persistent_cache_open(persistent, filename, FALSE) < 0))
+		goto fail;
+
+	if (!test_persistent_cache_put(persistent, 0x1111, 0))
+		goto fail;
+
+	persistent_cache_close(persistent);
+
+	if (!test_persistent_cache_set_clock(filename, 0xFFFFFFFD))
+		goto fail;
+
+	if (persistent_cache_open(persistent, filename, FALSE) < 0)
+		goto fail;
+
+	/* the clock reaches its limit: stamps are renumbered instead of wrapping */
+
+	if (!test_persistent_cache_put(persistent, 0x2222, 0) || !test_persistent_cache_put(persistent, 0x3333, 0))
+		goto fail;
+
+	if (!persistent_cache_get(persistent, 0x1111, &entry))
+		goto fail;
+
+	count = persistent_cache_get_key_list(persistent, 0, keys, 8);
+
+	if ((count != 3) || (keys[0] != 0x1111) || (keys[1] != 0x3333) || (keys[2] != 0x2222))
+	{
+		printf("recency lost when the clock wrapped\n");
+		goto fail;
+	}
+
+	rc = 0;
+
+fail:
+	persistent_cache_free(persistent);
+	return rc;
+}
+
+int TestPersistentCache(int argc, char* argv[])
+{
+	int rc = -1;
+	UINT32 count;
+	UINT64 keys[8];
+	char* filename;
+	char* tempPath;
+	rdpPersistentCache* persistent = NULL;
+	PERSISTENT_CACHE_ENTRY entry;
+
+	tempPath = GetKnownPath(KNOWN_PATH_TEMP);
+	filename = GetCombinedPath(tempPath, "TestPersistentCache.bin");
+	free(tempPath);
+
+	if (!filename)
+		return -1;
+
+	DeleteFileA(filename);
+
+	persistent = persistent_cache_new(4);
+
+	if (!persistent)
+		goto fail;
+
+	/* a missing file is never created by a read-only open */
+
+	if (persistent_cache_open(persistent, filename, TRUE) >= 0)
+		goto fail;
+
+	if (persistent_cache_open(persistent, filename, FALSE) < 0)
+		goto fail;
+
+	if (!test_persistent_cache_put(persistent, 0x1111, 0) ||
+		!test_persistent_cache_put(persistent, 0x2222, 0) ||
+		!test_persistent_cache_put(persistent, 0x3333, 1) ||
+		!test_persistent_cache_put(persistent, 0x4444, 0))
+		goto fail;
+
+	/* touch 0x1111 so that 0x2222 becomes the least recently used entry */
+
+	if (!persistent_cache_get(persistent, 0x1111, &entry) || (entry.data[0] != 0x11))
+		goto fail;
+
+	if (!test_persistent_cache_put(persistent, 0x5555, 0))
+		goto fail;
+
+	if (persistent_cache_get(persistent, 0x2222, &entry))
+	{
+		printf("least recently used entry was not evicted\n");
+		goto fail;
+	}
+
+	if (persistent_cache_get_count(persistent) != 4)
+		goto fail;
+
+	persistent_cache_close(persistent);
+
+	/* the key list survives a reopen, most recently used first */
+
+	if (persistent_cache_open(persistent, filename, TRUE) < 0)
+		goto fail;
+
+	count = persistent_cache_get_key_list(persistent, 0, keys, 8);
+
+	if ((count != 3) || (keys[0] != 0x5555) || (keys[1] != 0x1111) || (keys[2] != 0x4444))
+	{
+		printf("unexpected key list for cell 0 (%d keys)\n", count);
+		goto fail;
+	}
+
+	count = persistent_cache_get_key_list(persistent, 1, keys, 8);
+
+	if ((count != 1) || (keys[0] != 0x3333))
+		goto fail;
+
+	if (!persistent_cache_get(persistent, 0x3333, &entry))
+		goto fail;
+
+	if ((entry.width != 4) || (entry.height != 4) || (entry.size != 64) || (entry.data[63] != 0x33))
+		goto fail;
+
+	persistent_cache_close(persistent);
+	persistent_cache_free(persistent);
+
+	/* a different layout resets the file instead of offering stale keys */
+
+	persistent = persistent_cache_new(8);
+
+	if (!persistent)
+		goto fail;
+
+	if (persistent_cache_open(persistent, filename, TRUE) >= 0)
+		goto fail;
+
+	if (persistent_cache_open(persistent, filename, FALSE) < 0)
+		goto fail;
+
+	if (persistent_cache_get_count(persistent) != 0)
+		goto fail;
+
+	persistent_cache_free(persistent);
+	persistent = NULL;
+
+	if (test_persistent_cache_pinned(filename) < 0)
+		goto fail;
+
+	if (test_persistent_cache_shared(filename) < 0)
+		goto fail;
+
+	if (test_persistent_cache_clock(filename) < 0)
+		goto fail;
+
+	rc = 0;
+
+fail:
+	persistent_cache_free(persistent);
+	DeleteFileA(filename);
+	free(filename);
+
+	return rc;
+}
@@ -63,6 +63,13 @@ UINT32 rdpsnd_compute_audio_time_length(AUDIO_FORMAT* format, int size)
 				WLog_ERR(TAG,  "rdpsnd_compute_audio_time_length: invalid WAVE_FORMAT_GSM610 format");
 			}
 		}
+		else if (format->wFormatTag == WAVE_FORMAT_OPUS)
+		{
+			if (format->nAvgBytesPerSec)
+				mstime = (UINT32) ((((UINT64) size) * 1000) / format->nAvgBytesPerSec);
+			else
+				WLog_ERR(TAG,  "rdpsnd_compute_audio_time_length: invalid WAVE_FORMAT_OPUS format");
+		}
 		else
 		{
 			WLog_ERR(TAG,  "rdpsnd_compute_audio_time_length: unknown format %d", format->wFormatTag);
@@ -105,6 +112,9 @@ char* rdpsnd_get_audio_tag_string(UINT16 wFormatTag)
 
 		case WAVE_FORMAT_WMAUDIO2:
 			return "WAVE_FORMAT_WMAUDIO2";
+
+		case WAVE_FORMAT_OPUS:
+			return "WAVE_FORMAT_OPUS";
 	}
 
 	return "WAVE_FORMAT_UNKNOWN";
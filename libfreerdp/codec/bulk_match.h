@@ -0,0 +1,89 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Bulk Compression Match Helpers
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CODEC_BULK_MATCH_H
+#define FREERDP_CODEC_BULK_MATCH_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/**
+ * The compressors are not built with SIMD flags, only use SSE2 when the
+ * compiler already targets it (always the case on x86_64).
+ */
+#if defined(WITH_SSE2) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define BULK_MATCH_SSE2	1
+#include <emmintrin.h>
+#endif
+
+#include <winpr/crt.h>
+
+#ifdef BULK_MATCH_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/* index of the lowest set bit, Mask must not be zero */
+
+static INLINE UINT32 bulk_match_first_set(UINT32 Mask)
+{
+#ifdef _MSC_VER
+	unsigned long Index;
+	_BitScanForward(&Index, Mask);
+	return (UINT32) Index;
+#else
+	return (UINT32) __builtin_ctz(Mask);
+#endif
+}
+#endif
+
+/**
+ * Number of leading bytes that are equal in Ptr1 and Ptr2, at most MaxLength.
+ * Only the first MaxLength bytes of each buffer are read. The buffers may
+ * overlap as long as neither of them is written during the call.
+ */
+
+static INLINE UINT32 bulk_match_length(const BYTE* Ptr1, const BYTE* Ptr2, UINT32 MaxLength)
+{
+	UINT32 Length = 0;
+
+#ifdef BULK_MATCH_SSE2
+	UINT32 Mask;
+	__m128i xmm1;
+	__m128i xmm2;
+
+	while ((Length + 16) <= MaxLength)
+	{
+		xmm1 = _mm_loadu_si128((const __m128i*) &Ptr1[Length]);
+		xmm2 = _mm_loadu_si128((const __m128i*) &Ptr2[Length]);
+		Mask = ~((UINT32) _mm_movemask_epi8(_mm_cmpeq_epi8(xmm1, xmm2))) & 0xFFFF;
+
+		if (Mask)
+			return Length + bulk_match_first_set(Mask);
+
+		Length += 16;
+	}
+#endif
+
+	while ((Length < MaxLength) && (Ptr1[Length] == Ptr2[Length]))
+		Length++;
+
+	return Length;
+}
+
+#endif /* FREERDP_CODEC_BULK_MATCH_H */
@@ -31,65 +31,14 @@
 
 #include <freerdp/codec/dsp.h>
 
+#include "dsp_codec.h"
+#include "dsp_resample.h"
+
 /**
  * Microsoft Multimedia Standards Update
  * http://download.microsoft.com/download/9/8/6/9863C72A-A3AA-4DDB-B1BA-CA8D17EFD2D4/RIFFNEW.pdf
  */
 
-static BOOL freerdp_dsp_resample(FREERDP_DSP_CONTEXT* context,
-	const BYTE* src, int bytes_per_sample,
-	UINT32 schan, UINT32 srate, int sframes,
-	UINT32 rchan, UINT32 rrate)
-{
-	BYTE* dst;
-	BYTE* p;
-	int rframes;
-	int rsize;
-	int i, j;
-	int n1, n2;
-	int sbytes, rbytes;
-
-	sbytes = bytes_per_sample * schan;
-	rbytes = bytes_per_sample * rchan;
-	rframes = sframes * rrate / srate;
-	rsize = rbytes * rframes;
-
-	if (rsize > (int) context->resampled_maxlength)
-	{
-		BYTE *newBuffer = (BYTE*) realloc(context->resampled_buffer, rsize + 1024);
-		if (!newBuffer)
-			return FALSE;
-
-		context->resampled_maxlength = rsize + 1024;
-		context->resampled_buffer = newBuffer;
-	}
-	dst = context->resampled_buffer;
-
-	p = dst;
-
-	for (i = 0; i < rframes; i++)
-	{
-		n1 = i * srate / rrate;
-
-		if (n1 >= sframes)
-			n1 = sframes - 1;
-
-		n2 = (n1 * rrate == i * srate || n1 == sframes - 1 ? n1 : n1 + 1);
-
-		for (j = 0; j < rbytes; j++)
-		{
-			/* Nearest Interpolation, probably the easiest, but works */
-			*p++ = (i * srate - n1 * rrate > n2 * rrate - i * srate ?
-				src[n2 * sbytes + (j % sbytes)] :
-				src[n1 * sbytes + (j % sbytes)]);
-		}
-	}
-
-	context->resampled_frames = rframes;
-	context->resampled_size = rsize;
-	return TRUE;
-}
-
 /**
  * Microsoft IMA ADPCM specification:
  *
@@ -673,6 +622,235 @@ static BOOL freerdp_dsp_encode_ms_adpcm(FREERDP_DSP_CONTEXT* context,
 	return TRUE;
 }
 
+/**
+ * ADPCM blocks start with a header of the predictor state per channel,
+ * IMA ADPCM codes two samples per byte after it, MS ADPCM also has the
+ * first two samples of each channel in the header.
+ */
+
+static BOOL freerdp_dsp_adpcm_supported(const AUDIO_FORMAT* format, BOOL encode)
+{
+	UINT32 header;
+
+	if ((format->nChannels < 1) || (format->nChannels > 2) || (format->wBitsPerSample != 4))
+		return FALSE;
+
+	header = (format->wFormatTag == WAVE_FORMAT_ADPCM) ? 7 : 4;
+
+	/* stereo IMA ADPCM interleaves the channels in groups of four bytes */
+	if ((format->wFormatTag == WAVE_FORMAT_DVI_ADPCM) && (format->nChannels > 1) &&
+			(format->nBlockAlign % 8))
+		return FALSE;
+
+	return (format->nSamplesPerSec > 0) && (format->nBlockAlign > header * format->nChannels);
+}
+
+static UINT32 freerdp_dsp_adpcm_block_frames(const AUDIO_FORMAT* format)
+{
+	if (format->wFormatTag == WAVE_FORMAT_ADPCM)
+		return (format->nBlockAlign - 7 * format->nChannels) * 2 / format->nChannels + 2;
+
+	return (format->nBlockAlign - 4 * format->nChannels) * 2 / format->nChannels;
+}
+
+static BOOL freerdp_dsp_adpcm_open(FREERDP_DSP_CONTEXT* context, const AUDIO_FORMAT* format,
+	BOOL encode, void** state)
+{
+	freerdp_dsp_context_reset_adpcm(context);
+	*state = NULL;
+	return TRUE;
+}
+
+static void freerdp_dsp_adpcm_close(void* state)
+{
+}
+
+static BOOL freerdp_dsp_adpcm_encode(FREERDP_DSP_CONTEXT* context, void* state,
+	const AUDIO_FORMAT* format, const BYTE* data, UINT32 length, wStream* out)
+{
+	BOOL status;
+
+	if (format->wFormatTag == WAVE_FORMAT_ADPCM)
+		status = context->encode_ms_adpcm(context, data, length, format->nChannels, format->nBlockAlign);
+	else
+		status = context->encode_ima_adpcm(context, data, length, format->nChannels, format->nBlockAlign);
+
+	if (!status)
+		return FALSE;
+
+	Stream_EnsureRemainingCapacity(out, context->adpcm_size);
+	Stream_Write(out, context->adpcm_buffer, context->adpcm_size);
+	return TRUE;
+}
+
+static BOOL freerdp_dsp_adpcm_decode(FREERDP_DSP_CONTEXT* context, void* state,
+	const AUDIO_FORMAT* format, const BYTE* data, UINT32 length, wStream* out)
+{
+	BOOL status;
+
+	if (format->wFormatTag == WAVE_FORMAT_ADPCM)
+		status = context->decode_ms_adpcm(context, data, length, format->nChannels, format->nBlockAlign);
+	else
+		status = context->decode_ima_adpcm(context, data, length, format->nChannels, format->nBlockAlign);
+
+	if (!status)
+		return FALSE;
+
+	Stream_EnsureRemainingCapacity(out, context->adpcm_size);
+	Stream_Write(out, context->adpcm_buffer, context->adpcm_size);
+	return TRUE;
+}
+
+static const FREERDP_DSP_CODEC freerdp_dsp_ima_adpcm_codec =
+{
+	WAVE_FORMAT_DVI_ADPCM,
+	freerdp_dsp_adpcm_supported,
+	freerdp_dsp_adpcm_block_frames,
+	freerdp_dsp_adpcm_open,
+	freerdp_dsp_adpcm_close,
+	freerdp_dsp_adpcm_encode,
+	freerdp_dsp_adpcm_decode
+};
+
+static const FREERDP_DSP_CODEC freerdp_dsp_ms_adpcm_codec =
+{
+	WAVE_FORMAT_ADPCM,
+	freerdp_dsp_adpcm_supported,
+	freerdp_dsp_adpcm_block_frames,
+	freerdp_dsp_adpcm_open,
+	freerdp_dsp_adpcm_close,
+	freerdp_dsp_adpcm_encode,
+	freerdp_dsp_adpcm_decode
+};
+
+static const FREERDP_DSP_CODEC* freerdp_dsp_codecs[] =
+{
+#ifdef WITH_OPUS
+	&freerdp_dsp_opus_codec,
+#endif
+	&freerdp_dsp_ima_adpcm_codec,
+	&freerdp_dsp_ms_adpcm_codec
+};
+
+static const FREERDP_DSP_CODEC* freerdp_dsp_find_codec(const AUDIO_FORMAT* format, BOOL encode)
+{
+	UINT32 index;
+	const FREERDP_DSP_CODEC* codec;
+
+	for (index = 0; index < ARRAYSIZE(freerdp_dsp_codecs); index++)
+	{
+		codec = freerdp_dsp_codecs[index];
+
+		if (codec->wFormatTag == format->wFormatTag)
+			return codec->supported(format, encode) ? codec : NULL;
+	}
+
+	return NULL;
+}
+
+BOOL freerdp_dsp_supports_format(const AUDIO_FORMAT* format, BOOL encode)
+{
+	return freerdp_dsp_find_codec(format, encode) != NULL;
+}
+
+UINT32 freerdp_dsp_get_block_frames(const AUDIO_FORMAT* format)
+{
+	const FREERDP_DSP_CODEC* codec;
+
+	codec = freerdp_dsp_find_codec(format, FALSE);
+
+	return codec ? codec->block_frames(format) : 0;
+}
+
+/**
+ * The PCM format a compressed format is coded from and decoded to.
+ */
+
+void freerdp_dsp_get_pcm_format(const AUDIO_FORMAT* format, AUDIO_FORMAT* pcm)
+{
+	ZeroMemory(pcm, sizeof(AUDIO_FORMAT));
+
+	pcm->wFormatTag = WAVE_FORMAT_PCM;
+	pcm->nChannels = format->nChannels;
+	pcm->nSamplesPerSec = format->nSamplesPerSec;
+	pcm->wBitsPerSample = 16;
+	pcm->nBlockAlign = pcm->nChannels * 2;
+	pcm->nAvgBytesPerSec = pcm->nSamplesPerSec * pcm->nBlockAlign;
+}
+
+static void freerdp_dsp_codec_close(FREERDP_DSP_CONTEXT* context)
+{
+	if (!context->codec)
+		return;
+
+	if (context->codec->codec)
+		context->codec->codec->close(context->codec->state);
+
+	free(context->codec);
+	context->codec = NULL;
+}
+
+static BOOL freerdp_dsp_codec_open(FREERDP_DSP_CONTEXT* context, const AUDIO_FORMAT* format, BOOL encode)
+{
+	FREERDP_DSP_CODEC_CONTEXT* codec = context->codec;
+
+	if (codec && codec->codec && (codec->encode == encode) &&
+			(codec->format.wFormatTag == format->wFormatTag) &&
+			(codec->format.nChannels == format->nChannels) &&
+			(codec->format.nSamplesPerSec == format->nSamplesPerSec) &&
+			(codec->format.nAvgBytesPerSec == format->nAvgBytesPerSec) &&
+			(codec->format.nBlockAlign == format->nBlockAlign) &&
+			(codec->format.wBitsPerSample == format->wBitsPerSample))
+		return TRUE;
+
+	freerdp_dsp_codec_close(context);
+
+	codec = (FREERDP_DSP_CODEC_CONTEXT*) calloc(1, sizeof(FREERDP_DSP_CODEC_CONTEXT));
+
+	if (!codec)
+		return FALSE;
+
+	codec->codec = freerdp_dsp_find_codec(format, encode);
+
+	if (!codec->codec || !codec->codec->open(context, format, encode, &codec->state))
+	{
+		free(codec);
+		return FALSE;
+	}
+
+	CopyMemory(&codec->format, format, sizeof(AUDIO_FORMAT));
+	codec->format.cbSize = 0;
+	codec->format.data = NULL;
+	codec->encode = encode;
+
+	context->codec = codec;
+	return TRUE;
+}
+
+void freerdp_dsp_context_reset(FREERDP_DSP_CONTEXT* context)
+{
+	freerdp_dsp_codec_close(context);
+	freerdp_dsp_context_reset_adpcm(context);
+}
+
+BOOL freerdp_dsp_encode(FREERDP_DSP_CONTEXT* context, const AUDIO_FORMAT* format,
+	const BYTE* data, UINT32 length, wStream* out)
+{
+	if (!freerdp_dsp_codec_open(context, format, TRUE))
+		return FALSE;
+
+	return context->codec->codec->encode(context, context->codec->state, format, data, length, out);
+}
+
+BOOL freerdp_dsp_decode(FREERDP_DSP_CONTEXT* context, const AUDIO_FORMAT* format,
+	const BYTE* data, UINT32 length, wStream* out)
+{
+	if (!freerdp_dsp_codec_open(context, format, FALSE))
+		return FALSE;
+
+	return context->codec->codec->decode(context, context->codec->state, format, data, length, out);
+}
+
 FREERDP_DSP_CONTEXT* freerdp_dsp_context_new(void)
 {
 	FREERDP_DSP_CONTEXT* context;
@@ -682,6 +860,7 @@ FREERDP_DSP_CONTEXT* freerdp_dsp_context_new(void)
 		return NULL;
 
 	context->resample = freerdp_dsp_resample;
+	context->resample_quality = FREERDP_DSP_RESAMPLE_QUALITY_MEDIUM;
 	context->decode_ima_adpcm = freerdp_dsp_decode_ima_adpcm;
 	context->encode_ima_adpcm = freerdp_dsp_encode_ima_adpcm;
 	context->decode_ms_adpcm = freerdp_dsp_decode_ms_adpcm;
@@ -700,6 +879,9 @@ void freerdp_dsp_context_free(FREERDP_DSP_CONTEXT* context)
 		if (context->adpcm_buffer)
 			free(context->adpcm_buffer);
 
+		freerdp_dsp_resampler_free(context->resampler);
+		freerdp_dsp_codec_close(context);
+
 		free(context);
 	}
 }
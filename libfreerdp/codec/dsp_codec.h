@@ -0,0 +1,58 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - Codec Interface
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DSP_CODEC_H
+#define __DSP_CODEC_H
+
+#include <freerdp/codec/dsp.h>
+
+/**
+ * A compressed format: supported checks the format parameters, open sets
+ * up the state for coding in one direction and close releases it. Encode
+ * and decode append their output to the stream, growing it as needed.
+ */
+
+struct _FREERDP_DSP_CODEC
+{
+	UINT16 wFormatTag;
+
+	BOOL (*supported)(const AUDIO_FORMAT* format, BOOL encode);
+	UINT32 (*block_frames)(const AUDIO_FORMAT* format);
+
+	BOOL (*open)(FREERDP_DSP_CONTEXT* context, const AUDIO_FORMAT* format, BOOL encode, void** state);
+	void (*close)(void* state);
+
+	BOOL (*encode)(FREERDP_DSP_CONTEXT* context, void* state, const AUDIO_FORMAT* format,
+		const BYTE* data, UINT32 length, wStream* out);
+	BOOL (*decode)(FREERDP_DSP_CONTEXT* context, void* state, const AUDIO_FORMAT* format,
+		const BYTE* data, UINT32 length, wStream* out);
+};
+typedef struct _FREERDP_DSP_CODEC FREERDP_DSP_CODEC;
+
+struct _FREERDP_DSP_CODEC_CONTEXT
+{
+	const FREERDP_DSP_CODEC* codec;
+	AUDIO_FORMAT format;
+	BOOL encode;
+	void* state;
+};
+
+#ifdef WITH_OPUS
+extern const FREERDP_DSP_CODEC freerdp_dsp_opus_codec;
+#endif
+
+#endif /* __DSP_CODEC_H */
@@ -0,0 +1,289 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - Opus Codec
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+
+#include <freerdp/log.h>
+
+#include "dsp_codec.h"
+
+#ifdef WITH_OPUS
+
+#include <opus/opus.h>
+
+#define TAG FREERDP_TAG("codec.dsp")
+
+/**
+ * Opus is coded at a constant bit rate, every packet is padded to
+ * nBlockAlign bytes so that packets can be concatenated in a wave and
+ * split again without a length prefix, and the audio time of a wave
+ * follows from its size as for the other block formats.
+ */
+
+#define DSP_OPUS_MAX_PACKET	1275
+
+struct _DSP_OPUS
+{
+	OpusEncoder* encoder;
+	OpusDecoder* decoder;
+
+	UINT32 channels;
+	UINT32 frames;
+	UINT32 packetSize;
+
+	INT16* pending;
+	UINT32 pendingFrames;
+};
+typedef struct _DSP_OPUS DSP_OPUS;
+
+static UINT32 freerdp_dsp_opus_block_frames(const AUDIO_FORMAT* format)
+{
+	if (!format->nAvgBytesPerSec)
+		return 0;
+
+	return (UINT32) (((UINT64) format->nBlockAlign) * format->nSamplesPerSec / format->nAvgBytesPerSec);
+}
+
+static BOOL freerdp_dsp_opus_supported(const AUDIO_FORMAT* format, BOOL encode)
+{
+	UINT32 frames;
+	UINT32 units;
+
+	switch (format->nSamplesPerSec)
+	{
+		case 8000:
+		case 12000:
+		case 16000:
+		case 24000:
+		case 48000:
+			break;
+
+		default:
+			return FALSE;
+	}
+
+	if ((format->nChannels < 1) || (format->nChannels > 2))
+		return FALSE;
+
+	if ((format->nBlockAlign < 8) || (format->nBlockAlign > DSP_OPUS_MAX_PACKET))
+		return FALSE;
+
+	/* 6 to 510 kbit/s */
+	if ((format->nAvgBytesPerSec < 750) || (format->nAvgBytesPerSec > 63750))
+		return FALSE;
+
+	/* the packet must hold a whole frame of 2.5, 5, 10, 20, 40 or 60 ms */
+	frames = freerdp_dsp_opus_block_frames(format);
+
+	if (((UINT64) frames) * format->nAvgBytesPerSec != ((UINT64) format->nBlockAlign) * format->nSamplesPerSec)
+		return FALSE;
+
+	if ((frames * 400) % format->nSamplesPerSec)
+		return FALSE;
+
+	units = frames * 400 / format->nSamplesPerSec;
+
+	return (units == 1) || (units == 2) || (units == 4) || (units == 8) || (units == 16) || (units == 24);
+}
+
+static void freerdp_dsp_opus_close(void* state)
+{
+	DSP_OPUS* opus = (DSP_OPUS*) state;
+
+	if (!opus)
+		return;
+
+	if (opus->encoder)
+		opus_encoder_destroy(opus->encoder);
+
+	if (opus->decoder)
+		opus_decoder_destroy(opus->decoder);
+
+	free(opus->pending);
+	free(opus);
+}
+
+static BOOL freerdp_dsp_opus_open(FREERDP_DSP_CONTEXT* context, const AUDIO_FORMAT* format,
+	BOOL encode, void** state)
+{
+	int error;
+	int application;
+	DSP_OPUS* opus;
+
+	opus = (DSP_OPUS*) calloc(1, sizeof(DSP_OPUS));
+
+	if (!opus)
+		return FALSE;
+
+	opus->channels = format->nChannels;
+	opus->frames = freerdp_dsp_opus_block_frames(format);
+	opus->packetSize = format->nBlockAlign;
+
+	if (encode)
+	{
+		/**
+		 * Mono up to 16 kHz is taken to be speech, which the SILK layer codes best.
+		 * Anything else is coded by CELT alone, which has the lowest delay.
+		 */
+		if ((format->nChannels == 1) && (format->nSamplesPerSec <= 16000))
+			application = OPUS_APPLICATION_VOIP;
+		else
+			application = OPUS_APPLICATION_RESTRICTED_LOWDELAY;
+
+		opus->pending = (INT16*) calloc(opus->frames * opus->channels, sizeof(INT16));
+		opus->encoder = opus_encoder_create(format->nSamplesPerSec, format->nChannels, application, &error);
+
+		if (!opus->pending || !opus->encoder)
+			goto fail;
+
+		if ((opus_encoder_ctl(opus->encoder, OPUS_SET_BITRATE(format->nAvgBytesPerSec * 8)) != OPUS_OK) ||
+				(opus_encoder_ctl(opus->encoder, OPUS_SET_VBR(0)) != OPUS_OK))
+			goto fail;
+	}
+	else
+	{
+		opus->decoder = opus_decoder_create(format->nSamplesPerSec, format->nChannels, &error);
+
+		if (!opus->decoder)
+			goto fail;
+	}
+
+	*state = opus;
+	return TRUE;
+
+fail:
+	WLog_ERR(TAG, "failed to set up the Opus %s for %u Hz, %u channels",
+			encode ? "encoder" : "decoder", format->nSamplesPerSec, format->nChannels);
+	freerdp_dsp_opus_close(opus);
+	return FALSE;
+}
+
+static BOOL freerdp_dsp_opus_encode_frame(DSP_OPUS* opus, const INT16* pcm, wStream* out)
+{
+	int status;
+	BYTE* packet;
+
+	Stream_EnsureRemainingCapacity(out, opus->packetSize);
+	packet = Stream_Pointer(out);
+	status = opus_encode(opus->encoder, pcm, opus->frames, packet, opus->packetSize);
+
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "opus_encode: %s", opus_strerror(status));
+		return FALSE;
+	}
+
+	/* the encoder may come in below the bit rate, packets keep their size */
+	if ((status < (int) opus->packetSize) && (opus_packet_pad(packet, status, opus->packetSize) != OPUS_OK))
+		return FALSE;
+
+	Stream_Seek(out, opus->packetSize);
+	return TRUE;
+}
+
+static BOOL freerdp_dsp_opus_encode(FREERDP_DSP_CONTEXT* context, void* state,
+	const AUDIO_FORMAT* format, const BYTE* data, UINT32 length, wStream* out)
+{
+	UINT32 count;
+	UINT32 frameSize;
+	UINT32 frames;
+	DSP_OPUS* opus = (DSP_OPUS*) state;
+
+	frameSize = opus->channels * 2;
+	frames = length / frameSize;
+
+	while (frames > 0)
+	{
+		/* whole frames are coded in place, only the remainder is copied */
+		if (!opus->pendingFrames && (frames >= opus->frames))
+		{
+			if (!freerdp_dsp_opus_encode_frame(opus, (const INT16*) data, out))
+				return FALSE;
+
+			data += opus->frames * frameSize;
+			frames -= opus->frames;
+			continue;
+		}
+
+		count = opus->frames - opus->pendingFrames;
+
+		if (count > frames)
+			count = frames;
+
+		CopyMemory(&opus->pending[opus->pendingFrames * opus->channels], data, count * frameSize);
+		opus->pendingFrames += count;
+		data += count * frameSize;
+		frames -= count;
+
+		if (opus->pendingFrames == opus->frames)
+		{
+			opus->pendingFrames = 0;
+
+			if (!freerdp_dsp_opus_encode_frame(opus, opus->pending, out))
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL freerdp_dsp_opus_decode(FREERDP_DSP_CONTEXT* context, void* state,
+	const AUDIO_FORMAT* format, const BYTE* data, UINT32 length, wStream* out)
+{
+	int status;
+	UINT32 frameSize;
+	DSP_OPUS* opus = (DSP_OPUS*) state;
+
+	frameSize = opus->channels * 2;
+
+	while (length >= opus->packetSize)
+	{
+		Stream_EnsureRemainingCapacity(out, opus->frames * frameSize);
+
+		status = opus_decode(opus->decoder, data, opus->packetSize,
+				(opus_int16*) Stream_Pointer(out), opus->frames, 0);
+
+		if (status < 0)
+		{
+			WLog_ERR(TAG, "opus_decode: %s", opus_strerror(status));
+			return FALSE;
+		}
+
+		Stream_Seek(out, status * frameSize);
+		data += opus->packetSize;
+		length -= opus->packetSize;
+	}
+
+	return TRUE;
+}
+
+const FREERDP_DSP_CODEC freerdp_dsp_opus_codec =
+{
+	WAVE_FORMAT_OPUS,
+	freerdp_dsp_opus_supported,
+	freerdp_dsp_opus_block_frames,
+	freerdp_dsp_opus_open,
+	freerdp_dsp_opus_close,
+	freerdp_dsp_opus_encode,
+	freerdp_dsp_opus_decode
+};
+
+#endif /* WITH_OPUS */
@@ -0,0 +1,493 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - Resampler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/types.h>
+
+#include "dsp_resample.h"
+#include "dsp_resample_sse2.h"
+#include "dsp_resample_neon.h"
+
+#ifndef DSP_RESAMPLE_INIT_SIMD
+#define DSP_RESAMPLE_INIT_SIMD(_resampler) do { } while (0)
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/**
+ * Nearest neighbour, for sample sizes and rate pairs the filter does not
+ * handle and for plain channel conversion at the same rate.
+ */
+
+static BOOL dsp_resample_nearest(FREERDP_DSP_CONTEXT* context,
+	const BYTE* src, int bytes_per_sample,
+	UINT32 schan, UINT32 srate, int sframes,
+	UINT32 rchan, UINT32 rrate)
+{
+	BYTE* dst;
+	BYTE* p;
+	int rframes;
+	int rsize;
+	int i, j;
+	int n1, n2;
+	int sbytes, rbytes;
+
+	sbytes = bytes_per_sample * schan;
+	rbytes = bytes_per_sample * rchan;
+	rframes = sframes * rrate / srate;
+	rsize = rbytes * rframes;
+
+	if (rsize > (int) context->resampled_maxlength)
+	{
+		BYTE *newBuffer = (BYTE*) realloc(context->resampled_buffer, rsize + 1024);
+		if (!newBuffer)
+			return FALSE;
+
+		context->resampled_maxlength = rsize + 1024;
+		context->resampled_buffer = newBuffer;
+	}
+	dst = context->resampled_buffer;
+
+	p = dst;
+
+	for (i = 0; i < rframes; i++)
+	{
+		n1 = i * srate / rrate;
+
+		if (n1 >= sframes)
+			n1 = sframes - 1;
+
+		n2 = (n1 * rrate == i * srate || n1 == sframes - 1 ? n1 : n1 + 1);
+
+		for (j = 0; j < rbytes; j++)
+		{
+			/* Nearest Interpolation, probably the easiest, but works */
+			*p++ = (i * srate - n1 * rrate > n2 * rrate - i * srate ?
+				src[n2 * sbytes + (j % sbytes)] :
+				src[n1 * sbytes + (j % sbytes)]);
+		}
+	}
+
+	context->resampled_frames = rframes;
+	context->resampled_size = rsize;
+	return TRUE;
+}
+
+static float dsp_resample_dot(const float* pCoefs, const float* pSamples, UINT32 count)
+{
+	UINT32 i;
+	float sum = 0.0f;
+
+	for (i = 0; i < count; i++)
+		sum += pCoefs[i] * pSamples[i];
+
+	return sum;
+}
+
+static double dsp_resample_bessel_i0(double x)
+{
+	int k;
+	double term = 1.0;
+	double sum = 1.0;
+
+	for (k = 1; k < 64; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+
+		if (term < sum * 1e-12)
+			break;
+	}
+
+	return sum;
+}
+
+static UINT32 dsp_resample_gcd(UINT32 a, UINT32 b)
+{
+	UINT32 t;
+
+	while (b)
+	{
+		t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/**
+ * Kaiser windowed sinc, cut off below the lower of both Nyquist frequencies.
+ * The number of taps is given for the lower rate, when downsampling the
+ * filter spans proportionally more input samples.
+ */
+
+static BOOL dsp_resample_init_filter(FREERDP_DSP_RESAMPLER* resampler)
+{
+	UINT32 p, k;
+	UINT32 taps;
+	UINT32 length;
+	double t, x, w;
+	double sum;
+	double beta;
+	double ratio;
+	double cutoff;
+	double attenuation;
+	float* coefs;
+	UINT32 L = resampler->L;
+
+	ratio = (resampler->L < resampler->M) ? ((double) resampler->L / resampler->M) : 1.0;
+
+	switch (resampler->quality)
+	{
+		case FREERDP_DSP_RESAMPLE_QUALITY_LOW:
+			taps = 2;
+			attenuation = 0.0;
+			break;
+
+		case FREERDP_DSP_RESAMPLE_QUALITY_HIGH:
+			taps = 96;
+			attenuation = 96.0;
+			break;
+
+		default:
+			taps = 32;
+			attenuation = 60.0;
+			break;
+	}
+
+	if (taps > 2)
+		taps = (((UINT32) ceil(taps / ratio)) + 3) & ~3;
+
+	coefs = (float*) _aligned_malloc(L * taps * sizeof(float), 16);
+
+	if (!coefs)
+		return FALSE;
+
+	if (taps == 2)
+	{
+		/* linear interpolation between the two newest samples */
+		for (p = 0; p < L; p++)
+		{
+			coefs[p * taps + 0] = 1.0f - ((float) p / L);
+			coefs[p * taps + 1] = (float) p / L;
+		}
+	}
+	else
+	{
+		beta = 0.1102 * (attenuation - 8.7);
+		cutoff = ratio * (0.5 - (attenuation - 8.0) / (2.285 * 2.0 * M_PI * (taps * ratio)) / 2.0);
+		length = taps * L;
+
+		for (p = 0; p < L; p++)
+		{
+			sum = 0.0;
+
+			/* tap k applies to the sample (k * L + p) / L input samples before the output */
+			for (k = 0; k < taps; k++)
+			{
+				t = ((double) (k * L + p) - (length - 1) / 2.0) / L;
+				x = 2.0 * (k * L + p) / (length - 1) - 1.0;
+				w = dsp_resample_bessel_i0(beta * sqrt(1.0 - x * x)) / dsp_resample_bessel_i0(beta);
+
+				if (fabs(t) < 1e-9)
+					x = 2.0 * cutoff;
+				else
+					x = sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+
+				coefs[p * taps + (taps - 1 - k)] = (float) (x * w);
+				sum += x * w;
+			}
+
+			/* unity gain at DC for every phase */
+			for (k = 0; k < taps; k++)
+				coefs[p * taps + k] = (float) (coefs[p * taps + k] / sum);
+		}
+	}
+
+	_aligned_free(resampler->coefs);
+	resampler->coefs = coefs;
+	resampler->taps = taps;
+
+	return TRUE;
+}
+
+static BOOL dsp_resample_reset(FREERDP_DSP_RESAMPLER* resampler, UINT32 quality, int bytes_per_sample,
+		UINT32 schan, UINT32 srate, UINT32 rchan, UINT32 rrate)
+{
+	UINT32 gcd;
+
+	resampler->quality = quality;
+	resampler->bytesPerSample = bytes_per_sample;
+	resampler->schan = schan;
+	resampler->srate = srate;
+	resampler->rchan = rchan;
+	resampler->rrate = rrate;
+
+	/* downmixing averages the source channels before filtering, upmixing duplicates after */
+	resampler->channels = (rchan < schan) ? rchan : schan;
+
+	gcd = dsp_resample_gcd(srate, rrate);
+	resampler->L = rrate / gcd;
+	resampler->M = srate / gcd;
+
+	_aligned_free(resampler->samples);
+	resampler->samples = NULL;
+	resampler->capacity = 0;
+	resampler->taps = 0;
+
+	free(resampler->frame);
+	resampler->frame = (float*) calloc(resampler->channels, sizeof(float));
+
+	if (!resampler->frame)
+		return FALSE;
+
+	if (resampler->L > DSP_RESAMPLE_MAX_PHASES)
+		return TRUE;
+
+	if (!dsp_resample_init_filter(resampler))
+		return FALSE;
+
+	resampler->history = resampler->taps - 1;
+	resampler->position = resampler->history;
+	resampler->phase = 0;
+
+	return TRUE;
+}
+
+static BOOL dsp_resample_ensure_capacity(FREERDP_DSP_RESAMPLER* resampler, UINT32 frames)
+{
+	UINT32 c;
+	UINT32 capacity;
+	float* samples;
+
+	if (resampler->history + frames <= resampler->capacity)
+		return TRUE;
+
+	capacity = resampler->history + frames + 1024;
+	samples = (float*) _aligned_malloc(resampler->channels * capacity * sizeof(float), 16);
+
+	if (!samples)
+		return FALSE;
+
+	for (c = 0; c < resampler->channels; c++)
+	{
+		if (resampler->samples)
+			CopyMemory(&samples[c * capacity], &resampler->samples[c * resampler->capacity],
+					resampler->history * sizeof(float));
+		else
+			ZeroMemory(&samples[c * capacity], resampler->history * sizeof(float));
+	}
+
+	_aligned_free(resampler->samples);
+	resampler->samples = samples;
+	resampler->capacity = capacity;
+
+	return TRUE;
+}
+
+static void dsp_resample_read(FREERDP_DSP_RESAMPLER* resampler, const BYTE* src, UINT32 sframes)
+{
+	UINT32 i, c, s;
+	UINT32 count;
+	float sample;
+	float* dst;
+	UINT32 schan = resampler->schan;
+	UINT32 channels = resampler->channels;
+
+	for (c = 0; c < channels; c++)
+	{
+		dst = &resampler->samples[c * resampler->capacity + resampler->history];
+		count = 0;
+
+		for (s = c; s < schan; s += channels)
+			count++;
+
+		for (i = 0; i < sframes; i++)
+		{
+			sample = 0.0f;
+
+			for (s = c; s < schan; s += channels)
+			{
+				if (resampler->bytesPerSample == 2)
+					sample += (INT16) ((src[(i * schan + s) * 2]) | (src[(i * schan + s) * 2 + 1] << 8));
+				else
+					sample += (src[i * schan + s] - 128) * 256.0f;
+			}
+
+			dst[i] = (count > 1) ? (sample / count) : sample;
+		}
+	}
+}
+
+static INLINE INT16 dsp_resample_clamp(float sample)
+{
+	if (sample >= 32767.0f)
+		return 32767;
+
+	if (sample <= -32768.0f)
+		return -32768;
+
+	return (INT16) lrintf(sample);
+}
+
+BOOL freerdp_dsp_resample(FREERDP_DSP_CONTEXT* context,
+	const BYTE* src, int bytes_per_sample,
+	UINT32 schan, UINT32 srate, int sframes,
+	UINT32 rchan, UINT32 rrate)
+{
+	UINT32 c;
+	UINT32 n, p;
+	UINT32 rsize;
+	UINT32 rframes;
+	UINT32 maxFrames;
+	UINT32 end;
+	INT16 value;
+	BYTE* dst;
+	float* coefs;
+	FREERDP_DSP_RESAMPLER* resampler;
+
+	if ((srate == rrate) || (sframes <= 0) || ((bytes_per_sample != 1) && (bytes_per_sample != 2)))
+		return dsp_resample_nearest(context, src, bytes_per_sample, schan, srate, sframes, rchan, rrate);
+
+	resampler = context->resampler;
+
+	if (!resampler)
+	{
+		resampler = (FREERDP_DSP_RESAMPLER*) calloc(1, sizeof(FREERDP_DSP_RESAMPLER));
+
+		if (!resampler)
+			return FALSE;
+
+		resampler->dot = dsp_resample_dot;
+		DSP_RESAMPLE_INIT_SIMD(resampler);
+
+		context->resampler = resampler;
+	}
+
+	if ((resampler->quality != context->resample_quality) || !resampler->frame ||
+			(resampler->bytesPerSample != (UINT32) bytes_per_sample) ||
+			(resampler->schan != schan) || (resampler->srate != srate) ||
+			(resampler->rchan != rchan) || (resampler->rrate != rrate))
+	{
+		if (!dsp_resample_reset(resampler, context->resample_quality, bytes_per_sample,
+				schan, srate, rchan, rrate))
+		{
+			free(resampler->frame);
+			resampler->frame = NULL;
+			return FALSE;
+		}
+	}
+
+	if (!resampler->taps)
+		return dsp_resample_nearest(context, src, bytes_per_sample, schan, srate, sframes, rchan, rrate);
+
+	if (!dsp_resample_ensure_capacity(resampler, sframes))
+		return FALSE;
+
+	maxFrames = (UINT32) ((((UINT64) sframes) * resampler->L) / resampler->M) + 2;
+	rsize = maxFrames * rchan * bytes_per_sample;
+
+	if (rsize > context->resampled_maxlength)
+	{
+		BYTE* newBuffer = (BYTE*) realloc(context->resampled_buffer, rsize + 1024);
+
+		if (!newBuffer)
+			return FALSE;
+
+		context->resampled_maxlength = rsize + 1024;
+		context->resampled_buffer = newBuffer;
+	}
+
+	dsp_resample_read(resampler, src, sframes);
+
+	n = resampler->position;
+	p = resampler->phase;
+	end = resampler->history + sframes;
+	dst = context->resampled_buffer;
+	rframes = 0;
+
+	while (n < end)
+	{
+		coefs = &resampler->coefs[p * resampler->taps];
+
+		for (c = 0; c < resampler->channels; c++)
+		{
+			resampler->frame[c] = resampler->dot(coefs,
+					&resampler->samples[c * resampler->capacity + n - resampler->history], resampler->taps);
+		}
+
+		for (c = 0; c < rchan; c++)
+		{
+			value = dsp_resample_clamp(resampler->frame[c % resampler->channels]);
+
+			if (bytes_per_sample == 2)
+			{
+				*dst++ = (BYTE) (value & 0xFF);
+				*dst++ = (BYTE) ((value >> 8) & 0xFF);
+			}
+			else
+			{
+				*dst++ = (BYTE) ((value >> 8) + 128);
+			}
+		}
+
+		rframes++;
+
+		p += resampler->M;
+		n += p / resampler->L;
+		p %= resampler->L;
+	}
+
+	/* keep the newest samples as history for the next call */
+	for (c = 0; c < resampler->channels; c++)
+	{
+		MoveMemory(&resampler->samples[c * resampler->capacity],
+				&resampler->samples[c * resampler->capacity + sframes],
+				resampler->history * sizeof(float));
+	}
+
+	resampler->position = n - sframes;
+	resampler->phase = p;
+
+	context->resampled_frames = rframes;
+	context->resampled_size = rframes * rchan * bytes_per_sample;
+
+	return TRUE;
+}
+
+void freerdp_dsp_resampler_free(FREERDP_DSP_RESAMPLER* resampler)
+{
+	if (!resampler)
+		return;
+
+	_aligned_free(resampler->coefs);
+	_aligned_free(resampler->samples);
+	free(resampler->frame);
+	free(resampler);
+}
@@ -0,0 +1,68 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - Resampler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DSP_RESAMPLE_H
+#define __DSP_RESAMPLE_H
+
+#include <freerdp/codec/dsp.h>
+
+/* rate pairs needing more filter phases fall back to nearest neighbour */
+#define DSP_RESAMPLE_MAX_PHASES	1024
+
+typedef float (*pfnDspResampleDot)(const float* pCoefs, const float* pSamples, UINT32 count);
+
+/**
+ * Polyphase resampler: the output rate is L / M times the input rate
+ * (both reduced by their gcd). Phase p of the filter holds the taps for
+ * an output sample p / L input samples past the newest input sample it
+ * covers. Samples are kept planar as floats, each channel is preceded by
+ * the last (taps - 1) samples of the previous call.
+ */
+
+struct _FREERDP_DSP_RESAMPLER
+{
+	UINT32 quality;
+	UINT32 bytesPerSample;
+	UINT32 schan;
+	UINT32 srate;
+	UINT32 rchan;
+	UINT32 rrate;
+	UINT32 channels;
+
+	UINT32 L;
+	UINT32 M;
+	UINT32 taps;
+	float* coefs;
+
+	UINT32 phase;
+	UINT32 position;
+	UINT32 history;
+	UINT32 capacity;
+	float* samples;
+	float* frame;
+
+	pfnDspResampleDot dot;
+};
+
+BOOL freerdp_dsp_resample(FREERDP_DSP_CONTEXT* context,
+	const BYTE* src, int bytes_per_sample,
+	UINT32 schan, UINT32 srate, int sframes,
+	UINT32 rchan, UINT32 rrate);
+
+void freerdp_dsp_resampler_free(FREERDP_DSP_RESAMPLER* resampler);
+
+#endif /* __DSP_RESAMPLE_H */
@@ -0,0 +1,65 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+#include <winpr/sysinfo.h>
+
+#include "dsp_resample_neon.h"
+
+static float dsp_resample_dot_NEON(const float* pCoefs, const float* pSamples, UINT32 count)
+{
+	UINT32 i = 0;
+	float sum;
+	float32x2_t half;
+	float32x4_t acc0 = vdupq_n_f32(0.0f);
+	float32x4_t acc1 = vdupq_n_f32(0.0f);
+
+	for (; i + 8 <= count; i += 8)
+	{
+		acc0 = vmlaq_f32(acc0, vld1q_f32(&pCoefs[i]), vld1q_f32(&pSamples[i]));
+		acc1 = vmlaq_f32(acc1, vld1q_f32(&pCoefs[i + 4]), vld1q_f32(&pSamples[i + 4]));
+	}
+
+	for (; i + 4 <= count; i += 4)
+		acc0 = vmlaq_f32(acc0, vld1q_f32(&pCoefs[i]), vld1q_f32(&pSamples[i]));
+
+	acc0 = vaddq_f32(acc0, acc1);
+	half = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+	half = vpadd_f32(half, half);
+	sum = vget_lane_f32(half, 0);
+
+	for (; i < count; i++)
+		sum += pCoefs[i] * pSamples[i];
+
+	return sum;
+}
+
+void dsp_resample_init_neon(FREERDP_DSP_RESAMPLER* resampler)
+{
+	if (!IsProcessorFeaturePresent(PF_ARM_NEON_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	resampler->dot = dsp_resample_dot_NEON;
+}
+
+#endif /* __ARM_NEON__ */
@@ -0,0 +1,31 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DSP_RESAMPLE_NEON_H
+#define __DSP_RESAMPLE_NEON_H
+
+#include "dsp_resample.h"
+
+void dsp_resample_init_neon(FREERDP_DSP_RESAMPLER* resampler);
+
+#ifndef DSP_RESAMPLE_INIT_SIMD
+ #if defined(WITH_NEON)
+  #define DSP_RESAMPLE_INIT_SIMD(_resampler) dsp_resample_init_neon(_resampler)
+ #endif
+#endif
+
+#endif /* __DSP_RESAMPLE_NEON_H */
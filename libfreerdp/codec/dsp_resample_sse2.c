@@ -0,0 +1,64 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include "dsp_resample_sse2.h"
+
+static float dsp_resample_dot_sse2(const float* pCoefs, const float* pSamples, UINT32 count)
+{
+	UINT32 i = 0;
+	float sum;
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+
+	/* the sample window starts at any sample, rows of the two tap filter are not aligned either */
+
+	for (; i + 8 <= count; i += 8)
+	{
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(&pCoefs[i]), _mm_loadu_ps(&pSamples[i])));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(&pCoefs[i + 4]), _mm_loadu_ps(&pSamples[i + 4])));
+	}
+
+	for (; i + 4 <= count; i += 4)
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(&pCoefs[i]), _mm_loadu_ps(&pSamples[i])));
+
+	acc0 = _mm_add_ps(acc0, acc1);
+	acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+	acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+	sum = _mm_cvtss_f32(acc0);
+
+	for (; i < count; i++)
+		sum += pCoefs[i] * pSamples[i];
+
+	return sum;
+}
+
+void dsp_resample_init_sse2(FREERDP_DSP_RESAMPLER* resampler)
+{
+	if (!IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	resampler->dot = dsp_resample_dot_sse2;
+}
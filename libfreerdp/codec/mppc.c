@@ -29,8 +29,12 @@
 #include <freerdp/log.h>
 #include <freerdp/codec/mppc.h>
 
+#include "bulk_match.h"
+
 #define TAG FREERDP_TAG("codec.mppc")
 
+#define MPPC_SHORT_MATCH_LENGTH	16
+
 #define MPPC_MATCH_INDEX(_sym1, _sym2, _sym3) \
 	((((MPPC_MATCH_TABLE[_sym3] << 16) + (MPPC_MATCH_TABLE[_sym2] << 8) + MPPC_MATCH_TABLE[_sym1]) & 0x07FFF000) >> 12)
 
@@ -445,10 +449,35 @@ int mppc_decompress(MPPC_CONTEXT* mppc, BYTE* pSrcData, UINT32 SrcSize, BYTE** p
 	return 1;
 }
 
+/**
+ * Length of the match between the source at pSrcPtr and the history at
+ * MatchPtr, HistoryPtr being the (not yet written) history position of
+ * pSrcPtr. A match running into HistoryPtr continues over the bytes it
+ * produces, which are the source bytes themselves.
+ */
+
+static INLINE UINT32 mppc_match_length(const BYTE* pSrcPtr, const BYTE* MatchPtr,
+		const BYTE* HistoryPtr, UINT32 MaxLength)
+{
+	UINT32 Length;
+	UINT32 Distance = HistoryPtr - MatchPtr;
+
+	if (MaxLength <= Distance)
+		return bulk_match_length(pSrcPtr, MatchPtr, MaxLength);
+
+	Length = bulk_match_length(pSrcPtr, MatchPtr, Distance);
+
+	if (Length < Distance)
+		return Length;
+
+	return Distance + bulk_match_length(&pSrcPtr[Distance], pSrcPtr, MaxLength - Distance);
+}
+
 int mppc_compress(MPPC_CONTEXT* mppc, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags)
 {
 	BYTE* pSrcPtr;
 	BYTE* pSrcEnd;
+	BYTE* pSrcShortEnd;
 	BYTE* pDstEnd;
 	BYTE* MatchPtr;
 	UINT32 DstSize;
@@ -465,6 +494,8 @@ int mppc_compress(MPPC_CONTEXT* mppc, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppD
 	UINT32 HistoryBufferSize;
 	BYTE Sym1, Sym2, Sym3;
 	UINT32 CompressionLevel;
+	UINT32 Length;
+	UINT32 MaxLength;
 	wBitStream* bs = mppc->bs;
 
 	HistoryBuffer = mppc->HistoryBuffer;
@@ -568,13 +599,47 @@ int mppc_compress(MPPC_CONTEXT* mppc, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppD
 			LengthOfMatch = 3;
 			MatchPtr += 2;
 
-			while ((*pSrcPtr == *MatchPtr) && (pSrcPtr < pSrcEnd) && (MatchPtr <= mppc->HistoryPtr))
+			/* most matches are short, the long ones are extended in blocks */
+
+			if ((pSrcEnd - pSrcPtr) > MPPC_SHORT_MATCH_LENGTH)
+				pSrcShortEnd = &pSrcPtr[MPPC_SHORT_MATCH_LENGTH];
+			else
+				pSrcShortEnd = pSrcEnd;
+
+			while ((*pSrcPtr == *MatchPtr) && (pSrcPtr < pSrcShortEnd) && (MatchPtr <= mppc->HistoryPtr))
 			{
 				MatchPtr++;
 				*HistoryPtr++ = *pSrcPtr++;
 				LengthOfMatch++;
 			}
 
+			if ((pSrcPtr == pSrcShortEnd) && (pSrcPtr < pSrcEnd))
+			{
+				if (MatchPtr < HistoryPtr)
+				{
+					MaxLength = pSrcEnd - pSrcPtr;
+
+					if (MaxLength > (UINT32) (mppc->HistoryPtr - MatchPtr + 1))
+						MaxLength = (UINT32) (mppc->HistoryPtr - MatchPtr + 1);
+
+					Length = mppc_match_length(pSrcPtr, MatchPtr, HistoryPtr, MaxLength);
+					CopyMemory(HistoryPtr, pSrcPtr, Length);
+
+					HistoryPtr += Length;
+					pSrcPtr += Length;
+					LengthOfMatch += Length;
+				}
+				else
+				{
+					while ((*pSrcPtr == *MatchPtr) && (pSrcPtr < pSrcEnd) && (MatchPtr <= mppc->HistoryPtr))
+					{
+						MatchPtr++;
+						*HistoryPtr++ = *pSrcPtr++;
+						LengthOfMatch++;
+					}
+				}
+			}
+
 #ifdef DEBUG_MPPC
 			WLog_DBG(TAG, "<%d,%d>", (int) CopyOffset, (int) LengthOfMatch);
 #endif
@@ -28,8 +28,13 @@
 #include <freerdp/log.h>
 #include <freerdp/codec/ncrush.h>
 
+#include "bulk_match.h"
+
 #define TAG FREERDP_TAG("codec")
 
+#define NCRUSH_MAX_CHAIN_LENGTH		32
+#define NCRUSH_MAX_MATCH_LENGTH		16385 /* 14 extra LOM bits above the base of 2 */
+
 UINT16 HuffTableLEC[8192] =
 {
 	0x510B, 0x611F, 0x610D, 0x9027, 0x6000, 0x7105, 0x6117, 0xA068, 0x5111, 0x7007, 0x6113, 0x90C0, 0x6108, 0x8018, 0x611B, 0xA0B3,
@@ -2060,20 +2065,67 @@ int ncrush_hash_table_add(NCRUSH_CONTEXT* ncrush, BYTE* pSrcData, UINT32 SrcSize
 
 int ncrush_find_match_length(BYTE* Ptr1, BYTE* Ptr2, BYTE* HistoryPtr)
 {
-	BYTE val1, val2;
-	BYTE* Ptr = Ptr1;
+	if (Ptr1 > HistoryPtr)
+		return -1;
+
+	return (int) bulk_match_length(Ptr1, Ptr2, HistoryPtr - Ptr1);
+}
+
+/**
+ * Walks the match chain of HistoryOffset for at most MaxChainLength candidates
+ * and returns the longest match, or 0 when there is none. The chain links to
+ * strictly lower offsets, offset 0 terminates it.
+ */
+
+static int ncrush_find_longest_match(NCRUSH_CONTEXT* ncrush, UINT16 HistoryOffset,
+		UINT32 MaxChainLength, UINT32* pMatchOffset)
+{
+	UINT32 Chain;
+	UINT32 Length;
+	UINT32 MaxLength;
+	UINT32 MatchLength = 0;
+	UINT16 Offset;
+	UINT16 MatchOffset = 0;
+	BYTE* HistoryPtr;
+	BYTE* HistoryBuffer;
+
+	HistoryBuffer = ncrush->HistoryBuffer;
+	HistoryPtr = &HistoryBuffer[HistoryOffset];
 
-	do
+	MaxLength = ncrush->HistoryPtr - HistoryPtr;
+
+	if (MaxLength > NCRUSH_MAX_MATCH_LENGTH)
+		MaxLength = NCRUSH_MAX_MATCH_LENGTH;
+
+	Offset = ncrush->MatchTable[HistoryOffset];
+
+	for (Chain = 0; Offset && (Offset < HistoryOffset) && (Chain < MaxChainLength); Chain++)
 	{
-		if (Ptr1 > HistoryPtr)
-			break;
+		/* a candidate can only be longer if it also matches at the current length */
 
-		val1 = *Ptr1++;
-		val2 = *Ptr2++;
+		if ((MatchLength < MaxLength) && (HistoryBuffer[Offset + MatchLength] == HistoryPtr[MatchLength]))
+		{
+			Length = bulk_match_length(HistoryPtr, &HistoryBuffer[Offset], MaxLength);
+
+			if (Length > MatchLength)
+			{
+				MatchLength = Length;
+				MatchOffset = Offset;
+
+				if (MatchLength >= MaxLength)
+					break;
+			}
+		}
+
+		Offset = ncrush->MatchTable[Offset];
 	}
-	while (val1 == val2);
 
-	return Ptr1 - (Ptr + 1);
+	if (MatchLength < 2)
+		return 0;
+
+	*pMatchOffset = MatchOffset;
+
+	return (int) MatchLength;
 }
 
 int ncrush_find_best_match(NCRUSH_CONTEXT* ncrush, UINT16 HistoryOffset, UINT32* pMatchOffset)
@@ -2347,7 +2399,13 @@ int ncrush_compress(NCRUSH_CONTEXT* ncrush, BYTE* pSrcData, UINT32 SrcSize, BYTE
 		if (ncrush->MatchTable[HistoryOffset])
 		{
 			MatchOffset = 0;
-			MatchLength = ncrush_find_best_match(ncrush, HistoryOffset, &MatchOffset);
+
+			if (ncrush->CompressionEffort == BULK_COMPRESSION_EFFORT_FAST)
+				MatchLength = ncrush_find_longest_match(ncrush, HistoryOffset, 1, &MatchOffset);
+			else if (ncrush->CompressionEffort >= BULK_COMPRESSION_EFFORT_HIGH)
+				MatchLength = ncrush_find_longest_match(ncrush, HistoryOffset, NCRUSH_MAX_CHAIN_LENGTH, &MatchOffset);
+			else
+				MatchLength = ncrush_find_best_match(ncrush, HistoryOffset, &MatchOffset);
 
 			if (MatchLength == -1)
 				return -1005;
@@ -2660,6 +2718,20 @@ int ncrush_generate_tables(NCRUSH_CONTEXT *context)
 	return 1;
 }
 
+/**
+ * FAST only considers the most recent position sharing the first two bytes,
+ * DEFAULT keeps the historical search (which ignores matches longer than 16
+ * bytes) and HIGH walks the match chain for the longest match.
+ */
+
+void ncrush_set_compression_effort(NCRUSH_CONTEXT* ncrush, DWORD CompressionEffort)
+{
+	if (CompressionEffort > BULK_COMPRESSION_EFFORT_HIGH)
+		CompressionEffort = BULK_COMPRESSION_EFFORT_HIGH;
+
+	ncrush->CompressionEffort = CompressionEffort;
+}
+
 void ncrush_context_reset(NCRUSH_CONTEXT* ncrush, BOOL flush)
 {
 	ZeroMemory(&(ncrush->HistoryBuffer), sizeof(ncrush->HistoryBuffer));
@@ -2685,6 +2757,7 @@ NCRUSH_CONTEXT* ncrush_context_new(BOOL Compressor)
 	if (ncrush)
 	{
 		ncrush->Compressor = Compressor;
+		ncrush->CompressionEffort = BULK_COMPRESSION_EFFORT_DEFAULT;
 
 		ZeroMemory(&(ncrush->OffsetCache), sizeof(ncrush->OffsetCache));
 
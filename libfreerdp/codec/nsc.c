@@ -31,6 +31,9 @@
 #endif
 
 #include <winpr/crt.h>
+#include <winpr/tchar.h>
+#include <winpr/sysinfo.h>
+#include <winpr/registry.h>
 
 #include <freerdp/codec/nsc.h>
 
@@ -43,10 +46,10 @@
 #define NSC_INIT_SIMD(_nsc_context) do { } while (0)
 #endif
 
-static void nsc_decode(NSC_CONTEXT* context)
+static void nsc_decode_band(NSC_CONTEXT* context, UINT32 yStart, UINT32 yEnd)
 {
 	UINT16 x;
-	UINT16 y;
+	UINT32 y;
 	UINT16 rw;
 	BYTE shift;
 	BYTE* yplane;
@@ -61,14 +64,11 @@ static void nsc_decode(NSC_CONTEXT* context)
 	INT16 b_val;
 	BYTE* bmpdata;
 
-	bmpdata = context->BitmapData;
+	bmpdata = context->BitmapData + yStart * context->width * 4;
 	rw = ROUND_UP_TO(context->width, 8);
 	shift = context->ColorLossLevel - 1; /* colorloss recovery + YCoCg shift */
 
-	WLog_Print(context->priv->log, WLOG_DEBUG, "NscDecode: width: %d height: %d ChromaSubsamplingLevel: %d",
-			context->width, context->height, context->ChromaSubsamplingLevel);
-
-	for (y = 0; y < context->height; y++)
+	for (y = yStart; y < yEnd; y++)
 	{
 		if (context->ChromaSubsamplingLevel)
 		{
@@ -105,6 +105,25 @@ static void nsc_decode(NSC_CONTEXT* context)
 	}
 }
 
+static void nsc_decode_band_job(NSC_CONTEXT* context, UINT32 index, void* param)
+{
+	UINT32 yStart;
+	UINT32 yEnd;
+
+	yStart = index * NSC_BAND_HEIGHT;
+	yEnd = MIN(yStart + NSC_BAND_HEIGHT, context->height);
+
+	context->priv->decode_band(context, yStart, yEnd);
+}
+
+static void nsc_decode(NSC_CONTEXT* context)
+{
+	WLog_Print(context->priv->log, WLOG_DEBUG, "NscDecode: width: %d height: %d ChromaSubsamplingLevel: %d",
+			context->width, context->height, context->ChromaSubsamplingLevel);
+
+	nsc_run_jobs(context, NSC_BAND_COUNT(context->height), nsc_decode_band_job, NULL);
+}
+
 static void nsc_rle_decode(BYTE* in, BYTE* out, UINT32 originalSize)
 {
 	UINT32 len;
@@ -152,29 +171,120 @@ static void nsc_rle_decode(BYTE* in, BYTE* out, UINT32 originalSize)
 	*((UINT32*)out) = *((UINT32*)in);
 }
 
-static void nsc_rle_decompress_data(NSC_CONTEXT* context)
+static void nsc_rle_decompress_plane(NSC_CONTEXT* context, UINT32 index, void* param)
 {
-	UINT16 i;
+	UINT32 i;
 	BYTE* rle;
 	UINT32 planeSize;
 	UINT32 originalSize;
 
 	rle = context->Planes;
 
-	for (i = 0; i < 4; i++)
+	for (i = 0; i < index; i++)
+		rle += context->PlaneByteCount[i];
+
+	originalSize = context->OrgByteCount[index];
+	planeSize = context->PlaneByteCount[index];
+
+	if (planeSize == 0)
+		FillMemory(context->priv->PlaneBuffers[index], originalSize, 0xFF);
+	else if (planeSize < originalSize)
+		nsc_rle_decode(rle, context->priv->PlaneBuffers[index], originalSize);
+	else
+		CopyMemory(context->priv->PlaneBuffers[index], rle, originalSize);
+}
+
+static void nsc_rle_decompress_data(NSC_CONTEXT* context)
+{
+	/* the planes are stored one after the other and decode independently */
+	nsc_run_jobs(context, 4, nsc_rle_decompress_plane, NULL);
+}
+
+static void CALLBACK nsc_job_work_callback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
+{
+	NSC_JOB_PARAM* param = (NSC_JOB_PARAM*) context;
+
+	param->job(param->context, param->index, param->param);
+}
+
+static BOOL nsc_setup_workers(NSC_CONTEXT* context, UINT32 count)
+{
+	UINT32 index;
+	PTP_WORK* workObjects;
+	NSC_JOB_PARAM* jobParams;
+	NSC_CONTEXT_PRIV* priv = context->priv;
+
+	if (count <= priv->numWorkObjects)
+		return TRUE;
+
+	/* work objects are kept across calls, they point into jobParams */
+
+	for (index = 0; index < priv->numWorkObjects; index++)
+		CloseThreadpoolWork(priv->workObjects[index]);
+
+	priv->numWorkObjects = 0;
+
+	workObjects = (PTP_WORK*) realloc(priv->workObjects, sizeof(PTP_WORK) * count);
+
+	if (!workObjects)
+		return FALSE;
+
+	priv->workObjects = workObjects;
+
+	jobParams = (NSC_JOB_PARAM*) realloc(priv->jobParams, sizeof(NSC_JOB_PARAM) * count);
+
+	if (!jobParams)
+		return FALSE;
+
+	priv->jobParams = jobParams;
+
+	for (index = 0; index < count; index++)
 	{
-		originalSize = context->OrgByteCount[i];
-		planeSize = context->PlaneByteCount[i];
+		priv->jobParams[index].context = context;
 
-		if (planeSize == 0)
-			FillMemory(context->priv->PlaneBuffers[i], originalSize, 0xFF);
-		else if (planeSize < originalSize)
-			nsc_rle_decode(rle, context->priv->PlaneBuffers[i], originalSize);
-		else
-			CopyMemory(context->priv->PlaneBuffers[i], rle, originalSize);
+		priv->workObjects[index] = CreateThreadpoolWork((PTP_WORK_CALLBACK) nsc_job_work_callback,
+				(void*) &priv->jobParams[index], &priv->ThreadPoolEnv);
+
+		if (!priv->workObjects[index])
+			return FALSE;
 
-		rle += planeSize;
+		priv->numWorkObjects++;
 	}
+
+	return TRUE;
+}
+
+/**
+ * Runs job(context, index, param) for every index in [0, count) and returns when all of them are done.
+ * The jobs are spread over the thread pool, the calling thread runs the first one itself.
+ */
+void nsc_run_jobs(NSC_CONTEXT* context, UINT32 count, pfnNscJob job, void* param)
+{
+	UINT32 index;
+	NSC_CONTEXT_PRIV* priv = context->priv;
+
+	if (!priv->UseThreads || (count < 2) ||
+			((UINT32) context->width * context->height < NSC_THREADING_THRESHOLD) ||
+			!nsc_setup_workers(context, count - 1))
+	{
+		for (index = 0; index < count; index++)
+			job(context, index, param);
+
+		return;
+	}
+
+	for (index = 1; index < count; index++)
+	{
+		priv->jobParams[index - 1].job = job;
+		priv->jobParams[index - 1].index = index;
+		priv->jobParams[index - 1].param = param;
+		SubmitThreadpoolWork(priv->workObjects[index - 1]);
+	}
+
+	job(context, 0, param);
+
+	for (index = 1; index < count; index++)
+		WaitForThreadpoolWorkCallbacks(priv->workObjects[index - 1], FALSE);
 }
 
 static void nsc_stream_initialize(NSC_CONTEXT* context, wStream* s)
@@ -260,6 +370,12 @@ int nsc_context_reset(NSC_CONTEXT* context)
 NSC_CONTEXT* nsc_context_new(void)
 {
 	UINT8 i;
+	HKEY hKey;
+	LONG status;
+	DWORD dwType;
+	DWORD dwSize;
+	DWORD dwValue;
+	SYSTEM_INFO sysinfo;
 	NSC_CONTEXT* context;
 
 	context = (NSC_CONTEXT*) calloc(1, sizeof(NSC_CONTEXT));
@@ -280,8 +396,70 @@ NSC_CONTEXT* nsc_context_new(void)
 	context->decode = nsc_decode;
 	context->encode = nsc_encode;
 
+	context->priv->encode_argb_to_aycocg = nsc_encode_argb_to_aycocg;
+	context->priv->encode_subsampling = nsc_encode_subsampling;
+	context->priv->decode_band = nsc_decode_band;
+
 	context->priv->PlanePool = BufferPool_New(TRUE, 0, 16);
 
+#ifdef _WIN32
+	{
+		OSVERSIONINFOA verinfo;
+
+		ZeroMemory(&verinfo, sizeof(OSVERSIONINFOA));
+		verinfo.dwOSVersionInfoSize = sizeof(OSVERSIONINFOA);
+
+		GetVersionExA(&verinfo);
+		context->priv->UseThreads = (verinfo.dwMajorVersion >= 6) ? TRUE : FALSE;
+	}
+#else
+	context->priv->UseThreads = TRUE;
+#endif
+
+	GetNativeSystemInfo(&sysinfo);
+
+	context->priv->MinThreadCount = sysinfo.dwNumberOfProcessors;
+	context->priv->MaxThreadCount = 0;
+
+	status = RegOpenKeyEx(HKEY_LOCAL_MACHINE, _T("Software\\FreeRDP\\NSCodec"), 0, KEY_READ | KEY_WOW64_64KEY, &hKey);
+
+	if (status == ERROR_SUCCESS)
+	{
+		dwSize = sizeof(dwValue);
+
+		if (RegQueryValueEx(hKey, _T("UseThreads"), NULL, &dwType, (BYTE*) &dwValue, &dwSize) == ERROR_SUCCESS)
+			context->priv->UseThreads = dwValue ? 1 : 0;
+
+		if (RegQueryValueEx(hKey, _T("MinThreadCount"), NULL, &dwType, (BYTE*) &dwValue, &dwSize) == ERROR_SUCCESS)
+			context->priv->MinThreadCount = dwValue;
+
+		if (RegQueryValueEx(hKey, _T("MaxThreadCount"), NULL, &dwType, (BYTE*) &dwValue, &dwSize) == ERROR_SUCCESS)
+			context->priv->MaxThreadCount = dwValue;
+
+		RegCloseKey(hKey);
+	}
+
+	if (context->priv->UseThreads)
+	{
+		context->priv->ThreadPool = CreateThreadpool(NULL);
+
+		if (context->priv->ThreadPool)
+		{
+			InitializeThreadpoolEnvironment(&context->priv->ThreadPoolEnv);
+			SetThreadpoolCallbackPool(&context->priv->ThreadPoolEnv, context->priv->ThreadPool);
+
+			if (context->priv->MinThreadCount)
+				SetThreadpoolThreadMinimum(context->priv->ThreadPool, context->priv->MinThreadCount);
+
+			if (context->priv->MaxThreadCount)
+				SetThreadpoolThreadMaximum(context->priv->ThreadPool, context->priv->MaxThreadCount);
+		}
+		else
+		{
+			context->priv->UseThreads = FALSE;
+		}
+	}
+
 	PROFILER_CREATE(context->priv->prof_nsc_rle_decompress_data, "nsc_rle_decompress_data");
 	PROFILER_CREATE(context->priv->prof_nsc_decode, "nsc_decode");
 	PROFILER_CREATE(context->priv->prof_nsc_rle_compress_data, "nsc_rle_compress_data");
@@ -299,9 +477,22 @@ NSC_CONTEXT* nsc_context_new(void)
 
 void nsc_context_free(NSC_CONTEXT* context)
 {
-	int i;
+	UINT32 i;
 
-	for (i = 0; i < 4; i++)
+	if (context->priv->ThreadPool)
+	{
+		for (i = 0; i < context->priv->numWorkObjects; i++)
+			CloseThreadpoolWork(context->priv->workObjects[i]);
+
+		CloseThreadpool(context->priv->ThreadPool);
+		DestroyThreadpoolEnvironment(&context->priv->ThreadPoolEnv);
+	}
+
+	free(context->priv->workObjects);
+	free(context->priv->jobParams);
+	free(context->priv->RleBuffer);
+
+	for (i = 0; i < 5; i++)
 	{
 		if (context->priv->PlaneBuffers[i])
 		{
@@ -360,6 +551,22 @@ void nsc_context_set_pixel_format(NSC_CONTEXT* context, RDP_PIXEL_FORMAT pixel_f
 	}
 }
 
+/* the generic kernels produce the same output, the optimized ones can be turned off to compare */
+void nsc_context_set_simd(NSC_CONTEXT* context, BOOL enabled)
+{
+	context->priv->encode_argb_to_aycocg = nsc_encode_argb_to_aycocg;
+	context->priv->encode_subsampling = nsc_encode_subsampling;
+	context->priv->decode_band = nsc_decode_band;
+
+	if (enabled)
+		NSC_INIT_SIMD(context);
+}
+
+void nsc_context_set_threading(NSC_CONTEXT* context, BOOL enabled)
+{
+	context->priv->UseThreads = (enabled && context->priv->ThreadPool) ? TRUE : FALSE;
+}
+
 int nsc_process_message(NSC_CONTEXT* context, UINT16 bpp, UINT16 width, UINT16 height, BYTE* data, UINT32 length)
 {
 	wStream* s;
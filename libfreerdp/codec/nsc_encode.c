@@ -73,13 +73,14 @@ static void nsc_context_initialize_encode(NSC_CONTEXT* context)
 	}
 }
 
-static void nsc_encode_argb_to_aycocg(NSC_CONTEXT* context, BYTE* data, int scanline)
+/**
+ * Converts the pixels of row y starting at column x, src points to the source pixel of column x.
+ * For RDP_PIXEL_FORMAT_P4_PLANER x must be a multiple of 8.
+ */
+void nsc_encode_argb_to_aycocg_row(NSC_CONTEXT* context, BYTE* src, UINT32 y, UINT32 x)
 {
-	UINT16 x;
-	UINT16 y;
 	UINT16 rw;
 	BYTE ccl;
-	BYTE* src;
 	BYTE* yplane;
 	BYTE* coplane;
 	BYTE* cgplane;
@@ -89,138 +90,139 @@ static void nsc_encode_argb_to_aycocg(NSC_CONTEXT* context, BYTE* data, int scan
 	INT16 b_val;
 	BYTE a_val;
 	UINT32 tempWidth;
-	UINT32 tempHeight;
 
 	tempWidth = ROUND_UP_TO(context->width, 8);
-	tempHeight = ROUND_UP_TO(context->height, 2);
 	rw = (context->ChromaSubsamplingLevel ? tempWidth : context->width);
 	ccl = context->ColorLossLevel;
-	yplane = context->priv->PlaneBuffers[0];
-	coplane = context->priv->PlaneBuffers[1];
-	cgplane = context->priv->PlaneBuffers[2];
-	aplane = context->priv->PlaneBuffers[3];
+	yplane = context->priv->PlaneBuffers[0] + y * rw + x;
+	coplane = context->priv->PlaneBuffers[1] + y * rw + x;
+	cgplane = context->priv->PlaneBuffers[2] + y * rw + x;
+	aplane = context->priv->PlaneBuffers[3] + y * context->width + x;
 
-	for (y = 0; y < context->height; y++)
+	for (; x < context->width; x++)
 	{
-		src = data + (context->height - 1 - y) * scanline;
-		yplane = context->priv->PlaneBuffers[0] + y * rw;
-		coplane = context->priv->PlaneBuffers[1] + y * rw;
-		cgplane = context->priv->PlaneBuffers[2] + y * rw;
-		aplane = context->priv->PlaneBuffers[3] + y * context->width;
-
-		for (x = 0; x < context->width; x++)
+		switch (context->pixel_format)
 		{
-			switch (context->pixel_format)
-			{
-				case RDP_PIXEL_FORMAT_B8G8R8A8:
-					b_val = *src++;
-					g_val = *src++;
-					r_val = *src++;
-					a_val = *src++;
-					break;
-
-				case RDP_PIXEL_FORMAT_R8G8B8A8:
-					r_val = *src++;
-					g_val = *src++;
-					b_val = *src++;
-					a_val = *src++;
-					break;
-
-				case RDP_PIXEL_FORMAT_B8G8R8:
-					b_val = *src++;
-					g_val = *src++;
-					r_val = *src++;
-					a_val = 0xFF;
-					break;
-
-				case RDP_PIXEL_FORMAT_R8G8B8:
-					r_val = *src++;
-					g_val = *src++;
-					b_val = *src++;
-					a_val = 0xFF;
-					break;
-
-				case RDP_PIXEL_FORMAT_B5G6R5_LE:
-					b_val = (INT16) (((*(src + 1)) & 0xF8) | ((*(src + 1)) >> 5));
-					g_val = (INT16) ((((*(src + 1)) & 0x07) << 5) | (((*src) & 0xE0) >> 3));
-					r_val = (INT16) ((((*src) & 0x1F) << 3) | (((*src) >> 2) & 0x07));
-					a_val = 0xFF;
-					src += 2;
-					break;
-
-				case RDP_PIXEL_FORMAT_R5G6B5_LE:
-					r_val = (INT16) (((*(src + 1)) & 0xF8) | ((*(src + 1)) >> 5));
-					g_val = (INT16) ((((*(src + 1)) & 0x07) << 5) | (((*src) & 0xE0) >> 3));
-					b_val = (INT16) ((((*src) & 0x1F) << 3) | (((*src) >> 2) & 0x07));
-					a_val = 0xFF;
-					src += 2;
-					break;
-
-				case RDP_PIXEL_FORMAT_P4_PLANER:
-					{
-						int shift;
-						BYTE idx;
-
-						shift = (7 - (x % 8));
-						idx = ((*src) >> shift) & 1;
-						idx |= (((*(src + 1)) >> shift) & 1) << 1;
-						idx |= (((*(src + 2)) >> shift) & 1) << 2;
-						idx |= (((*(src + 3)) >> shift) & 1) << 3;
-						idx *= 3;
-						r_val = (INT16) context->palette[idx];
-						g_val = (INT16) context->palette[idx + 1];
-						b_val = (INT16) context->palette[idx + 2];
-						if (shift == 0)
-							src += 4;
-					}
-					a_val = 0xFF;
-					break;
-
-				case RDP_PIXEL_FORMAT_P8:
-					{
-						int idx = (*src) * 3;
-
-						r_val = (INT16) context->palette[idx];
-						g_val = (INT16) context->palette[idx + 1];
-						b_val = (INT16) context->palette[idx + 2];
-						src++;
-					}
-					a_val = 0xFF;
-					break;
-
-				default:
-					r_val = g_val = b_val = a_val = 0;
-					break;
-			}
-
-			*yplane++ = (BYTE) ((r_val >> 2) + (g_val >> 1) + (b_val >> 2));
-
-			/* Perform color loss reduction here */
-			*coplane++ = (BYTE) ((r_val - b_val) >> ccl);
-			*cgplane++ = (BYTE) ((-(r_val >> 1) + g_val - (b_val >> 1)) >> ccl);
-			*aplane++ = a_val;
+			case RDP_PIXEL_FORMAT_B8G8R8A8:
+				b_val = *src++;
+				g_val = *src++;
+				r_val = *src++;
+				a_val = *src++;
+				break;
+
+			case RDP_PIXEL_FORMAT_R8G8B8A8:
+				r_val = *src++;
+				g_val = *src++;
+				b_val = *src++;
+				a_val = *src++;
+				break;
+
+			case RDP_PIXEL_FORMAT_B8G8R8:
+				b_val = *src++;
+				g_val = *src++;
+				r_val = *src++;
+				a_val = 0xFF;
+				break;
+
+			case RDP_PIXEL_FORMAT_R8G8B8:
+				r_val = *src++;
+				g_val = *src++;
+				b_val = *src++;
+				a_val = 0xFF;
+				break;
+
+			case RDP_PIXEL_FORMAT_B5G6R5_LE:
+				b_val = (INT16) (((*(src + 1)) & 0xF8) | ((*(src + 1)) >> 5));
+				g_val = (INT16) ((((*(src + 1)) & 0x07) << 5) | (((*src) & 0xE0) >> 3));
+				r_val = (INT16) ((((*src) & 0x1F) << 3) | (((*src) >> 2) & 0x07));
+				a_val = 0xFF;
+				src += 2;
+				break;
+
+			case RDP_PIXEL_FORMAT_R5G6B5_LE:
+				r_val = (INT16) (((*(src + 1)) & 0xF8) | ((*(src + 1)) >> 5));
+				g_val = (INT16) ((((*(src + 1)) & 0x07) << 5) | (((*src) & 0xE0) >> 3));
+				b_val = (INT16) ((((*src) & 0x1F) << 3) | (((*src) >> 2) & 0x07));
+				a_val = 0xFF;
+				src += 2;
+				break;
+
+			case RDP_PIXEL_FORMAT_P4_PLANER:
+				{
+					int shift;
+					BYTE idx;
+
+					shift = (7 - (x % 8));
+					idx = ((*src) >> shift) & 1;
+					idx |= (((*(src + 1)) >> shift) & 1) << 1;
+					idx |= (((*(src + 2)) >> shift) & 1) << 2;
+					idx |= (((*(src + 3)) >> shift) & 1) << 3;
+					idx *= 3;
+					r_val = (INT16) context->palette[idx];
+					g_val = (INT16) context->palette[idx + 1];
+					b_val = (INT16) context->palette[idx + 2];
+					if (shift == 0)
+						src += 4;
+				}
+				a_val = 0xFF;
+				break;
+
+			case RDP_PIXEL_FORMAT_P8:
+				{
+					int idx = (*src) * 3;
+
+					r_val = (INT16) context->palette[idx];
+					g_val = (INT16) context->palette[idx + 1];
+					b_val = (INT16) context->palette[idx + 2];
+					src++;
+				}
+				a_val = 0xFF;
+				break;
+
+			default:
+				r_val = g_val = b_val = a_val = 0;
+				break;
 		}
 
-		if (context->ChromaSubsamplingLevel && (x % 2) == 1)
+		*yplane++ = (BYTE) ((r_val >> 2) + (g_val >> 1) + (b_val >> 2));
+
+		/* Perform color loss reduction here */
+		*coplane++ = (BYTE) ((r_val - b_val) >> ccl);
+		*cgplane++ = (BYTE) ((-(r_val >> 1) + g_val - (b_val >> 1)) >> ccl);
+		*aplane++ = a_val;
+	}
+
+	/* the rows are sent padded to a multiple of 8, repeat the last pixel instead of leaving stale bytes */
+	if (context->ChromaSubsamplingLevel)
+	{
+		for (; x < rw; x++)
 		{
 			*yplane = *(yplane - 1);
 			*coplane = *(coplane - 1);
 			*cgplane = *(cgplane - 1);
+			yplane++;
+			coplane++;
+			cgplane++;
 		}
 	}
+}
 
-	if (context->ChromaSubsamplingLevel && (y % 2) == 1)
-	{
-		CopyMemory(yplane + rw, yplane, rw);
-		CopyMemory(coplane + rw, coplane, rw);
-		CopyMemory(cgplane + rw, cgplane, rw);
-	}
+void nsc_encode_argb_to_aycocg(NSC_CONTEXT* context, BYTE* data, int scanline, UINT32 yStart, UINT32 yEnd)
+{
+	UINT32 y;
+
+	for (y = yStart; y < yEnd; y++)
+		nsc_encode_argb_to_aycocg_row(context, data + (context->height - 1 - y) * scanline, y, 0);
 }
 
-static void nsc_encode_subsampling(NSC_CONTEXT* context)
+/**
+ * Subsamples the chroma rows of the band [yStart, yEnd) into PlaneBuffers[4],
+ * Co first and Cg OrgByteCount[1] bytes further, so that bands can run concurrently.
+ */
+void nsc_encode_subsampling(NSC_CONTEXT* context, UINT32 yStart, UINT32 yEnd)
 {
 	UINT16 x;
-	UINT16 y;
+	UINT32 y;
 	BYTE* co_dst;
 	BYTE* cg_dst;
 	INT8* co_src0;
@@ -228,15 +230,13 @@ static void nsc_encode_subsampling(NSC_CONTEXT* context)
 	INT8* cg_src0;
 	INT8* cg_src1;
 	UINT32 tempWidth;
-	UINT32 tempHeight;
 
 	tempWidth = ROUND_UP_TO(context->width, 8);
-	tempHeight = ROUND_UP_TO(context->height, 2);
 
-	for (y = 0; y < tempHeight >> 1; y++)
+	for (y = yStart >> 1; y < (yEnd + 1) >> 1; y++)
 	{
-		co_dst = context->priv->PlaneBuffers[1] + y * (tempWidth >> 1);
-		cg_dst = context->priv->PlaneBuffers[2] + y * (tempWidth >> 1);
+		co_dst = context->priv->PlaneBuffers[4] + y * (tempWidth >> 1);
+		cg_dst = context->priv->PlaneBuffers[4] + context->OrgByteCount[1] + y * (tempWidth >> 1);
 		co_src0 = (INT8*) context->priv->PlaneBuffers[1] + (y << 1) * tempWidth;
 		co_src1 = co_src0 + tempWidth;
 		cg_src0 = (INT8*) context->priv->PlaneBuffers[2] + (y << 1) * tempWidth;
@@ -256,13 +256,54 @@ static void nsc_encode_subsampling(NSC_CONTEXT* context)
 	}
 }
 
+struct _NSC_ENCODE_PARAM
+{
+	BYTE* data;
+	int scanline;
+};
+typedef struct _NSC_ENCODE_PARAM NSC_ENCODE_PARAM;
+
+static void nsc_encode_band(NSC_CONTEXT* context, UINT32 index, void* param)
+{
+	UINT32 rw;
+	UINT32 yStart;
+	UINT32 yEnd;
+	NSC_ENCODE_PARAM* encode = (NSC_ENCODE_PARAM*) param;
+
+	yStart = index * NSC_BAND_HEIGHT;
+	yEnd = MIN(yStart + NSC_BAND_HEIGHT, context->height);
+
+	context->priv->encode_argb_to_aycocg(context, encode->data, encode->scanline, yStart, yEnd);
+
+	if (!context->ChromaSubsamplingLevel)
+		return;
+
+	if ((yEnd == context->height) && (yEnd % 2) == 1)
+	{
+		/* duplicate the last row so that the last chroma row has a pair */
+		rw = ROUND_UP_TO(context->width, 8);
+		CopyMemory(context->priv->PlaneBuffers[0] + yEnd * rw, context->priv->PlaneBuffers[0] + (yEnd - 1) * rw, rw);
+		CopyMemory(context->priv->PlaneBuffers[1] + yEnd * rw, context->priv->PlaneBuffers[1] + (yEnd - 1) * rw, rw);
+		CopyMemory(context->priv->PlaneBuffers[2] + yEnd * rw, context->priv->PlaneBuffers[2] + (yEnd - 1) * rw, rw);
+	}
+
+	context->priv->encode_subsampling(context, yStart, yEnd);
+}
+
 void nsc_encode(NSC_CONTEXT* context, BYTE* bmpdata, int rowstride)
 {
-	nsc_encode_argb_to_aycocg(context, bmpdata, rowstride);
+	NSC_ENCODE_PARAM param;
+
+	param.data = bmpdata;
+	param.scanline = rowstride;
+
+	nsc_run_jobs(context, NSC_BAND_COUNT(context->height), nsc_encode_band, &param);
 
 	if (context->ChromaSubsamplingLevel)
 	{
-		nsc_encode_subsampling(context);
+		CopyMemory(context->priv->PlaneBuffers[1], context->priv->PlaneBuffers[4], context->OrgByteCount[1]);
+		CopyMemory(context->priv->PlaneBuffers[2], context->priv->PlaneBuffers[4] + context->OrgByteCount[1],
+				context->OrgByteCount[2]);
 	}
 }
 
@@ -320,32 +361,59 @@ static UINT32 nsc_rle_encode(BYTE* in, BYTE* out, UINT32 originalSize)
 	return planeSize;
 }
 
-static void nsc_rle_compress_data(NSC_CONTEXT* context)
+static void nsc_rle_compress_plane(NSC_CONTEXT* context, UINT32 index, void* param)
 {
-	UINT16 i;
+	BYTE* rle;
 	UINT32 planeSize;
 	UINT32 originalSize;
 
-	for (i = 0; i < 4; i++)
+	originalSize = context->OrgByteCount[index];
+	rle = context->priv->RleBuffer + index * context->priv->PlaneBuffersLength;
+
+	if (originalSize == 0)
 	{
-		originalSize = context->OrgByteCount[i];
+		planeSize = 0;
+	}
+	else
+	{
+		planeSize = nsc_rle_encode(context->priv->PlaneBuffers[index], rle, originalSize);
 
-		if (originalSize == 0)
-		{
-			planeSize = 0;
-		}
+		if (planeSize < originalSize)
+			CopyMemory(context->priv->PlaneBuffers[index], rle, planeSize);
 		else
+			planeSize = originalSize;
+	}
+
+	context->PlaneByteCount[index] = planeSize;
+}
+
+static void nsc_rle_compress_data(NSC_CONTEXT* context)
+{
+	UINT16 i;
+	BYTE* RleBuffer;
+	UINT32 length;
+
+	/* the planes are independent, each one gets its own output buffer */
+	length = context->priv->PlaneBuffersLength * 4;
+
+	if (length > context->priv->RleBufferLength)
+	{
+		RleBuffer = (BYTE*) realloc(context->priv->RleBuffer, length);
+
+		if (!RleBuffer)
 		{
-			planeSize = nsc_rle_encode(context->priv->PlaneBuffers[i], context->priv->PlaneBuffers[4], originalSize);
+			/* send the planes uncompressed */
+			for (i = 0; i < 4; i++)
+				context->PlaneByteCount[i] = context->OrgByteCount[i];
 
-			if (planeSize < originalSize)
-				CopyMemory(context->priv->PlaneBuffers[i], context->priv->PlaneBuffers[4], planeSize);
-			else
-				planeSize = originalSize;
+			return;
 		}
 
-		context->PlaneByteCount[i] = planeSize;
+		context->priv->RleBuffer = RleBuffer;
+		context->priv->RleBufferLength = length;
 	}
+
+	nsc_run_jobs(context, 4, nsc_rle_compress_plane, NULL);
 }
 
 UINT32 nsc_compute_byte_count(NSC_CONTEXT* context, UINT32* ByteCount, UINT32 width, UINT32 height)
@@ -22,4 +22,8 @@
 
 void nsc_encode(NSC_CONTEXT* context, BYTE* bmpdata, int rowstride);
 
+void nsc_encode_argb_to_aycocg(NSC_CONTEXT* context, BYTE* data, int scanline, UINT32 yStart, UINT32 yEnd);
+void nsc_encode_argb_to_aycocg_row(NSC_CONTEXT* context, BYTE* src, UINT32 y, UINT32 x);
+void nsc_encode_subsampling(NSC_CONTEXT* context, UINT32 yStart, UINT32 yEnd);
+
 #endif
@@ -31,12 +31,13 @@
 #include <winpr/crt.h>
 
 #include "nsc_types.h"
+#include "nsc_encode.h"
 #include "nsc_sse2.h"
 
-static void nsc_encode_argb_to_aycocg_sse2(NSC_CONTEXT* context, BYTE* data, int scanline)
+static void nsc_encode_argb_to_aycocg_sse2(NSC_CONTEXT* context, BYTE* data, int scanline, UINT32 yStart, UINT32 yEnd)
 {
 	UINT16 x;
-	UINT16 y;
+	UINT32 y;
 	UINT16 rw;
 	BYTE ccl;
 	BYTE* src;
@@ -52,18 +53,12 @@ static void nsc_encode_argb_to_aycocg_sse2(NSC_CONTEXT* context, BYTE* data, int
 	__m128i co_val;
 	__m128i cg_val;
 	UINT32 tempWidth;
-	UINT32 tempHeight;
 
 	tempWidth = ROUND_UP_TO(context->width, 8);
-	tempHeight = ROUND_UP_TO(context->height, 2);
 	rw = (context->ChromaSubsamplingLevel > 0 ? tempWidth : context->width);
 	ccl = context->ColorLossLevel;
-	yplane = context->priv->PlaneBuffers[0];
-	coplane = context->priv->PlaneBuffers[1];
-	cgplane = context->priv->PlaneBuffers[2];
-	aplane = context->priv->PlaneBuffers[3];
 
-	for (y = 0; y < context->height; y++)
+	for (y = yStart; y < yEnd; y++)
 	{
 		src = data + (context->height - 1 - y) * scanline;
 		yplane = context->priv->PlaneBuffers[0] + y * rw;
@@ -71,7 +66,8 @@ static void nsc_encode_argb_to_aycocg_sse2(NSC_CONTEXT* context, BYTE* data, int
 		cgplane = context->priv->PlaneBuffers[2] + y * rw;
 		aplane = context->priv->PlaneBuffers[3] + y * context->width;
 
-		for (x = 0; x < context->width; x += 8)
+		/* only whole groups of 8 pixels, the stores must not spill into the next row of another band */
+		for (x = 0; x + 8 <= context->width; x += 8)
 		{
 			switch (context->pixel_format)
 			{
@@ -265,39 +261,52 @@ static void nsc_encode_argb_to_aycocg_sse2(NSC_CONTEXT* context, BYTE* data, int
 			cg_val = _mm_srai_epi16(cg_val, ccl);
 
 			y_val = _mm_packus_epi16(y_val, y_val);
-			_mm_storeu_si128((__m128i*) yplane, y_val);
+			_mm_storel_epi64((__m128i*) yplane, y_val);
 			co_val = _mm_packs_epi16(co_val, co_val);
-			_mm_storeu_si128((__m128i*) coplane, co_val);
+			_mm_storel_epi64((__m128i*) coplane, co_val);
 			cg_val = _mm_packs_epi16(cg_val, cg_val);
-			_mm_storeu_si128((__m128i*) cgplane, cg_val);
+			_mm_storel_epi64((__m128i*) cgplane, cg_val);
 			a_val = _mm_packus_epi16(a_val, a_val);
-			_mm_storeu_si128((__m128i*) aplane, a_val);
+			_mm_storel_epi64((__m128i*) aplane, a_val);
 			yplane += 8;
 			coplane += 8;
 			cgplane += 8;
 			aplane += 8;
 		}
 
-		if (context->ChromaSubsamplingLevel > 0 && (context->width % 2) == 1)
-		{
-			context->priv->PlaneBuffers[0][y * rw + context->width] = context->priv->PlaneBuffers[0][y * rw + context->width - 1];
-			context->priv->PlaneBuffers[1][y * rw + context->width] = context->priv->PlaneBuffers[1][y * rw + context->width - 1];
-			context->priv->PlaneBuffers[2][y * rw + context->width] = context->priv->PlaneBuffers[2][y * rw + context->width - 1];
-		}
+		/* remaining pixels and the padding column */
+		if (x < context->width)
+			nsc_encode_argb_to_aycocg_row(context, src, y, x);
 	}
+}
 
-	if (context->ChromaSubsamplingLevel > 0 && (y % 2) == 1)
-	{
-		CopyMemory(yplane + rw, yplane, rw);
-		CopyMemory(coplane + rw, coplane, rw);
-		CopyMemory(cgplane + rw, cgplane, rw);
-	}
+/**
+ * Averages the 2x2 blocks of 16 signed chroma values from two rows into 8 values.
+ * The values are biased to unsigned first so that the sum can be done on 16 bits
+ * with the same rounding as the generic code.
+ */
+static INLINE __m128i nsc_subsample_sse2(const BYTE* src0, const BYTE* src1)
+{
+	__m128i a;
+	__m128i b;
+	__m128i sum;
+	const __m128i bias = _mm_set1_epi8((char) 0x80);
+	const __m128i mask = _mm_set1_epi16(0xFF);
+
+	a = _mm_xor_si128(_mm_loadu_si128((const __m128i*) src0), bias);
+	b = _mm_xor_si128(_mm_loadu_si128((const __m128i*) src1), bias);
+	sum = _mm_add_epi16(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8));
+	sum = _mm_add_epi16(sum, _mm_and_si128(b, mask));
+	sum = _mm_add_epi16(sum, _mm_srli_epi16(b, 8));
+	sum = _mm_sub_epi16(_mm_srli_epi16(sum, 2), _mm_set1_epi16(0x80));
+
+	return _mm_packs_epi16(sum, sum);
 }
 
-static void nsc_encode_subsampling_sse2(NSC_CONTEXT* context)
+static void nsc_encode_subsampling_sse2(NSC_CONTEXT* context, UINT32 yStart, UINT32 yEnd)
 {
 	UINT16 x;
-	UINT16 y;
+	UINT32 y;
 	BYTE* co_dst;
 	BYTE* cg_dst;
 	INT8* co_src0;
@@ -305,61 +314,162 @@ static void nsc_encode_subsampling_sse2(NSC_CONTEXT* context)
 	INT8* cg_src0;
 	INT8* cg_src1;
 	UINT32 tempWidth;
-	UINT32 tempHeight;
-	__m128i t;
-	__m128i val;
-	__m128i mask = _mm_set1_epi16(0xFF);
 
 	tempWidth = ROUND_UP_TO(context->width, 8);
-	tempHeight = ROUND_UP_TO(context->height, 2);
 
-	for (y = 0; y < tempHeight >> 1; y++)
+	for (y = yStart >> 1; y < (yEnd + 1) >> 1; y++)
 	{
-		co_dst = context->priv->PlaneBuffers[1] + y * (tempWidth >> 1);
-		cg_dst = context->priv->PlaneBuffers[2] + y * (tempWidth >> 1);
+		co_dst = context->priv->PlaneBuffers[4] + y * (tempWidth >> 1);
+		cg_dst = context->priv->PlaneBuffers[4] + context->OrgByteCount[1] + y * (tempWidth >> 1);
 		co_src0 = (INT8*) context->priv->PlaneBuffers[1] + (y << 1) * tempWidth;
 		co_src1 = co_src0 + tempWidth;
 		cg_src0 = (INT8*) context->priv->PlaneBuffers[2] + (y << 1) * tempWidth;
 		cg_src1 = cg_src0 + tempWidth;
 
-		for (x = 0; x < tempWidth >> 1; x += 8)
+		for (x = 0; x + 8 <= tempWidth >> 1; x += 8)
 		{
-			t = _mm_loadu_si128((__m128i*) co_src0);
-			t = _mm_avg_epu8(t, _mm_loadu_si128((__m128i*) co_src1));
-			val = _mm_and_si128(_mm_srli_si128(t, 1), mask);
-			val = _mm_avg_epu16(val, _mm_and_si128(t, mask));
-			val = _mm_packus_epi16(val, val);
-			_mm_storeu_si128((__m128i*) co_dst, val);
+			_mm_storel_epi64((__m128i*) co_dst, nsc_subsample_sse2((BYTE*) co_src0, (BYTE*) co_src1));
 			co_dst += 8;
 			co_src0 += 16;
 			co_src1 += 16;
 
-			t = _mm_loadu_si128((__m128i*) cg_src0);
-			t = _mm_avg_epu8(t, _mm_loadu_si128((__m128i*) cg_src1));
-			val = _mm_and_si128(_mm_srli_si128(t, 1), mask);
-			val = _mm_avg_epu16(val, _mm_and_si128(t, mask));
-			val = _mm_packus_epi16(val, val);
-			_mm_storeu_si128((__m128i*) cg_dst, val);
+			_mm_storel_epi64((__m128i*) cg_dst, nsc_subsample_sse2((BYTE*) cg_src0, (BYTE*) cg_src1));
 			cg_dst += 8;
 			cg_src0 += 16;
 			cg_src1 += 16;
 		}
+
+		for (; x < tempWidth >> 1; x++)
+		{
+			*co_dst++ = (BYTE) (((INT16) *co_src0 + (INT16) *(co_src0 + 1) +
+				(INT16) *co_src1 + (INT16) *(co_src1 + 1)) >> 2);
+			*cg_dst++ = (BYTE) (((INT16) *cg_src0 + (INT16) *(cg_src0 + 1) +
+				(INT16) *cg_src1 + (INT16) *(cg_src1 + 1)) >> 2);
+			co_src0 += 2;
+			co_src1 += 2;
+			cg_src0 += 2;
+			cg_src1 += 2;
+		}
 	}
 }
 
-static void nsc_encode_sse2(NSC_CONTEXT* context, BYTE* data, int scanline)
+static void nsc_decode_sse2(NSC_CONTEXT* context, UINT32 yStart, UINT32 yEnd)
 {
-	nsc_encode_argb_to_aycocg_sse2(context, data, scanline);
+	UINT16 x;
+	UINT32 y;
+	UINT16 rw;
+	BYTE shift;
+	BYTE* yplane;
+	BYTE* coplane;
+	BYTE* cgplane;
+	BYTE* aplane;
+	BYTE* bmpdata;
+	INT16 y_val;
+	INT16 co_val;
+	INT16 cg_val;
+	__m128i count;
+	__m128i c;
+	__m128i yv[2];
+	__m128i co[2];
+	__m128i cg[2];
+	__m128i r8, g8, b8, a8;
+	__m128i bg, ra;
+	const __m128i zero = _mm_setzero_si128();
+
+	rw = ROUND_UP_TO(context->width, 8);
+	shift = context->ColorLossLevel - 1; /* colorloss recovery + YCoCg shift */
+
+	/* (INT8) (v << shift) on 16 bits: move the low byte to the top and shift it back signed */
+	count = _mm_cvtsi32_si128(shift + 8);
 
-	if (context->ChromaSubsamplingLevel > 0)
+	for (y = yStart; y < yEnd; y++)
 	{
-		nsc_encode_subsampling_sse2(context);
+		if (context->ChromaSubsamplingLevel)
+		{
+			yplane = context->priv->PlaneBuffers[0] + y * rw; /* Y */
+			coplane = context->priv->PlaneBuffers[1] + (y >> 1) * (rw >> 1); /* Co, supersampled */
+			cgplane = context->priv->PlaneBuffers[2] + (y >> 1) * (rw >> 1); /* Cg, supersampled */
+		}
+		else
+		{
+			yplane = context->priv->PlaneBuffers[0] + y * context->width; /* Y */
+			coplane = context->priv->PlaneBuffers[1] + y * context->width; /* Co */
+			cgplane = context->priv->PlaneBuffers[2] + y * context->width; /* Cg */
+		}
+
+		aplane = context->priv->PlaneBuffers[3] + y * context->width; /* A */
+		bmpdata = context->BitmapData + y * context->width * 4;
+
+		for (x = 0; x + 16 <= context->width; x += 16)
+		{
+			c = _mm_loadu_si128((__m128i*) &yplane[x]);
+			yv[0] = _mm_unpacklo_epi8(c, zero);
+			yv[1] = _mm_unpackhi_epi8(c, zero);
+
+			if (context->ChromaSubsamplingLevel)
+			{
+				c = _mm_loadl_epi64((__m128i*) &coplane[x >> 1]);
+				c = _mm_unpacklo_epi8(c, c);
+			}
+			else
+			{
+				c = _mm_loadu_si128((__m128i*) &coplane[x]);
+			}
+
+			co[0] = _mm_srai_epi16(_mm_sll_epi16(_mm_unpacklo_epi8(c, zero), count), 8);
+			co[1] = _mm_srai_epi16(_mm_sll_epi16(_mm_unpackhi_epi8(c, zero), count), 8);
+
+			if (context->ChromaSubsamplingLevel)
+			{
+				c = _mm_loadl_epi64((__m128i*) &cgplane[x >> 1]);
+				c = _mm_unpacklo_epi8(c, c);
+			}
+			else
+			{
+				c = _mm_loadu_si128((__m128i*) &cgplane[x]);
+			}
+
+			cg[0] = _mm_srai_epi16(_mm_sll_epi16(_mm_unpacklo_epi8(c, zero), count), 8);
+			cg[1] = _mm_srai_epi16(_mm_sll_epi16(_mm_unpackhi_epi8(c, zero), count), 8);
+
+			/* r = y + co - cg, g = y + cg, b = y - co - cg, saturated to [0, 255] when packing */
+			r8 = _mm_packus_epi16(_mm_sub_epi16(_mm_add_epi16(yv[0], co[0]), cg[0]),
+					_mm_sub_epi16(_mm_add_epi16(yv[1], co[1]), cg[1]));
+			g8 = _mm_packus_epi16(_mm_add_epi16(yv[0], cg[0]), _mm_add_epi16(yv[1], cg[1]));
+			b8 = _mm_packus_epi16(_mm_sub_epi16(_mm_sub_epi16(yv[0], co[0]), cg[0]),
+					_mm_sub_epi16(_mm_sub_epi16(yv[1], co[1]), cg[1]));
+			a8 = _mm_loadu_si128((__m128i*) &aplane[x]);
+
+			bg = _mm_unpacklo_epi8(b8, g8);
+			ra = _mm_unpacklo_epi8(r8, a8);
+			_mm_storeu_si128((__m128i*) &bmpdata[x * 4], _mm_unpacklo_epi16(bg, ra));
+			_mm_storeu_si128((__m128i*) &bmpdata[x * 4 + 16], _mm_unpackhi_epi16(bg, ra));
+
+			bg = _mm_unpackhi_epi8(b8, g8);
+			ra = _mm_unpackhi_epi8(r8, a8);
+			_mm_storeu_si128((__m128i*) &bmpdata[x * 4 + 32], _mm_unpacklo_epi16(bg, ra));
+			_mm_storeu_si128((__m128i*) &bmpdata[x * 4 + 48], _mm_unpackhi_epi16(bg, ra));
+		}
+
+		for (; x < context->width; x++)
+		{
+			y_val = (INT16) yplane[x];
+			co_val = (INT16) (INT8) (coplane[context->ChromaSubsamplingLevel ? x >> 1 : x] << shift);
+			cg_val = (INT16) (INT8) (cgplane[context->ChromaSubsamplingLevel ? x >> 1 : x] << shift);
+			bmpdata[x * 4] = MINMAX(y_val - co_val - cg_val, 0, 0xFF);
+			bmpdata[x * 4 + 1] = MINMAX(y_val + cg_val, 0, 0xFF);
+			bmpdata[x * 4 + 2] = MINMAX(y_val + co_val - cg_val, 0, 0xFF);
+			bmpdata[x * 4 + 3] = aplane[x];
+		}
 	}
 }
 
 void nsc_init_sse2(NSC_CONTEXT* context)
 {
 	IF_PROFILER(context->priv->prof_nsc_encode->name = "nsc_encode_sse2");
+	IF_PROFILER(context->priv->prof_nsc_decode->name = "nsc_decode_sse2");
 
-	context->encode = nsc_encode_sse2;
+	context->priv->encode_argb_to_aycocg = nsc_encode_argb_to_aycocg_sse2;
+	context->priv->encode_subsampling = nsc_encode_subsampling_sse2;
+	context->priv->decode_band = nsc_decode_sse2;
 }
@@ -27,14 +27,33 @@
 
 #include <winpr/crt.h>
 #include <winpr/wlog.h>
+#include <winpr/pool.h>
 #include <winpr/collections.h>
 
-
+#include <freerdp/codec/nsc.h>
 #include <freerdp/utils/profiler.h>
 
 #define ROUND_UP_TO(_b, _n) (_b + ((~(_b & (_n-1)) + 0x1) & (_n-1)))
 #define MINMAX(_v,_l,_h) ((_v) < (_l) ? (_l) : ((_v) > (_h) ? (_h) : (_v)))
 
+/* Images are converted in bands of rows, the height must be even for chroma subsampling */
+#define NSC_BAND_HEIGHT		64
+#define NSC_BAND_COUNT(_h)	(((_h) + NSC_BAND_HEIGHT - 1) / NSC_BAND_HEIGHT)
+
+/* Images smaller than this (in pixels) are processed on the calling thread only */
+#define NSC_THREADING_THRESHOLD	(128 * 128)
+
+typedef void (*pfnNscJob)(NSC_CONTEXT* context, UINT32 index, void* param);
+
+struct _NSC_JOB_PARAM
+{
+	NSC_CONTEXT* context;
+	pfnNscJob job;
+	UINT32 index;
+	void* param;
+};
+typedef struct _NSC_JOB_PARAM NSC_JOB_PARAM;
+
 struct _NSC_CONTEXT_PRIV
 {
 	wLog* log;
@@ -44,6 +63,25 @@ struct _NSC_CONTEXT_PRIV
 	BYTE* PlaneBuffers[5];		/* Decompressed Plane Buffers in the respective order */
 	UINT32 PlaneBuffersLength;	/* Lengths of each plane buffer */
 
+	BYTE* RleBuffer;		/* RLE output of the four planes, PlaneBuffersLength each */
+	UINT32 RleBufferLength;
+
+	BOOL UseThreads;
+	UINT32 numWorkObjects;
+	PTP_WORK* workObjects;
+	NSC_JOB_PARAM* jobParams;
+
+	DWORD MinThreadCount;
+	DWORD MaxThreadCount;
+
+	PTP_POOL ThreadPool;
+	TP_CALLBACK_ENVIRON ThreadPoolEnv;
+
+	/* band kernels, replaced by the optimized versions */
+	void (*encode_argb_to_aycocg)(NSC_CONTEXT* context, BYTE* data, int scanline, UINT32 yStart, UINT32 yEnd);
+	void (*encode_subsampling)(NSC_CONTEXT* context, UINT32 yStart, UINT32 yEnd);
+	void (*decode_band)(NSC_CONTEXT* context, UINT32 yStart, UINT32 yEnd);
+
 	/* profilers */
 	PROFILER_DEFINE(prof_nsc_rle_decompress_data);
 	PROFILER_DEFINE(prof_nsc_decode);
@@ -51,4 +89,6 @@ struct _NSC_CONTEXT_PRIV
 	PROFILER_DEFINE(prof_nsc_encode);
 };
 
+void nsc_run_jobs(NSC_CONTEXT* context, UINT32 count, pfnNscJob job, void* param);
+
 #endif /* __NSC_TYPES_H */
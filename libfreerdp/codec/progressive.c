@@ -23,18 +23,66 @@
 
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/tchar.h>
+#include <winpr/sysinfo.h>
+#include <winpr/registry.h>
 #include <winpr/bitstream.h>
 
 #include <freerdp/primitives.h>
 #include <freerdp/codec/color.h>
+#include <freerdp/codec/region.h>
 #include <freerdp/codec/progressive.h>
 #include <freerdp/log.h>
 
 #include "rfx_differential.h"
 #include "rfx_quantization.h"
 
+#include "progressive_sse2.h"
+#include "progressive_neon.h"
+
 #define TAG FREERDP_TAG("codec.progressive")
 
+#ifndef PROGRESSIVE_INIT_SIMD
+#define PROGRESSIVE_INIT_SIMD(_progressive) do { } while (0)
+#endif
+
+/**
+ * Tiles of a region are decoded in parallel by a fixed set of workers.
+ * A tile always goes to the same worker (zIdx modulo the worker count),
+ * so that repeated blocks for the same tile are decoded in stream order.
+ * Each worker owns its coefficient, DWT and staging buffers.
+ */
+
+struct _PROGRESSIVE_TILE_JOB
+{
+	PROGRESSIVE_SURFACE_CONTEXT* surface;
+	RFX_PROGRESSIVE_TILE** tiles;
+	UINT32 numTiles;
+	UINT32 numWorkers;
+
+	BYTE* pDstData;
+	DWORD DstFormat;
+	DWORD SrcFormat;
+	int nDstStep;
+	int nXDst;
+	int nYDst;
+	REGION16 clippingRects;
+};
+typedef struct _PROGRESSIVE_TILE_JOB PROGRESSIVE_TILE_JOB;
+
+struct _PROGRESSIVE_TILE_WORKER
+{
+	UINT32 index;
+	PTP_WORK work;
+	PROGRESSIVE_CONTEXT* progressive;
+	PROGRESSIVE_TILE_JOB* job;
+	int status;
+
+	BYTE* buffer; /* Y/Cb/Cr coefficients */
+	INT16* temp; /* DWT buffer */
+	BYTE* image; /* 64x64 staging for partially visible tiles */
+};
+
 const char* progressive_get_block_type_string(UINT16 blockType)
 {
 	switch (blockType)
@@ -352,7 +400,7 @@ int progressive_delete_surface_context(PROGRESSIVE_CONTEXT* progressive, UINT16
  * LL3		4015		9x9		81
  */
 
-static void progressive_rfx_idwt_x(INT16* pLowBand, int nLowStep, INT16* pHighBand, int nHighStep,
+void progressive_rfx_idwt_x(INT16* pLowBand, int nLowStep, INT16* pHighBand, int nHighStep,
 		INT16* pDstBand, int nDstStep, int nLowCount, int nHighCount, int nDstCount)
 {
 	int i, j;
@@ -437,7 +485,7 @@ static void progressive_rfx_idwt_x(INT16* pLowBand, int nLowStep, INT16* pHighBa
 	}
 }
 
-static void progressive_rfx_idwt_y(INT16* pLowBand, int nLowStep, INT16* pHighBand, int nHighStep,
+void progressive_rfx_idwt_y(INT16* pLowBand, int nLowStep, INT16* pHighBand, int nHighStep,
 		INT16* pDstBand, int nDstStep, int nLowCount, int nHighCount, int nDstCount)
 {
 	int i, j;
@@ -551,7 +599,7 @@ static int progressive_rfx_get_band_h_count(int level)
 		return (64 + (1 << (level - 1))) >> level;
 }
 
-static void progressive_rfx_dwt_2d_decode_block(INT16* buffer, INT16* temp, int level)
+static void progressive_rfx_dwt_2d_decode_block(PROGRESSIVE_CONTEXT* progressive, INT16* buffer, INT16* temp, int level)
 {
 	int offset;
 	int nBandL;
@@ -613,7 +661,7 @@ static void progressive_rfx_dwt_2d_decode_block(INT16* buffer, INT16* temp, int
 	nHighCount[0] = nBandH;
 	nDstCount[0] = nBandL;
 
-	progressive_rfx_idwt_x(pLowBand[0], nLowStep[0], pHighBand[0], nHighStep[0], pDstBand[0], nDstStep[0], nLowCount[0], nHighCount[0], nDstCount[0]);
+	progressive->idwt_x(pLowBand[0], nLowStep[0], pHighBand[0], nHighStep[0], pDstBand[0], nDstStep[0], nLowCount[0], nHighCount[0], nDstCount[0]);
 
 	/* horizontal (LH + HH -> H) */
 
@@ -627,7 +675,7 @@ static void progressive_rfx_dwt_2d_decode_block(INT16* buffer, INT16* temp, int
 	nHighCount[1] = nBandH;
 	nDstCount[1] = nBandH;
 
-	progressive_rfx_idwt_x(pLowBand[1], nLowStep[1], pHighBand[1], nHighStep[1], pDstBand[1], nDstStep[1], nLowCount[1], nHighCount[1], nDstCount[1]);
+	progressive->idwt_x(pLowBand[1], nLowStep[1], pHighBand[1], nHighStep[1], pDstBand[1], nDstStep[1], nLowCount[1], nHighCount[1], nDstCount[1]);
 
 	/* vertical (L + H -> LL) */
 
@@ -641,10 +689,10 @@ static void progressive_rfx_dwt_2d_decode_block(INT16* buffer, INT16* temp, int
 	nHighCount[2] = nBandH;
 	nDstCount[2] = nBandL + nBandH;
 
-	progressive_rfx_idwt_y(pLowBand[2], nLowStep[2], pHighBand[2], nHighStep[2], pDstBand[2], nDstStep[2], nLowCount[2], nHighCount[2], nDstCount[2]);
+	progressive->idwt_y(pLowBand[2], nLowStep[2], pHighBand[2], nHighStep[2], pDstBand[2], nDstStep[2], nLowCount[2], nHighCount[2], nDstCount[2]);
 }
 
-void progressive_rfx_dwt_2d_decode(INT16* buffer, INT16* temp, INT16* current, INT16* sign, BOOL diff)
+void progressive_rfx_dwt_2d_decode(PROGRESSIVE_CONTEXT* progressive, INT16* buffer, INT16* temp, INT16* current, INT16* sign, BOOL diff)
 {
 	const primitives_t* prims = primitives_get();
 
@@ -653,9 +701,9 @@ void progressive_rfx_dwt_2d_decode(INT16* buffer, INT16* temp, INT16* current, I
 
 	CopyMemory(current, buffer, 4096 * 2);
 
-	progressive_rfx_dwt_2d_decode_block(&buffer[3807], temp, 3);
-	progressive_rfx_dwt_2d_decode_block(&buffer[3007], temp, 2);
-	progressive_rfx_dwt_2d_decode_block(&buffer[0], temp, 1);
+	progressive_rfx_dwt_2d_decode_block(progressive, &buffer[3807], temp, 3);
+	progressive_rfx_dwt_2d_decode_block(progressive, &buffer[3007], temp, 2);
+	progressive_rfx_dwt_2d_decode_block(progressive, &buffer[0], temp, 1);
 }
 
 void progressive_rfx_decode_block(const primitives_t* prims, INT16* buffer, int length, UINT32 shift)
@@ -667,10 +715,9 @@ void progressive_rfx_decode_block(const primitives_t* prims, INT16* buffer, int
 }
 
 int progressive_rfx_decode_component(PROGRESSIVE_CONTEXT* progressive, RFX_COMPONENT_CODEC_QUANT* shift,
-		const BYTE* data, int length, INT16* buffer, INT16* current, INT16* sign, BOOL diff)
+		const BYTE* data, int length, INT16* buffer, INT16* temp, INT16* current, INT16* sign, BOOL diff)
 {
 	int status;
-	INT16* temp;
 	const primitives_t* prims = primitives_get();
 
 	status = rfx_rlgr_decode(data, length, buffer, 4096, 1);
@@ -693,16 +740,74 @@ int progressive_rfx_decode_component(PROGRESSIVE_CONTEXT* progressive, RFX_COMPO
 	progressive_rfx_decode_block(prims, &buffer[3951], 64, shift->HH3); /* HH3 */
 	progressive_rfx_decode_block(prims, &buffer[4015], 81, shift->LL3); /* LL3 */
 
-	temp = (INT16*) BufferPool_Take(progressive->bufferPool, -1); /* DWT buffer */
+	progressive_rfx_dwt_2d_decode(progressive, buffer, temp, current, sign, diff);
+
+	return 1;
+}
+
+static void progressive_tile_write(PROGRESSIVE_TILE_WORKER* worker, RFX_PROGRESSIVE_TILE* tile, INT16** pSrcDst)
+{
+	int index;
+	int nbUpdateRects;
+	BYTE* pDstData;
+	RECTANGLE_16 tileRect;
+	REGION16 updateRegion;
+	const RECTANGLE_16* updateRects;
+	PROGRESSIVE_TILE_JOB* job = worker->job;
+	static const prim_size_t roi_64x64 = { 64, 64 };
+	const primitives_t* prims = primitives_get();
+	__yCbCrToRGB_16s8u_P3AC4R_t yCbCrToRGB;
+
+	yCbCrToRGB = worker->progressive->invert ? prims->yCbCrToBGR_16s8u_P3AC4R : prims->yCbCrToRGB_16s8u_P3AC4R;
 
-	progressive_rfx_dwt_2d_decode(buffer, temp, current, sign, diff);
+	if (!job->pDstData)
+	{
+		if (!tile->data)
+			tile->data = (BYTE*) _aligned_malloc(64 * 64 * 4, 16);
 
-	BufferPool_Return(progressive->bufferPool, temp);
+		if (tile->data)
+			yCbCrToRGB((const INT16**) pSrcDst, 64 * 2, tile->data, 64 * 4, &roi_64x64);
 
-	return 1;
+		return;
+	}
+
+	tileRect.left = job->nXDst + tile->x;
+	tileRect.top = job->nYDst + tile->y;
+	tileRect.right = tileRect.left + 64;
+	tileRect.bottom = tileRect.top + 64;
+
+	region16_init(&updateRegion);
+	region16_intersect_rect(&updateRegion, &(job->clippingRects), &tileRect);
+	updateRects = region16_rects(&updateRegion, &nbUpdateRects);
+
+	if ((nbUpdateRects == 1) && rectangles_equal(&updateRects[0], &tileRect) &&
+			(FREERDP_PIXEL_FORMAT_BPP(job->DstFormat) == 32))
+	{
+		/* fully visible tile, convert straight into the destination */
+
+		pDstData = &(job->pDstData[(tileRect.top * job->nDstStep) + (tileRect.left * 4)]);
+		yCbCrToRGB((const INT16**) pSrcDst, 64 * 2, pDstData, job->nDstStep, &roi_64x64);
+	}
+	else if (nbUpdateRects > 0)
+	{
+		yCbCrToRGB((const INT16**) pSrcDst, 64 * 2, worker->image, 64 * 4, &roi_64x64);
+
+		for (index = 0; index < nbUpdateRects; index++)
+		{
+			freerdp_image_copy(job->pDstData, job->DstFormat, job->nDstStep,
+					updateRects[index].left, updateRects[index].top,
+					updateRects[index].right - updateRects[index].left,
+					updateRects[index].bottom - updateRects[index].top,
+					worker->image, job->SrcFormat, 64 * 4,
+					updateRects[index].left - tileRect.left,
+					updateRects[index].top - tileRect.top, NULL);
+		}
+	}
+
+	region16_uninit(&updateRegion);
 }
 
-int progressive_decompress_tile_first(PROGRESSIVE_CONTEXT* progressive, RFX_PROGRESSIVE_TILE* tile)
+int progressive_decompress_tile_first(PROGRESSIVE_TILE_WORKER* worker, RFX_PROGRESSIVE_TILE* tile)
 {
 	BOOL diff;
 	BYTE* pBuffer;
@@ -720,8 +825,7 @@ int progressive_decompress_tile_first(PROGRESSIVE_CONTEXT* progressive, RFX_PROG
 	RFX_COMPONENT_CODEC_QUANT* quantProgCb;
 	RFX_COMPONENT_CODEC_QUANT* quantProgCr;
 	RFX_PROGRESSIVE_CODEC_QUANT* quantProgVal;
-	static const prim_size_t roi_64x64 = { 64, 64 };
-	const primitives_t* prims = primitives_get();
+	PROGRESSIVE_CONTEXT* progressive = worker->progressive;
 
 	tile->pass = 1;
 
@@ -784,11 +888,6 @@ int progressive_decompress_tile_first(PROGRESSIVE_CONTEXT* progressive, RFX_PROG
 	progressive_rfx_quant_add(quantCr, quantProgCr, &shiftCr);
 	progressive_rfx_quant_lsub(&shiftCr, 1); /* -6 + 5 = -1 */
 
-	if (!tile->data)
-	{
-		tile->data = (BYTE*) _aligned_malloc(64 * 64 * 4, 16);
-	}
-
 	if (!tile->sign)
 	{
 		tile->sign = (BYTE*) _aligned_malloc((8192 + 32) * 3, 16);
@@ -799,6 +898,9 @@ int progressive_decompress_tile_first(PROGRESSIVE_CONTEXT* progressive, RFX_PROG
 		tile->current = (BYTE*) _aligned_malloc((8192 + 32) * 3, 16);
 	}
 
+	if (!tile->sign || !tile->current)
+		return -1;
+
 	pBuffer = tile->sign;
 	pSign[0] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 0) + 16])); /* Y/R buffer */
 	pSign[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
@@ -809,32 +911,45 @@ int progressive_decompress_tile_first(PROGRESSIVE_CONTEXT* progressive, RFX_PROG
 	pCurrent[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
 	pCurrent[2] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
 
-	pBuffer = (BYTE*) BufferPool_Take(progressive->bufferPool, -1);
+	pBuffer = worker->buffer;
 	pSrcDst[0] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 0) + 16])); /* Y/R buffer */
 	pSrcDst[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
 	pSrcDst[2] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
 
-	progressive_rfx_decode_component(progressive, &shiftY, tile->yData, tile->yLen, pSrcDst[0], pCurrent[0], pSign[0], diff); /* Y */
-	progressive_rfx_decode_component(progressive, &shiftCb, tile->cbData, tile->cbLen, pSrcDst[1], pCurrent[1], pSign[1], diff); /* Cb */
-	progressive_rfx_decode_component(progressive, &shiftCr, tile->crData, tile->crLen, pSrcDst[2], pCurrent[2], pSign[2], diff); /* Cr */
-
-	if (!progressive->invert)
-		prims->yCbCrToRGB_16s8u_P3AC4R((const INT16**) pSrcDst, 64 * 2, tile->data, 64 * 4, &roi_64x64);
-	else
-		prims->yCbCrToBGR_16s8u_P3AC4R((const INT16**) pSrcDst, 64 * 2, tile->data, 64 * 4, &roi_64x64);
+	progressive_rfx_decode_component(progressive, &shiftY, tile->yData, tile->yLen, pSrcDst[0], worker->temp, pCurrent[0], pSign[0], diff); /* Y */
+	progressive_rfx_decode_component(progressive, &shiftCb, tile->cbData, tile->cbLen, pSrcDst[1], worker->temp, pCurrent[1], pSign[1], diff); /* Cb */
+	progressive_rfx_decode_component(progressive, &shiftCr, tile->crData, tile->crLen, pSrcDst[2], worker->temp, pCurrent[2], pSign[2], diff); /* Cr */
 
-	BufferPool_Return(progressive->bufferPool, pBuffer);
+	progressive_tile_write(worker, tile, pSrcDst);
 
 	//WLog_Image(progressive->log, WLOG_TRACE, tile->data, 64, 64, 32);
 
 	return 1;
 }
 
+/**
+ * The SRL and RAW streams of a tile upgrade are read through a 64-bit cache
+ * refilled a byte at a time: a read is a shift of the cache instead of a
+ * BitStream_Shift(), and the cache is only refilled once fewer than 32 bits
+ * are left. Bytes past the end of a stream read as zero.
+ */
+
+struct _RFX_PROGRESSIVE_BIT_READER
+{
+	const BYTE* data;
+	UINT32 length;
+	UINT32 index;
+	UINT32 position;
+	UINT64 cache;
+	UINT32 cached;
+};
+typedef struct _RFX_PROGRESSIVE_BIT_READER RFX_PROGRESSIVE_BIT_READER;
+
 struct _RFX_PROGRESSIVE_UPGRADE_STATE
 {
 	BOOL nonLL;
-	wBitStream* srl;
-	wBitStream* raw;
+	RFX_PROGRESSIVE_BIT_READER srl;
+	RFX_PROGRESSIVE_BIT_READER raw;
 
 	/* SRL state */
 
@@ -844,20 +959,91 @@ struct _RFX_PROGRESSIVE_UPGRADE_STATE
 };
 typedef struct _RFX_PROGRESSIVE_UPGRADE_STATE RFX_PROGRESSIVE_UPGRADE_STATE;
 
-INT16 progressive_rfx_srl_read(RFX_PROGRESSIVE_UPGRADE_STATE* state, UINT32 numBits)
+static void progressive_bit_reader_attach(RFX_PROGRESSIVE_BIT_READER* br, const BYTE* data, UINT32 length)
+{
+	br->data = data;
+	br->length = length;
+	br->index = 0;
+	br->position = 0;
+	br->cache = 0;
+	br->cached = 0;
+}
+
+/* returns the next 32 bits, most significant first, without consuming them */
+
+static INLINE UINT32 progressive_bit_reader_peek(RFX_PROGRESSIVE_BIT_READER* br)
+{
+	if (br->cached < 32)
+	{
+		while (br->cached <= 56)
+		{
+			if (br->index < br->length)
+				br->cache |= ((UINT64) br->data[br->index]) << (56 - br->cached);
+
+			br->index++;
+			br->cached += 8;
+		}
+	}
+
+	return (UINT32) (br->cache >> 32);
+}
+
+/* at most 32 bits, and only after a peek */
+
+static INLINE void progressive_bit_reader_skip(RFX_PROGRESSIVE_BIT_READER* br, UINT32 nbits)
+{
+	br->cache <<= nbits;
+	br->cached -= nbits;
+	br->position += nbits;
+}
+
+static INLINE UINT32 progressive_bit_reader_read(RFX_PROGRESSIVE_BIT_READER* br, UINT32 nbits)
+{
+	UINT32 value;
+
+	value = progressive_bit_reader_peek(br) >> (32 - nbits);
+	progressive_bit_reader_skip(br, nbits);
+
+	return value;
+}
+
+/* number of leading '0' bits in a byte, used to read SRL unary codes a byte at a time */
+
+static const BYTE progressive_srl_zero_run[256] =
+{
+	8, 7, 6, 6, 5, 5, 5, 5, 4, 4, 4, 4, 4, 4, 4, 4,
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/**
+ * Called once the pending zero run (nz) is exhausted. Each '0' bit of zero
+ * encoding stands for (1 << k) zeros that are counted down by the caller
+ * without reading the stream, so only one bit is read per run.
+ */
+
+static INT16 progressive_rfx_srl_read(RFX_PROGRESSIVE_UPGRADE_STATE* state, UINT32 numBits)
 {
 	int k;
-	UINT32 bit;
+	UINT32 bits;
 	UINT32 max;
 	UINT32 mag;
+	UINT32 run;
 	UINT32 sign;
-	wBitStream* bs = state->srl;
-
-	if (state->nz)
-	{
-		state->nz--;
-		return 0;
-	}
+	RFX_PROGRESSIVE_BIT_READER* br = &state->srl;
 
 	k = state->kp / 8;
 
@@ -865,13 +1051,14 @@ INT16 progressive_rfx_srl_read(RFX_PROGRESSIVE_UPGRADE_STATE* state, UINT32 numB
 	{
 		/* zero encoding */
 
-		bit = (bs->accumulator & 0x80000000) ? 1 : 0;
-		BitStream_Shift(bs, 1);
+		bits = progressive_bit_reader_peek(br);
 
-		if (!bit)
+		if (!(bits & 0x80000000))
 		{
 			/* '0' bit, nz >= (1 << k), nz = (1 << k) */
 
+			progressive_bit_reader_skip(br, 1);
+
 			state->nz = (1 << k);
 
 			state->kp += 4;
@@ -882,25 +1069,17 @@ INT16 progressive_rfx_srl_read(RFX_PROGRESSIVE_UPGRADE_STATE* state, UINT32 numB
 			state->nz--;
 			return 0;
 		}
-		else
-		{
-			/* '1' bit, nz < (1 << k), nz = next k bits */
 
-			state->nz = 0;
-			state->mode = 1; /* unary encoding is next */
+		/* '1' bit, nz < (1 << k), nz = next k bits */
 
-			if (k)
-			{
-				bs->mask = ((1 << k) - 1);
-				state->nz = ((bs->accumulator >> (32 - k)) & bs->mask);
-				BitStream_Shift(bs, k);
-			}
+		state->mode = 1; /* unary encoding is next */
+		state->nz = k ? (int) ((bits >> (31 - k)) & ((1 << k) - 1)) : 0;
+		progressive_bit_reader_skip(br, 1 + k);
 
-			if (state->nz)
-			{
-				state->nz--;
-				return 0;
-			}
+		if (state->nz)
+		{
+			state->nz--;
+			return 0;
 		}
 	}
 
@@ -910,8 +1089,7 @@ INT16 progressive_rfx_srl_read(RFX_PROGRESSIVE_UPGRADE_STATE* state, UINT32 numB
 
 	/* read sign bit */
 
-	sign = (bs->accumulator & 0x80000000) ? 1 : 0;
-	BitStream_Shift(bs, 1);
+	sign = progressive_bit_reader_read(br, 1);
 
 	state->kp -= 6;
 
@@ -924,69 +1102,72 @@ INT16 progressive_rfx_srl_read(RFX_PROGRESSIVE_UPGRADE_STATE* state, UINT32 numB
 	mag = 1;
 	max = (1 << numBits) - 1;
 
+	/* magnitude: '0' bits up to the terminating '1' bit, or until max is reached */
+
 	while (mag < max)
 	{
-		bit = (bs->accumulator & 0x80000000) ? 1 : 0;
-		BitStream_Shift(bs, 1);
+		run = progressive_srl_zero_run[progressive_bit_reader_peek(br) >> 24];
 
-		if (bit)
+		if (run >= (max - mag))
+		{
+			progressive_bit_reader_skip(br, max - mag);
+			mag = max;
+			break;
+		}
+
+		if (run < 8)
+		{
+			progressive_bit_reader_skip(br, run + 1);
+			mag += run;
 			break;
+		}
 
-		mag++;
+		progressive_bit_reader_skip(br, 8);
+		mag += 8;
 	}
 
 	return sign ? -mag : mag;
 }
 
-int progressive_rfx_upgrade_state_finish(RFX_PROGRESSIVE_UPGRADE_STATE* state)
+static int progressive_rfx_upgrade_state_finish(RFX_PROGRESSIVE_UPGRADE_STATE* state)
 {
 	int pad;
-	wBitStream* srl;
-	wBitStream* raw;
-
-	srl = state->srl;
-	raw = state->raw;
+	RFX_PROGRESSIVE_BIT_READER* srl = &state->srl;
+	RFX_PROGRESSIVE_BIT_READER* raw = &state->raw;
 
 	/* Read trailing bits from RAW/SRL bit streams */
 
 	pad = (raw->position % 8) ? (8 - (raw->position % 8)) : 0;
 
 	if (pad)
-		BitStream_Shift(raw, pad);
+		progressive_bit_reader_read(raw, pad);
 
 	pad = (srl->position % 8) ? (8 - (srl->position % 8)) : 0;
 
 	if (pad)
-		BitStream_Shift(srl, pad);
+		progressive_bit_reader_read(srl, pad);
 
-	if (BitStream_GetRemainingLength(srl) == 8)
-		BitStream_Shift(srl, 8);
+	if (((srl->length * 8) - srl->position) == 8)
+		progressive_bit_reader_read(srl, 8);
 
 	return 1;
 }
 
-int progressive_rfx_upgrade_block(RFX_PROGRESSIVE_UPGRADE_STATE* state, INT16* buffer,
+static int progressive_rfx_upgrade_block(RFX_PROGRESSIVE_UPGRADE_STATE* state, INT16* buffer,
 		INT16* sign, int length, UINT32 shift, UINT32 bitPos, UINT32 numBits)
 {
 	int index;
 	INT16 input;
-	wBitStream* srl;
-	wBitStream* raw;
+	RFX_PROGRESSIVE_BIT_READER* raw = &state->raw;
 
 	if (!numBits)
 		return 1;
 
-	srl = state->srl;
-	raw = state->raw;
-
 	if (!state->nonLL)
 	{
 		for (index = 0; index < length; index++)
 		{
-			raw->mask = ((1 << numBits) - 1);
-			input = (INT16) ((raw->accumulator >> (32 - numBits)) & raw->mask);
-			BitStream_Shift(raw, numBits);
-
+			input = (INT16) progressive_bit_reader_read(raw, numBits);
 			buffer[index] += (input << shift);
 		}
 
@@ -999,20 +1180,22 @@ int progressive_rfx_upgrade_block(RFX_PROGRESSIVE_UPGRADE_STATE* state, INT16* b
 		{
 			/* sign > 0, read from raw */
 
-			raw->mask = ((1 << numBits) - 1);
-			input = (INT16) ((raw->accumulator >> (32 - numBits)) & raw->mask);
-			BitStream_Shift(raw, numBits);
+			input = (INT16) progressive_bit_reader_read(raw, numBits);
 		}
 		else if (sign[index] < 0)
 		{
 			/* sign < 0, read from raw */
 
-			raw->mask = ((1 << numBits) - 1);
-			input = (INT16) ((raw->accumulator >> (32 - numBits)) & raw->mask);
-			BitStream_Shift(raw, numBits);
-
+			input = (INT16) progressive_bit_reader_read(raw, numBits);
 			input *= -1;
 		}
+		else if (state->nz)
+		{
+			/* sign == 0, within a run of zeros */
+
+			state->nz--;
+			continue;
+		}
 		else
 		{
 			/* sign == 0, read from srl */
@@ -1029,30 +1212,20 @@ int progressive_rfx_upgrade_block(RFX_PROGRESSIVE_UPGRADE_STATE* state, INT16* b
 }
 
 int progressive_rfx_upgrade_component(PROGRESSIVE_CONTEXT* progressive, RFX_COMPONENT_CODEC_QUANT* shift,
-		RFX_COMPONENT_CODEC_QUANT* bitPos, RFX_COMPONENT_CODEC_QUANT* numBits, INT16* buffer,
+		RFX_COMPONENT_CODEC_QUANT* bitPos, RFX_COMPONENT_CODEC_QUANT* numBits, INT16* buffer, INT16* temp,
 		INT16* current, INT16* sign, const BYTE* srlData, int srlLen, const BYTE* rawData, int rawLen)
 {
-	INT16* temp;
 	int aRawLen;
 	int aSrlLen;
-	wBitStream s_srl;
-	wBitStream s_raw;
 	RFX_PROGRESSIVE_UPGRADE_STATE state;
 
-	ZeroMemory(&s_srl, sizeof(wBitStream));
-	ZeroMemory(&s_raw, sizeof(wBitStream));
 	ZeroMemory(&state, sizeof(RFX_PROGRESSIVE_UPGRADE_STATE));
 
 	state.kp = 8;
 	state.mode = 0;
-	state.srl = &s_srl;
-	state.raw = &s_raw;
 
-	BitStream_Attach(state.srl, srlData, srlLen);
-	BitStream_Fetch(state.srl);
-
-	BitStream_Attach(state.raw, rawData, rawLen);
-	BitStream_Fetch(state.raw);
+	progressive_bit_reader_attach(&state.srl, srlData, srlLen);
+	progressive_bit_reader_attach(&state.raw, rawData, rawLen);
 
 	state.nonLL = TRUE;
 	progressive_rfx_upgrade_block(&state, &current[0], &sign[0], 1023, shift->HL1, bitPos->HL1, numBits->HL1); /* HL1 */
@@ -1069,8 +1242,8 @@ int progressive_rfx_upgrade_component(PROGRESSIVE_CONTEXT* progressive, RFX_COMP
 	progressive_rfx_upgrade_block(&state, &current[4015], &sign[4015], 81, shift->LL3, bitPos->LL3, numBits->LL3); /* LL3 */
 	progressive_rfx_upgrade_state_finish(&state);
 
-	aRawLen = (state.raw->position + 7) / 8;
-	aSrlLen = (state.srl->position + 7) / 8;
+	aRawLen = (state.raw.position + 7) / 8;
+	aSrlLen = (state.srl.position + 7) / 8;
 
 	if ((aRawLen != rawLen) || (aSrlLen != srlLen))
 	{
@@ -1084,28 +1257,24 @@ int progressive_rfx_upgrade_component(PROGRESSIVE_CONTEXT* progressive, RFX_COMP
 			pSrlLen = (int) ((((float) aSrlLen) / ((float) srlLen)) * 100.0f);
 
 		WLog_INFO(TAG, "RAW: %d/%d %d%% (%d/%d:%d)\tSRL: %d/%d %d%% (%d/%d:%d)",
-			aRawLen, rawLen, pRawLen, state.raw->position, rawLen * 8,
-			(rawLen * 8) - state.raw->position,
-			aSrlLen, srlLen, pSrlLen, state.srl->position, srlLen * 8,
-			(srlLen * 8) - state.srl->position);
+			aRawLen, rawLen, pRawLen, state.raw.position, rawLen * 8,
+			(rawLen * 8) - state.raw.position,
+			aSrlLen, srlLen, pSrlLen, state.srl.position, srlLen * 8,
+			(srlLen * 8) - state.srl.position);
 
 		return -1;
 	}
 
-	temp = (INT16*) BufferPool_Take(progressive->bufferPool, -1); /* DWT buffer */
-
 	CopyMemory(buffer, current, 4096 * 2);
 
-	progressive_rfx_dwt_2d_decode_block(&buffer[3807], temp, 3);
-	progressive_rfx_dwt_2d_decode_block(&buffer[3007], temp, 2);
-	progressive_rfx_dwt_2d_decode_block(&buffer[0], temp, 1);
-
-	BufferPool_Return(progressive->bufferPool, temp);
+	progressive_rfx_dwt_2d_decode_block(progressive, &buffer[3807], temp, 3);
+	progressive_rfx_dwt_2d_decode_block(progressive, &buffer[3007], temp, 2);
+	progressive_rfx_dwt_2d_decode_block(progressive, &buffer[0], temp, 1);
 
 	return 1;
 }
 
-int progressive_decompress_tile_upgrade(PROGRESSIVE_CONTEXT* progressive, RFX_PROGRESSIVE_TILE* tile)
+int progressive_decompress_tile_upgrade(PROGRESSIVE_TILE_WORKER* worker, RFX_PROGRESSIVE_TILE* tile)
 {
 	int status;
 	BYTE* pBuffer;
@@ -1129,8 +1298,10 @@ int progressive_decompress_tile_upgrade(PROGRESSIVE_CONTEXT* progressive, RFX_PR
 	RFX_COMPONENT_CODEC_QUANT* quantProgCb;
 	RFX_COMPONENT_CODEC_QUANT* quantProgCr;
 	RFX_PROGRESSIVE_CODEC_QUANT* quantProg;
-	static const prim_size_t roi_64x64 = { 64, 64 };
-	const primitives_t* prims = primitives_get();
+	PROGRESSIVE_CONTEXT* progressive = worker->progressive;
+
+	if (!tile->sign || !tile->current)
+		return -1; /* upgrade without a preceding first pass */
 
 	tile->pass++;
 
@@ -1216,49 +1387,88 @@ int progressive_decompress_tile_upgrade(PROGRESSIVE_CONTEXT* progressive, RFX_PR
 	pCurrent[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
 	pCurrent[2] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
 
-	pBuffer = (BYTE*) BufferPool_Take(progressive->bufferPool, -1);
+	pBuffer = worker->buffer;
 	pSrcDst[0] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 0) + 16])); /* Y/R buffer */
 	pSrcDst[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
 	pSrcDst[2] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
 
-	status = progressive_rfx_upgrade_component(progressive, &shiftY, quantProgY, &yNumBits,
-			pSrcDst[0], pCurrent[0], pSign[0], tile->ySrlData, tile->ySrlLen, tile->yRawData, tile->yRawLen); /* Y */
+	status = progressive_rfx_upgrade_component(progressive, &shiftY, quantProgY, &yNumBits, pSrcDst[0], worker->temp,
+			pCurrent[0], pSign[0], tile->ySrlData, tile->ySrlLen, tile->yRawData, tile->yRawLen); /* Y */
 
 	if (status < 0)
 		return -1;
 
-	status = progressive_rfx_upgrade_component(progressive, &shiftCb, quantProgCb, &cbNumBits,
-			pSrcDst[1], pCurrent[1], pSign[1], tile->cbSrlData, tile->cbSrlLen, tile->cbRawData, tile->cbRawLen); /* Cb */
+	status = progressive_rfx_upgrade_component(progressive, &shiftCb, quantProgCb, &cbNumBits, pSrcDst[1], worker->temp,
+			pCurrent[1], pSign[1], tile->cbSrlData, tile->cbSrlLen, tile->cbRawData, tile->cbRawLen); /* Cb */
 
 	if (status < 0)
 		return -1;
 
-	status = progressive_rfx_upgrade_component(progressive, &shiftCr, quantProgCr, &crNumBits,
-			pSrcDst[2], pCurrent[2], pSign[2], tile->crSrlData, tile->crSrlLen, tile->crRawData, tile->crRawLen); /* Cr */
+	status = progressive_rfx_upgrade_component(progressive, &shiftCr, quantProgCr, &crNumBits, pSrcDst[2], worker->temp,
+			pCurrent[2], pSign[2], tile->crSrlData, tile->crSrlLen, tile->crRawData, tile->crRawLen); /* Cr */
 
 	if (status < 0)
 		return -1;
 
-	if (!progressive->invert)
-		prims->yCbCrToRGB_16s8u_P3AC4R((const INT16**) pSrcDst, 64 * 2, tile->data, 64 * 4, &roi_64x64);
-	else
-		prims->yCbCrToBGR_16s8u_P3AC4R((const INT16**) pSrcDst, 64 * 2, tile->data, 64 * 4, &roi_64x64);
-
-	BufferPool_Return(progressive->bufferPool, pBuffer);
+	progressive_tile_write(worker, tile, pSrcDst);
 
 	//WLog_Image(progressive->log, WLOG_TRACE, tile->data, 64, 64, 32);
 
 	return 1;
 }
 
-int progressive_process_tiles(PROGRESSIVE_CONTEXT* progressive, BYTE* blocks, UINT32 blocksLen, PROGRESSIVE_SURFACE_CONTEXT* surface)
+static int progressive_tile_worker_run(PROGRESSIVE_TILE_WORKER* worker)
 {
-	int status = -1;
+	int status = 1;
+	UINT32 index;
+	UINT32 zIdx;
+	RFX_PROGRESSIVE_TILE* tile;
+	PROGRESSIVE_TILE_JOB* job = worker->job;
+
+	for (index = 0; index < job->numTiles; index++)
+	{
+		tile = job->tiles[index];
+		zIdx = (UINT32) (tile - job->surface->tiles);
+
+		if ((zIdx % job->numWorkers) != worker->index)
+			continue;
+
+		switch (tile->blockType)
+		{
+			case PROGRESSIVE_WBT_TILE_SIMPLE:
+			case PROGRESSIVE_WBT_TILE_FIRST:
+				status = progressive_decompress_tile_first(worker, tile);
+				break;
+
+			case PROGRESSIVE_WBT_TILE_UPGRADE:
+				status = progressive_decompress_tile_upgrade(worker, tile);
+				break;
+		}
+
+		if (status < 0)
+			return -1;
+	}
+
+	return 1;
+}
+
+void CALLBACK progressive_tile_work_callback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
+{
+	PROGRESSIVE_TILE_WORKER* worker = (PROGRESSIVE_TILE_WORKER*) context;
+
+	worker->status = progressive_tile_worker_run(worker);
+}
+
+int progressive_process_tiles(PROGRESSIVE_CONTEXT* progressive, BYTE* blocks, UINT32 blocksLen,
+		PROGRESSIVE_SURFACE_CONTEXT* surface, PROGRESSIVE_TILE_JOB* job)
+{
+	int status = 1;
 	BYTE* block;
 	UINT16 xIdx;
 	UINT16 yIdx;
 	UINT16 zIdx;
-	UINT16 index;
+	UINT32 index;
+	UINT32 numWorkers;
 	UINT32 boffset;
 	UINT16 blockType;
 	UINT32 blockLen;
@@ -1286,6 +1496,9 @@ int progressive_process_tiles(PROGRESSIVE_CONTEXT* progressive, BYTE* blocks, UI
 		if ((blocksLen - offset) < blockLen)
 			return -1003;
 
+		if (count >= region->numTiles)
+			return -1042;
+
 		switch (blockType)
 		{
 			case PROGRESSIVE_WBT_TILE_SIMPLE:
@@ -1507,26 +1720,40 @@ int progressive_process_tiles(PROGRESSIVE_CONTEXT* progressive, BYTE* blocks, UI
 	if (offset != blocksLen)
 		return -1041;
 
-	for (index = 0; index < region->numTiles; index++)
+	region->numTiles = count;
+
+	numWorkers = progressive->UseThreads ? MIN(progressive->numWorkers, count) : 1;
+
+	job->surface = surface;
+	job->tiles = tiles;
+	job->numTiles = count;
+	job->numWorkers = numWorkers ? numWorkers : 1;
+
+	for (index = 0; index < job->numWorkers; index++)
+		progressive->workers[index].job = job;
+
+	if (job->numWorkers > 1)
 	{
-		tile = tiles[index];
+		for (index = 0; index < job->numWorkers; index++)
+			SubmitThreadpoolWork(progressive->workers[index].work);
 
-		switch (tile->blockType)
-		{
-			case PROGRESSIVE_WBT_TILE_SIMPLE:
-			case PROGRESSIVE_WBT_TILE_FIRST:
-				status = progressive_decompress_tile_first(progressive, tile);
-				break;
+		for (index = 0; index < job->numWorkers; index++)
+			WaitForThreadpoolWorkCallbacks(progressive->workers[index].work, FALSE);
 
-			case PROGRESSIVE_WBT_TILE_UPGRADE:
-				status = progressive_decompress_tile_upgrade(progressive, tile);
-				break;
+		for (index = 0; index < job->numWorkers; index++)
+		{
+			if (progressive->workers[index].status < 0)
+				status = -1;
 		}
-
-		if (status < 0)
-			return -1;
+	}
+	else
+	{
+		status = progressive_tile_worker_run(&(progressive->workers[0]));
 	}
 
+	if (status < 0)
+		return -1;
+
 	return (int) offset;
 }
 
@@ -1544,6 +1771,9 @@ int progressive_decompress(PROGRESSIVE_CONTEXT* progressive, BYTE* pSrcData, UIN
 	UINT32 count = 0;
 	UINT32 offset = 0;
 	RFX_RECT* rect = NULL;
+	RECTANGLE_16 clippingRect;
+	RECTANGLE_16 surfaceRect;
+	PROGRESSIVE_TILE_JOB job;
 	PROGRESSIVE_BLOCK_SYNC sync;
 	PROGRESSIVE_BLOCK_REGION* region;
 	PROGRESSIVE_BLOCK_CONTEXT context;
@@ -1560,6 +1790,20 @@ int progressive_decompress(PROGRESSIVE_CONTEXT* progressive, BYTE* pSrcData, UIN
 	if (!surface)
 		return -1001;
 
+	ZeroMemory(&job, sizeof(PROGRESSIVE_TILE_JOB));
+
+	job.pDstData = ppDstData ? *ppDstData : NULL;
+	job.DstFormat = DstFormat;
+	job.SrcFormat = progressive->invert ? PIXEL_FORMAT_XBGR32 : PIXEL_FORMAT_XRGB32;
+	job.nDstStep = nDstStep;
+	job.nXDst = nXDst;
+	job.nYDst = nYDst;
+
+	surfaceRect.left = 0;
+	surfaceRect.top = 0;
+	surfaceRect.right = surface->width;
+	surfaceRect.bottom = surface->height;
+
 	blocks = pSrcData;
 	blocksLen = SrcSize;
 
@@ -1770,7 +2014,24 @@ int progressive_decompress(PROGRESSIVE_CONTEXT* progressive, BYTE* pSrcData, UIN
 				//WLog_INFO(TAG, "numRects: %d numTiles: %d numQuant: %d numProgQuant: %d",
 				//		region->numRects, region->numTiles, region->numQuant, region->numProgQuant);
 
-				status = progressive_process_tiles(progressive, &block[boffset], region->tileDataSize, surface);
+				region16_init(&(job.clippingRects));
+
+				for (index = 0; index < region->numRects; index++)
+				{
+					rect = &(region->rects[index]);
+
+					clippingRect.left = nXDst + rect->x;
+					clippingRect.top = nYDst + rect->y;
+					clippingRect.right = clippingRect.left + rect->width;
+					clippingRect.bottom = clippingRect.top + rect->height;
+
+					if (rectangles_intersection(&clippingRect, &surfaceRect, &clippingRect))
+						region16_union_rect(&(job.clippingRects), &(job.clippingRects), &clippingRect);
+				}
+
+				status = progressive_process_tiles(progressive, &block[boffset], region->tileDataSize, surface, &job);
+
+				region16_uninit(&(job.clippingRects));
 
 				if (status < 0)
 					return status;
@@ -1807,6 +2068,139 @@ int progressive_context_reset(PROGRESSIVE_CONTEXT* progressive)
 	return 1;
 }
 
+static BOOL progressive_workers_new(PROGRESSIVE_CONTEXT* progressive)
+{
+	HKEY hKey;
+	LONG status;
+	DWORD dwType;
+	DWORD dwSize;
+	DWORD dwValue;
+	UINT32 index;
+	SYSTEM_INFO sysinfo;
+	DWORD MinThreadCount;
+	DWORD MaxThreadCount = 0;
+	PROGRESSIVE_TILE_WORKER* worker;
+
+	GetNativeSystemInfo(&sysinfo);
+
+	progressive->UseThreads = TRUE;
+	MinThreadCount = sysinfo.dwNumberOfProcessors;
+
+	status = RegOpenKeyEx(HKEY_LOCAL_MACHINE, _T("Software\\FreeRDP\\Progressive"), 0, KEY_READ | KEY_WOW64_64KEY, &hKey);
+
+	if (status == ERROR_SUCCESS)
+	{
+		dwSize = sizeof(dwValue);
+
+		if (RegQueryValueEx(hKey, _T("UseThreads"), NULL, &dwType, (BYTE*) &dwValue, &dwSize) == ERROR_SUCCESS)
+			progressive->UseThreads = dwValue ? 1 : 0;
+
+		if (RegQueryValueEx(hKey, _T("MinThreadCount"), NULL, &dwType, (BYTE*) &dwValue, &dwSize) == ERROR_SUCCESS)
+			MinThreadCount = dwValue;
+
+		if (RegQueryValueEx(hKey, _T("MaxThreadCount"), NULL, &dwType, (BYTE*) &dwValue, &dwSize) == ERROR_SUCCESS)
+			MaxThreadCount = dwValue;
+
+		RegCloseKey(hKey);
+	}
+
+	progressive->numWorkers = 1;
+
+	if (progressive->UseThreads && (sysinfo.dwNumberOfProcessors > 1))
+	{
+		progressive->numWorkers = sysinfo.dwNumberOfProcessors;
+
+		if (MaxThreadCount && (progressive->numWorkers > MaxThreadCount))
+			progressive->numWorkers = MaxThreadCount;
+	}
+	else
+	{
+		progressive->UseThreads = FALSE;
+	}
+
+	progressive->workers = (PROGRESSIVE_TILE_WORKER*) calloc(progressive->numWorkers, sizeof(PROGRESSIVE_TILE_WORKER));
+
+	if (!progressive->workers)
+		return FALSE;
+
+	if (progressive->UseThreads)
+	{
+		/* initialize the primitives before any decoding thread can race on it */
+		primitives_get();
+
+		progressive->ThreadPool = CreateThreadpool(NULL);
+
+		if (!progressive->ThreadPool)
+			return FALSE;
+
+		InitializeThreadpoolEnvironment(&progressive->ThreadPoolEnv);
+		SetThreadpoolCallbackPool(&progressive->ThreadPoolEnv, progressive->ThreadPool);
+
+		if (MinThreadCount)
+			SetThreadpoolThreadMinimum(progressive->ThreadPool, MinThreadCount);
+
+		if (MaxThreadCount)
+			SetThreadpoolThreadMaximum(progressive->ThreadPool, MaxThreadCount);
+	}
+
+	for (index = 0; index < progressive->numWorkers; index++)
+	{
+		worker = &(progressive->workers[index]);
+
+		worker->index = index;
+		worker->progressive = progressive;
+
+		worker->buffer = (BYTE*) _aligned_malloc((8192 + 32) * 3, 16);
+		worker->temp = (INT16*) _aligned_malloc(8192 + 32, 16);
+		worker->image = (BYTE*) _aligned_malloc(64 * 64 * 4, 16);
+
+		if (!worker->buffer || !worker->temp || !worker->image)
+			return FALSE;
+
+		if (progressive->UseThreads)
+		{
+			worker->work = CreateThreadpoolWork((PTP_WORK_CALLBACK) progressive_tile_work_callback,
+					(void*) worker, &progressive->ThreadPoolEnv);
+
+			if (!worker->work)
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static void progressive_workers_free(PROGRESSIVE_CONTEXT* progressive)
+{
+	UINT32 index;
+	PROGRESSIVE_TILE_WORKER* worker;
+
+	if (progressive->workers)
+	{
+		for (index = 0; index < progressive->numWorkers; index++)
+		{
+			worker = &(progressive->workers[index]);
+
+			if (worker->work)
+				CloseThreadpoolWork(worker->work);
+
+			_aligned_free(worker->buffer);
+			_aligned_free(worker->temp);
+			_aligned_free(worker->image);
+		}
+
+		free(progressive->workers);
+		progressive->workers = NULL;
+	}
+
+	if (progressive->ThreadPool)
+	{
+		CloseThreadpool(progressive->ThreadPool);
+		DestroyThreadpoolEnvironment(&progressive->ThreadPoolEnv);
+		progressive->ThreadPool = NULL;
+	}
+}
+
 PROGRESSIVE_CONTEXT* progressive_context_new(BOOL Compressor)
 {
 	PROGRESSIVE_CONTEXT* progressive;
@@ -1819,7 +2213,13 @@ PROGRESSIVE_CONTEXT* progressive_context_new(BOOL Compressor)
 
 		progressive->log = WLog_Get(TAG);
 
-		progressive->bufferPool = BufferPool_New(TRUE, (8192 + 32) * 3, 16);
+		progressive->idwt_x = progressive_rfx_idwt_x;
+		progressive->idwt_y = progressive_rfx_idwt_y;
+
+		PROGRESSIVE_INIT_SIMD(progressive);
+
+		if (!progressive_workers_new(progressive))
+			goto cleanup;
 
 		progressive->cRects = 64;
 		progressive->rects = (RFX_RECT*) malloc(progressive->cRects * sizeof(RFX_RECT));
@@ -1856,6 +2256,7 @@ PROGRESSIVE_CONTEXT* progressive_context_new(BOOL Compressor)
 	return progressive;
 
 cleanup:
+	progressive_workers_free(progressive);
 	if (progressive->rects)
 		free(progressive->rects);
 	if (progressive->tiles)
@@ -1879,7 +2280,7 @@ void progressive_context_free(PROGRESSIVE_CONTEXT* progressive)
 	if (!progressive)
 		return;
 
-	BufferPool_Free(progressive->bufferPool);
+	progressive_workers_free(progressive);
 
 	free(progressive->rects);
 	free(progressive->tiles);
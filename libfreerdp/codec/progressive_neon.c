@@ -0,0 +1,262 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Progressive Codec Bitmap Compression - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+#include <winpr/sysinfo.h>
+
+#include "progressive_neon.h"
+
+/* longest band row handled by the vectorized horizontal pass (level 1 is 33 + 31) */
+#define PROGRESSIVE_IDWT_MAX_BAND	64
+
+/**
+ * (a + b) / 2 and a / 2 rounded toward zero like the generic code,
+ * see progressive_sse2.c
+ */
+
+static __inline int16x8_t __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+vavgtruncq_s16(int16x8_t a, int16x8_t b)
+{
+	int16x8_t x = veorq_s16(a, b);
+	int16x8_t f = vaddq_s16(vandq_s16(a, b), vshrq_n_s16(x, 1));
+	int16x8_t c = vreinterpretq_s16_u16(vshrq_n_u16(vreinterpretq_u16_s16(f), 15));
+
+	return vaddq_s16(f, vandq_s16(x, c));
+}
+
+static __inline int16x8_t __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+vhalftruncq_s16(int16x8_t a)
+{
+	int16x8_t c = vreinterpretq_s16_u16(vshrq_n_u16(vreinterpretq_u16_s16(a), 15));
+
+	return vshrq_n_s16(vaddq_s16(a, c), 1);
+}
+
+static void progressive_rfx_idwt_x_NEON(INT16* pLowBand, int nLowStep, INT16* pHighBand, int nHighStep,
+		INT16* pDstBand, int nDstStep, int nLowCount, int nHighCount, int nDstCount)
+{
+	int i, j, n;
+	INT16 L0;
+	INT16 H0;
+	INT16 X0, X2;
+	INT16 *pL, *pH, *pX;
+	int16x8_t h0, h1, l0;
+	int16x8_t x0, x2;
+	int16x8x2_t x01;
+	INT16 X[PROGRESSIVE_IDWT_MAX_BAND + 8];
+
+	n = nHighCount - 1;
+
+	if ((n < 0) || (n >= PROGRESSIVE_IDWT_MAX_BAND))
+	{
+		progressive_rfx_idwt_x(pLowBand, nLowStep, pHighBand, nHighStep,
+				pDstBand, nDstStep, nLowCount, nHighCount, nDstCount);
+		return;
+	}
+
+	for (i = 0; i < nDstCount; i++)
+	{
+		pL = pLowBand;
+		pH = pHighBand;
+		pX = pDstBand;
+
+		X[0] = pL[0] - pH[0];
+
+		for (j = 0; (j + 8) <= n; j += 8)
+		{
+			h0 = vld1q_s16(&pH[j]);
+			h1 = vld1q_s16(&pH[j + 1]);
+			l0 = vld1q_s16(&pL[j + 1]);
+
+			x2 = vsubq_s16(l0, vavgtruncq_s16(h0, h1));
+			vst1q_s16(&X[j + 1], x2);
+		}
+
+		for (; j < n; j++)
+			X[j + 1] = pL[j + 1] - ((pH[j] + pH[j + 1]) / 2);
+
+		for (j = 0; (j + 8) <= n; j += 8)
+		{
+			x0 = vld1q_s16(&X[j]);
+			x2 = vld1q_s16(&X[j + 1]);
+			h0 = vld1q_s16(&pH[j]);
+
+			x01.val[0] = x0;
+			x01.val[1] = vaddq_s16(vavgtruncq_s16(x0, x2), vshlq_n_s16(h0, 1));
+
+			vst2q_s16(&pX[2 * j], x01);
+		}
+
+		for (; j < n; j++)
+		{
+			pX[2 * j] = X[j];
+			pX[(2 * j) + 1] = ((X[j] + X[j + 1]) / 2) + (2 * pH[j]);
+		}
+
+		X0 = X[n];
+		X2 = X[n];
+		H0 = pH[n];
+		pL += n + 1;
+		pX += 2 * n;
+
+		if (nLowCount <= (nHighCount + 1))
+		{
+			if (nLowCount <= nHighCount)
+			{
+				pX[0] = X2;
+				pX[1] = X2 + (2 * H0);
+			}
+			else
+			{
+				L0 = *pL;
+				X0 = L0 - H0;
+
+				pX[0] = X2;
+				pX[1] = ((X0 + X2) / 2) + (2 * H0);
+				pX[2] = X0;
+			}
+		}
+		else
+		{
+			L0 = pL[0];
+			X0 = L0 - (H0 / 2);
+
+			pX[0] = X2;
+			pX[1] = ((X0 + X2) / 2) + (2 * H0);
+			pX[2] = X0;
+
+			L0 = pL[1];
+			pX[3] = (X0 + L0) / 2;
+		}
+
+		pLowBand += nLowStep;
+		pHighBand += nHighStep;
+		pDstBand += nDstStep;
+	}
+}
+
+static void progressive_rfx_idwt_y_NEON(INT16* pLowBand, int nLowStep, INT16* pHighBand, int nHighStep,
+		INT16* pDstBand, int nDstStep, int nLowCount, int nHighCount, int nDstCount)
+{
+	int i, j;
+	INT16 *pL, *pH, *pX;
+	int16x8_t l0, h0, h1;
+	int16x8_t x0, x1, x2;
+
+	for (i = 0; (i + 8) <= nDstCount; i += 8)
+	{
+		pL = &pLowBand[i];
+		pH = &pHighBand[i];
+		pX = &pDstBand[i];
+
+		h0 = vld1q_s16(pH);
+		pH += nHighStep;
+
+		l0 = vld1q_s16(pL);
+		pL += nLowStep;
+
+		x0 = vsubq_s16(l0, h0);
+		x2 = x0;
+
+		for (j = 0; j < (nHighCount - 1); j++)
+		{
+			h1 = vld1q_s16(pH);
+			pH += nHighStep;
+
+			l0 = vld1q_s16(pL);
+			pL += nLowStep;
+
+			x2 = vsubq_s16(l0, vavgtruncq_s16(h0, h1));
+			x1 = vaddq_s16(vavgtruncq_s16(x0, x2), vshlq_n_s16(h0, 1));
+
+			vst1q_s16(pX, x0);
+			pX += nDstStep;
+
+			vst1q_s16(pX, x1);
+			pX += nDstStep;
+
+			x0 = x2;
+			h0 = h1;
+		}
+
+		if (nLowCount <= (nHighCount + 1))
+		{
+			if (nLowCount <= nHighCount)
+			{
+				vst1q_s16(pX, x2);
+				pX += nDstStep;
+
+				vst1q_s16(pX, vaddq_s16(x2, vshlq_n_s16(h0, 1)));
+			}
+			else
+			{
+				l0 = vld1q_s16(pL);
+				x0 = vsubq_s16(l0, h0);
+
+				vst1q_s16(pX, x2);
+				pX += nDstStep;
+
+				vst1q_s16(pX, vaddq_s16(vavgtruncq_s16(x0, x2), vshlq_n_s16(h0, 1)));
+				pX += nDstStep;
+
+				vst1q_s16(pX, x0);
+			}
+		}
+		else
+		{
+			l0 = vld1q_s16(pL);
+			pL += nLowStep;
+
+			x0 = vsubq_s16(l0, vhalftruncq_s16(h0));
+
+			vst1q_s16(pX, x2);
+			pX += nDstStep;
+
+			vst1q_s16(pX, vaddq_s16(vavgtruncq_s16(x0, x2), vshlq_n_s16(h0, 1)));
+			pX += nDstStep;
+
+			vst1q_s16(pX, x0);
+			pX += nDstStep;
+
+			l0 = vld1q_s16(pL);
+			vst1q_s16(pX, vavgtruncq_s16(x0, l0));
+		}
+	}
+
+	if (i < nDstCount)
+	{
+		progressive_rfx_idwt_y(&pLowBand[i], nLowStep, &pHighBand[i], nHighStep,
+				&pDstBand[i], nDstStep, nLowCount, nHighCount, nDstCount - i);
+	}
+}
+
+void progressive_init_neon(PROGRESSIVE_CONTEXT* progressive)
+{
+	if (!IsProcessorFeaturePresent(PF_ARM_NEON_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	progressive->idwt_x = progressive_rfx_idwt_x_NEON;
+	progressive->idwt_y = progressive_rfx_idwt_y_NEON;
+}
+
+#endif /* __ARM_NEON__ */
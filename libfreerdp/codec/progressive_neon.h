@@ -0,0 +1,31 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Progressive Codec Bitmap Compression - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PROGRESSIVE_NEON_H
+#define __PROGRESSIVE_NEON_H
+
+#include <freerdp/codec/progressive.h>
+
+void progressive_init_neon(PROGRESSIVE_CONTEXT* progressive);
+
+#ifndef PROGRESSIVE_INIT_SIMD
+ #if defined(WITH_NEON) && defined(WITH_NEON_PROGRESSIVE)
+  #define PROGRESSIVE_INIT_SIMD(_progressive) progressive_init_neon(_progressive)
+ #endif
+#endif
+
+#endif /* __PROGRESSIVE_NEON_H */
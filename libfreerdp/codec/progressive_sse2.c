@@ -0,0 +1,278 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Progressive Codec Bitmap Compression - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include "progressive_sse2.h"
+
+#ifdef _MSC_VER
+#define	__attribute__(...)
+#endif
+
+#ifndef __clang__
+#define ATTRIBUTES  __gnu_inline__, __always_inline__, __artificial__
+#else
+#define ATTRIBUTES __gnu_inline__, __always_inline__
+#endif
+
+/* longest band row handled by the vectorized horizontal pass (level 1 is 33 + 31) */
+#define PROGRESSIVE_IDWT_MAX_BAND	64
+
+/**
+ * The generic code works on promoted integers and truncates the result,
+ * so (a + b) / 2 rounds toward zero and never overflows. Reproduce that
+ * exactly in 16-bit lanes: floor average first, then add one back for
+ * negative odd sums.
+ */
+
+static __inline __m128i __attribute__((ATTRIBUTES))
+_mm_avg_trunc_epi16(__m128i a, __m128i b)
+{
+	__m128i x = _mm_xor_si128(a, b);
+	__m128i f = _mm_add_epi16(_mm_and_si128(a, b), _mm_srai_epi16(x, 1));
+
+	return _mm_add_epi16(f, _mm_and_si128(x, _mm_srli_epi16(f, 15)));
+}
+
+static __inline __m128i __attribute__((ATTRIBUTES))
+_mm_half_trunc_epi16(__m128i a)
+{
+	return _mm_srai_epi16(_mm_add_epi16(a, _mm_srli_epi16(a, 15)), 1);
+}
+
+static void progressive_rfx_idwt_x_sse2(INT16* pLowBand, int nLowStep, INT16* pHighBand, int nHighStep,
+		INT16* pDstBand, int nDstStep, int nLowCount, int nHighCount, int nDstCount)
+{
+	int i, j, n;
+	INT16 L0;
+	INT16 H0;
+	INT16 X0, X2;
+	INT16 *pL, *pH, *pX;
+	__m128i h0, h1, l0;
+	__m128i x0, x1, x2;
+	INT16 X[PROGRESSIVE_IDWT_MAX_BAND + 8];
+
+	n = nHighCount - 1;
+
+	if ((n < 0) || (n >= PROGRESSIVE_IDWT_MAX_BAND))
+	{
+		progressive_rfx_idwt_x(pLowBand, nLowStep, pHighBand, nHighStep,
+				pDstBand, nDstStep, nLowCount, nHighCount, nDstCount);
+		return;
+	}
+
+	for (i = 0; i < nDstCount; i++)
+	{
+		pL = pLowBand;
+		pH = pHighBand;
+		pX = pDstBand;
+
+		/* even samples: X[j + 1] = L[j + 1] - (H[j] + H[j + 1]) / 2 */
+
+		X[0] = pL[0] - pH[0];
+
+		for (j = 0; (j + 8) <= n; j += 8)
+		{
+			h0 = _mm_loadu_si128((__m128i*) &pH[j]);
+			h1 = _mm_loadu_si128((__m128i*) &pH[j + 1]);
+			l0 = _mm_loadu_si128((__m128i*) &pL[j + 1]);
+
+			x2 = _mm_sub_epi16(l0, _mm_avg_trunc_epi16(h0, h1));
+			_mm_storeu_si128((__m128i*) &X[j + 1], x2);
+		}
+
+		for (; j < n; j++)
+			X[j + 1] = pL[j + 1] - ((pH[j] + pH[j + 1]) / 2);
+
+		/* odd samples, interleaved with the even ones */
+
+		for (j = 0; (j + 8) <= n; j += 8)
+		{
+			x0 = _mm_loadu_si128((__m128i*) &X[j]);
+			x2 = _mm_loadu_si128((__m128i*) &X[j + 1]);
+			h0 = _mm_loadu_si128((__m128i*) &pH[j]);
+
+			x1 = _mm_add_epi16(_mm_avg_trunc_epi16(x0, x2), _mm_slli_epi16(h0, 1));
+
+			_mm_storeu_si128((__m128i*) &pX[2 * j], _mm_unpacklo_epi16(x0, x1));
+			_mm_storeu_si128((__m128i*) &pX[(2 * j) + 8], _mm_unpackhi_epi16(x0, x1));
+		}
+
+		for (; j < n; j++)
+		{
+			pX[2 * j] = X[j];
+			pX[(2 * j) + 1] = ((X[j] + X[j + 1]) / 2) + (2 * pH[j]);
+		}
+
+		/* right edge, same extrapolation as the generic version */
+
+		X0 = X[n];
+		X2 = X[n];
+		H0 = pH[n];
+		pL += n + 1;
+		pX += 2 * n;
+
+		if (nLowCount <= (nHighCount + 1))
+		{
+			if (nLowCount <= nHighCount)
+			{
+				pX[0] = X2;
+				pX[1] = X2 + (2 * H0);
+			}
+			else
+			{
+				L0 = *pL;
+				X0 = L0 - H0;
+
+				pX[0] = X2;
+				pX[1] = ((X0 + X2) / 2) + (2 * H0);
+				pX[2] = X0;
+			}
+		}
+		else
+		{
+			L0 = pL[0];
+			X0 = L0 - (H0 / 2);
+
+			pX[0] = X2;
+			pX[1] = ((X0 + X2) / 2) + (2 * H0);
+			pX[2] = X0;
+
+			L0 = pL[1];
+			pX[3] = (X0 + L0) / 2;
+		}
+
+		pLowBand += nLowStep;
+		pHighBand += nHighStep;
+		pDstBand += nDstStep;
+	}
+}
+
+static void progressive_rfx_idwt_y_sse2(INT16* pLowBand, int nLowStep, INT16* pHighBand, int nHighStep,
+		INT16* pDstBand, int nDstStep, int nLowCount, int nHighCount, int nDstCount)
+{
+	int i, j;
+	INT16 *pL, *pH, *pX;
+	__m128i l0, h0, h1;
+	__m128i x0, x1, x2;
+
+	/* eight columns at a time, the generic code takes the remaining ones */
+
+	for (i = 0; (i + 8) <= nDstCount; i += 8)
+	{
+		pL = &pLowBand[i];
+		pH = &pHighBand[i];
+		pX = &pDstBand[i];
+
+		h0 = _mm_loadu_si128((__m128i*) pH);
+		pH += nHighStep;
+
+		l0 = _mm_loadu_si128((__m128i*) pL);
+		pL += nLowStep;
+
+		x0 = _mm_sub_epi16(l0, h0);
+		x2 = x0;
+
+		for (j = 0; j < (nHighCount - 1); j++)
+		{
+			h1 = _mm_loadu_si128((__m128i*) pH);
+			pH += nHighStep;
+
+			l0 = _mm_loadu_si128((__m128i*) pL);
+			pL += nLowStep;
+
+			x2 = _mm_sub_epi16(l0, _mm_avg_trunc_epi16(h0, h1));
+			x1 = _mm_add_epi16(_mm_avg_trunc_epi16(x0, x2), _mm_slli_epi16(h0, 1));
+
+			_mm_storeu_si128((__m128i*) pX, x0);
+			pX += nDstStep;
+
+			_mm_storeu_si128((__m128i*) pX, x1);
+			pX += nDstStep;
+
+			x0 = x2;
+			h0 = h1;
+		}
+
+		if (nLowCount <= (nHighCount + 1))
+		{
+			if (nLowCount <= nHighCount)
+			{
+				_mm_storeu_si128((__m128i*) pX, x2);
+				pX += nDstStep;
+
+				_mm_storeu_si128((__m128i*) pX, _mm_add_epi16(x2, _mm_slli_epi16(h0, 1)));
+			}
+			else
+			{
+				l0 = _mm_loadu_si128((__m128i*) pL);
+				x0 = _mm_sub_epi16(l0, h0);
+
+				_mm_storeu_si128((__m128i*) pX, x2);
+				pX += nDstStep;
+
+				x1 = _mm_add_epi16(_mm_avg_trunc_epi16(x0, x2), _mm_slli_epi16(h0, 1));
+				_mm_storeu_si128((__m128i*) pX, x1);
+				pX += nDstStep;
+
+				_mm_storeu_si128((__m128i*) pX, x0);
+			}
+		}
+		else
+		{
+			l0 = _mm_loadu_si128((__m128i*) pL);
+			pL += nLowStep;
+
+			x0 = _mm_sub_epi16(l0, _mm_half_trunc_epi16(h0));
+
+			_mm_storeu_si128((__m128i*) pX, x2);
+			pX += nDstStep;
+
+			x1 = _mm_add_epi16(_mm_avg_trunc_epi16(x0, x2), _mm_slli_epi16(h0, 1));
+			_mm_storeu_si128((__m128i*) pX, x1);
+			pX += nDstStep;
+
+			_mm_storeu_si128((__m128i*) pX, x0);
+			pX += nDstStep;
+
+			l0 = _mm_loadu_si128((__m128i*) pL);
+			_mm_storeu_si128((__m128i*) pX, _mm_avg_trunc_epi16(x0, l0));
+		}
+	}
+
+	if (i < nDstCount)
+	{
+		progressive_rfx_idwt_y(&pLowBand[i], nLowStep, &pHighBand[i], nHighStep,
+				&pDstBand[i], nDstStep, nLowCount, nHighCount, nDstCount - i);
+	}
+}
+
+void progressive_init_sse2(PROGRESSIVE_CONTEXT* progressive)
+{
+	if (!IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	progressive->idwt_x = progressive_rfx_idwt_x_sse2;
+	progressive->idwt_y = progressive_rfx_idwt_y_sse2;
+}
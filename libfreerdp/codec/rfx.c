@@ -52,6 +52,7 @@
 
 #include "rfx_sse2.h"
 #include "rfx_neon.h"
+#include "rfx_avx2.h"
 
 #define TAG FREERDP_TAG("codec")
 
@@ -76,6 +77,8 @@ static const UINT32 rfx_default_quantization_values[] =
 	6, 6, 6, 6, 7, 7, 8, 8, 8, 9
 };
 
+static void rfx_encoder_free_frame(RFX_CONTEXT* context);
+
 static void rfx_profiler_create(RFX_CONTEXT* context)
 {
 	PROFILER_CREATE(context->priv->prof_rfx_decode_rgb, "rfx_decode_rgb");
@@ -334,6 +337,11 @@ RFX_CONTEXT* rfx_context_new(BOOL encoder)
 	context->dwt_2d_encode = rfx_dwt_2d_encode;
 
 	RFX_INIT_SIMD(context);
+
+#ifdef WITH_AVX2
+	/* takes precedence over the SSE2 routines when the processor supports it */
+	rfx_init_avx2(context);
+#endif
 	
 	context->state = RFX_STATE_SEND_HEADERS;
 	return context;
@@ -351,6 +359,7 @@ error_priv:
 
 void rfx_context_free(RFX_CONTEXT* context)
 {
+	int i;
 	RFX_CONTEXT_PRIV *priv;
 
 	assert(NULL != context);
@@ -362,6 +371,11 @@ void rfx_context_free(RFX_CONTEXT* context)
 	if (context->quants)
 		free(context->quants);
 
+	rfx_encoder_free_frame(context);
+	free(priv->tileGrid);
+	_aligned_free(priv->refData);
+	free(priv->refValid);
+
 	ObjectPool_Free(priv->TilePool);
 
 	rfx_profiler_print(context);
@@ -369,6 +383,9 @@ void rfx_context_free(RFX_CONTEXT* context)
 
 	if (priv->UseThreads)
 	{
+		for (i = 0; i < priv->numWorkObjects; i++)
+			CloseThreadpoolWork(priv->workObjects[i]);
+
 		CloseThreadpool(context->priv->ThreadPool);
 		DestroyThreadpoolEnvironment(&context->priv->ThreadPoolEnv);
 
@@ -422,6 +439,10 @@ int rfx_context_reset(RFX_CONTEXT* context)
 {
 	context->state = RFX_STATE_SEND_HEADERS;
 	context->frameIdx = 0;
+
+	if (context->priv)
+		rfx_context_invalidate_tiles(context, NULL);
+
 	return 1;
 }
 
@@ -1012,6 +1033,10 @@ void rfx_message_free(RFX_CONTEXT* context, RFX_MESSAGE* message)
 	int i;
 	RFX_TILE* tile;
 
+	/* the encoder frame belongs to the context */
+	if (message == &context->priv->frame)
+		return;
+
 	if (message)
 	{
 		if ((message->rects) && (message->freeRects))
@@ -1025,6 +1050,9 @@ void rfx_message_free(RFX_CONTEXT* context, RFX_MESSAGE* message)
 			{
 				tile = message->tiles[i];
 
+				if (!tile)
+					continue;
+
 				if (tile->YCbCrData)
 				{
 					BufferPool_Return(context->priv->BufferPool, tile->YCbCrData);
@@ -1181,39 +1209,318 @@ static BOOL computeRegion(const RFX_RECT* rects, int numRects, REGION16 *region,
 
 BOOL setupWorkers(RFX_CONTEXT *context, int nbTiles)
 {
+	int index;
+	PTP_WORK* workObjects;
+	RFX_TILE_COMPOSE_WORK_PARAM* tileWorkParams;
 	RFX_CONTEXT_PRIV *priv = context->priv;
 
 	if (!context->priv->UseThreads)
 		return TRUE;
 
-	priv->workObjects = (PTP_WORK*) realloc(priv->workObjects, sizeof(PTP_WORK) * nbTiles);
+	if (nbTiles <= priv->numWorkObjects)
+		return TRUE;
+
+	/* work objects are kept across frames, they point into tileWorkParams */
 
-	if (!priv->workObjects)
+	for (index = 0; index < priv->numWorkObjects; index++)
+		CloseThreadpoolWork(priv->workObjects[index]);
+
+	priv->numWorkObjects = 0;
+
+	workObjects = (PTP_WORK*) realloc(priv->workObjects, sizeof(PTP_WORK) * nbTiles);
+
+	if (!workObjects)
 		return FALSE;
 
-	priv->tileWorkParams = (RFX_TILE_COMPOSE_WORK_PARAM*)
+	priv->workObjects = workObjects;
+
+	tileWorkParams = (RFX_TILE_COMPOSE_WORK_PARAM*)
 			realloc(priv->tileWorkParams, sizeof(RFX_TILE_COMPOSE_WORK_PARAM) * nbTiles);
 
-	if (!priv->tileWorkParams)
+	if (!tileWorkParams)
 		return FALSE;
 
+	priv->tileWorkParams = tileWorkParams;
+
+	for (index = 0; index < nbTiles; index++)
+	{
+		priv->tileWorkParams[index].context = context;
+		priv->tileWorkParams[index].tile = NULL;
+
+		priv->workObjects[index] = CreateThreadpoolWork(
+				(PTP_WORK_CALLBACK) rfx_compose_message_tile_work_callback,
+				(void*) &priv->tileWorkParams[index], &priv->ThreadPoolEnv);
+
+		if (!priv->workObjects[index])
+			return FALSE;
+
+		priv->numWorkObjects++;
+	}
+
 	return TRUE;
 }
 
-RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects, int numRects,
-		BYTE* data, int width, int height, int scanline)
+static BOOL rfx_encoder_reserve_frame(RFX_CONTEXT* context, int numTiles, int numRects)
 {
+	RFX_TILE* tile;
+	RFX_TILE** tiles;
+	RFX_RECT* rects;
+	RFX_CONTEXT_PRIV* priv = context->priv;
+	RFX_MESSAGE* frame = &priv->frame;
+
+	if (numRects > priv->frameRectCapacity)
+	{
+		rects = (RFX_RECT*) realloc(frame->rects, sizeof(RFX_RECT) * numRects);
+
+		if (!rects)
+			return FALSE;
+
+		frame->rects = rects;
+		priv->frameRectCapacity = numRects;
+	}
+
+	if (numTiles > priv->frameTileCapacity)
+	{
+		tiles = (RFX_TILE**) realloc(frame->tiles, sizeof(RFX_TILE*) * numTiles);
+
+		if (!tiles)
+			return FALSE;
+
+		frame->tiles = tiles;
+
+		while (priv->frameTileCapacity < numTiles)
+		{
+			tile = (RFX_TILE*) ObjectPool_Take(priv->TilePool);
+
+			if (!tile)
+				return FALSE;
+
+			tile->YCbCrData = (BYTE*) BufferPool_Take(priv->BufferPool, -1);
+
+			if (!tile->YCbCrData)
+			{
+				ObjectPool_Return(priv->TilePool, (void*) tile);
+				return FALSE;
+			}
+
+			frame->tiles[priv->frameTileCapacity++] = tile;
+		}
+	}
+
+	return TRUE;
+}
+
+static void rfx_encoder_free_frame(RFX_CONTEXT* context)
+{
+	int index;
+	RFX_TILE* tile;
+	RFX_CONTEXT_PRIV* priv = context->priv;
+
+	for (index = 0; index < priv->frameTileCapacity; index++)
+	{
+		tile = priv->frame.tiles[index];
+		BufferPool_Return(priv->BufferPool, tile->YCbCrData);
+		tile->YCbCrData = NULL;
+		ObjectPool_Return(priv->TilePool, (void*) tile);
+	}
+
+	free(priv->frame.tiles);
+	free(priv->frame.rects);
+	ZeroMemory(&priv->frame, sizeof(RFX_MESSAGE));
+
+	priv->frameTileCapacity = 0;
+	priv->frameRectCapacity = 0;
+}
+
+static RFX_TILE* rfx_encoder_next_tile(RFX_CONTEXT* context, RFX_MESSAGE* message, BOOL reuse)
+{
+	RFX_TILE* tile;
+
+	if (reuse)
+		return message->tiles[message->numTiles];
+
+	tile = (RFX_TILE*) ObjectPool_Take(context->priv->TilePool);
+
+	if (!tile)
+		return NULL;
+
+	tile->YCbCrData = (BYTE*) BufferPool_Take(context->priv->BufferPool, -1);
+
+	if (!tile->YCbCrData)
+	{
+		ObjectPool_Return(context->priv->TilePool, (void*) tile);
+		return NULL;
+	}
+
+	message->tiles[message->numTiles] = tile;
+
+	return tile;
+}
+
+static BOOL rfx_encoder_prepare_reference(RFX_CONTEXT* context, int width, int height)
+{
+	int size;
+	int refStep;
+	int numTiles;
+	BYTE* refData;
+	BYTE* refValid;
+	RFX_CONTEXT_PRIV* priv = context->priv;
+
+	refStep = width * (context->bits_per_pixel / 8);
+
+	if ((width == priv->refWidth) && (height == priv->refHeight) && (refStep == priv->refStep))
+		return TRUE;
+
+	size = refStep * height;
+	numTiles = ((width + 63) / 64) * ((height + 63) / 64);
+
+	refData = (BYTE*) _aligned_malloc(size, 16);
+	refValid = (BYTE*) calloc(numTiles, sizeof(BYTE));
+
+	if (!refData || !refValid)
+	{
+		_aligned_free(refData);
+		free(refValid);
+		return FALSE;
+	}
+
+	_aligned_free(priv->refData);
+	free(priv->refValid);
+
+	priv->refData = refData;
+	priv->refValid = refValid;
+	priv->refWidth = width;
+	priv->refHeight = height;
+	priv->refStep = refStep;
+
+	return TRUE;
+}
+
+/**
+ * Compares a tile with the content last sent for it and updates the reference
+ * copy. Returns FALSE if the tile is unchanged and can be skipped.
+ */
+
+static BOOL rfx_encoder_tile_changed(RFX_CONTEXT* context, const BYTE* pSrcData, int scanline,
+		int xIdx, int yIdx, int width, int height)
+{
+	int y;
+	int rowSize;
+	BYTE* pRefData;
+	int bytesPerPixel;
+	BYTE* pTileValid;
+	RFX_CONTEXT_PRIV* priv = context->priv;
+
+	bytesPerPixel = (context->bits_per_pixel / 8);
+	rowSize = width * bytesPerPixel;
+	pTileValid = &priv->refValid[(yIdx * ((priv->refWidth + 63) / 64)) + xIdx];
+	pRefData = &priv->refData[(yIdx * 64 * priv->refStep) + (xIdx * 64 * bytesPerPixel)];
+
+	y = 0;
+
+	if (*pTileValid)
+	{
+		for (y = 0; y < height; y++)
+		{
+			if (memcmp(&pRefData[y * priv->refStep], &pSrcData[y * scanline], rowSize) != 0)
+				break;
+		}
+
+		if (y == height)
+			return FALSE;
+	}
+
+	/* the rows before the first difference are already up to date */
+
+	for (; y < height; y++)
+		CopyMemory(&pRefData[y * priv->refStep], &pSrcData[y * scanline], rowSize);
+
+	*pTileValid = 1;
+
+	return TRUE;
+}
+
+void rfx_context_set_change_detection(RFX_CONTEXT* context, BOOL enabled)
+{
+	context->priv->ChangeDetection = enabled;
+	rfx_context_invalidate_tiles(context, NULL);
+}
+
+void rfx_context_invalidate_tiles(RFX_CONTEXT* context, const RECTANGLE_16* rect)
+{
+	int xIdx, yIdx;
+	int numTilesX, numTilesY;
+	RFX_CONTEXT_PRIV* priv = context->priv;
+
+	if (!priv->refValid)
+		return;
+
+	numTilesX = (priv->refWidth + 63) / 64;
+	numTilesY = (priv->refHeight + 63) / 64;
+
+	if (!rect)
+	{
+		ZeroMemory(priv->refValid, numTilesX * numTilesY);
+		return;
+	}
+
+	if ((rect->left >= rect->right) || (rect->top >= rect->bottom))
+		return;
+
+	for (yIdx = TILE_NO(rect->top); (yIdx <= TILE_NO(rect->bottom - 1)) && (yIdx < numTilesY); yIdx++)
+	{
+		for (xIdx = TILE_NO(rect->left); (xIdx <= TILE_NO(rect->right - 1)) && (xIdx < numTilesX); xIdx++)
+			priv->refValid[(yIdx * numTilesX) + xIdx] = 0;
+	}
+}
+
+/**
+ * The reference keeps whole tiles, so with change detection the rectangles
+ * are the sent tiles themselves, clipped to the surface: the client paints
+ * every pixel the reference holds for them, and nothing of skipped tiles.
+ */
+
+static BOOL rfx_encoder_tiles_region(RFX_MESSAGE* message, REGION16* region)
+{
+	int i;
+	BOOL status = TRUE;
+	RECTANGLE_16 tileRect;
+
+	region16_clear(region);
+
+	for (i = 0; (i < message->numTiles) && status; i++)
+	{
+		tileRect.left = message->tiles[i]->x;
+		tileRect.top = message->tiles[i]->y;
+		tileRect.right = tileRect.left + message->tiles[i]->width;
+		tileRect.bottom = tileRect.top + message->tiles[i]->height;
+
+		status = region16_union_rect(region, region, &tileRect);
+	}
+
+	return status;
+}
+
+/**
+ * Encodes the tiles covering the region into message. With reuse set, message is
+ * the context frame and its arrays and tiles are recycled from the previous frame.
+ */
+
+static BOOL rfx_encode_message_tiles(RFX_CONTEXT* context, RFX_MESSAGE* message, BOOL reuse,
+		const RFX_RECT* rects, int numRects, BYTE* data, int width, int height, int scanline)
+{
+	BOOL status = FALSE;
 	int i, maxNbTiles, maxTilesX, maxTilesY;
 	int xIdx, yIdx, regionNbRects;
 	int gridRelX, gridRelY, ax, ay, bytesPerPixel;
+	int gridIdx, firstTileX, firstTileY;
+	BYTE* tileGrid;
+	BYTE* pTileData;
 	RFX_TILE* tile;
 	RFX_RECT* rfxRect;
-	RFX_MESSAGE* message = NULL;
-	PTP_WORK* workObject = NULL;
-	RFX_TILE_COMPOSE_WORK_PARAM *workParam = NULL;
+	RFX_CONTEXT_PRIV* priv = context->priv;
 
-	REGION16 rectsRegion, tilesRegion;
-	RECTANGLE_16 currentTileRect;
+	REGION16 rectsRegion;
 	const RECTANGLE_16 *regionRect;
 	const RECTANGLE_16 *extents;
 
@@ -1224,20 +1531,22 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects, int
 	assert(height > 0);
 	assert(scanline > 0);
 
-	message = (RFX_MESSAGE*)calloc(1, sizeof(RFX_MESSAGE));
-
-	if (!message)
-		return NULL;
-
 	if (context->state == RFX_STATE_SEND_HEADERS)
 		rfx_update_context_properties(context);
 
 	message->frameIdx = context->frameIdx++;
+	message->numRects = 0;
+	message->numTiles = 0;
+	message->tilesDataSize = 0;
 
 	if (!context->numQuant)
 	{
 		context->numQuant = 1;
 		context->quants = (UINT32*) malloc(sizeof(rfx_default_quantization_values));
+
+		if (!context->quants)
+			return FALSE;
+
 		CopyMemory(context->quants, &rfx_default_quantization_values, sizeof(rfx_default_quantization_values));
 		context->quantIdxY = 0;
 		context->quantIdxCb = 0;
@@ -1252,41 +1561,55 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects, int
 	region16_init(&rectsRegion);
 
 	if (!computeRegion(rects, numRects, &rectsRegion, width, height))
-		goto out_free_message;
+		goto out;
+
+	if (priv->ChangeDetection && !rfx_encoder_prepare_reference(context, width, height))
+		goto out;
 
 	extents = region16_extents(&rectsRegion);
 	assert(extents->right - extents->left > 0);
 	assert(extents->bottom - extents->top > 0);
 
-	maxTilesX = 1 + TILE_NO(extents->right - 1) - TILE_NO(extents->left);
-	maxTilesY = 1 + TILE_NO(extents->bottom - 1) - TILE_NO(extents->top);
+	firstTileX = TILE_NO(extents->left);
+	firstTileY = TILE_NO(extents->top);
+	maxTilesX = 1 + TILE_NO(extents->right - 1) - firstTileX;
+	maxTilesY = 1 + TILE_NO(extents->bottom - 1) - firstTileY;
 	maxNbTiles = maxTilesX * maxTilesY;
 
-	message->tiles = calloc(maxNbTiles, sizeof(RFX_TILE*));
+	regionRect = region16_rects(&rectsRegion, &regionNbRects);
 
-	if (!message->tiles)
-		goto out_free_message;
+	if (reuse)
+	{
+		if (!rfx_encoder_reserve_frame(context, maxNbTiles, 0))
+			goto out;
+	}
+	else
+	{
+		message->tiles = (RFX_TILE**) calloc(maxNbTiles, sizeof(RFX_TILE*));
+
+		if (!message->tiles)
+			goto out;
+	}
 
 	if (!setupWorkers(context, maxNbTiles))
-		goto out_clean_tiles;
+		goto out;
 
-	if (context->priv->UseThreads)
-	{
-		workObject = context->priv->workObjects;
-		workParam = context->priv->tileWorkParams;
-	}
+	/* one byte per tile of the extents, set once the tile has been queued */
 
-	regionRect = region16_rects(&rectsRegion, &regionNbRects);
-	message->rects = rfxRect = calloc(regionNbRects, sizeof(RFX_RECT));
+	if (maxNbTiles > priv->tileGridSize)
+	{
+		tileGrid = (BYTE*) realloc(priv->tileGrid, maxNbTiles);
 
-	if (!message->rects)
-		goto out_clean_tiles;
+		if (!tileGrid)
+			goto out;
 
-	message->numRects = regionNbRects;
+		priv->tileGrid = tileGrid;
+		priv->tileGridSize = maxNbTiles;
+	}
 
-	region16_init(&tilesRegion);
+	ZeroMemory(priv->tileGrid, maxNbTiles);
 
-	for (i = 0; i < regionNbRects; i++, regionRect++, rfxRect++)
+	for (i = 0; i < regionNbRects; i++, regionRect++)
 	{
 		int startTileX = regionRect->left / 64;
 		int endTileX = (regionRect->right - 1) / 64;
@@ -1294,12 +1617,6 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects, int
 		int startTileY = regionRect->top / 64;
 		int endTileY = (regionRect->bottom - 1) / 64;
 
-		rfxRect->x = regionRect->left;
-		rfxRect->y = regionRect->top;
-		rfxRect->width = (regionRect->right - regionRect->left);
-		rfxRect->height = (regionRect->bottom - regionRect->top);
-
-
 		for (yIdx = startTileY, gridRelY = startTileY * 64; yIdx <= endTileY; yIdx++, gridRelY += 64 )
 		{
 			int tileHeight = 64;
@@ -1307,9 +1624,6 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects, int
 			if ((yIdx == endTileY) && (gridRelY + 64 > height))
 				tileHeight = height - gridRelY;
 
-			currentTileRect.top = gridRelY;
-			currentTileRect.bottom = gridRelY + tileHeight;
-
 			for (xIdx = startTileX, gridRelX = startTileX * 64; xIdx <= endTileX; xIdx++, gridRelX += 64)
 			{
 				int tileWidth = 64;
@@ -1317,17 +1631,26 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects, int
 				if ((xIdx == endTileX) && (gridRelX + 64 > width))
 					tileWidth = width - gridRelX;
 
-				currentTileRect.left = gridRelX;
-				currentTileRect.right = gridRelX + tileWidth;
-
 				/* checks if this tile is already treated */
-				if (region16_intersects_rect(&tilesRegion, &currentTileRect))
+				gridIdx = ((yIdx - firstTileY) * maxTilesX) + (xIdx - firstTileX);
+
+				if (priv->tileGrid[gridIdx])
 					continue;
 
-				tile = (RFX_TILE*) ObjectPool_Take(context->priv->TilePool);
+				priv->tileGrid[gridIdx] = 1;
+
+				ax = gridRelX;
+				ay = gridRelY;
+				pTileData = &data[(ay * scanline) + (ax * bytesPerPixel)];
+
+				if (priv->ChangeDetection && !rfx_encoder_tile_changed(context, pTileData,
+						scanline, xIdx, yIdx, tileWidth, tileHeight))
+					continue;
+
+				tile = rfx_encoder_next_tile(context, message, reuse);
 
 				if (!tile)
-					goto out_clean_rects;;
+					goto out;
 
 				tile->xIdx = xIdx;
 				tile->yIdx = yIdx;
@@ -1337,15 +1660,12 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects, int
 				tile->width = tileWidth;
 				tile->height = tileHeight;
 
-				ax = gridRelX;
-				ay = gridRelY;
-
 				if (tile->data && tile->allocated)
 				{
 					free(tile->data);
 					tile->allocated = FALSE;
 				}
-				tile->data = &data[(ay * scanline) + (ax * bytesPerPixel)];
+				tile->data = pTileData;
 
 				tile->quantIdxY = context->quantIdxY;
 				tile->quantIdxCb = context->quantIdxCb;
@@ -1353,87 +1673,108 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects, int
 
 				tile->YLen = tile->CbLen = tile->CrLen = 0;
 
-				tile->YCbCrData = (BYTE *)BufferPool_Take(context->priv->BufferPool, -1);
-				if (!tile->YCbCrData)
-					goto out_clean_rects;
-
 				tile->YData = (BYTE*) &(tile->YCbCrData[((8192 + 32) * 0) + 16]);
 				tile->CbData = (BYTE*) &(tile->YCbCrData[((8192 + 32) * 1) + 16]);
 				tile->CrData = (BYTE*) &(tile->YCbCrData[((8192 + 32) * 2) + 16]);
 
-				if (context->priv->UseThreads)
+				if (priv->UseThreads)
 				{
-					workParam->context = context;
-					workParam->tile = tile;
-
-					*workObject = CreateThreadpoolWork(
-							(PTP_WORK_CALLBACK)rfx_compose_message_tile_work_callback,
-							(void*) workParam,
-							&context->priv->ThreadPoolEnv
-					);
-
-					SubmitThreadpoolWork(*workObject);
-
-					workObject++;
-					workParam++;
+					priv->tileWorkParams[message->numTiles].tile = tile;
+					SubmitThreadpoolWork(priv->workObjects[message->numTiles]);
 				}
 				else
 				{
 					rfx_encode_rgb(context, tile);
 				}
 
-				message->tiles[message->numTiles] = tile;
 				message->numTiles++;
-
-				if (!region16_union_rect(&tilesRegion, &tilesRegion, &currentTileRect))
-					goto out_clean_rects;
 			} /* xIdx */
 		}  /* yIdx */
 	}  /* rects */
 
-	if (message->numTiles != maxNbTiles)
+	if (priv->ChangeDetection && !rfx_encoder_tiles_region(message, &rectsRegion))
+		goto out;
+
+	regionRect = region16_rects(&rectsRegion, &regionNbRects);
+
+	if (regionNbRects > 0)
 	{
-		message->tiles = realloc(message->tiles, sizeof(RFX_TILE*) * message->numTiles);
+		if (reuse)
+		{
+			if (!rfx_encoder_reserve_frame(context, 0, regionNbRects))
+				goto out;
+		}
+		else
+		{
+			message->rects = (RFX_RECT*) calloc(regionNbRects, sizeof(RFX_RECT));
+			message->freeRects = TRUE;
 
-		if (!message->tiles)
-			goto out_clean_rects;
+			if (!message->rects)
+				goto out;
+		}
+	}
+
+	rfxRect = message->rects;
+	message->numRects = regionNbRects;
+
+	for (i = 0; i < regionNbRects; i++, regionRect++, rfxRect++)
+	{
+		rfxRect->x = regionRect->left;
+		rfxRect->y = regionRect->top;
+		rfxRect->width = (regionRect->right - regionRect->left);
+		rfxRect->height = (regionRect->bottom - regionRect->top);
 	}
 
-	region16_uninit(&tilesRegion);
+	status = TRUE;
 
+out:
 	/* when using threads ensure all computations are done */
-	message->tilesDataSize = 0;
-	workObject = context->priv->workObjects;
 
 	for (i = 0; i < message->numTiles; i++)
 	{
-		tile = message->tiles[i];
-		if (context->priv->UseThreads)
-		{
-			WaitForThreadpoolWorkCallbacks(*workObject, FALSE);
-			CloseThreadpoolWork(*workObject);
-			workObject++;
-		}
+		if (priv->UseThreads)
+			WaitForThreadpoolWorkCallbacks(priv->workObjects[i], FALSE);
 
-		message->tilesDataSize += rfx_tile_length(tile);
+		message->tilesDataSize += rfx_tile_length(message->tiles[i]);
 	}
 
-
 	region16_uninit(&rectsRegion);
-	return message;
 
-out_clean_rects:
-	free(message->rects);
-out_clean_tiles:
-	free(message->tiles);
-	region16_uninit(&tilesRegion);
-out_free_message:
-	WLog_ERR(TAG,  "remoteFx error");
-	region16_uninit(&rectsRegion);
-	free(message);
-	return 0;
+	if (!status)
+		WLog_ERR(TAG,  "remoteFx error");
+
+	return status;
 }
 
+RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects, int numRects,
+		BYTE* data, int width, int height, int scanline)
+{
+	RFX_MESSAGE* message;
+
+	message = (RFX_MESSAGE*) calloc(1, sizeof(RFX_MESSAGE));
+
+	if (!message)
+		return NULL;
+
+	if (!rfx_encode_message_tiles(context, message, FALSE, rects, numRects, data, width, height, scanline))
+	{
+		rfx_message_free(context, message);
+		return NULL;
+	}
+
+	return message;
+}
+
+RFX_MESSAGE* rfx_encode_frame(RFX_CONTEXT* context, const RFX_RECT* rects, int numRects,
+		BYTE* data, int width, int height, int scanline)
+{
+	RFX_MESSAGE* message = &context->priv->frame;
+
+	if (!rfx_encode_message_tiles(context, message, TRUE, rects, numRects, data, width, height, scanline))
+		return NULL;
+
+	return message;
+}
 
 RFX_MESSAGE* rfx_split_message(RFX_CONTEXT* context, RFX_MESSAGE* message, int* numMessages, int maxDataSize)
 {
@@ -1480,13 +1821,10 @@ RFX_MESSAGE* rfx_split_message(RFX_CONTEXT* context, RFX_MESSAGE* message, int*
 	context->frameIdx += j;
 	message->numTiles = 0;
 
-	for (i = 0; i < *numMessages; i++)
-	{
-		for (j = 0; j < messages[i].numTiles; j++)
-		{
+	/* the rects are shared, the last message (freed last) owns them */
 
-		}
-	}
+	messages[j].freeRects = message->freeRects;
+	message->freeRects = FALSE;
 
 	return messages;
 }
@@ -1498,6 +1836,10 @@ RFX_MESSAGE* rfx_encode_messages(RFX_CONTEXT* context, const RFX_RECT* rects, in
 	RFX_MESSAGE* messages;
 
 	message = rfx_encode_message(context, rects, numRects, data, width, height, scanline);
+
+	if (!message)
+		return NULL;
+
 	messages = rfx_split_message(context, message, numMessages, maxDataSize);
 	rfx_message_free(context, message);
 
@@ -1609,14 +1951,54 @@ void rfx_write_message(RFX_CONTEXT* context, wStream* s, RFX_MESSAGE* message)
 	rfx_write_message_frame_end(context, s, message);
 }
 
+int rfx_write_message_fragment(RFX_CONTEXT* context, wStream* s, RFX_MESSAGE* message,
+		int firstTile, int maxDataSize)
+{
+	int index;
+	UINT32 tileDataSize;
+	RFX_MESSAGE fragment;
+
+	if ((firstTile < 0) || (firstTile >= message->numTiles))
+		return 0;
+
+	maxDataSize -= 1024; /* reserve enough space for headers */
+
+	CopyMemory(&fragment, message, sizeof(RFX_MESSAGE));
+
+	fragment.tiles = &message->tiles[firstTile];
+	fragment.numTiles = 0;
+	fragment.tilesDataSize = 0;
+
+	for (index = firstTile; index < message->numTiles; index++)
+	{
+		tileDataSize = rfx_tile_length(message->tiles[index]);
+
+		if (fragment.numTiles && ((fragment.tilesDataSize + tileDataSize) > ((UINT32) maxDataSize)))
+			break;
+
+		fragment.tilesDataSize += tileDataSize;
+		fragment.numTiles++;
+	}
+
+	/* every fragment is a complete frame of its own */
+
+	if (firstTile > 0)
+		fragment.frameIdx = context->frameIdx++;
+
+	rfx_write_message(context, s, &fragment);
+
+	return fragment.numTiles;
+}
+
 void rfx_compose_message(RFX_CONTEXT* context, wStream* s,
 	const RFX_RECT* rects, int numRects, BYTE* data, int width, int height, int scanline)
 {
 	RFX_MESSAGE* message;
 
- 	message = rfx_encode_message(context, rects, numRects, data, width, height, scanline);
+	message = rfx_encode_frame(context, rects, numRects, data, width, height, scanline);
 
-	rfx_write_message(context, s, message);
+	if (!message)
+		return;
 
-	rfx_message_free(context, message);
+	rfx_write_message(context, s, message);
 }
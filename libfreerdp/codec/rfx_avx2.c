@@ -0,0 +1,616 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RemoteFX Codec Library - AVX2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* before any winpr header: winpr/crt.h may redefine the __lzcnt intrinsics, not the other way around */
+#include <immintrin.h>
+
+#include <winpr/sysinfo.h>
+
+#include "rfx_types.h"
+#include "rfx_avx2.h"
+
+/**
+ * The kernels below produce exactly the same coefficients as the generic and
+ * SSE2 implementations, they only process 16 coefficients per instruction.
+ *
+ * The subbands of the third decomposition level are 8 coefficients wide, the
+ * horizontal passes use 128-bit registers for that level. All other passes
+ * work on rows that are a multiple of 16 coefficients wide.
+ */
+
+#ifdef _MSC_VER
+#define	__attribute__(...)
+#endif
+
+#ifndef __clang__
+#define ATTRIBUTES  __gnu_inline__, __always_inline__, __artificial__
+#else
+#define ATTRIBUTES __gnu_inline__, __always_inline__
+#endif
+
+/* [ prev15, v0 ... v14 ] */
+static __inline __m256i __attribute__((ATTRIBUTES))
+_mm256_shift_in_prev_epi16(__m256i v, __m256i prev)
+{
+	return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(prev, v, 0x21), 14);
+}
+
+/* [ v1 ... v15, next0 ] */
+static __inline __m256i __attribute__((ATTRIBUTES))
+_mm256_shift_in_next_epi16(__m256i v, __m256i next)
+{
+	return _mm256_alignr_epi8(_mm256_permute2x128_si256(v, next, 0x21), v, 2);
+}
+
+/* v15 in the first coefficient of both lanes */
+static __inline __m256i __attribute__((ATTRIBUTES))
+_mm256_last_epi16(__m256i v)
+{
+	return _mm256_srli_si256(_mm256_permute2x128_si256(v, v, 0x11), 14);
+}
+
+/* Splits 16 interleaved coefficients into 8 even ones (low lane) and 8 odd ones (high lane) */
+static __inline __m256i __attribute__((ATTRIBUTES))
+_mm256_deinterleave_epi16(__m256i v)
+{
+	const __m256i mask = _mm256_setr_epi8(
+		0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15,
+		0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+
+	v = _mm256_shuffle_epi8(v, mask);
+	return _mm256_permute4x64_epi64(v, 0xD8);
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_quantization_decode_block_avx2(INT16* buffer, const int buffer_size, const UINT32 factor)
+{
+	__m256i a;
+	__m256i* ptr = (__m256i*) buffer;
+	__m256i* buf_end = (__m256i*) (buffer + buffer_size);
+
+	if (factor == 0)
+		return;
+
+	do
+	{
+		a = _mm256_loadu_si256(ptr);
+		a = _mm256_slli_epi16(a, factor);
+		_mm256_storeu_si256(ptr, a);
+
+		ptr++;
+	} while (ptr < buf_end);
+}
+
+static void rfx_quantization_decode_avx2(INT16* buffer, const UINT32* quantVals)
+{
+	rfx_quantization_decode_block_avx2(&buffer[0], 1024, quantVals[8] - 1); /* HL1 */
+	rfx_quantization_decode_block_avx2(&buffer[1024], 1024, quantVals[7] - 1); /* LH1 */
+	rfx_quantization_decode_block_avx2(&buffer[2048], 1024, quantVals[9] - 1); /* HH1 */
+	rfx_quantization_decode_block_avx2(&buffer[3072], 256, quantVals[5] - 1); /* HL2 */
+	rfx_quantization_decode_block_avx2(&buffer[3328], 256, quantVals[4] - 1); /* LH2 */
+	rfx_quantization_decode_block_avx2(&buffer[3584], 256, quantVals[6] - 1); /* HH2 */
+	rfx_quantization_decode_block_avx2(&buffer[3840], 64, quantVals[2] - 1); /* HL3 */
+	rfx_quantization_decode_block_avx2(&buffer[3904], 64, quantVals[1] - 1); /* LH3 */
+	rfx_quantization_decode_block_avx2(&buffer[3968], 64, quantVals[3] - 1); /* HH3 */
+	rfx_quantization_decode_block_avx2(&buffer[4032], 64, quantVals[0] - 1); /* LL3 */
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_quantization_encode_block_avx2(INT16* buffer, const int buffer_size, const UINT32 factor)
+{
+	__m256i a;
+	__m256i* ptr = (__m256i*) buffer;
+	__m256i* buf_end = (__m256i*) (buffer + buffer_size);
+	__m256i half;
+
+	if (factor == 0)
+		return;
+
+	half = _mm256_set1_epi16(1 << (factor - 1));
+
+	do
+	{
+		a = _mm256_loadu_si256(ptr);
+		a = _mm256_add_epi16(a, half);
+		a = _mm256_srai_epi16(a, factor);
+		_mm256_storeu_si256(ptr, a);
+
+		ptr++;
+	} while (ptr < buf_end);
+}
+
+static void rfx_quantization_encode_avx2(INT16* buffer, const UINT32* quantization_values)
+{
+	rfx_quantization_encode_block_avx2(buffer, 1024, quantization_values[8] - 6); /* HL1 */
+	rfx_quantization_encode_block_avx2(buffer + 1024, 1024, quantization_values[7] - 6); /* LH1 */
+	rfx_quantization_encode_block_avx2(buffer + 2048, 1024, quantization_values[9] - 6); /* HH1 */
+	rfx_quantization_encode_block_avx2(buffer + 3072, 256, quantization_values[5] - 6); /* HL2 */
+	rfx_quantization_encode_block_avx2(buffer + 3328, 256, quantization_values[4] - 6); /* LH2 */
+	rfx_quantization_encode_block_avx2(buffer + 3584, 256, quantization_values[6] - 6); /* HH2 */
+	rfx_quantization_encode_block_avx2(buffer + 3840, 64, quantization_values[2] - 6); /* HL3 */
+	rfx_quantization_encode_block_avx2(buffer + 3904, 64, quantization_values[1] - 6); /* LH3 */
+	rfx_quantization_encode_block_avx2(buffer + 3968, 64, quantization_values[3] - 6); /* HH3 */
+	rfx_quantization_encode_block_avx2(buffer + 4032, 64, quantization_values[0] - 6); /* LL3 */
+
+	rfx_quantization_encode_block_avx2(buffer, 4096, 5);
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_decode_block_horiz_8_avx2(INT16* l, INT16* h, INT16* dst)
+{
+	int y;
+	__m128i l_n;
+	__m128i h_n;
+	__m128i h_n_m;
+	__m128i tmp_n;
+	__m128i dst_n;
+	__m128i dst_n_p;
+
+	for (y = 0; y < 8; y++)
+	{
+		/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+
+		l_n = _mm_loadu_si128((__m128i*) l);
+		h_n = _mm_loadu_si128((__m128i*) h);
+		h_n_m = _mm_insert_epi16(_mm_slli_si128(h_n, 2), h[0], 0);
+
+		tmp_n = _mm_add_epi16(h_n, h_n_m);
+		tmp_n = _mm_add_epi16(tmp_n, _mm_set1_epi16(1));
+		tmp_n = _mm_srai_epi16(tmp_n, 1);
+
+		dst_n = _mm_sub_epi16(l_n, tmp_n);
+
+		/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+
+		dst_n_p = _mm_insert_epi16(_mm_srli_si128(dst_n, 2), _mm_extract_epi16(dst_n, 7), 7);
+
+		tmp_n = _mm_add_epi16(dst_n_p, dst_n);
+		tmp_n = _mm_srai_epi16(tmp_n, 1);
+		tmp_n = _mm_add_epi16(tmp_n, _mm_slli_epi16(h_n, 1));
+
+		_mm_storeu_si128((__m128i*) dst, _mm_unpacklo_epi16(dst_n, tmp_n));
+		_mm_storeu_si128((__m128i*) (dst + 8), _mm_unpackhi_epi16(dst_n, tmp_n));
+
+		l += 8;
+		h += 8;
+		dst += 16;
+	}
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_decode_odd_avx2(__m256i dst_n, __m256i dst_n_next, __m256i h_n, INT16* dst)
+{
+	__m256i tmp_n;
+	__m256i dst1;
+	__m256i dst2;
+
+	/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+
+	tmp_n = _mm256_add_epi16(_mm256_shift_in_next_epi16(dst_n, dst_n_next), dst_n);
+	tmp_n = _mm256_srai_epi16(tmp_n, 1);
+	tmp_n = _mm256_add_epi16(tmp_n, _mm256_slli_epi16(h_n, 1));
+
+	/* unpack works per 128-bit lane, put the lanes back in order */
+	dst1 = _mm256_unpacklo_epi16(dst_n, tmp_n);
+	dst2 = _mm256_unpackhi_epi16(dst_n, tmp_n);
+
+	_mm256_storeu_si256((__m256i*) dst, _mm256_permute2x128_si256(dst1, dst2, 0x20));
+	_mm256_storeu_si256((__m256i*) (dst + 16), _mm256_permute2x128_si256(dst1, dst2, 0x31));
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_decode_block_horiz_avx2(INT16* l, INT16* h, INT16* dst, int subband_width)
+{
+	int y, n;
+	__m256i l_n;
+	__m256i h_n;
+	__m256i h_n_m;
+	__m256i h_prev;
+	__m256i tmp_n;
+	__m256i dst_n;
+	__m256i dst_prev;
+
+	if (subband_width == 8)
+	{
+		rfx_dwt_2d_decode_block_horiz_8_avx2(l, h, dst);
+		return;
+	}
+
+	/**
+	 * The even and odd coefficients are computed in the same pass, the odd
+	 * coefficients of a vector are written once the next even ones are known.
+	 * Neighbours are shifted in from registers, reloading them from memory
+	 * right after a store would stall on store forwarding.
+	 */
+
+	for (y = 0; y < subband_width; y++)
+	{
+		/* h[-1] = h[0] */
+		h_prev = _mm256_set1_epi16(h[0]);
+		dst_prev = _mm256_setzero_si256();
+
+		for (n = 0; n < subband_width; n += 16)
+		{
+			/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+
+			l_n = _mm256_loadu_si256((__m256i*) l);
+			h_n = _mm256_loadu_si256((__m256i*) h);
+			h_n_m = _mm256_shift_in_prev_epi16(h_n, h_prev);
+
+			tmp_n = _mm256_add_epi16(h_n, h_n_m);
+			tmp_n = _mm256_add_epi16(tmp_n, _mm256_set1_epi16(1));
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+
+			dst_n = _mm256_sub_epi16(l_n, tmp_n);
+
+			if (n > 0)
+				rfx_dwt_2d_decode_odd_avx2(dst_prev, dst_n, h_prev, dst - 32);
+
+			dst_prev = dst_n;
+			h_prev = h_n;
+
+			l += 16;
+			h += 16;
+			dst += 32;
+		}
+
+		/* dst[2n + 2] = dst[2n] for the last coefficient */
+		rfx_dwt_2d_decode_odd_avx2(dst_prev, _mm256_last_epi16(dst_prev), h_prev, dst - 32);
+	}
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_decode_block_vert_avx2(INT16* l, INT16* h, INT16* dst, int subband_width)
+{
+	int x, n;
+	INT16* l_ptr = l;
+	INT16* h_ptr = h;
+	INT16* dst_ptr = dst;
+	__m256i l_n;
+	__m256i h_n;
+	__m256i tmp_n;
+	__m256i h_n_m;
+	__m256i dst_n;
+	__m256i dst_n_m;
+	__m256i dst_n_p;
+	int total_width = subband_width + subband_width;
+
+	/* Even coefficients */
+	for (n = 0; n < subband_width; n++)
+	{
+		for (x = 0; x < total_width; x += 16)
+		{
+			/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+
+			l_n = _mm256_loadu_si256((__m256i*) l_ptr);
+			h_n = _mm256_loadu_si256((__m256i*) h_ptr);
+
+			tmp_n = _mm256_add_epi16(h_n, _mm256_set1_epi16(1));
+
+			if (n == 0)
+				tmp_n = _mm256_add_epi16(tmp_n, h_n);
+			else
+			{
+				h_n_m = _mm256_loadu_si256((__m256i*) (h_ptr - total_width));
+				tmp_n = _mm256_add_epi16(tmp_n, h_n_m);
+			}
+
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+
+			dst_n = _mm256_sub_epi16(l_n, tmp_n);
+			_mm256_storeu_si256((__m256i*) dst_ptr, dst_n);
+
+			l_ptr += 16;
+			h_ptr += 16;
+			dst_ptr += 16;
+		}
+
+		dst_ptr += total_width;
+	}
+
+	h_ptr = h;
+	dst_ptr = dst + total_width;
+
+	/* Odd coefficients */
+	for (n = 0; n < subband_width; n++)
+	{
+		for (x = 0; x < total_width; x += 16)
+		{
+			/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+
+			h_n = _mm256_loadu_si256((__m256i*) h_ptr);
+			dst_n_m = _mm256_loadu_si256((__m256i*) (dst_ptr - total_width));
+			h_n = _mm256_slli_epi16(h_n, 1);
+
+			tmp_n = dst_n_m;
+
+			if (n == subband_width - 1)
+				tmp_n = _mm256_add_epi16(tmp_n, dst_n_m);
+			else
+			{
+				dst_n_p = _mm256_loadu_si256((__m256i*) (dst_ptr + total_width));
+				tmp_n = _mm256_add_epi16(tmp_n, dst_n_p);
+			}
+
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+
+			dst_n = _mm256_add_epi16(tmp_n, h_n);
+			_mm256_storeu_si256((__m256i*) dst_ptr, dst_n);
+
+			h_ptr += 16;
+			dst_ptr += 16;
+		}
+
+		dst_ptr += total_width;
+	}
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_decode_block_avx2(INT16* buffer, INT16* idwt, int subband_width)
+{
+	INT16 *hl, *lh, *hh, *ll;
+	INT16 *l_dst, *h_dst;
+
+	/* Inverse DWT in horizontal direction, results in 2 sub-bands in L, H order in tmp buffer idwt. */
+	/* The 4 sub-bands are stored in HL(0), LH(1), HH(2), LL(3) order. */
+	/* The lower part L uses LL(3) and HL(0). */
+	/* The higher part H uses LH(1) and HH(2). */
+
+	ll = buffer + subband_width * subband_width * 3;
+	hl = buffer;
+	l_dst = idwt;
+
+	rfx_dwt_2d_decode_block_horiz_avx2(ll, hl, l_dst, subband_width);
+
+	lh = buffer + subband_width * subband_width;
+	hh = buffer + subband_width * subband_width * 2;
+	h_dst = idwt + subband_width * subband_width * 2;
+
+	rfx_dwt_2d_decode_block_horiz_avx2(lh, hh, h_dst, subband_width);
+
+	/* Inverse DWT in vertical direction, results are stored in original buffer. */
+	rfx_dwt_2d_decode_block_vert_avx2(l_dst, h_dst, buffer, subband_width);
+}
+
+static void rfx_dwt_2d_decode_avx2(INT16* buffer, INT16* dwt_buffer)
+{
+	rfx_dwt_2d_decode_block_avx2(&buffer[3840], dwt_buffer, 8);
+	rfx_dwt_2d_decode_block_avx2(&buffer[3072], dwt_buffer, 16);
+	rfx_dwt_2d_decode_block_avx2(&buffer[0], dwt_buffer, 32);
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_encode_block_vert_avx2(INT16* src, INT16* l, INT16* h, int subband_width)
+{
+	int total_width;
+	int x;
+	int n;
+	__m256i src_2n;
+	__m256i src_2n_1;
+	__m256i src_2n_2;
+	__m256i h_n;
+	__m256i h_n_m;
+	__m256i l_n;
+
+	total_width = subband_width << 1;
+
+	for (n = 0; n < subband_width; n++)
+	{
+		for (x = 0; x < total_width; x += 16)
+		{
+			src_2n = _mm256_loadu_si256((__m256i*) src);
+			src_2n_1 = _mm256_loadu_si256((__m256i*) (src + total_width));
+
+			if (n < subband_width - 1)
+				src_2n_2 = _mm256_loadu_si256((__m256i*) (src + 2 * total_width));
+			else
+				src_2n_2 = src_2n;
+
+			/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+
+			h_n = _mm256_add_epi16(src_2n, src_2n_2);
+			h_n = _mm256_srai_epi16(h_n, 1);
+			h_n = _mm256_sub_epi16(src_2n_1, h_n);
+			h_n = _mm256_srai_epi16(h_n, 1);
+
+			_mm256_storeu_si256((__m256i*) h, h_n);
+
+			if (n == 0)
+				h_n_m = h_n;
+			else
+				h_n_m = _mm256_loadu_si256((__m256i*) (h - total_width));
+
+			/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+
+			l_n = _mm256_add_epi16(h_n_m, h_n);
+			l_n = _mm256_srai_epi16(l_n, 1);
+			l_n = _mm256_add_epi16(l_n, src_2n);
+
+			_mm256_storeu_si256((__m256i*) l, l_n);
+
+			src += 16;
+			l += 16;
+			h += 16;
+		}
+
+		src += total_width;
+	}
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_encode_block_horiz_8_avx2(INT16* src, INT16* l, INT16* h)
+{
+	int y;
+	__m256i src_n;
+	__m128i src_2n;
+	__m128i src_2n_1;
+	__m128i src_2n_2;
+	__m128i h_n;
+	__m128i h_n_m;
+	__m128i l_n;
+
+	for (y = 0; y < 8; y++)
+	{
+		src_n = _mm256_deinterleave_epi16(_mm256_loadu_si256((__m256i*) src));
+		src_2n = _mm256_castsi256_si128(src_n);
+		src_2n_1 = _mm256_extracti128_si256(src_n, 1);
+		src_2n_2 = _mm_insert_epi16(_mm_srli_si128(src_2n, 2), src[14], 7);
+
+		/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+
+		h_n = _mm_add_epi16(src_2n, src_2n_2);
+		h_n = _mm_srai_epi16(h_n, 1);
+		h_n = _mm_sub_epi16(src_2n_1, h_n);
+		h_n = _mm_srai_epi16(h_n, 1);
+
+		_mm_storeu_si128((__m128i*) h, h_n);
+
+		h_n_m = _mm_insert_epi16(_mm_slli_si128(h_n, 2), _mm_extract_epi16(h_n, 0), 0);
+
+		/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+
+		l_n = _mm_add_epi16(h_n_m, h_n);
+		l_n = _mm_srai_epi16(l_n, 1);
+		l_n = _mm_add_epi16(l_n, src_2n);
+
+		_mm_storeu_si128((__m128i*) l, l_n);
+
+		src += 16;
+		l += 8;
+		h += 8;
+	}
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_encode_block_horiz_avx2(INT16* src, INT16* l, INT16* h, int subband_width)
+{
+	int y;
+	int n;
+	__m256i src_lo;
+	__m256i src_hi;
+	__m256i src_2n;
+	__m256i src_2n_1;
+	__m256i src_2n_2;
+	__m256i h_n;
+	__m256i h_n_m;
+	__m256i h_prev;
+	__m256i l_n;
+
+	if (subband_width == 8)
+	{
+		rfx_dwt_2d_encode_block_horiz_8_avx2(src, l, h);
+		return;
+	}
+
+	for (y = 0; y < subband_width; y++)
+	{
+		h_prev = _mm256_setzero_si256();
+
+		for (n = 0; n < subband_width; n += 16)
+		{
+			/* shuffle the even coefficients in src_2n and the odd ones in src_2n_1 */
+			src_lo = _mm256_deinterleave_epi16(_mm256_loadu_si256((__m256i*) src));
+			src_hi = _mm256_deinterleave_epi16(_mm256_loadu_si256((__m256i*) (src + 16)));
+			src_2n = _mm256_permute2x128_si256(src_lo, src_hi, 0x20);
+			src_2n_1 = _mm256_permute2x128_si256(src_lo, src_hi, 0x31);
+			src_2n_2 = _mm256_shift_in_next_epi16(src_2n,
+				_mm256_set1_epi16((n == subband_width - 16) ? src[30] : src[32]));
+
+			/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+
+			h_n = _mm256_add_epi16(src_2n, src_2n_2);
+			h_n = _mm256_srai_epi16(h_n, 1);
+			h_n = _mm256_sub_epi16(src_2n_1, h_n);
+			h_n = _mm256_srai_epi16(h_n, 1);
+
+			_mm256_storeu_si256((__m256i*) h, h_n);
+
+			/* h[-1] = h[0] */
+			if (n == 0)
+				h_prev = _mm256_broadcastw_epi16(_mm256_castsi256_si128(h_n));
+
+			h_n_m = _mm256_shift_in_prev_epi16(h_n, h_prev);
+			h_prev = h_n;
+
+			/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+
+			l_n = _mm256_add_epi16(h_n_m, h_n);
+			l_n = _mm256_srai_epi16(l_n, 1);
+			l_n = _mm256_add_epi16(l_n, src_2n);
+
+			_mm256_storeu_si256((__m256i*) l, l_n);
+
+			src += 32;
+			l += 16;
+			h += 16;
+		}
+	}
+}
+
+static __inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_encode_block_avx2(INT16* buffer, INT16* dwt, int subband_width)
+{
+	INT16 *hl, *lh, *hh, *ll;
+	INT16 *l_src, *h_src;
+
+	/* DWT in vertical direction, results in 2 sub-bands in L, H order in tmp buffer dwt. */
+
+	l_src = dwt;
+	h_src = dwt + subband_width * subband_width * 2;
+
+	rfx_dwt_2d_encode_block_vert_avx2(buffer, l_src, h_src, subband_width);
+
+	/* DWT in horizontal direction, results in 4 sub-bands in HL(0), LH(1), HH(2), LL(3) order, stored in original buffer. */
+	/* The lower part L generates LL(3) and HL(0). */
+	/* The higher part H generates LH(1) and HH(2). */
+
+	ll = buffer + subband_width * subband_width * 3;
+	hl = buffer;
+
+	lh = buffer + subband_width * subband_width;
+	hh = buffer + subband_width * subband_width * 2;
+
+	rfx_dwt_2d_encode_block_horiz_avx2(l_src, ll, hl, subband_width);
+	rfx_dwt_2d_encode_block_horiz_avx2(h_src, lh, hh, subband_width);
+}
+
+static void rfx_dwt_2d_encode_avx2(INT16* buffer, INT16* dwt_buffer)
+{
+	rfx_dwt_2d_encode_block_avx2(buffer, dwt_buffer, 32);
+	rfx_dwt_2d_encode_block_avx2(buffer + 3072, dwt_buffer, 16);
+	rfx_dwt_2d_encode_block_avx2(buffer + 3840, dwt_buffer, 8);
+}
+
+void rfx_init_avx2(RFX_CONTEXT* context)
+{
+	if (!IsProcessorFeaturePresentEx(PF_EX_AVX2))
+		return;
+
+	IF_PROFILER(context->priv->prof_rfx_quantization_decode->name = "rfx_quantization_decode_avx2");
+	IF_PROFILER(context->priv->prof_rfx_quantization_encode->name = "rfx_quantization_encode_avx2");
+	IF_PROFILER(context->priv->prof_rfx_dwt_2d_decode->name = "rfx_dwt_2d_decode_avx2");
+	IF_PROFILER(context->priv->prof_rfx_dwt_2d_encode->name = "rfx_dwt_2d_encode_avx2");
+
+	context->quantization_decode = rfx_quantization_decode_avx2;
+	context->quantization_encode = rfx_quantization_encode_avx2;
+	context->dwt_2d_decode = rfx_dwt_2d_decode_avx2;
+	context->dwt_2d_encode = rfx_dwt_2d_encode_avx2;
+}
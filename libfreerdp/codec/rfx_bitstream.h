@@ -22,64 +22,163 @@
 
 #include <freerdp/codec/rfx.h>
 
+/**
+ * Big endian bit writer. Bits are collected in a 64-bit accumulator and
+ * stored 32 at a time, bits beyond the end of the buffer are dropped.
+ */
+
 struct _RFX_BITSTREAM
 {
+	UINT64 accumulator;
+	UINT32 count;
 	BYTE* buffer;
-	int nbytes;
-	int byte_pos;
-	int bits_left;
+	BYTE* pointer;
+	BYTE* end;
 };
 typedef struct _RFX_BITSTREAM RFX_BITSTREAM;
 
-#define rfx_bitstream_attach(bs, _buffer, _nbytes) do { \
-	bs->buffer = (BYTE*) (_buffer); \
-	bs->nbytes = (_nbytes); \
-	bs->byte_pos = 0; \
-	bs->bits_left = 8; } while (0)
-
-#define rfx_bitstream_get_bits(bs, _nbits, _r) do { \
-	int nbits = _nbits; \
-	int b; \
-	UINT16 n = 0; \
-	while (bs->byte_pos < bs->nbytes && nbits > 0) \
-	{ \
-		b = nbits; \
-		if (b > bs->bits_left) \
-			b = bs->bits_left; \
-		if (n) \
-			n <<= b; \
-		n |= (bs->buffer[bs->byte_pos] >> (bs->bits_left - b)) & ((1 << b) - 1); \
-		bs->bits_left -= b; \
-		nbits -= b; \
-		if (bs->bits_left == 0) \
-		{ \
-			bs->bits_left = 8; \
-			bs->byte_pos++; \
-		} \
-	} \
-	_r = n; } while (0)
-
-#define rfx_bitstream_put_bits(bs, _bits, _nbits) do { \
-	UINT16 bits = (_bits); \
-	int nbits = (_nbits); \
-	int b; \
-	while (bs->byte_pos < bs->nbytes && nbits > 0) \
-	{ \
-		b = nbits; \
-		if (b > bs->bits_left) \
-			b = bs->bits_left; \
-		bs->buffer[bs->byte_pos] |= ((bits >> (nbits - b)) & ((1 << b) - 1)) << (bs->bits_left - b); \
-		bs->bits_left -= b; \
-		nbits -= b; \
-		if (bs->bits_left == 0) \
-		{ \
-			bs->bits_left = 8; \
-			bs->byte_pos++; \
-		} \
-	} } while (0)
-
-#define rfx_bitstream_eos(_bs) ((_bs)->byte_pos >= (_bs)->nbytes)
-#define rfx_bitstream_left(_bs) ((_bs)->byte_pos >= (_bs)->nbytes ? 0 : ((_bs)->nbytes - (_bs)->byte_pos - 1) * 8 + (_bs)->bits_left)
-#define rfx_bitstream_get_processed_bytes(_bs) ((_bs)->bits_left < 8 ? (_bs)->byte_pos + 1 : (_bs)->byte_pos)
+static INLINE void rfx_bitstream_attach(RFX_BITSTREAM* bs, BYTE* buffer, int nbytes)
+{
+	bs->accumulator = 0;
+	bs->count = 0;
+	bs->buffer = buffer;
+	bs->pointer = buffer;
+	bs->end = &buffer[nbytes];
+}
+
+static INLINE void rfx_bitstream_store(RFX_BITSTREAM* bs, UINT32 value, int nbytes)
+{
+	int shift = 24;
+
+	if ((nbytes == 4) && ((bs->end - bs->pointer) >= 4))
+	{
+		bs->pointer[0] = (BYTE) (value >> 24);
+		bs->pointer[1] = (BYTE) (value >> 16);
+		bs->pointer[2] = (BYTE) (value >> 8);
+		bs->pointer[3] = (BYTE) value;
+		bs->pointer += 4;
+		return;
+	}
+
+	while ((nbytes-- > 0) && (bs->pointer < bs->end))
+	{
+		*bs->pointer++ = (BYTE) (value >> shift);
+		shift -= 8;
+	}
+}
+
+/* nbits must not exceed 32 */
+static INLINE void rfx_bitstream_put_bits(RFX_BITSTREAM* bs, UINT32 bits, UINT32 nbits)
+{
+	bs->accumulator = (bs->accumulator << nbits) | (bits & ((((UINT64) 1) << nbits) - 1));
+	bs->count += nbits;
+
+	if (bs->count >= 32)
+	{
+		bs->count -= 32;
+		rfx_bitstream_store(bs, (UINT32) (bs->accumulator >> bs->count), 4);
+	}
+}
+
+static INLINE void rfx_bitstream_put_ones(RFX_BITSTREAM* bs, UINT32 count)
+{
+	while (count >= 32)
+	{
+		rfx_bitstream_put_bits(bs, 0xFFFFFFFF, 32);
+		count -= 32;
+	}
+
+	rfx_bitstream_put_bits(bs, 0xFFFFFFFF, count);
+}
+
+/* pads the last byte with zero bits and returns the number of bytes written */
+static INLINE int rfx_bitstream_flush(RFX_BITSTREAM* bs)
+{
+	if (bs->count)
+	{
+		rfx_bitstream_store(bs, (UINT32) (bs->accumulator << (32 - bs->count)), (bs->count + 7) / 8);
+		bs->count = 0;
+	}
+
+	return (int) (bs->pointer - bs->buffer);
+}
+
+/**
+ * Big endian bit reader. The cache holds up to 64 bits of the stream and is
+ * refilled a word at a time, accumulator always holds the next 32 bits.
+ * Reading past the end of the buffer yields zero bits.
+ */
+
+struct _RFX_BITREADER
+{
+	UINT64 cache;
+	UINT32 cached;
+	UINT32 accumulator;
+	int remaining;
+	const BYTE* pointer;
+	const BYTE* end;
+};
+typedef struct _RFX_BITREADER RFX_BITREADER;
+
+static INLINE void rfx_bitreader_refill(RFX_BITREADER* bs)
+{
+	UINT64 word;
+	UINT32 nbytes;
+
+	if ((bs->end - bs->pointer) >= 8)
+	{
+		word = ((UINT64) bs->pointer[0] << 56) | ((UINT64) bs->pointer[1] << 48) |
+			((UINT64) bs->pointer[2] << 40) | ((UINT64) bs->pointer[3] << 32) |
+			((UINT64) bs->pointer[4] << 24) | ((UINT64) bs->pointer[5] << 16) |
+			((UINT64) bs->pointer[6] << 8) | ((UINT64) bs->pointer[7]);
+
+		/* the bits of a partially loaded byte are loaded again by the next refill */
+		nbytes = (64 - bs->cached) >> 3;
+		bs->cache |= word >> bs->cached;
+		bs->pointer += nbytes;
+		bs->cached += nbytes * 8;
+	}
+	else
+	{
+		while (bs->cached <= 56)
+		{
+			if (bs->pointer < bs->end)
+				bs->cache |= ((UINT64) *bs->pointer++) << (56 - bs->cached);
+
+			bs->cached += 8;
+		}
+	}
+
+	bs->accumulator = (UINT32) (bs->cache >> 32);
+}
+
+static INLINE void rfx_bitreader_attach(RFX_BITREADER* bs, const BYTE* buffer, UINT32 nbytes)
+{
+	bs->cache = 0;
+	bs->cached = 0;
+	bs->remaining = (int) (nbytes * 8);
+	bs->pointer = buffer;
+	bs->end = &buffer[nbytes];
+
+	rfx_bitreader_refill(bs);
+}
+
+/* nbits must not exceed 32 */
+static INLINE void rfx_bitreader_shift(RFX_BITREADER* bs, UINT32 nbits)
+{
+	bs->cache <<= nbits;
+	bs->cached -= nbits;
+	bs->remaining -= nbits;
+
+	if (bs->cached < 32)
+		rfx_bitreader_refill(bs);
+	else
+		bs->accumulator = (UINT32) (bs->cache >> 32);
+}
+
+/* returns the next nbits bits without consuming them, nbits must not exceed 32 */
+#define rfx_bitreader_peek(_bs, _nbits) ((UINT32) ((((UINT64) (_bs)->accumulator) << (_nbits)) >> 32))
+
+#define rfx_bitreader_get_remaining_length(_bs) ((_bs)->remaining)
 
 #endif /* __RFX_BITSTREAM_H */
@@ -22,7 +22,6 @@
 
 #include <freerdp/codec/rfx.h>
 
-void rfx_dwt_2d_decode(INT16* buffer, INT16* dwt_buffer);
-void rfx_dwt_2d_encode(INT16* buffer, INT16* dwt_buffer);
+/* rfx_dwt_2d_decode() and rfx_dwt_2d_encode() are declared in rfx.h */
 
 #endif /* __RFX_DWT_H */
@@ -22,8 +22,7 @@
 
 #include <freerdp/codec/rfx.h>
 
-void rfx_quantization_decode(INT16* buffer, const UINT32* quantization_values);
-void rfx_quantization_encode(INT16* buffer, const UINT32* quantization_values);
+/* rfx_quantization_decode() and rfx_quantization_encode() are declared in rfx.h */
 
 void rfx_quantization_decode_block(const primitives_t *prims, INT16* buffer, int buffer_size, UINT32 factor);
 
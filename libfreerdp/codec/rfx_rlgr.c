@@ -33,7 +33,6 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
 #include <winpr/sysinfo.h>
-#include <winpr/bitstream.h>
 
 #include "rfx_bitstream.h"
 
@@ -47,18 +46,6 @@
 #define UQ_GR	(3)	/* increase in kp after nonzero symbol in GR mode */
 #define DQ_GR	(3)	/* decrease in kp after zero symbol in GR mode */
 
-/* Returns the least number of bits required to represent a given value */
-#define GetMinBits(_val, _nbits) \
-{ \
-	UINT32 _v = _val; \
-	_nbits = 0; \
-	while (_v) \
-	{ \
-		_v >>= 1; \
-		_nbits++; \
-	} \
-}
-
 /*
  * Update the passed parameter and clamp it to the range [0, KPMAX]
  * Return the value of parameter right-shifted by LSGR
@@ -73,13 +60,17 @@
 	_k = (_param >> LSGR); \
 }
 
-static BOOL g_LZCNT = FALSE;
+static int g_LZCNT = -1;
 
 static INLINE UINT32 lzcnt_s(UINT32 x)
 {
 	if (!x)
 		return 32;
-	
+
+	/* detected once, concurrent first calls store the same value */
+	if (g_LZCNT < 0)
+		g_LZCNT = IsProcessorFeaturePresentEx(PF_EX_LZCNT) ? 1 : 0;
+
 	if (!g_LZCNT)
 	{
 		UINT32 y;
@@ -112,10 +103,8 @@ int rfx_rlgr_decode(const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData, UINT3
 	UINT32 val1;
 	UINT32 val2;
 	INT16* pOutput;
-	wBitStream* bs;
-	wBitStream s_bs;
-
-	g_LZCNT = IsProcessorFeaturePresentEx(PF_EX_LZCNT);
+	RFX_BITREADER* bs;
+	RFX_BITREADER s_bs;
 
 	k = 1;
 	kp = k << LSGR;
@@ -136,10 +125,9 @@ int rfx_rlgr_decode(const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData, UINT3
 
 	bs = &s_bs;
 
-	BitStream_Attach(bs, pSrcData, SrcSize);
-	BitStream_Fetch(bs);
+	rfx_bitreader_attach(bs, pSrcData, SrcSize);
 
-	while ((BitStream_GetRemainingLength(bs) > 0) && ((pOutput - pDstData) < DstSize))
+	while ((rfx_bitreader_get_remaining_length(bs) > 0) && ((pOutput - pDstData) < DstSize))
 	{
 		if (k)
 		{
@@ -151,20 +139,20 @@ int rfx_rlgr_decode(const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData, UINT3
 
 			cnt = lzcnt_s(bs->accumulator);
 
-			nbits = BitStream_GetRemainingLength(bs);
+			nbits = rfx_bitreader_get_remaining_length(bs);
 
 			if (cnt > nbits)
 				cnt = nbits;
 
 			vk = cnt;
 
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
+			while ((cnt == 32) && (rfx_bitreader_get_remaining_length(bs) > 0))
 			{
-				BitStream_Shift32(bs);
+				rfx_bitreader_shift(bs, 32);
 
 				cnt = lzcnt_s(bs->accumulator);
 
-				nbits = BitStream_GetRemainingLength(bs);
+				nbits = rfx_bitreader_get_remaining_length(bs);
 
 				if (cnt > nbits)
 					cnt = nbits;
@@ -172,12 +160,12 @@ int rfx_rlgr_decode(const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData, UINT3
 				vk += cnt;
 			}
 
-			BitStream_Shift(bs, (vk % 32));
+			rfx_bitreader_shift(bs, (vk % 32));
 
-			if (BitStream_GetRemainingLength(bs) < 1)
+			if (rfx_bitreader_get_remaining_length(bs) < 1)
 				break;
 
-			BitStream_Shift(bs, 1);
+			rfx_bitreader_shift(bs, 1);
 
 			while (vk--)
 			{
@@ -195,39 +183,38 @@ int rfx_rlgr_decode(const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData, UINT3
 
 			/* next k bits contain run length remainder */
 
-			if (BitStream_GetRemainingLength(bs) < k)
+			if (rfx_bitreader_get_remaining_length(bs) < k)
 				break;
 
-			bs->mask = ((1 << k) - 1);
-			run += ((bs->accumulator >> (32 - k)) & bs->mask);
-			BitStream_Shift(bs, k);
+			run += rfx_bitreader_peek(bs, k);
+			rfx_bitreader_shift(bs, k);
 
 			/* read sign bit */
 
-			if (BitStream_GetRemainingLength(bs) < 1)
+			if (rfx_bitreader_get_remaining_length(bs) < 1)
 				break;
 
 			sign = (bs->accumulator & 0x80000000) ? 1 : 0;
-			BitStream_Shift(bs, 1);
+			rfx_bitreader_shift(bs, 1);
 
 			/* count number of leading 1s */
 
 			cnt = lzcnt_s(~(bs->accumulator));
 
-			nbits = BitStream_GetRemainingLength(bs);
+			nbits = rfx_bitreader_get_remaining_length(bs);
 
 			if (cnt > nbits)
 				cnt = nbits;
 
 			vk = cnt;
 
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
+			while ((cnt == 32) && (rfx_bitreader_get_remaining_length(bs) > 0))
 			{
-				BitStream_Shift32(bs);
+				rfx_bitreader_shift(bs, 32);
 
 				cnt = lzcnt_s(~(bs->accumulator));
 
-				nbits = BitStream_GetRemainingLength(bs);
+				nbits = rfx_bitreader_get_remaining_length(bs);
 
 				if (cnt > nbits)
 					cnt = nbits;
@@ -235,21 +222,20 @@ int rfx_rlgr_decode(const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData, UINT3
 				vk += cnt;
 			}
 
-			BitStream_Shift(bs, (vk % 32));
+			rfx_bitreader_shift(bs, (vk % 32));
 
-			if (BitStream_GetRemainingLength(bs) < 1)
+			if (rfx_bitreader_get_remaining_length(bs) < 1)
 				break;
 
-			BitStream_Shift(bs, 1);
+			rfx_bitreader_shift(bs, 1);
 
 			/* next kr bits contain code remainder */
 
-			if (BitStream_GetRemainingLength(bs) < kr)
+			if (rfx_bitreader_get_remaining_length(bs) < kr)
 				break;
 
-			bs->mask = ((1 << kr) - 1);
-			code = (UINT16) ((bs->accumulator >> (32 - kr)) & bs->mask);
-			BitStream_Shift(bs, kr);
+			code = (UINT16) rfx_bitreader_peek(bs, kr);
+			rfx_bitreader_shift(bs, kr);
 
 			/* add (vk << kr) to code */
 
@@ -322,20 +308,20 @@ int rfx_rlgr_decode(const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData, UINT3
 
 			cnt = lzcnt_s(~(bs->accumulator));
 
-			nbits = BitStream_GetRemainingLength(bs);
+			nbits = rfx_bitreader_get_remaining_length(bs);
 
 			if (cnt > nbits)
 				cnt = nbits;
 
 			vk = cnt;
 
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
+			while ((cnt == 32) && (rfx_bitreader_get_remaining_length(bs) > 0))
 			{
-				BitStream_Shift32(bs);
+				rfx_bitreader_shift(bs, 32);
 
 				cnt = lzcnt_s(~(bs->accumulator));
 
-				nbits = BitStream_GetRemainingLength(bs);
+				nbits = rfx_bitreader_get_remaining_length(bs);
 
 				if (cnt > nbits)
 					cnt = nbits;
@@ -343,21 +329,20 @@ int rfx_rlgr_decode(const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData, UINT3
 				vk += cnt;
 			}
 
-			BitStream_Shift(bs, (vk % 32));
+			rfx_bitreader_shift(bs, (vk % 32));
 
-			if (BitStream_GetRemainingLength(bs) < 1)
+			if (rfx_bitreader_get_remaining_length(bs) < 1)
 				break;
 
-			BitStream_Shift(bs, 1);
+			rfx_bitreader_shift(bs, 1);
 
 			/* next kr bits contain code remainder */
 
-			if (BitStream_GetRemainingLength(bs) < kr)
+			if (rfx_bitreader_get_remaining_length(bs) < kr)
 				break;
 
-			bs->mask = ((1 << kr) - 1);
-			code = (UINT16) ((bs->accumulator >> (32 - kr)) & bs->mask);
-			BitStream_Shift(bs, kr);
+			code = (UINT16) rfx_bitreader_peek(bs, kr);
+			rfx_bitreader_shift(bs, kr);
 
 			/* add (vk << kr) to code */
 
@@ -435,16 +420,14 @@ int rfx_rlgr_decode(const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData, UINT3
 
 				if (code)
 				{
-					mag = (UINT32) code;
-					nIdx = 32 - lzcnt_s(mag);
+					nIdx = 32 - lzcnt_s((UINT32) code);
 				}
 
-				if (BitStream_GetRemainingLength(bs) < nIdx)
+				if (rfx_bitreader_get_remaining_length(bs) < nIdx)
 					break;
 
-				bs->mask = ((1 << nIdx) - 1);
-				val1 = ((bs->accumulator >> (32 - nIdx)) & bs->mask);
-				BitStream_Shift(bs, nIdx);
+				val1 = rfx_bitreader_peek(bs, nIdx);
+				rfx_bitreader_shift(bs, nIdx);
 
 				val2 = code - val1;
 
@@ -513,47 +496,57 @@ int rfx_rlgr_decode(const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData, UINT3
 	return 1;
 }
 
-/* Returns the next coefficient (a signed int) to encode, from the input stream */
-#define GetNextInput(_n) \
-{ \
-	if (data_size > 0) \
-	{ \
-		_n = *data++; \
-		data_size--; \
-	} \
-	else \
-	{ \
-		_n = 0; \
-	} \
+/* Returns the number of leading zero coefficients, at most data_size */
+static INLINE int rfx_rlgr_count_zeros(const INT16* data, int data_size)
+{
+	UINT64 block;
+	int count = 0;
+
+	/* four coefficients at a time */
+
+	while ((data_size - count) >= 4)
+	{
+		CopyMemory(&block, &data[count], sizeof(UINT64));
+
+		if (block)
+			break;
+
+		count += 4;
+	}
+
+	while ((count < data_size) && !data[count])
+		count++;
+
+	return count;
 }
 
 /* Emit bitPattern to the output bitstream */
 #define OutputBits(numBits, bitPattern) rfx_bitstream_put_bits(bs, bitPattern, numBits)
 
-/* Emit a bit (0 or 1), count number of times, to the output bitstream */
-#define OutputBit(count, bit) \
-{	\
-	UINT16 _b = (bit ? 0xFFFF : 0); \
-	int _c = (count); \
-	for (; _c > 0; _c -= 16) \
-		rfx_bitstream_put_bits(bs, _b, (_c > 16 ? 16 : _c)); \
-}
-
 /* Converts the input value to (2 * abs(input) - sign(input)), where sign(input) = (input < 0 ? 1 : 0) and returns it */
 #define Get2MagSign(input) ((input) >= 0 ? 2 * (input) : -2 * (input) - 1)
 
 /* Outputs the Golomb/Rice encoding of a non-negative integer */
 #define CodeGR(krp, val) rfx_rlgr_code_gr(bs, krp, val)
 
-static void rfx_rlgr_code_gr(RFX_BITSTREAM* bs, int* krp, UINT32 val)
+static INLINE void rfx_rlgr_code_gr(RFX_BITSTREAM* bs, int* krp, UINT32 val)
 {
 	int kr = *krp >> LSGR;
 
 	/* unary part of GR code */
 
 	UINT32 vk = (val) >> kr;
-	OutputBit(vk, 1);
-	OutputBit(1, 0);
+
+	if (vk < 32)
+	{
+		/* vk ones and the terminating zero at once */
+		OutputBits(vk + 1, 0xFFFFFFFE);
+	}
+	else
+	{
+		rfx_bitstream_put_ones(bs, vk);
+		OutputBits(1, 0);
+	}
 
 	/* remainder part of GR code, if needed */
 	if (kr)
@@ -577,11 +570,8 @@ int rfx_rlgr_encode(RLGR_MODE mode, const INT16* data, int data_size, BYTE* buff
 	int k;
 	int kp;
 	int krp;
-	RFX_BITSTREAM* bs;
-	int processed_size;
-
-	bs = (RFX_BITSTREAM*) malloc(sizeof(RFX_BITSTREAM));
-	ZeroMemory(bs, sizeof(RFX_BITSTREAM));
+	RFX_BITSTREAM s_bs;
+	RFX_BITSTREAM* bs = &s_bs;
 
 	rfx_bitstream_attach(bs, buffer, buffer_size);
 
@@ -604,39 +594,36 @@ int rfx_rlgr_encode(RLGR_MODE mode, const INT16* data, int data_size, BYTE* buff
 
 			/* RUN-LENGTH MODE */
 
-			/* collect the run of zeros in the input stream */
-			numZeros = 0;
-			GetNextInput(input);
-			while (input == 0 && data_size > 0)
-			{
-				numZeros++;
-				GetNextInput(input);
-			}
+			/* collect the run of zeros in the input stream, the last coefficient always terminates it */
+			numZeros = rfx_rlgr_count_zeros(data, data_size);
+
+			if (numZeros == data_size)
+				numZeros--;
+
+			input = data[numZeros];
+			data += numZeros + 1;
+			data_size -= numZeros + 1;
 
 			// emit output zeros
 			runmax = 1 << k;
 			while (numZeros >= runmax)
 			{
-				OutputBit(1, 0); /* output a zero bit */
+				OutputBits(1, 0); /* output a zero bit */
 				numZeros -= runmax;
 				UpdateParam(kp, UP_GR, k); /* update kp, k */
 				runmax = 1 << k;
 			}
 
-			/* output a 1 to terminate runs */
-			OutputBit(1, 1);
-
-			/* output the remaining run length using k bits */
-			OutputBits(k, numZeros);
-
 			/* note: when we reach here and the last byte being encoded is 0, we still
 			   need to output the last two bits, otherwise mstsc will crash */
 
-			/* encode the nonzero value using GR coding */
 			mag = (input < 0 ? -input : input); /* absolute value of input coefficient */
 			sign = (input < 0 ? 1 : 0);  /* sign of input coefficient */
 
-			OutputBit(1, sign); /* output the sign bit */
+			/* a 1 to terminate the run, the remaining run length using k bits and the sign bit */
+			OutputBits(k + 2, (((1 << k) | numZeros) << 1) | sign);
+
+			/* encode the nonzero value using GR coding */
 			CodeGR(&krp, mag ? mag - 1 : 0); /* output GR code for (mag - 1) */
 
 			UpdateParam(kp, -DN_GR, k);
@@ -652,7 +639,8 @@ int rfx_rlgr_encode(RLGR_MODE mode, const INT16* data, int data_size, BYTE* buff
 				/* RLGR1 variant */
 
 				/* convert input to (2*magnitude - sign), encode using GR code */
-				GetNextInput(input);
+				input = *data++;
+				data_size--;
 				twoMs = Get2MagSign(input);
 				CodeGR(&krp, twoMs);
 
@@ -680,16 +668,25 @@ int rfx_rlgr_encode(RLGR_MODE mode, const INT16* data, int data_size, BYTE* buff
 				/* convert the next two input values to (2*magnitude - sign) and */
 				/* encode their sum using GR code */
 
-				GetNextInput(input);
+				input = *data++;
+				data_size--;
 				twoMs1 = Get2MagSign(input);
-				GetNextInput(input);
+
+				input = 0;
+
+				if (data_size > 0)
+				{
+					input = *data++;
+					data_size--;
+				}
+
 				twoMs2 = Get2MagSign(input);
 				sum2Ms = twoMs1 + twoMs2;
 
 				CodeGR(&krp, sum2Ms);
 
 				/* encode binary representation of the first input (twoMs1). */
-				GetMinBits(sum2Ms, nIdx);
+				nIdx = 32 - lzcnt_s(sum2Ms);
 				OutputBits(nIdx, twoMs1);
 
 				/* update k,kp for the two input values */
@@ -706,8 +703,5 @@ int rfx_rlgr_encode(RLGR_MODE mode, const INT16* data, int data_size, BYTE* buff
 		}
 	}
 
-	processed_size = rfx_bitstream_get_processed_bytes(bs);
-	free(bs);
-
-	return processed_size;
+	return rfx_bitstream_flush(bs);
 }
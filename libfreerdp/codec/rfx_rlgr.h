@@ -22,6 +22,6 @@
 
 #include <freerdp/codec/rfx.h>
 
-int rfx_rlgr_encode(RLGR_MODE mode, const INT16* data, int data_size, BYTE* buffer, int buffer_size);
+/* rfx_rlgr_encode() and rfx_rlgr_decode() are declared in rfx.h */
 
 #endif /* __RFX_RLGR_H */
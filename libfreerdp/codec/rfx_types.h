@@ -30,6 +30,7 @@
 #include <winpr/collections.h>
 
 #include <freerdp/log.h>
+#include <freerdp/codec/rfx.h>
 #include <freerdp/utils/profiler.h>
 
 #define RFX_TAG FREERDP_TAG("codec.rfx")
@@ -47,6 +48,7 @@ struct _RFX_CONTEXT_PRIV
 	wObjectPool* TilePool;
 
 	BOOL UseThreads;
+	int numWorkObjects;
 	PTP_WORK* workObjects;
 	RFX_TILE_COMPOSE_WORK_PARAM* tileWorkParams;
 
@@ -58,6 +60,23 @@ struct _RFX_CONTEXT_PRIV
  
 	wBufferPool* BufferPool;
 
+	/* encoder frame reused by rfx_encode_frame(), tiles keep their buffers */
+	RFX_MESSAGE frame;
+	int frameTileCapacity;
+	int frameRectCapacity;
+
+	/* tiles already encoded in the current frame */
+	BYTE* tileGrid;
+	int tileGridSize;
+
+	/* content last sent for each tile, used to skip unchanged tiles */
+	BOOL ChangeDetection;
+	BYTE* refData;
+	BYTE* refValid;
+	int refWidth;
+	int refHeight;
+	int refStep;
+
 	/* profilers */
 	PROFILER_DEFINE(prof_rfx_decode_rgb);
 	PROFILER_DEFINE(prof_rfx_decode_component);
@@ -0,0 +1,444 @@
+
+#include <winpr/crt.h>
+#include <winpr/print.h>
+
+#include <freerdp/settings.h>
+#include <freerdp/codec/mppc.h>
+#include <freerdp/codec/ncrush.h>
+#include <freerdp/codec/xcrush.h>
+#include <freerdp/utils/pcap.h>
+#include <freerdp/utils/stopwatch.h>
+
+/**
+ * Bulk compression benchmark: every PDU of a stream is compressed and sent
+ * back through the matching decompressor for each compression type and
+ * effort, reporting the throughput and the compression ratio. A PDU that does
+ * not round trip fails the test.
+ *
+ * Without arguments a synthetic stream of order-like PDUs is used. A captured
+ * stream can be given as first argument instead: a pcap file as written by
+ * pcap_add_record() with one uncompressed PDU per record.
+ */
+
+#define TEST_BULK_PDU_COUNT	512
+
+struct _TEST_BULK_PDU
+{
+	BYTE* data;
+	UINT32 size;
+};
+typedef struct _TEST_BULK_PDU TEST_BULK_PDU;
+
+struct _TEST_BULK_STREAM
+{
+	UINT32 count;
+	UINT64 size;
+	TEST_BULK_PDU* pdus;
+};
+typedef struct _TEST_BULK_STREAM TEST_BULK_STREAM;
+
+static UINT32 test_bulk_seed = 0x12345678;
+
+static UINT32 test_bulk_rand(void)
+{
+	test_bulk_seed = (test_bulk_seed * 1103515245) + 12345;
+	return (test_bulk_seed >> 16) & 0x7FFF;
+}
+
+static const char* test_bulk_words[] =
+{
+	"File", "Edit", "View", "Window", "Help", "Document", "Settings", "Properties",
+	"Cancel", "Apply", "OK", "Untitled", "Desktop", "Computer", "Network", "Recycle Bin"
+};
+
+static void test_bulk_fill_orders(BYTE* data, UINT32 size)
+{
+	UINT32 i;
+	UINT32 x = test_bulk_rand() % 1024;
+	UINT32 y = test_bulk_rand() % 768;
+
+	/* primary drawing orders: a few header bytes and coordinate deltas */
+
+	for (i = 0; (i + 12) <= size; i += 12)
+	{
+		x = (x + (test_bulk_rand() % 16)) % 1024;
+		y = (y + (test_bulk_rand() % 4)) % 768;
+
+		data[i + 0] = 0x09;
+		data[i + 1] = 0x0A;
+		data[i + 2] = 0x3F;
+		data[i + 3] = (BYTE) (x & 0xFF);
+		data[i + 4] = (BYTE) (x >> 8);
+		data[i + 5] = (BYTE) (y & 0xFF);
+		data[i + 6] = (BYTE) (y >> 8);
+		data[i + 7] = 0x10;
+		data[i + 8] = 0x00;
+		data[i + 9] = 0x10;
+		data[i + 10] = 0x00;
+		data[i + 11] = (BYTE) (test_bulk_rand() % 4);
+	}
+
+	for (; i < size; i++)
+		data[i] = 0;
+}
+
+static void test_bulk_fill_text(BYTE* data, UINT32 size)
+{
+	UINT32 i = 0;
+	UINT32 length;
+	const char* word;
+
+	/* glyph indices and strings of window titles and menus */
+
+	while (i < size)
+	{
+		word = test_bulk_words[test_bulk_rand() % ARRAYSIZE(test_bulk_words)];
+		length = strlen(word);
+
+		if (length > (size - i))
+			length = size - i;
+
+		CopyMemory(&data[i], word, length);
+		i += length;
+
+		if (i < size)
+			data[i++] = (BYTE) (test_bulk_rand() % 3);
+	}
+}
+
+static void test_bulk_fill_bitmap(BYTE* data, UINT32 size)
+{
+	UINT32 i = 0;
+	UINT32 run;
+	BYTE color[4];
+
+	/* 32bpp pixel runs with a little noise */
+
+	while (i < size)
+	{
+		color[0] = (BYTE) (test_bulk_rand() % 8) * 32;
+		color[1] = (BYTE) (test_bulk_rand() % 8) * 32;
+		color[2] = (BYTE) (test_bulk_rand() % 8) * 32;
+		color[3] = 0xFF;
+
+		for (run = test_bulk_rand() % 64; run && (i < size); run--, i++)
+			data[i] = color[i % 4] ^ ((test_bulk_rand() % 16) ? 0 : 1);
+	}
+}
+
+static void test_bulk_fill_noise(BYTE* data, UINT32 size)
+{
+	UINT32 i;
+
+	/* already compressed content, such as codec payloads */
+
+	for (i = 0; i < size; i++)
+		data[i] = (BYTE) (test_bulk_rand() >> 3);
+}
+
+static BOOL test_bulk_stream_add(TEST_BULK_STREAM* stream, BYTE* data, UINT32 size)
+{
+	TEST_BULK_PDU* pdus;
+
+	pdus = (TEST_BULK_PDU*) realloc(stream->pdus, sizeof(TEST_BULK_PDU) * (stream->count + 1));
+
+	if (!pdus)
+		return FALSE;
+
+	stream->pdus = pdus;
+	stream->pdus[stream->count].data = data;
+	stream->pdus[stream->count].size = size;
+	stream->count++;
+	stream->size += size;
+
+	return TRUE;
+}
+
+static BOOL test_bulk_stream_generate(TEST_BULK_STREAM* stream)
+{
+	UINT32 index;
+	UINT32 size;
+	BYTE* data;
+
+	for (index = 0; index < TEST_BULK_PDU_COUNT; index++)
+	{
+		size = 64 + (test_bulk_rand() % 4096);
+		data = (BYTE*) malloc(size);
+
+		if (!data)
+			return FALSE;
+
+		switch (index % 8)
+		{
+			case 0:
+			case 1:
+			case 2:
+				test_bulk_fill_orders(data, size);
+				break;
+
+			case 3:
+			case 4:
+				test_bulk_fill_text(data, size);
+				break;
+
+			case 5:
+			case 6:
+				test_bulk_fill_bitmap(data, size);
+				break;
+
+			default:
+				test_bulk_fill_noise(data, size);
+				break;
+		}
+
+		if (!test_bulk_stream_add(stream, data, size))
+		{
+			free(data);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL test_bulk_stream_load(TEST_BULK_STREAM* stream, char* name)
+{
+	BOOL status = TRUE;
+	rdpPcap* pcap;
+	pcap_record record;
+
+	pcap = pcap_open(name, FALSE);
+
+	if (!pcap)
+		return FALSE;
+
+	while (status && pcap_has_next_record(pcap))
+	{
+		if (!pcap_get_next_record_header(pcap, &record))
+			break;
+
+		record.data = malloc(record.length);
+
+		if (!record.data)
+			status = FALSE;
+		else if (!pcap_get_next_record_content(pcap, &record))
+			status = FALSE;
+		else if ((record.length > 50) && (record.length < 16384))
+			status = test_bulk_stream_add(stream, (BYTE*) record.data, record.length);
+		else
+			free(record.data); /* bulk_compress() passes these through */
+
+		if (!status)
+			free(record.data);
+	}
+
+	pcap_close(pcap);
+
+	return status && (stream->count > 0);
+}
+
+static void test_bulk_stream_free(TEST_BULK_STREAM* stream)
+{
+	UINT32 index;
+
+	for (index = 0; index < stream->count; index++)
+		free(stream->pdus[index].data);
+
+	free(stream->pdus);
+}
+
+static int test_bulk_compress(void* send, UINT32 type, BYTE* pSrcData, UINT32 SrcSize,
+		BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags)
+{
+	if (type == PACKET_COMPR_TYPE_RDP6)
+		return ncrush_compress((NCRUSH_CONTEXT*) send, pSrcData, SrcSize, ppDstData, pDstSize, pFlags);
+	else if (type == PACKET_COMPR_TYPE_RDP61)
+		return xcrush_compress((XCRUSH_CONTEXT*) send, pSrcData, SrcSize, ppDstData, pDstSize, pFlags);
+
+	return mppc_compress((MPPC_CONTEXT*) send, pSrcData, SrcSize, ppDstData, pDstSize, pFlags);
+}
+
+static int test_bulk_decompress(void* recv, UINT32 type, BYTE* pSrcData, UINT32 SrcSize,
+		BYTE** ppDstData, UINT32* pDstSize, UINT32 flags)
+{
+	if (!(flags & 0xE0))
+	{
+		*ppDstData = pSrcData;
+		*pDstSize = SrcSize;
+		return 0;
+	}
+
+	if (type == PACKET_COMPR_TYPE_RDP6)
+		return ncrush_decompress((NCRUSH_CONTEXT*) recv, pSrcData, SrcSize, ppDstData, pDstSize, flags);
+	else if (type == PACKET_COMPR_TYPE_RDP61)
+		return xcrush_decompress((XCRUSH_CONTEXT*) recv, pSrcData, SrcSize, ppDstData, pDstSize, flags);
+
+	return mppc_decompress((MPPC_CONTEXT*) recv, pSrcData, SrcSize, ppDstData, pDstSize, flags);
+}
+
+static int test_bulk_run(TEST_BULK_STREAM* stream, UINT32 type, UINT32 effort)
+{
+	int rc = -1;
+	UINT32 index;
+	UINT32 flags;
+	UINT32 SrcSize;
+	UINT32 DstSize;
+	BYTE* pSrcData;
+	BYTE* pDstData;
+	UINT64 CompressedBytes = 0;
+	double compressTime;
+	double decompressTime;
+	void* send = NULL;
+	void* recv = NULL;
+	STOPWATCH* compressWatch;
+	STOPWATCH* decompressWatch;
+	BYTE OutputBuffer[65536];
+	static const char* names[] = { "MPPC-8K", "MPPC-64K", "NCRUSH", "XCRUSH" };
+
+	compressWatch = stopwatch_create();
+	decompressWatch = stopwatch_create();
+
+	if (type == PACKET_COMPR_TYPE_RDP6)
+	{
+		send = ncrush_context_new(TRUE);
+		recv = ncrush_context_new(FALSE);
+
+		if (send)
+			ncrush_set_compression_effort((NCRUSH_CONTEXT*) send, effort);
+	}
+	else if (type == PACKET_COMPR_TYPE_RDP61)
+	{
+		send = xcrush_context_new(TRUE);
+		recv = xcrush_context_new(FALSE);
+
+		if (send)
+			xcrush_set_compression_effort((XCRUSH_CONTEXT*) send, effort);
+	}
+	else
+	{
+		send = mppc_context_new(type, TRUE);
+		recv = mppc_context_new(type, FALSE);
+	}
+
+	if (!send || !recv || !compressWatch || !decompressWatch)
+		goto fail;
+
+	for (index = 0; index < stream->count; index++)
+	{
+		flags = 0;
+		pSrcData = stream->pdus[index].data;
+		SrcSize = stream->pdus[index].size;
+		pDstData = OutputBuffer;
+		DstSize = sizeof(OutputBuffer);
+
+		stopwatch_start(compressWatch);
+
+		if (test_bulk_compress(send, type, pSrcData, SrcSize, &pDstData, &DstSize, &flags) < 0)
+		{
+			printf("%s effort %u: compression of PDU %u failed\n", names[type], effort, index);
+			goto fail;
+		}
+
+		stopwatch_stop(compressWatch);
+
+		flags |= type;
+		CompressedBytes += DstSize;
+		pSrcData = pDstData;
+		SrcSize = DstSize;
+
+		stopwatch_start(decompressWatch);
+
+		if (test_bulk_decompress(recv, type, pSrcData, SrcSize, &pDstData, &DstSize, flags) < 0)
+		{
+			printf("%s effort %u: decompression of PDU %u failed\n", names[type], effort, index);
+			goto fail;
+		}
+
+		stopwatch_stop(decompressWatch);
+
+		if ((DstSize != stream->pdus[index].size) ||
+				(memcmp(pDstData, stream->pdus[index].data, DstSize) != 0))
+		{
+			printf("%s effort %u: PDU %u does not round trip\n", names[type], effort, index);
+			goto fail;
+		}
+	}
+
+	compressTime = stopwatch_get_elapsed_time_in_seconds(compressWatch);
+	decompressTime = stopwatch_get_elapsed_time_in_seconds(decompressWatch);
+
+	printf("%-8s effort %u: ratio %6.3f compress %8.2f MB/s decompress %8.2f MB/s\n",
+			names[type], effort, (double) stream->size / (double) CompressedBytes,
+			(compressTime > 0.0) ? stream->size / compressTime / (1024.0 * 1024.0) : 0.0,
+			(decompressTime > 0.0) ? stream->size / decompressTime / (1024.0 * 1024.0) : 0.0);
+
+	rc = 0;
+
+fail:
+	if (type == PACKET_COMPR_TYPE_RDP6)
+	{
+		ncrush_context_free((NCRUSH_CONTEXT*) send);
+		ncrush_context_free((NCRUSH_CONTEXT*) recv);
+	}
+	else if (type == PACKET_COMPR_TYPE_RDP61)
+	{
+		xcrush_context_free((XCRUSH_CONTEXT*) send);
+		xcrush_context_free((XCRUSH_CONTEXT*) recv);
+	}
+	else
+	{
+		mppc_context_free((MPPC_CONTEXT*) send);
+		mppc_context_free((MPPC_CONTEXT*) recv);
+	}
+
+	stopwatch_free(compressWatch);
+	stopwatch_free(decompressWatch);
+
+	return rc;
+}
+
+int TestFreeRDPCodecBulk(int argc, char* argv[])
+{
+	int rc = -1;
+	UINT32 type;
+	UINT32 effort;
+	TEST_BULK_STREAM stream;
+
+	ZeroMemory(&stream, sizeof(TEST_BULK_STREAM));
+
+	if (argc > 1)
+	{
+		if (!test_bulk_stream_load(&stream, argv[1]))
+		{
+			printf("failed to load PDU stream from %s\n", argv[1]);
+			goto fail;
+		}
+	}
+	else if (!test_bulk_stream_generate(&stream))
+	{
+		goto fail;
+	}
+
+	printf("%u PDUs, %u bytes\n", stream.count, (UINT32) stream.size);
+
+	for (type = PACKET_COMPR_TYPE_8K; type <= PACKET_COMPR_TYPE_RDP61; type++)
+	{
+		for (effort = BULK_COMPRESSION_EFFORT_FAST; effort <= BULK_COMPRESSION_EFFORT_HIGH; effort++)
+		{
+			/* MPPC has a single hash probe at every effort */
+
+			if ((type < PACKET_COMPR_TYPE_RDP6) && (effort != BULK_COMPRESSION_EFFORT_DEFAULT))
+				continue;
+
+			if (test_bulk_run(&stream, type, effort) < 0)
+				goto fail;
+		}
+	}
+
+	rc = 0;
+
+fail:
+	test_bulk_stream_free(&stream);
+
+	return rc;
+}
@@ -0,0 +1,483 @@
+#include <math.h>
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/codec/dsp.h>
+#include <freerdp/codec/audio.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/**
+ * Resampler quality and throughput: generated tones are resampled in
+ * chunks of varying size as an audio stream would be, the signal-to-noise
+ * ratio of the output is measured against the best fitting sine at the
+ * tone frequency. A tone above the output Nyquist frequency must be
+ * filtered out when downsampling.
+ */
+
+#define TEST_DSP_SECONDS	2
+#define TEST_DSP_AMPLITUDE	16384.0
+
+struct _TEST_DSP_CASE
+{
+	UINT32 srate;
+	UINT32 schan;
+	UINT32 rrate;
+	UINT32 rchan;
+	double frequency;
+	double minSnr[3];
+};
+typedef struct _TEST_DSP_CASE TEST_DSP_CASE;
+
+static const TEST_DSP_CASE g_Cases[] =
+{
+	{ 44100, 2, 48000, 2, 1000.0, { 45.0, 65.0, 85.0 } },
+	{ 48000, 2, 44100, 2, 1000.0, { 45.0, 65.0, 85.0 } },
+	{ 22050, 2, 44100, 2, 3000.0, { 15.0, 65.0, 85.0 } },
+	{ 8000, 1, 48000, 2, 440.0, { 35.0, 65.0, 85.0 } },
+	{ 48000, 2, 16000, 1, 1100.0, { 45.0, 65.0, 85.0 } },
+	{ 11025, 1, 44100, 1, 2000.0, { 15.0, 65.0, 85.0 } }
+};
+
+static const int g_Chunks[] = { 441, 1000, 37, 2048, 1, 512 };
+
+static const char* g_Quality[3] = { "low", "medium", "high" };
+
+/* the right channel plays a different tone, unless channels are mixed down */
+static double test_dsp_frequency(const TEST_DSP_CASE* test, UINT32 channel)
+{
+	return ((channel == 1) && (test->rchan >= test->schan)) ? test->frequency * 1.37 : test->frequency;
+}
+
+static INT16* test_dsp_tone(const TEST_DSP_CASE* test, UINT32 frames)
+{
+	UINT32 i, c;
+	INT16* samples;
+
+	samples = (INT16*) malloc(frames * test->schan * sizeof(INT16));
+
+	if (!samples)
+		return NULL;
+
+	for (i = 0; i < frames; i++)
+	{
+		for (c = 0; c < test->schan; c++)
+		{
+			samples[i * test->schan + c] = (INT16) lrint(TEST_DSP_AMPLITUDE *
+					sin(2.0 * M_PI * test_dsp_frequency(test, c) * i / test->srate));
+		}
+	}
+
+	return samples;
+}
+
+/* resamples all frames in chunks, returns the number of output frames */
+static UINT32 test_dsp_run(FREERDP_DSP_CONTEXT* context, const INT16* src, UINT32 frames,
+		const TEST_DSP_CASE* test, INT16* dst, UINT32 maxFrames)
+{
+	UINT32 offset = 0;
+	UINT32 count = 0;
+	UINT32 chunk;
+	int index = 0;
+
+	while (offset < frames)
+	{
+		chunk = g_Chunks[index++ % ARRAYSIZE(g_Chunks)];
+
+		if (chunk > frames - offset)
+			chunk = frames - offset;
+
+		if (!context->resample(context, (const BYTE*) &src[offset * test->schan], 2,
+				test->schan, test->srate, chunk, test->rchan, test->rrate))
+			return 0;
+
+		if (dst)
+		{
+			if (count + context->resampled_frames > maxFrames)
+				return 0;
+
+			CopyMemory(&dst[count * test->rchan], context->resampled_buffer, context->resampled_size);
+		}
+
+		count += context->resampled_frames;
+		offset += chunk;
+	}
+
+	return count;
+}
+
+/* least squares fit of a sine at the given frequency, returns the SNR in dB */
+static double test_dsp_snr(const INT16* samples, UINT32 channel, UINT32 channels,
+		UINT32 first, UINT32 frames, double frequency, UINT32 rate)
+{
+	UINT32 i;
+	double y, s, c;
+	double Sss = 0, Scc = 0, Ssc = 0, Sys = 0, Syc = 0;
+	double det, a, b;
+	double fit, signal = 0, noise = 0;
+	double omega = 2.0 * M_PI * frequency / rate;
+
+	for (i = first; i < frames; i++)
+	{
+		y = samples[i * channels + channel];
+		s = sin(omega * i);
+		c = cos(omega * i);
+		Sss += s * s;
+		Scc += c * c;
+		Ssc += s * c;
+		Sys += y * s;
+		Syc += y * c;
+	}
+
+	det = Sss * Scc - Ssc * Ssc;
+	a = (Sys * Scc - Syc * Ssc) / det;
+	b = (Syc * Sss - Sys * Ssc) / det;
+
+	for (i = first; i < frames; i++)
+	{
+		fit = a * sin(omega * i) + b * cos(omega * i);
+		y = samples[i * channels + channel];
+		signal += fit * fit;
+		noise += (y - fit) * (y - fit);
+	}
+
+	if (noise <= 0.0)
+		return 200.0;
+
+	return 10.0 * log10(signal / noise);
+}
+
+static BOOL test_dsp_quality(const TEST_DSP_CASE* test, UINT32 quality)
+{
+	UINT32 c;
+	UINT32 frames;
+	UINT32 maxFrames;
+	UINT32 rframes;
+	double snr;
+	double frequency;
+	BOOL rc = FALSE;
+	INT16* src = NULL;
+	INT16* dst = NULL;
+	FREERDP_DSP_CONTEXT* context;
+
+	context = freerdp_dsp_context_new();
+
+	if (!context)
+		return FALSE;
+
+	context->resample_quality = quality;
+
+	frames = test->srate * TEST_DSP_SECONDS;
+	maxFrames = test->rrate * TEST_DSP_SECONDS + 16;
+	src = test_dsp_tone(test, frames);
+	dst = (INT16*) calloc(maxFrames * test->rchan, sizeof(INT16));
+
+	if (!src || !dst)
+		goto fail;
+
+	rframes = test_dsp_run(context, src, frames, test, dst, maxFrames);
+
+	if ((rframes + 2 < test->rrate * TEST_DSP_SECONDS) || (rframes > test->rrate * TEST_DSP_SECONDS))
+	{
+		printf("%u -> %u %s: %u frames, expected %u\n", test->srate, test->rrate,
+				g_Quality[quality], rframes, test->rrate * TEST_DSP_SECONDS);
+		goto fail;
+	}
+
+	for (c = 0; c < test->rchan; c++)
+	{
+		/* upmixed channels repeat the source channels */
+		frequency = test_dsp_frequency(test, c % test->schan);
+
+		/* skip the filter delay, a tenth of a second */
+		snr = test_dsp_snr(dst, c, test->rchan, test->rrate / 10, rframes, frequency, test->rrate);
+
+		printf("%5u/%u -> %5u/%u %-6s channel %u: %.1f Hz tone, SNR %.1f dB\n", test->srate, test->schan,
+				test->rrate, test->rchan, g_Quality[quality], c, frequency, snr);
+
+		if (snr < test->minSnr[quality])
+			goto fail;
+	}
+
+	rc = TRUE;
+
+fail:
+	free(src);
+	free(dst);
+	freerdp_dsp_context_free(context);
+
+	return rc;
+}
+
+/* a tone above the output Nyquist frequency, returns the output level relative to the input in dB */
+static double test_dsp_alias(UINT32 quality)
+{
+	UINT32 i;
+	UINT32 frames;
+	UINT32 rframes;
+	double energy = 0.0;
+	INT16* src;
+	INT16* dst;
+	FREERDP_DSP_CONTEXT* context;
+	TEST_DSP_CASE test = { 48000, 1, 16000, 1, 10000.0, { 0 } };
+
+	context = freerdp_dsp_context_new();
+	frames = test.srate * TEST_DSP_SECONDS;
+	src = test_dsp_tone(&test, frames);
+	dst = (INT16*) calloc(test.rrate * TEST_DSP_SECONDS + 16, sizeof(INT16));
+	rframes = 0;
+
+	if (context && src && dst)
+	{
+		context->resample_quality = quality;
+		rframes = test_dsp_run(context, src, frames, &test, dst, test.rrate * TEST_DSP_SECONDS + 16);
+	}
+
+	for (i = test.rrate / 10; i < rframes; i++)
+		energy += ((double) dst[i]) * dst[i];
+
+	/* an empty output counts as full level */
+	energy = (rframes > test.rrate / 10) ? energy / (rframes - test.rrate / 10) :
+			TEST_DSP_AMPLITUDE * TEST_DSP_AMPLITUDE / 2.0;
+
+	free(src);
+	free(dst);
+	freerdp_dsp_context_free(context);
+
+	/* a sine of amplitude A has a mean energy of A^2 / 2 */
+	return 10.0 * log10((energy + 1e-3) / (TEST_DSP_AMPLITUDE * TEST_DSP_AMPLITUDE / 2.0));
+}
+
+static BOOL test_dsp_throughput(UINT32 quality)
+{
+	UINT32 frames;
+	UINT64 start;
+	UINT64 elapsed;
+	INT16* src;
+	FREERDP_DSP_CONTEXT* context;
+	TEST_DSP_CASE test = { 44100, 2, 48000, 2, 1000.0, { 0 } };
+
+	context = freerdp_dsp_context_new();
+	frames = test.srate * 20;
+	src = test_dsp_tone(&test, frames);
+
+	if (!context || !src)
+	{
+		free(src);
+		freerdp_dsp_context_free(context);
+		return FALSE;
+	}
+
+	context->resample_quality = quality;
+
+	start = GetTickCount64();
+	test_dsp_run(context, src, frames, &test, NULL, 0);
+	elapsed = GetTickCount64() - start;
+
+	printf("44100/2 -> 48000/2 %-6s: 20 s of audio in %d ms (%.0fx realtime)\n",
+			g_Quality[quality], (int) elapsed, 20000.0 / (elapsed ? elapsed : 1));
+
+	free(src);
+	freerdp_dsp_context_free(context);
+
+	return TRUE;
+}
+
+/**
+ * Codec loopback: a stereo tone is encoded by one context as the rdpsnd
+ * server and the audin client do, a wave of the block frames of the
+ * format at a time, and decoded by another as on the other end of the
+ * channel. Frame based codecs are fed waves of a few frames more or less,
+ * as after resampling. The decoded tone is measured as above, and the
+ * audio time of each wave must match what was encoded.
+ */
+
+struct _TEST_DSP_CODEC_CASE
+{
+	AUDIO_FORMAT format;
+	double frequency;
+	double minSnr;
+};
+typedef struct _TEST_DSP_CODEC_CASE TEST_DSP_CODEC_CASE;
+
+static const TEST_DSP_CODEC_CASE g_CodecCases[] =
+{
+	{ { WAVE_FORMAT_DVI_ADPCM, 2, 44100, 44273, 2048, 4, 0, NULL }, 1000.0, 25.0 },
+	{ { WAVE_FORMAT_DVI_ADPCM, 1, 22050, 11069, 512, 4, 0, NULL }, 440.0, 25.0 },
+	{ { WAVE_FORMAT_ADPCM, 2, 44100, 44360, 2048, 4, 0, NULL }, 1000.0, 25.0 },
+	{ { WAVE_FORMAT_ADPCM, 1, 22050, 11155, 512, 4, 0, NULL }, 440.0, 25.0 },
+	/* 64 kbit/s with 20 ms frames and 24 kbit/s with 10 ms frames, a perceptual codec
+	 * is not held to a waveform SNR, only gross errors are caught */
+	{ { WAVE_FORMAT_OPUS, 2, 48000, 8000, 160, 0, 0, NULL }, 1000.0, 12.0 },
+	{ { WAVE_FORMAT_OPUS, 1, 16000, 3000, 30, 0, 0, NULL }, 440.0, 12.0 }
+};
+
+static BOOL test_dsp_codec(const TEST_DSP_CODEC_CASE* test)
+{
+	UINT32 c;
+	UINT32 wave;
+	UINT32 frames;
+	UINT32 offset;
+	UINT32 chunk;
+	UINT32 blockFrames;
+	UINT32 decoded;
+	UINT32 encoded = 0;
+	UINT32 length;
+	UINT32 expected;
+	UINT32 rframes;
+	double snr;
+	BOOL rc = FALSE;
+	INT16* src = NULL;
+	wStream* s = NULL;
+	wStream* out = NULL;
+	FREERDP_DSP_CONTEXT* encoder;
+	FREERDP_DSP_CONTEXT* decoder;
+	const AUDIO_FORMAT* format = &test->format;
+	TEST_DSP_CASE tone = { format->nSamplesPerSec, format->nChannels, format->nSamplesPerSec,
+			format->nChannels, test->frequency, { 0 } };
+
+	if (!freerdp_dsp_supports_format(format, TRUE) || !freerdp_dsp_supports_format(format, FALSE))
+	{
+		printf("%s: not supported\n", rdpsnd_get_audio_tag_string(format->wFormatTag));
+
+		/* Opus is an optional dependency */
+		return format->wFormatTag == WAVE_FORMAT_OPUS;
+	}
+
+	encoder = freerdp_dsp_context_new();
+	decoder = freerdp_dsp_context_new();
+	blockFrames = freerdp_dsp_get_block_frames(format);
+
+	/* a partial last block is padded by the server, code whole blocks */
+	frames = format->nSamplesPerSec * TEST_DSP_SECONDS;
+	frames -= blockFrames ? frames % blockFrames : 0;
+	src = test_dsp_tone(&tone, frames);
+	s = Stream_New(NULL, 4096);
+	out = Stream_New(NULL, (frames + blockFrames) * format->nChannels * 2);
+
+	if (!encoder || !decoder || !blockFrames || !src || !s || !out)
+		goto fail;
+
+	for (wave = 0, offset = 0; offset < frames; wave++, offset += chunk)
+	{
+		chunk = blockFrames;
+
+		if ((format->wFormatTag == WAVE_FORMAT_OPUS) && (wave % 3))
+			chunk += (wave % 3 == 1) ? 3 : -3;
+
+		if (chunk > frames - offset)
+			chunk = frames - offset;
+
+		Stream_SetPosition(s, 0);
+
+		if (!freerdp_dsp_encode(encoder, format, (const BYTE*) &src[offset * format->nChannels],
+				chunk * format->nChannels * 2, s))
+			goto fail;
+
+		length = (UINT32) Stream_GetPosition(s);
+
+		if (!length)
+			continue;
+
+		if (length % format->nBlockAlign)
+			goto fail;
+
+		encoded += length;
+		decoded = (UINT32) Stream_GetPosition(out);
+
+		if (!freerdp_dsp_decode(decoder, format, Stream_Buffer(s), length, out))
+			goto fail;
+
+		/* the audio time of the wave, as the client confirms it */
+		decoded = ((UINT32) Stream_GetPosition(out) - decoded) / (format->nChannels * 2);
+		expected = decoded * 1000 / format->nSamplesPerSec;
+
+		if (abs((int) rdpsnd_compute_audio_time_length((AUDIO_FORMAT*) format, length) - (int) expected) > 1)
+		{
+			printf("%s: wave of %u bytes plays %u ms, expected %u ms\n",
+					rdpsnd_get_audio_tag_string(format->wFormatTag), length,
+					rdpsnd_compute_audio_time_length((AUDIO_FORMAT*) format, length), expected);
+			goto fail;
+		}
+	}
+
+	rframes = (UINT32) Stream_GetPosition(out) / (format->nChannels * 2);
+
+	/* frame based codecs hold back less than a frame */
+	if ((rframes > frames) || (rframes + blockFrames < frames))
+	{
+		printf("%s: %u frames decoded, expected %u\n",
+				rdpsnd_get_audio_tag_string(format->wFormatTag), rframes, frames);
+		goto fail;
+	}
+
+	for (c = 0; c < format->nChannels; c++)
+	{
+		snr = test_dsp_snr((INT16*) Stream_Buffer(out), c, format->nChannels, format->nSamplesPerSec / 10,
+				rframes, test_dsp_frequency(&tone, c), format->nSamplesPerSec);
+
+		printf("%-21s %5u/%u %4u byte blocks of %4u frames, %6.1f kbit/s, channel %u: SNR %.1f dB\n",
+				rdpsnd_get_audio_tag_string(format->wFormatTag), format->nSamplesPerSec,
+				format->nChannels, format->nBlockAlign, blockFrames,
+				encoded * 8.0 / TEST_DSP_SECONDS / 1000.0, c, snr);
+
+		if (snr < test->minSnr)
+			goto fail;
+	}
+
+	rc = TRUE;
+
+fail:
+	free(src);
+	Stream_Free(s, TRUE);
+	Stream_Free(out, TRUE);
+	freerdp_dsp_context_free(encoder);
+	freerdp_dsp_context_free(decoder);
+
+	return rc;
+}
+
+int TestFreeRDPCodecDsp(int argc, char* argv[])
+{
+	UINT32 index;
+	UINT32 quality;
+	double level;
+
+	for (index = 0; index < ARRAYSIZE(g_Cases); index++)
+	{
+		for (quality = FREERDP_DSP_RESAMPLE_QUALITY_LOW; quality <= FREERDP_DSP_RESAMPLE_QUALITY_HIGH; quality++)
+		{
+			if (!test_dsp_quality(&g_Cases[index], quality))
+				return -1;
+		}
+	}
+
+	for (quality = FREERDP_DSP_RESAMPLE_QUALITY_LOW; quality <= FREERDP_DSP_RESAMPLE_QUALITY_HIGH; quality++)
+	{
+		level = test_dsp_alias(quality);
+
+		printf("48000 -> 16000 %-6s: 10 kHz tone at %.1f dB\n", g_Quality[quality], level);
+
+		if ((quality != FREERDP_DSP_RESAMPLE_QUALITY_LOW) && (level > -50.0))
+			return -1;
+	}
+
+	for (quality = FREERDP_DSP_RESAMPLE_QUALITY_LOW; quality <= FREERDP_DSP_RESAMPLE_QUALITY_HIGH; quality++)
+	{
+		if (!test_dsp_throughput(quality))
+			return -1;
+	}
+
+	for (index = 0; index < ARRAYSIZE(g_CodecCases); index++)
+	{
+		if (!test_dsp_codec(&g_CodecCases[index]))
+			return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,192 @@
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/codec/nsc.h>
+
+/**
+ * NSCodec is lossy (color loss reduction and chroma subsampling), a smooth
+ * gradient must however come back close to the original. The sizes cover odd
+ * widths and heights and images spanning several bands of rows.
+ */
+
+static void test_nsc_fill_gradient(BYTE* data, int width, int height, int scanline)
+{
+	int x, y;
+	BYTE* pixel;
+
+	for (y = 0; y < height; y++)
+	{
+		pixel = &data[y * scanline];
+
+		for (x = 0; x < width; x++)
+		{
+			*pixel++ = (BYTE) (x / 4); /* B */
+			*pixel++ = (BYTE) (y / 4); /* G */
+			*pixel++ = (BYTE) ((x + y) / 8); /* R */
+			*pixel++ = 0xFF; /* A */
+		}
+	}
+}
+
+/* the SSE2 kernels and the thread pool must not change a single byte */
+
+static const char* const test_nsc_configs[4] = { "generic", "SSE2", "generic threaded", "SSE2 threaded" };
+
+static void test_nsc_configure(NSC_CONTEXT* encoder, NSC_CONTEXT* decoder, int config)
+{
+	nsc_context_set_simd(encoder, (config & 1) ? TRUE : FALSE);
+	nsc_context_set_simd(decoder, (config & 1) ? TRUE : FALSE);
+	nsc_context_set_threading(encoder, (config & 2) ? TRUE : FALSE);
+	nsc_context_set_threading(decoder, (config & 2) ? TRUE : FALSE);
+}
+
+static int test_nsc_round_trip(NSC_CONTEXT* encoder, NSC_CONTEXT* decoder, int width, int height)
+{
+	int x, y, i;
+	int diff;
+	int config;
+	int maxDiff = 0;
+	int rc = -1;
+	int scanline;
+	size_t length = 0;
+	size_t bitmapLength;
+	BYTE* src;
+	BYTE* dst;
+	BYTE* data;
+	BYTE* stream = NULL;
+	BYTE* bitmap;
+	wStream* s;
+
+	scanline = width * 4;
+	bitmapLength = scanline * height;
+	data = (BYTE*) malloc(bitmapLength);
+	bitmap = (BYTE*) malloc(bitmapLength);
+	s = Stream_New(NULL, 1024);
+
+	if (!data || !bitmap || !s)
+		goto fail;
+
+	test_nsc_fill_gradient(data, width, height, scanline);
+
+	/* the first configuration (generic, single thread) is the reference */
+
+	for (config = 0; config < 4; config++)
+	{
+		test_nsc_configure(encoder, decoder, config);
+
+		Stream_SetPosition(s, 0);
+		nsc_compose_message(encoder, s, data, width, height, scanline);
+
+		if (nsc_process_message(decoder, 32, width, height, Stream_Buffer(s), Stream_GetPosition(s)) < 0)
+			goto fail;
+
+		if (config == 0)
+		{
+			length = Stream_GetPosition(s);
+			stream = (BYTE*) malloc(length);
+
+			if (!stream)
+				goto fail;
+
+			CopyMemory(stream, Stream_Buffer(s), length);
+			CopyMemory(bitmap, decoder->BitmapData, bitmapLength);
+			continue;
+		}
+
+		if ((Stream_GetPosition(s) != length) || (memcmp(Stream_Buffer(s), stream, length) != 0))
+		{
+			printf("nsc %dx%d (subsampling %d): %s encoder output differs from generic\n",
+					width, height, encoder->ChromaSubsamplingLevel, test_nsc_configs[config]);
+			goto fail;
+		}
+
+		if (memcmp(decoder->BitmapData, bitmap, bitmapLength) != 0)
+		{
+			printf("nsc %dx%d (subsampling %d): %s decoder output differs from generic\n",
+					width, height, encoder->ChromaSubsamplingLevel, test_nsc_configs[config]);
+			goto fail;
+		}
+	}
+
+	/* the encoder stores the rows bottom-up */
+
+	for (y = 0; y < height; y++)
+	{
+		src = &data[(height - 1 - y) * scanline];
+		dst = &bitmap[y * width * 4];
+
+		for (x = 0; x < width * 4; x++)
+		{
+			diff = abs((int) src[x] - (int) dst[x]);
+
+			if (diff > maxDiff)
+				maxDiff = diff;
+		}
+	}
+
+	if (maxDiff > 16)
+	{
+		printf("nsc round trip %dx%d (subsampling %d): max difference %d\n",
+				width, height, encoder->ChromaSubsamplingLevel, maxDiff);
+		goto fail;
+	}
+
+	for (i = 0; i < 4; i++)
+	{
+		if (decoder->PlaneByteCount[i] > decoder->OrgByteCount[i])
+			goto fail;
+	}
+
+	rc = 0;
+
+fail:
+	Stream_Free(s, TRUE);
+	free(stream);
+	free(bitmap);
+	free(data);
+	return rc;
+}
+
+int TestFreeRDPCodecNSC(int argc, char* argv[])
+{
+	int i;
+	int subsampling;
+	int rc = -1;
+	NSC_CONTEXT* encoder;
+	NSC_CONTEXT* decoder;
+	static const int sizes[][2] = {
+		{ 1, 1 }, { 7, 3 }, { 64, 64 }, { 63, 65 }, { 100, 129 }, { 256, 128 }, { 333, 257 }, { 1024, 768 }
+	};
+
+	encoder = nsc_context_new();
+	decoder = nsc_context_new();
+
+	if (!encoder || !decoder)
+		goto fail;
+
+	nsc_context_set_pixel_format(encoder, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+	for (subsampling = 0; subsampling < 2; subsampling++)
+	{
+		encoder->ChromaSubsamplingLevel = subsampling;
+
+		for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		{
+			if (test_nsc_round_trip(encoder, decoder, sizes[i][0], sizes[i][1]) < 0)
+				goto fail;
+		}
+	}
+
+	rc = 0;
+
+fail:
+	if (encoder)
+		nsc_context_free(encoder);
+
+	if (decoder)
+		nsc_context_free(decoder);
+
+	return rc;
+}
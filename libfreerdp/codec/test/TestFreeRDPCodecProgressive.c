@@ -825,94 +825,22 @@ static int test_memcmp_count(const BYTE* mem1, const BYTE* mem2, int size, int m
 	return count;
 }
 
-int test_progressive_decode(PROGRESSIVE_CONTEXT* progressive, EGFX_SAMPLE_FILE files[4], EGFX_SAMPLE_FILE bitmaps[4], int quarter, int count)
+int test_progressive_decode(PROGRESSIVE_CONTEXT* progressive, EGFX_SAMPLE_FILE files[4], EGFX_SAMPLE_FILE bitmaps[4], int count)
 {
 	int cnt;
 	int pass;
 	int size;
-	int index;
 	int status;
-	int nXSrc, nYSrc;
-	int nXDst, nYDst;
-	int nWidth, nHeight;
-	RECTANGLE_16 tileRect;
-	RECTANGLE_16 updateRect;
-	RECTANGLE_16 clippingRect;
-	RFX_PROGRESSIVE_TILE* tile;
-	PROGRESSIVE_BLOCK_REGION* region;
-
-	clippingRect.left = 0;
-	clippingRect.top = 0;
-	clippingRect.right = g_Width;
-	clippingRect.bottom = g_Height;
 
 	for (pass = 0; pass < count; pass++)
 	{
+		/* visible tile areas are written straight into the destination */
+
 		status = progressive_decompress(progressive, files[pass].buffer, files[pass].size,
 				&g_DstData, PIXEL_FORMAT_XRGB32, g_DstStep, 0, 0, g_Width, g_Height, 0);
 
 		printf("ProgressiveDecompress: status: %d pass: %d\n", status, pass + 1);
 
-		region = &(progressive->region);
-
-		switch (quarter)
-		{
-			case 0:
-				clippingRect.left = 0;
-				clippingRect.top = 0;
-				clippingRect.right = g_Width / 2;
-				clippingRect.bottom = g_Height /2;
-				break;
-
-			case 1:
-				clippingRect.left = g_Width / 2;
-				clippingRect.top = g_Height / 2;
-				clippingRect.right = g_Width;
-				clippingRect.bottom = g_Height;
-				break;
-
-			case 2:
-				clippingRect.left = 0;
-				clippingRect.top = g_Height / 2;
-				clippingRect.right = g_Width / 2;
-				clippingRect.bottom = g_Height;
-				break;
-
-			case 3:
-				clippingRect.left = g_Width / 2;
-				clippingRect.top = 0;
-				clippingRect.right = g_Width;
-				clippingRect.bottom = g_Height / 2;
-				break;
-		}
-
-		for (index = 0; index < region->numTiles; index++)
-		{
-			tile = region->tiles[index];
-
-			tileRect.left = tile->x;
-			tileRect.top = tile->y;
-			tileRect.right = tile->x + tile->width;
-			tileRect.bottom = tile->y + tile->height;
-
-			rectangles_intersection(&tileRect, &clippingRect, &updateRect);
-
-			nXDst = updateRect.left;
-			nYDst = updateRect.top;
-			nWidth = updateRect.right - updateRect.left;
-			nHeight = updateRect.bottom - updateRect.top;
-
-			if ((nWidth <= 0) || (nHeight <= 0))
-				continue;
-
-			nXSrc = nXDst - tile->x;
-			nYSrc = nYDst - tile->y;
-
-			freerdp_image_copy(g_DstData, PIXEL_FORMAT_XRGB32, g_DstStep,
-					nXDst, nYDst, nWidth, nHeight, tile->data,
-					PIXEL_FORMAT_XRGB32, 64 * 4, nXSrc, nYSrc, NULL);
-		}
-
 		size = bitmaps[pass].size;
 		cnt = test_memcmp_count(g_DstData, bitmaps[pass].buffer, size, 1);
 
@@ -968,10 +896,10 @@ int test_progressive_ms_sample(char* ms_sample_path)
 	{
 		printf("\nSample Image 1\n");
 		test_image_fill(g_DstData, g_DstStep, 0, 0, g_Width, g_Height, 0xFF000000);
-		test_progressive_decode(progressive, files[0][0], bitmaps[0][0], 0, count);
-		test_progressive_decode(progressive, files[0][1], bitmaps[0][1], 1, count);
-		test_progressive_decode(progressive, files[0][2], bitmaps[0][2], 2, count);
-		test_progressive_decode(progressive, files[0][3], bitmaps[0][3], 3, count);
+		test_progressive_decode(progressive, files[0][0], bitmaps[0][0], count);
+		test_progressive_decode(progressive, files[0][1], bitmaps[0][1], count);
+		test_progressive_decode(progressive, files[0][2], bitmaps[0][2], count);
+		test_progressive_decode(progressive, files[0][3], bitmaps[0][3], count);
 	}
 
 	/* image 2 */
@@ -980,10 +908,10 @@ int test_progressive_ms_sample(char* ms_sample_path)
 	{
 		printf("\nSample Image 2\n"); /* sample data is in incorrect order */
 		test_image_fill(g_DstData, g_DstStep, 0, 0, g_Width, g_Height, 0xFF000000);
-		test_progressive_decode(progressive, files[1][0], bitmaps[1][0], 0, count);
-		test_progressive_decode(progressive, files[1][1], bitmaps[1][1], 1, count);
-		test_progressive_decode(progressive, files[1][2], bitmaps[1][2], 2, count);
-		test_progressive_decode(progressive, files[1][3], bitmaps[1][3], 3, count);
+		test_progressive_decode(progressive, files[1][0], bitmaps[1][0], count);
+		test_progressive_decode(progressive, files[1][1], bitmaps[1][1], count);
+		test_progressive_decode(progressive, files[1][2], bitmaps[1][2], count);
+		test_progressive_decode(progressive, files[1][3], bitmaps[1][3], count);
 	}
 
 	/* image 3 */
@@ -992,10 +920,10 @@ int test_progressive_ms_sample(char* ms_sample_path)
 	{
 		printf("\nSample Image 3\n"); /* sample data is in incorrect order */
 		test_image_fill(g_DstData, g_DstStep, 0, 0, g_Width, g_Height, 0xFF000000);
-		test_progressive_decode(progressive, files[2][0], bitmaps[2][0], 0, count);
-		test_progressive_decode(progressive, files[2][1], bitmaps[2][1], 1, count);
-		test_progressive_decode(progressive, files[2][2], bitmaps[2][2], 2, count);
-		test_progressive_decode(progressive, files[2][3], bitmaps[2][3], 3, count);
+		test_progressive_decode(progressive, files[2][0], bitmaps[2][0], count);
+		test_progressive_decode(progressive, files[2][1], bitmaps[2][1], count);
+		test_progressive_decode(progressive, files[2][2], bitmaps[2][2], count);
+		test_progressive_decode(progressive, files[2][3], bitmaps[2][3], count);
 	}
 
 	progressive_context_free(progressive);
@@ -0,0 +1,147 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/codec/progressive.h>
+
+typedef void (*pfnIdwt)(INT16* pLowBand, int nLowStep, INT16* pHighBand, int nHighStep,
+		INT16* pDstBand, int nDstStep, int nLowCount, int nHighCount, int nDstCount);
+
+static const int g_BandL[3] = { 33, 17, 9 };
+static const int g_BandH[3] = { 31, 16, 8 };
+
+static void test_fill_random(INT16* buffer, int count, int range)
+{
+	int index;
+
+	for (index = 0; index < count; index++)
+	{
+		/* a range of 0 exercises the full 16-bit span, including overflowing sums */
+		if (range)
+			buffer[index] = (INT16) ((rand() % (2 * range + 1)) - range);
+		else
+			buffer[index] = (INT16) (rand() & 0xFFFF);
+	}
+}
+
+/* the three passes of progressive_rfx_dwt_2d_decode_block() for one level */
+static void test_idwt_level(pfnIdwt idwt_x, pfnIdwt idwt_y, INT16* buffer, INT16* temp, int level)
+{
+	int nBandL = g_BandL[level - 1];
+	int nBandH = g_BandH[level - 1];
+	int nStep = nBandL + nBandH;
+	INT16* HL = &buffer[0];
+	INT16* LH = &HL[nBandH * nBandL];
+	INT16* HH = &LH[nBandL * nBandH];
+	INT16* LL = &HH[nBandH * nBandH];
+	INT16* L = &temp[0];
+	INT16* H = &temp[nBandL * nStep];
+
+	idwt_x(LL, nBandL, HL, nBandH, L, nStep, nBandL, nBandH, nBandL);
+	idwt_x(LH, nBandL, HH, nBandH, H, nStep, nBandL, nBandH, nBandH);
+	idwt_y(L, nStep, H, nStep, buffer, nStep, nBandL, nBandH, nStep);
+}
+
+static BOOL test_idwt_compare(PROGRESSIVE_CONTEXT* progressive, int range)
+{
+	int level;
+	int index;
+	INT16 input[4096];
+	INT16 bufferC[4096];
+	INT16 bufferOpt[4096];
+	INT16 tempC[4096];
+	INT16 tempOpt[4096];
+
+	for (level = 1; level <= 3; level++)
+	{
+		test_fill_random(input, 4096, range);
+		CopyMemory(bufferC, input, sizeof(input));
+		CopyMemory(bufferOpt, input, sizeof(input));
+
+		test_idwt_level(progressive_rfx_idwt_x, progressive_rfx_idwt_y, bufferC, tempC, level);
+		test_idwt_level(progressive->idwt_x, progressive->idwt_y, bufferOpt, tempOpt, level);
+
+		for (index = 0; index < 4096; index++)
+		{
+			if (bufferC[index] != bufferOpt[index])
+			{
+				printf("idwt level %d range %d mismatch at %d: %d != %d\n",
+					level, range, index, bufferOpt[index], bufferC[index]);
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static UINT64 test_idwt_benchmark(pfnIdwt idwt_x, pfnIdwt idwt_y, int iterations)
+{
+	int index;
+	UINT64 start;
+	INT16 buffer[4096];
+	INT16 temp[4096];
+
+	test_fill_random(buffer, 4096, 1024);
+
+	start = GetTickCount64();
+
+	for (index = 0; index < iterations; index++)
+	{
+		test_idwt_level(idwt_x, idwt_y, buffer, temp, 3);
+		test_idwt_level(idwt_x, idwt_y, buffer, temp, 2);
+		test_idwt_level(idwt_x, idwt_y, buffer, temp, 1);
+	}
+
+	return GetTickCount64() - start;
+}
+
+int TestFreeRDPCodecProgressiveDwt(int argc, char* argv[])
+{
+	int pass;
+	int iterations = 20000;
+	UINT64 genericTime;
+	UINT64 optimizedTime;
+	PROGRESSIVE_CONTEXT* progressive;
+
+	progressive = progressive_context_new(FALSE);
+
+	if (!progressive)
+		return -1;
+
+	srand(0x1234);
+
+	for (pass = 0; pass < 16; pass++)
+	{
+		if (!test_idwt_compare(progressive, 64) ||
+			!test_idwt_compare(progressive, 4096) ||
+			!test_idwt_compare(progressive, 0))
+		{
+			progressive_context_free(progressive);
+			return -1;
+		}
+	}
+
+	/**
+	 * The timing depends on the machine and its load, it is only printed when
+	 * asked for: TestFreeRDPCodec TestFreeRDPCodecProgressiveDwt benchmark
+	 */
+
+	if ((argc > 1) && !strcmp(argv[1], "benchmark"))
+	{
+		/* one 64x64 component (three levels) per iteration */
+
+		genericTime = test_idwt_benchmark(progressive_rfx_idwt_x, progressive_rfx_idwt_y, iterations);
+		optimizedTime = test_idwt_benchmark(progressive->idwt_x, progressive->idwt_y, iterations);
+
+		printf("progressive idwt, %d components: generic %d ms, optimized %d ms\n",
+			iterations, (int) genericTime, (int) optimizedTime);
+	}
+
+	progressive_context_free(progressive);
+
+	return 0;
+}
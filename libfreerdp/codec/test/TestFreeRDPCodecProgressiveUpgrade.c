@@ -0,0 +1,360 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/bitstream.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/codec/progressive.h>
+
+#define TEST_STREAM_SIZE	16384
+
+/**
+ * Reference decoder: the SRL and RAW streams read one BitStream_Shift() at
+ * a time, as progressive_rfx_upgrade_component() did before it was made
+ * word-driven. Only the coefficient decoding is reproduced, not the DWT.
+ */
+
+struct test_upgrade_state
+{
+	BOOL nonLL;
+	wBitStream* srl;
+	wBitStream* raw;
+	int kp;
+	int nz;
+	BOOL mode;
+};
+typedef struct test_upgrade_state TEST_UPGRADE_STATE;
+
+static INT16 test_srl_read(TEST_UPGRADE_STATE* state, UINT32 numBits)
+{
+	int k;
+	UINT32 bit;
+	UINT32 max;
+	UINT32 mag;
+	UINT32 sign;
+	wBitStream* bs = state->srl;
+
+	if (state->nz)
+	{
+		state->nz--;
+		return 0;
+	}
+
+	k = state->kp / 8;
+
+	if (!state->mode)
+	{
+		bit = (bs->accumulator & 0x80000000) ? 1 : 0;
+		BitStream_Shift(bs, 1);
+
+		if (!bit)
+		{
+			state->nz = (1 << k);
+			state->kp += 4;
+
+			if (state->kp > 80)
+				state->kp = 80;
+
+			state->nz--;
+			return 0;
+		}
+
+		state->nz = 0;
+		state->mode = 1;
+
+		if (k)
+		{
+			bs->mask = ((1 << k) - 1);
+			state->nz = ((bs->accumulator >> (32 - k)) & bs->mask);
+			BitStream_Shift(bs, k);
+		}
+
+		if (state->nz)
+		{
+			state->nz--;
+			return 0;
+		}
+	}
+
+	state->mode = 0;
+
+	sign = (bs->accumulator & 0x80000000) ? 1 : 0;
+	BitStream_Shift(bs, 1);
+
+	state->kp -= 6;
+
+	if (state->kp < 0)
+		state->kp = 0;
+
+	if (numBits == 1)
+		return sign ? -1 : 1;
+
+	mag = 1;
+	max = (1 << numBits) - 1;
+
+	while (mag < max)
+	{
+		bit = (bs->accumulator & 0x80000000) ? 1 : 0;
+		BitStream_Shift(bs, 1);
+
+		if (bit)
+			break;
+
+		mag++;
+	}
+
+	return sign ? -mag : mag;
+}
+
+static INT16 test_raw_read(wBitStream* raw, UINT32 numBits)
+{
+	INT16 input;
+
+	raw->mask = ((1 << numBits) - 1);
+	input = (INT16) ((raw->accumulator >> (32 - numBits)) & raw->mask);
+	BitStream_Shift(raw, numBits);
+
+	return input;
+}
+
+static void test_upgrade_block(TEST_UPGRADE_STATE* state, INT16* buffer, INT16* sign, int length,
+		UINT32 shift, UINT32 numBits)
+{
+	int index;
+	INT16 input;
+
+	if (!numBits)
+		return;
+
+	for (index = 0; index < length; index++)
+	{
+		if (!state->nonLL)
+		{
+			input = test_raw_read(state->raw, numBits);
+		}
+		else if (sign[index] > 0)
+		{
+			input = test_raw_read(state->raw, numBits);
+		}
+		else if (sign[index] < 0)
+		{
+			input = test_raw_read(state->raw, numBits);
+			input *= -1;
+		}
+		else
+		{
+			input = test_srl_read(state, numBits);
+			sign[index] = input;
+		}
+
+		buffer[index] += (input << shift);
+	}
+}
+
+static void test_upgrade_finish(TEST_UPGRADE_STATE* state)
+{
+	int pad;
+	wBitStream* srl = state->srl;
+	wBitStream* raw = state->raw;
+
+	pad = (raw->position % 8) ? (8 - (raw->position % 8)) : 0;
+
+	if (pad)
+		BitStream_Shift(raw, pad);
+
+	pad = (srl->position % 8) ? (8 - (srl->position % 8)) : 0;
+
+	if (pad)
+		BitStream_Shift(srl, pad);
+
+	if (BitStream_GetRemainingLength(srl) == 8)
+		BitStream_Shift(srl, 8);
+}
+
+static const int g_BandOffset[10] = { 0, 1023, 2046, 3007, 3279, 3551, 3807, 3879, 3951, 4015 };
+static const int g_BandLength[10] = { 1023, 1023, 961, 272, 272, 256, 72, 72, 64, 81 };
+
+static void test_quant_set(RFX_COMPONENT_CODEC_QUANT* q, const BYTE* values)
+{
+	q->HL1 = values[0];
+	q->LH1 = values[1];
+	q->HH1 = values[2];
+	q->HL2 = values[3];
+	q->LH2 = values[4];
+	q->HH2 = values[5];
+	q->HL3 = values[6];
+	q->LH3 = values[7];
+	q->HH3 = values[8];
+	q->LL3 = values[9];
+}
+
+/* returns the number of bytes consumed from the srl and raw streams */
+
+static void test_upgrade_reference(const BYTE* shift, const BYTE* numBits, INT16* current, INT16* sign,
+		const BYTE* srlData, const BYTE* rawData, int* srlLen, int* rawLen)
+{
+	int band;
+	wBitStream s_srl;
+	wBitStream s_raw;
+	TEST_UPGRADE_STATE state;
+
+	ZeroMemory(&s_srl, sizeof(wBitStream));
+	ZeroMemory(&s_raw, sizeof(wBitStream));
+	ZeroMemory(&state, sizeof(TEST_UPGRADE_STATE));
+
+	state.kp = 8;
+	state.srl = &s_srl;
+	state.raw = &s_raw;
+
+	BitStream_Attach(state.srl, srlData, TEST_STREAM_SIZE);
+	BitStream_Fetch(state.srl);
+
+	BitStream_Attach(state.raw, rawData, TEST_STREAM_SIZE);
+	BitStream_Fetch(state.raw);
+
+	for (band = 0; band < 10; band++)
+	{
+		state.nonLL = (band < 9) ? TRUE : FALSE;
+		test_upgrade_block(&state, &current[g_BandOffset[band]], &sign[g_BandOffset[band]],
+				g_BandLength[band], shift[band], numBits[band]);
+	}
+
+	test_upgrade_finish(&state);
+
+	*srlLen = (state.srl->position + 7) / 8;
+	*rawLen = (state.raw->position + 7) / 8;
+}
+
+/* sparse streams give long zero runs, dense ones long magnitudes */
+
+static void test_fill_stream(BYTE* data, int density)
+{
+	int index;
+	int count;
+	BYTE value;
+
+	for (index = 0; index < TEST_STREAM_SIZE; index++)
+	{
+		value = (BYTE) rand();
+
+		for (count = 0; count < density; count++)
+			value &= (BYTE) rand();
+
+		data[index] = value;
+	}
+}
+
+static BOOL test_upgrade_compare(PROGRESSIVE_CONTEXT* progressive, BYTE* srlData, BYTE* rawData, int pass)
+{
+	int index;
+	int srlLen;
+	int rawLen;
+	int status;
+	BYTE shift[10];
+	BYTE numBits[10];
+	INT16 signC[4096];
+	INT16 signOpt[4096];
+	INT16 currentC[4096];
+	INT16 currentOpt[4096];
+	INT16 buffer[4096];
+	INT16 temp[4096];
+	RFX_COMPONENT_CODEC_QUANT qShift;
+	RFX_COMPONENT_CODEC_QUANT qBitPos;
+	RFX_COMPONENT_CODEC_QUANT qNumBits;
+
+	for (index = 0; index < 10; index++)
+	{
+		shift[index] = (BYTE) (rand() % 7);
+		numBits[index] = (BYTE) (rand() % 16);
+	}
+
+	/* most coefficients are still zero after the first pass */
+
+	for (index = 0; index < 4096; index++)
+	{
+		currentC[index] = (INT16) ((rand() % 512) - 256);
+
+		switch (rand() % 8)
+		{
+			case 0:
+				signC[index] = 1;
+				break;
+
+			case 1:
+				signC[index] = -1;
+				break;
+
+			default:
+				signC[index] = 0;
+				break;
+		}
+	}
+
+	test_fill_stream(srlData, pass % 4);
+	test_fill_stream(rawData, 0);
+
+	CopyMemory(currentOpt, currentC, sizeof(currentC));
+	CopyMemory(signOpt, signC, sizeof(signC));
+
+	test_upgrade_reference(shift, numBits, currentC, signC, srlData, rawData, &srlLen, &rawLen);
+
+	test_quant_set(&qShift, shift);
+	test_quant_set(&qNumBits, numBits);
+	ZeroMemory(&qBitPos, sizeof(RFX_COMPONENT_CODEC_QUANT));
+
+	status = progressive_rfx_upgrade_component(progressive, &qShift, &qBitPos, &qNumBits, buffer, temp,
+			currentOpt, signOpt, srlData, srlLen, rawData, rawLen);
+
+	if (status < 0)
+	{
+		printf("pass %d: stream lengths srl %d raw %d not consumed\n", pass, srlLen, rawLen);
+		return FALSE;
+	}
+
+	for (index = 0; index < 4096; index++)
+	{
+		if ((currentC[index] != currentOpt[index]) || (signC[index] != signOpt[index]))
+		{
+			printf("pass %d: coefficient %d is %d (sign %d), expected %d (sign %d)\n", pass, index,
+					currentOpt[index], signOpt[index], currentC[index], signC[index]);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+int TestFreeRDPCodecProgressiveUpgrade(int argc, char* argv[])
+{
+	int pass;
+	int rc = -1;
+	BYTE* srlData;
+	BYTE* rawData;
+	PROGRESSIVE_CONTEXT* progressive;
+
+	progressive = progressive_context_new(FALSE);
+
+	/* BitStream_Fetch() reads a few bytes past the end of the stream */
+	srlData = (BYTE*) calloc(1, TEST_STREAM_SIZE + 16);
+	rawData = (BYTE*) calloc(1, TEST_STREAM_SIZE + 16);
+
+	if (!progressive || !srlData || !rawData)
+		goto fail;
+
+	srand(0x5EED);
+
+	for (pass = 0; pass < 256; pass++)
+	{
+		if (!test_upgrade_compare(progressive, srlData, rawData, pass))
+			goto fail;
+	}
+
+	rc = 0;
+
+fail:
+	free(srlData);
+	free(rawData);
+	progressive_context_free(progressive);
+	return rc;
+}
@@ -1,5 +1,6 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/freerdp.h>
 #include <freerdp/codec/rfx.h>
@@ -756,7 +757,746 @@ const UINT32 TEST_RFX_XRGB_IMAGE[4096] =
 	0x00169ff8, 0x00159ef7, 0x00149df7, 0x00139cf6, 0x00129bf5, 0x00129bf5, 0x00129bf5, 0x00129bf5
 };
 
+static int test_rfx_encode_frame_fragments(void)
+{
+	int rc = -1;
+	int x, y;
+	int index, count;
+	int numTiles = 0;
+	int numFragments = 0;
+	BYTE* image = NULL;
+	wStream* s = NULL;
+	RFX_RECT rect;
+	RFX_MESSAGE* frame;
+	RFX_MESSAGE* message;
+	RFX_CONTEXT* encoder = NULL;
+	RFX_CONTEXT* decoder = NULL;
+	const int width = 256;
+	const int height = 128;
+
+	image = (BYTE*) malloc(width * height * 4);
+	encoder = rfx_context_new(TRUE);
+	decoder = rfx_context_new(FALSE);
+	s = Stream_New(NULL, 65536);
+
+	if (!image || !encoder || !decoder || !s)
+		goto fail;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+			*((UINT32*) &image[(y * width + x) * 4]) = (x * 7) ^ (y * 13) ^ ((x * y) << 8);
+	}
+
+	encoder->width = width;
+	encoder->height = height;
+	rfx_context_set_pixel_format(encoder, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+	rect.x = 10;
+	rect.y = 5;
+	rect.width = 200;
+	rect.height = 100;
+
+	frame = rfx_encode_frame(encoder, &rect, 1, image, width, height, width * 4);
+
+	if (!frame || (frame->numTiles != 8))
+	{
+		printf("rfx_encode_frame: unexpected tile count\n");
+		goto fail;
+	}
+
+	/* the second frame reuses the context owned message */
+
+	if (rfx_encode_frame(encoder, &rect, 1, image, width, height, width * 4) != frame)
+	{
+		printf("rfx_encode_frame: frame was not reused\n");
+		goto fail;
+	}
+
+	/* small fragments, every one of them has to decode on its own */
+
+	for (index = 0; index < frame->numTiles; index += count)
+	{
+		Stream_SetPosition(s, 0);
+		count = rfx_write_message_fragment(encoder, s, frame, index, 1024 + 4096);
+
+		if (count < 1)
+			goto fail;
+
+		message = rfx_process_message(decoder, Stream_Buffer(s), Stream_GetPosition(s));
+
+		if (!message)
+			goto fail;
+
+		numTiles += rfx_message_get_tile_count(message);
+		rfx_message_free(decoder, message);
+		numFragments++;
+	}
+
+	if ((numTiles != frame->numTiles) || (numFragments < 2))
+	{
+		printf("rfx_write_message_fragment: %d tiles in %d fragments\n", numTiles, numFragments);
+		goto fail;
+	}
+
+	rc = 0;
+
+fail:
+	Stream_Free(s, TRUE);
+	rfx_context_free(decoder);
+	rfx_context_free(encoder);
+	free(image);
+
+	return rc;
+}
+
+static int test_rfx_change_detection(void)
+{
+	int rc = -1;
+	int index;
+	BYTE* image = NULL;
+	RFX_RECT rect;
+	RFX_RECT* rfxRect;
+	RECTANGLE_16 invalid;
+	RFX_MESSAGE* frame;
+	RFX_CONTEXT* encoder = NULL;
+	const int width = 200;
+	const int height = 130;
+
+	image = (BYTE*) calloc(width * height, 4);
+	encoder = rfx_context_new(TRUE);
+
+	if (!image || !encoder)
+		goto fail;
+
+	encoder->width = width;
+	encoder->height = height;
+	rfx_context_set_pixel_format(encoder, RDP_PIXEL_FORMAT_B8G8R8A8);
+	rfx_context_set_change_detection(encoder, TRUE);
+
+	rect.x = 0;
+	rect.y = 0;
+	rect.width = width;
+	rect.height = height;
+
+	frame = rfx_encode_frame(encoder, &rect, 1, image, width, height, width * 4);
+
+	if (!frame || (frame->numTiles != 12))
+		goto fail;
+
+	/* nothing changed, nothing to send */
+
+	frame = rfx_encode_frame(encoder, &rect, 1, image, width, height, width * 4);
+
+	if (!frame || (frame->numTiles != 0) || (frame->numRects != 0))
+	{
+		printf("change detection: unchanged tiles were encoded\n");
+		goto fail;
+	}
+
+	/* one pixel in the partial bottom right tile */
+
+	*((UINT32*) &image[((129 * width) + 199) * 4]) = 0x00FF00FF;
+
+	frame = rfx_encode_frame(encoder, &rect, 1, image, width, height, width * 4);
+
+	if (!frame || (frame->numTiles != 1) || (frame->tiles[0]->xIdx != 3) || (frame->tiles[0]->yIdx != 2))
+	{
+		printf("change detection: modified tile was not encoded alone\n");
+		goto fail;
+	}
+
+	for (index = 0; index < frame->numRects; index++)
+	{
+		rfxRect = &frame->rects[index];
+
+		if ((rfxRect->x < 192) || (rfxRect->y < 128) ||
+				(rfxRect->x + rfxRect->width > width) || (rfxRect->y + rfxRect->height > height))
+		{
+			printf("change detection: rectangle outside of the sent tiles\n");
+			goto fail;
+		}
+	}
+
+	/* invalidated tiles are sent again */
+
+	invalid.left = 0;
+	invalid.top = 0;
+	invalid.right = 65;
+	invalid.bottom = 10;
+	rfx_context_invalidate_tiles(encoder, &invalid);
+
+	frame = rfx_encode_frame(encoder, &rect, 1, image, width, height, width * 4);
+
+	if (!frame || (frame->numTiles != 2))
+	{
+		printf("change detection: invalidated tiles were not encoded\n");
+		goto fail;
+	}
+
+	rfx_context_reset(encoder);
+
+	frame = rfx_encode_frame(encoder, &rect, 1, image, width, height, width * 4);
+
+	if (!frame || (frame->numTiles != 12))
+		goto fail;
+
+	rc = 0;
+
+fail:
+	rfx_context_free(encoder);
+	free(image);
+
+	return rc;
+}
+
+/* paints what a client decodes: the pixels of each tile covered by the rectangles */
+
+static void test_rfx_paint(BYTE* client, const BYTE* image, int width, RFX_MESSAGE* frame)
+{
+	int i, j, y;
+	int left, top, right, bottom;
+	RFX_TILE* tile;
+	RFX_RECT* rfxRect;
+
+	for (i = 0; i < frame->numTiles; i++)
+	{
+		tile = frame->tiles[i];
+
+		for (j = 0; j < frame->numRects; j++)
+		{
+			rfxRect = &frame->rects[j];
+
+			left = MAX(tile->x, rfxRect->x);
+			top = MAX(tile->y, rfxRect->y);
+			right = MIN(tile->x + 64, rfxRect->x + rfxRect->width);
+			bottom = MIN(tile->y + 64, rfxRect->y + rfxRect->height);
+
+			for (y = top; y < bottom; y++)
+			{
+				if (left < right)
+					CopyMemory(&client[((y * width) + left) * 4], &image[((y * width) + left) * 4], (right - left) * 4);
+			}
+		}
+	}
+}
+
+static int test_rfx_change_detection_partial(void)
+{
+	int x, y;
+	int rc = -1;
+	BYTE* image = NULL;
+	BYTE* client = NULL;
+	RFX_RECT rect;
+	RFX_MESSAGE* frame;
+	RFX_CONTEXT* encoder = NULL;
+	const int width = 100;
+	const int height = 70;
+
+	image = (BYTE*) calloc(width * height, 4);
+	client = (BYTE*) calloc(width * height, 4);
+	encoder = rfx_context_new(TRUE);
+
+	if (!image || !client || !encoder)
+		goto fail;
+
+	encoder->width = width;
+	encoder->height = height;
+	rfx_context_set_pixel_format(encoder, RDP_PIXEL_FORMAT_B8G8R8A8);
+	rfx_context_set_change_detection(encoder, TRUE);
+
+	rect.x = 0;
+	rect.y = 0;
+	rect.width = width;
+	rect.height = height;
+
+	frame = rfx_encode_frame(encoder, &rect, 1, image, width, height, width * 4);
+
+	if (!frame)
+		goto fail;
+
+	test_rfx_paint(client, image, width, frame);
+
+	/* the whole first tile changes, but only its left half is damaged */
+
+	for (y = 0; y < 64; y++)
+	{
+		for (x = 0; x < 64; x++)
+			*((UINT32*) &image[((y * width) + x) * 4]) = 0x00FF0000 | (y << 8) | x;
+	}
+
+	rect.width = 32;
+	rect.height = 64;
+
+	frame = rfx_encode_frame(encoder, &rect, 1, image, width, height, width * 4);
+
+	if (!frame || (frame->numTiles != 1))
+		goto fail;
+
+	test_rfx_paint(client, image, width, frame);
+
+	/* the right half is damaged next, its tile is unchanged since it was sent */
+
+	rect.x = 32;
+
+	frame = rfx_encode_frame(encoder, &rect, 1, image, width, height, width * 4);
+
+	if (!frame)
+		goto fail;
+
+	test_rfx_paint(client, image, width, frame);
+
+	if (memcmp(client, image, width * height * 4) != 0)
+	{
+		printf("change detection: pixels of a sent tile were never painted\n");
+		goto fail;
+	}
+
+	rc = 0;
+
+fail:
+	rfx_context_free(encoder);
+	free(client);
+	free(image);
+
+	return rc;
+}
+
+/**
+ * Reference RLGR encoder: the bit-by-bit encoder the word-based one replaced,
+ * kept here so the output of the optimized encoder can be compared against it.
+ */
+
+struct _TEST_RLGR_WRITER
+{
+	BYTE* buffer;
+	int nbytes;
+	int byte_pos;
+	int bits_left;
+};
+typedef struct _TEST_RLGR_WRITER TEST_RLGR_WRITER;
+
+static void test_rlgr_put_bits(TEST_RLGR_WRITER* bs, UINT32 bits, int nbits)
+{
+	int b;
+
+	while ((bs->byte_pos < bs->nbytes) && (nbits > 0))
+	{
+		b = (nbits > bs->bits_left) ? bs->bits_left : nbits;
+		bs->buffer[bs->byte_pos] |= ((bits >> (nbits - b)) & ((1 << b) - 1)) << (bs->bits_left - b);
+		bs->bits_left -= b;
+		nbits -= b;
+
+		if (bs->bits_left == 0)
+		{
+			bs->bits_left = 8;
+			bs->byte_pos++;
+		}
+	}
+}
+
+static void test_rlgr_put_bit(TEST_RLGR_WRITER* bs, UINT32 count, int bit)
+{
+	for (; count > 0; count--)
+		test_rlgr_put_bits(bs, bit, 1);
+}
+
+static int test_rlgr_update(int* param, int delta)
+{
+	*param += delta;
+
+	if (*param > 80)
+		*param = 80;
+
+	if (*param < 0)
+		*param = 0;
+
+	return *param >> 3;
+}
+
+static void test_rlgr_code_gr(TEST_RLGR_WRITER* bs, int* krp, UINT32 val)
+{
+	int kr = *krp >> 3;
+	UINT32 vk = val >> kr;
+
+	test_rlgr_put_bit(bs, vk, 1);
+	test_rlgr_put_bit(bs, 1, 0);
+
+	if (kr)
+		test_rlgr_put_bits(bs, val & ((1 << kr) - 1), kr);
+
+	if (vk == 0)
+		test_rlgr_update(krp, -2);
+	else if (vk > 1)
+		test_rlgr_update(krp, vk);
+}
+
+static int test_rlgr_next(const INT16** data, int* size)
+{
+	if (*size <= 0)
+		return 0;
+
+	(*size)--;
+	return *(*data)++;
+}
+
+#define TEST_RLGR_TWO_MS(_v) ((_v) >= 0 ? 2 * (_v) : -2 * (_v) - 1)
+
+static int test_rlgr_reference_encode(int mode, const INT16* data, int size, BYTE* buffer, int buffer_size)
+{
+	int k = 1;
+	int kp = 1 << 3;
+	int krp = 1 << 3;
+	int input;
+	TEST_RLGR_WRITER bs;
+
+	ZeroMemory(buffer, buffer_size);
+	bs.buffer = buffer;
+	bs.nbytes = buffer_size;
+	bs.byte_pos = 0;
+	bs.bits_left = 8;
+
+	while (size > 0)
+	{
+		if (k)
+		{
+			UINT32 numZeros = 0;
+			UINT32 mag;
+
+			input = test_rlgr_next(&data, &size);
+
+			while ((input == 0) && (size > 0))
+			{
+				numZeros++;
+				input = test_rlgr_next(&data, &size);
+			}
+
+			while (numZeros >= (UINT32) (1 << k))
+			{
+				test_rlgr_put_bit(&bs, 1, 0);
+				numZeros -= (1 << k);
+				k = test_rlgr_update(&kp, 4);
+			}
+
+			test_rlgr_put_bit(&bs, 1, 1);
+			test_rlgr_put_bits(&bs, numZeros, k);
+
+			mag = (input < 0) ? -input : input;
+			test_rlgr_put_bit(&bs, 1, (input < 0) ? 1 : 0);
+			test_rlgr_code_gr(&bs, &krp, mag ? mag - 1 : 0);
+
+			k = test_rlgr_update(&kp, -6);
+		}
+		else if (mode == RLGR1)
+		{
+			UINT32 twoMs;
+
+			input = test_rlgr_next(&data, &size);
+			twoMs = TEST_RLGR_TWO_MS(input);
+			test_rlgr_code_gr(&bs, &krp, twoMs);
+			k = test_rlgr_update(&kp, twoMs ? -3 : 3);
+		}
+		else
+		{
+			UINT32 twoMs1;
+			UINT32 twoMs2;
+			UINT32 sum2Ms;
+			int nIdx = 0;
+
+			input = test_rlgr_next(&data, &size);
+			twoMs1 = TEST_RLGR_TWO_MS(input);
+			input = test_rlgr_next(&data, &size);
+			twoMs2 = TEST_RLGR_TWO_MS(input);
+			sum2Ms = twoMs1 + twoMs2;
+
+			test_rlgr_code_gr(&bs, &krp, sum2Ms);
+
+			while (sum2Ms >> nIdx)
+				nIdx++;
+
+			test_rlgr_put_bits(&bs, twoMs1, nIdx);
+
+			if (twoMs1 && twoMs2)
+				k = test_rlgr_update(&kp, -6);
+			else if (!twoMs1 && !twoMs2)
+				k = test_rlgr_update(&kp, 6);
+		}
+	}
+
+	return (bs.bits_left < 8) ? bs.byte_pos + 1 : bs.byte_pos;
+}
+
+static BOOL test_rfx_rlgr_compare(int mode, const INT16* coefficients, const char* name)
+{
+	int size;
+	int expectedSize;
+	BYTE buffer[16384];
+	BYTE expected[16384];
+
+	expectedSize = test_rlgr_reference_encode(mode, coefficients, 4096, expected, sizeof(expected));
+
+	FillMemory(buffer, sizeof(buffer), 0xCD);
+	size = rfx_rlgr_encode(mode, coefficients, 4096, buffer, sizeof(buffer));
+
+	if ((size != expectedSize) || (memcmp(buffer, expected, size) != 0))
+	{
+		printf("rlgr%d output of %s differs from the reference encoder (%d bytes, expected %d)\n",
+				(mode == RLGR1) ? 1 : 3, name, size, expectedSize);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static int test_rfx_rlgr_reference(void)
+{
+	int i;
+	int mode;
+	int component;
+	INT16 coefficients[4096];
+	static const char* names[] = { "Y", "Cb", "Cr" };
+	static const int offsets[] = { 0x2E, 0x3DC, 0x7AB };
+	static const int lengths[] = { 942, 975, 915 };
+
+	for (component = 0; component < 3; component++)
+	{
+		/* the coefficients of the sample tile, as the server quantized them */
+
+		if (rfx_rlgr_decode(&TEST_RFX_TILESET[offsets[component]], lengths[component], coefficients, 4096, 3) < 0)
+			return -1;
+
+		for (mode = RLGR1; mode <= RLGR3; mode += (RLGR3 - RLGR1))
+		{
+			if (!test_rfx_rlgr_compare(mode, coefficients, names[component]))
+				return -1;
+		}
+
+		/* drop the LL3 band so the tile ends in a long zero run */
+
+		ZeroMemory(&coefficients[4032], 64 * sizeof(INT16));
+
+		for (mode = RLGR1; mode <= RLGR3; mode += (RLGR3 - RLGR1))
+		{
+			if (!test_rfx_rlgr_compare(mode, coefficients, "tile ending in a zero run"))
+				return -1;
+		}
+	}
+
+	for (i = 0; i < 4096; i++)
+		coefficients[i] = (i < 4000) ? (INT16) ((i * 7919) % 61) - 30 : 0;
+
+	coefficients[4001] = -1;
+
+	for (mode = RLGR1; mode <= RLGR3; mode += (RLGR3 - RLGR1))
+	{
+		if (!test_rfx_rlgr_compare(mode, coefficients, "dense tile ending in a zero run"))
+			return -1;
+	}
+
+	ZeroMemory(coefficients, sizeof(coefficients));
+
+	for (mode = RLGR1; mode <= RLGR3; mode += (RLGR3 - RLGR1))
+	{
+		if (!test_rfx_rlgr_compare(mode, coefficients, "empty tile"))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int test_rfx_rlgr_round_trip(void)
+{
+	int i, n;
+	int mode;
+	int size;
+	UINT32 seed = 1;
+	INT16 coefficients[4096];
+	INT16 decoded[4096];
+	BYTE buffer[16384];
+
+	for (n = 0; n < 64; n++)
+	{
+		for (i = 0; i < 4096; i++)
+		{
+			seed = (seed * 1103515245) + 12345;
+
+			/* mostly zeros with a few large magnitudes, like quantized bands */
+			if (((seed >> 16) % 100) < (UINT32) n + 4)
+				coefficients[i] = (INT16) (((seed >> 8) % ((n & 7) ? 127 : 16383)) - (((n & 7) ? 127 : 16383) / 2));
+			else
+				coefficients[i] = 0;
+		}
+
+		/**
+		 * A trailing zero run is flushed with a terminating GR(0) symbol, which
+		 * decodes as 1: the round trip needs a nonzero last coefficient, the
+		 * trailing run itself is checked against the reference encoder below.
+		 */
+		coefficients[4095] = 1;
+
+		for (mode = RLGR1; mode <= RLGR3; mode += (RLGR3 - RLGR1))
+		{
+			size = rfx_rlgr_encode(mode, coefficients, 4096, buffer, sizeof(buffer));
+
+			if ((size < 1) || (size > (int) sizeof(buffer)))
+				return -1;
+
+			if (rfx_rlgr_decode(buffer, size, decoded, 4096, (mode == RLGR1) ? 1 : 3) < 0)
+				return -1;
+
+			if (memcmp(coefficients, decoded, sizeof(decoded)) != 0)
+			{
+				printf("rlgr round trip mismatch, set %d mode %d\n", n, mode);
+				return -1;
+			}
+
+			if (!test_rfx_rlgr_compare(mode, coefficients, "random set"))
+				return -1;
+		}
+
+		ZeroMemory(&coefficients[4096 - ((n + 1) * 8)], (n + 1) * 8 * sizeof(INT16));
+
+		for (mode = RLGR1; mode <= RLGR3; mode += (RLGR3 - RLGR1))
+		{
+			if (!test_rfx_rlgr_compare(mode, coefficients, "random set ending in a zero run"))
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void test_rfx_run_kernel(RFX_CONTEXT* context, int kernel, BOOL simd, INT16* buffer, INT16* dwt)
+{
+	static const UINT32 quants[10] = { 6, 6, 6, 6, 7, 7, 8, 8, 8, 9 };
+
+	switch (kernel)
+	{
+		case 0:
+			if (simd)
+				context->dwt_2d_encode(buffer, dwt);
+			else
+				rfx_dwt_2d_encode(buffer, dwt);
+			break;
+
+		case 1:
+			if (simd)
+				context->quantization_encode(buffer, quants);
+			else
+				rfx_quantization_encode(buffer, quants);
+			break;
+
+		case 2:
+			if (simd)
+				context->quantization_decode(buffer, quants);
+			else
+				rfx_quantization_decode(buffer, quants);
+			break;
+
+		case 3:
+			if (simd)
+				context->dwt_2d_decode(buffer, dwt);
+			else
+				rfx_dwt_2d_decode(buffer, dwt);
+			break;
+	}
+}
+
+static int test_rfx_simd_kernels(void)
+{
+	int i, n;
+	int rc = -1;
+	int kernel;
+	int pass;
+	UINT32 seed = 7;
+	UINT64 start;
+	UINT64 elapsed[2];
+	INT16* input;
+	INT16* buffer[2];
+	INT16* dwt;
+	BYTE* memory;
+	RFX_CONTEXT* context;
+	static const char* names[4] = { "dwt_2d_encode", "quantization_encode", "quantization_decode", "dwt_2d_decode" };
+
+	context = rfx_context_new(TRUE);
+
+	/* the SSE2 kernels may touch a coefficient next to the buffers, keep some room around them */
+	memory = (BYTE*) _aligned_malloc(4 * 8192 + 64, 32);
+
+	if (!context || !memory)
+		goto fail;
+
+	input = (INT16*) &memory[32];
+	buffer[0] = (INT16*) &memory[32 + 8192];
+	buffer[1] = (INT16*) &memory[32 + 2 * 8192];
+	dwt = (INT16*) &memory[32 + 3 * 8192];
+
+	for (i = 0; i < 4096; i++)
+	{
+		seed = (seed * 1103515245) + 12345;
+
+		/* gradients with some noise, in the 11.5 fixed point YCbCr range */
+		buffer[0][i] = buffer[1][i] = (INT16) ((((i & 63) + (i >> 6)) * 48) - 4096 + ((seed >> 16) & 0xFF));
+	}
+
+	/* run the whole encode and decode chain, the optimized kernels must be bit exact with the generic ones */
+
+	for (kernel = 0; kernel < 4; kernel++)
+	{
+		CopyMemory(input, buffer[0], 8192);
+
+		for (pass = 0; pass < 2; pass++)
+			test_rfx_run_kernel(context, kernel, pass, buffer[pass], dwt);
+
+		if (memcmp(buffer[0], buffer[1], 8192) != 0)
+		{
+			printf("%s: the active kernel differs from the generic one\n", names[kernel]);
+			goto fail;
+		}
+
+		for (pass = 0; pass < 2; pass++)
+		{
+			start = GetTickCount64();
+
+			for (n = 0; n < 2000; n++)
+			{
+				CopyMemory(buffer[pass], input, 8192);
+				test_rfx_run_kernel(context, kernel, pass, buffer[pass], dwt);
+			}
+
+			elapsed[pass] = GetTickCount64() - start;
+		}
+
+		printf("%-20s generic: %4u ms, active: %4u ms\n", names[kernel], (UINT32) elapsed[0], (UINT32) elapsed[1]);
+	}
+
+	rc = 0;
+
+fail:
+	_aligned_free(memory);
+	rfx_context_free(context);
+	return rc;
+}
+
 int TestFreeRDPCodecRemoteFX(int argc, char* argv[])
 {
+	if (test_rfx_rlgr_round_trip() < 0)
+		return -1;
+
+	if (test_rfx_rlgr_reference() < 0)
+		return -1;
+
+	if (test_rfx_encode_frame_fragments() < 0)
+		return -1;
+
+	if (test_rfx_change_detection() < 0)
+		return -1;
+
+	if (test_rfx_change_detection_partial() < 0)
+		return -1;
+
+	if (test_rfx_simd_kernels() < 0)
+		return -1;
+
 	return 0;
 }
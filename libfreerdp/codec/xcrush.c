@@ -28,8 +28,18 @@
 #include <freerdp/log.h>
 #include <freerdp/codec/xcrush.h>
 
+#include "bulk_match.h"
+
 #define TAG FREERDP_TAG("codec")
 
+/**
+ * Per compression effort: the chunk chain walk stops once the chunk index
+ * reaches XCRUSH_MAX_CHAIN_LENGTH or a match exceeds XCRUSH_NICE_MATCH_LENGTH.
+ */
+
+static const UINT32 XCRUSH_MAX_CHAIN_LENGTH[3] = { 0, 5, 31 };
+static const UINT32 XCRUSH_NICE_MATCH_LENGTH[3] = { 64, 256, 2048 };
+
 const char* xcrush_get_level_2_compression_flags_string(UINT32 flags)
 {
 	flags &= 0xE0;
@@ -322,8 +332,6 @@ int xcrush_insert_chunk(XCRUSH_CONTEXT* xcrush, XCRUSH_SIGNATURE* signature, UIN
 
 int xcrush_find_match_length(XCRUSH_CONTEXT* xcrush, UINT32 MatchOffset, UINT32 ChunkOffset, UINT32 HistoryOffset, UINT32 SrcSize, UINT32 MaxMatchLength, XCRUSH_MATCH_INFO* MatchInfo)
 {
-	UINT32 MatchSymbol;
-	UINT32 ChunkSymbol;
 	BYTE* ChunkBuffer;
 	BYTE* MatchBuffer;
 	BYTE* MatchStartPtr;
@@ -373,19 +381,7 @@ int xcrush_find_match_length(XCRUSH_CONTEXT* xcrush, UINT32 MatchOffset, UINT32
 		return 0;
 	}
 
-	while (1)
-	{
-		MatchSymbol = *ForwardMatchPtr++;
-		ChunkSymbol = *ForwardChunkPtr++;
-
-		if (MatchSymbol != ChunkSymbol)
-			break;
-
-		if (ForwardMatchPtr > HistoryBufferEnd)
-			break;
-			
-		ForwardMatchLength++;
-	}
+	ForwardMatchLength = bulk_match_length(ForwardMatchPtr, ForwardChunkPtr, HistoryBufferEnd - ForwardMatchPtr);
 
 	ReverseMatchPtr = MatchBuffer - 1;
 	ReverseChunkPtr = ChunkBuffer - 1;
@@ -471,14 +467,14 @@ int xcrush_find_all_matches(XCRUSH_CONTEXT* xcrush, UINT32 SignatureIndex, UINT3
 						MaxMatchInfo.ChunkOffset = MatchInfo.ChunkOffset;
 						MaxMatchInfo.MatchLength = MatchInfo.MatchLength;
 						
-						if (MatchLength > 256)
+						if (MatchLength > XCRUSH_NICE_MATCH_LENGTH[xcrush->CompressionEffort])
 							break;
 					}
 				}
 				
 				ChunkIndex = ChunkCount++;
 
-				if (ChunkIndex > 4)
+				if (ChunkIndex >= XCRUSH_MAX_CHAIN_LENGTH[xcrush->CompressionEffort])
 					break;
 				
 				status = xcrush_find_next_matching_chunk(xcrush, chunk, &chunk);
@@ -962,7 +958,9 @@ int xcrush_compress(XCRUSH_CONTEXT* xcrush, BYTE* pSrcData, UINT32 SrcSize, BYTE
 	if (status < 0)
 		return status;
 
-	if (!status || (Level2ComprFlags & PACKET_FLUSHED))
+	/* a flushed but compressed block only restarts the MPPC history */
+
+	if (!status || !(Level2ComprFlags & PACKET_COMPRESSED))
 	{
 		if (CompressedDataSize > DstSize)
 		{
@@ -1007,6 +1005,14 @@ int xcrush_compress(XCRUSH_CONTEXT* xcrush, BYTE* pSrcData, UINT32 SrcSize, BYTE
 	return 1;
 }
 
+void xcrush_set_compression_effort(XCRUSH_CONTEXT* xcrush, DWORD CompressionEffort)
+{
+	if (CompressionEffort > BULK_COMPRESSION_EFFORT_HIGH)
+		CompressionEffort = BULK_COMPRESSION_EFFORT_HIGH;
+
+	xcrush->CompressionEffort = CompressionEffort;
+}
+
 void xcrush_context_reset(XCRUSH_CONTEXT* xcrush, BOOL flush)
 {
 	xcrush->SignatureIndex = 0;
@@ -1039,6 +1045,7 @@ XCRUSH_CONTEXT* xcrush_context_new(BOOL Compressor)
 	if (xcrush)
 	{
 		xcrush->Compressor = Compressor;
+		xcrush->CompressionEffort = BULK_COMPRESSION_EFFORT_DEFAULT;
 		xcrush->mppc = mppc_context_new(1, Compressor);
 
 		xcrush->HistoryOffset = 0;
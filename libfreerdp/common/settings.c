@@ -874,6 +874,9 @@ BOOL freerdp_get_param_bool(rdpSettings* settings, int id)
 		case FreeRDP_PlayRemoteFx:
 			return settings->PlayRemoteFx;
 
+		case FreeRDP_DumpUpdates:
+			return settings->DumpUpdates;
+
 		case FreeRDP_GatewayUseSameCredentials:
 			return settings->GatewayUseSameCredentials;
 
@@ -1331,6 +1334,10 @@ int freerdp_set_param_bool(rdpSettings* settings, int id, BOOL param)
 			settings->PlayRemoteFx = param;
 			break;
 
+		case FreeRDP_DumpUpdates:
+			settings->DumpUpdates = param;
+			break;
+
 		case FreeRDP_GatewayUseSameCredentials:
 			settings->GatewayUseSameCredentials = param;
 			break;
@@ -1668,6 +1675,9 @@ UINT32 freerdp_get_param_uint32(rdpSettings* settings, int id)
 		case FreeRDP_CompressionLevel:
 			return settings->CompressionLevel;
 
+		case FreeRDP_CompressionEffort:
+			return settings->CompressionEffort;
+
 		case FreeRDP_AutoReconnectMaxRetries:
 			return settings->AutoReconnectMaxRetries;
 
@@ -1946,6 +1956,10 @@ int freerdp_set_param_uint32(rdpSettings* settings, int id, UINT32 param)
 			settings->CompressionLevel = param;
 			break;
 
+		case FreeRDP_CompressionEffort:
+			settings->CompressionEffort = param;
+			break;
+
 		case FreeRDP_AutoReconnectMaxRetries:
 			settings->AutoReconnectMaxRetries = param;
 			break;
@@ -2312,6 +2326,15 @@ char* freerdp_get_param_string(rdpSettings* settings, int id)
 		case FreeRDP_PlayRemoteFxFile:
 			return settings->PlayRemoteFxFile;
 
+		case FreeRDP_DumpUpdatesFile:
+			return settings->DumpUpdatesFile;
+
+		case FreeRDP_BitmapCachePersistFile:
+			return settings->BitmapCachePersistFile;
+
+		case FreeRDP_GfxCachePersistFile:
+			return settings->GfxCachePersistFile;
+
 		case FreeRDP_GatewayHostname:
 			return settings->GatewayHostname;
 
@@ -2523,6 +2546,21 @@ int freerdp_set_param_string(rdpSettings* settings, int id, const char* param)
 			settings->PlayRemoteFxFile = _strdup(param);
 			break;
 
+		case FreeRDP_DumpUpdatesFile:
+			free(settings->DumpUpdatesFile);
+			settings->DumpUpdatesFile = _strdup(param);
+			break;
+
+		case FreeRDP_BitmapCachePersistFile:
+			free(settings->BitmapCachePersistFile);
+			settings->BitmapCachePersistFile = _strdup(param);
+			break;
+
+		case FreeRDP_GfxCachePersistFile:
+			free(settings->GfxCachePersistFile);
+			settings->GfxCachePersistFile = _strdup(param);
+			break;
+
 		case FreeRDP_GatewayHostname:
 			free(settings->GatewayHostname);
 			settings->GatewayHostname = _strdup(param);
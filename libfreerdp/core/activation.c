@@ -21,6 +21,9 @@
 #include "config.h"
 #endif
 
+#include <freerdp/cache/cache.h>
+#include <freerdp/cache/persistent.h>
+
 #include "activation.h"
 
 /*
@@ -178,33 +181,187 @@ void rdp_write_persistent_list_entry(wStream* s, UINT32 key1, UINT32 key2)
 	Stream_Write_UINT32(s, key2); /* key2 (4 bytes) */
 }
 
-void rdp_write_client_persistent_key_list_pdu(wStream* s, rdpSettings* settings)
+void rdp_write_client_persistent_key_list_pdu(wStream* s, UINT16* numEntries, UINT16* totalEntries, BYTE bitMask)
 {
-	Stream_Write_UINT16(s, 0); /* numEntriesCache0 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* numEntriesCache1 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* numEntriesCache2 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* numEntriesCache3 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* numEntriesCache4 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache0 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache1 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache2 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache3 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache4 (2 bytes) */
-	Stream_Write_UINT8(s, PERSIST_FIRST_PDU | PERSIST_LAST_PDU); /* bBitMask (1 byte) */
+	int i;
+
+	for (i = 0; i < PERSIST_CACHE_MAX_CELLS; i++)
+		Stream_Write_UINT16(s, numEntries[i]); /* numEntriesCacheX (2 bytes) */
+
+	for (i = 0; i < PERSIST_CACHE_MAX_CELLS; i++)
+		Stream_Write_UINT16(s, totalEntries[i]); /* totalEntriesCacheX (2 bytes) */
+
+	Stream_Write_UINT8(s, bitMask); /* bBitMask (1 byte) */
 	Stream_Write_UINT8(s, 0); /* pad1 (1 byte) */
 	Stream_Write_UINT16(s, 0); /* pad3 (2 bytes) */
 
 	/* entries */
 }
 
+/**
+ * Once connected (on reconnect), the bitmap cache maps the file: its key lists
+ * are rebuilt from the current contents and offered as they are.
+ */
+
+static UINT32 rdp_copy_persistent_key_list(rdpBitmapCache* bitmapCache, UINT64** keys, UINT16* totalEntries)
+{
+	UINT32 i;
+	UINT32 total = 0;
+
+	bitmap_cache_reset_persistent_keys(bitmapCache);
+
+	for (i = 0; i < PERSIST_CACHE_MAX_CELLS; i++)
+	{
+		if (!bitmapCache->persistentKeyCount[i])
+			continue;
+
+		keys[i] = (UINT64*) calloc(bitmapCache->persistentKeyCount[i], sizeof(UINT64));
+
+		if (!keys[i])
+			continue;
+
+		CopyMemory(keys[i], bitmapCache->persistentKeys[i], bitmapCache->persistentKeyCount[i] * sizeof(UINT64));
+		totalEntries[i] = (UINT16) bitmapCache->persistentKeyCount[i];
+		total += totalEntries[i];
+	}
+
+	return total;
+}
+
+/**
+ * Load the keys of the persistent bitmap cache, most recently used first.
+ * The bitmap cache rebuilds the same lists from the same file when it is
+ * created, so that the n-th key of a cell maps to cache index n.
+ */
+
+static UINT32 rdp_load_persistent_key_list(rdpRdp* rdp, UINT64** keys, UINT16* totalEntries)
+{
+	UINT32 i;
+	UINT32 total = 0;
+	UINT32 numCells;
+	rdpPersistentCache* persistent;
+	rdpSettings* settings = rdp->settings;
+	rdpCache* cache = rdp->context ? rdp->context->cache : NULL;
+
+	if (cache && cache->bitmap)
+	{
+		if (!cache->bitmap->persistent)
+			return 0;
+
+		return rdp_copy_persistent_key_list(cache->bitmap, keys, totalEntries);
+	}
+
+	if (!settings->BitmapCachePersistFile)
+		return 0;
+
+	persistent = persistent_cache_new(persistent_cache_max_entries(settings));
+
+	if (!persistent)
+		return 0;
+
+	if (persistent_cache_open(persistent, settings->BitmapCachePersistFile, TRUE) < 0)
+	{
+		persistent_cache_free(persistent);
+		return 0;
+	}
+
+	numCells = settings->BitmapCacheV2NumCells;
+
+	if (numCells > PERSIST_CACHE_MAX_CELLS)
+		numCells = PERSIST_CACHE_MAX_CELLS;
+
+	for (i = 0; i < numCells; i++)
+	{
+		BITMAP_CACHE_V2_CELL_INFO* cellInfo = &settings->BitmapCacheV2CellInfo[i];
+
+		if (!cellInfo->persistent || !cellInfo->numEntries)
+			continue;
+
+		keys[i] = (UINT64*) calloc(cellInfo->numEntries, sizeof(UINT64));
+
+		if (!keys[i])
+			continue;
+
+		totalEntries[i] = (UINT16) persistent_cache_get_key_list(persistent, (BYTE) i, keys[i],
+				(cellInfo->numEntries < 0xFFFF) ? cellInfo->numEntries : 0xFFFF);
+		total += totalEntries[i];
+	}
+
+	persistent_cache_free(persistent);
+
+	return total;
+}
+
 BOOL rdp_send_client_persistent_key_list_pdu(rdpRdp* rdp)
 {
+	int i;
 	wStream* s;
+	BYTE bitMask;
+	UINT32 count;
+	UINT32 total;
+	UINT32 sent = 0;
+	BOOL status = TRUE;
+	UINT64* keys[PERSIST_CACHE_MAX_CELLS] = { NULL };
+	UINT16 offset[PERSIST_CACHE_MAX_CELLS] = { 0 };
+	UINT16 numEntries[PERSIST_CACHE_MAX_CELLS];
+	UINT16 totalEntries[PERSIST_CACHE_MAX_CELLS] = { 0 };
+
+	total = rdp_load_persistent_key_list(rdp, keys, totalEntries);
+
+	do
+	{
+		/* every PDU repeats the totals but carries at most 169 keys */
 
-	s = rdp_data_pdu_init(rdp);
-	rdp_write_client_persistent_key_list_pdu(s, rdp->settings);
+		count = 0;
+		bitMask = (sent == 0) ? PERSIST_FIRST_PDU : 0;
+
+		for (i = 0; i < PERSIST_CACHE_MAX_CELLS; i++)
+		{
+			numEntries[i] = totalEntries[i] - offset[i];
+
+			if (numEntries[i] > (PERSIST_CACHE_MAX_PDU_KEYS - count))
+				numEntries[i] = (UINT16) (PERSIST_CACHE_MAX_PDU_KEYS - count);
+
+			count += numEntries[i];
+		}
+
+		if ((sent + count) >= total)
+			bitMask |= PERSIST_LAST_PDU;
 
-	return rdp_send_data_pdu(rdp, s, DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST, rdp->mcs->userId);
+		s = rdp_data_pdu_init(rdp);
+
+		if (!s)
+		{
+			status = FALSE;
+			break;
+		}
+
+		Stream_EnsureRemainingCapacity(s, 24 + (count * 8));
+		rdp_write_client_persistent_key_list_pdu(s, numEntries, totalEntries, bitMask);
+
+		for (i = 0; i < PERSIST_CACHE_MAX_CELLS; i++)
+		{
+			for (; numEntries[i] > 0; numEntries[i]--)
+			{
+				UINT64 key64 = keys[i][offset[i]++];
+				rdp_write_persistent_list_entry(s, (UINT32) (key64 & 0xFFFFFFFF), (UINT32) (key64 >> 32));
+			}
+		}
+
+		if (!rdp_send_data_pdu(rdp, s, DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST, rdp->mcs->userId))
+		{
+			status = FALSE;
+			break;
+		}
+
+		sent += count;
+	}
+	while (sent < total);
+
+	for (i = 0; i < PERSIST_CACHE_MAX_CELLS; i++)
+		free(keys[i]);
+
+	return status;
 }
 
 BOOL rdp_recv_client_font_list_pdu(wStream* s)
@@ -66,6 +66,13 @@ UINT32 bulk_compression_max_size(rdpBulk* bulk)
 	return bulk->CompressionMaxSize;
 }
 
+static void bulk_compression_effort(rdpBulk* bulk)
+{
+	bulk->CompressionEffort = bulk->context->settings->CompressionEffort;
+	ncrush_set_compression_effort(bulk->ncrushSend, bulk->CompressionEffort);
+	xcrush_set_compression_effort(bulk->xcrushSend, bulk->CompressionEffort);
+}
+
 int bulk_compress_validate(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags)
 {
 	int status;
@@ -182,6 +189,7 @@ int bulk_compress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstDat
 	UINT32 CompressedBytes;
 	UINT32 UncompressedBytes;
 	double CompressionRatio;
+	rdpSettings* settings = bulk->context->settings;
 	metrics = bulk->context->metrics;
 
 	if ((SrcSize <= 50) || (SrcSize >= 16384))
@@ -196,6 +204,9 @@ int bulk_compress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstDat
 	bulk_compression_level(bulk);
 	bulk_compression_max_size(bulk);
 
+	if (bulk->CompressionEffort != settings->CompressionEffort)
+		bulk_compression_effort(bulk);
+
 	if ((bulk->CompressionLevel == PACKET_COMPR_TYPE_8K) ||
 			(bulk->CompressionLevel == PACKET_COMPR_TYPE_64K))
 	{
@@ -240,14 +251,92 @@ int bulk_compress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstDat
 	return status;
 }
 
+/**
+ * Compress an update PDU unless its update type has recently proven to be
+ * incompressible (surface bits carrying RemoteFX or NSCodec data, cached
+ * bitmaps already compressed by the bitmap codec). A bypassed PDU is sent
+ * without PACKET_COMPRESSED and never enters the sender history, so the
+ * receiver leaves its own history untouched as well and both stay in sync.
+ */
+
+int bulk_compress_update(rdpBulk* bulk, BYTE updateCode, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags)
+{
+	int status;
+	BOOL probe;
+	double CompressionRatio;
+	UINT32 CompressedBytes;
+	rdpBulkUpdateClass* updateClass;
+	rdpMetrics* metrics = bulk->context->metrics;
+
+	if ((SrcSize <= 50) || (SrcSize >= 16384) || (updateCode >= METRICS_UPDATE_TYPE_COUNT))
+		return bulk_compress(bulk, pSrcData, SrcSize, ppDstData, pDstSize, pFlags);
+
+	updateClass = &bulk->UpdateClasses[updateCode];
+
+	if (updateClass->SkipCount > 0)
+	{
+		updateClass->SkipCount--;
+		metrics_write_bypassed_bytes(metrics, updateCode, SrcSize);
+		*ppDstData = pSrcData;
+		*pDstSize = SrcSize;
+		*pFlags = 0;
+		return 0;
+	}
+
+	probe = (updateClass->ProbeInterval > 0);
+	status = bulk_compress(bulk, pSrcData, SrcSize, ppDstData, pDstSize, pFlags);
+
+	if (status < 0)
+		return status;
+
+	/* PDUs the compressor gave up on go out uncompressed */
+
+	CompressedBytes = (*pFlags & PACKET_COMPRESSED) ? *pDstSize : SrcSize;
+	CompressionRatio = metrics_write_update_bytes(metrics, updateCode, SrcSize, CompressedBytes);
+
+	if (probe)
+	{
+		if (CompressionRatio < BULK_BYPASS_COMPRESSION_RATIO)
+		{
+			/* compressible again, restart the average from this PDU */
+			metrics->UpdateCompressionRatio[updateCode] = CompressionRatio;
+			updateClass->ProbeInterval = 0;
+		}
+		else
+		{
+			updateClass->ProbeInterval *= 2;
+
+			if (updateClass->ProbeInterval > BULK_BYPASS_MAX_INTERVAL)
+				updateClass->ProbeInterval = BULK_BYPASS_MAX_INTERVAL;
+
+			updateClass->SkipCount = updateClass->ProbeInterval;
+		}
+	}
+	else if ((metrics->UpdateSampleCount[updateCode] >= BULK_BYPASS_MIN_SAMPLES) &&
+			(metrics->UpdateCompressionRatio[updateCode] >= BULK_BYPASS_COMPRESSION_RATIO))
+	{
+		updateClass->ProbeInterval = BULK_BYPASS_MIN_INTERVAL;
+		updateClass->SkipCount = updateClass->ProbeInterval;
+#ifdef WITH_BULK_DEBUG
+		WLog_DBG(TAG, "Bypassing compression for update type %d, ratio: %f",
+				 updateCode, metrics->UpdateCompressionRatio[updateCode]);
+#endif
+	}
+
+	return status;
+}
+
 void bulk_reset(rdpBulk* bulk)
 {
+	ZeroMemory(bulk->UpdateClasses, sizeof(bulk->UpdateClasses));
+
 	mppc_context_reset(bulk->mppcSend, FALSE);
 	mppc_context_reset(bulk->mppcRecv, FALSE);
 	ncrush_context_reset(bulk->ncrushRecv, FALSE);
 	ncrush_context_reset(bulk->ncrushSend, FALSE);
 	xcrush_context_reset(bulk->xcrushRecv, FALSE);
 	xcrush_context_reset(bulk->xcrushSend, FALSE);
+	bulk_compression_effort(bulk);
 }
 
 rdpBulk* bulk_new(rdpContext* context)
@@ -265,6 +354,14 @@ rdpBulk* bulk_new(rdpContext* context)
 		bulk->xcrushRecv = xcrush_context_new(FALSE);
 		bulk->xcrushSend = xcrush_context_new(TRUE);
 		bulk->CompressionLevel = context->settings->CompressionLevel;
+
+		if (!bulk->ncrushSend || !bulk->xcrushSend)
+		{
+			bulk_free(bulk);
+			return NULL;
+		}
+
+		bulk_compression_effort(bulk);
 	}
 
 	return bulk;
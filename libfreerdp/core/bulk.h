@@ -21,6 +21,7 @@
 #define FREERDP_CORE_BULK_H
 
 typedef struct rdp_bulk rdpBulk;
+typedef struct rdp_bulk_update_class rdpBulkUpdateClass;
 
 #include "rdp.h"
 
@@ -28,28 +29,47 @@ typedef struct rdp_bulk rdpBulk;
 #include <freerdp/codec/ncrush.h>
 #include <freerdp/codec/xcrush.h>
 
+struct rdp_bulk_update_class
+{
+	UINT32 SkipCount;
+	UINT32 ProbeInterval;
+};
+
 struct rdp_bulk
 {
 	rdpContext* context;
 	UINT32 CompressionLevel;
 	UINT32 CompressionMaxSize;
+	UINT32 CompressionEffort;
 	MPPC_CONTEXT* mppcSend;
 	MPPC_CONTEXT* mppcRecv;
 	NCRUSH_CONTEXT* ncrushRecv;
 	NCRUSH_CONTEXT* ncrushSend;
 	XCRUSH_CONTEXT* xcrushRecv;
 	XCRUSH_CONTEXT* xcrushSend;
+	rdpBulkUpdateClass UpdateClasses[METRICS_UPDATE_TYPE_COUNT];
 	BYTE OutputBuffer[65536];
 };
 
 #define BULK_COMPRESSION_FLAGS_MASK	0xE0
 #define BULK_COMPRESSION_TYPE_MASK	0x0F
 
+/**
+ * Update types whose recent PDUs shrink by less than 5% are sent uncompressed,
+ * compression is retried on one PDU after a skip interval that doubles with
+ * every failed probe.
+ */
+#define BULK_BYPASS_COMPRESSION_RATIO	0.95
+#define BULK_BYPASS_MIN_SAMPLES		8
+#define BULK_BYPASS_MIN_INTERVAL	16
+#define BULK_BYPASS_MAX_INTERVAL	256
+
 UINT32 bulk_compression_level(rdpBulk* bulk);
 UINT32 bulk_compression_max_size(rdpBulk* bulk);
 
 int bulk_decompress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32 flags);
 int bulk_compress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags);
+int bulk_compress_update(rdpBulk* bulk, BYTE updateCode, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags);
 
 void bulk_reset(rdpBulk* bulk);
 
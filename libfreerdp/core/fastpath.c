@@ -37,6 +37,7 @@
 #include "update.h"
 #include "surface.h"
 #include "fastpath.h"
+#include "replay.h"
 #include "rdp.h"
 
 #define TAG FREERDP_TAG("core.fastpath")
@@ -247,13 +248,16 @@ static BOOL fastpath_recv_update_synchronize(rdpFastPath* fastpath, wStream* s)
 	return TRUE;
 }
 
-static int fastpath_recv_update(rdpFastPath* fastpath, BYTE updateCode, UINT32 size, wStream* s)
+int fastpath_recv_update(rdpFastPath* fastpath, BYTE updateCode, UINT32 size, wStream* s)
 {
 	int status = 0;
 	rdpUpdate* update = fastpath->rdp->update;
 	rdpContext* context = fastpath->rdp->update->context;
 	rdpPointerUpdate* pointer = update->pointer;
 
+	if (update->dump_updates)
+		replay_record_update(update, REPLAY_RECORD_FASTPATH_UPDATE, updateCode, Stream_Pointer(s), size);
+
 #ifdef WITH_DEBUG_RDP
 	DEBUG_RDP("recv Fast-Path %s Update (0x%X), length:%d",
 		updateCode < ARRAYSIZE(FASTPATH_UPDATETYPE_STRINGS) ? FASTPATH_UPDATETYPE_STRINGS[updateCode] : "???", updateCode, size);
@@ -518,6 +522,9 @@ int fastpath_recv_updates(rdpFastPath* fastpath, wStream* s)
 			return -1;
 	}
 
+	if (update->dump_updates)
+		replay_record_update(update, REPLAY_RECORD_END_PAINT, 0, NULL, 0);
+
 	IFCALL(update->EndPaint, update->context);
 
 	return status;
@@ -957,7 +964,7 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 
 		if (settings->CompressionEnabled && !skipCompression)
 		{
-			if (bulk_compress(rdp->bulk, pSrcData, SrcSize, &pDstData, &DstSize, &compressionFlags) >= 0)
+			if (bulk_compress_update(rdp->bulk, updateCode, pSrcData, SrcSize, &pDstData, &DstSize, &compressionFlags) >= 0)
 			{
 				if (compressionFlags)
 				{
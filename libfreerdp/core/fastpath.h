@@ -151,6 +151,7 @@ struct rdp_fastpath
 UINT16 fastpath_header_length(wStream* s);
 UINT16 fastpath_read_header(rdpFastPath* fastpath, wStream* s);
 BOOL fastpath_read_header_rdp(rdpFastPath* fastpath, wStream* s, UINT16 *length);
+int fastpath_recv_update(rdpFastPath* fastpath, BYTE updateCode, UINT32 size, wStream* s);
 int fastpath_recv_updates(rdpFastPath* fastpath, wStream* s);
 int fastpath_recv_inputs(rdpFastPath* fastpath, wStream* s);
 
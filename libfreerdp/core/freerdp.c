@@ -29,6 +29,7 @@
 #include "transport.h"
 #include "connection.h"
 #include "message.h"
+#include "replay.h"
 
 #include <assert.h>
 
@@ -116,6 +117,13 @@ BOOL freerdp_connect(freerdp* instance)
 				instance->update->dump_rfx = TRUE;
 		}
 
+		if (instance->settings->DumpUpdates)
+		{
+			instance->update->pcap_updates = pcap_open(instance->settings->DumpUpdatesFile, TRUE);
+			if (instance->update->pcap_updates)
+				instance->update->dump_updates = TRUE;
+		}
+
 		IFCALLRET(instance->PostConnect, status, instance);
 		update_post_connect(instance->update);
 
@@ -329,6 +337,13 @@ BOOL freerdp_disconnect(freerdp* instance)
 		instance->update->pcap_rfx = NULL;
 	}
 
+	if (instance->update->pcap_updates)
+	{
+		instance->update->dump_updates = FALSE;
+		pcap_close(instance->update->pcap_updates);
+		instance->update->pcap_updates = NULL;
+	}
+
 	return TRUE;
 }
 
@@ -320,6 +320,15 @@ static BOOL freerdp_listener_check_fds(freerdp_listener* instance)
 
 		client = freerdp_peer_new(peer_sockfd);
 
+		if (!client)
+		{
+			close(peer_sockfd);
+			return FALSE;
+		}
+
+		/* all peers of a listener share its TLS context, credentials and session cache */
+		client->TlsServerContext = tls_server_context_ref(listener->tls);
+
 		sin_addr = NULL;
 		if (peer_addr.ss_family == AF_INET)
 		{
@@ -374,6 +383,15 @@ freerdp_listener* freerdp_listener_new(void)
 
 	listener->instance = instance;
 
+	listener->tls = tls_server_context_new();
+
+	if (!listener->tls)
+	{
+		free(listener);
+		free(instance);
+		return NULL;
+	}
+
 	instance->listener = (void*) listener;
 
 	return instance;
@@ -384,6 +402,7 @@ void freerdp_listener_free(freerdp_listener* instance)
 	rdpListener* listener;
 
 	listener = (rdpListener*) instance->listener;
+	tls_server_context_free(listener->tls);
 	free(listener);
 
 	free(instance);
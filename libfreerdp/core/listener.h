@@ -38,6 +38,8 @@ struct rdp_listener
 	int num_sockfds;
  	int sockfds[MAX_LISTENER_HANDLES];
  	HANDLE events[MAX_LISTENER_HANDLES];
+
+	rdpTlsServerContext* tls;
 };
 
 #endif
@@ -36,6 +36,39 @@ double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes, UINT32
 	return CompressionRatio;
 }
 
+/**
+ * Per update type compressibility, the moving average gives the last eight
+ * or so PDUs most of the weight. Returns the ratio of this PDU alone.
+ */
+
+double metrics_write_update_bytes(rdpMetrics* metrics, UINT32 UpdateType, UINT32 UncompressedBytes, UINT32 CompressedBytes)
+{
+	double CompressionRatio;
+
+	CompressionRatio = ((double) CompressedBytes) / ((double) UncompressedBytes);
+
+	if (UpdateType >= METRICS_UPDATE_TYPE_COUNT)
+		return CompressionRatio;
+
+	metrics->UpdateUncompressedBytes[UpdateType] += UncompressedBytes;
+	metrics->UpdateCompressedBytes[UpdateType] += CompressedBytes;
+
+	if (metrics->UpdateSampleCount[UpdateType]++ == 0)
+		metrics->UpdateCompressionRatio[UpdateType] = CompressionRatio;
+	else
+		metrics->UpdateCompressionRatio[UpdateType] += (CompressionRatio - metrics->UpdateCompressionRatio[UpdateType]) / 8.0;
+
+	return CompressionRatio;
+}
+
+void metrics_write_bypassed_bytes(rdpMetrics* metrics, UINT32 UpdateType, UINT32 Bytes)
+{
+	metrics_write_bytes(metrics, Bytes, Bytes);
+
+	if (UpdateType < METRICS_UPDATE_TYPE_COUNT)
+		metrics->UpdateBypassedBytes[UpdateType] += Bytes;
+}
+
 rdpMetrics* metrics_new(rdpContext* context)
 {
 	rdpMetrics* metrics;
@@ -636,6 +636,7 @@ void freerdp_peer_context_new(freerdp_peer* client)
 	autodetect_register_server_callbacks(client->autodetect);
 
 	transport_attach(rdp->transport, client->sockfd);
+	rdp->transport->TlsServerContext = client->TlsServerContext;
 
 	rdp->transport->ReceiveCallback = peer_recv_callback;
 	rdp->transport->ReceiveExtra = client;
@@ -701,5 +702,6 @@ void freerdp_peer_free(freerdp_peer* client)
 
 	rdp_free(client->context->rdp);
 	free(client->context);
+	tls_server_context_free(client->TlsServerContext);
 	free(client);
 }
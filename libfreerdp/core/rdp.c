@@ -28,6 +28,7 @@
 
 #include "info.h"
 #include "redirection.h"
+#include "replay.h"
 
 #include <freerdp/crypto/per.h>
 #include <freerdp/log.h>
@@ -775,6 +776,9 @@ int rdp_recv_data_pdu(rdpRdp* rdp, wStream* s)
 	switch (type)
 	{
 		case DATA_PDU_TYPE_UPDATE:
+			if (rdp->update->dump_updates)
+				replay_record_update(rdp->update, REPLAY_RECORD_SLOWPATH_UPDATE, 0, Stream_Pointer(cs), Stream_GetRemainingLength(cs));
+
 			if (!update_recv(rdp->update, cs))
 				return -1;
 			break;
@@ -785,6 +789,9 @@ int rdp_recv_data_pdu(rdpRdp* rdp, wStream* s)
 			break;
 
 		case DATA_PDU_TYPE_POINTER:
+			if (rdp->update->dump_updates)
+				replay_record_update(rdp->update, REPLAY_RECORD_SLOWPATH_POINTER, 0, Stream_Pointer(cs), Stream_GetRemainingLength(cs));
+
 			if (!update_recv_pointer(rdp->update, cs))
 				return -1;
 			break;
@@ -0,0 +1,891 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RDP Server Peer Reactor
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+#include <winpr/collections.h>
+
+#include <freerdp/log.h>
+#include <freerdp/reactor.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#endif
+
+#define TAG FREERDP_TAG("core.reactor")
+
+#ifdef HAVE_SYS_EPOLL_H
+
+#define PEER_REACTOR_MAX_EVENTS		64
+
+typedef struct _PEER_REACTOR_PEER PEER_REACTOR_PEER;
+typedef struct _PEER_REACTOR_WORKER PEER_REACTOR_WORKER;
+
+struct _PEER_REACTOR_SOURCE
+{
+	int fd;
+	HANDLE event;
+	psPeerReactorEventHandler handler;
+	void* param;
+	PEER_REACTOR_PEER* peer;
+};
+typedef struct _PEER_REACTOR_SOURCE PEER_REACTOR_SOURCE;
+
+/**
+ * The worker lock protects the peer table, the source lists and the closed
+ * and busy flags. The peer lock serializes the callbacks of one peer and is
+ * never acquired while holding a worker lock.
+ */
+
+struct _PEER_REACTOR_PEER
+{
+	LONG refs;
+	LONG busy;
+	LONG closed;
+	CRITICAL_SECTION lock;
+	freerdp_peer* client;
+	wArrayList* sources;
+	PEER_REACTOR_WORKER* worker;
+
+	PTP_WORK work;
+	psPeerReactorWorkHandler workHandler;
+	void* workParam;
+};
+
+struct _PEER_REACTOR_WORKER
+{
+	int epfd;
+	HANDLE thread;
+	CRITICAL_SECTION lock;
+	wHashTable* peers;
+	rdpPeerReactor* reactor;
+};
+
+#endif
+
+struct rdp_peer_reactor
+{
+	HANDLE stopEvent;
+	UINT32 numWorkers;
+	psPeerReactorPeerClosed PeerClosed;
+	void* param;
+
+#ifdef HAVE_SYS_EPOLL_H
+	PEER_REACTOR_WORKER* workers;
+#endif
+
+	PTP_POOL ThreadPool;
+	TP_CALLBACK_ENVIRON ThreadPoolEnv;
+	wCountdownEvent* pendingWork;
+};
+
+#ifdef HAVE_SYS_EPOLL_H
+
+static void peer_reactor_source_free(void* obj)
+{
+	PEER_REACTOR_SOURCE* source = (PEER_REACTOR_SOURCE*) obj;
+
+	if (!source)
+		return;
+
+	close(source->fd);
+	free(source);
+}
+
+static void peer_reactor_peer_release(PEER_REACTOR_PEER* peer)
+{
+	if (!peer || (InterlockedDecrement(&peer->refs) > 0))
+		return;
+
+	if (peer->work)
+		CloseThreadpoolWork(peer->work);
+
+	if (peer->sources)
+		ArrayList_Free(peer->sources);
+	DeleteCriticalSection(&peer->lock);
+	free(peer);
+}
+
+/**
+ * Enables or disables the delivery of the events of a peer, level-triggered
+ * sources that became ready in the meantime are reported again once enabled.
+ * Must be called with the worker lock held.
+ */
+
+static void peer_reactor_peer_arm(PEER_REACTOR_PEER* peer, BOOL armed)
+{
+	int index;
+	int count;
+	struct epoll_event epev;
+	PEER_REACTOR_SOURCE* source;
+
+	count = ArrayList_Count(peer->sources);
+
+	for (index = 0; index < count; index++)
+	{
+		source = (PEER_REACTOR_SOURCE*) ArrayList_GetItem(peer->sources, index);
+
+		ZeroMemory(&epev, sizeof(epev));
+		epev.events = armed ? EPOLLIN : 0;
+		epev.data.ptr = source;
+
+		epoll_ctl(peer->worker->epfd, EPOLL_CTL_MOD, source->fd, &epev);
+	}
+}
+
+/**
+ * Unregisters all the sources of a peer and drops the reference held by the
+ * peer table. Batches, work items and removals still using the peer hold
+ * their own reference. Must be called with the worker lock held.
+ */
+
+static void peer_reactor_peer_close(PEER_REACTOR_PEER* peer)
+{
+	int index;
+	int count;
+	PEER_REACTOR_SOURCE* source;
+	PEER_REACTOR_WORKER* worker = peer->worker;
+
+	if (InterlockedExchange(&peer->closed, TRUE))
+		return;
+
+	count = ArrayList_Count(peer->sources);
+
+	for (index = 0; index < count; index++)
+	{
+		source = (PEER_REACTOR_SOURCE*) ArrayList_GetItem(peer->sources, index);
+		epoll_ctl(worker->epfd, EPOLL_CTL_DEL, source->fd, NULL);
+	}
+
+	HashTable_Remove(worker->peers, peer->client);
+	peer_reactor_peer_release(peer);
+}
+
+static BOOL peer_reactor_dispatch(PEER_REACTOR_SOURCE* source)
+{
+	freerdp_peer* client = source->peer->client;
+
+	if (source->handler)
+		return source->handler(client, source->event, source->param);
+
+	return client->CheckFileDescriptor(client);
+}
+
+/**
+ * Finds the worker serving a client and returns the peer with that worker
+ * locked, or NULL. Workers are only ever locked one at a time.
+ */
+
+static PEER_REACTOR_PEER* peer_reactor_lock_peer(rdpPeerReactor* reactor, freerdp_peer* client)
+{
+	UINT32 index;
+	PEER_REACTOR_PEER* peer;
+	PEER_REACTOR_WORKER* worker;
+
+	for (index = 0; index < reactor->numWorkers; index++)
+	{
+		worker = &reactor->workers[index];
+
+		EnterCriticalSection(&worker->lock);
+
+		peer = (PEER_REACTOR_PEER*) HashTable_GetItemValue(worker->peers, client);
+
+		if (peer)
+			return peer;
+
+		LeaveCriticalSection(&worker->lock);
+	}
+
+	return NULL;
+}
+
+static UINT32 peer_reactor_worker_count(PEER_REACTOR_WORKER* worker)
+{
+	UINT32 count;
+
+	EnterCriticalSection(&worker->lock);
+	count = (UINT32) HashTable_Count(worker->peers);
+	LeaveCriticalSection(&worker->lock);
+
+	return count;
+}
+
+static void* peer_reactor_worker_thread(void* arg)
+{
+	int index;
+	int status;
+	int numClosed;
+	int numSources;
+	BOOL running = TRUE;
+	BOOL dispatched;
+	PEER_REACTOR_PEER* peer;
+	freerdp_peer* closed[PEER_REACTOR_MAX_EVENTS];
+	PEER_REACTOR_SOURCE* source;
+	PEER_REACTOR_SOURCE* sources[PEER_REACTOR_MAX_EVENTS];
+	struct epoll_event events[PEER_REACTOR_MAX_EVENTS];
+	PEER_REACTOR_WORKER* worker = (PEER_REACTOR_WORKER*) arg;
+	rdpPeerReactor* reactor = worker->reactor;
+
+	while (running)
+	{
+		status = epoll_wait(worker->epfd, events, PEER_REACTOR_MAX_EVENTS, -1);
+
+		if (status < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			WLog_ERR(TAG, "epoll_wait failure: %d", errno);
+			break;
+		}
+
+		numClosed = 0;
+		numSources = 0;
+
+		/* the batch keeps its peers alive once the worker lock is released */
+
+		EnterCriticalSection(&worker->lock);
+
+		for (index = 0; index < status; index++)
+		{
+			source = (PEER_REACTOR_SOURCE*) events[index].data.ptr;
+
+			/* the stop event is the only source without a peer */
+
+			if (!source)
+			{
+				running = FALSE;
+				break;
+			}
+
+			peer = source->peer;
+
+			if (peer->closed || peer->busy)
+				continue;
+
+			InterlockedIncrement(&peer->refs);
+			sources[numSources++] = source;
+		}
+
+		LeaveCriticalSection(&worker->lock);
+
+		for (index = 0; index < numSources; index++)
+		{
+			source = sources[index];
+			peer = source->peer;
+			dispatched = TRUE;
+
+			/**
+			 * The peer lock is only contended by work items, which disarm the
+			 * peer first, and by removals: skip the event, it is reported
+			 * again if still pending once the peer is released.
+			 */
+
+			if (TryEnterCriticalSection(&peer->lock))
+			{
+				if (!InterlockedCompareExchange(&peer->closed, 0, 0) &&
+						!InterlockedCompareExchange(&peer->busy, 0, 0))
+					dispatched = peer_reactor_dispatch(source);
+
+				LeaveCriticalSection(&peer->lock);
+			}
+
+			if (!dispatched)
+			{
+				EnterCriticalSection(&worker->lock);
+
+				if (!peer->closed)
+				{
+					closed[numClosed++] = peer->client;
+					peer_reactor_peer_close(peer);
+				}
+
+				LeaveCriticalSection(&worker->lock);
+			}
+
+			peer_reactor_peer_release(peer);
+		}
+
+		/* reported without holding any lock, the server usually frees the peer here */
+
+		for (index = 0; index < numClosed; index++)
+			IFCALL(reactor->PeerClosed, reactor, closed[index], reactor->param);
+	}
+
+	return NULL;
+}
+
+static VOID CALLBACK peer_reactor_work_callback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
+{
+	BOOL status = TRUE;
+	freerdp_peer* closed = NULL;
+	PEER_REACTOR_PEER* peer = (PEER_REACTOR_PEER*) context;
+	PEER_REACTOR_WORKER* worker = peer->worker;
+	rdpPeerReactor* reactor = worker->reactor;
+	psPeerReactorWorkHandler handler = peer->workHandler;
+	void* param = peer->workParam;
+
+	/* waits for an event callback started before the peer was disarmed */
+
+	EnterCriticalSection(&peer->lock);
+
+	if (!InterlockedCompareExchange(&peer->closed, 0, 0))
+		status = handler(peer->client, param);
+	else
+		handler(NULL, param);
+
+	LeaveCriticalSection(&peer->lock);
+
+	EnterCriticalSection(&worker->lock);
+
+	InterlockedExchange(&peer->busy, FALSE);
+
+	if (!peer->closed)
+	{
+		if (status)
+		{
+			peer_reactor_peer_arm(peer, TRUE);
+		}
+		else
+		{
+			closed = peer->client;
+			peer_reactor_peer_close(peer);
+		}
+	}
+
+	LeaveCriticalSection(&worker->lock);
+
+	if (closed)
+		IFCALL(reactor->PeerClosed, reactor, closed, reactor->param);
+
+	peer_reactor_peer_release(peer);
+	CountdownEvent_Signal(reactor->pendingWork, 1);
+}
+
+/**
+ * Queues a work item for a peer, its event sources stay disarmed until the
+ * handler returns. Must be called with the worker lock held.
+ */
+
+static BOOL peer_reactor_peer_submit(PEER_REACTOR_PEER* peer,
+		psPeerReactorWorkHandler handler, void* param)
+{
+	if (peer->closed || peer->busy)
+		return FALSE;
+
+	InterlockedExchange(&peer->busy, TRUE);
+	InterlockedIncrement(&peer->refs);
+
+	peer->workHandler = handler;
+	peer->workParam = param;
+
+	peer_reactor_peer_arm(peer, FALSE);
+
+	CountdownEvent_AddCount(peer->worker->reactor->pendingWork, 1);
+	SubmitThreadpoolWork(peer->work);
+
+	return TRUE;
+}
+
+static BOOL peer_reactor_add_source(PEER_REACTOR_PEER* peer, HANDLE event,
+		psPeerReactorEventHandler handler, void* param)
+{
+	int fd;
+	struct epoll_event epev;
+	PEER_REACTOR_SOURCE* source;
+
+	fd = GetEventFileDescriptor(event);
+
+	if (fd < 0)
+	{
+		WLog_ERR(TAG, "event handle has no file descriptor");
+		return FALSE;
+	}
+
+	source = (PEER_REACTOR_SOURCE*) calloc(1, sizeof(PEER_REACTOR_SOURCE));
+
+	if (!source)
+		return FALSE;
+
+	/* a private descriptor lets peers of the same worker share an event */
+
+	source->fd = dup(fd);
+
+	if (source->fd < 0)
+	{
+		free(source);
+		return FALSE;
+	}
+
+	source->event = event;
+	source->handler = handler;
+	source->param = param;
+	source->peer = peer;
+
+	if (ArrayList_Add(peer->sources, source) < 0)
+	{
+		peer_reactor_source_free(source);
+		return FALSE;
+	}
+
+	ZeroMemory(&epev, sizeof(epev));
+	epev.events = peer->busy ? 0 : EPOLLIN;
+	epev.data.ptr = source;
+
+	if (epoll_ctl(peer->worker->epfd, EPOLL_CTL_ADD, source->fd, &epev) < 0)
+	{
+		WLog_ERR(TAG, "epoll_ctl failure: %d", errno);
+		ArrayList_Remove(peer->sources, source);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+BOOL freerdp_peer_reactor_add(rdpPeerReactor* reactor, freerdp_peer* client)
+{
+	UINT32 index;
+	UINT32 count;
+	UINT32 minCount;
+	BOOL status = FALSE;
+	PEER_REACTOR_PEER* peer;
+	PEER_REACTOR_WORKER* worker;
+
+	if (!reactor || !client || !client->context)
+		return FALSE;
+
+	peer = peer_reactor_lock_peer(reactor, client);
+
+	if (peer)
+	{
+		LeaveCriticalSection(&peer->worker->lock);
+		return FALSE;
+	}
+
+	/* least loaded worker, a peer then stays on it for its whole lifetime */
+
+	worker = &reactor->workers[0];
+	minCount = peer_reactor_worker_count(worker);
+
+	for (index = 1; index < reactor->numWorkers; index++)
+	{
+		count = peer_reactor_worker_count(&reactor->workers[index]);
+
+		if (count < minCount)
+		{
+			worker = &reactor->workers[index];
+			minCount = count;
+		}
+	}
+
+	peer = (PEER_REACTOR_PEER*) calloc(1, sizeof(PEER_REACTOR_PEER));
+
+	if (!peer)
+		return FALSE;
+
+	if (!InitializeCriticalSectionAndSpinCount(&peer->lock, 4000))
+	{
+		free(peer);
+		return FALSE;
+	}
+
+	peer->refs = 1;
+	peer->client = client;
+	peer->worker = worker;
+	peer->sources = ArrayList_New(FALSE);
+	peer->work = CreateThreadpoolWork(peer_reactor_work_callback, (void*) peer, &reactor->ThreadPoolEnv);
+
+	if (!peer->sources || !peer->work)
+	{
+		peer_reactor_peer_release(peer);
+		return FALSE;
+	}
+
+	ArrayList_Object(peer->sources)->fnObjectFree = peer_reactor_source_free;
+
+	EnterCriticalSection(&worker->lock);
+
+	if (HashTable_Add(worker->peers, client, peer) < 0)
+		goto out;
+
+	if (!peer_reactor_add_source(peer, client->GetEventHandle(client), NULL, NULL))
+	{
+		peer_reactor_peer_close(peer);
+		peer = NULL;
+		goto out;
+	}
+
+	peer = NULL;
+	status = TRUE;
+
+out:
+	LeaveCriticalSection(&worker->lock);
+	peer_reactor_peer_release(peer);
+
+	return status;
+}
+
+BOOL freerdp_peer_reactor_add_event(rdpPeerReactor* reactor, freerdp_peer* client,
+		HANDLE event, psPeerReactorEventHandler handler, void* param)
+{
+	BOOL status;
+	PEER_REACTOR_PEER* peer;
+
+	if (!reactor || !handler)
+		return FALSE;
+
+	peer = peer_reactor_lock_peer(reactor, client);
+
+	if (!peer)
+		return FALSE;
+
+	status = peer_reactor_add_source(peer, event, handler, param);
+
+	LeaveCriticalSection(&peer->worker->lock);
+
+	return status;
+}
+
+void freerdp_peer_reactor_remove(rdpPeerReactor* reactor, freerdp_peer* client)
+{
+	PEER_REACTOR_PEER* peer;
+	PEER_REACTOR_WORKER* worker;
+
+	if (!reactor)
+		return;
+
+	peer = peer_reactor_lock_peer(reactor, client);
+
+	if (!peer)
+		return;
+
+	worker = peer->worker;
+
+	InterlockedIncrement(&peer->refs);
+	peer_reactor_peer_close(peer);
+
+	LeaveCriticalSection(&worker->lock);
+
+	/* waits for a callback of this peer to return, the lock is recursive for callers removing their own peer */
+
+	EnterCriticalSection(&peer->lock);
+	LeaveCriticalSection(&peer->lock);
+
+	peer_reactor_peer_release(peer);
+}
+
+BOOL freerdp_peer_reactor_submit(rdpPeerReactor* reactor, freerdp_peer* client,
+		psPeerReactorWorkHandler handler, void* param)
+{
+	BOOL status;
+	PEER_REACTOR_PEER* peer;
+
+	if (!reactor || !handler)
+		return FALSE;
+
+	peer = peer_reactor_lock_peer(reactor, client);
+
+	if (!peer)
+		return FALSE;
+
+	status = peer_reactor_peer_submit(peer, handler, param);
+
+	LeaveCriticalSection(&peer->worker->lock);
+
+	return status;
+}
+
+UINT32 freerdp_peer_reactor_submit_all(rdpPeerReactor* reactor,
+		psPeerReactorWorkHandler handler, void* param)
+{
+	int key;
+	int count;
+	UINT32 index;
+	UINT32 submitted = 0;
+	ULONG_PTR* keys = NULL;
+	PEER_REACTOR_PEER* peer;
+	PEER_REACTOR_WORKER* worker;
+
+	if (!reactor || !handler)
+		return 0;
+
+	for (index = 0; index < reactor->numWorkers; index++)
+	{
+		worker = &reactor->workers[index];
+
+		EnterCriticalSection(&worker->lock);
+
+		count = HashTable_GetKeys(worker->peers, &keys);
+
+		for (key = 0; key < count; key++)
+		{
+			peer = (PEER_REACTOR_PEER*) HashTable_GetItemValue(worker->peers, (void*) keys[key]);
+
+			if (peer && peer_reactor_peer_submit(peer, handler, param))
+				submitted++;
+		}
+
+		LeaveCriticalSection(&worker->lock);
+
+		free(keys);
+		keys = NULL;
+	}
+
+	return submitted;
+}
+
+#else
+
+BOOL freerdp_peer_reactor_add(rdpPeerReactor* reactor, freerdp_peer* client)
+{
+	return FALSE;
+}
+
+BOOL freerdp_peer_reactor_add_event(rdpPeerReactor* reactor, freerdp_peer* client,
+		HANDLE event, psPeerReactorEventHandler handler, void* param)
+{
+	return FALSE;
+}
+
+void freerdp_peer_reactor_remove(rdpPeerReactor* reactor, freerdp_peer* client)
+{
+
+}
+
+BOOL freerdp_peer_reactor_submit(rdpPeerReactor* reactor, freerdp_peer* client,
+		psPeerReactorWorkHandler handler, void* param)
+{
+	return FALSE;
+}
+
+UINT32 freerdp_peer_reactor_submit_all(rdpPeerReactor* reactor,
+		psPeerReactorWorkHandler handler, void* param)
+{
+	return 0;
+}
+
+#endif
+
+void freerdp_peer_reactor_wait_for_work(rdpPeerReactor* reactor)
+{
+	if (!reactor || !reactor->pendingWork)
+		return;
+
+	WaitForSingleObject(CountdownEvent_WaitHandle(reactor->pendingWork), INFINITE);
+}
+
+UINT32 freerdp_peer_reactor_get_peer_count(rdpPeerReactor* reactor)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	UINT32 index;
+	UINT32 count = 0;
+
+	if (!reactor)
+		return 0;
+
+	for (index = 0; index < reactor->numWorkers; index++)
+		count += peer_reactor_worker_count(&reactor->workers[index]);
+
+	return count;
+#else
+	return 0;
+#endif
+}
+
+PTP_CALLBACK_ENVIRON freerdp_peer_reactor_get_callback_environment(rdpPeerReactor* reactor)
+{
+	if (!reactor)
+		return NULL;
+
+	return &reactor->ThreadPoolEnv;
+}
+
+rdpPeerReactor* freerdp_peer_reactor_new(UINT32 numWorkers, psPeerReactorPeerClosed PeerClosed, void* param)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	UINT32 index;
+	SYSTEM_INFO sysinfo;
+	struct epoll_event epev;
+	PEER_REACTOR_WORKER* worker;
+	rdpPeerReactor* reactor;
+
+	reactor = (rdpPeerReactor*) calloc(1, sizeof(rdpPeerReactor));
+
+	if (!reactor)
+		return NULL;
+
+	GetNativeSystemInfo(&sysinfo);
+
+	if (!numWorkers)
+		numWorkers = sysinfo.dwNumberOfProcessors;
+
+	reactor->numWorkers = numWorkers ? numWorkers : 1;
+	reactor->PeerClosed = PeerClosed;
+	reactor->param = param;
+
+	reactor->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	reactor->workers = (PEER_REACTOR_WORKER*) calloc(reactor->numWorkers, sizeof(PEER_REACTOR_WORKER));
+	reactor->ThreadPool = CreateThreadpool(NULL);
+	reactor->pendingWork = CountdownEvent_New(0);
+
+	if (!reactor->stopEvent || !reactor->workers || !reactor->ThreadPool || !reactor->pendingWork)
+		goto error;
+
+	InitializeThreadpoolEnvironment(&reactor->ThreadPoolEnv);
+	SetThreadpoolCallbackPool(&reactor->ThreadPoolEnv, reactor->ThreadPool);
+	SetThreadpoolThreadMaximum(reactor->ThreadPool, sysinfo.dwNumberOfProcessors);
+
+	for (index = 0; index < reactor->numWorkers; index++)
+	{
+		worker = &reactor->workers[index];
+
+		worker->epfd = -1;
+
+		if (!InitializeCriticalSectionAndSpinCount(&worker->lock, 4000))
+			goto error;
+
+		/* from here on the worker needs to be cleaned up */
+		worker->reactor = reactor;
+
+		worker->peers = HashTable_New(FALSE);
+
+		if (!worker->peers)
+			goto error;
+
+		worker->epfd = epoll_create(PEER_REACTOR_MAX_EVENTS);
+
+		if (worker->epfd < 0)
+			goto error;
+
+		ZeroMemory(&epev, sizeof(epev));
+		epev.events = EPOLLIN;
+		epev.data.ptr = NULL;
+
+		if (epoll_ctl(worker->epfd, EPOLL_CTL_ADD, GetEventFileDescriptor(reactor->stopEvent), &epev) < 0)
+			goto error;
+
+		worker->thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)
+				peer_reactor_worker_thread, (void*) worker, 0, NULL);
+
+		if (!worker->thread)
+			goto error;
+	}
+
+	return reactor;
+
+error:
+	WLog_ERR(TAG, "failed to create peer reactor");
+	freerdp_peer_reactor_free(reactor);
+	return NULL;
+#else
+	WLog_ERR(TAG, "peer reactor is not supported on this platform");
+	return NULL;
+#endif
+}
+
+void freerdp_peer_reactor_free(rdpPeerReactor* reactor)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	int key;
+	int index;
+	int count;
+	ULONG_PTR* keys = NULL;
+	PEER_REACTOR_PEER* peer;
+	PEER_REACTOR_WORKER* worker;
+
+	if (!reactor)
+		return;
+
+	if (reactor->stopEvent)
+		SetEvent(reactor->stopEvent);
+
+	if (reactor->workers)
+	{
+		for (index = 0; index < (int) reactor->numWorkers; index++)
+		{
+			worker = &reactor->workers[index];
+
+			if (worker->thread)
+			{
+				WaitForSingleObject(worker->thread, INFINITE);
+				CloseHandle(worker->thread);
+			}
+		}
+	}
+
+	/* work items may still report closed peers, let them finish first */
+
+	freerdp_peer_reactor_wait_for_work(reactor);
+
+	/* hand the remaining peers back to the server, the workers are gone now */
+
+	if (reactor->workers)
+	{
+		for (index = 0; index < (int) reactor->numWorkers; index++)
+		{
+			worker = &reactor->workers[index];
+
+			if (!worker->reactor)
+				continue;
+
+			if (worker->peers)
+			{
+				count = HashTable_GetKeys(worker->peers, &keys);
+
+				for (key = 0; key < count; key++)
+				{
+					peer = (PEER_REACTOR_PEER*) HashTable_GetItemValue(worker->peers, (void*) keys[key]);
+					peer_reactor_peer_close(peer);
+					IFCALL(reactor->PeerClosed, reactor, (freerdp_peer*) keys[key], reactor->param);
+				}
+
+				free(keys);
+				keys = NULL;
+
+				HashTable_Free(worker->peers);
+			}
+
+			if (worker->epfd >= 0)
+				close(worker->epfd);
+
+			DeleteCriticalSection(&worker->lock);
+		}
+
+		free(reactor->workers);
+	}
+
+	if (reactor->ThreadPool)
+		CloseThreadpool(reactor->ThreadPool);
+
+	if (reactor->pendingWork)
+		CountdownEvent_Free(reactor->pendingWork);
+
+	if (reactor->stopEvent)
+		CloseHandle(reactor->stopEvent);
+
+	free(reactor);
+#endif
+}
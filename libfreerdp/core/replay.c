@@ -0,0 +1,483 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Update Recording and Replay
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+
+#include <freerdp/log.h>
+#include <freerdp/utils/pcap.h>
+#include <freerdp/utils/stopwatch.h>
+
+#include "update.h"
+#include "fastpath.h"
+#include "replay.h"
+
+#define TAG FREERDP_TAG("core.replay")
+
+struct _REPLAY_RECORD
+{
+	BYTE* data;
+	UINT32 length;
+};
+typedef struct _REPLAY_RECORD REPLAY_RECORD;
+
+void replay_record_update(rdpUpdate* update, BYTE type, BYTE updateCode, const BYTE* data, UINT32 size)
+{
+	BYTE* record;
+
+	if (!update->dump_updates)
+		return;
+
+	record = (BYTE*) malloc(size + 2);
+
+	if (!record)
+		return;
+
+	record[0] = type;
+	record[1] = updateCode;
+
+	if (size > 0)
+		CopyMemory(&record[2], data, size);
+
+	pcap_add_record(update->pcap_updates, record, size + 2);
+	pcap_flush(update->pcap_updates);
+
+	free(record);
+}
+
+static void replay_records_free(REPLAY_RECORD* records, UINT32 count)
+{
+	UINT32 index;
+
+	for (index = 0; index < count; index++)
+		free(records[index].data);
+
+	free(records);
+}
+
+/**
+ * The whole recording is loaded up front so that file I/O does not end up
+ * in the measurements.
+ */
+
+static REPLAY_RECORD* replay_records_load(char* file, UINT32* pCount)
+{
+	rdpPcap* pcap;
+	pcap_record record;
+	UINT32 count = 0;
+	UINT32 capacity = 0;
+	REPLAY_RECORD* records = NULL;
+	REPLAY_RECORD* newRecords;
+
+	pcap = pcap_open(file, FALSE);
+
+	if (!pcap)
+		return NULL;
+
+	while (pcap_has_next_record(pcap))
+	{
+		if (count == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 1024;
+			newRecords = (REPLAY_RECORD*) realloc(records, sizeof(REPLAY_RECORD) * capacity);
+
+			if (!newRecords)
+				goto fail;
+
+			records = newRecords;
+		}
+
+		if (!pcap_get_next_record_header(pcap, &record))
+			break;
+
+		if (record.length < 2)
+		{
+			WLog_ERR(TAG, "invalid record length %d", record.length);
+			goto fail;
+		}
+
+		record.data = malloc(record.length);
+
+		if (!record.data)
+			goto fail;
+
+		pcap_get_next_record_content(pcap, &record);
+
+		records[count].data = (BYTE*) record.data;
+		records[count].length = record.length;
+		count++;
+	}
+
+	pcap_close(pcap);
+	*pCount = count;
+	return records;
+
+fail:
+	pcap_close(pcap);
+	replay_records_free(records, count);
+	return NULL;
+}
+
+/**
+ * While replaying, the update callbacks of the context are wrapped so the
+ * time spent in the handlers can be told apart from the time spent parsing.
+ */
+
+#define REPLAY_STAGE_CODEC	0
+#define REPLAY_STAGE_GDI	1
+
+struct rdp_replay_hooks
+{
+	int depth;
+	STOPWATCH stages[2];
+
+	pBeginPaint BeginPaint;
+	pEndPaint EndPaint;
+	pSetBounds SetBounds;
+	pBitmapUpdate BitmapUpdate;
+	pPalette Palette;
+	pSurfaceBits SurfaceBits;
+	pSurfaceFrameMarker SurfaceFrameMarker;
+
+	pPointerPosition PointerPosition;
+	pPointerSystem PointerSystem;
+	pPointerColor PointerColor;
+	pPointerNew PointerNew;
+	pPointerCached PointerCached;
+
+	pDstBlt DstBlt;
+	pPatBlt PatBlt;
+	pScrBlt ScrBlt;
+	pOpaqueRect OpaqueRect;
+	pDrawNineGrid DrawNineGrid;
+	pMultiDstBlt MultiDstBlt;
+	pMultiPatBlt MultiPatBlt;
+	pMultiScrBlt MultiScrBlt;
+	pMultiOpaqueRect MultiOpaqueRect;
+	pMultiDrawNineGrid MultiDrawNineGrid;
+	pLineTo LineTo;
+	pPolyline Polyline;
+	pMemBlt MemBlt;
+	pMem3Blt Mem3Blt;
+	pSaveBitmap SaveBitmap;
+	pGlyphIndex GlyphIndex;
+	pFastIndex FastIndex;
+	pFastGlyph FastGlyph;
+	pPolygonSC PolygonSC;
+	pPolygonCB PolygonCB;
+	pEllipseSC EllipseSC;
+	pEllipseCB EllipseCB;
+
+	pCacheBitmap CacheBitmap;
+	pCacheBitmapV2 CacheBitmapV2;
+	pCacheBitmapV3 CacheBitmapV3;
+	pCacheColorTable CacheColorTable;
+	pCacheGlyph CacheGlyph;
+	pCacheGlyphV2 CacheGlyphV2;
+	pCacheBrush CacheBrush;
+};
+typedef struct rdp_replay_hooks REPLAY_HOOKS;
+
+/* only the outermost handler is timed, in case a handler calls another one */
+
+static void replay_hook_enter(REPLAY_HOOKS* hooks, int stage)
+{
+	if (hooks->depth++ == 0)
+		stopwatch_start(&hooks->stages[stage]);
+}
+
+static void replay_hook_leave(REPLAY_HOOKS* hooks, int stage)
+{
+	if (--hooks->depth == 0)
+		stopwatch_stop(&hooks->stages[stage]);
+}
+
+static UINT64 replay_hook_elapsed(REPLAY_HOOKS* hooks)
+{
+	return hooks->stages[REPLAY_STAGE_CODEC].elapsed + hooks->stages[REPLAY_STAGE_GDI].elapsed;
+}
+
+#define REPLAY_HOOK(_stage, _callback, _type) \
+static void replay_hook_##_callback(rdpContext* context, _type* arg) \
+{ \
+	REPLAY_HOOKS* hooks = context->update->replay; \
+	replay_hook_enter(hooks, _stage); \
+	hooks->_callback(context, arg); \
+	replay_hook_leave(hooks, _stage); \
+}
+
+static void replay_hook_BeginPaint(rdpContext* context)
+{
+	REPLAY_HOOKS* hooks = context->update->replay;
+	replay_hook_enter(hooks, REPLAY_STAGE_GDI);
+	hooks->BeginPaint(context);
+	replay_hook_leave(hooks, REPLAY_STAGE_GDI);
+}
+
+static void replay_hook_EndPaint(rdpContext* context)
+{
+	REPLAY_HOOKS* hooks = context->update->replay;
+	replay_hook_enter(hooks, REPLAY_STAGE_GDI);
+	hooks->EndPaint(context);
+	replay_hook_leave(hooks, REPLAY_STAGE_GDI);
+}
+
+REPLAY_HOOK(REPLAY_STAGE_GDI, SetBounds, rdpBounds)
+REPLAY_HOOK(REPLAY_STAGE_CODEC, BitmapUpdate, BITMAP_UPDATE)
+REPLAY_HOOK(REPLAY_STAGE_GDI, Palette, PALETTE_UPDATE)
+REPLAY_HOOK(REPLAY_STAGE_CODEC, SurfaceBits, SURFACE_BITS_COMMAND)
+REPLAY_HOOK(REPLAY_STAGE_GDI, SurfaceFrameMarker, SURFACE_FRAME_MARKER)
+
+REPLAY_HOOK(REPLAY_STAGE_GDI, PointerPosition, POINTER_POSITION_UPDATE)
+REPLAY_HOOK(REPLAY_STAGE_GDI, PointerSystem, POINTER_SYSTEM_UPDATE)
+REPLAY_HOOK(REPLAY_STAGE_GDI, PointerColor, POINTER_COLOR_UPDATE)
+REPLAY_HOOK(REPLAY_STAGE_GDI, PointerNew, POINTER_NEW_UPDATE)
+REPLAY_HOOK(REPLAY_STAGE_GDI, PointerCached, POINTER_CACHED_UPDATE)
+
+REPLAY_HOOK(REPLAY_STAGE_GDI, DstBlt, DSTBLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, PatBlt, PATBLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, ScrBlt, SCRBLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, OpaqueRect, OPAQUE_RECT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, DrawNineGrid, DRAW_NINE_GRID_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, MultiDstBlt, MULTI_DSTBLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, MultiPatBlt, MULTI_PATBLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, MultiScrBlt, MULTI_SCRBLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, MultiOpaqueRect, MULTI_OPAQUE_RECT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, MultiDrawNineGrid, MULTI_DRAW_NINE_GRID_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, LineTo, LINE_TO_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, Polyline, POLYLINE_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, MemBlt, MEMBLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, Mem3Blt, MEM3BLT_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, SaveBitmap, SAVE_BITMAP_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, GlyphIndex, GLYPH_INDEX_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, FastIndex, FAST_INDEX_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, FastGlyph, FAST_GLYPH_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, PolygonSC, POLYGON_SC_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, PolygonCB, POLYGON_CB_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, EllipseSC, ELLIPSE_SC_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, EllipseCB, ELLIPSE_CB_ORDER)
+
+REPLAY_HOOK(REPLAY_STAGE_CODEC, CacheBitmap, CACHE_BITMAP_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_CODEC, CacheBitmapV2, CACHE_BITMAP_V2_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_CODEC, CacheBitmapV3, CACHE_BITMAP_V3_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, CacheColorTable, CACHE_COLOR_TABLE_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, CacheGlyph, CACHE_GLYPH_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, CacheGlyphV2, CACHE_GLYPH_V2_ORDER)
+REPLAY_HOOK(REPLAY_STAGE_GDI, CacheBrush, CACHE_BRUSH_ORDER)
+
+#define REPLAY_HOOK_INSTALL(_hooks, _iface, _callback) \
+	if (((_hooks)->_callback = (_iface)->_callback) != NULL) \
+		(_iface)->_callback = replay_hook_##_callback
+
+#define REPLAY_HOOK_REMOVE(_hooks, _iface, _callback) \
+	if ((_hooks)->_callback) \
+		(_iface)->_callback = (_hooks)->_callback
+
+#define REPLAY_HOOK_ALL(_action, _hooks, _update) \
+	do { \
+		_action(_hooks, _update, BeginPaint); \
+		_action(_hooks, _update, EndPaint); \
+		_action(_hooks, _update, SetBounds); \
+		_action(_hooks, _update, BitmapUpdate); \
+		_action(_hooks, _update, Palette); \
+		_action(_hooks, _update, SurfaceBits); \
+		_action(_hooks, _update, SurfaceFrameMarker); \
+		_action(_hooks, (_update)->pointer, PointerPosition); \
+		_action(_hooks, (_update)->pointer, PointerSystem); \
+		_action(_hooks, (_update)->pointer, PointerColor); \
+		_action(_hooks, (_update)->pointer, PointerNew); \
+		_action(_hooks, (_update)->pointer, PointerCached); \
+		_action(_hooks, (_update)->primary, DstBlt); \
+		_action(_hooks, (_update)->primary, PatBlt); \
+		_action(_hooks, (_update)->primary, ScrBlt); \
+		_action(_hooks, (_update)->primary, OpaqueRect); \
+		_action(_hooks, (_update)->primary, DrawNineGrid); \
+		_action(_hooks, (_update)->primary, MultiDstBlt); \
+		_action(_hooks, (_update)->primary, MultiPatBlt); \
+		_action(_hooks, (_update)->primary, MultiScrBlt); \
+		_action(_hooks, (_update)->primary, MultiOpaqueRect); \
+		_action(_hooks, (_update)->primary, MultiDrawNineGrid); \
+		_action(_hooks, (_update)->primary, LineTo); \
+		_action(_hooks, (_update)->primary, Polyline); \
+		_action(_hooks, (_update)->primary, MemBlt); \
+		_action(_hooks, (_update)->primary, Mem3Blt); \
+		_action(_hooks, (_update)->primary, SaveBitmap); \
+		_action(_hooks, (_update)->primary, GlyphIndex); \
+		_action(_hooks, (_update)->primary, FastIndex); \
+		_action(_hooks, (_update)->primary, FastGlyph); \
+		_action(_hooks, (_update)->primary, PolygonSC); \
+		_action(_hooks, (_update)->primary, PolygonCB); \
+		_action(_hooks, (_update)->primary, EllipseSC); \
+		_action(_hooks, (_update)->primary, EllipseCB); \
+		_action(_hooks, (_update)->secondary, CacheBitmap); \
+		_action(_hooks, (_update)->secondary, CacheBitmapV2); \
+		_action(_hooks, (_update)->secondary, CacheBitmapV3); \
+		_action(_hooks, (_update)->secondary, CacheColorTable); \
+		_action(_hooks, (_update)->secondary, CacheGlyph); \
+		_action(_hooks, (_update)->secondary, CacheGlyphV2); \
+		_action(_hooks, (_update)->secondary, CacheBrush); \
+	} while (0)
+
+/**
+ * Replays a recording made with the DumpUpdates setting through the update
+ * callbacks of the context. Update handlers and the codecs behind them are
+ * deterministic, replaying the same recording into a fresh context always
+ * produces the same output.
+ */
+
+int freerdp_replay_updates(rdpContext* context, char* file, rdpReplayStats* stats)
+{
+	int status = 0;
+	BYTE type;
+	BYTE updateCode;
+	UINT32 index;
+	UINT32 count = 0;
+	UINT32 length;
+	BOOL painting = FALSE;
+	wStream* s;
+	UINT64 hooked;
+	STOPWATCH stage;
+	STOPWATCH parse;
+	STOPWATCH total;
+	REPLAY_HOOKS hooks;
+	REPLAY_RECORD* records;
+	rdpRdp* rdp = context->rdp;
+	rdpUpdate* update = context->update;
+
+	ZeroMemory(stats, sizeof(rdpReplayStats));
+
+	records = replay_records_load(file, &count);
+
+	if (!records)
+		return -1;
+
+	ZeroMemory(&hooks, sizeof(REPLAY_HOOKS));
+	REPLAY_HOOK_ALL(REPLAY_HOOK_INSTALL, &hooks, update);
+	update->replay = &hooks;
+
+	stopwatch_reset(&parse);
+	stopwatch_reset(&total);
+	stopwatch_start(&total);
+
+	for (index = 0; (index < count) && (status >= 0); index++)
+	{
+		type = records[index].data[0];
+		updateCode = records[index].data[1] & 0x0F;
+		length = records[index].length - 2;
+
+		s = Stream_New(&records[index].data[2], length);
+
+		if (!s)
+		{
+			status = -1;
+			break;
+		}
+
+		hooked = replay_hook_elapsed(&hooks);
+		stopwatch_reset(&stage);
+		stopwatch_start(&stage);
+
+		switch (type)
+		{
+			case REPLAY_RECORD_FASTPATH_UPDATE:
+				if (!painting)
+				{
+					IFCALL(update->BeginPaint, context);
+					painting = TRUE;
+				}
+
+				status = fastpath_recv_update(rdp->fastpath, updateCode, length, s);
+				break;
+
+			case REPLAY_RECORD_SLOWPATH_UPDATE:
+				/* slow-path update types match the fast-path update codes */
+				updateCode = (length > 0) ? (records[index].data[2] & 0x0F) : 0;
+				status = update_recv(update, s) ? 0 : -1;
+				stats->PaintCount++;
+				break;
+
+			case REPLAY_RECORD_SLOWPATH_POINTER:
+				updateCode = FASTPATH_UPDATETYPE_POINTER;
+				status = update_recv_pointer(update, s) ? 0 : -1;
+				break;
+
+			case REPLAY_RECORD_END_PAINT:
+				if (painting)
+				{
+					IFCALL(update->EndPaint, context);
+					painting = FALSE;
+					stats->PaintCount++;
+				}
+				break;
+
+			default:
+				WLog_ERR(TAG, "unknown record type 0x%02X", type);
+				status = -1;
+				break;
+		}
+
+		stopwatch_stop(&stage);
+		Stream_Free(s, FALSE);
+
+		/* whatever the handlers did not take was spent parsing */
+		parse.elapsed += stage.elapsed - (replay_hook_elapsed(&hooks) - hooked);
+
+		stats->RecordCount++;
+		stats->RecordBytes += length;
+
+		if (type == REPLAY_RECORD_END_PAINT)
+		{
+			stats->EndPaintTime += stopwatch_get_elapsed_time_in_seconds(&stage);
+		}
+		else
+		{
+			stats->UpdateCount[updateCode]++;
+			stats->UpdateBytes[updateCode] += length;
+			stats->UpdateTime[updateCode] += stopwatch_get_elapsed_time_in_seconds(&stage);
+		}
+	}
+
+	if (painting)
+	{
+		IFCALL(update->EndPaint, context);
+		stats->PaintCount++;
+	}
+
+	stopwatch_stop(&total);
+
+	update->replay = NULL;
+	REPLAY_HOOK_ALL(REPLAY_HOOK_REMOVE, &hooks, update);
+
+	stats->TotalTime = stopwatch_get_elapsed_time_in_seconds(&total);
+	stats->ParseTime = stopwatch_get_elapsed_time_in_seconds(&parse);
+	stats->CodecTime = stopwatch_get_elapsed_time_in_seconds(&hooks.stages[REPLAY_STAGE_CODEC]);
+	stats->GdiTime = stopwatch_get_elapsed_time_in_seconds(&hooks.stages[REPLAY_STAGE_GDI]);
+
+	if (stats->TotalTime > 0)
+		stats->FramesPerSecond = stats->PaintCount / stats->TotalTime;
+
+	if (status < 0)
+		WLog_ERR(TAG, "replay failed at record %d of %d", index, count);
+
+	replay_records_free(records, count);
+
+	return (status < 0) ? -1 : 0;
+}
@@ -0,0 +1,28 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Update Recording and Replay
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CORE_REPLAY_H
+#define FREERDP_CORE_REPLAY_H
+
+#include "rdp.h"
+
+#include <freerdp/replay.h>
+#include <freerdp/update.h>
+
+void replay_record_update(rdpUpdate* update, BYTE type, BYTE updateCode, const BYTE* data, UINT32 size);
+
+#endif /* FREERDP_CORE_REPLAY_H */
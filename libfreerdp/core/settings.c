@@ -35,6 +35,7 @@
 #include <winpr/registry.h>
 
 #include <freerdp/settings.h>
+#include <freerdp/codec/bulk.h>
 
 #ifdef _WIN32
 #pragma warning(push)
@@ -260,6 +261,8 @@ rdpSettings* freerdp_settings_new(DWORD flags)
 		else
 			settings->CompressionLevel = PACKET_COMPR_TYPE_RDP61;
 
+		settings->CompressionEffort = BULK_COMPRESSION_EFFORT_DEFAULT;
+
 		settings->Authentication = TRUE;
 		settings->AuthenticationOnly = FALSE;
 		settings->CredentialsFromStdin = FALSE;
@@ -500,6 +503,7 @@ rdpSettings* freerdp_settings_clone(rdpSettings* settings)
 		_settings->CurrentPath = _strdup(settings->CurrentPath); /* 1794 */
 		_settings->DumpRemoteFxFile = _strdup(settings->DumpRemoteFxFile); /* 1858 */
 		_settings->PlayRemoteFxFile = _strdup(settings->PlayRemoteFxFile); /* 1859 */
+		_settings->DumpUpdatesFile = _strdup(settings->DumpUpdatesFile); /* 1861 */
 		_settings->GatewayHostname = _strdup(settings->GatewayHostname); /* 1986 */
 		_settings->GatewayUsername = _strdup(settings->GatewayUsername); /* 1987 */
 		_settings->GatewayPassword = _strdup(settings->GatewayPassword); /* 1988 */
@@ -510,7 +514,9 @@ rdpSettings* freerdp_settings_clone(rdpSettings* settings)
 		_settings->RemoteApplicationFile = _strdup(settings->RemoteApplicationFile); /* 2116 */
 		_settings->RemoteApplicationGuid = _strdup(settings->RemoteApplicationGuid); /* 2117 */
 		_settings->RemoteApplicationCmdLine = _strdup(settings->RemoteApplicationCmdLine); /* 2118 */
+		_settings->BitmapCachePersistFile = _strdup(settings->BitmapCachePersistFile); /* 2503 */
 		_settings->ImeFileName = _strdup(settings->ImeFileName); /* 2628 */
+		_settings->GfxCachePersistFile = _strdup(settings->GfxCachePersistFile); /* 3845 */
 		_settings->DrivesToRedirect = _strdup(settings->DrivesToRedirect); /* 4290 */
 
 		/**
@@ -669,12 +675,15 @@ void freerdp_settings_free(rdpSettings* settings)
 		free(settings->ServerAutoReconnectCookie);
 		free(settings->ClientTimeZone);
 		free(settings->BitmapCacheV2CellInfo);
+		free(settings->BitmapCachePersistFile);
+		free(settings->GfxCachePersistFile);
 		free(settings->GlyphCache);
 		free(settings->FragCache);
 		key_free(settings->RdpServerRsaKey);
 		free(settings->ConfigPath);
 		free(settings->CurrentPath);
 		free(settings->HomePath);
+		free(settings->DumpUpdatesFile);
 		free(settings->LoadBalanceInfo);
 		free(settings->TargetNetAddress);
 		free(settings->RedirectionTargetFQDN);
@@ -0,0 +1,191 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/settings.h>
+#include <freerdp/metrics.h>
+
+#include "../bulk.h"
+
+#define TEST_PDU_SIZE		2048
+#define TEST_UPDATE_CODE	FASTPATH_UPDATETYPE_SURFCMDS
+
+static BYTE g_Incompressible[TEST_PDU_SIZE];
+static BYTE g_Compressible[TEST_PDU_SIZE];
+
+static void test_fill_pdus(void)
+{
+	int i;
+	UINT32 seed = 0x2545F491;
+	static const char text[] = "RemoteFX surface bits compress badly, orders compress well. ";
+
+	for (i = 0; i < TEST_PDU_SIZE; i++)
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		g_Incompressible[i] = (BYTE) (seed >> 7);
+		g_Compressible[i] = (BYTE) text[i % (sizeof(text) - 1)];
+	}
+}
+
+static int test_send(rdpBulk* bulk, BYTE updateCode, BYTE* pdu, BOOL* bypassed)
+{
+	int status;
+	UINT64 bypassedBytes;
+	BYTE* pDstData = NULL;
+	UINT32 DstSize = 0;
+	UINT32 flags = 0;
+	rdpMetrics* metrics = bulk->context->metrics;
+
+	bypassedBytes = metrics->UpdateBypassedBytes[updateCode];
+	status = bulk_compress_update(bulk, updateCode, pdu, TEST_PDU_SIZE, &pDstData, &DstSize, &flags);
+
+	if (status < 0)
+		return -1;
+
+	*bypassed = (metrics->UpdateBypassedBytes[updateCode] != bypassedBytes) ? TRUE : FALSE;
+
+	/* a bypassed PDU goes out as is, without touching the compressor history */
+
+	if (*bypassed && ((pDstData != pdu) || (DstSize != TEST_PDU_SIZE) || flags))
+		return -1;
+
+	/* compressible data must actually come out compressed when not bypassed */
+
+	if (!*bypassed && (pdu == g_Compressible) && !(flags & PACKET_COMPRESSED))
+		return -1;
+
+	return 1;
+}
+
+static BOOL test_send_many(rdpBulk* bulk, BYTE* pdu, int count, BOOL bypass, const char* step)
+{
+	int i;
+	BOOL bypassed;
+
+	for (i = 0; i < count; i++)
+	{
+		if (test_send(bulk, TEST_UPDATE_CODE, pdu, &bypassed) < 0)
+			return FALSE;
+
+		if (bypassed != bypass)
+		{
+			printf("%s: pdu %d was %s\n", step, i, bypassed ? "bypassed" : "compressed");
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL test_check_metrics(rdpMetrics* metrics, UINT32 samples, UINT64 bypassedBytes, const char* step)
+{
+	if ((metrics->UpdateSampleCount[TEST_UPDATE_CODE] != samples) ||
+			(metrics->UpdateBypassedBytes[TEST_UPDATE_CODE] != bypassedBytes) ||
+			(metrics->UpdateUncompressedBytes[TEST_UPDATE_CODE] != (UINT64) samples * TEST_PDU_SIZE))
+	{
+		printf("%s: %u samples, %u bypassed bytes, expected %u and %u\n", step,
+				metrics->UpdateSampleCount[TEST_UPDATE_CODE],
+				(UINT32) metrics->UpdateBypassedBytes[TEST_UPDATE_CODE],
+				samples, (UINT32) bypassedBytes);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+int TestBulkUpdateBypass(int argc, char* argv[])
+{
+	int rc = -1;
+	BOOL bypassed;
+	UINT64 bypassedBytes;
+	rdpBulk* bulk = NULL;
+	rdpContext context;
+
+	test_fill_pdus();
+
+	ZeroMemory(&context, sizeof(rdpContext));
+	context.settings = freerdp_settings_new(0);
+	context.metrics = metrics_new(&context);
+
+	if (!context.settings || !context.metrics)
+		goto fail;
+
+	context.settings->CompressionLevel = PACKET_COMPR_TYPE_64K;
+
+	bulk = bulk_new(&context);
+
+	if (!bulk)
+		goto fail;
+
+	/* incompressible PDUs are compressed until enough samples are collected */
+
+	if (!test_send_many(bulk, g_Incompressible, BULK_BYPASS_MIN_SAMPLES, FALSE, "sampling"))
+		goto fail;
+
+	if (!test_check_metrics(context.metrics, BULK_BYPASS_MIN_SAMPLES, 0, "sampling"))
+		goto fail;
+
+	if (context.metrics->UpdateCompressionRatio[TEST_UPDATE_CODE] < BULK_BYPASS_COMPRESSION_RATIO)
+		goto fail;
+
+	/* then bypassed for the minimum interval, without adding samples */
+
+	if (!test_send_many(bulk, g_Incompressible, BULK_BYPASS_MIN_INTERVAL, TRUE, "first bypass"))
+		goto fail;
+
+	bypassedBytes = BULK_BYPASS_MIN_INTERVAL * TEST_PDU_SIZE;
+
+	if (!test_check_metrics(context.metrics, BULK_BYPASS_MIN_SAMPLES, bypassedBytes, "first bypass"))
+		goto fail;
+
+	/* other update types are not affected */
+
+	if ((test_send(bulk, FASTPATH_UPDATETYPE_ORDERS, g_Compressible, &bypassed) < 0) || bypassed)
+		goto fail;
+
+	if (context.metrics->UpdateSampleCount[FASTPATH_UPDATETYPE_ORDERS] != 1)
+		goto fail;
+
+	/* a failed probe doubles the interval */
+
+	if (!test_send_many(bulk, g_Incompressible, 1, FALSE, "first probe"))
+		goto fail;
+
+	if (!test_send_many(bulk, g_Compressible, BULK_BYPASS_MIN_INTERVAL * 2, TRUE, "second bypass"))
+		goto fail;
+
+	bypassedBytes += BULK_BYPASS_MIN_INTERVAL * 2 * TEST_PDU_SIZE;
+
+	if (!test_check_metrics(context.metrics, BULK_BYPASS_MIN_SAMPLES + 1, bypassedBytes, "second bypass"))
+		goto fail;
+
+	/* a successful probe restarts the average from the probed PDU */
+
+	if (!test_send_many(bulk, g_Compressible, 1, FALSE, "second probe"))
+		goto fail;
+
+	if (context.metrics->UpdateCompressionRatio[TEST_UPDATE_CODE] >= 0.5)
+	{
+		printf("compression ratio %f was not restarted by the probe\n",
+				context.metrics->UpdateCompressionRatio[TEST_UPDATE_CODE]);
+		goto fail;
+	}
+
+	if (!test_send_many(bulk, g_Compressible, BULK_BYPASS_MAX_INTERVAL, FALSE, "compressible"))
+		goto fail;
+
+	if (!test_check_metrics(context.metrics, BULK_BYPASS_MIN_SAMPLES + 2 + BULK_BYPASS_MAX_INTERVAL, bypassedBytes, "compressible"))
+		goto fail;
+
+	rc = 0;
+
+fail:
+	bulk_free(bulk);
+	metrics_free(context.metrics);
+	freerdp_settings_free(context.settings);
+	return rc;
+}
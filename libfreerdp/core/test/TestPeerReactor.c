@@ -0,0 +1,268 @@
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/reactor.h>
+
+#define TEST_PEER_COUNT		32
+
+struct test_peer
+{
+	freerdp_peer client;
+	int pipe[2];
+	HANDLE event;
+	LONG running;
+	LONG reads;
+	LONG works;
+	LONG shared;
+	BOOL overlap;
+};
+typedef struct test_peer TEST_PEER;
+
+static TEST_PEER g_Peers[TEST_PEER_COUNT];
+static volatile LONG g_Closed;
+
+static TEST_PEER* test_peer_get(freerdp_peer* client)
+{
+	return (TEST_PEER*) client;
+}
+
+/* callbacks and work items of a peer must never overlap */
+
+static void test_peer_enter(TEST_PEER* peer)
+{
+	if (InterlockedIncrement(&peer->running) != 1)
+		peer->overlap = TRUE;
+}
+
+static void test_peer_leave(TEST_PEER* peer)
+{
+	InterlockedDecrement(&peer->running);
+}
+
+static HANDLE test_get_event_handle(freerdp_peer* client)
+{
+	return test_peer_get(client)->event;
+}
+
+static BOOL test_check_file_descriptor(freerdp_peer* client)
+{
+	int status;
+	char buffer[64];
+	TEST_PEER* peer = test_peer_get(client);
+
+	test_peer_enter(peer);
+	status = read(peer->pipe[0], buffer, sizeof(buffer));
+	test_peer_leave(peer);
+
+	if (status <= 0)
+		return FALSE;
+
+	InterlockedExchangeAdd(&peer->reads, status);
+
+	/* 'q' asks the reactor to drop the peer */
+
+	return (buffer[status - 1] != 'q') ? TRUE : FALSE;
+}
+
+static BOOL test_shared_event(freerdp_peer* client, HANDLE event, void* param)
+{
+	InterlockedExchange(&test_peer_get(client)->shared, 1);
+	return TRUE;
+}
+
+static BOOL test_work(freerdp_peer* client, void* param)
+{
+	TEST_PEER* peer;
+
+	if (!client)
+		return TRUE;
+
+	peer = test_peer_get(client);
+
+	test_peer_enter(peer);
+	Sleep(20);
+	InterlockedIncrement(&peer->works);
+	test_peer_leave(peer);
+
+	return param ? FALSE : TRUE;
+}
+
+static void test_peer_closed(rdpPeerReactor* reactor, freerdp_peer* client, void* param)
+{
+	InterlockedIncrement(&g_Closed);
+}
+
+static BOOL test_wait_for(volatile LONG* value, LONG expected)
+{
+	int retry;
+
+	for (retry = 0; retry < 200; retry++)
+	{
+		if (InterlockedCompareExchange(value, 0, 0) == expected)
+			return TRUE;
+
+		Sleep(10);
+	}
+
+	printf("expected %d, got %d\n", (int) expected, (int) *value);
+	return FALSE;
+}
+
+int TestPeerReactor(int argc, char* argv[])
+{
+	int index;
+	int rc = -1;
+	HANDLE shared;
+	TEST_PEER* peer;
+	rdpPeerReactor* reactor;
+
+	ZeroMemory(g_Peers, sizeof(g_Peers));
+
+	reactor = freerdp_peer_reactor_new(2, test_peer_closed, NULL);
+	shared = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!reactor || !shared)
+		goto fail;
+
+	for (index = 0; index < TEST_PEER_COUNT; index++)
+	{
+		peer = &g_Peers[index];
+
+		if (pipe(peer->pipe) < 0)
+			goto fail;
+
+		peer->event = CreateFileDescriptorEvent(NULL, FALSE, FALSE, peer->pipe[0]);
+		peer->client.context = (rdpContext*) peer;
+		peer->client.GetEventHandle = test_get_event_handle;
+		peer->client.CheckFileDescriptor = test_check_file_descriptor;
+
+		if (!peer->event || !freerdp_peer_reactor_add(reactor, &peer->client))
+			goto fail;
+
+		/* peers 0 and 2 share the first worker and watch the same event */
+
+		if (((index == 0) || (index == 2)) && !freerdp_peer_reactor_add_event(reactor, &peer->client, shared, test_shared_event, NULL))
+			goto fail;
+	}
+
+	if (freerdp_peer_reactor_add(reactor, &g_Peers[0].client))
+		goto fail;
+
+	if (freerdp_peer_reactor_get_peer_count(reactor) != TEST_PEER_COUNT)
+		goto fail;
+
+	SetEvent(shared);
+
+	if (!test_wait_for(&g_Peers[0].shared, 1) || !test_wait_for(&g_Peers[2].shared, 1))
+		goto fail;
+
+	ResetEvent(shared);
+
+	/* input keeps arriving while work items run for every peer */
+
+	if (freerdp_peer_reactor_submit_all(reactor, test_work, NULL) != TEST_PEER_COUNT)
+		goto fail;
+
+	if (freerdp_peer_reactor_submit(reactor, &g_Peers[0].client, test_work, NULL))
+	{
+		printf("a second work item was accepted for a busy peer\n");
+		goto fail;
+	}
+
+	for (index = 0; index < TEST_PEER_COUNT; index++)
+	{
+		if (write(g_Peers[index].pipe[1], "abcd", 4) != 4)
+			goto fail;
+	}
+
+	freerdp_peer_reactor_wait_for_work(reactor);
+
+	for (index = 0; index < TEST_PEER_COUNT; index++)
+	{
+		peer = &g_Peers[index];
+
+		if ((peer->works != 1) || !test_wait_for(&peer->reads, 4))
+			goto fail;
+	}
+
+	/* a callback or a work item failing closes the peer */
+
+	if (write(g_Peers[0].pipe[1], "q", 1) != 1)
+		goto fail;
+
+	if (!freerdp_peer_reactor_submit(reactor, &g_Peers[1].client, test_work, (void*) reactor))
+		goto fail;
+
+	freerdp_peer_reactor_wait_for_work(reactor);
+
+	if (!test_wait_for(&g_Closed, 2))
+		goto fail;
+
+	if (freerdp_peer_reactor_submit(reactor, &g_Peers[1].client, test_work, NULL))
+		goto fail;
+
+	/* removed peers are not reported, and work queued for them sees no client */
+
+	if (!freerdp_peer_reactor_submit(reactor, &g_Peers[2].client, test_work, NULL))
+		goto fail;
+
+	freerdp_peer_reactor_remove(reactor, &g_Peers[2].client);
+	freerdp_peer_reactor_remove(reactor, &g_Peers[3].client);
+	freerdp_peer_reactor_wait_for_work(reactor);
+
+	if (write(g_Peers[3].pipe[1], "q", 1) != 1)
+		goto fail;
+
+	Sleep(50);
+
+	if ((g_Closed != 2) || (freerdp_peer_reactor_get_peer_count(reactor) != TEST_PEER_COUNT - 4))
+	{
+		printf("unexpected peers after removal\n");
+		goto fail;
+	}
+
+	for (index = 0; index < TEST_PEER_COUNT; index++)
+	{
+		if (g_Peers[index].overlap)
+		{
+			printf("callbacks of peer %d overlapped\n", index);
+			goto fail;
+		}
+	}
+
+	/* the remaining peers are handed back when the reactor is freed */
+
+	freerdp_peer_reactor_free(reactor);
+	reactor = NULL;
+
+	if (g_Closed != TEST_PEER_COUNT - 2)
+		goto fail;
+
+	rc = 0;
+
+fail:
+	freerdp_peer_reactor_free(reactor);
+
+	for (index = 0; index < TEST_PEER_COUNT; index++)
+	{
+		peer = &g_Peers[index];
+
+		if (peer->event)
+		{
+			CloseHandle(peer->event);
+			close(peer->pipe[0]);
+			close(peer->pipe[1]);
+		}
+	}
+
+	if (shared)
+		CloseHandle(shared);
+
+	return rc;
+}
@@ -527,10 +527,14 @@ BOOL transport_accept_tls(rdpTransport* transport)
 	if (!transport->TlsIn)
 		transport->TlsIn = tls_new(transport->settings);
 
+	if (!transport->TlsIn)
+		return FALSE;
+
 	if (!transport->TlsOut)
 		transport->TlsOut = transport->TlsIn;
 
 	transport->layer = TRANSPORT_LAYER_TLS;
+	transport->TlsIn->serverContext = transport->TlsServerContext;
 
 	if (!tls_accept(transport->TlsIn, transport->TcpIn->bufferedBio, transport->settings->CertificateFile, transport->settings->PrivateKeyFile))
 		return FALSE;
@@ -549,10 +553,14 @@ BOOL transport_accept_nla(rdpTransport* transport)
 	if (!transport->TlsIn)
 		transport->TlsIn = tls_new(transport->settings);
 
+	if (!transport->TlsIn)
+		return FALSE;
+
 	if (!transport->TlsOut)
 		transport->TlsOut = transport->TlsIn;
 
 	transport->layer = TRANSPORT_LAYER_TLS;
+	transport->TlsIn->serverContext = transport->TlsServerContext;
 
 	if (!tls_accept(transport->TlsIn, transport->TcpIn->bufferedBio, settings->CertificateFile, settings->PrivateKeyFile))
 		return FALSE;
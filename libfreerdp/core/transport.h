@@ -62,6 +62,7 @@ struct rdp_transport
 	rdpTls* TlsIn;
 	rdpTls* TlsOut;
 	rdpTls* TsgTls;
+	rdpTlsServerContext* TlsServerContext;
 	rdpContext* context;
 	rdpCredssp* credssp;
 	rdpSettings* settings;
@@ -26,6 +26,8 @@
 #include <winpr/crt.h>
 #include <winpr/sspi.h>
 #include <winpr/ssl.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
 
 #include <winpr/stream.h>
 #include <freerdp/utils/ringbuffer.h>
@@ -46,6 +48,20 @@ struct _BIO_RDP_TLS
 };
 typedef struct _BIO_RDP_TLS BIO_RDP_TLS;
 
+#define TLS_SERVER_SESSION_CACHE_SIZE		1024
+#define TLS_SERVER_SESSION_TIMEOUT		(60 * 60)
+
+struct rdp_tls_server_context
+{
+	LONG refCount;
+	CRITICAL_SECTION lock;
+
+	SSL_CTX* ctx;
+	char* CertificateFile;
+	char* PrivateKeyFile;
+	char* PermittedTLSCiphers;
+};
+
 long bio_rdp_tls_callback(BIO* bio, int mode, const char* argp, int argi, long argl, long ret)
 {
 	return 1;
@@ -576,30 +592,64 @@ out_free:
 
 
 #if defined(__APPLE__)
-BOOL tls_prepare(rdpTls* tls, BIO *underlying, SSL_METHOD *method, int options, BOOL clientMode)
+static SSL_CTX* tls_context_new(rdpSettings* settings, SSL_METHOD* method, long options)
 #else
-BOOL tls_prepare(rdpTls* tls, BIO *underlying, const SSL_METHOD *method, int options, BOOL clientMode)
+static SSL_CTX* tls_context_new(rdpSettings* settings, const SSL_METHOD* method, long options)
 #endif
 {
-	tls->ctx = SSL_CTX_new(method);
-	if (!tls->ctx)
+	SSL_CTX* ctx;
+
+	ctx = SSL_CTX_new(method);
+
+	if (!ctx)
 	{
 		WLog_ERR(TAG,  "SSL_CTX_new failed");
-		return FALSE;
+		return NULL;
 	}
 
-	SSL_CTX_set_mode(tls->ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_ENABLE_PARTIAL_WRITE);
+	SSL_CTX_set_mode(ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_ENABLE_PARTIAL_WRITE);
 
-	SSL_CTX_set_options(tls->ctx, options);
-	SSL_CTX_set_read_ahead(tls->ctx, 1);
+	SSL_CTX_set_options(ctx, options);
+	SSL_CTX_set_read_ahead(ctx, 1);
 
-	if (tls->settings->PermittedTLSCiphers) {
-		if(!SSL_CTX_set_cipher_list(tls->ctx, tls->settings->PermittedTLSCiphers)) {
-			WLog_ERR(TAG,  "SSL_CTX_set_cipher_list %s failed", tls->settings->PermittedTLSCiphers);
-			return FALSE;
+	if (settings->PermittedTLSCiphers)
+	{
+		if (!SSL_CTX_set_cipher_list(ctx, settings->PermittedTLSCiphers))
+		{
+			WLog_ERR(TAG,  "SSL_CTX_set_cipher_list %s failed", settings->PermittedTLSCiphers);
+			SSL_CTX_free(ctx);
+			return NULL;
 		}
 	}
- 
+
+	return ctx;
+}
+
+static void tls_context_ref(SSL_CTX* ctx)
+{
+#if (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+	SSL_CTX_up_ref(ctx);
+#else
+	CRYPTO_add(&ctx->references, 1, CRYPTO_LOCK_SSL_CTX);
+#endif
+}
+
+#if defined(__APPLE__)
+BOOL tls_prepare(rdpTls* tls, BIO *underlying, SSL_METHOD *method, int options, BOOL clientMode)
+#else
+BOOL tls_prepare(rdpTls* tls, BIO *underlying, const SSL_METHOD *method, int options, BOOL clientMode)
+#endif
+{
+	/* a server sharing its listener context arrives here with tls->ctx already set */
+
+	if (!tls->ctx)
+	{
+		tls->ctx = tls_context_new(tls->settings, method, options);
+
+		if (!tls->ctx)
+			return FALSE;
+	}
+
 	tls->bio = BIO_new_rdp_tls(tls->ctx, clientMode);
 
 	if (BIO_get_ssl(tls->bio, &tls->ssl) < 0)
@@ -757,8 +807,157 @@ int tls_connect(rdpTls* tls, BIO *underlying)
 
 
 
+static BOOL tls_string_equal(const char* a, const char* b)
+{
+	if (!a || !b)
+		return (a == b) ? TRUE : FALSE;
+
+	return (strcmp(a, b) == 0) ? TRUE : FALSE;
+}
+
+/**
+ * Returns 1 with a new reference to the shared SSL_CTX in *ctx, 0 if the
+ * shared context holds other credentials than the ones requested (the caller
+ * then falls back to a per-connection context) and -1 on error.
+ */
+
+static int tls_server_context_get(rdpTlsServerContext* context, rdpSettings* settings,
+		long options, const char* cert_file, const char* privatekey_file, SSL_CTX** ctx)
+{
+	int status = -1;
+	SSL_CTX* sslCtx = NULL;
+	static const BYTE sessionIdContext[] = "FreeRDP";
+
+	EnterCriticalSection(&context->lock);
+
+	if (context->ctx)
+	{
+		if (tls_string_equal(context->CertificateFile, cert_file) &&
+			tls_string_equal(context->PrivateKeyFile, privatekey_file) &&
+			tls_string_equal(context->PermittedTLSCiphers, settings->PermittedTLSCiphers))
+		{
+			tls_context_ref(context->ctx);
+			*ctx = context->ctx;
+			status = 1;
+		}
+		else
+		{
+			status = 0;
+		}
+
+		goto out;
+	}
+
+	sslCtx = tls_context_new(settings, SSLv23_server_method(), options);
+
+	if (!sslCtx)
+		goto out;
+
+	/* parse the credentials once, every connection accepted by the listener shares them */
+
+	if (SSL_CTX_use_RSAPrivateKey_file(sslCtx, privatekey_file, SSL_FILETYPE_PEM) <= 0)
+	{
+		WLog_ERR(TAG,  "SSL_CTX_use_RSAPrivateKey_file failed");
+		WLog_ERR(TAG,  "PrivateKeyFile: %s", privatekey_file);
+		goto out;
+	}
+
+	if (SSL_CTX_use_certificate_file(sslCtx, cert_file, SSL_FILETYPE_PEM) <= 0)
+	{
+		WLog_ERR(TAG,  "SSL_CTX_use_certificate_file failed");
+		goto out;
+	}
+
+	/* the session cache (and session tickets) let reconnecting clients skip the full handshake */
+
+	SSL_CTX_set_session_id_context(sslCtx, sessionIdContext, sizeof(sessionIdContext) - 1);
+	SSL_CTX_set_session_cache_mode(sslCtx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_sess_set_cache_size(sslCtx, TLS_SERVER_SESSION_CACHE_SIZE);
+	SSL_CTX_set_timeout(sslCtx, TLS_SERVER_SESSION_TIMEOUT);
+
+	context->CertificateFile = cert_file ? _strdup(cert_file) : NULL;
+	context->PrivateKeyFile = privatekey_file ? _strdup(privatekey_file) : NULL;
+	context->PermittedTLSCiphers = settings->PermittedTLSCiphers ? _strdup(settings->PermittedTLSCiphers) : NULL;
+
+	if ((cert_file && !context->CertificateFile) || (privatekey_file && !context->PrivateKeyFile) ||
+		(settings->PermittedTLSCiphers && !context->PermittedTLSCiphers))
+	{
+		free(context->CertificateFile);
+		free(context->PrivateKeyFile);
+		free(context->PermittedTLSCiphers);
+		context->CertificateFile = context->PrivateKeyFile = context->PermittedTLSCiphers = NULL;
+		goto out;
+	}
+
+	context->ctx = sslCtx;
+	sslCtx = NULL;
+
+	tls_context_ref(context->ctx);
+	*ctx = context->ctx;
+	status = 1;
+
+out:
+	LeaveCriticalSection(&context->lock);
+
+	if (sslCtx)
+		SSL_CTX_free(sslCtx);
+
+	return status;
+}
+
+rdpTlsServerContext* tls_server_context_new(void)
+{
+	rdpTlsServerContext* context;
+
+	context = (rdpTlsServerContext*) calloc(1, sizeof(rdpTlsServerContext));
+
+	if (!context)
+		return NULL;
+
+	winpr_InitializeSSL(WINPR_SSL_INIT_DEFAULT);
+
+	if (!InitializeCriticalSectionAndSpinCount(&context->lock, 4000))
+	{
+		free(context);
+		return NULL;
+	}
+
+	context->refCount = 1;
+
+	return context;
+}
+
+rdpTlsServerContext* tls_server_context_ref(rdpTlsServerContext* context)
+{
+	if (context)
+		InterlockedIncrement(&context->refCount);
+
+	return context;
+}
+
+void tls_server_context_free(rdpTlsServerContext* context)
+{
+	if (!context)
+		return;
+
+	if (InterlockedDecrement(&context->refCount) > 0)
+		return;
+
+	if (context->ctx)
+		SSL_CTX_free(context->ctx);
+
+	free(context->CertificateFile);
+	free(context->PrivateKeyFile);
+	free(context->PermittedTLSCiphers);
+
+	DeleteCriticalSection(&context->lock);
+
+	free(context);
+}
+
 BOOL tls_accept(rdpTls* tls, BIO *underlying, const char* cert_file, const char* privatekey_file)
 {
+	int status = 0;
 	long options = 0;
 
 	/**
@@ -798,20 +997,34 @@ BOOL tls_accept(rdpTls* tls, BIO *underlying, const char* cert_file, const char*
 	 */
 	options |= SSL_OP_DONT_INSERT_EMPTY_FRAGMENTS;
 
+	if (tls->serverContext)
+	{
+		status = tls_server_context_get(tls->serverContext, tls->settings,
+				options, cert_file, privatekey_file, &tls->ctx);
+
+		if (status < 0)
+			return FALSE;
+	}
+
 	if (!tls_prepare(tls, underlying, SSLv23_server_method(), options, FALSE))
 		return FALSE;
 
-	if (SSL_use_RSAPrivateKey_file(tls->ssl, privatekey_file, SSL_FILETYPE_PEM) <= 0)
+	if (!status)
 	{
-		WLog_ERR(TAG,  "SSL_CTX_use_RSAPrivateKey_file failed");
-		WLog_ERR(TAG,  "PrivateKeyFile: %s", privatekey_file);
-		return FALSE;
-	}
+		/* no shared context, or one holding other credentials: load them for this connection */
 
-	if (SSL_use_certificate_file(tls->ssl, cert_file, SSL_FILETYPE_PEM) <= 0)
-	{
-		WLog_ERR(TAG,  "SSL_use_certificate_file failed");
-		return FALSE;
+		if (SSL_use_RSAPrivateKey_file(tls->ssl, privatekey_file, SSL_FILETYPE_PEM) <= 0)
+		{
+			WLog_ERR(TAG,  "SSL_CTX_use_RSAPrivateKey_file failed");
+			WLog_ERR(TAG,  "PrivateKeyFile: %s", privatekey_file);
+			return FALSE;
+		}
+
+		if (SSL_use_certificate_file(tls->ssl, cert_file, SSL_FILETYPE_PEM) <= 0)
+		{
+			WLog_ERR(TAG,  "SSL_use_certificate_file failed");
+			return FALSE;
+		}
 	}
 
 	return tls_do_handshake(tls, FALSE) > 0;
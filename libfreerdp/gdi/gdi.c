@@ -912,6 +912,7 @@ static void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* cmd)
 	int tx, ty;
 	BYTE* pSrcData;
 	BYTE* pDstData;
+	BYTE* pImageData;
 	RFX_MESSAGE* message;
 	rdpGdi* gdi = context->gdi;
 
@@ -986,9 +987,13 @@ static void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* cmd)
 		gdi->image->bitmap->height = cmd->height;
 		gdi->image->bitmap->bitsPerPixel = cmd->bpp;
 		gdi->image->bitmap->bytesPerPixel = cmd->bpp / 8;
+		pImageData = gdi->image->bitmap->data;
 		gdi->image->bitmap->data = gdi->bitmap_buffer;
 
 		gdi_BitBlt(gdi->primary->hdc, cmd->destLeft, cmd->destTop, cmd->width, cmd->height, gdi->image->hdc, 0, 0, GDI_SRCCOPY);
+
+		/* the image bitmap only borrows bitmap_buffer */
+		gdi->image->bitmap->data = pImageData;
 	} 
 	else if (cmd->codecID == RDP_CODEC_ID_NONE)
 	{
@@ -1011,9 +1016,13 @@ static void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* cmd)
 		gdi->image->bitmap->height = cmd->height;
 		gdi->image->bitmap->bitsPerPixel = cmd->bpp;
 		gdi->image->bitmap->bytesPerPixel = cmd->bpp / 8;
+		pImageData = gdi->image->bitmap->data;
 		gdi->image->bitmap->data = gdi->bitmap_buffer;
 
 		gdi_BitBlt(gdi->primary->hdc, cmd->destLeft, cmd->destTop, cmd->width, cmd->height, gdi->image->hdc, 0, 0, GDI_SRCCOPY);
+
+		/* the image bitmap only borrows bitmap_buffer */
+		gdi->image->bitmap->data = pImageData;
 	}
 	else
 	{
@@ -22,98 +22,156 @@
 #endif
 
 #include <freerdp/log.h>
+#include <freerdp/primitives.h>
 #include <freerdp/gdi/gfx.h>
 #include <freerdp/gdi/region.h>
 
 #define TAG FREERDP_TAG("gdi")
 
-int gdi_ResetGraphics(RdpgfxClientContext* context, RDPGFX_RESET_GRAPHICS_PDU* resetGraphics)
+/* surface rows are padded so that every row starts on a 16-byte boundary */
+#define GDI_GFX_SCANLINE(_width)	((((_width) * 4) + 15) & ~15)
+
+static BYTE* gdi_gfx_buffer_new(UINT32 scanline, UINT32 height)
 {
-	UINT32 DesktopWidth;
-	UINT32 DesktopHeight;
-	rdpGdi* gdi = (rdpGdi*) context->custom;
-	rdpUpdate* update = gdi->context->update;
-	rdpSettings* settings = gdi->context->settings;
+	BYTE* data;
+	size_t size = scanline * height;
 
-	DesktopWidth = resetGraphics->width;
-	DesktopHeight = resetGraphics->height;
+	data = (BYTE*) _aligned_malloc(size ? size : 16, 16);
 
-	region16_init(&(gdi->invalidRegion));
+	if (data)
+		ZeroMemory(data, size);
 
-	if ((DesktopWidth != settings->DesktopWidth) ||
-			(DesktopHeight != settings->DesktopHeight))
-	{
-		settings->DesktopWidth = DesktopWidth;
-		settings->DesktopHeight = DesktopHeight;
+	return data;
+}
 
-		if (update)
-			update->DesktopResize(gdi->context);
-	}
+static void gdi_gfx_invalidate(gdiGfxEngine* engine, const RECTANGLE_16* rect)
+{
+	region16_union_rect(&(engine->invalidRegion), &(engine->invalidRegion), rect);
+}
+
+static void gdi_gfx_invalidate_cmd(gdiGfxEngine* engine, RDPGFX_SURFACE_COMMAND* cmd)
+{
+	RECTANGLE_16 invalidRect;
+
+	invalidRect.left = cmd->left;
+	invalidRect.top = cmd->top;
+	invalidRect.right = cmd->right;
+	invalidRect.bottom = cmd->bottom;
+
+	gdi_gfx_invalidate(engine, &invalidRect);
+}
 
-	gdi->graphicsReset = TRUE;
+static int gdi_gfx_frame_update(gdiGfxEngine* engine)
+{
+	if (!engine->inGfxFrame)
+		return gdi_gfx_engine_update(engine);
 
 	return 1;
 }
 
-int gdi_OutputUpdate(rdpGdi* gdi)
+/**
+ * SolidFill and SurfaceToSurface are the hottest non-codec paths: they go
+ * through the primitives so that fills use the vectorized set_32u and
+ * non-overlapping copies the block copy primitive.
+ */
+
+static void gdi_gfx_fill(gdiGfxSurface* surface, int nXDst, int nYDst, int nWidth, int nHeight, UINT32 color)
 {
-	int nDstStep;
+	int y;
 	BYTE* pDstData;
-	int nXDst, nYDst;
-	int nXSrc, nYSrc;
-	int nWidth, nHeight;
-	gdiGfxSurface* surface;
-	RECTANGLE_16 surfaceRect;
-	const RECTANGLE_16* extents;
-	rdpUpdate* update = gdi->context->update;
+	primitives_t* prims = primitives_get();
 
-	if (!gdi->graphicsReset)
-		return 1;
+	pDstData = &surface->data[(nYDst * surface->scanline) + (nXDst * 4)];
 
-	pDstData = gdi->primary_buffer;
-	nDstStep = gdi->bytesPerPixel * gdi->width;
+	for (y = 0; y < nHeight; y++)
+	{
+		prims->set_32u(color, (UINT32*) pDstData, nWidth);
+		pDstData += surface->scanline;
+	}
+}
 
-	surface = (gdiGfxSurface*) gdi->gfx->GetSurfaceData(gdi->gfx, gdi->outputSurfaceId);
+static void gdi_gfx_move(gdiGfxSurface* surface, int nXDst, int nYDst, int nWidth, int nHeight, int nXSrc, int nYSrc)
+{
+	int y;
+	int nStep;
+	BYTE* pSrcData;
+	BYTE* pDstData;
+	primitives_t* prims = primitives_get();
 
-	if (!surface)
-		return -1;
+	nStep = surface->scanline;
+	pSrcData = &surface->data[(nYSrc * nStep) + (nXSrc * 4)];
+	pDstData = &surface->data[(nYDst * nStep) + (nXDst * 4)];
 
-	surfaceRect.left = 0;
-	surfaceRect.top = 0;
-	surfaceRect.right = gdi->width;
-	surfaceRect.bottom = gdi->height;
+	if ((nYDst >= nYSrc + nHeight) || (nYSrc >= nYDst + nHeight) ||
+			(nXDst >= nXSrc + nWidth) || (nXSrc >= nXDst + nWidth))
+	{
+		prims->copy_8u_AC4r(pSrcData, nStep, pDstData, nStep, nWidth, nHeight);
+		return;
+	}
 
-	region16_intersect_rect(&(gdi->invalidRegion), &(gdi->invalidRegion), &surfaceRect);
+	/* overlapping rows must be walked away from the destination */
+
+	if (nYDst > nYSrc)
+	{
+		pSrcData += (nHeight - 1) * nStep;
+		pDstData += (nHeight - 1) * nStep;
+		nStep = -nStep;
+	}
 
-	if (!region16_is_empty(&(gdi->invalidRegion)))
+	for (y = 0; y < nHeight; y++)
 	{
-		extents = region16_extents(&(gdi->invalidRegion));
+		MoveMemory(pDstData, pSrcData, nWidth * 4);
+		pSrcData += nStep;
+		pDstData += nStep;
+	}
+}
+
+static BOOL gdi_gfx_is_rect_valid(gdiGfxSurface* surface, int left, int top, int right, int bottom)
+{
+	if ((left < 0) || (top < 0) || (left > right) || (top > bottom))
+		return FALSE;
 
-		nXDst = extents->left;
-		nYDst = extents->top;
+	if ((right > (int) surface->width) || (bottom > (int) surface->height))
+		return FALSE;
 
-		nXSrc = extents->left;
-		nYSrc = extents->top;
+	return TRUE;
+}
 
-		nWidth = extents->right - extents->left;
-		nHeight = extents->bottom - extents->top;
+int gdi_gfx_engine_update(gdiGfxEngine* engine)
+{
+	int status = 1;
+	int nbRects;
+	gdiGfxSurface* surface;
+	RECTANGLE_16 surfaceRect;
+	const RECTANGLE_16* rects;
 
-		update->BeginPaint(gdi->context);
+	if (!engine->graphicsReset)
+		return 1;
 
-		freerdp_image_copy(pDstData, gdi->format, nDstStep, nXDst, nYDst, nWidth, nHeight,
-				surface->data, surface->format, surface->scanline, nXSrc, nYSrc, NULL);
+	surface = (gdiGfxSurface*) engine->gfx->GetSurfaceData(engine->gfx, engine->outputSurfaceId);
 
-		gdi_InvalidateRegion(gdi->primary->hdc, nXDst, nYDst, nWidth, nHeight);
+	if (!surface)
+		return -1;
 
-		update->EndPaint(gdi->context);
+	surfaceRect.left = 0;
+	surfaceRect.top = 0;
+	surfaceRect.right = surface->width;
+	surfaceRect.bottom = surface->height;
+
+	region16_intersect_rect(&(engine->invalidRegion), &(engine->invalidRegion), &surfaceRect);
+
+	if (!region16_is_empty(&(engine->invalidRegion)) && engine->Present)
+	{
+		rects = region16_rects(&(engine->invalidRegion), &nbRects);
+		status = engine->Present(engine, surface, rects, (UINT32) nbRects);
 	}
 
-	region16_clear(&(gdi->invalidRegion));
+	region16_clear(&(engine->invalidRegion));
 
-	return 1;
+	return status;
 }
 
-int gdi_OutputExpose(rdpGdi* gdi, int x, int y, int width, int height)
+int gdi_gfx_engine_expose(gdiGfxEngine* engine, int x, int y, int width, int height)
 {
 	RECTANGLE_16 invalidRect;
 
@@ -122,60 +180,71 @@ int gdi_OutputExpose(rdpGdi* gdi, int x, int y, int width, int height)
 	invalidRect.right = x + width;
 	invalidRect.bottom = y + height;
 
-	region16_union_rect(&(gdi->invalidRegion), &(gdi->invalidRegion), &invalidRect);
+	gdi_gfx_invalidate(engine, &invalidRect);
+
+	return gdi_gfx_engine_update(engine);
+}
+
+static int gdi_ResetGraphics(RdpgfxClientContext* context, RDPGFX_RESET_GRAPHICS_PDU* resetGraphics)
+{
+	gdiGfxEngine* engine = (gdiGfxEngine*) context->custom;
+
+	freerdp_client_codecs_reset(engine->codecs, FREERDP_CODEC_ALL);
+
+	region16_clear(&(engine->invalidRegion));
 
-	gdi_OutputUpdate(gdi);
+	if (engine->ResetGraphics)
+		engine->ResetGraphics(engine, resetGraphics->width, resetGraphics->height);
+
+	engine->graphicsReset = TRUE;
 
 	return 1;
 }
 
-int gdi_StartFrame(RdpgfxClientContext* context, RDPGFX_START_FRAME_PDU* startFrame)
+static int gdi_StartFrame(RdpgfxClientContext* context, RDPGFX_START_FRAME_PDU* startFrame)
 {
-	rdpGdi* gdi = (rdpGdi*) context->custom;
+	gdiGfxEngine* engine = (gdiGfxEngine*) context->custom;
 
-	gdi->inGfxFrame = TRUE;
+	engine->inGfxFrame = TRUE;
 
 	return 1;
 }
 
-int gdi_EndFrame(RdpgfxClientContext* context, RDPGFX_END_FRAME_PDU* endFrame)
+static int gdi_EndFrame(RdpgfxClientContext* context, RDPGFX_END_FRAME_PDU* endFrame)
 {
-	rdpGdi* gdi = (rdpGdi*) context->custom;
+	gdiGfxEngine* engine = (gdiGfxEngine*) context->custom;
 
-	gdi_OutputUpdate(gdi);
+	gdi_gfx_engine_update(engine);
 
-	gdi->inGfxFrame = FALSE;
+	engine->inGfxFrame = FALSE;
 
 	return 1;
 }
 
-int gdi_SurfaceCommand_Uncompressed(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
+static int gdi_SurfaceCommand_Uncompressed(gdiGfxEngine* engine, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
 {
 	gdiGfxSurface* surface;
-	RECTANGLE_16 invalidRect;
 
 	surface = (gdiGfxSurface*) context->GetSurfaceData(context, cmd->surfaceId);
 
 	if (!surface)
 		return -1;
 
-	freerdp_image_copy(surface->data, surface->format, surface->scanline, cmd->left, cmd->top,
-			cmd->width, cmd->height, cmd->data, PIXEL_FORMAT_XRGB32, cmd->width * 4, 0, 0, NULL);
+	if (!gdi_gfx_is_rect_valid(surface, cmd->left, cmd->top, cmd->right, cmd->bottom))
+		return -1;
 
-	invalidRect.left = cmd->left;
-	invalidRect.top = cmd->top;
-	invalidRect.right = cmd->right;
-	invalidRect.bottom = cmd->bottom;
+	if (cmd->length < (cmd->width * cmd->height * 4))
+		return -1;
 
-	region16_union_rect(&(gdi->invalidRegion), &(gdi->invalidRegion), &invalidRect);
+	freerdp_image_copy(surface->data, surface->format, surface->scanline, cmd->left, cmd->top,
+			cmd->width, cmd->height, cmd->data, PIXEL_FORMAT_XRGB32, cmd->width * 4, 0, 0, NULL);
 
-	if (!gdi->inGfxFrame)
-		gdi_OutputUpdate(gdi);
+	gdi_gfx_invalidate_cmd(engine, cmd);
 
-	return 1;
+	return gdi_gfx_frame_update(engine);
 }
 
-int gdi_SurfaceCommand_RemoteFX(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
+static int gdi_SurfaceCommand_RemoteFX(gdiGfxEngine* engine, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
 {
 	int j;
 	UINT16 i;
@@ -192,14 +261,14 @@ int gdi_SurfaceCommand_RemoteFX(rdpGdi* gdi, RdpgfxClientContext* context, RDPGF
 	REGION16 clippingRects;
 	RECTANGLE_16 clippingRect;
 
-	freerdp_client_codecs_prepare(gdi->codecs, FREERDP_CODEC_REMOTEFX);
+	freerdp_client_codecs_prepare(engine->codecs, FREERDP_CODEC_REMOTEFX);
 
 	surface = (gdiGfxSurface*) context->GetSurfaceData(context, cmd->surfaceId);
 
 	if (!surface)
 		return -1;
 
-	message = rfx_process_message(gdi->codecs->rfx, cmd->data, cmd->length);
+	message = rfx_process_message(engine->codecs->rfx, cmd->data, cmd->length);
 
 	if (!message)
 		return -1;
@@ -242,37 +311,38 @@ int gdi_SurfaceCommand_RemoteFX(rdpGdi* gdi, RdpgfxClientContext* context, RDPGF
 					nXDst, nYDst, nWidth, nHeight,
 					tile->data, PIXEL_FORMAT_XRGB32, 64 * 4, 0, 0, NULL);
 
-			region16_union_rect(&(gdi->invalidRegion), &(gdi->invalidRegion), &updateRects[j]);
+			gdi_gfx_invalidate(engine, &updateRects[j]);
 		}
 
 		region16_uninit(&updateRegion);
 	}
 
-	rfx_message_free(gdi->codecs->rfx, message);
+	rfx_message_free(engine->codecs->rfx, message);
 
-	if (!gdi->inGfxFrame)
-		gdi_OutputUpdate(gdi);
+	region16_uninit(&clippingRects);
 
-	return 1;
+	return gdi_gfx_frame_update(engine);
 }
 
-int gdi_SurfaceCommand_ClearCodec(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
+static int gdi_SurfaceCommand_ClearCodec(gdiGfxEngine* engine, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
 {
 	int status;
 	BYTE* DstData = NULL;
 	gdiGfxSurface* surface;
-	RECTANGLE_16 invalidRect;
 
-	freerdp_client_codecs_prepare(gdi->codecs, FREERDP_CODEC_CLEARCODEC);
+	freerdp_client_codecs_prepare(engine->codecs, FREERDP_CODEC_CLEARCODEC);
 
 	surface = (gdiGfxSurface*) context->GetSurfaceData(context, cmd->surfaceId);
 
 	if (!surface)
 		return -1;
 
+	if (!gdi_gfx_is_rect_valid(surface, cmd->left, cmd->top, cmd->right, cmd->bottom))
+		return -1;
+
 	DstData = surface->data;
 
-	status = clear_decompress(gdi->codecs->clear, cmd->data, cmd->length, &DstData,
+	status = clear_decompress(engine->codecs->clear, cmd->data, cmd->length, &DstData,
 			surface->format, surface->scanline, cmd->left, cmd->top, cmd->width, cmd->height);
 
 	if (status < 0)
@@ -281,65 +351,53 @@ int gdi_SurfaceCommand_ClearCodec(rdpGdi* gdi, RdpgfxClientContext* context, RDP
 		return -1;
 	}
 
-	invalidRect.left = cmd->left;
-	invalidRect.top = cmd->top;
-	invalidRect.right = cmd->right;
-	invalidRect.bottom = cmd->bottom;
-
-	region16_union_rect(&(gdi->invalidRegion), &(gdi->invalidRegion), &invalidRect);
-
-
-	if (!gdi->inGfxFrame)
-		gdi_OutputUpdate(gdi);
+	gdi_gfx_invalidate_cmd(engine, cmd);
 
-	return 1;
+	return gdi_gfx_frame_update(engine);
 }
 
-int gdi_SurfaceCommand_Planar(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
+static int gdi_SurfaceCommand_Planar(gdiGfxEngine* engine, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
 {
 	int status;
 	BYTE* DstData = NULL;
 	gdiGfxSurface* surface;
-	RECTANGLE_16 invalidRect;
 
-	freerdp_client_codecs_prepare(gdi->codecs, FREERDP_CODEC_PLANAR);
+	freerdp_client_codecs_prepare(engine->codecs, FREERDP_CODEC_PLANAR);
 
 	surface = (gdiGfxSurface*) context->GetSurfaceData(context, cmd->surfaceId);
 
 	if (!surface)
 		return -1;
 
+	if (!gdi_gfx_is_rect_valid(surface, cmd->left, cmd->top, cmd->right, cmd->bottom))
+		return -1;
+
 	DstData = surface->data;
 
-	status = planar_decompress(gdi->codecs->planar, cmd->data, cmd->length, &DstData,
-			PIXEL_FORMAT_XRGB32, surface->scanline, cmd->left, cmd->top, cmd->width, cmd->height, FALSE);
+	status = planar_decompress(engine->codecs->planar, cmd->data, cmd->length, &DstData,
+			surface->format, surface->scanline, cmd->left, cmd->top, cmd->width, cmd->height, FALSE);
 
-	invalidRect.left = cmd->left;
-	invalidRect.top = cmd->top;
-	invalidRect.right = cmd->right;
-	invalidRect.bottom = cmd->bottom;
-
-	region16_union_rect(&(gdi->invalidRegion), &(gdi->invalidRegion), &invalidRect);
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "planar_decompress failure: %d", status);
+		return -1;
+	}
 
-	if (!gdi->inGfxFrame)
-		gdi_OutputUpdate(gdi);
+	gdi_gfx_invalidate_cmd(engine, cmd);
 
-	return 1;
+	return gdi_gfx_frame_update(engine);
 }
 
-int gdi_SurfaceCommand_H264(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
+static int gdi_SurfaceCommand_H264(gdiGfxEngine* engine, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
 {
 	int status;
 	UINT32 i;
 	BYTE* DstData = NULL;
-	H264_CONTEXT* h264;
 	gdiGfxSurface* surface;
 	RDPGFX_H264_METABLOCK* meta;
 	RDPGFX_H264_BITMAP_STREAM* bs;
 
-	freerdp_client_codecs_prepare(gdi->codecs, FREERDP_CODEC_H264);
-
-	h264 = gdi->codecs->h264;
+	freerdp_client_codecs_prepare(engine->codecs, FREERDP_CODEC_H264);
 
 	bs = (RDPGFX_H264_BITMAP_STREAM*) cmd->extra;
 
@@ -355,68 +413,53 @@ int gdi_SurfaceCommand_H264(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_SU
 
 	DstData = surface->data;
 
-	status = h264_decompress(gdi->codecs->h264, bs->data, bs->length, &DstData,
-			PIXEL_FORMAT_XRGB32, surface->scanline , surface->height, meta->regionRects, meta->numRegionRects);
+	status = h264_decompress(engine->codecs->h264, bs->data, bs->length, &DstData,
+			surface->format, surface->scanline, surface->height, meta->regionRects, meta->numRegionRects);
 
 	if (status < 0)
 	{
-		WLog_ERR(TAG, "h264_decompress failure: %d",status);
+		WLog_ERR(TAG, "h264_decompress failure: %d", status);
 		return -1;
 	}
 
 	for (i = 0; i < meta->numRegionRects; i++)
 	{
-		region16_union_rect(&(gdi->invalidRegion), &(gdi->invalidRegion), (RECTANGLE_16*) &(meta->regionRects[i]));
+		gdi_gfx_invalidate(engine, (RECTANGLE_16*) &(meta->regionRects[i]));
 	}
 
-	if (!gdi->inGfxFrame)
-		gdi_OutputUpdate(gdi);
-
-	return 1;
+	return gdi_gfx_frame_update(engine);
 }
 
-int gdi_SurfaceCommand_Alpha(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
+static int gdi_SurfaceCommand_Alpha(gdiGfxEngine* engine, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
 {
-	int status = 0;
 	gdiGfxSurface* surface;
-	RECTANGLE_16 invalidRect;
 
-	freerdp_client_codecs_prepare(gdi->codecs, FREERDP_CODEC_ALPHACODEC);
+	freerdp_client_codecs_prepare(engine->codecs, FREERDP_CODEC_ALPHACODEC);
 
 	surface = (gdiGfxSurface*) context->GetSurfaceData(context, cmd->surfaceId);
 
 	if (!surface)
 		return -1;
 
-	WLog_DBG(TAG, "gdi_SurfaceCommand_Alpha: status: %d", status);
+	if (!gdi_gfx_is_rect_valid(surface, cmd->left, cmd->top, cmd->right, cmd->bottom))
+		return -1;
 
 	/* fill with green for now to distinguish from the rest */
 
-	freerdp_image_fill(surface->data, PIXEL_FORMAT_XRGB32, surface->scanline,
-			cmd->left, cmd->top, cmd->width, cmd->height, 0x00FF00);
-
-	invalidRect.left = cmd->left;
-	invalidRect.top = cmd->top;
-	invalidRect.right = cmd->right;
-	invalidRect.bottom = cmd->bottom;
-
-	region16_union_rect(&(gdi->invalidRegion), &(gdi->invalidRegion), &invalidRect);
+	gdi_gfx_fill(surface, cmd->left, cmd->top, cmd->width, cmd->height,
+			(surface->format == PIXEL_FORMAT_XBGR32) ? ABGR32(0xFF, 0, 0xFF, 0) : ARGB32(0xFF, 0, 0xFF, 0));
 
-	if (!gdi->inGfxFrame)
-		gdi_OutputUpdate(gdi);
+	gdi_gfx_invalidate_cmd(engine, cmd);
 
-	return 1;
+	return gdi_gfx_frame_update(engine);
 }
 
-int gdi_SurfaceCommand_Progressive(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
+static int gdi_SurfaceCommand_Progressive(gdiGfxEngine* engine, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
 {
 	int i, j;
 	int status;
 	BYTE* DstData;
 	RFX_RECT* rect;
-	int nXDst, nYDst;
-	int nXSrc, nYSrc;
-	int nWidth, nHeight;
 	int nbUpdateRects;
 	gdiGfxSurface* surface;
 	REGION16 updateRegion;
@@ -427,19 +470,19 @@ int gdi_SurfaceCommand_Progressive(rdpGdi* gdi, RdpgfxClientContext* context, RD
 	RFX_PROGRESSIVE_TILE* tile;
 	PROGRESSIVE_BLOCK_REGION* region;
 
-	freerdp_client_codecs_prepare(gdi->codecs, FREERDP_CODEC_PROGRESSIVE);
+	freerdp_client_codecs_prepare(engine->codecs, FREERDP_CODEC_PROGRESSIVE);
 
 	surface = (gdiGfxSurface*) context->GetSurfaceData(context, cmd->surfaceId);
 
 	if (!surface)
 		return -1;
 
-	progressive_create_surface_context(gdi->codecs->progressive, cmd->surfaceId, surface->width, surface->height);
+	progressive_create_surface_context(engine->codecs->progressive, cmd->surfaceId, surface->width, surface->height);
 
 	DstData = surface->data;
 
-	status = progressive_decompress(gdi->codecs->progressive, cmd->data, cmd->length, &DstData,
-			PIXEL_FORMAT_XRGB32, surface->scanline, cmd->left, cmd->top, cmd->width, cmd->height, cmd->surfaceId);
+	status = progressive_decompress(engine->codecs->progressive, cmd->data, cmd->length, &DstData,
+			surface->format, surface->scanline, cmd->left, cmd->top, cmd->width, cmd->height, cmd->surfaceId);
 
 	if (status < 0)
 	{
@@ -447,7 +490,7 @@ int gdi_SurfaceCommand_Progressive(rdpGdi* gdi, RdpgfxClientContext* context, RD
 		return -1;
 	}
 
-	region = &(gdi->codecs->progressive->region);
+	region = &(engine->codecs->progressive->region);
 
 	region16_init(&clippingRects);
 
@@ -476,83 +519,85 @@ int gdi_SurfaceCommand_Progressive(rdpGdi* gdi, RdpgfxClientContext* context, RD
 		region16_intersect_rect(&updateRegion, &clippingRects, &updateRect);
 		updateRects = (RECTANGLE_16*) region16_rects(&updateRegion, &nbUpdateRects);
 
-		for (j = 0; j < nbUpdateRects; j++)
-		{
-			nXDst = updateRects[j].left;
-			nYDst = updateRects[j].top;
-			nWidth = updateRects[j].right - updateRects[j].left;
-			nHeight = updateRects[j].bottom - updateRects[j].top;
-
-			nXSrc = nXDst - (cmd->left + tile->x);
-			nYSrc = nYDst - (cmd->top + tile->y);
-
-			freerdp_image_copy(surface->data, surface->format,
-					surface->scanline, nXDst, nYDst, nWidth, nHeight,
-					tile->data, PIXEL_FORMAT_XRGB32, 64 * 4, nXSrc, nYSrc, NULL);
+		/* the decoder has already written the visible part of the tile into the surface */
 
-			region16_union_rect(&(gdi->invalidRegion), &(gdi->invalidRegion), &updateRects[j]);
-		}
+		for (j = 0; j < nbUpdateRects; j++)
+			gdi_gfx_invalidate(engine, &updateRects[j]);
 
 		region16_uninit(&updateRegion);
 	}
 
-	if (!gdi->inGfxFrame)
-		gdi_OutputUpdate(gdi);
+	region16_uninit(&clippingRects);
 
-	return 1;
+	return gdi_gfx_frame_update(engine);
 }
 
-int gdi_SurfaceCommand(RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
+static int gdi_SurfaceCommand(RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
 {
 	int status = 1;
-	rdpGdi* gdi = (rdpGdi*) context->custom;
+	gdiGfxEngine* engine = (gdiGfxEngine*) context->custom;
 
 	switch (cmd->codecId)
 	{
 		case RDPGFX_CODECID_UNCOMPRESSED:
-			status = gdi_SurfaceCommand_Uncompressed(gdi, context, cmd);
+			status = gdi_SurfaceCommand_Uncompressed(engine, context, cmd);
 			break;
 
 		case RDPGFX_CODECID_CAVIDEO:
-			status = gdi_SurfaceCommand_RemoteFX(gdi, context, cmd);
+			status = gdi_SurfaceCommand_RemoteFX(engine, context, cmd);
 			break;
 
 		case RDPGFX_CODECID_CLEARCODEC:
-			status = gdi_SurfaceCommand_ClearCodec(gdi, context, cmd);
+			status = gdi_SurfaceCommand_ClearCodec(engine, context, cmd);
 			break;
 
 		case RDPGFX_CODECID_PLANAR:
-			status = gdi_SurfaceCommand_Planar(gdi, context, cmd);
+			status = gdi_SurfaceCommand_Planar(engine, context, cmd);
 			break;
 
 		case RDPGFX_CODECID_H264:
-			status = gdi_SurfaceCommand_H264(gdi, context, cmd);
+			status = gdi_SurfaceCommand_H264(engine, context, cmd);
 			break;
 
 		case RDPGFX_CODECID_ALPHA:
-			status = gdi_SurfaceCommand_Alpha(gdi, context, cmd);
+			status = gdi_SurfaceCommand_Alpha(engine, context, cmd);
 			break;
 
 		case RDPGFX_CODECID_CAPROGRESSIVE:
-			status = gdi_SurfaceCommand_Progressive(gdi, context, cmd);
+			status = gdi_SurfaceCommand_Progressive(engine, context, cmd);
 			break;
 
 		case RDPGFX_CODECID_CAPROGRESSIVE_V2:
 			break;
 	}
 
+	if (status < 0)
+		WLog_DBG(TAG, "surface command failure: codecId: 0x%04X", cmd->codecId);
+
 	return 1;
 }
 
-int gdi_DeleteEncodingContext(RdpgfxClientContext* context, RDPGFX_DELETE_ENCODING_CONTEXT_PDU* deleteEncodingContext)
+static int gdi_DeleteEncodingContext(RdpgfxClientContext* context, RDPGFX_DELETE_ENCODING_CONTEXT_PDU* deleteEncodingContext)
 {
 	return 1;
 }
 
-int gdi_CreateSurface(RdpgfxClientContext* context, RDPGFX_CREATE_SURFACE_PDU* createSurface)
+static void gdi_gfx_surface_free(gdiGfxEngine* engine, gdiGfxSurface* surface)
+{
+	if (!surface)
+		return;
+
+	if (engine && engine->SurfaceDeleted)
+		engine->SurfaceDeleted(engine, surface);
+
+	_aligned_free(surface->data);
+	free(surface);
+}
+
+static int gdi_CreateSurface(RdpgfxClientContext* context, RDPGFX_CREATE_SURFACE_PDU* createSurface)
 {
 	gdiGfxSurface* surface;
-	rdpGdi* gdi = (rdpGdi*) context->custom;
+	gdiGfxEngine* engine = (gdiGfxEngine*) context->custom;
 
 	surface = (gdiGfxSurface*) calloc(1, sizeof(gdiGfxSurface));
 
@@ -563,15 +608,21 @@ int gdi_CreateSurface(RdpgfxClientContext* context, RDPGFX_CREATE_SURFACE_PDU* c
 	surface->width = (UINT32) createSurface->width;
 	surface->height = (UINT32) createSurface->height;
 	surface->alpha = (createSurface->pixelFormat == PIXEL_FORMAT_ARGB_8888) ? TRUE : FALSE;
+	surface->format = engine->format;
 
-	surface->format = (!gdi->invert) ? PIXEL_FORMAT_XRGB32 : PIXEL_FORMAT_XBGR32;
-
-	surface->scanline = (surface->width + (surface->width % 4)) * 4;
-	surface->data = (BYTE*) calloc(1, surface->scanline * surface->height);
+	surface->scanline = GDI_GFX_SCANLINE(surface->width);
+	surface->data = gdi_gfx_buffer_new(surface->scanline, surface->height);
 
 	if (!surface->data)
 	{
-		free (surface);
+		free(surface);
+		return -1;
+	}
+
+	if (engine->SurfaceCreated && (engine->SurfaceCreated(engine, surface) < 0))
+	{
+		_aligned_free(surface->data);
+		free(surface);
 		return -1;
 	}
 
@@ -580,37 +631,34 @@ int gdi_CreateSurface(RdpgfxClientContext* context, RDPGFX_CREATE_SURFACE_PDU* c
 	return 1;
 }
 
-int gdi_DeleteSurface(RdpgfxClientContext* context, RDPGFX_DELETE_SURFACE_PDU* deleteSurface)
+static int gdi_DeleteSurface(RdpgfxClientContext* context, RDPGFX_DELETE_SURFACE_PDU* deleteSurface)
 {
 	gdiGfxSurface* surface;
-	rdpGdi* gdi = (rdpGdi*) context->custom;
+	gdiGfxEngine* engine = (gdiGfxEngine*) context->custom;
 
 	surface = (gdiGfxSurface*) context->GetSurfaceData(context, deleteSurface->surfaceId);
 
-	if (surface)
-	{
-		free(surface->data);
-		free(surface);
-	}
+	gdi_gfx_surface_free(engine, surface);
 
 	context->SetSurfaceData(context, deleteSurface->surfaceId, NULL);
 
-	if (gdi->codecs->progressive)
-		progressive_delete_surface_context(gdi->codecs->progressive, deleteSurface->surfaceId);
+	if (engine && engine->codecs && engine->codecs->progressive)
+		progressive_delete_surface_context(engine->codecs->progressive, deleteSurface->surfaceId);
 
 	return 1;
 }
 
-int gdi_SolidFill(RdpgfxClientContext* context, RDPGFX_SOLID_FILL_PDU* solidFill)
+static int gdi_SolidFill(RdpgfxClientContext* context, RDPGFX_SOLID_FILL_PDU* solidFill)
 {
 	UINT16 index;
 	UINT32 color;
 	BYTE a, r, g, b;
-	int nWidth, nHeight;
 	RDPGFX_RECT16* rect;
 	gdiGfxSurface* surface;
+	RECTANGLE_16 fillRect;
+	RECTANGLE_16 surfaceRect;
 	RECTANGLE_16 invalidRect;
-	rdpGdi* gdi = (rdpGdi*) context->custom;
+	gdiGfxEngine* engine = (gdiGfxEngine*) context->custom;
 
 	surface = (gdiGfxSurface*) context->GetSurfaceData(context, solidFill->surfaceId);
 
@@ -622,36 +670,40 @@ int gdi_SolidFill(RdpgfxClientContext* context, RDPGFX_SOLID_FILL_PDU* solidFill
 	r = solidFill->fillPixel.R;
 	a = solidFill->fillPixel.XA;
 
-	if (!gdi->invert)
-		color = ARGB32(a, r, g, b);
-	else
+	if (surface->format == PIXEL_FORMAT_XBGR32)
 		color = ABGR32(a, r, g, b);
+	else
+		color = ARGB32(a, r, g, b);
+
+	surfaceRect.left = 0;
+	surfaceRect.top = 0;
+	surfaceRect.right = (UINT16) surface->width;
+	surfaceRect.bottom = (UINT16) surface->height;
 
 	for (index = 0; index < solidFill->fillRectCount; index++)
 	{
 		rect = &(solidFill->fillRects[index]);
 
-		nWidth = rect->right - rect->left;
-		nHeight = rect->bottom - rect->top;
+		fillRect.left = rect->left;
+		fillRect.top = rect->top;
+		fillRect.right = rect->right;
+		fillRect.bottom = rect->bottom;
 
-		invalidRect.left = rect->left;
-		invalidRect.top = rect->top;
-		invalidRect.right = rect->right;
-		invalidRect.bottom = rect->bottom;
+		/* fills are clipped to the surface, the part inside is still drawn */
 
-		freerdp_image_fill(surface->data, surface->format, surface->scanline,
-				rect->left, rect->top, nWidth, nHeight, color);
+		if (!rectangles_intersection(&fillRect, &surfaceRect, &invalidRect))
+			continue;
 
-		region16_union_rect(&(gdi->invalidRegion), &(gdi->invalidRegion), &invalidRect);
-	}
+		gdi_gfx_fill(surface, invalidRect.left, invalidRect.top,
+				invalidRect.right - invalidRect.left, invalidRect.bottom - invalidRect.top, color);
 
-	if (!gdi->inGfxFrame)
-		gdi_OutputUpdate(gdi);
+		gdi_gfx_invalidate(engine, &invalidRect);
+	}
 
-	return 1;
+	return gdi_gfx_frame_update(engine);
 }
 
-int gdi_SurfaceToSurface(RdpgfxClientContext* context, RDPGFX_SURFACE_TO_SURFACE_PDU* surfaceToSurface)
+static int gdi_SurfaceToSurface(RdpgfxClientContext* context, RDPGFX_SURFACE_TO_SURFACE_PDU* surfaceToSurface)
 {
 	UINT16 index;
 	BOOL sameSurface;
@@ -661,10 +713,10 @@ int gdi_SurfaceToSurface(RdpgfxClientContext* context, RDPGFX_SURFACE_TO_SURFACE
 	RECTANGLE_16 invalidRect;
 	gdiGfxSurface* surfaceSrc;
 	gdiGfxSurface* surfaceDst;
-	rdpGdi* gdi = (rdpGdi*) context->custom;
+	primitives_t* prims = primitives_get();
+	gdiGfxEngine* engine = (gdiGfxEngine*) context->custom;
 
 	rectSrc = &(surfaceToSurface->rectSrc);
-	destPt = &surfaceToSurface->destPts[0];
 
 	surfaceSrc = (gdiGfxSurface*) context->GetSurfaceData(context, surfaceToSurface->surfaceIdSrc);
 
@@ -678,6 +730,9 @@ int gdi_SurfaceToSurface(RdpgfxClientContext* context, RDPGFX_SURFACE_TO_SURFACE
 	if (!surfaceSrc || !surfaceDst)
 		return -1;
 
+	if (!gdi_gfx_is_rect_valid(surfaceSrc, rectSrc->left, rectSrc->top, rectSrc->right, rectSrc->bottom))
+		return -1;
+
 	nWidth = rectSrc->right - rectSrc->left;
 	nHeight = rectSrc->bottom - rectSrc->top;
 
@@ -685,10 +740,19 @@ int gdi_SurfaceToSurface(RdpgfxClientContext* context, RDPGFX_SURFACE_TO_SURFACE
 	{
 		destPt = &surfaceToSurface->destPts[index];
 
+		if (!gdi_gfx_is_rect_valid(surfaceDst, destPt->x, destPt->y, destPt->x + nWidth, destPt->y + nHeight))
+			continue;
+
 		if (sameSurface)
 		{
-			freerdp_image_move(surfaceDst->data, surfaceDst->format, surfaceDst->scanline,
-					destPt->x, destPt->y, nWidth, nHeight, rectSrc->left, rectSrc->top);
+			gdi_gfx_move(surfaceDst, destPt->x, destPt->y, nWidth, nHeight, rectSrc->left, rectSrc->top);
+		}
+		else if (surfaceDst->format == surfaceSrc->format)
+		{
+			prims->copy_8u_AC4r(&surfaceSrc->data[(rectSrc->top * surfaceSrc->scanline) + (rectSrc->left * 4)],
+					surfaceSrc->scanline,
+					&surfaceDst->data[(destPt->y * surfaceDst->scanline) + (destPt->x * 4)],
+					surfaceDst->scanline, nWidth, nHeight);
 		}
 		else
 		{
@@ -699,24 +763,57 @@ int gdi_SurfaceToSurface(RdpgfxClientContext* context, RDPGFX_SURFACE_TO_SURFACE
 
 		invalidRect.left = destPt->x;
 		invalidRect.top = destPt->y;
-		invalidRect.right = destPt->x + rectSrc->right;
-		invalidRect.bottom = destPt->y + rectSrc->bottom;
+		invalidRect.right = destPt->x + nWidth;
+		invalidRect.bottom = destPt->y + nHeight;
 
-		region16_union_rect(&(gdi->invalidRegion), &(gdi->invalidRegion), &invalidRect);
+		gdi_gfx_invalidate(engine, &invalidRect);
 	}
 
-	if (!gdi->inGfxFrame)
-		gdi_OutputUpdate(gdi);
+	return gdi_gfx_frame_update(engine);
+}
 
-	return 1;
+static gdiGfxCacheEntry* gdi_gfx_cache_entry_new(gdiGfxEngine* engine, UINT32 width, UINT32 height, BOOL alpha)
+{
+	gdiGfxCacheEntry* cacheEntry;
+
+	cacheEntry = (gdiGfxCacheEntry*) calloc(1, sizeof(gdiGfxCacheEntry));
+
+	if (!cacheEntry)
+		return NULL;
+
+	cacheEntry->width = width;
+	cacheEntry->height = height;
+	cacheEntry->alpha = alpha;
+	cacheEntry->format = engine->format;
+
+	cacheEntry->scanline = GDI_GFX_SCANLINE(cacheEntry->width);
+	cacheEntry->data = gdi_gfx_buffer_new(cacheEntry->scanline, cacheEntry->height);
+
+	if (!cacheEntry->data)
+	{
+		free(cacheEntry);
+		return NULL;
+	}
+
+	return cacheEntry;
 }
 
-int gdi_SurfaceToCache(RdpgfxClientContext* context, RDPGFX_SURFACE_TO_CACHE_PDU* surfaceToCache)
+static void gdi_gfx_cache_entry_free(gdiGfxCacheEntry* cacheEntry)
+{
+	if (!cacheEntry)
+		return;
+
+	_aligned_free(cacheEntry->data);
+	free(cacheEntry);
+}
+
+static int gdi_SurfaceToCache(RdpgfxClientContext* context, RDPGFX_SURFACE_TO_CACHE_PDU* surfaceToCache)
 {
 	RDPGFX_RECT16* rect;
 	gdiGfxSurface* surface;
 	gdiGfxCacheEntry* cacheEntry;
-	rdpGdi* gdi = (rdpGdi*) context->custom;
+	primitives_t* prims = primitives_get();
+	gdiGfxEngine* engine = (gdiGfxEngine*) context->custom;
 
 	rect = &(surfaceToCache->rectSrc);
 
@@ -725,43 +822,41 @@ int gdi_SurfaceToCache(RdpgfxClientContext* context, RDPGFX_SURFACE_TO_CACHE_PDU
 	if (!surface)
 		return -1;
 
-	cacheEntry = (gdiGfxCacheEntry*) calloc(1, sizeof(gdiGfxCacheEntry));
+	if (!gdi_gfx_is_rect_valid(surface, rect->left, rect->top, rect->right, rect->bottom))
+		return -1;
+
+	cacheEntry = gdi_gfx_cache_entry_new(engine, (UINT32) (rect->right - rect->left),
+			(UINT32) (rect->bottom - rect->top), surface->alpha);
 
 	if (!cacheEntry)
 		return -1;
 
-	cacheEntry->width = (UINT32) (rect->right - rect->left);
-	cacheEntry->height = (UINT32) (rect->bottom - rect->top);
-	cacheEntry->alpha = surface->alpha;
+	cacheEntry->cacheKey = surfaceToCache->cacheKey;
 
-	cacheEntry->format = (!gdi->invert) ? PIXEL_FORMAT_XRGB32 : PIXEL_FORMAT_XBGR32;
+	prims->copy_8u_AC4r(&surface->data[(rect->top * surface->scanline) + (rect->left * 4)],
+			surface->scanline, cacheEntry->data, cacheEntry->scanline,
+			cacheEntry->width, cacheEntry->height);
 
-	cacheEntry->scanline = (cacheEntry->width + (cacheEntry->width % 4)) * 4;
-	cacheEntry->data = (BYTE*) calloc(1, cacheEntry->scanline * cacheEntry->height);
+	gdi_gfx_cache_entry_free((gdiGfxCacheEntry*) context->GetCacheSlotData(context, surfaceToCache->cacheSlot));
 
-	if (!cacheEntry->data)
+	if (context->SetCacheSlotData(context, surfaceToCache->cacheSlot, (void*) cacheEntry) < 0)
 	{
-		free (cacheEntry);
+		gdi_gfx_cache_entry_free(cacheEntry);
 		return -1;
 	}
 
-	freerdp_image_copy(cacheEntry->data, cacheEntry->format, cacheEntry->scanline,
-			0, 0, cacheEntry->width, cacheEntry->height, surface->data,
-			surface->format, surface->scanline, rect->left, rect->top, NULL);
-
-	context->SetCacheSlotData(context, surfaceToCache->cacheSlot, (void*) cacheEntry);
-
 	return 1;
 }
 
-int gdi_CacheToSurface(RdpgfxClientContext* context, RDPGFX_CACHE_TO_SURFACE_PDU* cacheToSurface)
+static int gdi_CacheToSurface(RdpgfxClientContext* context, RDPGFX_CACHE_TO_SURFACE_PDU* cacheToSurface)
 {
 	UINT16 index;
 	RDPGFX_POINT16* destPt;
 	gdiGfxSurface* surface;
 	gdiGfxCacheEntry* cacheEntry;
 	RECTANGLE_16 invalidRect;
-	rdpGdi* gdi = (rdpGdi*) context->custom;
+	primitives_t* prims = primitives_get();
+	gdiGfxEngine* engine = (gdiGfxEngine*) context->custom;
 
 	surface = (gdiGfxSurface*) context->GetSurfaceData(context, cacheToSurface->surfaceId);
 	cacheEntry = (gdiGfxCacheEntry*) context->GetCacheSlotData(context, cacheToSurface->cacheSlot);
@@ -773,64 +868,127 @@ int gdi_CacheToSurface(RdpgfxClientContext* context, RDPGFX_CACHE_TO_SURFACE_PDU
 	{
 		destPt = &cacheToSurface->destPts[index];
 
-		freerdp_image_copy(surface->data, surface->format, surface->scanline,
-				destPt->x, destPt->y, cacheEntry->width, cacheEntry->height,
-				cacheEntry->data, cacheEntry->format, cacheEntry->scanline, 0, 0, NULL);
+		if (!gdi_gfx_is_rect_valid(surface, destPt->x, destPt->y,
+				destPt->x + cacheEntry->width, destPt->y + cacheEntry->height))
+			continue;
+
+		prims->copy_8u_AC4r(cacheEntry->data, cacheEntry->scanline,
+				&surface->data[(destPt->y * surface->scanline) + (destPt->x * 4)],
+				surface->scanline, cacheEntry->width, cacheEntry->height);
 
 		invalidRect.left = destPt->x;
 		invalidRect.top = destPt->y;
-		invalidRect.right = destPt->x + cacheEntry->width - 1;
-		invalidRect.bottom = destPt->y + cacheEntry->height - 1;
+		invalidRect.right = destPt->x + cacheEntry->width;
+		invalidRect.bottom = destPt->y + cacheEntry->height;
 
-		region16_union_rect(&(gdi->invalidRegion), &(gdi->invalidRegion), &invalidRect);
+		gdi_gfx_invalidate(engine, &invalidRect);
 	}
 
-	if (!gdi->inGfxFrame)
-		gdi_OutputUpdate(gdi);
+	return gdi_gfx_frame_update(engine);
+}
 
+static int gdi_CacheImportReply(RdpgfxClientContext* context, RDPGFX_CACHE_IMPORT_REPLY_PDU* cacheImportReply)
+{
 	return 1;
 }
 
-int gdi_CacheImportReply(RdpgfxClientContext* context, RDPGFX_CACHE_IMPORT_REPLY_PDU* cacheImportReply)
+static int gdi_EvictCacheEntry(RdpgfxClientContext* context, RDPGFX_EVICT_CACHE_ENTRY_PDU* evictCacheEntry)
 {
+	gdiGfxCacheEntry* cacheEntry;
+
+	cacheEntry = (gdiGfxCacheEntry*) context->GetCacheSlotData(context, evictCacheEntry->cacheSlot);
+
+	gdi_gfx_cache_entry_free(cacheEntry);
+
+	context->SetCacheSlotData(context, evictCacheEntry->cacheSlot, NULL);
+
 	return 1;
 }
 
-int gdi_EvictCacheEntry(RdpgfxClientContext* context, RDPGFX_EVICT_CACHE_ENTRY_PDU* evictCacheEntry)
+static int gdi_ImportCacheEntry(RdpgfxClientContext* context, UINT16 cacheSlot, PERSISTENT_CACHE_ENTRY* importCacheEntry)
 {
 	gdiGfxCacheEntry* cacheEntry;
+	gdiGfxEngine* engine = (gdiGfxEngine*) context->custom;
 
-	cacheEntry = (gdiGfxCacheEntry*) context->GetCacheSlotData(context, evictCacheEntry->cacheSlot);
+	if (importCacheEntry->size < (UINT32) (importCacheEntry->width * importCacheEntry->height * 4))
+		return -1;
+
+	cacheEntry = gdi_gfx_cache_entry_new(engine, importCacheEntry->width, importCacheEntry->height, FALSE);
+
+	if (!cacheEntry)
+		return -1;
+
+	cacheEntry->cacheKey = importCacheEntry->key64;
 
-	if (cacheEntry)
+	freerdp_image_copy(cacheEntry->data, cacheEntry->format, cacheEntry->scanline,
+			0, 0, cacheEntry->width, cacheEntry->height, importCacheEntry->data,
+			PIXEL_FORMAT_XRGB32, importCacheEntry->width * 4, 0, 0, NULL);
+
+	if (context->SetCacheSlotData(context, cacheSlot, (void*) cacheEntry) < 0)
 	{
-		free(cacheEntry->data);
-		free(cacheEntry);
+		gdi_gfx_cache_entry_free(cacheEntry);
+		return -1;
 	}
 
-	context->SetCacheSlotData(context, evictCacheEntry->cacheSlot, NULL);
+	return 1;
+}
+
+static int gdi_ExportCacheEntry(RdpgfxClientContext* context, UINT16 cacheSlot, PERSISTENT_CACHE_ENTRY* exportCacheEntry)
+{
+	UINT32 size;
+	gdiGfxCacheEntry* cacheEntry;
+
+	cacheEntry = (gdiGfxCacheEntry*) context->GetCacheSlotData(context, cacheSlot);
+
+	if (!cacheEntry)
+		return -1;
+
+	size = cacheEntry->width * cacheEntry->height * 4;
+
+	if (size > exportCacheEntry->size)
+		return -1;
+
+	exportCacheEntry->width = (UINT16) cacheEntry->width;
+	exportCacheEntry->height = (UINT16) cacheEntry->height;
+	exportCacheEntry->size = size;
+
+	freerdp_image_copy(exportCacheEntry->data, PIXEL_FORMAT_XRGB32, cacheEntry->width * 4,
+			0, 0, cacheEntry->width, cacheEntry->height, cacheEntry->data,
+			cacheEntry->format, cacheEntry->scanline, 0, 0, NULL);
 
 	return 1;
 }
 
-int gdi_MapSurfaceToOutput(RdpgfxClientContext* context, RDPGFX_MAP_SURFACE_TO_OUTPUT_PDU* surfaceToOutput)
+static int gdi_MapSurfaceToOutput(RdpgfxClientContext* context, RDPGFX_MAP_SURFACE_TO_OUTPUT_PDU* surfaceToOutput)
 {
-	rdpGdi* gdi = (rdpGdi*) context->custom;
+	gdiGfxEngine* engine = (gdiGfxEngine*) context->custom;
 
-	gdi->outputSurfaceId = surfaceToOutput->surfaceId;
+	engine->outputSurfaceId = surfaceToOutput->surfaceId;
 
 	return 1;
 }
 
-int gdi_MapSurfaceToWindow(RdpgfxClientContext* context, RDPGFX_MAP_SURFACE_TO_WINDOW_PDU* surfaceToWindow)
+static int gdi_MapSurfaceToWindow(RdpgfxClientContext* context, RDPGFX_MAP_SURFACE_TO_WINDOW_PDU* surfaceToWindow)
 {
 	return 1;
 }
 
-void gdi_graphics_pipeline_init(rdpGdi* gdi, RdpgfxClientContext* gfx)
+gdiGfxEngine* gdi_gfx_engine_new(RdpgfxClientContext* gfx, rdpCodecs* codecs, UINT32 format)
 {
-	gdi->gfx = gfx;
-	gfx->custom = (void*) gdi;
+	gdiGfxEngine* engine;
+
+	engine = (gdiGfxEngine*) calloc(1, sizeof(gdiGfxEngine));
+
+	if (!engine)
+		return NULL;
+
+	engine->gfx = gfx;
+	engine->codecs = codecs;
+	engine->format = format;
+
+	region16_init(&(engine->invalidRegion));
+
+	gfx->custom = (void*) engine;
 
 	gfx->ResetGraphics = gdi_ResetGraphics;
 	gfx->StartFrame = gdi_StartFrame;
@@ -845,17 +1003,154 @@ void gdi_graphics_pipeline_init(rdpGdi* gdi, RdpgfxClientContext* gfx)
 	gfx->CacheToSurface = gdi_CacheToSurface;
 	gfx->CacheImportReply = gdi_CacheImportReply;
 	gfx->EvictCacheEntry = gdi_EvictCacheEntry;
+	gfx->ImportCacheEntry = gdi_ImportCacheEntry;
+	gfx->ExportCacheEntry = gdi_ExportCacheEntry;
 	gfx->MapSurfaceToOutput = gdi_MapSurfaceToOutput;
 	gfx->MapSurfaceToWindow = gdi_MapSurfaceToWindow;
 
-	region16_init(&(gdi->invalidRegion));
+	return engine;
+}
+
+/**
+ * Surfaces and cache entries still alive are released through the regular
+ * DeleteSurface and EvictCacheEntry paths, so that front-end hooks run for
+ * them before the engine goes away.
+ */
+
+static void gdi_gfx_engine_release(gdiGfxEngine* engine)
+{
+	UINT16 index;
+	UINT16 count = 0;
+	UINT16* pSurfaceIds = NULL;
+	RdpgfxClientContext* context = engine->gfx;
+	RDPGFX_DELETE_SURFACE_PDU deleteSurface;
+	RDPGFX_EVICT_CACHE_ENTRY_PDU evictCacheEntry;
+
+	if (!context || (context->custom != (void*) engine))
+		return;
+
+	if (context->GetSurfaceIds && (context->GetSurfaceIds(context, &pSurfaceIds, &count) > 0))
+	{
+		for (index = 0; index < count; index++)
+		{
+			deleteSurface.surfaceId = pSurfaceIds[index];
+			gdi_DeleteSurface(context, &deleteSurface);
+		}
+
+		free(pSurfaceIds);
+	}
+
+	for (index = 0; index < context->MaxCacheSlots; index++)
+	{
+		if (!context->GetCacheSlotData(context, index))
+			continue;
+
+		evictCacheEntry.cacheSlot = index;
+		gdi_EvictCacheEntry(context, &evictCacheEntry);
+	}
+}
+
+void gdi_gfx_engine_free(gdiGfxEngine* engine)
+{
+	if (!engine)
+		return;
+
+	gdi_gfx_engine_release(engine);
+
+	region16_uninit(&(engine->invalidRegion));
+
+	if (engine->gfx)
+		engine->gfx->custom = NULL;
+
+	free(engine);
+}
+
+/**
+ * Software GDI front-end
+ */
+
+static int gdi_gfx_reset_graphics(gdiGfxEngine* engine, UINT32 width, UINT32 height)
+{
+	rdpGdi* gdi = (rdpGdi*) engine->custom;
+	rdpUpdate* update = gdi->context->update;
+	rdpSettings* settings = gdi->context->settings;
+
+	if ((width != settings->DesktopWidth) || (height != settings->DesktopHeight))
+	{
+		settings->DesktopWidth = width;
+		settings->DesktopHeight = height;
+
+		if (update)
+			update->DesktopResize(gdi->context);
+	}
+
+	return 1;
+}
+
+static int gdi_gfx_present(gdiGfxEngine* engine, gdiGfxSurface* surface, const RECTANGLE_16* rects, UINT32 numRects)
+{
+	UINT32 index;
+	int nDstStep;
+	int nWidth, nHeight;
+	RECTANGLE_16 rect;
+	rdpGdi* gdi = (rdpGdi*) engine->custom;
+	rdpUpdate* update = gdi->context->update;
+
+	nDstStep = gdi->bytesPerPixel * gdi->width;
+
+	update->BeginPaint(gdi->context);
+
+	for (index = 0; index < numRects; index++)
+	{
+		rect = rects[index];
+
+		if (rect.right > gdi->width)
+			rect.right = gdi->width;
+
+		if (rect.bottom > gdi->height)
+			rect.bottom = gdi->height;
+
+		if ((rect.left >= rect.right) || (rect.top >= rect.bottom))
+			continue;
+
+		nWidth = rect.right - rect.left;
+		nHeight = rect.bottom - rect.top;
+
+		freerdp_image_copy(gdi->primary_buffer, gdi->format, nDstStep, rect.left, rect.top, nWidth, nHeight,
+				surface->data, surface->format, surface->scanline, rect.left, rect.top, NULL);
+
+		gdi_InvalidateRegion(gdi->primary->hdc, rect.left, rect.top, nWidth, nHeight);
+	}
+
+	update->EndPaint(gdi->context);
+
+	return 1;
+}
+
+void gdi_graphics_pipeline_init(rdpGdi* gdi, RdpgfxClientContext* gfx)
+{
+	gdiGfxEngine* engine;
+
+	engine = gdi_gfx_engine_new(gfx, gdi->codecs, (!gdi->invert) ? PIXEL_FORMAT_XRGB32 : PIXEL_FORMAT_XBGR32);
+
+	if (!engine)
+	{
+		WLog_ERR(TAG, "unable to create graphics pipeline engine");
+		return;
+	}
+
+	engine->custom = (void*) gdi;
+	engine->ResetGraphics = gdi_gfx_reset_graphics;
+	engine->Present = gdi_gfx_present;
+
+	gdi->gfx = gfx;
+	gdi->gfxEngine = engine;
 }
 
 void gdi_graphics_pipeline_uninit(rdpGdi* gdi, RdpgfxClientContext* gfx)
 {
-	region16_uninit(&(gdi->invalidRegion));
+	gdi_gfx_engine_free(gdi->gfxEngine);
 
+	gdi->gfxEngine = NULL;
 	gdi->gfx = NULL;
-	gfx->custom = NULL;
 }
-
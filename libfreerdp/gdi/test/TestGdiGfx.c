@@ -0,0 +1,374 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gfx.h>
+
+static void* g_Surfaces[4];
+static void* g_CacheSlots[4];
+static UINT32 g_PresentCount;
+static UINT32 g_DeletedCount;
+static RECTANGLE_16 g_PresentExtents;
+
+static int test_set_surface_data(RdpgfxClientContext* context, UINT16 surfaceId, void* pData)
+{
+	if (surfaceId >= 4)
+		return -1;
+
+	g_Surfaces[surfaceId] = pData;
+	return 1;
+}
+
+static void* test_get_surface_data(RdpgfxClientContext* context, UINT16 surfaceId)
+{
+	return (surfaceId < 4) ? g_Surfaces[surfaceId] : NULL;
+}
+
+static int test_get_surface_ids(RdpgfxClientContext* context, UINT16** ppSurfaceIds, UINT16* count)
+{
+	UINT16 index;
+	UINT16* pSurfaceIds;
+
+	pSurfaceIds = (UINT16*) calloc(4, sizeof(UINT16));
+
+	if (!pSurfaceIds)
+		return -1;
+
+	*count = 0;
+
+	for (index = 0; index < 4; index++)
+	{
+		if (g_Surfaces[index])
+			pSurfaceIds[(*count)++] = index;
+	}
+
+	*ppSurfaceIds = pSurfaceIds;
+
+	return 1;
+}
+
+static int test_set_cache_slot_data(RdpgfxClientContext* context, UINT16 cacheSlot, void* pData)
+{
+	if (cacheSlot >= 4)
+		return -1;
+
+	g_CacheSlots[cacheSlot] = pData;
+	return 1;
+}
+
+static void* test_get_cache_slot_data(RdpgfxClientContext* context, UINT16 cacheSlot)
+{
+	return (cacheSlot < 4) ? g_CacheSlots[cacheSlot] : NULL;
+}
+
+static int test_present(gdiGfxEngine* engine, gdiGfxSurface* surface, const RECTANGLE_16* rects, UINT32 numRects)
+{
+	UINT32 index;
+
+	for (index = 0; index < numRects; index++)
+	{
+		if (!g_PresentCount++)
+		{
+			g_PresentExtents = rects[index];
+			continue;
+		}
+
+		g_PresentExtents.left = MIN(g_PresentExtents.left, rects[index].left);
+		g_PresentExtents.top = MIN(g_PresentExtents.top, rects[index].top);
+		g_PresentExtents.right = MAX(g_PresentExtents.right, rects[index].right);
+		g_PresentExtents.bottom = MAX(g_PresentExtents.bottom, rects[index].bottom);
+	}
+
+	return 1;
+}
+
+static void test_surface_deleted(gdiGfxEngine* engine, gdiGfxSurface* surface)
+{
+	g_DeletedCount++;
+}
+
+static UINT32 test_get_pixel(gdiGfxSurface* surface, int x, int y)
+{
+	return *((UINT32*) &surface->data[(y * surface->scanline) + (x * 4)]);
+}
+
+static BOOL test_check_rect(gdiGfxSurface* surface, int left, int top, int right, int bottom, UINT32 color)
+{
+	int x, y;
+
+	for (y = top; y < bottom; y++)
+	{
+		for (x = left; x < right; x++)
+		{
+			if (test_get_pixel(surface, x, y) != color)
+			{
+				printf("pixel (%d,%d) is 0x%08X, expected 0x%08X\n", x, y, test_get_pixel(surface, x, y), color);
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+int TestGdiGfx(int argc, char* argv[])
+{
+	int rc = -1;
+	int x, y;
+	BYTE pixels[16 * 4];
+	gdiGfxSurface* surface;
+	gdiGfxEngine* engine = NULL;
+	RdpgfxClientContext context;
+	RDPGFX_RECT16 fillRect;
+	RDPGFX_POINT16 destPt;
+	RDPGFX_SOLID_FILL_PDU solidFill;
+	RDPGFX_CREATE_SURFACE_PDU createSurface;
+	RDPGFX_DELETE_SURFACE_PDU deleteSurface;
+	RDPGFX_START_FRAME_PDU startFrame;
+	RDPGFX_END_FRAME_PDU endFrame;
+	RDPGFX_SURFACE_TO_SURFACE_PDU surfaceToSurface;
+	RDPGFX_SURFACE_TO_CACHE_PDU surfaceToCache;
+	RDPGFX_CACHE_TO_SURFACE_PDU cacheToSurface;
+	RDPGFX_EVICT_CACHE_ENTRY_PDU evictCacheEntry;
+	RDPGFX_MAP_SURFACE_TO_OUTPUT_PDU surfaceToOutput;
+	RDPGFX_SURFACE_COMMAND cmd;
+
+	ZeroMemory(&context, sizeof(RdpgfxClientContext));
+	ZeroMemory(&startFrame, sizeof(RDPGFX_START_FRAME_PDU));
+	ZeroMemory(&endFrame, sizeof(RDPGFX_END_FRAME_PDU));
+
+	context.SetSurfaceData = test_set_surface_data;
+	context.GetSurfaceData = test_get_surface_data;
+	context.GetSurfaceIds = test_get_surface_ids;
+	context.SetCacheSlotData = test_set_cache_slot_data;
+	context.GetCacheSlotData = test_get_cache_slot_data;
+	context.MaxCacheSlots = 4;
+
+	engine = gdi_gfx_engine_new(&context, NULL, PIXEL_FORMAT_XRGB32);
+
+	if (!engine)
+		return -1;
+
+	engine->Present = test_present;
+	engine->SurfaceDeleted = test_surface_deleted;
+	engine->graphicsReset = TRUE;
+
+	createSurface.surfaceId = 1;
+	createSurface.width = 100;
+	createSurface.height = 50;
+	createSurface.pixelFormat = PIXEL_FORMAT_XRGB_8888;
+
+	if (context.CreateSurface(&context, &createSurface) < 0)
+		goto fail;
+
+	surface = (gdiGfxSurface*) g_Surfaces[1];
+
+	if (!surface || (surface->scanline % 16) || (((ULONG_PTR) surface->data) % 16))
+	{
+		printf("surface buffer is not 16-byte aligned\n");
+		goto fail;
+	}
+
+	surfaceToOutput.surfaceId = 1;
+	surfaceToOutput.reserved = 0;
+	surfaceToOutput.outputOriginX = 0;
+	surfaceToOutput.outputOriginY = 0;
+	context.MapSurfaceToOutput(&context, &surfaceToOutput);
+
+	/* a solid fill inside a frame is presented once, at the end of the frame */
+
+	context.StartFrame(&context, &startFrame);
+
+	fillRect.left = 10;
+	fillRect.top = 5;
+	fillRect.right = 60;
+	fillRect.bottom = 25;
+
+	solidFill.surfaceId = 1;
+	solidFill.fillPixel.B = 0x11;
+	solidFill.fillPixel.G = 0x22;
+	solidFill.fillPixel.R = 0x33;
+	solidFill.fillPixel.XA = 0xFF;
+	solidFill.fillRectCount = 1;
+	solidFill.fillRects = &fillRect;
+
+	if (context.SolidFill(&context, &solidFill) < 0)
+		goto fail;
+
+	if (g_PresentCount != 0)
+		goto fail;
+
+	context.EndFrame(&context, &endFrame);
+
+	if ((g_PresentCount < 1) || (g_PresentExtents.left != 10) || (g_PresentExtents.top != 5) ||
+			(g_PresentExtents.right != 60) || (g_PresentExtents.bottom != 25))
+	{
+		printf("unexpected presented region\n");
+		goto fail;
+	}
+
+	if (!test_check_rect(surface, 10, 5, 60, 25, 0xFF332211) || !test_check_rect(surface, 60, 0, 100, 50, 0))
+		goto fail;
+
+	/* overlapping move on the same surface, down and to the right */
+
+	for (y = 0; y < 20; y++)
+	{
+		for (x = 0; x < 50; x++)
+			*((UINT32*) &surface->data[((y + 5) * surface->scanline) + ((x + 10) * 4)]) = (y << 8) | x;
+	}
+
+	surfaceToSurface.surfaceIdSrc = 1;
+	surfaceToSurface.surfaceIdDest = 1;
+	surfaceToSurface.rectSrc.left = 10;
+	surfaceToSurface.rectSrc.top = 5;
+	surfaceToSurface.rectSrc.right = 60;
+	surfaceToSurface.rectSrc.bottom = 25;
+	surfaceToSurface.destPtsCount = 1;
+	surfaceToSurface.destPts = &destPt;
+	destPt.x = 13;
+	destPt.y = 9;
+
+	if (context.SurfaceToSurface(&context, &surfaceToSurface) < 0)
+		goto fail;
+
+	for (y = 0; y < 20; y++)
+	{
+		for (x = 0; x < 50; x++)
+		{
+			if (test_get_pixel(surface, x + 13, y + 9) != (UINT32) ((y << 8) | x))
+			{
+				printf("overlapping move failed at (%d,%d)\n", x, y);
+				goto fail;
+			}
+		}
+	}
+
+	/* cache round trip */
+
+	surfaceToCache.surfaceId = 1;
+	surfaceToCache.cacheKey = 0x1234;
+	surfaceToCache.cacheSlot = 2;
+	surfaceToCache.rectSrc.left = 13;
+	surfaceToCache.rectSrc.top = 9;
+	surfaceToCache.rectSrc.right = 23;
+	surfaceToCache.rectSrc.bottom = 19;
+
+	if (context.SurfaceToCache(&context, &surfaceToCache) < 0)
+		goto fail;
+
+	cacheToSurface.cacheSlot = 2;
+	cacheToSurface.surfaceId = 1;
+	cacheToSurface.destPtsCount = 1;
+	cacheToSurface.destPts = &destPt;
+	destPt.x = 80;
+	destPt.y = 30;
+
+	if (context.CacheToSurface(&context, &cacheToSurface) < 0)
+		goto fail;
+
+	for (y = 0; y < 10; y++)
+	{
+		for (x = 0; x < 10; x++)
+		{
+			if (test_get_pixel(surface, x + 80, y + 30) != (UINT32) ((y << 8) | x))
+			{
+				printf("cache to surface failed at (%d,%d)\n", x, y);
+				goto fail;
+			}
+		}
+	}
+
+	/* out of bounds destinations are ignored rather than written */
+
+	destPt.x = 95;
+
+	if (context.CacheToSurface(&context, &cacheToSurface) < 0)
+		goto fail;
+
+	if (!test_check_rect(surface, 90, 0, 100, 30, 0))
+		goto fail;
+
+	evictCacheEntry.cacheSlot = 2;
+	context.EvictCacheEntry(&context, &evictCacheEntry);
+
+	if (g_CacheSlots[2])
+		goto fail;
+
+	/* fills crossing the surface edge are clipped, not dropped */
+
+	fillRect.left = 90;
+	fillRect.top = 40;
+	fillRect.right = 120;
+	fillRect.bottom = 70;
+
+	if (context.SolidFill(&context, &solidFill) < 0)
+		goto fail;
+
+	if (!test_check_rect(surface, 90, 40, 100, 50, 0xFF332211) || !test_check_rect(surface, 90, 30, 100, 40, 0))
+		goto fail;
+
+	/* uncompressed data outside of the surface is rejected */
+
+	FillMemory(pixels, sizeof(pixels), 0xAA);
+
+	ZeroMemory(&cmd, sizeof(RDPGFX_SURFACE_COMMAND));
+	cmd.surfaceId = 1;
+	cmd.codecId = RDPGFX_CODECID_UNCOMPRESSED;
+	cmd.left = 98;
+	cmd.top = 0;
+	cmd.right = 102;
+	cmd.bottom = 4;
+	cmd.width = 4;
+	cmd.height = 4;
+	cmd.length = sizeof(pixels);
+	cmd.data = pixels;
+
+	context.SurfaceCommand(&context, &cmd);
+
+	if (!test_check_rect(surface, 98, 0, 100, 4, 0))
+		goto fail;
+
+	cmd.left = 96;
+	cmd.right = 100;
+
+	context.SurfaceCommand(&context, &cmd);
+
+	if (!test_check_rect(surface, 96, 0, 100, 4, 0xAAAAAAAA))
+		goto fail;
+
+	/* freeing the engine deletes what is left through the front-end hooks */
+
+	createSurface.surfaceId = 3;
+
+	if (context.CreateSurface(&context, &createSurface) < 0)
+		goto fail;
+
+	surfaceToCache.cacheSlot = 1;
+
+	if (context.SurfaceToCache(&context, &surfaceToCache) < 0)
+		goto fail;
+
+	gdi_gfx_engine_free(engine);
+	engine = NULL;
+
+	if ((g_DeletedCount != 2) || g_Surfaces[1] || g_Surfaces[3] || g_CacheSlots[1])
+	{
+		printf("surfaces or cache entries left after the engine was freed\n");
+		goto fail;
+	}
+
+	rc = 0;
+
+fail:
+	if (engine)
+	{
+		deleteSurface.surfaceId = 1;
+		context.DeleteSurface(&context, &deleteSurface);
+		gdi_gfx_engine_free(engine);
+	}
+
+	return rc;
+}
@@ -0,0 +1,312 @@
+
+#include <winpr/crt.h>
+#include <winpr/path.h>
+#include <winpr/stream.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/replay.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/cache/cache.h>
+#include <freerdp/codec/rfx.h>
+#include <freerdp/codec/nsc.h>
+#include <freerdp/codec/color.h>
+#include <freerdp/utils/pcap.h>
+
+/**
+ * Session replay benchmark: a recording of update PDUs (see the DumpUpdates
+ * setting) is replayed into a gdi-only client context without a connection,
+ * twice, reporting frames per second and the time spent per update type.
+ * Both runs must leave the same frame buffer behind.
+ *
+ * Without arguments a synthetic recording of RemoteFX, NSCodec and
+ * uncompressed surface bits is generated. A recording made with
+ * /dump-updates can be given instead, followed by the desktop width and
+ * height of the recorded session.
+ */
+
+#define TEST_REPLAY_WIDTH	640
+#define TEST_REPLAY_HEIGHT	480
+#define TEST_REPLAY_FRAMES	48
+
+#define TEST_REPLAY_UPDATETYPE_SURFCMDS		0x04
+#define TEST_REPLAY_CMDTYPE_SET_SURFACE_BITS	0x0001
+
+static const char* test_replay_update_names[REPLAY_UPDATE_TYPE_COUNT] =
+{
+	"Orders", "Bitmap", "Palette", "Synchronize", "SurfCmds", "PtrNull", "PtrDefault", "???",
+	"PtrPosition", "Color", "Cached", "Pointer", "???", "???", "???", "???"
+};
+
+static void test_replay_fill(BYTE* data, int width, int height, int scanline, int frame)
+{
+	int x, y;
+	BYTE* pixel;
+
+	for (y = 0; y < height; y++)
+	{
+		pixel = &data[y * scanline];
+
+		for (x = 0; x < width; x++)
+		{
+			*pixel++ = (BYTE) (x + frame * 4); /* B */
+			*pixel++ = (BYTE) (y + frame * 2); /* G */
+			*pixel++ = (BYTE) (((x / 32) ^ (y / 32)) * 16 + frame); /* R */
+			*pixel++ = 0xFF; /* A */
+		}
+	}
+}
+
+static void test_replay_write_record(rdpPcap* pcap, wStream* s)
+{
+	pcap_add_record(pcap, Stream_Buffer(s), Stream_GetPosition(s));
+	pcap_flush(pcap);
+}
+
+static void test_replay_write_surface_bits(rdpPcap* pcap, wStream* s, BYTE codecID,
+		int x, int y, int width, int height, BYTE* bitmapData, UINT32 bitmapDataLength)
+{
+	Stream_SetPosition(s, 0);
+	Stream_EnsureCapacity(s, bitmapDataLength + 24);
+
+	Stream_Write_UINT8(s, REPLAY_RECORD_FASTPATH_UPDATE);
+	Stream_Write_UINT8(s, TEST_REPLAY_UPDATETYPE_SURFCMDS);
+
+	Stream_Write_UINT16(s, TEST_REPLAY_CMDTYPE_SET_SURFACE_BITS);
+	Stream_Write_UINT16(s, x); /* destLeft */
+	Stream_Write_UINT16(s, y); /* destTop */
+	Stream_Write_UINT16(s, x + width); /* destRight */
+	Stream_Write_UINT16(s, y + height); /* destBottom */
+	Stream_Write_UINT8(s, 32); /* bpp */
+	Stream_Write_UINT8(s, 0); /* reserved1 */
+	Stream_Write_UINT8(s, 0); /* reserved2 */
+	Stream_Write_UINT8(s, codecID);
+	Stream_Write_UINT16(s, width);
+	Stream_Write_UINT16(s, height);
+	Stream_Write_UINT32(s, bitmapDataLength);
+	Stream_Write(s, bitmapData, bitmapDataLength);
+
+	test_replay_write_record(pcap, s);
+
+	Stream_SetPosition(s, 0);
+	Stream_Write_UINT8(s, REPLAY_RECORD_END_PAINT);
+	Stream_Write_UINT8(s, 0);
+
+	test_replay_write_record(pcap, s);
+}
+
+static int test_replay_record(char* filename)
+{
+	int x, y;
+	int frame;
+	int rc = -1;
+	int scanline;
+	RFX_RECT rect;
+	BYTE* image = NULL;
+	wStream* s = NULL;
+	wStream* bs = NULL;
+	rdpPcap* pcap = NULL;
+	RFX_CONTEXT* rfx = NULL;
+	NSC_CONTEXT* nsc = NULL;
+
+	scanline = TEST_REPLAY_WIDTH * 4;
+	image = (BYTE*) malloc(scanline * TEST_REPLAY_HEIGHT);
+	s = Stream_New(NULL, 65536);
+	bs = Stream_New(NULL, 65536);
+	rfx = rfx_context_new(TRUE);
+	nsc = nsc_context_new();
+
+	if (!image || !s || !bs || !rfx || !nsc)
+		goto fail;
+
+	rfx->mode = RLGR3;
+	rfx->width = TEST_REPLAY_WIDTH;
+	rfx->height = TEST_REPLAY_HEIGHT;
+	rfx_context_set_pixel_format(rfx, RDP_PIXEL_FORMAT_B8G8R8A8);
+	nsc_context_set_pixel_format(nsc, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+	pcap = pcap_open(filename, TRUE);
+
+	if (!pcap)
+		goto fail;
+
+	for (frame = 0; frame < TEST_REPLAY_FRAMES; frame++)
+	{
+		test_replay_fill(image, TEST_REPLAY_WIDTH, TEST_REPLAY_HEIGHT, scanline, frame);
+
+		x = (frame * 64) % (TEST_REPLAY_WIDTH - 128);
+		y = (frame * 32) % (TEST_REPLAY_HEIGHT - 128);
+
+		Stream_SetPosition(bs, 0);
+
+		switch (frame % 3)
+		{
+			case 0:
+				rect.x = 0;
+				rect.y = 0;
+				rect.width = TEST_REPLAY_WIDTH;
+				rect.height = TEST_REPLAY_HEIGHT;
+
+				rfx_compose_message(rfx, bs, &rect, 1, image, TEST_REPLAY_WIDTH, TEST_REPLAY_HEIGHT, scanline);
+
+				test_replay_write_surface_bits(pcap, s, RDP_CODEC_ID_REMOTEFX, 0, 0,
+						TEST_REPLAY_WIDTH, TEST_REPLAY_HEIGHT, Stream_Buffer(bs), Stream_GetPosition(bs));
+				break;
+
+			case 1:
+				nsc_compose_message(nsc, bs, &image[y * scanline + x * 4], 128, 128, scanline);
+
+				test_replay_write_surface_bits(pcap, s, RDP_CODEC_ID_NSCODEC, x, y,
+						128, 128, Stream_Buffer(bs), Stream_GetPosition(bs));
+				break;
+
+			default:
+				test_replay_write_surface_bits(pcap, s, RDP_CODEC_ID_NONE, x, y,
+						64, 64, image, 64 * 64 * 4);
+				break;
+		}
+	}
+
+	rc = 0;
+
+fail:
+	if (pcap)
+		pcap_close(pcap);
+
+	rfx_context_free(rfx);
+	nsc_context_free(nsc);
+	Stream_Free(s, TRUE);
+	Stream_Free(bs, TRUE);
+	free(image);
+
+	return rc;
+}
+
+static int test_replay_run(char* filename, int width, int height, UINT32* hash, rdpReplayStats* stats)
+{
+	int index;
+	int size;
+	int status;
+	rdpGdi* gdi;
+	freerdp* instance;
+
+	instance = freerdp_new();
+
+	if (!instance)
+		return -1;
+
+	freerdp_context_new(instance);
+
+	instance->settings->DesktopWidth = width;
+	instance->settings->DesktopHeight = height;
+	instance->settings->ColorDepth = 32;
+
+	gdi_init(instance, CLRCONV_ALPHA | CLRBUF_32BPP, NULL);
+	gdi = instance->context->gdi;
+
+	status = freerdp_replay_updates(instance->context, filename, stats);
+
+	/* FNV-1a over the frame buffer */
+
+	*hash = 2166136261U;
+	size = gdi->width * gdi->height * gdi->bytesPerPixel;
+
+	for (index = 0; index < size; index++)
+		*hash = (*hash ^ gdi->primary_buffer[index]) * 16777619U;
+
+	gdi_free(instance);
+	cache_free(instance->context->cache);
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+
+	return status;
+}
+
+static void test_replay_print_stats(rdpReplayStats* stats, UINT32 hash)
+{
+	int index;
+
+	printf("replayed %d records (%d bytes), %d frames in %.3f s: %.1f frames/s, hash 0x%08X\n",
+			stats->RecordCount, (UINT32) stats->RecordBytes, stats->PaintCount, stats->TotalTime,
+			stats->FramesPerSecond, hash);
+
+	printf("  stages: parse %.3f s, codec %.3f s, gdi %.3f s\n",
+			stats->ParseTime, stats->CodecTime, stats->GdiTime);
+
+	for (index = 0; index < REPLAY_UPDATE_TYPE_COUNT; index++)
+	{
+		if (!stats->UpdateCount[index])
+			continue;
+
+		printf("  %-12s %6d updates %10d bytes %8.3f s\n", test_replay_update_names[index],
+				stats->UpdateCount[index], (UINT32) stats->UpdateBytes[index], stats->UpdateTime[index]);
+	}
+
+	printf("  %-12s %6d paints %12s %8.3f s\n", "EndPaint", stats->PaintCount, "", stats->EndPaintTime);
+}
+
+int TestGdiReplay(int argc, char* argv[])
+{
+	int run;
+	int rc = -1;
+	UINT32 hash[2];
+	char* filename;
+	char* tempPath = NULL;
+	int width = TEST_REPLAY_WIDTH;
+	int height = TEST_REPLAY_HEIGHT;
+	rdpReplayStats stats;
+
+	if (argc > 3)
+	{
+		filename = argv[1];
+		width = atoi(argv[2]);
+		height = atoi(argv[3]);
+	}
+	else
+	{
+		tempPath = GetKnownPath(KNOWN_PATH_TEMP);
+		filename = GetCombinedPath(tempPath, "TestGdiReplay.pcap");
+
+		if (!filename || (test_replay_record(filename) < 0))
+			goto fail;
+	}
+
+	for (run = 0; run < 2; run++)
+	{
+		if (test_replay_run(filename, width, height, &hash[run], &stats) < 0)
+			goto fail;
+
+		test_replay_print_stats(&stats, hash[run]);
+	}
+
+	if (hash[0] != hash[1])
+	{
+		printf("replay output differs between runs\n");
+		goto fail;
+	}
+
+	if (tempPath && (stats.PaintCount != TEST_REPLAY_FRAMES))
+		goto fail;
+
+	/* the generated recording is all surface bits, decoded in the codec stage */
+
+	if (tempPath && ((stats.CodecTime <= 0) ||
+			(stats.ParseTime + stats.CodecTime + stats.GdiTime > stats.TotalTime)))
+	{
+		printf("unexpected stage timing\n");
+		goto fail;
+	}
+
+	rc = 0;
+
+fail:
+	if (tempPath)
+	{
+		if (filename)
+			DeleteFileA(filename);
+
+		free(filename);
+		free(tempPath);
+	}
+
+	return rc;
+}
@@ -0,0 +1,214 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * AVX2 Color conversion operations.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* before any winpr header: winpr/crt.h may redefine the __lzcnt intrinsics, not the other way around */
+#include <immintrin.h>
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <winpr/sysinfo.h>
+
+#include "prim_internal.h"
+#include "prim_colors.h"
+
+/* These are the SSE2 routines widened to 16 coefficients per instruction,
+ * they use the same fixed-point factors and produce identical results.
+ * Rows which are not a multiple of 16 coefficients are left to SSE2.
+ */
+
+#define _mm256_between_epi16(_val, _min, _max) \
+	do { _val = _mm256_min_epi16(_max, _mm256_max_epi16(_val, _min)); } while (0)
+
+/*---------------------------------------------------------------------------*/
+pstatus_t avx2_yCbCrToRGB_16s16s_P3P3(
+	const INT16 *pSrc[3],
+	int srcStep,
+	INT16 *pDst[3],
+	int dstStep,
+	const prim_size_t *roi)	/* region of interest */
+{
+	__m256i zero, max, r_cr, g_cb, g_cr, b_cb, c4096;
+	const INT16 *y_buf, *cb_buf, *cr_buf;
+	INT16 *r_buf, *g_buf, *b_buf;
+	int srcbump, dstbump, yp, i;
+
+	if ((roi->width & 0x0F) || (srcStep & 31) || (dstStep & 31))
+		return sse2_yCbCrToRGB_16s16s_P3P3(pSrc, srcStep, pDst, dstStep, roi);
+
+	zero = _mm256_setzero_si256();
+	max = _mm256_set1_epi16(255);
+
+	r_cr = _mm256_set1_epi16(22986);	/*  1.403 << 14 */
+	g_cb = _mm256_set1_epi16(-5636);	/* -0.344 << 14 */
+	g_cr = _mm256_set1_epi16(-11698);	/* -0.714 << 14 */
+	b_cb = _mm256_set1_epi16(28999);	/*  1.770 << 14 */
+	c4096 = _mm256_set1_epi16(4096);
+
+	y_buf  = pSrc[0];
+	cb_buf = pSrc[1];
+	cr_buf = pSrc[2];
+	r_buf  = pDst[0];
+	g_buf  = pDst[1];
+	b_buf  = pDst[2];
+
+	srcbump = srcStep / sizeof(INT16);
+	dstbump = dstStep / sizeof(INT16);
+
+	for (yp = 0; yp < roi->height; ++yp)
+	{
+		for (i = 0; i < roi->width; i += 16)
+		{
+			/* See sse2_yCbCrToRGB_16s16s_P3P3() for the derivation. */
+			__m256i y, cb, cr, r, g, b;
+
+			/* y = (y_r_buf[i] + 4096) >> 2 */
+			y = _mm256_loadu_si256((const __m256i*) (y_buf + i));
+			y = _mm256_add_epi16(y, c4096);
+			y = _mm256_srai_epi16(y, 2);
+			cb = _mm256_loadu_si256((const __m256i*) (cb_buf + i));
+			cr = _mm256_loadu_si256((const __m256i*) (cr_buf + i));
+
+			/* (y + HIWORD(cr*22986)) >> 3 */
+			r = _mm256_add_epi16(y, _mm256_mulhi_epi16(cr, r_cr));
+			r = _mm256_srai_epi16(r, 3);
+			_mm256_between_epi16(r, zero, max);
+			_mm256_storeu_si256((__m256i*) (r_buf + i), r);
+
+			/* (y + HIWORD(cb*-5636) + HIWORD(cr*-11698)) >> 3 */
+			g = _mm256_add_epi16(y, _mm256_mulhi_epi16(cb, g_cb));
+			g = _mm256_add_epi16(g, _mm256_mulhi_epi16(cr, g_cr));
+			g = _mm256_srai_epi16(g, 3);
+			_mm256_between_epi16(g, zero, max);
+			_mm256_storeu_si256((__m256i*) (g_buf + i), g);
+
+			/* (y + HIWORD(cb*28999)) >> 3 */
+			b = _mm256_add_epi16(y, _mm256_mulhi_epi16(cb, b_cb));
+			b = _mm256_srai_epi16(b, 3);
+			_mm256_between_epi16(b, zero, max);
+			_mm256_storeu_si256((__m256i*) (b_buf + i), b);
+		}
+
+		y_buf  += srcbump;
+		cb_buf += srcbump;
+		cr_buf += srcbump;
+		r_buf += dstbump;
+		g_buf += dstbump;
+		b_buf += dstbump;
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/*---------------------------------------------------------------------------*/
+pstatus_t avx2_RGBToYCbCr_16s16s_P3P3(
+	const INT16 *pSrc[3],
+	int srcStep,
+	INT16 *pDst[3],
+	int dstStep,
+	const prim_size_t *roi)	/* region of interest */
+{
+	__m256i min, max, y_r, y_g, y_b, cb_r, cb_g, cb_b, cr_r, cr_g, cr_b;
+	const INT16 *r_buf, *g_buf, *b_buf;
+	INT16 *y_buf, *cb_buf, *cr_buf;
+	int srcbump, dstbump, yp, i;
+
+	if ((roi->width & 0x0F) || (srcStep & 31) || (dstStep & 31))
+		return sse2_RGBToYCbCr_16s16s_P3P3(pSrc, srcStep, pDst, dstStep, roi);
+
+	min = _mm256_set1_epi16(-(128 << 5));
+	max = _mm256_set1_epi16(127 << 5);
+
+	y_r  = _mm256_set1_epi16(9798);   /*  0.299000 << 15 */
+	y_g  = _mm256_set1_epi16(19235);  /*  0.587000 << 15 */
+	y_b  = _mm256_set1_epi16(3735);   /*  0.114000 << 15 */
+	cb_r = _mm256_set1_epi16(-5535);  /* -0.168935 << 15 */
+	cb_g = _mm256_set1_epi16(-10868); /* -0.331665 << 15 */
+	cb_b = _mm256_set1_epi16(16403);  /*  0.500590 << 15 */
+	cr_r = _mm256_set1_epi16(16377);  /*  0.499813 << 15 */
+	cr_g = _mm256_set1_epi16(-13714); /* -0.418531 << 15 */
+	cr_b = _mm256_set1_epi16(-2663);  /* -0.081282 << 15 */
+
+	r_buf  = pSrc[0];
+	g_buf  = pSrc[1];
+	b_buf  = pSrc[2];
+	y_buf  = pDst[0];
+	cb_buf = pDst[1];
+	cr_buf = pDst[2];
+
+	srcbump = srcStep / sizeof(INT16);
+	dstbump = dstStep / sizeof(INT16);
+
+	for (yp = 0; yp < roi->height; ++yp)
+	{
+		for (i = 0; i < roi->width; i += 16)
+		{
+			/* See sse2_RGBToYCbCr_16s16s_P3P3() for the derivation. */
+			__m256i r, g, b, y, cb, cr;
+
+			r = _mm256_loadu_si256((const __m256i*) (r_buf + i));
+			g = _mm256_loadu_si256((const __m256i*) (g_buf + i));
+			b = _mm256_loadu_si256((const __m256i*) (b_buf + i));
+
+			/* r<<6; g<<6; b<<6 */
+			r = _mm256_slli_epi16(r, 6);
+			g = _mm256_slli_epi16(g, 6);
+			b = _mm256_slli_epi16(b, 6);
+
+			/* y = HIWORD(r*y_r) + HIWORD(g*y_g) + HIWORD(b*y_b) + min */
+			y = _mm256_mulhi_epi16(r, y_r);
+			y = _mm256_add_epi16(y, _mm256_mulhi_epi16(g, y_g));
+			y = _mm256_add_epi16(y, _mm256_mulhi_epi16(b, y_b));
+			y = _mm256_add_epi16(y, min);
+			_mm256_between_epi16(y, min, max);
+			_mm256_storeu_si256((__m256i*) (y_buf + i), y);
+
+			/* cb = HIWORD(r*cb_r) + HIWORD(g*cb_g) + HIWORD(b*cb_b) */
+			cb = _mm256_mulhi_epi16(r, cb_r);
+			cb = _mm256_add_epi16(cb, _mm256_mulhi_epi16(g, cb_g));
+			cb = _mm256_add_epi16(cb, _mm256_mulhi_epi16(b, cb_b));
+			_mm256_between_epi16(cb, min, max);
+			_mm256_storeu_si256((__m256i*) (cb_buf + i), cb);
+
+			/* cr = HIWORD(r*cr_r) + HIWORD(g*cr_g) + HIWORD(b*cr_b) */
+			cr = _mm256_mulhi_epi16(r, cr_r);
+			cr = _mm256_add_epi16(cr, _mm256_mulhi_epi16(g, cr_g));
+			cr = _mm256_add_epi16(cr, _mm256_mulhi_epi16(b, cr_b));
+			_mm256_between_epi16(cr, min, max);
+			_mm256_storeu_si256((__m256i*) (cr_buf + i), cr);
+		}
+
+		r_buf += srcbump;
+		g_buf += srcbump;
+		b_buf += srcbump;
+		y_buf += dstbump;
+		cb_buf += dstbump;
+		cr_buf += dstbump;
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_colors_avx2(primitives_t* prims)
+{
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		prims->yCbCrToRGB_16s16s_P3P3 = avx2_yCbCrToRGB_16s16s_P3P3;
+		prims->RGBToYCbCr_16s16s_P3P3 = avx2_RGBToYCbCr_16s16s_P3P3;
+	}
+}
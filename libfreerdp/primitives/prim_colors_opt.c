@@ -294,7 +294,7 @@ pstatus_t sse2_RGBToYCbCr_16s16s_P3P3(
 			 * values used in the multiplication by << 5+(16-n).
 			 */
 			__m128i r, g, b, y, cb, cr;
-			r = _mm_load_si128(y_buf+i);
+			r = _mm_load_si128(r_buf+i);
 			g = _mm_load_si128(g_buf+i);
 			b = _mm_load_si128(b_buf+i);
 
@@ -552,6 +552,9 @@ void primitives_init_colors_opt(primitives_t* prims)
 		prims->yCbCrToRGB_16s16s_P3P3 = sse2_yCbCrToRGB_16s16s_P3P3;
 		prims->RGBToYCbCr_16s16s_P3P3 = sse2_RGBToYCbCr_16s16s_P3P3;
 	}
+#if defined(WITH_AVX2)
+	primitives_init_colors_avx2(prims);
+#endif
 #elif defined(WITH_NEON)
 	if (IsProcessorFeaturePresent(PF_ARM_NEON_INSTRUCTIONS_AVAILABLE))
 	{
@@ -33,6 +33,8 @@ extern pstatus_t general_yCbCrToRGB_16s16s_P3P3(const INT16 *pSrc[3],
 	int srcStep, INT16 *pDst[3], int dstStep, const prim_size_t *roi);
 extern pstatus_t sse2_yCbCrToRGB_16s16s_P3P3(const INT16 *pSrc[3],
 	int srcStep, INT16 *pDst[3], int dstStep, const prim_size_t *roi);
+extern pstatus_t avx2_yCbCrToRGB_16s16s_P3P3(const INT16 *pSrc[3],
+	int srcStep, INT16 *pDst[3], int dstStep, const prim_size_t *roi);
 extern pstatus_t neon_yCbCrToRGB_16s16s_P3P3(const INT16 *pSrc[3],
 	int srcStep, INT16 *pDst[3], int dstStep, const prim_size_t *roi);
 
@@ -192,6 +194,23 @@ int test_yCbCrToRGB_16s16s_P3P3_func(void)
 			}
 		}
 	}
+#ifdef WITH_AVX2
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		strcat(testStr, " AVX2");
+		avx2_yCbCrToRGB_16s16s_P3P3(in, 64*2, out2, 64*2, &roi);
+		for (i=0; i<4096; ++i)
+		{
+			if ((ABS(r1[i]-r2[i]) > 1)
+					|| (ABS(g1[i]-g2[i]) > 1)
+					|| (ABS(b1[i]-b2[i]) > 1)) {
+				printf("YCbCrToRGB-AVX2 FAIL[%d]: %d,%d,%d vs %d,%d,%d\n", i,
+					r1[i],g1[i],b1[i], r2[i],g2[i],b2[i]);
+				failed = 1;
+			}
+		}
+	}
+#endif /* WITH_AVX2 */
 #endif /* i386 */
 	if (!failed) printf("All yCbCrToRGB_16s16s_P3P3 tests passed (%s).\n", testStr);
 	return (failed > 0) ? FAILURE : SUCCESS;
@@ -0,0 +1,449 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Clipboard File Transfer Utils
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/endian.h>
+#include <winpr/stream.h>
+
+#include <freerdp/log.h>
+#include <freerdp/utils/cliprdr.h>
+
+#define TAG FREERDP_TAG("utils.cliprdr")
+
+/**
+ * FileGroupDescriptorW:
+ * cItems (4 bytes) followed by cItems FILEDESCRIPTORW of 592 bytes each.
+ * The file name is kept as the UTF-16 string of the descriptor.
+ */
+
+int cliprdr_parse_file_list(const BYTE* format_data, UINT32 format_data_length,
+		CLIPRDR_FILEDESCRIPTOR** file_descriptor_array, UINT32* file_descriptor_count)
+{
+	wStream* s;
+	UINT32 index;
+	UINT32 count;
+	CLIPRDR_FILEDESCRIPTOR* files;
+
+	if (!format_data || !file_descriptor_array || !file_descriptor_count)
+		return -1;
+
+	if (format_data_length < 4)
+		return -1;
+
+	s = Stream_New((BYTE*) format_data, format_data_length);
+
+	if (!s)
+		return -1;
+
+	Stream_Read_UINT32(s, count); /* cItems (4 bytes) */
+
+	if (Stream_GetRemainingLength(s) / CLIPRDR_FILEDESCRIPTOR_SIZE < count)
+	{
+		WLog_ERR(TAG, "file list of %u items does not fit in %u bytes", count, format_data_length);
+		Stream_Free(s, FALSE);
+		return -1;
+	}
+
+	files = NULL;
+
+	if (count)
+	{
+		files = (CLIPRDR_FILEDESCRIPTOR*) calloc(count, sizeof(CLIPRDR_FILEDESCRIPTOR));
+
+		if (!files)
+		{
+			Stream_Free(s, FALSE);
+			return -1;
+		}
+	}
+
+	for (index = 0; index < count; index++)
+	{
+		CLIPRDR_FILEDESCRIPTOR* file = &files[index];
+
+		Stream_Read_UINT32(s, file->flags); /* flags (4 bytes) */
+		Stream_Read(s, file->reserved1, 32); /* reserved1 (32 bytes) */
+		Stream_Read_UINT32(s, file->fileAttributes); /* fileAttributes (4 bytes) */
+		Stream_Read(s, file->reserved2, 16); /* reserved2 (16 bytes) */
+		Stream_Read_UINT64(s, file->lastWriteTime); /* lastWriteTime (8 bytes) */
+		Stream_Read_UINT32(s, file->fileSizeHigh); /* fileSizeHigh (4 bytes) */
+		Stream_Read_UINT32(s, file->fileSizeLow); /* fileSizeLow (4 bytes) */
+		Stream_Read(s, file->fileName, 520); /* cFileName (520 bytes) */
+
+		/* the name is not trusted to be terminated */
+		file->fileName[518] = '\0';
+		file->fileName[519] = '\0';
+	}
+
+	Stream_Free(s, FALSE);
+
+	*file_descriptor_array = files;
+	*file_descriptor_count = count;
+
+	return 0;
+}
+
+int cliprdr_serialize_file_list(const CLIPRDR_FILEDESCRIPTOR* file_descriptor_array,
+		UINT32 file_descriptor_count, BYTE** format_data, UINT32* format_data_length)
+{
+	wStream* s;
+	UINT32 index;
+
+	if ((!file_descriptor_array && file_descriptor_count) || !format_data || !format_data_length)
+		return -1;
+
+	if (file_descriptor_count > (0xFFFFFFFF - 4) / CLIPRDR_FILEDESCRIPTOR_SIZE)
+		return -1;
+
+	s = Stream_New(NULL, 4 + file_descriptor_count * CLIPRDR_FILEDESCRIPTOR_SIZE);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT32(s, file_descriptor_count); /* cItems (4 bytes) */
+
+	for (index = 0; index < file_descriptor_count; index++)
+	{
+		const CLIPRDR_FILEDESCRIPTOR* file = &file_descriptor_array[index];
+
+		Stream_Write_UINT32(s, file->flags); /* flags (4 bytes) */
+		Stream_Write(s, file->reserved1, 32); /* reserved1 (32 bytes) */
+		Stream_Write_UINT32(s, file->fileAttributes); /* fileAttributes (4 bytes) */
+		Stream_Write(s, file->reserved2, 16); /* reserved2 (16 bytes) */
+		Stream_Write_UINT64(s, file->lastWriteTime); /* lastWriteTime (8 bytes) */
+		Stream_Write_UINT32(s, file->fileSizeHigh); /* fileSizeHigh (4 bytes) */
+		Stream_Write_UINT32(s, file->fileSizeLow); /* fileSizeLow (4 bytes) */
+		Stream_Write(s, file->fileName, 520); /* cFileName (520 bytes) */
+	}
+
+	*format_data = Stream_Buffer(s);
+	*format_data_length = (UINT32) Stream_GetPosition(s);
+
+	Stream_Free(s, FALSE);
+
+	return 0;
+}
+
+static void cliprdr_file_transfer_fail(CLIPRDR_FILE_TRANSFER* transfer)
+{
+	UINT32 index;
+
+	/* responses still in flight are ignored from now on */
+	for (index = 0; index < CLIPRDR_FILE_TRANSFER_MAX_REQUESTS; index++)
+		transfer->ranges[index].pending = FALSE;
+
+	transfer->outstanding = 0;
+	transfer->state = CLIPRDR_FILE_TRANSFER_FAILED;
+}
+
+static int cliprdr_file_transfer_request(CLIPRDR_FILE_TRANSFER* transfer, CLIPRDR_FILE_RANGE* range,
+		UINT32 dwFlags, UINT64 offset, UINT32 length, UINT32 now)
+{
+	CLIPRDR_FILE_CONTENTS_REQUEST request;
+
+	range->pending = TRUE;
+	range->streamId = transfer->streamId++;
+	range->dwFlags = dwFlags;
+	range->offset = offset;
+	range->length = length;
+	range->sent = now;
+
+	transfer->outstanding++;
+	transfer->requests++;
+
+	if (transfer->outstanding > transfer->peakOutstanding)
+		transfer->peakOutstanding = transfer->outstanding;
+
+	ZeroMemory(&request, sizeof(CLIPRDR_FILE_CONTENTS_REQUEST));
+
+	request.msgType = CB_FILECONTENTS_REQUEST;
+	request.dataLen = 28; /* fixed */
+	request.streamId = range->streamId;
+	request.listIndex = transfer->listIndex;
+	request.dwFlags = dwFlags;
+	request.nPositionLow = (UINT32) (offset & 0xFFFFFFFF);
+	request.nPositionHigh = (UINT32) (offset >> 32);
+	request.cbRequested = (dwFlags & FILECONTENTS_SIZE) ? sizeof(UINT64) : length;
+	request.clipDataId = transfer->clipDataId;
+
+	if (transfer->Request(transfer, &request) < 0)
+	{
+		WLog_ERR(TAG, "failed to request %u bytes at %llu of file %u",
+				length, (unsigned long long) offset, transfer->listIndex);
+		cliprdr_file_transfer_fail(transfer);
+		return -1;
+	}
+
+	return 1;
+}
+
+static CLIPRDR_FILE_RANGE* cliprdr_file_transfer_free_range(CLIPRDR_FILE_TRANSFER* transfer)
+{
+	UINT32 index;
+
+	for (index = 0; index < CLIPRDR_FILE_TRANSFER_MAX_REQUESTS; index++)
+	{
+		if (!transfer->ranges[index].pending)
+			return &transfer->ranges[index];
+	}
+
+	return NULL;
+}
+
+static void cliprdr_file_transfer_complete(CLIPRDR_FILE_TRANSFER* transfer)
+{
+	if (!transfer->outstanding && (transfer->received >= transfer->size))
+		transfer->state = CLIPRDR_FILE_TRANSFER_DONE;
+}
+
+/* keeps the window of requests full until the whole file has been requested */
+static int cliprdr_file_transfer_fill(CLIPRDR_FILE_TRANSFER* transfer, UINT32 now)
+{
+	UINT32 length;
+	UINT32 maxRequests;
+	CLIPRDR_FILE_RANGE* range;
+
+	maxRequests = transfer->maxRequests;
+
+	if ((maxRequests < 1) || (maxRequests > CLIPRDR_FILE_TRANSFER_MAX_REQUESTS))
+		maxRequests = CLIPRDR_FILE_TRANSFER_MAX_REQUESTS;
+
+	while ((transfer->outstanding < maxRequests) && (transfer->offset < transfer->size))
+	{
+		range = cliprdr_file_transfer_free_range(transfer);
+
+		if (!range)
+			break;
+
+		length = transfer->chunkSize;
+
+		if (transfer->size - transfer->offset < length)
+			length = (UINT32) (transfer->size - transfer->offset);
+
+		if (cliprdr_file_transfer_request(transfer, range, FILECONTENTS_RANGE,
+				transfer->offset, length, now) < 0)
+			return -1;
+
+		transfer->offset += length;
+	}
+
+	cliprdr_file_transfer_complete(transfer);
+
+	return 1;
+}
+
+/**
+ * Only a range requested at the current chunk size is used to adapt it, the
+ * answers to requests issued before the last change say nothing about it.
+ */
+
+static void cliprdr_file_transfer_adapt(CLIPRDR_FILE_TRANSFER* transfer, CLIPRDR_FILE_RANGE* range,
+		UINT32 length, UINT32 now)
+{
+	UINT32 delay;
+
+	if ((range->length != transfer->chunkSize) || (length != range->length))
+		return;
+
+	delay = now - range->sent;
+
+	if (delay < CLIPRDR_FILE_TRANSFER_TARGET_DELAY / 2)
+	{
+		if (transfer->chunkSize < transfer->maxChunkSize)
+			transfer->chunkSize *= 2;
+	}
+	else if (delay > CLIPRDR_FILE_TRANSFER_TARGET_DELAY)
+	{
+		if (transfer->chunkSize > transfer->minChunkSize)
+			transfer->chunkSize /= 2;
+	}
+
+	if (transfer->chunkSize > transfer->maxChunkSize)
+		transfer->chunkSize = transfer->maxChunkSize;
+
+	if (transfer->chunkSize < transfer->minChunkSize)
+		transfer->chunkSize = transfer->minChunkSize;
+}
+
+/**
+ * The size is taken from the descriptor if it has one, otherwise it is
+ * requested first. The chunk size is kept from the previous file as it
+ * belongs to the link.
+ */
+
+int cliprdr_file_transfer_start(CLIPRDR_FILE_TRANSFER* transfer, UINT32 listIndex,
+		UINT32 clipDataId, const CLIPRDR_FILEDESCRIPTOR* descriptor, UINT32 now)
+{
+	if (!transfer || !transfer->Request || !transfer->Write)
+		return -1;
+
+	cliprdr_file_transfer_cancel(transfer);
+
+	transfer->listIndex = listIndex;
+	transfer->clipDataId = clipDataId;
+	transfer->size = 0;
+	transfer->offset = 0;
+	transfer->received = 0;
+	transfer->peakOutstanding = 0;
+	transfer->requests = 0;
+
+	if (descriptor && (descriptor->flags & FD_FILESIZE))
+	{
+		transfer->size = (((UINT64) descriptor->fileSizeHigh) << 32) | descriptor->fileSizeLow;
+		transfer->state = CLIPRDR_FILE_TRANSFER_DATA;
+
+		return cliprdr_file_transfer_fill(transfer, now);
+	}
+
+	transfer->state = CLIPRDR_FILE_TRANSFER_SIZE;
+
+	return cliprdr_file_transfer_request(transfer, &transfer->ranges[0], FILECONTENTS_SIZE, 0, 0, now);
+}
+
+/**
+ * Returns 0 if the response does not belong to the transfer, -1 if the
+ * transfer failed and 1 otherwise. The transfer is complete once its state
+ * is CLIPRDR_FILE_TRANSFER_DONE.
+ */
+
+int cliprdr_file_transfer_response(CLIPRDR_FILE_TRANSFER* transfer,
+		const CLIPRDR_FILE_CONTENTS_RESPONSE* response, UINT32 now)
+{
+	UINT32 index;
+	UINT32 length;
+	UINT64 offset;
+	CLIPRDR_FILE_RANGE* range = NULL;
+
+	if (!transfer || !response)
+		return -1;
+
+	if ((transfer->state != CLIPRDR_FILE_TRANSFER_SIZE) && (transfer->state != CLIPRDR_FILE_TRANSFER_DATA))
+		return 0;
+
+	for (index = 0; index < CLIPRDR_FILE_TRANSFER_MAX_REQUESTS; index++)
+	{
+		if (transfer->ranges[index].pending && (transfer->ranges[index].streamId == response->streamId))
+		{
+			range = &transfer->ranges[index];
+			break;
+		}
+	}
+
+	if (!range)
+		return 0;
+
+	range->pending = FALSE;
+	transfer->outstanding--;
+
+	if (response->msgFlags & CB_RESPONSE_FAIL)
+	{
+		WLog_ERR(TAG, "request for file %u failed at %llu",
+				transfer->listIndex, (unsigned long long) range->offset);
+		cliprdr_file_transfer_fail(transfer);
+		return -1;
+	}
+
+	if (range->dwFlags & FILECONTENTS_SIZE)
+	{
+		if ((response->cbRequested < sizeof(UINT64)) || !response->requestedData)
+		{
+			cliprdr_file_transfer_fail(transfer);
+			return -1;
+		}
+
+		Data_Read_UINT64(response->requestedData, transfer->size);
+		transfer->state = CLIPRDR_FILE_TRANSFER_DATA;
+
+		return cliprdr_file_transfer_fill(transfer, now);
+	}
+
+	length = response->cbRequested;
+
+	/* a range that comes back empty before the end would be requested forever */
+	if ((length > range->length) || (!length && range->length) || (length && !response->requestedData))
+	{
+		WLog_ERR(TAG, "invalid response of %u bytes to a request for %u bytes of file %u",
+				length, range->length, transfer->listIndex);
+		cliprdr_file_transfer_fail(transfer);
+		return -1;
+	}
+
+	if (length && (transfer->Write(transfer, range->offset, response->requestedData, length) < 0))
+	{
+		cliprdr_file_transfer_fail(transfer);
+		return -1;
+	}
+
+	transfer->received += length;
+	cliprdr_file_transfer_adapt(transfer, range, length, now);
+
+	/* the responder may return less than requested, the rest is asked for again */
+	if (length < range->length)
+	{
+		offset = range->offset + length;
+		length = range->length - length;
+
+		if (cliprdr_file_transfer_request(transfer, range, FILECONTENTS_RANGE, offset, length, now) < 0)
+			return -1;
+	}
+
+	if (cliprdr_file_transfer_fill(transfer, now) < 0)
+		return -1;
+
+	return 1;
+}
+
+/* responses still in flight are ignored, the streams they belong to are not reused */
+void cliprdr_file_transfer_cancel(CLIPRDR_FILE_TRANSFER* transfer)
+{
+	UINT32 index;
+
+	if (!transfer)
+		return;
+
+	for (index = 0; index < CLIPRDR_FILE_TRANSFER_MAX_REQUESTS; index++)
+		transfer->ranges[index].pending = FALSE;
+
+	transfer->outstanding = 0;
+	transfer->state = CLIPRDR_FILE_TRANSFER_IDLE;
+}
+
+CLIPRDR_FILE_TRANSFER* cliprdr_file_transfer_new(void)
+{
+	CLIPRDR_FILE_TRANSFER* transfer;
+
+	transfer = (CLIPRDR_FILE_TRANSFER*) calloc(1, sizeof(CLIPRDR_FILE_TRANSFER));
+
+	if (!transfer)
+		return NULL;
+
+	transfer->chunkSize = CLIPRDR_FILE_TRANSFER_START_CHUNK;
+	transfer->minChunkSize = CLIPRDR_FILE_TRANSFER_MIN_CHUNK;
+	transfer->maxChunkSize = CLIPRDR_FILE_TRANSFER_MAX_CHUNK;
+	transfer->maxRequests = CLIPRDR_FILE_TRANSFER_MAX_REQUESTS;
+
+	return transfer;
+}
+
+void cliprdr_file_transfer_free(CLIPRDR_FILE_TRANSFER* transfer)
+{
+	free(transfer);
+}
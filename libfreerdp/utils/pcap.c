@@ -205,12 +205,21 @@ rdpPcap* pcap_open(char* name, BOOL write)
 
 void pcap_flush(rdpPcap* pcap)
 {
+	pcap_record* record;
+
+	/* record data belongs to the caller, only the list entries are freed */
+
 	while (pcap->record != NULL)
 	{
-		pcap_write_record(pcap, pcap->record);
-		pcap->record = pcap->record->next;
+		record = pcap->record;
+		pcap_write_record(pcap, record);
+		pcap->record = record->next;
+		free(record);
 	}
 
+	pcap->head = NULL;
+	pcap->tail = NULL;
+
 	if (pcap->fp != NULL)
 		fflush(pcap->fp);
 }
@@ -33,7 +33,10 @@
 static const AUDIO_FORMAT test_audio_formats[] =
 {
 	{ WAVE_FORMAT_PCM, 2, 44100, 176400, 4, 16, 0, NULL },
-	{ WAVE_FORMAT_ALAW, 2, 22050, 44100, 2, 8, 0, NULL }
+	{ WAVE_FORMAT_ALAW, 2, 22050, 44100, 2, 8, 0, NULL },
+#if defined(WITH_OPUS)
+	{ WAVE_FORMAT_OPUS, 2, 48000, 8000, 160, 0, 0, NULL },
+#endif
 };
 
 static void sf_peer_audin_opening(audin_server_context* context)
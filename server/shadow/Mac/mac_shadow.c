@@ -362,7 +362,8 @@ void (^mac_capture_stream_handler)(CGDisplayStreamFrameStatus, uint64_t, IOSurfa
 			
 		count = ArrayList_Count(server->clients);
 			
-		InitializeSynchronizationBarrier(&(subsystem->barrier), count + 1, -1);
+		InitializeSynchronizationBarrier(&(subsystem->barrier),
+				shadow_subsystem_get_barrier_count((rdpShadowSubsystem*) subsystem, count) + 1, -1);
 			
 		SetEvent(subsystem->updateEvent);
 			
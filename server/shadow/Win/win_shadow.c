@@ -287,7 +287,8 @@ int win_shadow_surface_copy(winShadowSubsystem* subsystem)
 
 	count = ArrayList_Count(server->clients);
 
-	InitializeSynchronizationBarrier(&(subsystem->barrier), count + 1, -1);
+	InitializeSynchronizationBarrier(&(subsystem->barrier),
+			shadow_subsystem_get_barrier_count((rdpShadowSubsystem*) subsystem, count) + 1, -1);
 
 	SetEvent(subsystem->updateEvent);
 
@@ -708,7 +708,8 @@ int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 
 		count = ArrayList_Count(server->clients);
 
-		InitializeSynchronizationBarrier(&(subsystem->barrier), count + 1, -1);
+		InitializeSynchronizationBarrier(&(subsystem->barrier),
+				shadow_subsystem_get_barrier_count((rdpShadowSubsystem*) subsystem, count) + 1, -1);
 
 		SetEvent(subsystem->updateEvent);
 
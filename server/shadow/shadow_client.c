@@ -138,6 +138,8 @@ BOOL shadow_client_capabilities(freerdp_peer* peer)
 	return TRUE;
 }
 
+static BOOL shadow_client_reactor_add_events(rdpShadowClient* client);
+
 BOOL shadow_client_post_connect(freerdp_peer* peer)
 {
 	int authStatus;
@@ -178,6 +180,9 @@ BOOL shadow_client_post_connect(freerdp_peer* peer)
 
 	peer->update->DesktopResize(peer->update->context);
 
+	if (server->reactor && !shadow_client_reactor_add_events(client))
+		return FALSE;
+
 	shadow_client_channels_post_connect(client);
 
 	invalidRect.left = 0;
@@ -217,10 +222,22 @@ BOOL shadow_client_post_connect(freerdp_peer* peer)
 
 void shadow_client_refresh_rect(rdpShadowClient* client, BYTE count, RECTANGLE_16* areas)
 {
+	int index;
 	wMessage message = { 0 };
 	SHADOW_MSG_IN_REFRESH_OUTPUT* wParam;
 	wMessagePipe* MsgPipe = client->subsystem->MsgPipe;
 
+	/* refreshed areas have to be sent again even if they did not change */
+
+	if (client->encoder && client->encoder->rfx)
+	{
+		if (!areas)
+			rfx_context_invalidate_tiles(client->encoder->rfx, NULL);
+
+		for (index = 0; areas && (index < count); index++)
+			rfx_context_invalidate_tiles(client->encoder->rfx, &areas[index]);
+	}
+
 	wParam = (SHADOW_MSG_IN_REFRESH_OUTPUT*) calloc(1, sizeof(SHADOW_MSG_IN_REFRESH_OUTPUT));
 
 	if (!wParam || !areas)
@@ -343,7 +360,6 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 	wStream* s;
 	int nSrcStep;
 	BYTE* pSrcData;
-	int numMessages;
 	UINT32 frameId = 0;
 	rdpUpdate* update;
 	rdpContext* context;
@@ -382,8 +398,9 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 
 	if (settings->RemoteFxCodec)
 	{
+		int count;
 		RFX_RECT rect;
-		RFX_MESSAGE* messages;
+		RFX_MESSAGE* message;
 
 		shadow_encoder_prepare(encoder, FREERDP_CODEC_REMOTEFX);
 
@@ -394,9 +411,11 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 		rect.width = nWidth;
 		rect.height = nHeight;
 
-		messages = rfx_encode_messages(encoder->rfx, &rect, 1, pSrcData,
-				surface->width, surface->height, nSrcStep, &numMessages,
-				settings->MultifragMaxRequestSize);
+		message = rfx_encode_frame(encoder->rfx, &rect, 1, pSrcData,
+				surface->width, surface->height, nSrcStep);
+
+		if (!message)
+			return -1;
 
 		cmd.codecID = settings->RemoteFxCodecId;
 
@@ -409,25 +428,36 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 		cmd.width = surface->width;
 		cmd.height = surface->height;
 
-		for (i = 0; i < numMessages; i++)
+		/* unchanged tiles are skipped, an empty frame still has to be acknowledged */
+
+		if (!message->numTiles && encoder->frameAck)
+		{
+			shadow_client_send_surface_frame_marker(client, SURFACECMD_FRAMEACTION_BEGIN, frameId);
+			shadow_client_send_surface_frame_marker(client, SURFACECMD_FRAMEACTION_END, frameId);
+		}
+
+		/* the frame is split into messages while writing, no copies of the tiles are made */
+
+		for (i = 0; i < message->numTiles; i += count)
 		{
 			Stream_SetPosition(s, 0);
-			rfx_write_message(encoder->rfx, s, &messages[i]);
-			rfx_message_free(encoder->rfx, &messages[i]);
+			count = rfx_write_message_fragment(encoder->rfx, s, message, i,
+					settings->MultifragMaxRequestSize);
+
+			if (count < 1)
+				break;
 
 			cmd.bitmapDataLength = Stream_GetPosition(s);
 			cmd.bitmapData = Stream_Buffer(s);
 
 			first = (i == 0) ? TRUE : FALSE;
-			last = ((i + 1) == numMessages) ? TRUE : FALSE;
+			last = ((i + count) >= message->numTiles) ? TRUE : FALSE;
 
 			if (!encoder->frameAck)
 				IFCALL(update->SurfaceBits, update->context, &cmd);
 			else
 				IFCALL(update->SurfaceFrameBits, update->context, &cmd, first, last, frameId);
 		}
-
-		free(messages);
 	}
 	else if (settings->NSCodec)
 	{
@@ -897,6 +927,78 @@ int shadow_client_subsystem_process_message(rdpShadowClient* client, wMessage* m
 	return 1;
 }
 
+static BOOL shadow_client_check_channels(freerdp_peer* peer, HANDLE event, void* param)
+{
+	rdpShadowClient* client = (rdpShadowClient*) peer->context;
+
+	if (!WTSVirtualChannelManagerCheckFileDescriptor(client->vcm))
+	{
+		WLog_ERR(TAG, "WTSVirtualChannelManagerCheckFileDescriptor failure");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL shadow_client_check_messages(freerdp_peer* peer, HANDLE event, void* param)
+{
+	wMessage message;
+	wMessageQueue* queue = (wMessageQueue*) param;
+	rdpShadowClient* client = (rdpShadowClient*) peer->context;
+
+	if (MessageQueue_Peek(queue, &message, TRUE))
+	{
+		if (message.id == WMQ_QUIT)
+			return FALSE;
+
+		shadow_client_subsystem_process_message(client, &message);
+	}
+
+	return TRUE;
+}
+
+/**
+ * The channel and subsystem events are watched from the first callback of
+ * the peer on, so that a failing peer cannot be freed while registering them.
+ */
+
+static BOOL shadow_client_reactor_add_events(rdpShadowClient* client)
+{
+	freerdp_peer* peer = ((rdpContext*) client)->peer;
+	rdpPeerReactor* reactor = client->server->reactor;
+	wMessagePipe* MsgPipe = client->subsystem->MsgPipe;
+
+	if (client->reactorEvents)
+		return TRUE;
+
+	if (!freerdp_peer_reactor_add_event(reactor, peer, WTSVirtualChannelManagerGetEventHandle(client->vcm),
+			shadow_client_check_channels, NULL))
+		return FALSE;
+
+	if (!freerdp_peer_reactor_add_event(reactor, peer, MessageQueue_Event(MsgPipe->Out),
+			shadow_client_check_messages, (void*) MsgPipe->Out))
+		return FALSE;
+
+	client->reactorEvents = TRUE;
+
+	return TRUE;
+}
+
+static void shadow_client_init_peer(freerdp_peer* peer)
+{
+	peer->Capabilities = shadow_client_capabilities;
+	peer->PostConnect = shadow_client_post_connect;
+	peer->Activate = shadow_client_activate;
+
+	shadow_input_register_callbacks(peer->input);
+
+	peer->Initialize(peer);
+
+	peer->update->RefreshRect = (pRefreshRect) shadow_client_refresh_rect;
+	peer->update->SuppressOutput = (pSuppressOutput) shadow_client_suppress_output;
+	peer->update->SurfaceFrameAcknowledge = (pSurfaceFrameAcknowledge) shadow_client_surface_frame_acknowledge;
+}
+
 void* shadow_client_thread(rdpShadowClient* client)
 {
 	DWORD status;
@@ -925,17 +1027,7 @@ void* shadow_client_thread(rdpShadowClient* client)
 	peer = context->peer;
 	settings = peer->settings;
 
-	peer->Capabilities = shadow_client_capabilities;
-	peer->PostConnect = shadow_client_post_connect;
-	peer->Activate = shadow_client_activate;
-
-	shadow_input_register_callbacks(peer->input);
-
-	peer->Initialize(peer);
-
-	peer->update->RefreshRect = (pRefreshRect) shadow_client_refresh_rect;
-	peer->update->SuppressOutput = (pSuppressOutput) shadow_client_suppress_output;
-	peer->update->SurfaceFrameAcknowledge = (pSurfaceFrameAcknowledge) shadow_client_surface_frame_acknowledge;
+	shadow_client_init_peer(peer);
 
 	StopEvent = client->StopEvent;
 	UpdateEvent = subsystem->updateEvent;
@@ -1041,6 +1133,60 @@ void shadow_client_accepted(freerdp_listener* listener, freerdp_peer* peer)
 
 	client = (rdpShadowClient*) peer->context;
 
+	if (server->reactor)
+	{
+		shadow_client_init_peer(peer);
+
+		if (!freerdp_peer_reactor_add(server->reactor, peer))
+		{
+			WLog_ERR(TAG, "failed to add client to the peer reactor");
+			freerdp_peer_context_free(peer);
+			freerdp_peer_free(peer);
+		}
+
+		return;
+	}
+
 	client->thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)
 			shadow_client_thread, client, 0, NULL);
 }
+
+static BOOL shadow_client_encode_update(freerdp_peer* peer, void* param)
+{
+	rdpShadowClient* client;
+	rdpShadowSubsystem* subsystem = (rdpShadowSubsystem*) param;
+
+	/* the client went away before its turn came */
+
+	if (!peer)
+		return TRUE;
+
+	client = (rdpShadowClient*) peer->context;
+
+	if (client->activated)
+	{
+		shadow_client_surface_update(client, &(subsystem->invalidRegion));
+		shadow_client_send_surface_update(client);
+	}
+
+	return TRUE;
+}
+
+/**
+ * Encodes the pending update for every client of the peer reactor on its
+ * thread pool, and returns once all of them are done reading the surface.
+ */
+
+void shadow_client_reactor_update(rdpShadowServer* server)
+{
+	if (freerdp_peer_reactor_submit_all(server->reactor, shadow_client_encode_update, server->subsystem) > 0)
+		freerdp_peer_reactor_wait_for_work(server->reactor);
+}
+
+void shadow_client_reactor_closed(rdpPeerReactor* reactor, freerdp_peer* peer, void* param)
+{
+	peer->Disconnect(peer);
+
+	freerdp_peer_context_free(peer);
+	freerdp_peer_free(peer);
+}
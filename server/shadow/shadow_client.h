@@ -28,6 +28,9 @@ extern "C" {
 int shadow_client_surface_update(rdpShadowClient* client, REGION16* region);
 void shadow_client_accepted(freerdp_listener* instance, freerdp_peer* client);
 
+void shadow_client_reactor_update(rdpShadowServer* server);
+void shadow_client_reactor_closed(rdpPeerReactor* reactor, freerdp_peer* client, void* param);
+
 #ifdef __cplusplus
 }
 #endif
@@ -128,6 +128,7 @@ int shadow_encoder_init_rfx(rdpShadowEncoder* encoder)
 	encoder->rfx->height = encoder->height;
 
 	rfx_context_set_pixel_format(encoder->rfx, RDP_PIXEL_FORMAT_B8G8R8A8);
+	rfx_context_set_change_detection(encoder->rfx, TRUE);
 
 	if (!encoder->frameList)
 	{
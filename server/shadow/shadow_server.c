@@ -50,6 +50,7 @@ static COMMAND_LINE_ARGUMENT_A shadow_args[] =
 	{ "auth", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL, "Clients must authenticate" },
 	{ "may-view", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "Clients may view without prompt" },
 	{ "may-interact", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "Clients may interact without prompt" },
+	{ "reactor", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL, "Serve clients from shared I/O workers and encode on a thread pool" },
 	{ "version", COMMAND_LINE_VALUE_FLAG | COMMAND_LINE_PRINT_VERSION, NULL, NULL, NULL, -1, NULL, "Print version" },
 	{ "help", COMMAND_LINE_VALUE_FLAG | COMMAND_LINE_PRINT_HELP, NULL, NULL, NULL, -1, "?", "Print help" },
 	{ NULL, 0, NULL, NULL, NULL, -1, NULL, NULL }
@@ -237,6 +238,10 @@ int shadow_server_parse_command_line(rdpShadowServer* server, int argc, char** a
 		{
 			server->authentication = arg->Value ? TRUE : FALSE;
 		}
+		CommandLineSwitchCase(arg, "reactor")
+		{
+			server->useReactor = arg->Value ? TRUE : FALSE;
+		}
 		CommandLineSwitchDefault(arg)
 		{
 
@@ -350,6 +355,48 @@ void* shadow_server_thread(rdpShadowServer* server)
 	return NULL;
 }
 
+/**
+ * With the peer reactor, this thread enters the update barrier on behalf of
+ * all the clients once their encoding work has completed on the thread pool.
+ */
+
+void* shadow_server_frame_thread(rdpShadowServer* server)
+{
+	HANDLE events[2];
+	rdpShadowSubsystem* subsystem = server->subsystem;
+
+	events[0] = server->StopEvent;
+	events[1] = subsystem->updateEvent;
+
+	while (1)
+	{
+		WaitForMultipleObjects(2, events, FALSE, INFINITE);
+
+		if (WaitForSingleObject(server->StopEvent, 0) == WAIT_OBJECT_0)
+		{
+			if (WaitForSingleObject(subsystem->updateEvent, 0) == WAIT_OBJECT_0)
+			{
+				EnterSynchronizationBarrier(&(subsystem->barrier), 0);
+			}
+
+			break;
+		}
+
+		if (WaitForSingleObject(subsystem->updateEvent, 0) == WAIT_OBJECT_0)
+		{
+			shadow_client_reactor_update(server);
+
+			EnterSynchronizationBarrier(&(subsystem->barrier), 0);
+
+			while (WaitForSingleObject(subsystem->updateEvent, 0) == WAIT_OBJECT_0);
+		}
+	}
+
+	ExitThread(0);
+
+	return NULL;
+}
+
 int shadow_server_start(rdpShadowServer* server)
 {
 	BOOL status;
@@ -372,6 +419,20 @@ int shadow_server_start(rdpShadowServer* server)
 	if (!server->capture)
 		return -1;
 
+	if (server->useReactor)
+	{
+		server->reactor = freerdp_peer_reactor_new(0, shadow_client_reactor_closed, (void*) server);
+
+		if (!server->reactor)
+			return -1;
+
+		server->frameThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)
+				shadow_server_frame_thread, (void*) server, 0, NULL);
+
+		if (!server->frameThread)
+			return -1;
+	}
+
 	if (!server->ipcSocket)
 		status = server->listener->Open(server->listener, NULL, (UINT16) server->port);
 	else
@@ -398,6 +459,20 @@ int shadow_server_stop(rdpShadowServer* server)
 		server->listener->Close(server->listener);
 	}
 
+	if (server->frameThread)
+	{
+		SetEvent(server->StopEvent);
+		WaitForSingleObject(server->frameThread, INFINITE);
+		CloseHandle(server->frameThread);
+		server->frameThread = NULL;
+	}
+
+	if (server->reactor)
+	{
+		freerdp_peer_reactor_free(server->reactor);
+		server->reactor = NULL;
+	}
+
 	if (server->screen)
 	{
 		shadow_screen_free(server->screen);
@@ -195,6 +195,19 @@ int shadow_subsystem_stop(rdpShadowSubsystem* subsystem)
 	return status;
 }
 
+/**
+ * Number of threads entering the update barrier besides the subsystem: one
+ * per client thread, or the frame thread when the peer reactor is used.
+ */
+
+int shadow_subsystem_get_barrier_count(rdpShadowSubsystem* subsystem, int count)
+{
+	if (subsystem->server && subsystem->server->reactor)
+		return 1;
+
+	return count;
+}
+
 int shadow_enum_monitors(MONITOR_DEF* monitors, int maxMonitors, const char* name)
 {
 	int numMonitors = 0;
@@ -1126,6 +1126,8 @@ WINSCARDAPI const char* WINAPI SCardGetScopeString(DWORD dwScope);
 WINSCARDAPI const char* WINAPI SCardGetCardStateString(DWORD dwCardState);
 WINSCARDAPI char* WINAPI SCardGetReaderStateString(DWORD dwReaderState);
 
+WINSCARDAPI BOOL WINAPI SCardRegisterSCardApiFunctionTable(PSCardApiFunctionTable table);
+
 #ifdef __cplusplus
 }
 #endif
@@ -997,6 +997,18 @@ WINSCARDAPI char* WINAPI SCardGetReaderStateString(DWORD dwReaderState)
 	return szReaderState;
 }
 
+/**
+ * Replaces the smart card backend, mostly useful to run
+ * the smart card redirection against a stand-in in tests.
+ */
+
+BOOL WINAPI SCardRegisterSCardApiFunctionTable(PSCardApiFunctionTable table)
+{
+	g_SCardApi = table;
+	g_Initialized = TRUE;
+	return TRUE;
+}
+
 void InitializeSCardApiStubs(void)
 {
 	g_Initialized = TRUE;